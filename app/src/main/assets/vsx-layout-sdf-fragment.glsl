@@ -0,0 +1,38 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#version 100
+
+precision mediump float;
+
+varying vec2 tex_coord;
+
+uniform sampler2D tex;
+uniform vec3 color;
+/* Half of the change in distance value across one pixel */
+uniform float smoothing;
+
+void
+main()
+{
+        float distance = texture2D(tex, tex_coord).a;
+        float alpha = smoothstep(0.5 - smoothing,
+                                 0.5 + smoothing,
+                                 distance);
+
+        gl_FragColor = vec4(color, alpha);
+}
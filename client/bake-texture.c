@@ -0,0 +1,100 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Converts a .mpng image into a baked texture so that the client can
+ * upload it without having to decode the PNG at startup.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define STB_IMAGE_IMPLEMENTATION 1
+#define STBI_NO_HDR
+#include "stb_image.h"
+
+#include "vsx-baked-texture.h"
+
+static bool
+write_file(const char *filename,
+           const struct vsx_buffer *buffer)
+{
+        FILE *out = fopen(filename, "wb");
+
+        if (out == NULL) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                return false;
+        }
+
+        bool ret = true;
+
+        if (fwrite(buffer->data, 1, buffer->length, out) != buffer->length) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                ret = false;
+        }
+
+        if (fclose(out) == EOF) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                ret = false;
+        }
+
+        return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+        if (argc != 3) {
+                fprintf(stderr, "usage: bake-texture <in.mpng> <out.vtex>\n");
+                return EXIT_FAILURE;
+        }
+
+        struct vsx_image image = { .baked_asset = NULL };
+
+        image.data = stbi_load(argv[1],
+                               &image.width,
+                               &image.height,
+                               &image.components,
+                               0 /* req_comp */);
+
+        if (image.data == NULL) {
+                fprintf(stderr,
+                        "%s: %s\n",
+                        argv[1],
+                        stbi_failure_reason());
+                return EXIT_FAILURE;
+        }
+
+        struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+
+        vsx_baked_texture_bake(&image, &buffer);
+
+        stbi_image_free(image.data);
+
+        int ret = EXIT_SUCCESS;
+
+        if (!write_file(argv[2], &buffer))
+                ret = EXIT_FAILURE;
+
+        vsx_buffer_destroy(&buffer);
+
+        return ret;
+}
@@ -0,0 +1,173 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vsx-baked-texture.h"
+#include "vsx-util.h"
+
+/* Size of the first mipmap level. The rows of the smaller levels
+ * need padding with three components.
+ */
+#define WIDTH 8
+#define HEIGHT 4
+#define COMPONENTS 3
+
+/* Position of each mipmap level in the .mpng image */
+static const struct {
+        int x, y;
+        int width, height;
+} levels[] = {
+        { 0, 0, 8, 4 },
+        { 0, 4, 4, 2 },
+        { 4, 4, 2, 1 },
+        { 4, 5, 1, 1 },
+};
+
+#define MPNG_WIDTH WIDTH
+#define MPNG_HEIGHT (HEIGHT * 3 / 2)
+
+static uint8_t
+get_pixel_value(int x, int y, int component)
+{
+        return (y * MPNG_WIDTH + x) * COMPONENTS + component + 1;
+}
+
+static void
+make_image(struct vsx_image *image)
+{
+        image->width = MPNG_WIDTH;
+        image->height = MPNG_HEIGHT;
+        image->components = COMPONENTS;
+        image->data = vsx_alloc(MPNG_WIDTH * MPNG_HEIGHT * COMPONENTS);
+        image->baked_asset = NULL;
+
+        uint8_t *p = image->data;
+
+        for (int y = 0; y < MPNG_HEIGHT; y++) {
+                for (int x = 0; x < MPNG_WIDTH; x++) {
+                        for (int c = 0; c < COMPONENTS; c++)
+                                *(p++) = get_pixel_value(x, y, c);
+                }
+        }
+}
+
+static void
+check_levels(const struct vsx_baked_texture *texture)
+{
+        assert(texture->width == WIDTH);
+        assert(texture->height == HEIGHT);
+        assert(texture->components == COMPONENTS);
+
+        const uint8_t *data = texture->data;
+
+        for (int i = 0; i < VSX_N_ELEMENTS(levels); i++) {
+                size_t stride =
+                        vsx_baked_texture_get_stride(levels[i].width,
+                                                     COMPONENTS);
+
+                assert(stride % 4 == 0);
+
+                for (int y = 0; y < levels[i].height; y++) {
+                        for (int x = 0; x < levels[i].width; x++) {
+                                for (int c = 0; c < COMPONENTS; c++) {
+                                        int value = get_pixel_value(
+                                                levels[i].x + x,
+                                                levels[i].y + y,
+                                                c);
+                                        int offset = (y * stride +
+                                                      x * COMPONENTS +
+                                                      c);
+                                        assert(data[offset] == value);
+                                }
+                        }
+                }
+
+                data += stride * levels[i].height;
+        }
+}
+
+static void
+check_invalid(const uint8_t *data,
+              size_t size)
+{
+        struct vsx_baked_texture texture;
+        struct vsx_error *error = NULL;
+
+        assert(!vsx_baked_texture_parse(&texture, data, size, &error));
+        assert(error);
+        assert(error->domain == &vsx_baked_texture_error);
+        assert(error->code == VSX_BAKED_TEXTURE_ERROR_INVALID);
+
+        vsx_error_free(error);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct vsx_image image;
+
+        make_image(&image);
+
+        struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+
+        vsx_baked_texture_bake(&image, &buffer);
+
+        vsx_free(image.data);
+
+        assert(vsx_baked_texture_is_baked(buffer.data, buffer.length));
+        assert(!vsx_baked_texture_is_baked((const uint8_t *) "\x89PNG", 4));
+
+        struct vsx_baked_texture texture;
+        struct vsx_error *error = NULL;
+
+        assert(vsx_baked_texture_parse(&texture,
+                                       buffer.data,
+                                       buffer.length,
+                                       &error));
+        assert(error == NULL);
+        assert(texture.data == buffer.data + VSX_BAKED_TEXTURE_HEADER_SIZE);
+
+        check_levels(&texture);
+
+        /* Truncated */
+        check_invalid(buffer.data, buffer.length - 1);
+        check_invalid(buffer.data, VSX_BAKED_TEXTURE_HEADER_SIZE - 1);
+
+        /* Trailing data */
+        vsx_buffer_append_c(&buffer, 0);
+        check_invalid(buffer.data, buffer.length);
+        buffer.length--;
+
+        /* Bad number of components */
+        buffer.data[VSX_BAKED_TEXTURE_MAGIC_SIZE + 8] = 5;
+        check_invalid(buffer.data, buffer.length);
+        buffer.data[VSX_BAKED_TEXTURE_MAGIC_SIZE + 8] = COMPONENTS;
+
+        /* Bad magic */
+        buffer.data[0] = 'X';
+        check_invalid(buffer.data, buffer.length);
+
+        vsx_buffer_destroy(&buffer);
+
+        return EXIT_SUCCESS;
+}
@@ -1851,6 +1851,129 @@ out:
         return ret;
 }
 
+static bool
+send_compact_tile(struct harness *harness,
+                  uint8_t dx,
+                  uint8_t dy,
+                  int expected_x,
+                  int expected_y)
+{
+        uint8_t add_tile_message[] =
+                "\x82\x08\x07\x03\x00\x00\x00g\x00\x00";
+
+        /* The positions are zigzag-encoded varints. These are only
+         * single bytes so the caller can pass the encoded values.
+         */
+        add_tile_message[5] = dx;
+        add_tile_message[6] = dy;
+
+        struct send_tile_closure closure = {
+                .num = 0,
+                .x = expected_x,
+                .y = expected_y,
+                .letter = 'g',
+        };
+
+        return check_event(harness,
+                           VSX_CONNECTION_EVENT_TYPE_TILE_CHANGED,
+                           check_tile_changed_cb,
+                           add_tile_message,
+                           sizeof add_tile_message - 1,
+                           &closure);
+}
+
+static bool
+check_compact_protocol(struct harness *harness)
+{
+        static const uint8_t ws_request[] =
+                "GET / HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Protocol: " VSX_PROTO_V2_NAME "\r\n"
+                "\r\n";
+
+        if (!expect_data(harness, ws_request, sizeof ws_request - 1))
+                return false;
+
+        /* Nothing after the header should be sent until the server
+         * has replied.
+         */
+        vsx_connection_move_tile(harness->connection, 0, 3, -2);
+
+        if (!read_new_player_request(harness))
+                return false;
+
+        if (!wake_up_connection(harness))
+                return false;
+
+        if (fd_ready_for_read(harness->server_fd)) {
+                fprintf(stderr,
+                        "Connection sent data before the WebSocket "
+                        "response\n");
+                return false;
+        }
+
+        if (!write_string(harness,
+                          "HTTP/1.1 101 Switching Protocols\r\n"
+                          "SEC-WEBSOCKET-PROTOCOL: " VSX_PROTO_V2_NAME "\r\n"
+                          "\r\n"))
+                return false;
+
+        /* The tile positions are relative to the last one received */
+        if (!send_compact_tile(harness,
+                               0x0a, 0x0b, /* 5, -6 */
+                               5, -6) ||
+            !send_compact_tile(harness,
+                               0x02, 0x04, /* 1, 2 */
+                               6, -4))
+                return false;
+
+        /* The move is relative to 0,0 */
+        static const uint8_t first_move[] =
+                "\x82\x05\x04\x88\x00\x06\x03";
+
+        if (!expect_data(harness, first_move, sizeof first_move - 1))
+                return false;
+
+        /* Both commands should be packed into one frame */
+        vsx_connection_move_tile(harness->connection, 0, 4, -2);
+        vsx_connection_turn(harness->connection);
+
+        static const uint8_t packed_commands[] =
+                "\x82\x07"
+                "\x01\x89"
+                "\x04\x88\x00\x02\x00";
+
+        if (!expect_data(harness,
+                         packed_commands,
+                         sizeof packed_commands - 1))
+                return false;
+
+        return true;
+}
+
+static bool
+test_compact_protocol(void)
+{
+        struct harness *harness = create_harness_no_start();
+
+        if (harness == NULL)
+                return false;
+
+        bool ret = true;
+
+        vsx_connection_set_compact_protocol(harness->connection, true);
+
+        if (!start_connection(harness) ||
+            !check_compact_protocol(harness))
+                ret = false;
+
+        free_harness(harness);
+
+        return ret;
+}
+
 static bool
 test_set_n_tiles(void)
 {
@@ -3127,6 +3250,9 @@ main(int argc, char **argv)
         if (!test_move_tile())
                 ret = EXIT_FAILURE;
 
+        if (!test_compact_protocol())
+                ret = EXIT_FAILURE;
+
         if (!test_set_n_tiles())
                 ret = EXIT_FAILURE;
 
@@ -0,0 +1,178 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vsx-frame-scheduler.h"
+#include "vsx-util.h"
+
+#define REFRESH_INTERVAL 10000
+
+static const char * const
+painter_names[] = {
+        "first",
+        "second",
+};
+
+#define N_PAINTERS VSX_N_ELEMENTS(painter_names)
+
+static void
+paint_frame(struct vsx_frame_scheduler *sched,
+            int64_t start,
+            int64_t end,
+            unsigned n_draw_calls)
+{
+        int64_t painter_times[N_PAINTERS] = { start, end };
+
+        vsx_frame_scheduler_begin_frame(sched, start);
+        vsx_frame_scheduler_end_frame(sched,
+                                      end,
+                                      n_draw_calls,
+                                      painter_times);
+}
+
+static void
+test_pacing(void)
+{
+        struct vsx_frame_scheduler *sched =
+                vsx_frame_scheduler_new(N_PAINTERS, painter_names);
+
+        vsx_frame_scheduler_set_refresh_interval(sched, REFRESH_INTERVAL);
+
+        /* Nothing to paint yet */
+        assert(vsx_frame_scheduler_get_delay(sched, 0) == -1);
+
+        /* The first frame can be painted straight away */
+        vsx_frame_scheduler_queue_redraw(sched);
+        assert(vsx_frame_scheduler_get_delay(sched, 1000) == 0);
+        paint_frame(sched, 1000, 2000, 1);
+
+        assert(vsx_frame_scheduler_get_delay(sched, 2000) == -1);
+
+        /* Several redraws only need one frame and it has to wait for
+         * the next refresh.
+         */
+        vsx_frame_scheduler_queue_redraw(sched);
+        vsx_frame_scheduler_queue_redraw(sched);
+        assert(vsx_frame_scheduler_get_delay(sched, 3000) ==
+               REFRESH_INTERVAL - 2000);
+        assert(vsx_frame_scheduler_get_delay(sched, 1000 + REFRESH_INTERVAL)
+               == 0);
+        assert(vsx_frame_scheduler_get_delay(sched, 5000 + REFRESH_INTERVAL)
+               == 0);
+
+        paint_frame(sched,
+                    5000 + REFRESH_INTERVAL,
+                    6000 + REFRESH_INTERVAL,
+                    2);
+
+        assert(vsx_frame_scheduler_get_delay(sched, 0) == -1);
+
+        /* A redraw queued while painting causes another frame */
+        vsx_frame_scheduler_begin_frame(sched, 100000);
+        vsx_frame_scheduler_queue_redraw(sched);
+        vsx_frame_scheduler_end_frame(sched,
+                                      100500,
+                                      3,
+                                      (int64_t[]) { 1, 2 });
+        assert(vsx_frame_scheduler_get_delay(sched, 100500) ==
+               REFRESH_INTERVAL - 500);
+
+        assert(vsx_frame_scheduler_get_n_frames(sched) == 3);
+
+        const struct vsx_frame_scheduler_frame *frame =
+                vsx_frame_scheduler_get_frame(sched, 0);
+        assert(frame->interval == -1);
+        assert(frame->paint_time == 1000);
+        assert(frame->n_draw_calls == 1);
+        assert(frame->painter_times[0] == 1000);
+        assert(frame->painter_times[1] == 2000);
+
+        frame = vsx_frame_scheduler_get_frame(sched, 1);
+        assert(frame->interval == 4000 + REFRESH_INTERVAL);
+        assert(frame->n_draw_calls == 2);
+
+        frame = vsx_frame_scheduler_get_frame(sched, 2);
+        assert(frame->interval == 95000 - REFRESH_INTERVAL);
+        assert(frame->paint_time == 500);
+
+        vsx_frame_scheduler_free(sched);
+}
+
+static void
+test_history(void)
+{
+        struct vsx_frame_scheduler *sched =
+                vsx_frame_scheduler_new(N_PAINTERS, painter_names);
+
+        int n_frames = VSX_FRAME_SCHEDULER_HISTORY_SIZE + 10;
+
+        for (int i = 0; i < n_frames; i++)
+                paint_frame(sched, i * 100, i * 100 + 1, i);
+
+        /* Only the most recent frames should be kept */
+        assert(vsx_frame_scheduler_get_n_frames(sched) ==
+               VSX_FRAME_SCHEDULER_HISTORY_SIZE);
+
+        for (int i = 0; i < VSX_FRAME_SCHEDULER_HISTORY_SIZE; i++) {
+                const struct vsx_frame_scheduler_frame *frame =
+                        vsx_frame_scheduler_get_frame(sched, i);
+
+                assert(frame->n_draw_calls == i + 10);
+                assert(frame->interval == 100);
+        }
+
+        struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+
+        vsx_frame_scheduler_dump(sched, &buf);
+        vsx_buffer_append_c(&buf, '\0');
+
+        const char *text = (const char *) buf.data;
+
+        assert(!strncmp(text,
+                        "interval paint draws first second\n"
+                        "100 1 10 1000 1001\n",
+                        strlen("interval paint draws first second\n"
+                               "100 1 10 1000 1001\n")));
+
+        int n_lines = 0;
+
+        for (const char *p = text; *p; p++) {
+                if (*p == '\n')
+                        n_lines++;
+        }
+
+        assert(n_lines == VSX_FRAME_SCHEDULER_HISTORY_SIZE + 1);
+
+        vsx_buffer_destroy(&buf);
+
+        vsx_frame_scheduler_free(sched);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_pacing();
+        test_history();
+
+        return EXIT_SUCCESS;
+}
@@ -37,6 +37,9 @@ main(int argc, char **argv)
                 assert(entry->hash_entry.id == i);
                 assert(added);
 
+                assert(vsx_glyph_hash_lookup(hash, i) == entry);
+                assert(vsx_glyph_hash_lookup(hash, i + 1) == NULL);
+
                 /* Fill in some test values so that we can recognise
                  * it when it comes back.
                  */
@@ -0,0 +1,347 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Packs the SDF glyphs needed for all of the UI strings in every
+ * language into an atlas with each of the packers and reports how
+ * much of the used space is covered by glyphs and how long it takes.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+
+#include "vsx-bsp.h"
+#include "vsx-font.h"
+#include "vsx-skyline.h"
+#include "vsx-text.h"
+#include "vsx-tile-texture.h"
+#include "vsx-utf8.h"
+#include "vsx-buffer.h"
+#include "vsx-util.h"
+#include "vsx-monotonic.h"
+
+/* This should match the font used for VSX_FONT_TYPE_LABEL */
+#define FONT_FILENAME "app/src/main/assets/LunaSans-Regular.ttf"
+#define ATLAS_SIZE 1024
+
+#define N_PACK_RUNS 200
+
+struct glyph_size {
+        int width, height;
+};
+
+struct packer {
+        const char *name;
+        void *(* new)(int width, int height);
+        bool (* add)(void *packer,
+                     int width, int height,
+                     int *x_out, int *y_out);
+        void (* free)(void *packer);
+};
+
+static void *
+bsp_new(int width, int height)
+{
+        return vsx_bsp_new(width, height);
+}
+
+static bool
+bsp_add(void *packer, int width, int height, int *x_out, int *y_out)
+{
+        return vsx_bsp_add(packer, width, height, x_out, y_out);
+}
+
+static void
+bsp_free(void *packer)
+{
+        vsx_bsp_free(packer);
+}
+
+static void *
+skyline_new(int width, int height)
+{
+        return vsx_skyline_new(width, height);
+}
+
+static bool
+skyline_add(void *packer, int width, int height, int *x_out, int *y_out)
+{
+        return vsx_skyline_add(packer, width, height, x_out, y_out);
+}
+
+static void
+skyline_free(void *packer)
+{
+        vsx_skyline_free(packer);
+}
+
+static const struct packer
+packers[] = {
+        { "bsp", bsp_new, bsp_add, bsp_free },
+        { "skyline", skyline_new, skyline_add, skyline_free },
+};
+
+static const int
+atlas_widths[] = { 256, 512, 1024 };
+
+static void
+add_letter(struct vsx_buffer *letters,
+           uint32_t letter)
+{
+        const uint32_t *data = (const uint32_t *) letters->data;
+        size_t n_letters = letters->length / sizeof *data;
+
+        for (unsigned i = 0; i < n_letters; i++) {
+                if (data[i] == letter)
+                        return;
+        }
+
+        vsx_buffer_append(letters, &letter, sizeof letter);
+}
+
+static void
+get_letters(struct vsx_buffer *letters)
+{
+        for (int lang = 0; lang < VSX_TEXT_N_LANGUAGES; lang++) {
+                for (int text = 0; text < VSX_TEXT_N_TEXTS; text++) {
+                        for (const char *p = vsx_text_get(lang, text);
+                             *p;
+                             p = vsx_utf8_next(p))
+                                add_letter(letters, vsx_utf8_get_char(p));
+                }
+        }
+
+        for (int i = 0; i < VSX_TILE_TEXTURE_N_LETTERS; i++)
+                add_letter(letters, vsx_tile_texture_letters[i].letter);
+}
+
+static void
+get_glyph_sizes(struct vsx_buffer *sizes)
+{
+        FT_Library library;
+        FT_Face face;
+        FT_Error error;
+
+        error = FT_Init_FreeType(&library);
+        assert(error == 0);
+
+        FT_UInt spread = VSX_FONT_SDF_SPREAD;
+        FT_Property_Set(library, "sdf", "spread", &spread);
+
+        error = FT_New_Face(library, FONT_FILENAME, 0, &face);
+        assert(error == 0);
+
+        error = FT_Set_Pixel_Sizes(face,
+                                   VSX_FONT_SDF_SIZE,
+                                   VSX_FONT_SDF_SIZE);
+        assert(error == 0);
+
+        struct vsx_buffer letters = VSX_BUFFER_STATIC_INIT;
+
+        get_letters(&letters);
+
+        const uint32_t *letter_data = (const uint32_t *) letters.data;
+        size_t n_letters = letters.length / sizeof *letter_data;
+
+        for (unsigned i = 0; i < n_letters; i++) {
+                FT_UInt glyph_index = FT_Get_Char_Index(face, letter_data[i]);
+
+                error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
+                assert(error == 0);
+
+                error = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF);
+                assert(error == 0);
+
+                const FT_Bitmap *bitmap = &face->glyph->bitmap;
+
+                /* Empty glyphs such as spaces don’t take any space */
+                if (bitmap->width <= 0 || bitmap->rows <= 0)
+                        continue;
+
+                struct glyph_size size = {
+                        .width = bitmap->width,
+                        .height = bitmap->rows,
+                };
+
+                vsx_buffer_append(sizes, &size, sizeof size);
+        }
+
+        vsx_buffer_destroy(&letters);
+
+        FT_Done_Face(face);
+        FT_Done_FreeType(library);
+}
+
+/* Packs all of the glyphs and returns the height of the used part of
+ * the atlas, or -1 if they don’t all fit. Also checks that none of
+ * the glyphs overlap.
+ */
+static int
+pack_glyphs(const struct packer *packer,
+            int atlas_width,
+            const struct glyph_size *sizes,
+            size_t n_sizes)
+{
+        uint8_t *used = vsx_calloc(atlas_width * ATLAS_SIZE);
+        void *p = packer->new(atlas_width, ATLAS_SIZE);
+        int used_height = 0;
+
+        for (unsigned i = 0; i < n_sizes; i++) {
+                int x, y;
+
+                bool ret = packer->add(p,
+                                       sizes[i].width,
+                                       sizes[i].height,
+                                       &x, &y);
+                if (!ret) {
+                        used_height = -1;
+                        break;
+                }
+
+                assert(x >= 0 && x + sizes[i].width <= atlas_width);
+                assert(y >= 0 && y + sizes[i].height <= ATLAS_SIZE);
+
+                for (int gy = y; gy < y + sizes[i].height; gy++) {
+                        uint8_t *row = used + gy * atlas_width;
+
+                        for (int gx = x; gx < x + sizes[i].width; gx++) {
+                                assert(!row[gx]);
+                                row[gx] = 1;
+                        }
+                }
+
+                used_height = MAX(used_height, y + sizes[i].height);
+        }
+
+        packer->free(p);
+        vsx_free(used);
+
+        return used_height;
+}
+
+static int64_t
+time_packing(const struct packer *packer,
+             int atlas_width,
+             const struct glyph_size *sizes,
+             size_t n_sizes)
+{
+        int64_t start = vsx_monotonic_get();
+
+        for (int run = 0; run < N_PACK_RUNS; run++) {
+                void *p = packer->new(atlas_width, ATLAS_SIZE);
+
+                for (unsigned i = 0; i < n_sizes; i++) {
+                        int x, y;
+
+                        packer->add(p, sizes[i].width, sizes[i].height,
+                                    &x, &y);
+                }
+
+                packer->free(p);
+        }
+
+        return (vsx_monotonic_get() - start) / N_PACK_RUNS;
+}
+
+int
+main(int argc, char **argv)
+{
+        if (chdir(VSX_SOURCE_ROOT)) {
+                fprintf(stderr, "%s: %s\n", VSX_SOURCE_ROOT, strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        struct vsx_buffer size_buf = VSX_BUFFER_STATIC_INIT;
+
+        get_glyph_sizes(&size_buf);
+
+        const struct glyph_size *sizes =
+                (const struct glyph_size *) size_buf.data;
+        size_t n_sizes = size_buf.length / sizeof *sizes;
+        int64_t glyph_area = 0;
+
+        for (unsigned i = 0; i < n_sizes; i++)
+                glyph_area += sizes[i].width * sizes[i].height;
+
+        assert(n_sizes > 0);
+
+        printf("%zu glyphs, %" PRIi64 " texels\n"
+               "packer   width  height  occupancy  time (µs)\n",
+               n_sizes,
+               glyph_area);
+
+        for (unsigned w = 0; w < VSX_N_ELEMENTS(atlas_widths); w++) {
+                int bsp_height = 0;
+
+                for (unsigned i = 0; i < VSX_N_ELEMENTS(packers); i++) {
+                        const struct packer *packer = packers + i;
+                        int atlas_width = atlas_widths[w];
+
+                        int used_height = pack_glyphs(packer,
+                                                      atlas_width,
+                                                      sizes,
+                                                      n_sizes);
+                        if (used_height == -1) {
+                                /* Only the BSP is allowed to run out
+                                 * of space.
+                                 */
+                                assert(packer->add == bsp_add);
+                                printf("%-8s %5i  doesn’t fit\n",
+                                       packer->name,
+                                       atlas_width);
+                                bsp_height = INT_MAX;
+                                continue;
+                        }
+
+                        int64_t pack_time = time_packing(packer,
+                                                         atlas_width,
+                                                         sizes,
+                                                         n_sizes);
+
+                        printf("%-8s %5i  %6i  %8.1f%%  %9" PRIi64 "\n",
+                               packer->name,
+                               atlas_width,
+                               used_height,
+                               glyph_area * 100.0 /
+                               (atlas_width * used_height),
+                               pack_time);
+
+                        /* The skyline is supposed to be the better
+                         * packer so it shouldn’t need more space.
+                         */
+                        if (packer->add == bsp_add)
+                                bsp_height = used_height;
+                        else
+                                assert(used_height <= bsp_height);
+                }
+        }
+
+        vsx_buffer_destroy(&size_buf);
+
+        return EXIT_SUCCESS;
+}
@@ -88,6 +88,7 @@ test_load_tiles(struct data *data)
         struct vsx_image_loader_token *token =
                 vsx_image_loader_load(data->loader,
                                       "tiles.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_NORMAL,
                                       test_load_tiles_cb,
                                       &tiles_data);
 
@@ -118,9 +119,9 @@ test_load_multiple_cb(const struct vsx_image *image,
         assert(image->height > 0);
         assert(image->components == 3);
         assert(pthread_self() == data->loading_thread);
-        assert(data->count < 3);
+        assert(data->count < VSX_IMAGE_LOADER_N_PRIORITIES);
 
-        if (++data->count >= 3)
+        if (++data->count >= VSX_IMAGE_LOADER_N_PRIORITIES)
                 data->finished = true;
 }
 
@@ -132,10 +133,12 @@ test_load_multiple(struct data *data)
                 .loading_thread = pthread_self(),
         };
 
-        for (int i = 0; i < 3; i++) {
+        /* Load the image once with each priority */
+        for (int i = 0; i < VSX_IMAGE_LOADER_N_PRIORITIES; i++) {
                 struct vsx_image_loader_token *token =
                         vsx_image_loader_load(data->loader,
                                               "tiles.mpng",
+                                              i,
                                               test_load_multiple_cb,
                                               &multiple_data);
 
@@ -180,6 +183,7 @@ test_error(struct data *data)
         struct vsx_image_loader_token *token =
                 vsx_image_loader_load(data->loader,
                                       "file-doesnt-exist.png",
+                                      VSX_IMAGE_LOADER_PRIORITY_NORMAL,
                                       test_error_cb,
                                       &error_data);
 
@@ -203,6 +207,7 @@ test_cancel(struct data *data,
         struct vsx_image_loader_token *token =
                 vsx_image_loader_load(data->loader,
                                       "tiles.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_NORMAL,
                                       test_cancel_cb,
                                       NULL);
 
@@ -262,6 +267,7 @@ test_free_while_loading(struct data *data)
         struct vsx_image_loader_token *token =
                 vsx_image_loader_load(loader,
                                       "tiles.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_NORMAL,
                                       test_free_while_loading_cb,
                                       NULL);
 
@@ -0,0 +1,139 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "vsx-layout-cache.h"
+#include "vsx-util.h"
+
+static void
+add_string(struct vsx_layout_cache *cache,
+           const void *font,
+           unsigned width,
+           const char *text)
+{
+        struct vsx_buffer *buf = vsx_layout_cache_add(cache,
+                                                      font,
+                                                      width,
+                                                      text);
+
+        assert(buf->length == 0);
+
+        vsx_buffer_append_string(buf, text);
+}
+
+static bool
+check_string(struct vsx_layout_cache *cache,
+             const void *font,
+             unsigned width,
+             const char *text)
+{
+        const struct vsx_buffer *buf = vsx_layout_cache_lookup(cache,
+                                                               font,
+                                                               width,
+                                                               text);
+
+        if (buf == NULL)
+                return false;
+
+        assert(buf->length == strlen(text));
+        assert(!memcmp(buf->data, text, buf->length));
+
+        return true;
+}
+
+static void
+test_keys(void)
+{
+        struct vsx_layout_cache *cache = vsx_layout_cache_new(16);
+        int font_a, font_b;
+
+        assert(!check_string(cache, &font_a, 10, "hello"));
+
+        add_string(cache, &font_a, 10, "hello");
+
+        assert(check_string(cache, &font_a, 10, "hello"));
+        /* Each part of the key should make a difference */
+        assert(!check_string(cache, &font_b, 10, "hello"));
+        assert(!check_string(cache, &font_a, 11, "hello"));
+        assert(!check_string(cache, &font_a, 10, "hellp"));
+        assert(!check_string(cache, &font_a, 10, ""));
+
+        add_string(cache, &font_b, 10, "hello");
+        add_string(cache, &font_a, 11, "hello");
+        add_string(cache, &font_a, 10, "");
+
+        assert(check_string(cache, &font_a, 10, "hello"));
+        assert(check_string(cache, &font_b, 10, "hello"));
+        assert(check_string(cache, &font_a, 11, "hello"));
+        assert(check_string(cache, &font_a, 10, ""));
+
+        vsx_layout_cache_free(cache);
+}
+
+static void
+test_eviction(void)
+{
+        struct vsx_layout_cache *cache = vsx_layout_cache_new(4);
+        int font;
+
+        for (unsigned i = 0; i < 4; i++)
+                add_string(cache, &font, i, "text");
+
+        /* Use the first one so that the second one is the oldest */
+        assert(check_string(cache, &font, 0, "text"));
+
+        add_string(cache, &font, 4, "text");
+
+        assert(check_string(cache, &font, 0, "text"));
+        assert(!check_string(cache, &font, 1, "text"));
+        assert(check_string(cache, &font, 2, "text"));
+        assert(check_string(cache, &font, 3, "text"));
+        assert(check_string(cache, &font, 4, "text"));
+
+        /* Add lots of entries to make the hash table grow */
+        for (unsigned i = 0; i < 100; i++) {
+                char text[16];
+
+                snprintf(text, sizeof text, "%u", i);
+                add_string(cache, &font, 0, text);
+        }
+
+        for (unsigned i = 0; i < 100; i++) {
+                char text[16];
+
+                snprintf(text, sizeof text, "%u", i);
+                assert(check_string(cache, &font, 0, text) == (i >= 96));
+        }
+
+        vsx_layout_cache_free(cache);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_keys();
+        test_eviction();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <limits.h>
+
+#include "vsx-skyline.h"
+
+static void
+test_exact_size(void)
+{
+        struct vsx_skyline *skyline = vsx_skyline_new(1024, 1024);
+        int x = INT_MAX, y = INT_MAX;
+
+        /* Try adding something too big */
+        assert(!vsx_skyline_add(skyline, 1025, 1024, &x, &y));
+        assert(!vsx_skyline_add(skyline, 1024, 1025, &x, &y));
+        /* Try adding something that has exactly the right size */
+        assert(vsx_skyline_add(skyline, 1024, 1024, &x, &y));
+        assert(x == 0);
+        assert(y == 0);
+        /* Nothing else can be added */
+        assert(!vsx_skyline_add(skyline, 1, 1, &x, &y));
+
+        vsx_skyline_free(skyline);
+}
+
+static void
+test_fill_small_squares(void)
+{
+        struct vsx_skyline *skyline = vsx_skyline_new(1024, 1024);
+        int x = INT_MAX, y = INT_MAX;
+
+        /* The squares should fill up the space row by row */
+        for (int j = 0; j < 32; j++) {
+                for (int i = 0; i < 32; i++) {
+                        assert(vsx_skyline_add(skyline, 32, 32, &x, &y));
+                        assert(x == i * 32);
+                        assert(y == j * 32);
+                }
+        }
+
+        /* Nothing else can be added */
+        assert(!vsx_skyline_add(skyline, 1, 1, &x, &y));
+
+        vsx_skyline_free(skyline);
+}
+
+static void
+test_fill_gaps(void)
+{
+        struct vsx_skyline *skyline = vsx_skyline_new(100, 100);
+        int x = INT_MAX, y = INT_MAX;
+
+        assert(vsx_skyline_add(skyline, 40, 50, &x, &y));
+        assert(x == 0 && y == 0);
+        assert(vsx_skyline_add(skyline, 40, 10, &x, &y));
+        assert(x == 40 && y == 0);
+        /* This is too wide to fit next to the others so it has to go
+         * above the short one.
+         */
+        assert(vsx_skyline_add(skyline, 30, 10, &x, &y));
+        assert(x == 40 && y == 10);
+        /* This fits in the space at the right */
+        assert(vsx_skyline_add(skyline, 20, 60, &x, &y));
+        assert(x == 80 && y == 0);
+        /* This is wider than any of the steps so it goes on top of
+         * the tallest one it spans.
+         */
+        assert(vsx_skyline_add(skyline, 70, 20, &x, &y));
+        assert(x == 0 && y == 50);
+        /* The remaining space is 100x30 at the top and a 10x40 gap
+         * between the last two.
+         */
+        assert(!vsx_skyline_add(skyline, 100, 31, &x, &y));
+        assert(vsx_skyline_add(skyline, 10, 40, &x, &y));
+        assert(x == 70 && y == 10);
+        assert(vsx_skyline_add(skyline, 100, 30, &x, &y));
+        assert(x == 0 && y == 70);
+        assert(!vsx_skyline_add(skyline, 1, 1, &x, &y));
+
+        vsx_skyline_free(skyline);
+}
+
+int
+main(int argc, char **argv)
+{
+        test_exact_size();
+        test_fill_small_squares();
+        test_fill_gaps();
+}
@@ -116,6 +116,26 @@ vsx_asset_remaining(struct vsx_asset *asset,
         return true;
 }
 
+const void *
+vsx_asset_map(struct vsx_asset *asset,
+              size_t *size_out,
+              struct vsx_error **error)
+{
+        /* If the file is stored uncompressed in the APK then this
+         * will map it directly.
+         */
+        const void *buffer = AAsset_getBuffer(asset->asset);
+
+        if (buffer == NULL) {
+                set_file_error(asset, error);
+                return NULL;
+        }
+
+        *size_out = AAsset_getLength(asset->asset);
+
+        return buffer;
+}
+
 void
 vsx_asset_close(struct vsx_asset *asset)
 {
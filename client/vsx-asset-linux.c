@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "vsx-util.h"
 
@@ -33,6 +35,8 @@ struct vsx_asset_manager {
 struct vsx_asset {
         char *filename;
         FILE *file;
+        void *map;
+        size_t map_size;
 };
 
 struct vsx_error_domain
@@ -120,9 +124,51 @@ vsx_asset_remaining(struct vsx_asset *asset,
         return true;
 }
 
+const void *
+vsx_asset_map(struct vsx_asset *asset,
+              size_t *size_out,
+              struct vsx_error **error)
+{
+        if (asset->map == NULL) {
+                struct stat statbuf;
+
+                if (fstat(fileno(asset->file), &statbuf) == -1) {
+                        set_file_error(asset, error);
+                        return NULL;
+                }
+
+                /* mmap can’t map an empty file */
+                if (statbuf.st_size <= 0) {
+                        *size_out = 0;
+                        return "";
+                }
+
+                void *map = mmap(NULL, /* addr */
+                                 statbuf.st_size,
+                                 PROT_READ,
+                                 MAP_PRIVATE,
+                                 fileno(asset->file),
+                                 0 /* offset */);
+
+                if (map == MAP_FAILED) {
+                        set_file_error(asset, error);
+                        return NULL;
+                }
+
+                asset->map = map;
+                asset->map_size = statbuf.st_size;
+        }
+
+        *size_out = asset->map_size;
+
+        return asset->map;
+}
+
 void
 vsx_asset_close(struct vsx_asset *asset)
 {
+        if (asset->map)
+                munmap(asset->map, asset->map_size);
         if (asset->file)
                 fclose(asset->file);
         vsx_free(asset->filename);
@@ -57,6 +57,16 @@ vsx_asset_remaining(struct vsx_asset *asset,
                     size_t *amount,
                     struct vsx_error **error);
 
+/* Maps the whole file into memory. The memory is read-only and stays
+ * valid until the asset is closed. It doesn’t affect the position
+ * used by vsx_asset_read. Can fail in which case it returns NULL and
+ * sets error.
+ */
+const void *
+vsx_asset_map(struct vsx_asset *asset,
+              size_t *size_out,
+              struct vsx_error **error);
+
 void
 vsx_asset_close(struct vsx_asset *asset);
 
@@ -0,0 +1,187 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-baked-texture.h"
+
+#include <string.h>
+
+#include "vsx-util.h"
+
+/* Refuse to load anything bigger than this so that the size
+ * calculations can’t overflow.
+ */
+#define VSX_BAKED_TEXTURE_MAX_SIZE 16384
+
+struct vsx_error_domain
+vsx_baked_texture_error;
+
+bool
+vsx_baked_texture_is_baked(const uint8_t *data,
+                           size_t size)
+{
+        return (size >= VSX_BAKED_TEXTURE_MAGIC_SIZE &&
+                !memcmp(data,
+                        VSX_BAKED_TEXTURE_MAGIC,
+                        VSX_BAKED_TEXTURE_MAGIC_SIZE));
+}
+
+size_t
+vsx_baked_texture_get_stride(int width,
+                             int components)
+{
+        return ((width * components) + 3) & ~(size_t) 3;
+}
+
+static size_t
+get_data_size(int width,
+              int height,
+              int components)
+{
+        size_t size = 0;
+
+        while (true) {
+                size += vsx_baked_texture_get_stride(width,
+                                                     components) * height;
+
+                if (width <= 1 && height <= 1)
+                        break;
+
+                width = MAX(1, width / 2);
+                height = MAX(1, height / 2);
+        }
+
+        return size;
+}
+
+static uint32_t
+read_uint32(const uint8_t *data)
+{
+        uint32_t value;
+
+        memcpy(&value, data, sizeof value);
+
+        return VSX_UINT32_FROM_LE(value);
+}
+
+bool
+vsx_baked_texture_parse(struct vsx_baked_texture *texture,
+                        const uint8_t *data,
+                        size_t size,
+                        struct vsx_error **error)
+{
+        if (size < VSX_BAKED_TEXTURE_HEADER_SIZE ||
+            !vsx_baked_texture_is_baked(data, size))
+                goto invalid;
+
+        const uint8_t *p = data + VSX_BAKED_TEXTURE_MAGIC_SIZE;
+        uint32_t width = read_uint32(p);
+        uint32_t height = read_uint32(p + 4);
+        uint32_t components = read_uint32(p + 8);
+
+        if (width < 1 || width > VSX_BAKED_TEXTURE_MAX_SIZE ||
+            height < 1 || height > VSX_BAKED_TEXTURE_MAX_SIZE ||
+            components < 1 || components > 4)
+                goto invalid;
+
+        if (get_data_size(width, height, components) !=
+            size - VSX_BAKED_TEXTURE_HEADER_SIZE)
+                goto invalid;
+
+        texture->width = width;
+        texture->height = height;
+        texture->components = components;
+        texture->data = data + VSX_BAKED_TEXTURE_HEADER_SIZE;
+
+        return true;
+
+invalid:
+        vsx_set_error(error,
+                      &vsx_baked_texture_error,
+                      VSX_BAKED_TEXTURE_ERROR_INVALID,
+                      "Invalid baked texture");
+        return false;
+}
+
+static void
+append_uint32(struct vsx_buffer *buffer,
+              uint32_t value)
+{
+        value = VSX_UINT32_TO_LE(value);
+        vsx_buffer_append(buffer, &value, sizeof value);
+}
+
+void
+vsx_baked_texture_bake(const struct vsx_image *image,
+                       struct vsx_buffer *buffer)
+{
+        int components = image->components;
+        size_t image_stride = image->width * components;
+        /* The image in the .mpng file is 1.5 times the height of the
+         * first mipmap level. The smaller levels are placed below it,
+         * alternating between going down and to the right.
+         */
+        int width = image->width;
+        int height = image->height * 2 / 3;
+        bool go_down = true;
+        int x = 0, y = 0;
+
+        vsx_buffer_append(buffer,
+                          VSX_BAKED_TEXTURE_MAGIC,
+                          VSX_BAKED_TEXTURE_MAGIC_SIZE);
+        append_uint32(buffer, width);
+        append_uint32(buffer, height);
+        append_uint32(buffer, components);
+
+        while (true) {
+                size_t stride =
+                        vsx_baked_texture_get_stride(width, components);
+
+                for (int row = 0; row < height; row++) {
+                        size_t old_length = buffer->length;
+
+                        vsx_buffer_set_length(buffer, old_length + stride);
+
+                        uint8_t *dst = buffer->data + old_length;
+
+                        memcpy(dst,
+                               image->data +
+                               (y + row) * image_stride +
+                               x * components,
+                               width * components);
+                        memset(dst + width * components,
+                               0,
+                               stride - width * components);
+                }
+
+                if (width <= 1 && height <= 1)
+                        break;
+
+                if (go_down) {
+                        y += height;
+                        go_down = false;
+                } else {
+                        x += width;
+                        go_down = true;
+                }
+
+                width = MAX(1, width / 2);
+                height = MAX(1, height / 2);
+        }
+}
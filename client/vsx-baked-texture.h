@@ -0,0 +1,81 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_BAKED_TEXTURE_H
+#define VSX_BAKED_TEXTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "vsx-error.h"
+#include "vsx-buffer.h"
+#include "vsx-image.h"
+
+/* A baked texture is a .mpng image converted at build time into a
+ * form that can be mapped and given straight to GL. The file starts
+ * with the magic string followed by the width, height and number of
+ * components of the largest mipmap level as 32-bit little-endian
+ * integers. After that come all of the mipmap levels one after the
+ * other, down to 1x1. Each row is padded to a multiple of 4 bytes to
+ * match the default GL_UNPACK_ALIGNMENT.
+ */
+
+#define VSX_BAKED_TEXTURE_MAGIC "VSXTEX01"
+#define VSX_BAKED_TEXTURE_MAGIC_SIZE ((sizeof VSX_BAKED_TEXTURE_MAGIC) - 1)
+#define VSX_BAKED_TEXTURE_HEADER_SIZE (VSX_BAKED_TEXTURE_MAGIC_SIZE + 3 * 4)
+
+#define VSX_BAKED_TEXTURE_EXTENSION ".vtex"
+
+extern struct vsx_error_domain
+vsx_baked_texture_error;
+
+enum vsx_baked_texture_error {
+        VSX_BAKED_TEXTURE_ERROR_INVALID,
+};
+
+struct vsx_baked_texture {
+        int width, height;
+        int components;
+        /* The data for the first mipmap level */
+        const uint8_t *data;
+};
+
+bool
+vsx_baked_texture_is_baked(const uint8_t *data,
+                           size_t size);
+
+bool
+vsx_baked_texture_parse(struct vsx_baked_texture *texture,
+                        const uint8_t *data,
+                        size_t size,
+                        struct vsx_error **error);
+
+/* Returns the number of bytes in a row of a mipmap level */
+size_t
+vsx_baked_texture_get_stride(int width,
+                             int components);
+
+/* Converts a decoded .mpng image to a baked texture and appends it
+ * to the buffer.
+ */
+void
+vsx_baked_texture_bake(const struct vsx_image *image,
+                       struct vsx_buffer *buffer);
+
+#endif /* VSX_BAKED_TEXTURE_H */
@@ -23,23 +23,18 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
-#include "vsx-map-buffer.h"
 #include "vsx-mipmap.h"
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
 #include "vsx-board.h"
 #include "vsx-layout.h"
 
 #define N_BOX_STYLES 4
 
-struct box_style_draw_command {
-        int offset;
-        int min_vertex, max_vertex;
-};
-
 struct box_draw_command {
-        struct box_style_draw_command styles[N_BOX_STYLES];
+        /* The index of the first quad for each style */
+        int first_quads[N_BOX_STYLES];
 };
 
 struct vsx_board_painter {
@@ -53,19 +48,15 @@ struct vsx_board_painter {
         struct vsx_layout_paint_position name_labels[VSX_BOARD_N_PLAYER_SPACES];
         bool name_label_positions_dirty;
 
-        struct vsx_array_object *vao;
-        GLuint vbo;
-        struct vsx_quad_tool_buffer *quad_buffer;
+        /* Quads for the board followed by the quads of each style
+         * of each player box.
+         */
+        struct vsx_quad_batch_vertex *vertices;
 
         GLuint tex;
         struct vsx_image_loader_token *image_token;
 };
 
-struct vertex {
-        int16_t x, y;
-        uint16_t s, t;
-};
-
 struct board_quad {
         int16_t x1, y1;
         int16_t x2, y2;
@@ -364,7 +355,6 @@ _Static_assert(VSX_N_ELEMENTS(player_boxes) == VSX_BOARD_N_PLAYER_SPACES,
                "of visible players");
 
 #define N_BOARD_QUADS VSX_N_ELEMENTS(board_quads)
-#define N_BOARD_VERTICES (N_BOARD_QUADS * 4)
 
 static void
 update_player_name(struct vsx_board_painter *painter,
@@ -447,17 +437,17 @@ texture_load_cb(const struct vsx_image *image,
 }
 
 static void
-generate_vertices(struct vertex *vertices,
+generate_vertices(struct vsx_quad_batch_vertex *vertices,
                   int corner_image,
                   const struct board_quad *quads,
                   size_t n_quads)
 {
-        struct vertex *v = vertices;
+        struct vsx_quad_batch_vertex *v = vertices;
 
-        uint16_t left = 149 * corner_image * 65535 / 512;
-        uint16_t right = (149 * corner_image + 64) * 65535 / 512;
-        uint16_t top = 0;
-        uint16_t bottom = 65535;
+        float left = 149 * corner_image / 512.0f;
+        float right = (149 * corner_image + 64) / 512.0f;
+        float top = 0.0f;
+        float bottom = 1.0f;
 
         for (int i = 0; i < n_quads; i++) {
                 const struct board_quad *quad = quads + i;
@@ -488,88 +478,39 @@ generate_vertices(struct vertex *vertices,
 }
 
 static void
-create_buffer(struct vsx_board_painter *painter)
+create_vertices(struct vsx_board_painter *painter)
 {
         size_t total_n_quads = N_BOARD_QUADS;
 
         for (int i = 0; i < VSX_N_ELEMENTS(player_boxes); i++)
                 total_n_quads += player_boxes[i].n_quads * N_BOX_STYLES;
 
-        size_t total_n_vertices = total_n_quads * 4;
+        struct vsx_quad_batch_vertex *vertices =
+                vsx_alloc(total_n_quads * 4 * sizeof *vertices);
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         total_n_vertices * sizeof (struct vertex),
-                         NULL, /* data */
-                         GL_STATIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_TEX_COORD,
-                                       2, /* size */
-                                       GL_UNSIGNED_SHORT,
-                                       true, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, s));
-
-        struct vertex *vertices =
-                vsx_map_buffer_map(painter->toolbox->map_buffer,
-                                   GL_ARRAY_BUFFER,
-                                   total_n_vertices * sizeof (struct vertex),
-                                   false, /* flush explicit */
-                                   GL_STATIC_DRAW);
-
-        struct vertex *v = vertices;
+        struct vsx_quad_batch_vertex *v = vertices;
 
         generate_vertices(v,
                           0, /* corner_image */
                           board_quads,
                           N_BOARD_QUADS);
-        v += N_BOARD_VERTICES;
+        v += N_BOARD_QUADS * 4;
 
         for (int player = 0; player < VSX_N_ELEMENTS(player_boxes); player++) {
                 const struct player_box *box = player_boxes + player;
+                struct box_draw_command *command =
+                        painter->box_draw_commands + player;
 
                 for (int style = 0; style < N_BOX_STYLES; style++) {
-                        struct box_style_draw_command *command =
-                                painter->box_draw_commands[player].styles +
-                                style;
-
-                        command->offset = ((v - vertices) * 6 / 4 *
-                                           sizeof (uint16_t));
-                        command->min_vertex = v - vertices;
-                        command->max_vertex = (v - vertices +
-                                               box->n_quads * 4 -
-                                               1);
-
+                        command->first_quads[style] = (v - vertices) / 4;
                         generate_vertices(v, style, box->quads, box->n_quads);
                         v += box->n_quads * 4;
                 }
         }
 
-        assert(v - vertices == total_n_vertices);
+        assert(v - vertices == total_n_quads * 4);
 
-        vsx_map_buffer_unmap(painter->toolbox->map_buffer);
-
-        painter->quad_buffer =
-                vsx_quad_tool_get_buffer(painter->toolbox->quad_tool,
-                                         painter->vao,
-                                         total_n_quads);
+        painter->vertices = vertices;
 }
 
 static void
@@ -599,12 +540,14 @@ create_cb(struct vsx_game_state *game_state,
                 label->layout = vsx_layout_new(toolbox);
         }
 
-        create_buffer(painter);
+        create_vertices(painter);
 
-        painter->image_token = vsx_image_loader_load(toolbox->image_loader,
-                                                     "board.mpng",
-                                                     texture_load_cb,
-                                                     painter);
+        painter->image_token =
+                vsx_image_loader_load(toolbox->image_loader,
+                                      "board.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_HIGH,
+                                      texture_load_cb,
+                                      painter);
 
         painter->modified_listener.notify = modified_cb;
         vsx_signal_add(vsx_game_state_get_modified_signal(game_state),
@@ -617,19 +560,25 @@ create_cb(struct vsx_game_state *game_state,
         return painter;
 }
 
+struct paint_box_closure {
+        struct vsx_board_painter *painter;
+        struct vsx_quad_batch_state state;
+};
+
 static void
 paint_box_cb(int player_num,
              const char *name,
              enum vsx_game_state_player_flag flags,
              void *user_data)
 {
-        struct vsx_board_painter *painter = user_data;
+        struct paint_box_closure *closure = user_data;
+        struct vsx_board_painter *painter = closure->painter;
 
         assert(player_num <= VSX_BOARD_N_PLAYER_SPACES);
 
         const struct box_draw_command *box =
                 painter->box_draw_commands + player_num;
-        const struct box_style_draw_command *style;
+        int style;
 
         int shouting_player =
                 vsx_game_state_get_shouting_player(painter->game_state);
@@ -638,32 +587,29 @@ paint_box_cb(int player_num,
                 painter->name_labels + player_num;
 
         if (name && *name && !(flags & VSX_GAME_STATE_PLAYER_FLAG_CONNECTED)) {
-                style = box->styles + 3;
+                style = 3;
 
                 label->r = 0.4f;
                 label->g = 0.4f;
                 label->b = 0.4f;
         } else {
                 if (player_num == shouting_player)
-                        style = box->styles + 2;
+                        style = 2;
                 else if ((flags & VSX_GAME_STATE_PLAYER_FLAG_NEXT_TURN))
-                        style = box->styles + 1;
+                        style = 1;
                 else
-                        style = box->styles + 0;
+                        style = 0;
 
                 label->r = 0.0f;
                 label->g = 0.0f;
                 label->b = 0.0f;
         }
 
-        vsx_gl_draw_range_elements(painter->toolbox->gl,
-                                   GL_TRIANGLES,
-                                   style->min_vertex,
-                                   style->max_vertex,
-                                   player_boxes[player_num].n_quads * 6,
-                                   painter->quad_buffer->type,
-                                   (GLvoid *) (intptr_t)
-                                   style->offset);
+        vsx_quad_batch_add_quads(painter->toolbox->quad_batch,
+                                 &closure->state,
+                                 painter->vertices +
+                                 box->first_quads[style] * 4,
+                                 player_boxes[player_num].n_quads);
 }
 
 static void
@@ -766,36 +712,29 @@ paint_cb(void *painter_data)
 
         vsx_paint_state_ensure_layout(paint_state);
 
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_TEXTURE;
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glUseProgram(program->program);
-        vsx_array_object_bind(painter->vao, gl);
-
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               paint_state->board_matrix);
-        gl->glUniform2f(program->translation_uniform,
-                        paint_state->board_translation[0],
-                        paint_state->board_translation[1]);
-
-        gl->glBindTexture(GL_TEXTURE_2D, painter->tex);
-
-        vsx_gl_draw_range_elements(gl,
-                                   GL_TRIANGLES,
-                                   0, N_BOARD_VERTICES - 1,
-                                   N_BOARD_QUADS * 6,
-                                   painter->quad_buffer->type,
-                                   NULL /* indices */);
+        struct paint_box_closure closure = {
+                .painter = painter,
+                .state = {
+                        .program = VSX_SHADER_DATA_PROGRAM_TEXTURE,
+                        .tex = painter->tex,
+                },
+        };
+
+        memcpy(closure.state.matrix,
+               paint_state->board_matrix,
+               sizeof closure.state.matrix);
+        memcpy(closure.state.translation,
+               paint_state->board_translation,
+               sizeof closure.state.translation);
+
+        vsx_quad_batch_add_quads(painter->toolbox->quad_batch,
+                                 &closure.state,
+                                 painter->vertices,
+                                 N_BOARD_QUADS);
 
         vsx_game_state_foreach_player(painter->game_state,
                                       paint_box_cb,
-                                      painter);
+                                      &closure);
 
         vsx_layout_paint_multiple(painter->name_labels,
                                   VSX_N_ELEMENTS(painter->name_labels));
@@ -815,12 +754,7 @@ free_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-        if (painter->quad_buffer)
-                vsx_quad_tool_unref_buffer(painter->quad_buffer, gl);
+        vsx_free(painter->vertices);
 
         if (painter->image_token)
                 vsx_image_loader_cancel(painter->image_token);
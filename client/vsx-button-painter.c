@@ -25,38 +25,8 @@
 #include <assert.h>
 #include <string.h>
 
-#include "vsx-map-buffer.h"
 #include "vsx-mipmap.h"
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
-
-struct vsx_button_painter {
-        struct vsx_game_state *game_state;
-        struct vsx_listener modified_listener;
-        struct vsx_toolbox *toolbox;
-
-        struct vsx_array_object *vao;
-        GLuint vbo;
-        struct vsx_quad_tool_buffer *quad_buffer;
-
-        bool layout_dirty;
-        bool vertices_dirty;
-
-        float translation[2];
-        int area_x, area_y;
-        int area_width, area_height;
-        int button_size;
-
-        int n_quads;
-
-        GLuint tex;
-        struct vsx_image_loader_token *image_token;
-};
-
-struct vertex {
-        int16_t x, y;
-        float s, t;
-};
 
 #define N_BUTTONS 3
 #define N_GAPS (N_BUTTONS + 1)
@@ -96,6 +66,26 @@ struct vertex {
 #define TOTAL_N_QUADS (N_BUTTON_QUADS + MAX_DIGITS)
 #define TOTAL_N_VERTICES (TOTAL_N_QUADS * 4)
 
+struct vsx_button_painter {
+        struct vsx_game_state *game_state;
+        struct vsx_listener modified_listener;
+        struct vsx_toolbox *toolbox;
+
+        bool layout_dirty;
+        bool vertices_dirty;
+
+        float translation[2];
+        int area_x, area_y;
+        int area_width, area_height;
+        int button_size;
+
+        struct vsx_quad_batch_vertex vertices[TOTAL_N_VERTICES];
+        int n_quads;
+
+        GLuint tex;
+        struct vsx_image_loader_token *image_token;
+};
+
 static void
 modified_cb(struct vsx_listener *listener,
             void *user_data)
@@ -161,45 +151,6 @@ texture_load_cb(const struct vsx_image *image,
         painter->toolbox->shell->queue_redraw_cb(painter->toolbox->shell);
 }
 
-static void
-create_buffer(struct vsx_button_painter *painter)
-{
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         TOTAL_N_VERTICES * sizeof (struct vertex),
-                         NULL, /* data */
-                         GL_DYNAMIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_TEX_COORD,
-                                       2, /* size */
-                                       GL_FLOAT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, s));
-
-        painter->quad_buffer =
-                vsx_quad_tool_get_buffer(painter->toolbox->quad_tool,
-                                         painter->vao,
-                                         TOTAL_N_QUADS);
-}
-
 static void *
 create_cb(struct vsx_game_state *game_state,
           struct vsx_toolbox *toolbox)
@@ -212,16 +163,16 @@ create_cb(struct vsx_game_state *game_state,
         painter->vertices_dirty = true;
         painter->layout_dirty = true;
 
-        create_buffer(painter);
-
         painter->modified_listener.notify = modified_cb;
         vsx_signal_add(vsx_game_state_get_modified_signal(game_state),
                        &painter->modified_listener);
 
-        painter->image_token = vsx_image_loader_load(toolbox->image_loader,
-                                                     "buttons.mpng",
-                                                     texture_load_cb,
-                                                     painter);
+        painter->image_token =
+                vsx_image_loader_load(toolbox->image_loader,
+                                      "buttons.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_HIGH,
+                                      texture_load_cb,
+                                      painter);
 
         return painter;
 }
@@ -336,13 +287,13 @@ fb_size_changed_cb(void *painter_data)
 }
 
 static void
-store_quad(struct vertex *vertices,
+store_quad(struct vsx_quad_batch_vertex *vertices,
            int x, int y,
            int w, int h,
            float s1, float t1,
            float s2, float t2)
 {
-        struct vertex *v = vertices;
+        struct vsx_quad_batch_vertex *v = vertices;
 
         v->x = x;
         v->y = y;
@@ -367,9 +318,9 @@ store_quad(struct vertex *vertices,
 
 static void
 generate_button_vertices(struct vsx_button_painter *painter,
-                         struct vertex *vertices)
+                         struct vsx_quad_batch_vertex *vertices)
 {
-        struct vertex *v = vertices;
+        struct vsx_quad_batch_vertex *v = vertices;
         int y = 0;
         int button_size = painter->button_size;
 
@@ -436,7 +387,7 @@ get_n_digits(int num)
 
 static int
 generate_n_tiles_vertices(struct vsx_button_painter *painter,
-                          struct vertex *vertices)
+                          struct vsx_quad_batch_vertex *vertices)
 {
         int n_tiles = vsx_game_state_get_remaining_tiles(painter->game_state);
         int n_digits = get_n_digits(n_tiles);
@@ -483,7 +434,7 @@ generate_n_tiles_vertices(struct vsx_button_painter *painter,
 
         memset(vertices + n_digits * 4,
                0,
-               (MAX_DIGITS - n_digits) * 4 * sizeof (struct vertex));
+               (MAX_DIGITS - n_digits) * 4 * sizeof *vertices);
 
         return n_digits;
 }
@@ -494,16 +445,7 @@ ensure_vertices(struct vsx_button_painter *painter)
         if (!painter->vertices_dirty)
                 return;
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-
-        struct vertex *vertices =
-                vsx_map_buffer_map(painter->toolbox->map_buffer,
-                                   GL_ARRAY_BUFFER,
-                                   TOTAL_N_VERTICES * sizeof (struct vertex),
-                                   false, /* flush explicit */
-                                   GL_DYNAMIC_DRAW);
+        struct vsx_quad_batch_vertex *vertices = painter->vertices;
 
         if (vsx_game_state_get_has_player_name(painter->game_state)) {
                 generate_button_vertices(painter, vertices);
@@ -521,8 +463,6 @@ ensure_vertices(struct vsx_button_painter *painter)
                 painter->n_quads = 1;
         }
 
-        vsx_map_buffer_unmap(painter->toolbox->map_buffer);
-
         painter->vertices_dirty = false;
 }
 
@@ -538,32 +478,23 @@ paint_cb(void *painter_data)
 
         ensure_vertices(painter);
 
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_TEXTURE;
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glUseProgram(program->program);
-        vsx_array_object_bind(painter->vao, gl);
-
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               painter->toolbox->paint_state.pixel_matrix);
-        gl->glUniform2f(program->translation_uniform,
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_TEXTURE,
+                .tex = painter->tex,
+                .translation = {
                         painter->translation[0],
-                        painter->translation[1]);
-
-        gl->glBindTexture(GL_TEXTURE_2D, painter->tex);
-
-        vsx_gl_draw_range_elements(gl,
-                                   GL_TRIANGLES,
-                                   0, painter->n_quads * 4 - 1,
-                                   painter->n_quads * 6,
-                                   painter->quad_buffer->type,
-                                   NULL /* indices */);
+                        painter->translation[1],
+                },
+        };
+
+        memcpy(state.matrix,
+               painter->toolbox->paint_state.pixel_matrix,
+               sizeof state.matrix);
+
+        vsx_quad_batch_add_quads(painter->toolbox->quad_batch,
+                                 &state,
+                                 painter->vertices,
+                                 painter->n_quads);
 }
 
 static void
@@ -575,13 +506,6 @@ free_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-        if (painter->quad_buffer)
-                vsx_quad_tool_unref_buffer(painter->quad_buffer, gl);
-
         if (painter->image_token)
                 vsx_image_loader_cancel(painter->image_token);
         if (painter->tex)
@@ -46,6 +46,15 @@ ws_terminator[] = "\r\n\r\n";
 
 #define WS_TERMINATOR_LENGTH ((sizeof ws_terminator) - 1)
 
+/* Header in the WebSocket response that means the server accepted
+ * version 2 of the protocol. This is matched case-insensitively.
+ */
+static const uint8_t
+ws_protocol_header[] =
+        "\r\nsec-websocket-protocol: " VSX_PROTO_V2_NAME "\r\n";
+
+#define WS_PROTOCOL_HEADER_LENGTH ((sizeof ws_protocol_header) - 1)
+
 enum vsx_connection_dirty_flag {
         VSX_CONNECTION_DIRTY_FLAG_WS_HEADER = (1 << 0),
         VSX_CONNECTION_DIRTY_FLAG_HEADER = (1 << 1),
@@ -111,6 +120,10 @@ struct vsx_connection_tile_to_move {
         struct vsx_list link;
 };
 
+struct vsx_connection_tile_position {
+        int16_t x, y;
+};
+
 struct vsx_connection_message_to_send {
         struct vsx_list link;
         /* Over-allocated */
@@ -190,6 +203,22 @@ struct vsx_connection {
          * WebSocket negotation.
          */
         unsigned int ws_terminator_pos;
+
+        /* Whether to ask the server to use version 2 of the protocol */
+        bool compact_requested;
+        /* Whether the server accepted version 2 for this connection.
+         * Only the header command is sent until the server replies
+         * so that we know which format to use.
+         */
+        bool compact;
+        /* Position within ws_protocol_header that we have matched */
+        unsigned int ws_protocol_header_pos;
+
+        /* Last tile positions sent and received on this connection.
+         * Version 2 sends the positions relative to these.
+         */
+        struct vsx_connection_tile_position sent_tile_positions[256];
+        struct vsx_connection_tile_position received_tile_positions[256];
 };
 
 static void
@@ -488,6 +517,80 @@ handle_message(struct vsx_connection *connection,
         return true;
 }
 
+static void
+emit_tile_changed(struct vsx_connection *connection,
+                  int num,
+                  int x, int y,
+                  const char *letter,
+                  int player)
+{
+        struct vsx_connection_event event = {
+                .type = VSX_CONNECTION_EVENT_TYPE_TILE_CHANGED,
+                .tile_changed = {
+                        .num = num,
+                        .last_player_moved = player,
+                        .x = x,
+                        .y = y,
+                        .letter = vsx_utf8_get_char(letter),
+                },
+        };
+
+        emit_event(connection, &event);
+}
+
+static bool
+handle_compact_tile(struct vsx_connection *connection,
+                    const uint8_t *payload,
+                    size_t payload_length,
+                    struct vsx_error **error)
+{
+        uint8_t num, player;
+        int32_t dx, dy;
+        const char *letter;
+
+        if (!vsx_proto_read_payload(payload + 1,
+                                    payload_length - 1,
+
+                                    VSX_PROTO_TYPE_UINT8,
+                                    &num,
+
+                                    VSX_PROTO_TYPE_SVARINT,
+                                    &dx,
+
+                                    VSX_PROTO_TYPE_SVARINT,
+                                    &dy,
+
+                                    VSX_PROTO_TYPE_STRING,
+                                    &letter,
+
+                                    VSX_PROTO_TYPE_UINT8,
+                                    &player,
+
+                                    VSX_PROTO_TYPE_NONE) ||
+            *letter == 0 ||
+            *vsx_utf8_next(letter) != 0) {
+                vsx_set_error(error,
+                              &vsx_connection_error,
+                              VSX_CONNECTION_ERROR_BAD_DATA,
+                              "The server sent an invalid tile command");
+                return false;
+        }
+
+        struct vsx_connection_tile_position *position =
+                connection->received_tile_positions + num;
+
+        position->x += dx;
+        position->y += dy;
+
+        emit_tile_changed(connection,
+                          num,
+                          position->x, position->y,
+                          letter,
+                          player);
+
+        return true;
+}
+
 static bool
 handle_tile(struct vsx_connection *connection,
             const uint8_t *payload,
@@ -498,6 +601,12 @@ handle_tile(struct vsx_connection *connection,
         int16_t x, y;
         const char *letter;
 
+        if (connection->compact) {
+                return handle_compact_tile(connection,
+                                           payload, payload_length,
+                                           error);
+        }
+
         if (!vsx_proto_read_payload(payload + 1,
                                     payload_length - 1,
 
@@ -526,18 +635,7 @@ handle_tile(struct vsx_connection *connection,
                 return false;
         }
 
-        struct vsx_connection_event event = {
-                .type = VSX_CONNECTION_EVENT_TYPE_TILE_CHANGED,
-                .tile_changed = {
-                        .num = num,
-                        .last_player_moved = player,
-                        .x = x,
-                        .y = y,
-                        .letter = vsx_utf8_get_char(letter),
-                },
-        };
-
-        emit_event(connection, &event);
+        emit_tile_changed(connection, num, x, y, letter, player);
 
         return true;
 }
@@ -980,6 +1078,26 @@ is_would_block_error(int err)
         return err == EAGAIN || err == EWOULDBLOCK;
 }
 
+static void
+match_protocol_header(struct vsx_connection *connection,
+                      uint8_t ch)
+{
+        if (connection->ws_protocol_header_pos >= WS_PROTOCOL_HEADER_LENGTH)
+                return;
+
+        if (ch >= 'A' && ch <= 'Z')
+                ch += 'a' - 'A';
+
+        if (ch == ws_protocol_header[connection->ws_protocol_header_pos]) {
+                connection->ws_protocol_header_pos++;
+        } else {
+                /* The only prefix of the header that can restart a
+                 * match is the initial “\r”.
+                 */
+                connection->ws_protocol_header_pos = ch == '\r' ? 1 : 0;
+        }
+}
+
 static const uint8_t *
 find_ws_terminator(struct vsx_connection *connection)
 {
@@ -989,13 +1107,22 @@ find_ws_terminator(struct vsx_connection *connection)
         const uint8_t *p = connection->input_buffer;
 
         while (p - connection->input_buffer < connection->input_length) {
-                if (*(p++) != ws_terminator[connection->ws_terminator_pos]) {
+                uint8_t ch = *(p++);
+
+                match_protocol_header(connection, ch);
+
+                if (ch != ws_terminator[connection->ws_terminator_pos]) {
                         connection->ws_terminator_pos = 0;
                         continue;
                 }
 
-                if (++connection->ws_terminator_pos >= WS_TERMINATOR_LENGTH)
+                if (++connection->ws_terminator_pos >= WS_TERMINATOR_LENGTH) {
+                        connection->compact =
+                                connection->compact_requested &&
+                                connection->ws_protocol_header_pos >=
+                                WS_PROTOCOL_HEADER_LENGTH;
                         return p;
+                }
         }
 
         /* If we make it here then we haven’t found the end of the
@@ -1004,6 +1131,44 @@ find_ws_terminator(struct vsx_connection *connection)
         return NULL;
 }
 
+static bool
+process_frame(struct vsx_connection *connection,
+              const uint8_t *payload,
+              size_t payload_length,
+              struct vsx_error **error)
+{
+        if (!connection->compact) {
+                return process_message(connection,
+                                       payload, payload_length,
+                                       error);
+        }
+
+        /* In version 2 each frame contains several messages */
+        while (payload_length > 0) {
+                const uint8_t *message;
+                size_t message_length;
+
+                if (!vsx_proto_read_packed_command(&payload,
+                                                   &payload_length,
+                                                   &message,
+                                                   &message_length)) {
+                        vsx_set_error(error,
+                                      &vsx_connection_error,
+                                      VSX_CONNECTION_ERROR_BAD_DATA,
+                                      "The server sent an invalid packed "
+                                      "frame");
+                        return false;
+                }
+
+                if (!process_message(connection,
+                                     message, message_length,
+                                     error))
+                        return false;
+        }
+
+        return true;
+}
+
 static const uint8_t *
 process_frames(struct vsx_connection *connection,
                const uint8_t *buf_start,
@@ -1032,9 +1197,9 @@ process_frames(struct vsx_connection *connection,
 
                 /* Ignore control frames and non-binary frames */
                 if (*p == 0x82 &&
-                    !process_message(connection,
-                                     payload_start, payload_length,
-                                     error))
+                    !process_frame(connection,
+                                   payload_start, payload_length,
+                                   error))
                         return NULL;
 
                 p = payload_start + payload_length;
@@ -1124,16 +1289,26 @@ write_ws_request(struct vsx_connection *connection,
                 "GET / HTTP/1.1\r\n"
                 "Upgrade: websocket\r\n"
                 "Connection: Upgrade\r\n"
-                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
-                "\r\n";
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n";
+        static const uint8_t ws_protocol_request[] =
+                "Sec-WebSocket-Protocol: " VSX_PROTO_V2_NAME "\r\n";
         const size_t ws_request_len = (sizeof ws_request) - 1;
+        const size_t ws_protocol_request_len =
+                connection->compact_requested ?
+                (sizeof ws_protocol_request) - 1 :
+                0;
+        const size_t total_len = ws_request_len + ws_protocol_request_len + 2;
 
-        if (buffer_size < ws_request_len)
+        if (buffer_size < total_len)
                 return -1;
 
         memcpy(buffer, ws_request, ws_request_len);
+        memcpy(buffer + ws_request_len,
+               ws_protocol_request,
+               ws_protocol_request_len);
+        memcpy(buffer + total_len - 2, "\r\n", 2);
 
-        return ws_request_len;
+        return total_len;
 }
 
 static int
@@ -1233,82 +1408,121 @@ write_header(struct vsx_connection *connection,
         }
 }
 
+/* Writes a command in the format that was negotiated for the
+ * connection. The header command is always written in the original
+ * format because it is sent before the negotiation is complete.
+ */
+static int
+write_command(struct vsx_connection *connection,
+              uint8_t *buffer,
+              size_t buffer_size,
+              int command,
+              ...)
+{
+        va_list ap;
+        int ret;
+
+        va_start(ap, command);
+
+        if (connection->compact) {
+                ret = vsx_proto_write_packed_command_v(buffer,
+                                                       buffer_size,
+                                                       command,
+                                                       ap);
+        } else {
+                ret = vsx_proto_write_command_v(buffer,
+                                                buffer_size,
+                                                command,
+                                                ap);
+        }
+
+        va_end(ap);
+
+        return ret;
+}
+
 static int
 write_keep_alive(struct vsx_connection *connection,
                  uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_KEEP_ALIVE,
+                             VSX_PROTO_KEEP_ALIVE,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
 write_n_tiles(struct vsx_connection *connection,
               uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_SET_N_TILES,
+                             VSX_PROTO_SET_N_TILES,
 
-                                       VSX_PROTO_TYPE_UINT8,
-                                       connection->n_tiles_to_send,
+                             VSX_PROTO_TYPE_UINT8,
+                             connection->n_tiles_to_send,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
 write_language(struct vsx_connection *connection,
                uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_SET_LANGUAGE,
+                             VSX_PROTO_SET_LANGUAGE,
 
-                                       VSX_PROTO_TYPE_STRING,
-                                       connection->language_to_send,
+                             VSX_PROTO_TYPE_STRING,
+                             connection->language_to_send,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
 write_leave(struct vsx_connection *connection,
             uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_LEAVE,
+                             VSX_PROTO_LEAVE,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
 write_shout(struct vsx_connection *connection,
             uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_SHOUT,
+                             VSX_PROTO_SHOUT,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
 write_turn(struct vsx_connection *connection,
            uint8_t *buffer, size_t buffer_size)
 {
-        return vsx_proto_write_command(buffer,
-                                       buffer_size,
+        return write_command(connection,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_TURN,
+                             VSX_PROTO_TURN,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1323,21 +1537,50 @@ write_move_tile(struct vsx_connection *connection,
                                  struct vsx_connection_tile_to_move,
                                  link);
 
-        int ret = vsx_proto_write_command(buffer,
-                                          buffer_size,
+        int ret;
 
-                                          VSX_PROTO_MOVE_TILE,
+        if (connection->compact) {
+                uint8_t num = tile->num;
+                struct vsx_connection_tile_position *position =
+                        connection->sent_tile_positions + num;
 
-                                          VSX_PROTO_TYPE_UINT8,
-                                          tile->num,
+                ret = vsx_proto_write_packed_command(buffer,
+                                                     buffer_size,
 
-                                          VSX_PROTO_TYPE_INT16,
-                                          tile->x,
+                                                     VSX_PROTO_MOVE_TILE,
 
-                                          VSX_PROTO_TYPE_INT16,
-                                          tile->y,
+                                                     VSX_PROTO_TYPE_UINT8,
+                                                     num,
 
-                                          VSX_PROTO_TYPE_NONE);
+                                                     VSX_PROTO_TYPE_SVARINT,
+                                                     tile->x - position->x,
+
+                                                     VSX_PROTO_TYPE_SVARINT,
+                                                     tile->y - position->y,
+
+                                                     VSX_PROTO_TYPE_NONE);
+
+                if (ret > 0) {
+                        position->x = tile->x;
+                        position->y = tile->y;
+                }
+        } else {
+                ret = vsx_proto_write_command(buffer,
+                                              buffer_size,
+
+                                              VSX_PROTO_MOVE_TILE,
+
+                                              VSX_PROTO_TYPE_UINT8,
+                                              tile->num,
+
+                                              VSX_PROTO_TYPE_INT16,
+                                              tile->x,
+
+                                              VSX_PROTO_TYPE_INT16,
+                                              tile->y,
+
+                                              VSX_PROTO_TYPE_NONE);
+        }
 
         if (ret > 0) {
                 vsx_list_remove(&tile->link);
@@ -1359,15 +1602,16 @@ write_send_message(struct vsx_connection *connection,
                                  struct vsx_connection_message_to_send,
                                  link);
 
-        int ret = vsx_proto_write_command(buffer,
-                                          buffer_size,
+        int ret = write_command(connection,
+                                buffer,
+                                buffer_size,
 
-                                          VSX_PROTO_SEND_MESSAGE,
+                                VSX_PROTO_SEND_MESSAGE,
 
-                                          VSX_PROTO_TYPE_STRING,
-                                          message->message,
+                                VSX_PROTO_TYPE_STRING,
+                                message->message,
 
-                                          VSX_PROTO_TYPE_NONE);
+                                VSX_PROTO_TYPE_NONE);
 
         if (ret > 0) {
                 /* The server automatically assumes we're not typing
@@ -1389,14 +1633,15 @@ write_typing_state(struct vsx_connection *connection,
         if (connection->typing == connection->sent_typing_state)
                 return 0;
 
-        int ret = vsx_proto_write_command(buffer,
-                                          buffer_size,
+        int ret = write_command(connection,
+                                buffer,
+                                buffer_size,
 
-                                          connection->typing ?
-                                          VSX_PROTO_START_TYPING :
-                                          VSX_PROTO_STOP_TYPING,
+                                connection->typing ?
+                                VSX_PROTO_START_TYPING :
+                                VSX_PROTO_STOP_TYPING,
 
-                                          VSX_PROTO_TYPE_NONE);
+                                VSX_PROTO_TYPE_NONE);
 
         if (ret > 0)
                 connection->sent_typing_state = connection->typing;
@@ -1404,8 +1649,23 @@ write_typing_state(struct vsx_connection *connection,
         return ret;
 }
 
+static bool
+is_waiting_for_ws_response(struct vsx_connection *connection)
+{
+        /* If we’ve asked for version 2 then we can’t send anything
+         * after the header until we know whether the server accepted
+         * it.
+         */
+        return (connection->compact_requested &&
+                connection->ws_terminator_pos < WS_TERMINATOR_LENGTH);
+}
+
+/* Writes one item into the output buffer without letting the
+ * output_length go beyond buffer_end.
+ */
 static int
-write_one_item(struct vsx_connection *connection)
+write_one_item(struct vsx_connection *connection,
+               size_t buffer_end)
 {
         static const struct {
                 enum vsx_connection_dirty_flag flag;
@@ -1423,15 +1683,21 @@ write_one_item(struct vsx_connection *connection)
                 { .func = write_send_message },
                 { .func = write_typing_state },
         };
+        /* Number of write_funcs that are written before the
+         * WebSocket negotiation is complete.
+         */
+        static const int N_HEADER_WRITE_FUNCS = 2;
 
-        for (int i = 0; i < VSX_N_ELEMENTS(write_funcs); i++) {
+        int n_funcs = (is_waiting_for_ws_response(connection) ?
+                       N_HEADER_WRITE_FUNCS :
+                       VSX_N_ELEMENTS(write_funcs));
+
+        for (int i = 0; i < n_funcs; i++) {
                 if (write_funcs[i].flag != 0 &&
                     (connection->dirty_flags & write_funcs[i].flag) == 0)
                         continue;
 
-                size_t space_left =
-                        (sizeof connection->output_buffer) -
-                        connection->output_length;
+                size_t space_left = buffer_end - connection->output_length;
 
                 int wrote = write_funcs[i].func(connection,
                                                 connection->output_buffer +
@@ -1454,13 +1720,54 @@ write_one_item(struct vsx_connection *connection)
         return 0;
 }
 
+static void
+fill_packed_frame(struct vsx_connection *connection)
+{
+        size_t frame_start = connection->output_length;
+        size_t payload_start =
+                frame_start + VSX_PROTO_PACKED_FRAME_HEADER_LENGTH;
+
+        if (payload_start >= sizeof connection->output_buffer)
+                return;
+
+        size_t buffer_end = MIN(sizeof connection->output_buffer,
+                                payload_start + VSX_PROTO_MAX_PAYLOAD_SIZE);
+
+        connection->output_length = payload_start;
+
+        int wrote;
+
+        do {
+                wrote = write_one_item(connection, buffer_end);
+        } while (wrote > 0);
+
+        size_t payload_length = connection->output_length - payload_start;
+
+        if (payload_length == 0) {
+                connection->output_length = frame_start;
+                return;
+        }
+
+        connection->output_length =
+                frame_start +
+                vsx_proto_finish_packed_frame(connection->output_buffer +
+                                              frame_start,
+                                              payload_length);
+}
+
 static void
 fill_output_buffer(struct vsx_connection *connection)
 {
+        if (connection->compact) {
+                fill_packed_frame(connection);
+                return;
+        }
+
         int wrote;
 
         do {
-                wrote = write_one_item(connection);
+                wrote = write_one_item(connection,
+                                       sizeof connection->output_buffer);
         } while (wrote > 0);
 }
 
@@ -1545,6 +1852,14 @@ try_reconnect(struct vsx_connection *connection)
         connection->output_length = 0;
         connection->input_length = 0;
         connection->ws_terminator_pos = 0;
+        connection->ws_protocol_header_pos = 0;
+        connection->compact = false;
+        memset(connection->sent_tile_positions,
+               0,
+               sizeof connection->sent_tile_positions);
+        memset(connection->received_tile_positions,
+               0,
+               sizeof connection->received_tile_positions);
         connection->write_finished = false;
         connection->synced = false;
 
@@ -1601,6 +1916,12 @@ has_pending_data(struct vsx_connection *connection)
         if (connection->output_length > 0)
                 return true;
 
+        if (is_waiting_for_ws_response(connection)) {
+                return (connection->dirty_flags &
+                        (VSX_CONNECTION_DIRTY_FLAG_WS_HEADER |
+                         VSX_CONNECTION_DIRTY_FLAG_HEADER)) != 0;
+        }
+
         if (connection->dirty_flags)
                 return true;
 
@@ -1632,7 +1953,8 @@ calculate_poll_events(struct vsx_connection *connection)
                 if (!connection->write_finished) {
                         if (has_pending_data(connection)) {
                                 events |= POLLOUT;
-                        } else if (connection->finished) {
+                        } else if (connection->finished &&
+                                   !is_waiting_for_ws_response(connection)) {
                                 shutdown(connection->sock, SHUT_WR);
 
                                 connection->write_finished = true;
@@ -1850,6 +2172,13 @@ vsx_connection_reset(struct vsx_connection *connection)
         update_poll(connection);
 }
 
+void
+vsx_connection_set_compact_protocol(struct vsx_connection *connection,
+                                    bool compact)
+{
+        connection->compact_requested = compact;
+}
+
 struct vsx_connection *
 vsx_connection_new(void)
 {
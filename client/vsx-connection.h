@@ -170,6 +170,16 @@ void
 vsx_connection_set_conversation_id(struct vsx_connection *connection,
                                    uint64_t conversation_id);
 
+/* Sets whether to ask the server to use version 2 of the protocol,
+ * which packs several messages into each frame and sends tile
+ * positions as differences. The server can still pick the original
+ * version. This takes effect the next time the connection connects.
+ * It is off by default.
+ */
+void
+vsx_connection_set_compact_protocol(struct vsx_connection *connection,
+                                    bool compact);
+
 void
 vsx_connection_wake_up(struct vsx_connection *connection,
                        short poll_events);
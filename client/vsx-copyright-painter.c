@@ -20,6 +20,8 @@
 
 #include "vsx-copyright-painter.h"
 
+#include <string.h>
+
 #include "vsx-layout.h"
 #include "vsx-util.h"
 
@@ -28,9 +30,6 @@ struct vsx_copyright_painter {
 
         struct vsx_toolbox *toolbox;
 
-        struct vsx_array_object *vao;
-        GLuint vbo;
-
         bool position_dirty;
 
         int border;
@@ -44,10 +43,6 @@ struct vsx_copyright_painter {
         struct vsx_listener shadow_painter_ready_listener;
 };
 
-struct vertex {
-        int16_t x, y;
-};
-
 static const char
 copyright_text[] =
         "Copyright © 2022 Neil Roberts.\n"
@@ -58,9 +53,6 @@ copyright_text[] =
         "The Luna Sans font is copyright 2013 The Alegreya Sans Project "
         "Authors.";
 
-#define N_QUADS 1
-#define N_VERTICES (N_QUADS * 4)
-
 /* Max width of the text in mm */
 #define PARAGRAPH_WIDTH 60
 /* Border size around the paragraphs in mm */
@@ -78,41 +70,6 @@ shadow_painter_ready_cb(struct vsx_listener *listener,
         painter->toolbox->shell->queue_redraw_cb(painter->toolbox->shell);
 }
 
-static void
-create_buffer(struct vsx_copyright_painter *painter)
-{
-        int w = painter->dialog_width;
-        int h = painter->dialog_height;
-
-        struct vertex vertices[N_VERTICES] = {
-                { 0, 0 },
-                { 0, h },
-                { w, 0 },
-                { w, h },
-        };
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         sizeof vertices,
-                         vertices,
-                         GL_STATIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-}
-
 static void
 create_layout(struct vsx_copyright_painter *painter)
 {
@@ -176,8 +133,6 @@ create_cb(struct vsx_game_state *game_state,
 
         get_size(painter);
 
-        create_buffer(painter);
-
         painter->shadow =
                 vsx_shadow_painter_create_shadow(shadow_painter,
                                                  painter->dialog_width,
@@ -197,31 +152,24 @@ fb_size_changed_cb(void *painter_data)
 static void
 paint_background(struct vsx_copyright_painter *painter)
 {
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_SOLID;
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glUseProgram(program->program);
-
         struct vsx_paint_state *paint_state = &painter->toolbox->paint_state;
 
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               paint_state->pixel_matrix);
-        gl->glUniform2f(program->translation_uniform,
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_SOLID,
+                .translation = {
                         painter->translation[0],
-                        painter->translation[1]);
-
-        vsx_array_object_bind(painter->vao, gl);
+                        painter->translation[1],
+                },
+                .color = { 1.0f, 1.0f, 1.0f },
+        };
 
-        gl->glUniform3f(program->color_uniform, 1.0f, 1.0f, 1.0f);
+        memcpy(state.matrix, paint_state->pixel_matrix, sizeof state.matrix);
 
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, N_VERTICES);
+        vsx_quad_batch_add_rectangle(painter->toolbox->quad_batch,
+                                     &state,
+                                     0.0f, 0.0f,
+                                     painter->dialog_width,
+                                     painter->dialog_height);
 }
 
 static void
@@ -265,7 +213,7 @@ paint_cb(void *painter_data)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->toolbox->paint_state.pixel_matrix,
                                  painter->translation);
 
@@ -310,13 +258,6 @@ free_cb(void *painter_data)
 
         vsx_list_remove(&painter->shadow_painter_ready_listener.link);
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-
         vsx_layout_free(painter->layout.layout);
 
         vsx_shadow_painter_free_shadow(painter->toolbox->shadow_painter,
@@ -25,16 +25,12 @@
 
 #include "vsx-mipmap.h"
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
 
 struct vsx_error_painter {
         struct vsx_game_state *game_state;
         struct vsx_listener modified_listener;
         struct vsx_toolbox *toolbox;
 
-        struct vsx_array_object *vao;
-        GLuint vbo;
-
         bool error_visible;
 
         float icon_size;
@@ -49,13 +45,6 @@ struct vsx_error_painter {
         struct vsx_listener shadow_painter_ready_listener;
 };
 
-struct vertex {
-        int16_t x, y;
-        uint8_t s, t;
-};
-
-#define N_VERTICES 4
-
 /* Size in mm of the icon */
 #define ICON_SIZE 15
 
@@ -125,6 +114,20 @@ remove_delay_timeout(struct vsx_error_painter *painter)
         painter->delay_timeout = NULL;
 }
 
+static void
+start_image_load(struct vsx_error_painter *painter)
+{
+        /* The image is only loaded once the error needs to be shown
+         * so it is wanted straight away.
+         */
+        painter->image_token =
+                vsx_image_loader_load(painter->toolbox->image_loader,
+                                      "connection-lost.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_HIGH,
+                                      texture_load_cb,
+                                      painter);
+}
+
 static void
 set_visible_cb(void *user_data)
 {
@@ -135,16 +138,8 @@ set_visible_cb(void *user_data)
         painter->error_visible = true;
 
         if (painter->tex == 0) {
-                if (painter->image_token == NULL) {
-                        struct vsx_image_loader *image_loader =
-                                painter->toolbox->image_loader;
-
-                        painter->image_token =
-                                vsx_image_loader_load(image_loader,
-                                                      "connection-lost.mpng",
-                                                      texture_load_cb,
-                                                      painter);
-                }
+                if (painter->image_token == NULL)
+                        start_image_load(painter);
         } else if (can_paint(painter)) {
                 struct vsx_shell_interface *shell = painter->toolbox->shell;
                 shell->queue_redraw_cb(shell);
@@ -231,72 +226,6 @@ modified_cb(struct vsx_listener *listener,
         }
 }
 
-static void
-generate_vertices(struct vsx_error_painter *painter,
-                  struct vertex *v)
-{
-        v->x = 0;
-        v->y = 0;
-        v->s = 0;
-        v->t = 0;
-        v++;
-
-        v->x = 0;
-        v->y = painter->icon_size;
-        v->s = 0;
-        v->t = 255;
-        v++;
-
-        v->x = painter->icon_size;
-        v->y = 0;
-        v->s = 255;
-        v->t = 0;
-        v++;
-
-        v->x = painter->icon_size;
-        v->y = painter->icon_size;
-        v->s = 255;
-        v->t = 255;
-}
-
-static void
-create_buffer(struct vsx_error_painter *painter)
-{
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        struct vertex vertices[N_VERTICES];
-
-        generate_vertices(painter, vertices);
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         sizeof vertices,
-                         vertices,
-                         GL_STATIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_TEX_COORD,
-                                       2, /* size */
-                                       GL_UNSIGNED_BYTE,
-                                       true, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, s));
-}
-
 static void *
 create_cb(struct vsx_game_state *game_state,
           struct vsx_toolbox *toolbox)
@@ -315,8 +244,6 @@ create_cb(struct vsx_game_state *game_state,
         painter->icon_size = ICON_SIZE * paint_state->dpi / 25.4f;
         painter->gap = GAP * paint_state->dpi / 25.4f;
 
-        create_buffer(painter);
-
         struct vsx_shadow_painter *shadow_painter = toolbox->shadow_painter;
 
         painter->shadow =
@@ -365,35 +292,25 @@ paint_cb(void *painter_data)
 
         get_translation(painter, translation);
 
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 shader_data,
+                                 painter->toolbox->quad_batch,
                                  paint_state->pixel_matrix,
                                  translation);
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_TEXTURE;
-
-        gl->glUseProgram(program->program);
-
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               painter->toolbox->paint_state.pixel_matrix);
-        gl->glUniform2f(program->translation_uniform,
-                        translation[0],
-                        translation[1]);
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_TEXTURE,
+                .tex = painter->tex,
+                .translation = { translation[0], translation[1] },
+        };
 
-        vsx_array_object_bind(painter->vao, gl);
+        memcpy(state.matrix, paint_state->pixel_matrix, sizeof state.matrix);
 
-        gl->glBindTexture(GL_TEXTURE_2D, painter->tex);
-
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, N_VERTICES);
+        vsx_quad_batch_add_rectangle(painter->toolbox->quad_batch,
+                                     &state,
+                                     0.0f, 0.0f,
+                                     painter->icon_size,
+                                     painter->icon_size);
 }
 
 static void
@@ -408,11 +325,6 @@ free_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-
         if (painter->image_token)
                 vsx_image_loader_cancel(painter->image_token);
         if (painter->tex)
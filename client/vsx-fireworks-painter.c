@@ -325,7 +325,7 @@ init_uniforms(struct vsx_fireworks_painter *painter)
                             painter->toolbox->paint_state.dpi /
                             25.4f);
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
         gl->glUniform1f(point_size_uniform, point_size);
 
         painter->elapsed_time_uniform =
@@ -364,6 +364,7 @@ create_cb(struct vsx_game_state *game_state,
                 painter->image_token =
                         vsx_image_loader_load(painter->toolbox->image_loader,
                                               "firework.mpng",
+                                              VSX_IMAGE_LOADER_PRIORITY_LOW,
                                               texture_load_cb,
                                               painter);
         }
@@ -392,12 +393,12 @@ paint_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
+        vsx_gl_enable(gl, GL_BLEND);
         gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        gl->glEnable(GL_BLEND);
 
         gl->glBindTexture(GL_TEXTURE_2D, painter->tex);
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         gl->glUniformMatrix2fv(program->matrix_uniform,
                                1, /* count */
@@ -422,17 +423,17 @@ paint_cb(void *painter_data)
 
         vsx_array_object_bind(buffer->vao, gl);
 
-        gl->glEnable(GL_SCISSOR_TEST);
+        vsx_gl_enable(gl, GL_SCISSOR_TEST);
         gl->glScissor(paint_state->board_scissor_x,
                       paint_state->board_scissor_y,
                       paint_state->board_scissor_width,
                       paint_state->board_scissor_height);
 
-        gl->glDrawArrays(GL_POINTS, 0, N_VERTICES);
+        vsx_gl_draw_arrays(gl, GL_POINTS, 0, N_VERTICES);
 
-        gl->glDisable(GL_SCISSOR_TEST);
+        vsx_gl_disable(gl, GL_SCISSOR_TEST);
 
-        gl->glDisable(GL_BLEND);
+        vsx_gl_disable(gl, GL_BLEND);
 
         /* Queue a redraw immediately to animate the effect */
         painter->toolbox->shell->queue_redraw_cb(painter->toolbox->shell);
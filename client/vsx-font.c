@@ -22,27 +22,99 @@
 
 #include <freetype/freetype.h>
 #include <freetype/ftbitmap.h>
+#include <freetype/ftmodapi.h>
+#include <freetype/ftsizes.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "vsx-util.h"
 #include "vsx-gl.h"
+#ifdef VSX_GLYPH_PACKER_BSP
 #include "vsx-bsp.h"
+#else
+#include "vsx-skyline.h"
+#endif
+#include "vsx-list.h"
+#include "vsx-buffer.h"
+#include "vsx-utf8.h"
+#include "vsx-thread.h"
 
 struct vsx_error_domain
 vsx_font_error;
 
 struct vsx_font_texture {
         GLuint tex;
+        /* The space for the glyphs is allocated with a skyline
+         * unless the build was configured to use the BSP tree.
+         */
+#ifdef VSX_GLYPH_PACKER_BSP
         struct vsx_bsp *bsp;
+#else
+        struct vsx_skyline *skyline;
+#endif
+        /* Copy of the texture contents. The glyphs are added here and
+         * the changed rows are uploaded in one go by
+         * vsx_font_library_upload.
+         */
+        uint8_t *data;
+        /* Range of rows that need to be uploaded. Nothing needs to
+         * be uploaded if dirty_y2 <= dirty_y1.
+         */
+        int dirty_y1, dirty_y2;
         struct vsx_font_texture *next;
 };
 
+/* A FreeType face along with the size for rendering SDF glyphs.
+ * FreeType objects can’t be used from two threads at once so the
+ * prerender thread has its own faces.
+ */
+struct vsx_font_face {
+        FT_Face face;
+        /* NULL if the glyphs aren’t rendered as an SDF. Otherwise the
+         * glyph images are rendered with this size whereas the
+         * metrics and advances come from the face’s default size
+         * which is scaled by the DPI.
+         */
+        FT_Size sdf_size;
+};
+
 struct vsx_font {
         struct vsx_font_library *library;
-        FT_Face face;
+        struct vsx_font_face face;
         struct vsx_glyph_hash *glyph_hash;
         uint8_t *font_data;
+        size_t font_data_size;
+        float glyph_scale;
+};
+
+/* A list of glyphs waiting to be rendered by the prerender thread */
+struct vsx_font_prerender_request {
+        struct vsx_list link;
+        enum vsx_font_type type;
+        size_t n_glyphs;
+        unsigned glyphs[];
+};
+
+/* A glyph image in the format that is stored in the atlas */
+struct vsx_font_glyph_image {
+        long x_advance;
+        int left, top;
+        int width, height;
+        int stride;
+        const uint8_t *buffer;
+};
+
+/* A glyph rendered by the prerender thread that is waiting to be
+ * added to the atlas by the main thread.
+ */
+struct vsx_font_prerender_result {
+        struct vsx_list link;
+        enum vsx_font_type type;
+        unsigned glyph_index;
+        struct vsx_font_glyph_image image;
+        uint8_t buffer[];
 };
 
 struct vsx_font_library {
@@ -52,12 +124,29 @@ struct vsx_font_library {
         FT_Bitmap temp_bitmap;
         struct vsx_font_texture *textures;
         struct vsx_font *fonts[VSX_FONT_N_TYPES];
+        int dpi;
+
+        struct vsx_main_thread *main_thread;
+
+        bool prerender_thread_started;
+        pthread_t prerender_thread;
+        pthread_mutex_t prerender_mutex;
+        pthread_cond_t prerender_cond;
+        bool prerender_quit;
+        /* List of vsx_font_prerender_request */
+        struct vsx_list prerender_queue;
+        /* List of vsx_font_prerender_result. They are all added to
+         * the atlas in a single idle callback.
+         */
+        struct vsx_list prerender_finished;
+        struct vsx_main_thread_token *prerender_idle_token;
 };
 
 struct vsx_font_data {
         const char *filename;
         int face_index;
         int size;
+        bool sdf;
 };
 
 static const struct vsx_font_data
@@ -66,11 +155,13 @@ font_types[] = {
                 .filename = "LunaSans-Regular.ttf",
                 .face_index = 0,
                 .size = 8 * 64,
+                .sdf = true,
         },
         [VSX_FONT_TYPE_SYMBOL] = {
                 .filename = "symbols.otf",
                 .face_index = 0,
                 .size = 16 * 64,
+                .sdf = true,
         },
 };
 
@@ -119,6 +210,51 @@ out:
         return ret;
 }
 
+static bool
+open_face(FT_Library ft_library,
+          const uint8_t *font_data,
+          size_t font_data_size,
+          int dpi,
+          const struct vsx_font_data *font_type_data,
+          struct vsx_font_face *face_out)
+{
+        FT_Face face;
+
+        FT_Error ft_error = FT_New_Memory_Face(ft_library,
+                                               font_data,
+                                               font_data_size,
+                                               font_type_data->face_index,
+                                               &face);
+
+        if (ft_error)
+                return false;
+
+        FT_Set_Char_Size(face,
+                         0, /* width (= height) */
+                         font_type_data->size, /* height */
+                         dpi, /* horizontal resolution */
+                         dpi /* vertical resolution */);
+
+        face_out->face = face;
+        face_out->sdf_size = NULL;
+
+        if (font_type_data->sdf) {
+                FT_Size display_size = face->size;
+
+                if (FT_New_Size(face, &face_out->sdf_size) == 0) {
+                        FT_Activate_Size(face_out->sdf_size);
+                        FT_Set_Pixel_Sizes(face,
+                                           0, /* width (= height) */
+                                           VSX_FONT_SDF_SIZE);
+                        FT_Activate_Size(display_size);
+                } else {
+                        face_out->sdf_size = NULL;
+                }
+        }
+
+        return true;
+}
+
 static struct vsx_font *
 open_font(struct vsx_font_library *library,
           struct vsx_asset_manager *asset_manager,
@@ -128,7 +264,7 @@ open_font(struct vsx_font_library *library,
 {
         uint8_t *font_data;
         size_t font_data_size;
-        FT_Face face;
+        struct vsx_font_face face;
 
         if (!load_font_data(asset_manager,
                             font_type_data->filename,
@@ -137,13 +273,12 @@ open_font(struct vsx_font_library *library,
                             error))
                 return false;
 
-        FT_Error ft_error = FT_New_Memory_Face(library->library,
-                                               font_data,
-                                               font_data_size,
-                                               font_type_data->face_index,
-                                               &face);
-
-        if (ft_error) {
+        if (!open_face(library->library,
+                       font_data,
+                       font_data_size,
+                       dpi,
+                       font_type_data,
+                       &face)) {
                 vsx_free(font_data);
                 vsx_set_error(error,
                               &vsx_font_error,
@@ -153,18 +288,21 @@ open_font(struct vsx_font_library *library,
                 return false;
         }
 
-        FT_Set_Char_Size(face,
-                         0, /* width (= height) */
-                         font_type_data->size, /* height */
-                         dpi, /* horizontal resolution */
-                         dpi /* vertical resolution */);
-
         struct vsx_font *font = vsx_alloc(sizeof *font);
 
         font->face = face;
         font->glyph_hash = vsx_glyph_hash_new();
         font->library = library;
         font->font_data = font_data;
+        font->font_data_size = font_data_size;
+
+        if (face.sdf_size) {
+                font->glyph_scale = (font_type_data->size *
+                                     dpi /
+                                     (64.0f * 72.0f * VSX_FONT_SDF_SIZE));
+        } else {
+                font->glyph_scale = 1.0f;
+        }
 
         return font;
 }
@@ -189,40 +327,98 @@ open_fonts(struct vsx_font_library *library,
         return true;
 }
 
-struct vsx_font_library *
-vsx_font_library_new(struct vsx_gl *gl,
-                     struct vsx_asset_manager *asset_manager,
-                     int dpi,
-                     struct vsx_error **error)
+static bool
+init_freetype(FT_Library *ft_library_out)
 {
         FT_Library ft_library;
 
-        FT_Error ft_error = FT_Init_FreeType(&ft_library);
+        if (FT_Init_FreeType(&ft_library) != 0)
+                return false;
 
-        if (ft_error != 0) {
-                vsx_set_error(error,
-                              &vsx_font_error,
-                              VSX_FONT_ERROR_LIBRARY,
-                              "Failed to initialise Freetype");
-                return NULL;
-        }
+        FT_UInt spread = VSX_FONT_SDF_SPREAD;
 
-        struct vsx_font_library *library = vsx_calloc(sizeof *library);
+        FT_Property_Set(ft_library, "sdf", "spread", &spread);
 
-        library->gl = gl;
-        library->library = ft_library;
-        library->textures = NULL;
-        FT_Bitmap_Init(&library->temp_bitmap);
+        *ft_library_out = ft_library;
 
-        if (!open_fonts(library, asset_manager, dpi, error)) {
-                vsx_font_library_free(library);
-                return NULL;
+        return true;
+}
+
+static void
+render_glyph(FT_Library ft_library,
+             FT_Bitmap *temp_bitmap,
+             const struct vsx_font_face *face_data,
+             unsigned glyph_index,
+             struct vsx_font_glyph_image *image)
+{
+        FT_Face face = face_data->face;
+        FT_GlyphSlot glyph = face->glyph;
+
+        memset(image, 0, sizeof *image);
+
+        if (face_data->sdf_size) {
+                FT_Size display_size = face->size;
+
+                /* The advance is taken from the display size so that
+                 * the text is laid out the same as with a bitmap
+                 * font.
+                 */
+                if (FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT) != 0)
+                        return;
+
+                image->x_advance = glyph->advance.x;
+
+                /* The outline is rendered without hinting because it
+                 * will be scaled to an arbitrary size when it is
+                 * painted.
+                 */
+                FT_Activate_Size(face_data->sdf_size);
+
+                FT_Error error = FT_Load_Glyph(face,
+                                               glyph_index,
+                                               FT_LOAD_NO_HINTING);
+
+                if (error == 0)
+                        error = FT_Render_Glyph(glyph, FT_RENDER_MODE_SDF);
+
+                FT_Activate_Size(display_size);
+
+                if (error != 0)
+                        return;
+        } else {
+                if (FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER) != 0)
+                        return;
+
+                image->x_advance = glyph->advance.x;
         }
 
-        return library;
+        if (FT_Bitmap_Convert(ft_library,
+                              &glyph->bitmap,
+                              temp_bitmap,
+                              4 /* alignment */) != 0)
+                return;
+
+        image->left = glyph->bitmap_left;
+        image->top = glyph->bitmap_top;
+        image->width = temp_bitmap->width;
+        image->height = temp_bitmap->rows;
+        image->stride = temp_bitmap->pitch;
+        image->buffer = temp_bitmap->buffer;
 }
 
-static void
+static bool
+add_to_texture(struct vsx_font_texture *texture,
+               int width, int height,
+               int *x_out, int *y_out)
+{
+#ifdef VSX_GLYPH_PACKER_BSP
+        return vsx_bsp_add(texture->bsp, width, height, x_out, y_out);
+#else
+        return vsx_skyline_add(texture->skyline, width, height, x_out, y_out);
+#endif
+}
+
+static struct vsx_font_texture *
 reserve_texture_space(struct vsx_font *font,
                       struct vsx_glyph_hash_entry *hash_entry,
                       int width, int height,
@@ -234,9 +430,8 @@ reserve_texture_space(struct vsx_font *font,
         for (texture = font->library->textures;
              texture;
              texture = texture->next) {
-                if (vsx_bsp_add(texture->bsp, width, height, &x, &y)) {
+                if (add_to_texture(texture, width, height, &x, &y))
                         goto found;
-                }
         }
 
         texture = vsx_alloc(sizeof *texture);
@@ -245,8 +440,21 @@ reserve_texture_space(struct vsx_font *font,
 
         struct vsx_gl *gl = font->library->gl;
 
+#ifdef VSX_GLYPH_PACKER_BSP
         texture->bsp = vsx_bsp_new(VSX_FONT_TEXTURE_SIZE,
                                    VSX_FONT_TEXTURE_SIZE);
+#else
+        texture->skyline = vsx_skyline_new(VSX_FONT_TEXTURE_SIZE,
+                                           VSX_FONT_TEXTURE_SIZE);
+#endif
+        texture->data = vsx_calloc(VSX_FONT_TEXTURE_SIZE *
+                                   VSX_FONT_TEXTURE_SIZE);
+        /* Upload the whole texture the first time so that the space
+         * between the glyphs is cleared.
+         */
+        texture->dirty_y1 = 0;
+        texture->dirty_y2 = VSX_FONT_TEXTURE_SIZE;
+
         gl->glGenTextures(1, &texture->tex);
         gl->glBindTexture(GL_TEXTURE_2D, texture->tex);
         gl->glTexImage2D(GL_TEXTURE_2D,
@@ -264,14 +472,17 @@ reserve_texture_space(struct vsx_font *font,
         gl->glTexParameteri(GL_TEXTURE_2D,
                             GL_TEXTURE_WRAP_T,
                             GL_CLAMP_TO_EDGE);
+        /* Bitmap glyphs are always painted at their natural size so
+         * the filter only makes a difference for SDF glyphs.
+         */
         gl->glTexParameteri(GL_TEXTURE_2D,
                             GL_TEXTURE_MIN_FILTER,
-                            GL_NEAREST);
+                            GL_LINEAR);
         gl->glTexParameteri(GL_TEXTURE_2D,
                             GL_TEXTURE_MAG_FILTER,
                             GL_LINEAR);
 
-        vsx_bsp_add(texture->bsp, width, height, &x, &y);
+        add_to_texture(texture, width, height, &x, &y);
 
 found:
         hash_entry->tex_num = texture->tex;
@@ -282,13 +493,289 @@ found:
 
         *x_out = x;
         *y_out = y;
+
+        return texture;
+}
+
+static void
+add_glyph_image(struct vsx_font *font,
+                struct vsx_glyph_hash_entry *hash_entry,
+                const struct vsx_font_glyph_image *image)
+{
+        hash_entry->x_advance = image->x_advance;
+        hash_entry->tex_num = 0;
+        hash_entry->width = image->width;
+        hash_entry->height = image->height;
+
+        if (image->width <= 0 || image->height <= 0)
+                return;
+
+        int tex_x, tex_y;
+
+        struct vsx_font_texture *texture =
+                reserve_texture_space(font,
+                                      hash_entry,
+                                      image->width,
+                                      image->height,
+                                      &tex_x, &tex_y);
+
+        hash_entry->left = image->left;
+        hash_entry->top = image->top;
+
+        for (int y = 0; y < image->height; y++) {
+                memcpy(texture->data +
+                       (tex_y + y) * VSX_FONT_TEXTURE_SIZE +
+                       tex_x,
+                       image->buffer + y * image->stride,
+                       image->width);
+        }
+
+        if (texture->dirty_y2 <= texture->dirty_y1) {
+                texture->dirty_y1 = tex_y;
+                texture->dirty_y2 = tex_y + image->height;
+        } else {
+                texture->dirty_y1 = MIN(texture->dirty_y1, tex_y);
+                texture->dirty_y2 = MAX(texture->dirty_y2,
+                                        tex_y + image->height);
+        }
+}
+
+static void
+prerender_idle_cb(void *user_data)
+{
+        struct vsx_font_library *library = user_data;
+        struct vsx_list finished;
+
+        pthread_mutex_lock(&library->prerender_mutex);
+
+        /* Steal the whole list so that the thread can carry on
+         * adding to it while the glyphs are added to the atlas.
+         */
+        vsx_list_init(&finished);
+        vsx_list_insert_list(&finished, &library->prerender_finished);
+        vsx_list_init(&library->prerender_finished);
+
+        library->prerender_idle_token = NULL;
+
+        pthread_mutex_unlock(&library->prerender_mutex);
+
+        struct vsx_font_prerender_result *result, *tmp;
+
+        vsx_list_for_each_safe(result, tmp, &finished, link) {
+                struct vsx_font *font = library->fonts[result->type];
+                bool added;
+                struct vsx_glyph_hash_entry *hash_entry =
+                        vsx_glyph_hash_get(font->glyph_hash,
+                                           result->glyph_index,
+                                           &added);
+
+                /* The glyph might have been needed by a layout before
+                 * the thread got to it.
+                 */
+                if (added)
+                        add_glyph_image(font, hash_entry, &result->image);
+
+                vsx_free(result);
+        }
+}
+
+static struct vsx_font_prerender_result *
+create_prerender_result(enum vsx_font_type type,
+                        unsigned glyph_index,
+                        const struct vsx_font_glyph_image *image)
+{
+        size_t buffer_size = image->width * image->height;
+        struct vsx_font_prerender_result *result =
+                vsx_alloc(offsetof(struct vsx_font_prerender_result,
+                                   buffer) +
+                          buffer_size);
+
+        result->type = type;
+        result->glyph_index = glyph_index;
+        result->image = *image;
+        result->image.stride = image->width;
+        result->image.buffer = result->buffer;
+
+        for (int y = 0; y < image->height; y++) {
+                memcpy(result->buffer + y * image->width,
+                       image->buffer + y * image->stride,
+                       image->width);
+        }
+
+        return result;
+}
+
+static void
+prerender_glyphs(struct vsx_font_library *library,
+                 FT_Library ft_library,
+                 FT_Bitmap *temp_bitmap,
+                 const struct vsx_font_face *faces,
+                 const struct vsx_font_prerender_request *request)
+{
+        struct vsx_list results;
+
+        vsx_list_init(&results);
+
+        for (size_t i = 0; i < request->n_glyphs; i++) {
+                struct vsx_font_glyph_image image;
+
+                render_glyph(ft_library,
+                             temp_bitmap,
+                             faces + request->type,
+                             request->glyphs[i],
+                             &image);
+
+                struct vsx_font_prerender_result *result =
+                        create_prerender_result(request->type,
+                                                request->glyphs[i],
+                                                &image);
+
+                vsx_list_insert(results.prev, &result->link);
+        }
+
+        pthread_mutex_lock(&library->prerender_mutex);
+
+        vsx_list_insert_list(library->prerender_finished.prev, &results);
+
+        if (library->prerender_idle_token == NULL) {
+                library->prerender_idle_token =
+                        vsx_main_thread_queue_idle(library->main_thread,
+                                                   prerender_idle_cb,
+                                                   library);
+        }
+
+        pthread_mutex_unlock(&library->prerender_mutex);
+}
+
+static void *
+prerender_thread_func(void *user_data)
+{
+        struct vsx_font_library *library = user_data;
+        FT_Library ft_library = NULL;
+        FT_Bitmap temp_bitmap;
+        struct vsx_font_face faces[VSX_FONT_N_TYPES];
+        /* The thread still needs to run to free the requests even if
+         * FreeType couldn’t be initialised.
+         */
+        bool faces_ok = init_freetype(&ft_library);
+
+        FT_Bitmap_Init(&temp_bitmap);
+
+        /* The font data is only freed after the thread is joined so
+         * it is safe to share it.
+         */
+        for (int i = 0; faces_ok && i < VSX_FONT_N_TYPES; i++) {
+                if (!open_face(ft_library,
+                               library->fonts[i]->font_data,
+                               library->fonts[i]->font_data_size,
+                               library->dpi,
+                               font_types + i,
+                               faces + i))
+                        faces_ok = false;
+        }
+
+        pthread_mutex_lock(&library->prerender_mutex);
+
+        while (!library->prerender_quit) {
+                if (vsx_list_empty(&library->prerender_queue)) {
+                        pthread_cond_wait(&library->prerender_cond,
+                                          &library->prerender_mutex);
+                        continue;
+                }
+
+                struct vsx_font_prerender_request *request =
+                        vsx_container_of(library->prerender_queue.next,
+                                         struct vsx_font_prerender_request,
+                                         link);
+                vsx_list_remove(&request->link);
+
+                pthread_mutex_unlock(&library->prerender_mutex);
+
+                /* If the fonts couldn’t be opened then the glyphs
+                 * will just be rendered on the main thread when they
+                 * are needed.
+                 */
+                if (faces_ok) {
+                        prerender_glyphs(library,
+                                         ft_library,
+                                         &temp_bitmap,
+                                         faces,
+                                         request);
+                }
+
+                vsx_free(request);
+
+                pthread_mutex_lock(&library->prerender_mutex);
+        }
+
+        pthread_mutex_unlock(&library->prerender_mutex);
+
+        if (ft_library) {
+                FT_Bitmap_Done(ft_library, &temp_bitmap);
+                /* This also frees the faces */
+                FT_Done_FreeType(ft_library);
+        }
+
+        return NULL;
+}
+
+static void
+start_prerender_thread(struct vsx_font_library *library)
+{
+        library->prerender_thread_started =
+                vsx_thread_create(&library->prerender_thread,
+                                  "FontPrerender",
+                                  NULL, /* attr */
+                                  prerender_thread_func,
+                                  library) == 0;
+}
+
+struct vsx_font_library *
+vsx_font_library_new(struct vsx_gl *gl,
+                     struct vsx_main_thread *main_thread,
+                     struct vsx_asset_manager *asset_manager,
+                     int dpi,
+                     struct vsx_error **error)
+{
+        FT_Library ft_library;
+
+        if (!init_freetype(&ft_library)) {
+                vsx_set_error(error,
+                              &vsx_font_error,
+                              VSX_FONT_ERROR_LIBRARY,
+                              "Failed to initialise Freetype");
+                return NULL;
+        }
+
+        struct vsx_font_library *library = vsx_calloc(sizeof *library);
+
+        library->gl = gl;
+        library->main_thread = main_thread;
+        library->dpi = dpi;
+        library->library = ft_library;
+        library->textures = NULL;
+        FT_Bitmap_Init(&library->temp_bitmap);
+
+        pthread_mutex_init(&library->prerender_mutex, NULL);
+        pthread_cond_init(&library->prerender_cond, NULL);
+        vsx_list_init(&library->prerender_queue);
+        vsx_list_init(&library->prerender_finished);
+
+        if (!open_fonts(library, asset_manager, dpi, error)) {
+                vsx_font_library_free(library);
+                return NULL;
+        }
+
+        start_prerender_thread(library);
+
+        return library;
 }
 
 unsigned
 vsx_font_look_up_glyph(struct vsx_font *font,
                        uint32_t unicode)
 {
-        return FT_Get_Char_Index(font->face, unicode);
+        return FT_Get_Char_Index(font->face.face, unicode);
 }
 
 struct vsx_glyph_hash_entry *
@@ -302,62 +789,131 @@ vsx_font_prepare_glyph(struct vsx_font *font,
         if (!added)
                 return hash_entry;
 
-        hash_entry->x_advance = 0;
-        hash_entry->tex_num = 0;
+        struct vsx_font_glyph_image image;
 
-        FT_Error error = FT_Load_Glyph(font->face,
-                                       glyph_index,
-                                       FT_LOAD_RENDER);
+        render_glyph(font->library->library,
+                     &font->library->temp_bitmap,
+                     &font->face,
+                     glyph_index,
+                     &image);
 
-        if (error != 0)
-                return hash_entry;
+        add_glyph_image(font, hash_entry, &image);
+
+        return hash_entry;
+}
 
-        FT_GlyphSlot glyph = font->face->glyph;
+static bool
+has_glyph(const struct vsx_buffer *glyphs,
+          unsigned glyph_index)
+{
+        const unsigned *data = (const unsigned *) glyphs->data;
+        size_t n_glyphs = glyphs->length / sizeof *data;
 
-        hash_entry->x_advance = glyph->advance.x;
+        for (size_t i = 0; i < n_glyphs; i++) {
+                if (data[i] == glyph_index)
+                        return true;
+        }
 
-        if (FT_Bitmap_Convert(font->library->library,
-                              &glyph->bitmap,
-                              &font->library->temp_bitmap,
-                              4 /* alignment */) != 0)
-                return hash_entry;
+        return false;
+}
+
+void
+vsx_font_library_prerender(struct vsx_font_library *library,
+                           enum vsx_font_type type,
+                           const char *text)
+{
+        assert(type >= 0 && type < VSX_FONT_N_TYPES);
 
-        hash_entry->width = font->library->temp_bitmap.width;
-        hash_entry->height = font->library->temp_bitmap.rows;
+        if (!library->prerender_thread_started)
+                return;
 
-        struct vsx_gl *gl = font->library->gl;
+        struct vsx_font *font = library->fonts[type];
+        struct vsx_buffer glyphs = VSX_BUFFER_STATIC_INIT;
 
-        if (hash_entry->width > 0 && hash_entry->height > 0) {
-                int tex_x, tex_y;
+        /* The glyphs are looked up with the main thread’s face so
+         * that any that are already in the atlas can be skipped.
+         */
+        for (const char *p = text; *p; p = vsx_utf8_next(p)) {
+                unsigned glyph_index =
+                        vsx_font_look_up_glyph(font, vsx_utf8_get_char(p));
 
-                reserve_texture_space(font,
-                                      hash_entry,
-                                      hash_entry->width,
-                                      hash_entry->height,
-                                      &tex_x, &tex_y);
+                if (vsx_glyph_hash_lookup(font->glyph_hash, glyph_index) ||
+                    has_glyph(&glyphs, glyph_index))
+                        continue;
+
+                vsx_buffer_append(&glyphs, &glyph_index, sizeof glyph_index);
+        }
+
+        if (glyphs.length > 0) {
+                struct vsx_font_prerender_request *request =
+                        vsx_alloc(offsetof(struct vsx_font_prerender_request,
+                                           glyphs) +
+                                  glyphs.length);
+
+                request->type = type;
+                request->n_glyphs = glyphs.length / sizeof (unsigned);
+                memcpy(request->glyphs, glyphs.data, glyphs.length);
+
+                pthread_mutex_lock(&library->prerender_mutex);
+                vsx_list_insert(library->prerender_queue.prev,
+                                &request->link);
+                pthread_cond_signal(&library->prerender_cond);
+                pthread_mutex_unlock(&library->prerender_mutex);
+        }
+
+        vsx_buffer_destroy(&glyphs);
+}
 
-                hash_entry->left = glyph->bitmap_left;
-                hash_entry->top = glyph->bitmap_top;
+void
+vsx_font_library_upload(struct vsx_font_library *library)
+{
+        struct vsx_gl *gl = library->gl;
 
-                gl->glBindTexture(GL_TEXTURE_2D, hash_entry->tex_num);
+        for (struct vsx_font_texture *texture = library->textures;
+             texture;
+             texture = texture->next) {
+                if (texture->dirty_y2 <= texture->dirty_y1)
+                        continue;
+
+                /* GLES2 can’t upload part of a row from a larger
+                 * image so the whole width of the dirty rows is
+                 * uploaded.
+                 */
+                gl->glBindTexture(GL_TEXTURE_2D, texture->tex);
                 gl->glTexSubImage2D(GL_TEXTURE_2D,
                                     0, /* level */
-                                    tex_x, tex_y,
-                                    hash_entry->width,
-                                    hash_entry->height,
+                                    0, /* x */
+                                    texture->dirty_y1,
+                                    VSX_FONT_TEXTURE_SIZE,
+                                    texture->dirty_y2 - texture->dirty_y1,
                                     GL_ALPHA,
                                     GL_UNSIGNED_BYTE,
-                                    font->library->temp_bitmap.buffer);
+                                    texture->data +
+                                    texture->dirty_y1 *
+                                    VSX_FONT_TEXTURE_SIZE);
+
+                texture->dirty_y1 = texture->dirty_y2 = 0;
         }
+}
 
-        return hash_entry;
+bool
+vsx_font_is_sdf(struct vsx_font *font)
+{
+        return font->face.sdf_size != NULL;
+}
+
+float
+vsx_font_get_glyph_scale(struct vsx_font *font)
+{
+        return font->glyph_scale;
 }
 
 void
 vsx_font_get_metrics(struct vsx_font *font,
                      struct vsx_font_metrics *metrics)
 {
-        const FT_Size_Metrics *face_metrics = &font->face->size->metrics;
+        const FT_Size_Metrics *face_metrics =
+                &font->face.face->size->metrics;
 
         metrics->ascender = face_metrics->ascender / 64.0f;
         metrics->descender = face_metrics->descender / 64.0f;
@@ -383,11 +939,53 @@ vsx_font_library_get_font(struct vsx_font_library *library,
         return library->fonts[type];
 }
 
+static void
+stop_prerender_thread(struct vsx_font_library *library)
+{
+        if (library->prerender_thread_started) {
+                pthread_mutex_lock(&library->prerender_mutex);
+                library->prerender_quit = true;
+                pthread_cond_signal(&library->prerender_cond);
+                pthread_mutex_unlock(&library->prerender_mutex);
+
+                pthread_join(library->prerender_thread, NULL);
+        }
+
+        pthread_mutex_destroy(&library->prerender_mutex);
+        pthread_cond_destroy(&library->prerender_cond);
+
+        if (library->prerender_idle_token)
+                vsx_main_thread_cancel_idle(library->prerender_idle_token);
+
+        struct vsx_font_prerender_request *request, *tmp_request;
+
+        vsx_list_for_each_safe(request,
+                               tmp_request,
+                               &library->prerender_queue,
+                               link) {
+                vsx_free(request);
+        }
+
+        struct vsx_font_prerender_result *result, *tmp_result;
+
+        vsx_list_for_each_safe(result,
+                               tmp_result,
+                               &library->prerender_finished,
+                               link) {
+                vsx_free(result);
+        }
+}
+
 void
 vsx_font_library_free(struct vsx_font_library *library)
 {
         struct vsx_font_texture *next;
 
+        /* The thread uses the font data so it needs to be stopped
+         * before the fonts are freed.
+         */
+        stop_prerender_thread(library);
+
         for (int i = 0; i < VSX_N_ELEMENTS(library->fonts); i++) {
                 if (library->fonts[i])
                         free_font(library->fonts[i]);
@@ -400,7 +998,12 @@ vsx_font_library_free(struct vsx_font_library *library)
              tex = next) {
                 next = tex->next;
                 gl->glDeleteTextures(1, &tex->tex);
+#ifdef VSX_GLYPH_PACKER_BSP
                 vsx_bsp_free(tex->bsp);
+#else
+                vsx_skyline_free(tex->skyline);
+#endif
+                vsx_free(tex->data);
                 vsx_free(tex);
         }
 
@@ -20,11 +20,13 @@
 #define VSX_FONT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "vsx-error.h"
 #include "vsx-gl.h"
 #include "vsx-asset.h"
 #include "vsx-glyph-hash.h"
+#include "vsx-main-thread.h"
 
 struct vsx_font;
 struct vsx_font_library;
@@ -44,12 +46,24 @@ enum vsx_font_type {
         VSX_FONT_N_TYPES,
 };
 
+/* Number of pixels that the distance field of an SDF glyph extends
+ * outside of its outline. The distance is stored so that 0.5 is on
+ * the outline and a difference of 0.5 covers the spread.
+ */
+#define VSX_FONT_SDF_SPREAD 4
+
+/* Size of the em square in pixels that SDF glyphs are rendered at,
+ * regardless of the size that they will be painted at.
+ */
+#define VSX_FONT_SDF_SIZE 32
+
 struct vsx_font_metrics {
         float ascender, descender, height;
 };
 
 struct vsx_font_library *
 vsx_font_library_new(struct vsx_gl *gl,
+                     struct vsx_main_thread *main_thread,
                      struct vsx_asset_manager *asset_manager,
                      int dpi,
                      struct vsx_error **error);
@@ -66,6 +80,38 @@ struct vsx_glyph_hash_entry *
 vsx_font_prepare_glyph(struct vsx_font *font,
                        unsigned glyph_index);
 
+/* Returns true if the glyphs of the font are stored as signed distance
+ * fields. These need to be painted with the SDF layout program.
+ */
+bool
+vsx_font_is_sdf(struct vsx_font *font);
+
+/* Returns the size in pixels at the font’s size of a texel of the
+ * glyph images. The left, top, width and height of the glyph hash
+ * entries are in texels and should be multiplied by this. It is 1.0
+ * unless the font is an SDF font.
+ */
+float
+vsx_font_get_glyph_scale(struct vsx_font *font);
+
+/* Queues the glyphs needed for the text to be rendered on a separate
+ * thread so that they will already be in the atlas when a layout
+ * needs them. The rendered glyphs are added to the atlas from an idle
+ * callback on the main thread.
+ */
+void
+vsx_font_library_prerender(struct vsx_font_library *library,
+                           enum vsx_font_type type,
+                           const char *text);
+
+/* Glyphs are added to a copy of the atlas in memory. This uploads
+ * the rows that have changed since the last call, with one upload
+ * per texture. It needs to be called after the layouts are prepared
+ * and before they are painted.
+ */
+void
+vsx_font_library_upload(struct vsx_font_library *library);
+
 void
 vsx_font_get_metrics(struct vsx_font *font,
                      struct vsx_font_metrics *metrics);
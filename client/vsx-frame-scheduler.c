@@ -0,0 +1,202 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-frame-scheduler.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "vsx-util.h"
+
+/* Refresh interval to use if the display doesn’t report one */
+#define VSX_FRAME_SCHEDULER_DEFAULT_INTERVAL (1000000 / 60)
+
+struct vsx_frame_scheduler {
+        int n_painters;
+        const char * const *painter_names;
+
+        int64_t refresh_interval;
+
+        bool redraw_queued;
+
+        bool in_frame;
+        bool have_last_frame;
+        int64_t last_frame_start;
+        int64_t frame_interval;
+
+        /* Ring buffer of frames. history_start is the index of the
+         * oldest frame.
+         */
+        struct vsx_frame_scheduler_frame history
+        [VSX_FRAME_SCHEDULER_HISTORY_SIZE];
+        int history_start;
+        int n_frames;
+};
+
+struct vsx_frame_scheduler *
+vsx_frame_scheduler_new(int n_painters,
+                        const char * const *painter_names)
+{
+        assert(n_painters >= 0 &&
+               n_painters <= VSX_FRAME_SCHEDULER_MAX_PAINTERS);
+
+        struct vsx_frame_scheduler *sched = vsx_calloc(sizeof *sched);
+
+        sched->n_painters = n_painters;
+        sched->painter_names = painter_names;
+        sched->refresh_interval = VSX_FRAME_SCHEDULER_DEFAULT_INTERVAL;
+
+        return sched;
+}
+
+void
+vsx_frame_scheduler_set_refresh_interval(struct vsx_frame_scheduler *sched,
+                                         int64_t interval)
+{
+        if (interval <= 0)
+                interval = VSX_FRAME_SCHEDULER_DEFAULT_INTERVAL;
+
+        sched->refresh_interval = interval;
+}
+
+void
+vsx_frame_scheduler_queue_redraw(struct vsx_frame_scheduler *sched)
+{
+        sched->redraw_queued = true;
+}
+
+int64_t
+vsx_frame_scheduler_get_delay(struct vsx_frame_scheduler *sched,
+                              int64_t now)
+{
+        if (!sched->redraw_queued)
+                return -1;
+
+        if (!sched->have_last_frame)
+                return 0;
+
+        int64_t next_frame = sched->last_frame_start + sched->refresh_interval;
+
+        return MAX(next_frame - now, 0);
+}
+
+void
+vsx_frame_scheduler_begin_frame(struct vsx_frame_scheduler *sched,
+                                int64_t now)
+{
+        assert(!sched->in_frame);
+
+        sched->frame_interval = (sched->have_last_frame ?
+                                 now - sched->last_frame_start :
+                                 -1);
+
+        sched->in_frame = true;
+        sched->have_last_frame = true;
+        sched->last_frame_start = now;
+        sched->redraw_queued = false;
+}
+
+void
+vsx_frame_scheduler_end_frame(struct vsx_frame_scheduler *sched,
+                              int64_t now,
+                              unsigned n_draw_calls,
+                              const int64_t *painter_times)
+{
+        assert(sched->in_frame);
+
+        sched->in_frame = false;
+
+        struct vsx_frame_scheduler_frame *frame;
+
+        if (sched->n_frames < VSX_N_ELEMENTS(sched->history)) {
+                frame = sched->history +
+                        (sched->history_start + sched->n_frames) %
+                        VSX_N_ELEMENTS(sched->history);
+                sched->n_frames++;
+        } else {
+                /* Overwrite the oldest frame */
+                frame = sched->history + sched->history_start;
+                sched->history_start = ((sched->history_start + 1) %
+                                        VSX_N_ELEMENTS(sched->history));
+        }
+
+        frame->interval = sched->frame_interval;
+        frame->paint_time = now - sched->last_frame_start;
+        frame->n_draw_calls = n_draw_calls;
+
+        for (int i = 0; i < sched->n_painters; i++)
+                frame->painter_times[i] = painter_times[i];
+}
+
+int
+vsx_frame_scheduler_get_n_frames(struct vsx_frame_scheduler *sched)
+{
+        return sched->n_frames;
+}
+
+const struct vsx_frame_scheduler_frame *
+vsx_frame_scheduler_get_frame(struct vsx_frame_scheduler *sched,
+                              int frame_num)
+{
+        assert(frame_num >= 0 && frame_num < sched->n_frames);
+
+        return sched->history + ((sched->history_start + frame_num) %
+                                 VSX_N_ELEMENTS(sched->history));
+}
+
+void
+vsx_frame_scheduler_dump(struct vsx_frame_scheduler *sched,
+                         struct vsx_buffer *buffer)
+{
+        vsx_buffer_append_string(buffer, "interval paint draws");
+
+        for (int i = 0; i < sched->n_painters; i++) {
+                vsx_buffer_append_printf(buffer,
+                                         " %s",
+                                         sched->painter_names[i]);
+        }
+
+        vsx_buffer_append_c(buffer, '\n');
+
+        for (int i = 0; i < sched->n_frames; i++) {
+                const struct vsx_frame_scheduler_frame *frame =
+                        vsx_frame_scheduler_get_frame(sched, i);
+
+                vsx_buffer_append_printf(buffer,
+                                         "%" PRIi64 " %" PRIi64 " %u",
+                                         frame->interval,
+                                         frame->paint_time,
+                                         frame->n_draw_calls);
+
+                for (int j = 0; j < sched->n_painters; j++) {
+                        vsx_buffer_append_printf(buffer,
+                                                 " %" PRIi64,
+                                                 frame->painter_times[j]);
+                }
+
+                vsx_buffer_append_c(buffer, '\n');
+        }
+}
+
+void
+vsx_frame_scheduler_free(struct vsx_frame_scheduler *sched)
+{
+        vsx_free(sched);
+}
@@ -0,0 +1,107 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_FRAME_SCHEDULER_H
+#define VSX_FRAME_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vsx-buffer.h"
+
+/* The frame scheduler decides when the next frame should be painted.
+ * Any number of redraw requests between two frames cause only one
+ * frame to be painted, and frames are never started more often than
+ * the refresh rate of the display. It also keeps a history of the
+ * timings of the most recent frames which can be dumped for
+ * debugging. All of the times are in microseconds.
+ */
+
+#define VSX_FRAME_SCHEDULER_MAX_PAINTERS 16
+
+/* Number of frames remembered in the history */
+#define VSX_FRAME_SCHEDULER_HISTORY_SIZE 128
+
+struct vsx_frame_scheduler;
+
+struct vsx_frame_scheduler_frame {
+        /* Time since the start of the previous frame or -1 if there
+         * wasn’t one.
+         */
+        int64_t interval;
+        /* Time from the start of the frame until it was finished */
+        int64_t paint_time;
+        unsigned n_draw_calls;
+        int64_t painter_times[VSX_FRAME_SCHEDULER_MAX_PAINTERS];
+};
+
+struct vsx_frame_scheduler *
+vsx_frame_scheduler_new(int n_painters,
+                        const char * const *painter_names);
+
+void
+vsx_frame_scheduler_set_refresh_interval(struct vsx_frame_scheduler *sched,
+                                         int64_t interval);
+
+void
+vsx_frame_scheduler_queue_redraw(struct vsx_frame_scheduler *sched);
+
+/* Returns how long to wait before the next frame should be painted.
+ * This is zero if it should be painted straight away or -1 if no
+ * redraw has been queued.
+ */
+int64_t
+vsx_frame_scheduler_get_delay(struct vsx_frame_scheduler *sched,
+                              int64_t now);
+
+/* Marks the start of painting a frame. Any redraws queued after this
+ * will cause another frame.
+ */
+void
+vsx_frame_scheduler_begin_frame(struct vsx_frame_scheduler *sched,
+                                int64_t now);
+
+/* Records the timings of the frame that was started with
+ * vsx_frame_scheduler_begin_frame. painter_times should have an
+ * entry for each painter given to vsx_frame_scheduler_new.
+ */
+void
+vsx_frame_scheduler_end_frame(struct vsx_frame_scheduler *sched,
+                              int64_t now,
+                              unsigned n_draw_calls,
+                              const int64_t *painter_times);
+
+int
+vsx_frame_scheduler_get_n_frames(struct vsx_frame_scheduler *sched);
+
+/* Gets one of the frames in the history. Frame zero is the oldest
+ * one that is still remembered.
+ */
+const struct vsx_frame_scheduler_frame *
+vsx_frame_scheduler_get_frame(struct vsx_frame_scheduler *sched,
+                              int frame_num);
+
+/* Appends a human-readable table of the frame history to the buffer */
+void
+vsx_frame_scheduler_dump(struct vsx_frame_scheduler *sched,
+                         struct vsx_buffer *buffer);
+
+void
+vsx_frame_scheduler_free(struct vsx_frame_scheduler *sched);
+
+#endif /* VSX_FRAME_SCHEDULER_H */
@@ -21,6 +21,7 @@
 #include "vsx-game-painter.h"
 
 #include <stdbool.h>
+#include <assert.h>
 #include <math.h>
 #include <string.h>
 
@@ -35,6 +36,10 @@
 #include "vsx-gl.h"
 #include "vsx-board.h"
 #include "vsx-monotonic.h"
+#include "vsx-text.h"
+#include "vsx-tile-texture.h"
+#include "vsx-utf8.h"
+#include "vsx-buffer.h"
 
 static const struct vsx_painter * const
 painters[] = {
@@ -49,6 +54,23 @@ painters[] = {
 
 #define N_PAINTERS VSX_N_ELEMENTS(painters)
 
+_Static_assert(N_PAINTERS == VSX_GAME_PAINTER_N_PAINTERS,
+               "VSX_GAME_PAINTER_N_PAINTERS needs to be updated");
+
+static const char * const
+painter_names[] = {
+        "board",
+        "tile",
+        "fireworks",
+        "button",
+        "dialog",
+        "note",
+        "error",
+};
+
+_Static_assert(VSX_N_ELEMENTS(painter_names) == N_PAINTERS,
+               "There should be a name for each painter");
+
 struct finger {
         /* Screen position of the finger when it was pressed */
         int start_x, start_y;
@@ -66,11 +88,14 @@ struct vsx_game_painter {
         bool shader_data_inited;
 
         struct vsx_game_state *game_state;
+        struct vsx_listener modified_listener;
 
         bool viewport_dirty;
 
         struct painter_data painters[N_PAINTERS];
 
+        struct vsx_game_painter_frame_stats frame_stats;
+
         struct finger fingers[2];
         /* Bitmask of pressed fingers */
         int fingers_pressed;
@@ -91,6 +116,10 @@ struct vsx_game_painter {
  * much.
  */
 #define MAX_CLICK_TIME (750 * 1000)
+/* Number of prepared layouts to keep. This is enough for all of the
+ * UI strings in every language along with the player names.
+ */
+#define VSX_GAME_PAINTER_LAYOUT_CACHE_SIZE 128
 
 static void
 init_painters(struct vsx_game_painter *painter)
@@ -106,6 +135,58 @@ init_painters(struct vsx_game_painter *painter)
         }
 }
 
+static void
+prerender_text(struct vsx_game_painter *painter)
+{
+        enum vsx_text_language language =
+                vsx_game_state_get_language(painter->game_state);
+        struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+
+        /* Render the glyphs for all of the UI strings and the tile
+         * letters in the background so that opening a dialog doesn’t
+         * have to wait for them.
+         */
+        for (int i = 0; i < VSX_TEXT_N_TEXTS; i++)
+                vsx_buffer_append_string(&buf, vsx_text_get(language, i));
+
+        for (int i = 0; i < VSX_TILE_TEXTURE_N_LETTERS; i++) {
+                char letter[VSX_UTF8_MAX_CHAR_LENGTH];
+                int letter_length =
+                        vsx_utf8_encode(vsx_tile_texture_letters[i].letter,
+                                        letter);
+
+                vsx_buffer_append(&buf, letter, letter_length);
+        }
+
+        vsx_buffer_append_c(&buf, '\0');
+
+        vsx_font_library_prerender(painter->toolbox.font_library,
+                                   VSX_FONT_TYPE_LABEL,
+                                   (const char *) buf.data);
+
+        vsx_buffer_destroy(&buf);
+}
+
+static void
+modified_cb(struct vsx_listener *listener,
+            void *user_data)
+{
+        struct vsx_game_painter *painter =
+                vsx_container_of(listener,
+                                 struct vsx_game_painter,
+                                 modified_listener);
+        const struct vsx_game_state_modified_event *event = user_data;
+
+        switch (event->type) {
+        case VSX_GAME_STATE_MODIFIED_TYPE_LANGUAGE:
+                prerender_text(painter);
+                break;
+
+        default:
+                break;
+        }
+}
+
 static bool
 init_toolbox(struct vsx_game_painter *painter,
              struct vsx_shell_interface *shell,
@@ -138,7 +219,6 @@ init_toolbox(struct vsx_game_painter *painter,
         toolbox->shadow_painter = vsx_shadow_painter_new(toolbox->gl,
                                                          shell,
                                                          toolbox->image_loader,
-                                                         toolbox->map_buffer,
                                                          dpi);
 
         toolbox->tile_tool = vsx_tile_tool_new(toolbox->gl,
@@ -147,7 +227,13 @@ init_toolbox(struct vsx_game_painter *painter,
                                                toolbox->map_buffer,
                                                toolbox->quad_tool);
 
+        toolbox->quad_batch = vsx_quad_batch_new(toolbox->gl,
+                                                 toolbox->map_buffer,
+                                                 toolbox->quad_tool,
+                                                 &toolbox->shader_data);
+
         toolbox->font_library = vsx_font_library_new(toolbox->gl,
+                                                     main_thread,
                                                      asset_manager,
                                                      dpi,
                                                      error);
@@ -155,6 +241,9 @@ init_toolbox(struct vsx_game_painter *painter,
         if (toolbox->font_library == NULL)
                 return false;
 
+        toolbox->layout_cache =
+                vsx_layout_cache_new(VSX_GAME_PAINTER_LAYOUT_CACHE_SIZE);
+
         return true;
 }
 
@@ -163,9 +252,15 @@ destroy_toolbox(struct vsx_game_painter *painter)
 {
         struct vsx_toolbox *toolbox = &painter->toolbox;
 
+        if (toolbox->layout_cache)
+                vsx_layout_cache_free(toolbox->layout_cache);
+
         if (toolbox->font_library)
                 vsx_font_library_free(toolbox->font_library);
 
+        if (toolbox->quad_batch)
+                vsx_quad_batch_free(toolbox->quad_batch);
+
         if (toolbox->tile_tool)
                 vsx_tile_tool_free(toolbox->tile_tool);
 
@@ -216,6 +311,12 @@ vsx_game_painter_new(struct vsx_gl *gl,
 
         painter->toolbox.shell = shell;
 
+        prerender_text(painter);
+
+        painter->modified_listener.notify = modified_cb;
+        vsx_signal_add(vsx_game_state_get_modified_signal(game_state),
+                       &painter->modified_listener);
+
         init_painters(painter);
 
         return painter;
@@ -476,18 +577,32 @@ vsx_game_painter_cancel_gesture(struct vsx_game_painter *painter)
 void
 vsx_game_painter_paint(struct vsx_game_painter *painter)
 {
+        int64_t *painter_times = painter->frame_stats.painter_times;
+
         /* Preparation */
 
         for (unsigned i = 0; i < N_PAINTERS; i++) {
+                painter_times[i] = 0;
+
                 if (painters[i]->prepare_cb == NULL)
                         continue;
 
+                int64_t start_time = vsx_monotonic_get();
+
                 painters[i]->prepare_cb(painter->painters[i].data);
+
+                painter_times[i] += vsx_monotonic_get() - start_time;
         }
 
+        /* Upload all of the glyphs that the painters added while
+         * preparing in one go.
+         */
+        vsx_font_library_upload(painter->toolbox.font_library);
+
         /* Painting */
 
         struct vsx_gl *gl = painter->toolbox.gl;
+        unsigned start_n_draw_calls = gl->n_draw_calls;
 
         if (painter->viewport_dirty) {
                 gl->glViewport(0, 0,
@@ -503,8 +618,36 @@ vsx_game_painter_paint(struct vsx_game_painter *painter)
                 if (painters[i]->paint_cb == NULL)
                         continue;
 
+                int64_t start_time = vsx_monotonic_get();
+
                 painters[i]->paint_cb(painter->painters[i].data);
+
+                painter_times[i] += vsx_monotonic_get() - start_time;
         }
+
+        /* The batch is otherwise only flushed when something needs
+         * to change the GL state, so draw anything left over from
+         * the last painters.
+         */
+        vsx_quad_batch_flush(painter->toolbox.quad_batch);
+
+        painter->frame_stats.n_draw_calls =
+                gl->n_draw_calls - start_n_draw_calls;
+}
+
+void
+vsx_game_painter_get_frame_stats(struct vsx_game_painter *painter,
+                                 struct vsx_game_painter_frame_stats *stats)
+{
+        *stats = painter->frame_stats;
+}
+
+const char *
+vsx_game_painter_get_painter_name(int painter_num)
+{
+        assert(painter_num >= 0 && painter_num < N_PAINTERS);
+
+        return painter_names[painter_num];
 }
 
 static void
@@ -525,6 +668,9 @@ vsx_game_painter_free(struct vsx_game_painter *painter)
 {
         clear_maybe_click_timeout(painter);
 
+        if (painter->modified_listener.notify)
+                vsx_list_remove(&painter->modified_listener.link);
+
         free_painters(painter);
 
         destroy_toolbox(painter);
@@ -34,6 +34,16 @@
 
 struct vsx_game_painter;
 
+/* Number of painters that the game painter owns */
+#define VSX_GAME_PAINTER_N_PAINTERS 7
+
+/* Statistics about the last frame that was painted */
+struct vsx_game_painter_frame_stats {
+        unsigned n_draw_calls;
+        /* Time in microseconds spent in each painter */
+        int64_t painter_times[VSX_GAME_PAINTER_N_PAINTERS];
+};
+
 struct vsx_game_painter *
 vsx_game_painter_new(struct vsx_gl *gl,
                      struct vsx_main_thread *main_thread,
@@ -51,6 +61,16 @@ vsx_game_painter_set_fb_size(struct vsx_game_painter *painter,
 void
 vsx_game_painter_paint(struct vsx_game_painter *painter);
 
+void
+vsx_game_painter_get_frame_stats(struct vsx_game_painter *painter,
+                                 struct vsx_game_painter_frame_stats *stats);
+
+/* Returns a short name for the painter that has the given index in
+ * the painter_times array of the frame stats.
+ */
+const char *
+vsx_game_painter_get_painter_name(int painter_num);
+
 void
 vsx_game_painter_press_finger(struct vsx_game_painter *painter,
                               int finger,
@@ -82,6 +82,8 @@ VSX_GL_FUNC(void,
             glEnable, (GLenum cap))
 VSX_GL_FUNC(void,
             glEnableVertexAttribArray, (GLuint index))
+VSX_GL_FUNC(void,
+            glFinish, (void))
 VSX_GL_FUNC(void,
             glGenBuffers, (GLsizei n, GLuint *buffers))
 VSX_GL_FUNC(void,
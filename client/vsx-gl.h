@@ -26,6 +26,8 @@
 #endif
 #include <stdbool.h>
 #include <stdint.h>
+#include <assert.h>
+#include <stddef.h>
 
 #ifndef GL_APIENTRYP
 #define GL_APIENTRYP GL_APIENTRY *
@@ -52,6 +54,19 @@ struct vsx_gl {
          * objects are not available.
          */
         uint32_t enabled_attribs;
+
+        /* Number of draw calls made so far. This is only used to
+         * report statistics.
+         */
+        unsigned n_draw_calls;
+
+        /* Callback to draw anything that has been batched but not
+         * drawn yet. The quad batch sets this while it has pending
+         * quads so that they get drawn before any state is changed
+         * for something that isn’t batched.
+         */
+        void (* flush_cb)(void *data);
+        void *flush_data;
 };
 
 typedef void *
@@ -62,6 +77,48 @@ struct vsx_gl *
 vsx_gl_new(vsx_gl_get_proc_address_func get_proc_address_func,
            void *get_proc_address_data);
 
+/* Draws any pending batched quads */
+static inline void
+vsx_gl_flush(struct vsx_gl *gl)
+{
+        void (* flush_cb)(void *data) = gl->flush_cb;
+
+        if (flush_cb == NULL)
+                return;
+
+        gl->flush_cb = NULL;
+        flush_cb(gl->flush_data);
+}
+
+/* The following wrappers should be used for state changes when
+ * drawing directly so that any pending batched quads are flushed
+ * first and the drawing order is kept.
+ */
+
+static inline void
+vsx_gl_use_program(struct vsx_gl *gl,
+                   GLuint program)
+{
+        vsx_gl_flush(gl);
+        gl->glUseProgram(program);
+}
+
+static inline void
+vsx_gl_enable(struct vsx_gl *gl,
+              GLenum cap)
+{
+        vsx_gl_flush(gl);
+        gl->glEnable(cap);
+}
+
+static inline void
+vsx_gl_disable(struct vsx_gl *gl,
+               GLenum cap)
+{
+        vsx_gl_flush(gl);
+        gl->glDisable(cap);
+}
+
 static inline void
 vsx_gl_draw_range_elements(struct vsx_gl *gl,
                            GLenum mode,
@@ -70,6 +127,13 @@ vsx_gl_draw_range_elements(struct vsx_gl *gl,
                            GLenum type,
                            const GLvoid *indices)
 {
+        /* The state for this draw was set up after flushing the
+         * batch so it should still be empty.
+         */
+        assert(gl->flush_cb == NULL);
+
+        gl->n_draw_calls++;
+
         if (gl->glDrawRangeElements) {
                 gl->glDrawRangeElements(mode,
                                         start, end,
@@ -84,6 +148,19 @@ vsx_gl_draw_range_elements(struct vsx_gl *gl,
         }
 }
 
+static inline void
+vsx_gl_draw_arrays(struct vsx_gl *gl,
+                   GLenum mode,
+                   GLint first,
+                   GLsizei count)
+{
+        assert(gl->flush_cb == NULL);
+
+        gl->n_draw_calls++;
+
+        gl->glDrawArrays(mode, first, count);
+}
+
 void
 vsx_gl_free(struct vsx_gl *gl);
 
@@ -43,6 +43,21 @@ vsx_glyph_hash_new(void)
         return hash;
 }
 
+struct vsx_glyph_hash_entry *
+vsx_glyph_hash_lookup(struct vsx_glyph_hash *hash,
+                      unsigned code)
+{
+        struct vsx_hash_table_entry *hash_entry =
+                vsx_hash_table_get(&hash->table, code);
+
+        if (hash_entry == NULL)
+                return NULL;
+
+        return vsx_container_of(hash_entry,
+                                struct vsx_glyph_hash_entry,
+                                hash_entry);
+}
+
 struct vsx_glyph_hash_entry *
 vsx_glyph_hash_get(struct vsx_glyph_hash *hash,
                    unsigned code,
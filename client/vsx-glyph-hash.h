@@ -43,6 +43,11 @@ struct vsx_glyph_hash_entry {
 struct vsx_glyph_hash *
 vsx_glyph_hash_new(void);
 
+/* Returns NULL if the glyph hasn’t been added */
+struct vsx_glyph_hash_entry *
+vsx_glyph_hash_lookup(struct vsx_glyph_hash *hash,
+                      unsigned code);
+
 struct vsx_glyph_hash_entry *
 vsx_glyph_hash_get(struct vsx_glyph_hash *hash,
                    unsigned code,
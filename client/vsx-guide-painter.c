@@ -216,6 +216,7 @@ start_image_load(struct vsx_guide_painter *painter)
         painter->image_token =
                 vsx_image_loader_load(painter->toolbox->image_loader,
                                       page->image,
+                                      VSX_IMAGE_LOADER_PRIORITY_LOW,
                                       image_loaded_cb,
                                       painter);
 }
@@ -656,6 +657,7 @@ create_cb(struct vsx_game_state *game_state,
         painter->cursor_token =
                 vsx_image_loader_load(toolbox->image_loader,
                                       "cursor.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_LOW,
                                       cursor_loaded_cb,
                                       painter);
 
@@ -910,7 +912,7 @@ paint_background(struct vsx_guide_painter *painter)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         struct vsx_paint_state *paint_state = &painter->toolbox->paint_state;
 
@@ -929,7 +931,7 @@ paint_background(struct vsx_guide_painter *painter)
         else
                 gl->glUniform3f(program->color_uniform, 1.0f, 1.0f, 1.0f);
 
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, N_VERTICES);
+        vsx_gl_draw_arrays(gl, GL_TRIANGLE_STRIP, 0, N_VERTICES);
 }
 
 static void
@@ -946,7 +948,7 @@ paint_shadow(struct vsx_guide_painter *painter)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->toolbox->paint_state.pixel_matrix,
                                  translation);
 }
@@ -1061,10 +1063,10 @@ draw_cursor(struct vsx_guide_painter *painter,
         struct vsx_paint_state *paint_state =
                 &painter->toolbox->paint_state;
 
+        vsx_gl_enable(gl, GL_BLEND);
         gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        gl->glEnable(GL_BLEND);
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         gl->glUniformMatrix2fv(program->matrix_uniform,
                                1, /* count */
@@ -1084,11 +1086,12 @@ draw_cursor(struct vsx_guide_painter *painter,
 
         vsx_array_object_bind(painter->cursor_vao, gl);
 
-        gl->glDrawArrays(GL_TRIANGLE_STRIP,
-                         clicking ? 4 : 0,
-                         4);
+        vsx_gl_draw_arrays(gl,
+                           GL_TRIANGLE_STRIP,
+                           clicking ? 4 : 0,
+                           4);
 
-        gl->glDisable(GL_BLEND);
+        vsx_gl_disable(gl, GL_BLEND);
 }
 
 static void
@@ -1118,28 +1121,33 @@ paint_things(struct vsx_guide_painter *painter)
         struct vsx_paint_state *paint_state = &painter->toolbox->paint_state;
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        gl->glEnable(GL_SCISSOR_TEST);
-        gl->glScissor(painter->image_scissor_x,
-                      painter->image_scissor_y,
-                      painter->image_size,
-                      painter->image_size);
+        const GLint scissor[] = {
+                painter->image_scissor_x,
+                painter->image_scissor_y,
+                painter->image_size,
+                painter->image_size,
+        };
 
         if (painter->n_tiles > 0) {
                 update_tiles(painter);
                 vsx_tile_tool_paint(painter->tile_buffer,
                                     &painter->toolbox->shader_data,
                                     paint_state->pixel_matrix,
-                                    paint_state->pixel_translation);
+                                    paint_state->pixel_translation,
+                                    scissor);
         }
 
         if (painter->show_cursor) {
+                vsx_gl_enable(gl, GL_SCISSOR_TEST);
+                gl->glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+
                 draw_cursor(painter,
                             painter->cursor_position.x + painter->image_x,
                             painter->cursor_position.y + painter->image_y,
                             painter->clicking);
-        }
 
-        gl->glDisable(GL_SCISSOR_TEST);
+                vsx_gl_disable(gl, GL_SCISSOR_TEST);
+        }
 }
 
 static void
@@ -21,20 +21,38 @@
 #include "vsx-image-loader.h"
 
 #include <assert.h>
+#include <unistd.h>
+#include <string.h>
 
 #include "vsx-util.h"
+#include "vsx-baked-texture.h"
 #include "vsx-list.h"
 #include "vsx-main-thread.h"
 #include "vsx-thread.h"
 
+/* Maximum number of threads used to decode images. The actual number
+ * also depends on how many CPUs there are.
+ */
+#define VSX_IMAGE_LOADER_MAX_THREADS 4
+
+enum vsx_image_loader_token_state {
+        /* In one of the queues waiting for a thread */
+        VSX_IMAGE_LOADER_TOKEN_STATE_QUEUED,
+        /* Being decoded by one of the threads */
+        VSX_IMAGE_LOADER_TOKEN_STATE_LOADING,
+        /* In the finished list waiting for the main thread */
+        VSX_IMAGE_LOADER_TOKEN_STATE_FINISHED,
+};
+
 struct vsx_image_loader_token {
         struct vsx_image_loader *loader;
 
+        struct vsx_list link;
+        enum vsx_image_loader_token_state state;
         bool cancelled;
         char *filename;
         vsx_image_loader_callback func;
         void *user_data;
-        struct vsx_image_loader_token *next;
         bool image_loaded;
         struct vsx_image image;
         struct vsx_error *error;
@@ -43,13 +61,19 @@ struct vsx_image_loader_token {
 struct vsx_image_loader {
         pthread_mutex_t mutex;
         pthread_cond_t cond;
-        pthread_t thread;
+        int n_threads;
+        pthread_t threads[VSX_IMAGE_LOADER_MAX_THREADS];
         struct vsx_main_thread *main_thread;
         struct vsx_asset_manager *asset_manager;
         bool quit;
 
-        struct vsx_image_loader_token *queue;
-        struct vsx_image_loader_token *notify_slot;
+        /* A list of tokens waiting to be loaded for each priority */
+        struct vsx_list queues[VSX_IMAGE_LOADER_N_PRIORITIES];
+        /* Tokens that have been loaded in the order that they
+         * finished. They are all handed to the main thread in a
+         * single idle callback.
+         */
+        struct vsx_list finished;
         struct vsx_main_thread_token *idle_token;
 };
 
@@ -67,61 +91,121 @@ free_token(struct vsx_image_loader_token *token)
         vsx_free(token);
 }
 
+static char *
+get_baked_filename(const char *filename)
+{
+        const char *dot = strrchr(filename, '.');
+        size_t base_length = dot ? dot - filename : strlen(filename);
+        char *baked_filename =
+                vsx_alloc(base_length +
+                          sizeof VSX_BAKED_TEXTURE_EXTENSION);
+
+        memcpy(baked_filename, filename, base_length);
+        memcpy(baked_filename + base_length,
+               VSX_BAKED_TEXTURE_EXTENSION,
+               sizeof VSX_BAKED_TEXTURE_EXTENSION);
+
+        return baked_filename;
+}
+
+static struct vsx_asset *
+open_asset(struct vsx_image_loader *loader,
+           const char *filename,
+           struct vsx_error **error)
+{
+        /* Use the baked version of the texture if it has been
+         * generated because it can be uploaded without decoding it.
+         */
+        char *baked_filename = get_baked_filename(filename);
+        struct vsx_asset *asset =
+                vsx_asset_manager_open(loader->asset_manager,
+                                       baked_filename,
+                                       NULL /* error */);
+
+        vsx_free(baked_filename);
+
+        if (asset)
+                return asset;
+
+        return vsx_asset_manager_open(loader->asset_manager,
+                                      filename,
+                                      error);
+}
+
 static void
 handle_token(struct vsx_image_loader *loader,
              struct vsx_image_loader_token *token)
 {
         struct vsx_asset *asset =
-                vsx_asset_manager_open(loader->asset_manager,
-                                       token->filename,
-                                       &token->error);
+                open_asset(loader, token->filename, &token->error);
 
         if (asset == NULL)
                 return;
 
-        size_t asset_size;
-        bool ret = false;
-
-        if (vsx_asset_remaining(asset, &asset_size, &token->error)) {
-                ret = vsx_image_load_asset_with_size(&token->image,
-                                                     asset,
-                                                     asset_size,
-                                                     &token->error);
-        }
-
-        vsx_asset_close(asset);
-
-        if (ret)
+        if (vsx_image_load_asset(&token->image, asset, &token->error))
                 token->image_loaded = true;
+        else
+                vsx_asset_close(asset);
 }
 
 static void
 idle_cb(void *user_data)
 {
         struct vsx_image_loader *loader = user_data;
+        struct vsx_list finished;
 
         pthread_mutex_lock(&loader->mutex);
 
-        struct vsx_image_loader_token *token = loader->notify_slot;
+        assert(!vsx_list_empty(&loader->finished));
 
-        assert(token);
+        /* Steal the whole list so that the threads can carry on
+         * adding to it while the callbacks run.
+         */
+        vsx_list_init(&finished);
+        vsx_list_insert_list(&finished, &loader->finished);
+        vsx_list_init(&loader->finished);
 
-        loader->notify_slot = NULL;
         loader->idle_token = NULL;
 
-        pthread_cond_signal(&loader->cond);
-
         pthread_mutex_unlock(&loader->mutex);
 
-        if (!token->cancelled) {
-                token->func(token->image_loaded ?
-                            &token->image :
-                            NULL,
-                            token->error,
-                            token->user_data);
+        struct vsx_image_loader_token *token, *tmp;
+
+        /* The tokens can only be cancelled from the main thread so
+         * it’s safe to check the flag without the mutex, even if one
+         * of the callbacks cancels a later token.
+         */
+        vsx_list_for_each_safe(token, tmp, &finished, link) {
+                if (!token->cancelled) {
+                        token->func(token->image_loaded ?
+                                    &token->image :
+                                    NULL,
+                                    token->error,
+                                    token->user_data);
+                }
+
+                free_token(token);
         }
+}
 
-        free_token(token);
+static struct vsx_image_loader_token *
+take_queued_token(struct vsx_image_loader *loader)
+{
+        for (int i = 0; i < VSX_N_ELEMENTS(loader->queues); i++) {
+                struct vsx_list *queue = loader->queues + i;
+
+                if (!vsx_list_empty(queue)) {
+                        struct vsx_image_loader_token *token =
+                                vsx_container_of(queue->next,
+                                                 struct
+                                                 vsx_image_loader_token,
+                                                 link);
+                        vsx_list_remove(&token->link);
+                        return token;
+                }
+        }
+
+        return NULL;
 }
 
 static void *
@@ -131,39 +215,39 @@ thread_func(void *user_data)
 
         pthread_mutex_lock(&loader->mutex);
 
-        while (true) {
-                if (!loader->quit &&
-                    (loader->queue == NULL || loader->notify_slot != NULL))
-                        pthread_cond_wait(&loader->cond, &loader->mutex);
-
-                if (loader->quit)
-                        break;
+        while (!loader->quit) {
+                struct vsx_image_loader_token *token =
+                        take_queued_token(loader);
 
-                if (loader->queue != NULL && loader->notify_slot == NULL) {
-                        struct vsx_image_loader_token *token = loader->queue;
+                if (token == NULL) {
+                        pthread_cond_wait(&loader->cond, &loader->mutex);
+                        continue;
+                }
 
-                        loader->queue = token->next;
+                token->state = VSX_IMAGE_LOADER_TOKEN_STATE_LOADING;
 
-                        if (token->cancelled) {
-                                free_token(token);
-                        } else {
-                                pthread_mutex_unlock(&loader->mutex);
-                                handle_token(loader, token);
-                                pthread_mutex_lock(&loader->mutex);
+                pthread_mutex_unlock(&loader->mutex);
+                handle_token(loader, token);
+                pthread_mutex_lock(&loader->mutex);
 
-                                assert(loader->notify_slot == NULL);
-                                loader->notify_slot = token;
+                /* If the load was cancelled while it was in progress
+                 * then there’s no need to wake up the main thread.
+                 */
+                if (token->cancelled) {
+                        free_token(token);
+                        continue;
+                }
 
-                                assert(loader->idle_token == NULL);
+                token->state = VSX_IMAGE_LOADER_TOKEN_STATE_FINISHED;
+                vsx_list_insert(loader->finished.prev, &token->link);
 
-                                struct vsx_main_thread *mt =
-                                        loader->main_thread;
+                if (loader->idle_token == NULL) {
+                        struct vsx_main_thread *mt = loader->main_thread;
 
-                                loader->idle_token =
-                                        vsx_main_thread_queue_idle(mt,
-                                                                   idle_cb,
-                                                                   loader);
-                        }
+                        loader->idle_token =
+                                vsx_main_thread_queue_idle(mt,
+                                                           idle_cb,
+                                                           loader);
                 }
         }
 
@@ -172,6 +256,17 @@ thread_func(void *user_data)
         return NULL;
 }
 
+static int
+get_n_threads(void)
+{
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (n_cpus < 1)
+                return 1;
+
+        return MIN(n_cpus, VSX_IMAGE_LOADER_MAX_THREADS);
+}
+
 struct vsx_image_loader *
 vsx_image_loader_new(struct vsx_main_thread *main_thread,
                      struct vsx_asset_manager *asset_manager)
@@ -181,14 +276,23 @@ vsx_image_loader_new(struct vsx_main_thread *main_thread,
         loader->main_thread = main_thread;
         loader->asset_manager = asset_manager;
 
+        for (int i = 0; i < VSX_N_ELEMENTS(loader->queues); i++)
+                vsx_list_init(loader->queues + i);
+
+        vsx_list_init(&loader->finished);
+
         pthread_mutex_init(&loader->mutex, NULL);
         pthread_cond_init(&loader->cond, NULL);
 
-        vsx_thread_create(&loader->thread,
-                          "ImageLoader",
-                          NULL, /* attr */
-                          thread_func,
-                          loader);
+        loader->n_threads = get_n_threads();
+
+        for (int i = 0; i < loader->n_threads; i++) {
+                vsx_thread_create(loader->threads + i,
+                                  "ImageLoader",
+                                  NULL, /* attr */
+                                  thread_func,
+                                  loader);
+        }
 
         return loader;
 }
@@ -196,9 +300,12 @@ vsx_image_loader_new(struct vsx_main_thread *main_thread,
 struct vsx_image_loader_token *
 vsx_image_loader_load(struct vsx_image_loader *loader,
                       const char *filename,
+                      enum vsx_image_loader_priority priority,
                       vsx_image_loader_callback func,
                       void *user_data)
 {
+        assert(priority >= 0 && priority < VSX_IMAGE_LOADER_N_PRIORITIES);
+
         struct vsx_image_loader_token *token =
                 vsx_calloc(sizeof *token);
 
@@ -206,11 +313,11 @@ vsx_image_loader_load(struct vsx_image_loader *loader,
         token->filename = vsx_strdup(filename);
         token->func = func;
         token->user_data = user_data;
+        token->state = VSX_IMAGE_LOADER_TOKEN_STATE_QUEUED;
 
         pthread_mutex_lock(&loader->mutex);
 
-        token->next = loader->queue;
-        loader->queue = token;
+        vsx_list_insert(loader->queues[priority].prev, &token->link);
 
         pthread_cond_signal(&loader->cond);
 
@@ -222,22 +329,29 @@ vsx_image_loader_load(struct vsx_image_loader *loader,
 void
 vsx_image_loader_cancel(struct vsx_image_loader_token *token)
 {
-        pthread_mutex_lock(&token->loader->mutex);
+        struct vsx_image_loader *loader = token->loader;
 
-        token->cancelled = true;
+        pthread_mutex_lock(&loader->mutex);
+
+        if (token->state == VSX_IMAGE_LOADER_TOKEN_STATE_QUEUED) {
+                /* Nothing else refers to it yet so it can be dropped
+                 * straight away without using up a thread.
+                 */
+                vsx_list_remove(&token->link);
+                free_token(token);
+        } else {
+                token->cancelled = true;
+        }
 
-        pthread_mutex_unlock(&token->loader->mutex);
+        pthread_mutex_unlock(&loader->mutex);
 }
 
 static void
-free_queue(struct vsx_image_loader_token *queue)
+free_list(struct vsx_list *list)
 {
-        struct vsx_image_loader_token *next;
+        struct vsx_image_loader_token *token, *tmp;
 
-        for (struct vsx_image_loader_token *token = queue;
-             token;
-             token = next) {
-                next = token->next;
+        vsx_list_for_each_safe(token, tmp, list, link) {
                 free_token(token);
         }
 }
@@ -247,21 +361,22 @@ vsx_image_loader_free(struct vsx_image_loader *loader)
 {
         pthread_mutex_lock(&loader->mutex);
         loader->quit = true;
-        pthread_cond_signal(&loader->cond);
+        pthread_cond_broadcast(&loader->cond);
         pthread_mutex_unlock(&loader->mutex);
 
-        pthread_join(loader->thread, NULL);
+        for (int i = 0; i < loader->n_threads; i++)
+                pthread_join(loader->threads[i], NULL);
 
         pthread_mutex_destroy(&loader->mutex);
         pthread_cond_destroy(&loader->cond);
 
-        free_queue(loader->queue);
+        for (int i = 0; i < VSX_N_ELEMENTS(loader->queues); i++)
+                free_list(loader->queues + i);
 
         if (loader->idle_token)
                 vsx_main_thread_cancel_idle(loader->idle_token);
 
-        if (loader->notify_slot)
-                free_token(loader->notify_slot);
+        free_list(&loader->finished);
 
         vsx_free(loader);
 }
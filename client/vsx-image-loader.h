@@ -27,6 +27,20 @@
 struct vsx_image_loader;
 struct vsx_image_loader_token;
 
+/* Images are decoded on a pool of threads. Requests with a higher
+ * priority are started first so that the images needed for the first
+ * frame aren’t stuck behind ones that might never be shown.
+ */
+enum vsx_image_loader_priority {
+        /* Needed to paint the first frame of the game */
+        VSX_IMAGE_LOADER_PRIORITY_HIGH,
+        VSX_IMAGE_LOADER_PRIORITY_NORMAL,
+        /* Only needed once the user opens something */
+        VSX_IMAGE_LOADER_PRIORITY_LOW,
+};
+
+#define VSX_IMAGE_LOADER_N_PRIORITIES 3
+
 typedef void
 (* vsx_image_loader_callback)(const struct vsx_image *image,
                               struct vsx_error *error,
@@ -39,6 +53,7 @@ vsx_image_loader_new(struct vsx_main_thread *main_thread,
 struct vsx_image_loader_token *
 vsx_image_loader_load(struct vsx_image_loader *loader,
                       const char *filename,
+                      enum vsx_image_loader_priority priority,
                       vsx_image_loader_callback func,
                       void *user_data);
 
@@ -20,6 +20,8 @@
 
 #include "vsx-image.h"
 
+#include "vsx-baked-texture.h"
+
 #define STB_IMAGE_IMPLEMENTATION 1
 #define STBI_NO_HDR
 #define STBI_NO_STDIO
@@ -28,28 +30,56 @@
 struct vsx_error_domain
 vsx_image_error;
 
+static bool
+load_baked_texture(struct vsx_image *image,
+                   struct vsx_asset *asset,
+                   const uint8_t *contents,
+                   size_t size,
+                   struct vsx_error **error)
+{
+        struct vsx_baked_texture texture;
+
+        if (!vsx_baked_texture_parse(&texture, contents, size, error))
+                return false;
+
+        image->width = texture.width;
+        image->height = texture.height;
+        image->components = texture.components;
+        /* The data is mapped read-only but none of the functions that
+         * modify the data are used for baked textures.
+         */
+        image->data = (uint8_t *) texture.data;
+        image->baked_asset = asset;
+
+        return true;
+}
+
 bool
-vsx_image_load_asset_with_size(struct vsx_image *image,
-                               struct vsx_asset *asset,
-                               size_t asset_size,
-                               struct vsx_error **error)
+vsx_image_load_asset(struct vsx_image *image,
+                     struct vsx_asset *asset,
+                     struct vsx_error **error)
 {
-        uint8_t *file_buf = vsx_alloc(asset_size);
+        size_t size;
+        const uint8_t *contents = vsx_asset_map(asset, &size, error);
 
-        if (!vsx_asset_read(asset, file_buf, asset_size, error)) {
-                vsx_free(file_buf);
+        if (contents == NULL)
                 return false;
+
+        if (vsx_baked_texture_is_baked(contents, size)) {
+                return load_baked_texture(image,
+                                          asset,
+                                          contents,
+                                          size,
+                                          error);
         }
 
-        image->data = stbi_load_from_memory(file_buf,
-                                            asset_size,
+        image->data = stbi_load_from_memory(contents,
+                                            size,
                                             &image->width,
                                             &image->height,
                                             &image->components,
                                             0 /* req_comp */);
 
-        vsx_free(file_buf);
-
         if (image->data == NULL) {
                 vsx_set_error(error,
                               &vsx_image_error,
@@ -58,11 +88,18 @@ vsx_image_load_asset_with_size(struct vsx_image *image,
                 return false;
         }
 
+        image->baked_asset = NULL;
+
+        vsx_asset_close(asset);
+
         return true;
 }
 
 void
 vsx_image_destroy(struct vsx_image *image)
 {
-        stbi_image_free(image->data);
+        if (image->baked_asset)
+                vsx_asset_close(image->baked_asset);
+        else
+                stbi_image_free(image->data);
 }
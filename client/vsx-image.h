@@ -33,17 +33,27 @@ struct vsx_image {
         int width, height;
         int components;
         uint8_t *data;
+        /* If the image was loaded from a baked texture then this is
+         * the asset that the data is mapped from. In that case the
+         * size is the size of the first mipmap level and the data
+         * contains all of the levels in the baked texture layout. If
+         * this is NULL then the data is a decoded .mpng image.
+         */
+        struct vsx_asset *baked_asset;
 };
 
 enum vsx_image_error {
         VSX_IMAGE_ERROR_BAD,
 };
 
+/* Loads the image from either a baked texture or a compressed image
+ * file. On success the image takes ownership of the asset, otherwise
+ * it is left for the caller to close.
+ */
 bool
-vsx_image_load_asset_with_size(struct vsx_image *image,
-                               struct vsx_asset *asset,
-                               size_t asset_size,
-                               struct vsx_error **error);
+vsx_image_load_asset(struct vsx_image *image,
+                     struct vsx_asset *asset,
+                     struct vsx_error **error);
 
 void
 vsx_image_destroy(struct vsx_image *image);
@@ -518,7 +518,7 @@ paint_shadow(struct vsx_invite_painter *painter)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->toolbox->paint_state.pixel_matrix,
                                  translation);
 }
@@ -542,7 +542,7 @@ paint_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         set_uniforms(painter, program);
 
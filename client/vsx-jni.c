@@ -404,6 +404,7 @@ ensure_game_state(struct data *data)
         if (data->connection == NULL) {
                 data->connection = vsx_connection_new();
 
+                vsx_connection_set_compact_protocol(data->connection, true);
                 vsx_connection_set_default_language(data->connection,
                                                     data->game_language_code);
         }
@@ -284,7 +284,7 @@ paint_shadow(struct vsx_language_painter *painter,
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  paint_state->pixel_matrix,
                                  translation);
 }
@@ -341,13 +341,13 @@ paint_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         update_uniforms(painter, program);
 
         vsx_array_object_bind(painter->vao, gl);
 
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, N_VERTICES);
+        vsx_gl_draw_arrays(gl, GL_TRIANGLE_STRIP, 0, N_VERTICES);
 
         struct vsx_layout_paint_position pos[N_LANGUAGES];
 
@@ -0,0 +1,191 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-layout-cache.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "vsx-util.h"
+#include "vsx-list.h"
+#include "vsx-hash-table.h"
+
+struct vsx_layout_cache_entry {
+        /* The id is a hash of the key. Only one entry with each id
+         * is kept so if two keys have the same hash then the new
+         * one replaces the old one.
+         */
+        struct vsx_hash_table_entry hash_entry;
+        /* Node in the list of entries with the most recently used
+         * first.
+         */
+        struct vsx_list link;
+
+        const void *font;
+        unsigned width;
+        char *text;
+
+        struct vsx_buffer data;
+};
+
+struct vsx_layout_cache {
+        int max_entries;
+        int n_entries;
+        struct vsx_hash_table hash_table;
+        struct vsx_list entries;
+};
+
+struct vsx_layout_cache *
+vsx_layout_cache_new(int max_entries)
+{
+        assert(max_entries > 0);
+
+        struct vsx_layout_cache *cache = vsx_alloc(sizeof *cache);
+
+        cache->max_entries = max_entries;
+        cache->n_entries = 0;
+        vsx_hash_table_init(&cache->hash_table);
+        vsx_list_init(&cache->entries);
+
+        return cache;
+}
+
+static uint64_t
+hash_key(const void *font,
+         unsigned width,
+         const char *text)
+{
+        /* FNV-1a */
+        uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+        for (const char *p = text; *p; p++) {
+                hash ^= (uint8_t) *p;
+                hash *= UINT64_C(0x100000001b3);
+        }
+
+        hash ^= (uintptr_t) font;
+        hash *= UINT64_C(0x100000001b3);
+        hash ^= width;
+        hash *= UINT64_C(0x100000001b3);
+
+        return hash;
+}
+
+static struct vsx_layout_cache_entry *
+get_entry(struct vsx_layout_cache *cache,
+          uint64_t id)
+{
+        struct vsx_hash_table_entry *hash_entry =
+                vsx_hash_table_get(&cache->hash_table, id);
+
+        if (hash_entry == NULL)
+                return NULL;
+
+        return vsx_container_of(hash_entry,
+                                struct vsx_layout_cache_entry,
+                                hash_entry);
+}
+
+static void
+remove_entry(struct vsx_layout_cache *cache,
+             struct vsx_layout_cache_entry *entry)
+{
+        vsx_hash_table_remove(&cache->hash_table, &entry->hash_entry);
+        vsx_list_remove(&entry->link);
+        cache->n_entries--;
+
+        vsx_buffer_destroy(&entry->data);
+        vsx_free(entry->text);
+        vsx_free(entry);
+}
+
+const struct vsx_buffer *
+vsx_layout_cache_lookup(struct vsx_layout_cache *cache,
+                        const void *font,
+                        unsigned width,
+                        const char *text)
+{
+        struct vsx_layout_cache_entry *entry =
+                get_entry(cache, hash_key(font, width, text));
+
+        if (entry == NULL ||
+            entry->font != font ||
+            entry->width != width ||
+            strcmp(entry->text, text))
+                return NULL;
+
+        /* Move the entry to the front of the list */
+        vsx_list_remove(&entry->link);
+        vsx_list_insert(&cache->entries, &entry->link);
+
+        return &entry->data;
+}
+
+struct vsx_buffer *
+vsx_layout_cache_add(struct vsx_layout_cache *cache,
+                     const void *font,
+                     unsigned width,
+                     const char *text)
+{
+        uint64_t id = hash_key(font, width, text);
+
+        struct vsx_layout_cache_entry *old_entry = get_entry(cache, id);
+
+        if (old_entry) {
+                remove_entry(cache, old_entry);
+        } else if (cache->n_entries >= cache->max_entries) {
+                struct vsx_layout_cache_entry *oldest =
+                        vsx_container_of(cache->entries.prev,
+                                         struct vsx_layout_cache_entry,
+                                         link);
+                remove_entry(cache, oldest);
+        }
+
+        struct vsx_layout_cache_entry *entry = vsx_alloc(sizeof *entry);
+
+        entry->hash_entry.id = id;
+        entry->font = font;
+        entry->width = width;
+        entry->text = vsx_strdup(text);
+        vsx_buffer_init(&entry->data);
+
+        vsx_hash_table_add(&cache->hash_table, &entry->hash_entry);
+        vsx_list_insert(&cache->entries, &entry->link);
+        cache->n_entries++;
+
+        return &entry->data;
+}
+
+void
+vsx_layout_cache_free(struct vsx_layout_cache *cache)
+{
+        struct vsx_layout_cache_entry *entry, *tmp;
+
+        vsx_list_for_each_safe(entry, tmp, &cache->entries, link) {
+                vsx_buffer_destroy(&entry->data);
+                vsx_free(entry->text);
+                vsx_free(entry);
+        }
+
+        vsx_hash_table_destroy(&cache->hash_table);
+
+        vsx_free(cache);
+}
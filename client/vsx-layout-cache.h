@@ -0,0 +1,58 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_LAYOUT_CACHE_H
+#define VSX_LAYOUT_CACHE_H
+
+#include <stddef.h>
+
+#include "vsx-buffer.h"
+
+/* Cache of the results of laying out text, keyed by the font, the
+ * width and the text. The contents of each entry are only
+ * interpreted by vsx_layout. When the cache is full the least
+ * recently used entry is removed.
+ */
+
+struct vsx_layout_cache;
+
+struct vsx_layout_cache *
+vsx_layout_cache_new(int max_entries);
+
+/* Returns the data for the layout or NULL if it isn’t in the cache.
+ * The pointer is only valid until the next time something is added.
+ */
+const struct vsx_buffer *
+vsx_layout_cache_lookup(struct vsx_layout_cache *cache,
+                        const void *font,
+                        unsigned width,
+                        const char *text);
+
+/* Adds an entry and returns an empty buffer for the caller to fill
+ * in. The entry shouldn’t already be in the cache.
+ */
+struct vsx_buffer *
+vsx_layout_cache_add(struct vsx_layout_cache *cache,
+                     const void *font,
+                     unsigned width,
+                     const char *text);
+
+void
+vsx_layout_cache_free(struct vsx_layout_cache *cache);
+
+#endif /* VSX_LAYOUT_CACHE_H */
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <string.h>
+#include <math.h>
 
 #include "vsx-gl.h"
 #include "vsx-util.h"
@@ -31,6 +32,7 @@
 #include "vsx-shader-data.h"
 #include "vsx-map-buffer.h"
 #include "vsx-buffer.h"
+#include "vsx-layout-cache.h"
 
 struct vsx_layout {
         struct vsx_toolbox *toolbox;
@@ -48,12 +50,12 @@ struct vsx_layout {
 };
 
 struct vertex {
-        int16_t x, y;
+        float x, y;
         uint16_t s, t;
 };
 
 struct glyph_quad {
-        int16_t x, y;
+        float x, y;
         unsigned glyph_index;
         unsigned tex_num;
 };
@@ -64,6 +66,15 @@ struct draw_call {
         size_t offset;
 };
 
+/* The data stored in the layout cache starts with this header. It is
+ * followed by the draw calls and then four vertices for each quad.
+ */
+struct cache_header {
+        struct vsx_layout_extents logical_extents;
+        size_t n_quads;
+        size_t n_draw_calls;
+};
+
 #define VSX_LAYOUT_MINIMUM_BUFFER_SIZE 1024
 
 struct vsx_layout *
@@ -84,6 +95,9 @@ void
 vsx_layout_set_text(struct vsx_layout *layout,
                     const char *text)
 {
+        if (layout->text && !strcmp(layout->text, text))
+                return;
+
         vsx_free(layout->text);
         layout->text = vsx_strdup(text);
         layout->dirty = true;
@@ -94,8 +108,12 @@ vsx_layout_set_font(struct vsx_layout *layout,
                     enum vsx_font_type font)
 {
         struct vsx_font_library *library = layout->toolbox->font_library;
+        struct vsx_font *new_font = vsx_font_library_get_font(library, font);
+
+        if (new_font == layout->font)
+                return;
 
-        layout->font = vsx_font_library_get_font(library, font);
+        layout->font = new_font;
         layout->dirty = true;
 }
 
@@ -124,7 +142,10 @@ compare_glyph_quad_cb(const void *a, const void *b)
         if (qa->tex_num != qb->tex_num)
                 return qa->tex_num < qb->tex_num ? -1 : 1;
 
-        return qa->x - qb->x;
+        if (qa->x != qb->x)
+                return qa->x < qb->x ? -1 : 1;
+
+        return 0;
 }
 
 static void
@@ -136,6 +157,8 @@ add_glyph_quads_for_line(struct vsx_layout *layout,
                          int y)
 {
         int x = 0;
+        bool sdf = vsx_font_is_sdf(layout->font);
+        float glyph_scale = vsx_font_get_glyph_scale(layout->font);
 
         for (const char *p = line; p < end; p = vsx_utf8_next(p)) {
                 uint32_t ch = vsx_utf8_get_char(p);
@@ -153,8 +176,19 @@ add_glyph_quads_for_line(struct vsx_layout *layout,
                                 ((struct glyph_quad *)
                                  (buf->data + buf->length)) - 1;
 
-                        quad->x = (x + 32) / 64 + glyph->left;
-                        quad->y = (y + 32) / 64 - glyph->top;
+                        if (sdf) {
+                                /* SDF glyphs can be drawn at any
+                                 * position so there’s no need to
+                                 * round to a pixel.
+                                 */
+                                quad->x = (x / 64.0f +
+                                           glyph->left * glyph_scale);
+                                quad->y = (y / 64.0f -
+                                           glyph->top * glyph_scale);
+                        } else {
+                                quad->x = (x + 32) / 64 + glyph->left;
+                                quad->y = (y + 32) / 64 - glyph->top;
+                        }
                         quad->glyph_index = glyph_index;
                         quad->tex_num = glyph->tex_num;
                 }
@@ -282,12 +316,6 @@ get_glyph_quads(struct vsx_layout *layout,
 {
         memset(&layout->logical_extents, 0, sizeof layout->logical_extents);
 
-        if (layout->text == NULL) {
-                *quads_out = NULL;
-                *n_quads_out = 0;
-                return;
-        }
-
         struct vsx_font_metrics metrics;
         vsx_font_get_metrics(layout->font, &metrics);
 
@@ -372,7 +400,7 @@ ensure_buffer_size(struct vsx_layout *layout,
                                        gl,
                                        VSX_SHADER_DATA_ATTRIB_POSITION,
                                        2, /* size */
-                                       GL_SHORT,
+                                       GL_FLOAT,
                                        GL_FALSE, /* normalized */
                                        sizeof (struct vertex),
                                        layout->vbo,
@@ -399,15 +427,24 @@ static void
 generate_vertices(struct vsx_layout *layout,
                   const struct glyph_quad *quads,
                   size_t n_quads,
-                  struct vertex *vertices,
-                  size_t buffer_size)
+                  struct vsx_buffer *buf)
 {
+        size_t old_length = buf->length;
+
+        vsx_buffer_set_length(buf,
+                              old_length +
+                              n_quads * 4 * sizeof (struct vertex));
+
+        struct vertex *vertices = (struct vertex *) (buf->data + old_length);
         struct vertex *v = vertices;
+        float glyph_scale = vsx_font_get_glyph_scale(layout->font);
 
         for (unsigned q = 0; q < n_quads; q++) {
                 struct vsx_glyph_hash_entry *glyph =
                         vsx_font_prepare_glyph(layout->font,
                                                quads[q].glyph_index);
+                float width = glyph->width * glyph_scale;
+                float height = glyph->height * glyph_scale;
 
                 v->x = quads[q].x;
                 v->y = quads[q].y;
@@ -415,75 +452,87 @@ generate_vertices(struct vsx_layout *layout,
                 v->t = glyph->t1;
                 v++;
                 v->x = quads[q].x;
-                v->y = quads[q].y + glyph->height;
+                v->y = quads[q].y + height;
                 v->s = glyph->s1;
                 v->t = glyph->t2;
                 v++;
-                v->x = quads[q].x + glyph->width;
+                v->x = quads[q].x + width;
                 v->y = quads[q].y;
                 v->s = glyph->s2;
                 v->t = glyph->t1;
                 v++;
-                v->x = quads[q].x + glyph->width;
-                v->y = quads[q].y + glyph->height;
+                v->x = quads[q].x + width;
+                v->y = quads[q].y + height;
                 v->s = glyph->s2;
                 v->t = glyph->t2;
                 v++;
         }
 
-        assert((v - vertices) * sizeof (struct vertex) == buffer_size);
+        assert(v - vertices == n_quads * 4);
 }
 
-static void
-generate_draw_calls(struct vsx_layout *layout,
-                    const struct glyph_quad *quads,
-                    size_t n_quads)
+static size_t
+generate_draw_calls(const struct glyph_quad *quads,
+                    size_t n_quads,
+                    struct vsx_buffer *buf)
 {
-        vsx_buffer_set_length(&layout->draw_calls, 0);
-
         struct draw_call *draw_call = NULL;
         unsigned last_tex_num = -1;
         size_t offset = 0;
+        size_t n_draw_calls = 0;
 
         for (unsigned i = 0; i < n_quads; i++) {
                 if (last_tex_num != quads[i].tex_num) {
-                        vsx_buffer_set_length(&layout->draw_calls,
-                                              layout->draw_calls.length +
+                        vsx_buffer_set_length(buf,
+                                              buf->length +
                                               sizeof (struct draw_call));
 
                         draw_call = ((struct draw_call *)
-                                     (layout->draw_calls.data +
-                                      layout->draw_calls.length) - 1);
+                                     (buf->data + buf->length) - 1);
 
                         draw_call->tex_num = quads[i].tex_num;
                         draw_call->n_elements = 0;
                         draw_call->offset = offset;
                         last_tex_num = draw_call->tex_num;
+                        n_draw_calls++;
                 }
 
                 draw_call->n_elements += 6;
                 offset += 6 * sizeof (uint16_t);
         }
+
+        return n_draw_calls;
 }
 
-void
-vsx_layout_prepare(struct vsx_layout *layout)
+static void
+generate_cache_data(struct vsx_layout *layout,
+                    struct vsx_buffer *buf)
 {
-        if (!layout->dirty)
-                return;
-
-        layout->dirty = false;
-
         struct glyph_quad *quads;
         size_t n_quads;
 
         get_glyph_quads(layout, &quads, &n_quads);
 
-        if (n_quads == 0) {
-                vsx_buffer_set_length(&layout->draw_calls, 0);
-                return;
-        }
+        vsx_buffer_set_length(buf, sizeof (struct cache_header));
 
+        size_t n_draw_calls = generate_draw_calls(quads, n_quads, buf);
+
+        generate_vertices(layout, quads, n_quads, buf);
+
+        struct cache_header *header = (struct cache_header *) buf->data;
+
+        header->logical_extents = layout->logical_extents;
+        header->n_quads = n_quads;
+        header->n_draw_calls = n_draw_calls;
+
+        vsx_free(quads);
+}
+
+static void
+upload_vertices(struct vsx_layout *layout,
+                const struct vertex *vertices,
+                size_t n_quads)
+{
         size_t buffer_size = 4 * n_quads * sizeof(struct vertex);
 
         ensure_buffer_size(layout, buffer_size);
@@ -492,22 +541,76 @@ vsx_layout_prepare(struct vsx_layout *layout)
 
         gl->glBindBuffer(GL_ARRAY_BUFFER, layout->vbo);
 
-        struct vertex *vertices =
+        struct vertex *buffer_vertices =
                 vsx_map_buffer_map(layout->toolbox->map_buffer,
                                    GL_ARRAY_BUFFER,
                                    layout->buffer_size,
                                    true, /* flush_explicit */
                                    GL_DYNAMIC_DRAW);
 
-        generate_vertices(layout, quads, n_quads, vertices, buffer_size);
+        memcpy(buffer_vertices, vertices, buffer_size);
 
         vsx_map_buffer_flush(layout->toolbox->map_buffer, 0, buffer_size);
 
         vsx_map_buffer_unmap(layout->toolbox->map_buffer);
+}
+
+void
+vsx_layout_prepare(struct vsx_layout *layout)
+{
+        if (!layout->dirty)
+                return;
+
+        layout->dirty = false;
 
-        generate_draw_calls(layout, quads, n_quads);
+        vsx_buffer_set_length(&layout->draw_calls, 0);
 
-        vsx_free(quads);
+        if (layout->text == NULL) {
+                memset(&layout->logical_extents,
+                       0,
+                       sizeof layout->logical_extents);
+                return;
+        }
+
+        /* Most of the layouts are for the UI strings which get laid
+         * out again with the same width whenever a dialog is opened,
+         * so the glyph positions are shared between all of the
+         * layouts.
+         */
+        struct vsx_layout_cache *cache = layout->toolbox->layout_cache;
+        const struct vsx_buffer *data =
+                vsx_layout_cache_lookup(cache,
+                                        layout->font,
+                                        layout->width,
+                                        layout->text);
+
+        if (data == NULL) {
+                struct vsx_buffer *new_data =
+                        vsx_layout_cache_add(cache,
+                                             layout->font,
+                                             layout->width,
+                                             layout->text);
+                generate_cache_data(layout, new_data);
+                data = new_data;
+        }
+
+        const struct cache_header *header =
+                (const struct cache_header *) data->data;
+        const struct draw_call *draw_calls =
+                (const struct draw_call *) (header + 1);
+        const struct vertex *vertices =
+                (const struct vertex *) (draw_calls + header->n_draw_calls);
+
+        layout->logical_extents = header->logical_extents;
+
+        if (header->n_quads == 0)
+                return;
+
+        vsx_buffer_append(&layout->draw_calls,
+                          draw_calls,
+                          header->n_draw_calls * sizeof *draw_calls);
+
+        upload_vertices(layout, vertices, header->n_quads);
 }
 
 const struct vsx_layout_extents *
@@ -562,6 +665,42 @@ submit_layout(struct vsx_layout *layout)
         }
 }
 
+static float
+get_pixel_scale(struct vsx_paint_state *paint_state,
+                const float *matrix)
+{
+        vsx_paint_state_ensure_layout(paint_state);
+
+        /* Compare the area scaled by the matrix with the area scaled
+         * by the pixel matrix to get the number of framebuffer pixels
+         * per unit.
+         */
+        const float *pixel_matrix = paint_state->pixel_matrix;
+        float pixel_det = fabsf(pixel_matrix[0] * pixel_matrix[3] -
+                                pixel_matrix[1] * pixel_matrix[2]);
+        float det = fabsf(matrix[0] * matrix[3] - matrix[1] * matrix[2]);
+
+        if (pixel_det <= 0.0f)
+                return 1.0f;
+
+        return sqrtf(det / pixel_det);
+}
+
+static void
+set_smoothing_uniform(struct vsx_gl *gl,
+                      const struct vsx_shader_data_program_data *program,
+                      struct vsx_font *font,
+                      float pixel_scale)
+{
+        /* Blend across one pixel around the outline. A texel changes
+         * the distance value by 0.5/spread.
+         */
+        float texel_size = vsx_font_get_glyph_scale(font) * pixel_scale;
+        float smoothing = 0.25f / (VSX_FONT_SDF_SPREAD * texel_size);
+
+        gl->glUniform1f(program->smoothing_uniform, MIN(smoothing, 0.5f));
+}
+
 void
 vsx_layout_paint_params(const struct vsx_layout_paint_params *params)
 {
@@ -570,20 +709,15 @@ vsx_layout_paint_params(const struct vsx_layout_paint_params *params)
 
         struct vsx_toolbox *toolbox = params->layouts[0].layout->toolbox;
 
-        const struct vsx_shader_data_program_data *program =
-                toolbox->shader_data.programs + VSX_SHADER_DATA_PROGRAM_LAYOUT;
+        const struct vsx_shader_data_program_data *program = NULL;
 
         struct vsx_gl *gl = toolbox->gl;
 
-        gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        gl->glEnable(GL_BLEND);
-
-        gl->glUseProgram(program->program);
+        float pixel_scale = get_pixel_scale(&toolbox->paint_state,
+                                            params->matrix);
 
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               params->matrix);
+        vsx_gl_enable(gl, GL_BLEND);
+        gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         for (unsigned i = 0; i < params->n_layouts; i++) {
                 const struct vsx_layout_paint_position *pos =
@@ -597,6 +731,28 @@ vsx_layout_paint_params(const struct vsx_layout_paint_params *params)
                 if (pos->layout->draw_calls.length <= 0)
                         continue;
 
+                struct vsx_font *font = pos->layout->font;
+                bool sdf = vsx_font_is_sdf(font);
+                const struct vsx_shader_data_program_data *layout_program =
+                        toolbox->shader_data.programs +
+                        (sdf ?
+                         VSX_SHADER_DATA_PROGRAM_LAYOUT_SDF :
+                         VSX_SHADER_DATA_PROGRAM_LAYOUT);
+
+                if (layout_program != program) {
+                        program = layout_program;
+
+                        vsx_gl_use_program(gl, program->program);
+
+                        gl->glUniformMatrix2fv(program->matrix_uniform,
+                                               1, /* count */
+                                               GL_FALSE, /* transpose */
+                                               params->matrix);
+                }
+
+                if (sdf)
+                        set_smoothing_uniform(gl, program, font, pixel_scale);
+
                 vsx_array_object_bind(pos->layout->vao, gl);
 
                 gl->glUniform3f(program->color_uniform,
@@ -612,7 +768,7 @@ vsx_layout_paint_params(const struct vsx_layout_paint_params *params)
                 submit_layout(pos->layout);
         }
 
-        gl->glDisable(GL_BLEND);
+        vsx_gl_disable(gl, GL_BLEND);
 }
 
 void
@@ -0,0 +1,1022 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A load generator for the server. It simulates a large number of
+ * players using the same vsx_connection as the real client. The
+ * players are split between a few threads which each drive their
+ * connections from a single epoll loop. Each player joins a room,
+ * takes turns when it is their turn, drags tiles around, chats and
+ * occasionally drops the connection and reconnects. The time between
+ * sending each command and seeing its effect come back from the
+ * server is recorded and reported as percentiles at the end.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <math.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/epoll.h>
+
+#include "vsx-connection.h"
+#include "vsx-monotonic.h"
+#include "vsx-thread.h"
+#include "vsx-netaddress.h"
+#include "vsx-util.h"
+
+/* Interval in microseconds at which each thread checks whether any
+ * of its players want to do something.
+ */
+#define VSX_LOADGEN_TICK (10 * 1000)
+
+/* If the response to a command hasn’t arrived after this many
+ * microseconds then it is counted as a timeout.
+ */
+#define VSX_LOADGEN_TIMEOUT (5 * 1000 * 1000)
+
+/* Time in microseconds between each step of a drag. This roughly
+ * matches how often the real client sends a move while the mouse is
+ * moving.
+ */
+#define VSX_LOADGEN_DRAG_STEP (50 * 1000)
+
+#define VSX_LOADGEN_BOARD_WIDTH 600
+#define VSX_LOADGEN_BOARD_HEIGHT 360
+#define VSX_LOADGEN_TILE_SIZE 20
+
+/* Player flag sent by the server when it is that player’s turn */
+#define VSX_LOADGEN_PLAYER_FLAG_NEXT_TURN (1 << 2)
+
+#define VSX_LOADGEN_MAX_EVENTS 64
+
+enum vsx_loadgen_command {
+        VSX_LOADGEN_COMMAND_JOIN,
+        VSX_LOADGEN_COMMAND_RECONNECT,
+        VSX_LOADGEN_COMMAND_TURN,
+        VSX_LOADGEN_COMMAND_MOVE_TILE,
+        VSX_LOADGEN_COMMAND_SEND_MESSAGE,
+        VSX_LOADGEN_N_COMMANDS,
+};
+
+static const char * const
+command_names[] = {
+        [VSX_LOADGEN_COMMAND_JOIN] = "join",
+        [VSX_LOADGEN_COMMAND_RECONNECT] = "reconnect",
+        [VSX_LOADGEN_COMMAND_TURN] = "turn",
+        [VSX_LOADGEN_COMMAND_MOVE_TILE] = "move_tile",
+        [VSX_LOADGEN_COMMAND_SEND_MESSAGE] = "send_message",
+};
+
+_Static_assert(VSX_N_ELEMENTS(command_names) == VSX_LOADGEN_N_COMMANDS,
+               "Every command needs a name");
+
+struct vsx_loadgen_stats {
+        uint64_t n_sent;
+        uint64_t n_timeouts;
+
+        /* Round-trip times in microseconds */
+        uint32_t *samples;
+        size_t n_samples;
+        size_t samples_size;
+};
+
+struct vsx_loadgen_bot {
+        struct vsx_loadgen_thread *thread;
+
+        struct vsx_connection *connection;
+        struct vsx_listener event_listener;
+
+        unsigned int id;
+        unsigned int rand_state;
+
+        /* The fd and events that are currently registered with the
+         * thread’s epoll, or -1 if none.
+         */
+        int fd;
+        short events;
+        int64_t wakeup_time;
+
+        int64_t start_time;
+        bool started;
+
+        bool has_header;
+        int self_num;
+        bool next_turn;
+        int n_tiles;
+        int n_tiles_in_play;
+
+        int64_t next_turn_time;
+        int64_t next_drag_time;
+        int64_t next_chat_time;
+        int64_t next_reconnect_time;
+
+        /* Remaining steps in the current drag, or zero if the bot
+         * isn’t dragging anything.
+         */
+        int drag_steps;
+        int drag_tile;
+        int drag_x, drag_y;
+        int drag_dx, drag_dy;
+        int64_t drag_start_time;
+        int64_t next_drag_step_time;
+
+        /* Time that each command was sent for which we are waiting
+         * for a response, or zero if nothing is pending.
+         */
+        int64_t pending[VSX_LOADGEN_N_COMMANDS];
+        int pending_tile;
+        char pending_message[32];
+        unsigned int n_messages;
+};
+
+struct vsx_loadgen_thread {
+        pthread_t thread;
+        bool thread_created;
+
+        int epoll_fd;
+
+        struct vsx_loadgen_bot *bots;
+        int n_bots;
+
+        struct vsx_loadgen_stats stats[VSX_LOADGEN_N_COMMANDS];
+        uint64_t n_errors;
+};
+
+static const char options[] = "-hs:p:b:t:d:r:w:m:c:x:1";
+
+static const char *option_server = "127.0.0.1";
+static int option_server_port = 5144;
+static int option_n_bots = 1000;
+static int option_n_threads = 4;
+static int option_duration = 60;
+static int option_players_per_room = 4;
+static int option_ramp_up = 5;
+/* Mean time in seconds between the actions of each player */
+static double option_move_interval = 3.0;
+static double option_chat_interval = 30.0;
+static double option_reconnect_interval = 120.0;
+static bool option_compact_protocol = true;
+
+static struct vsx_netaddress server_address;
+static int64_t end_time;
+
+static void
+usage(void)
+{
+        printf("verda-sxtelo-loadgen - Simulate players of a "
+               "verda-sxtelo server\n"
+               "usage: verda-sxtelo-loadgen [options]...\n"
+               " -h                   Show this help message\n"
+               " -s <address>         The address of the server\n"
+               " -p <port>            The port on the server\n"
+               " -b <players>         Number of simulated players\n"
+               " -t <threads>         Number of threads to use\n"
+               " -d <seconds>         How long to run for\n"
+               " -r <players>         Number of players in each room\n"
+               " -w <seconds>         Time over which to start connecting\n"
+               " -m <seconds>         Mean time between drags of a tile\n"
+               " -c <seconds>         Mean time between chat messages\n"
+               " -x <seconds>         Mean time between reconnections\n"
+               " -1                   Use version 1 of the protocol\n");
+}
+
+static bool
+parse_number(const char *arg, int min, int *value)
+{
+        char *tail;
+
+        errno = 0;
+        long v = strtol(arg, &tail, 10);
+
+        if (errno || *tail || tail == arg || v < min || v > INT_MAX) {
+                fprintf(stderr, "invalid number: %s\n", arg);
+                return false;
+        }
+
+        *value = v;
+
+        return true;
+}
+
+static bool
+parse_interval(const char *arg, double *value)
+{
+        char *tail;
+
+        errno = 0;
+        double v = strtod(arg, &tail);
+
+        if (errno || *tail || tail == arg || !(v > 0.0)) {
+                fprintf(stderr, "invalid interval: %s\n", arg);
+                return false;
+        }
+
+        *value = v;
+
+        return true;
+}
+
+static bool
+process_arguments(int argc, char **argv)
+{
+        int opt;
+
+        opterr = false;
+
+        while ((opt = getopt(argc, argv, options)) != -1) {
+                switch (opt) {
+                case ':':
+                case '?':
+                        fprintf(stderr, "invalid option '%c'\n", optopt);
+                        return false;
+
+                case '\1':
+                        fprintf(stderr, "unexpected argument \"%s\"\n", optarg);
+                        return false;
+
+                case 'h':
+                        usage();
+                        return false;
+
+                case 's':
+                        option_server = optarg;
+                        break;
+
+                case 'p':
+                        if (!parse_number(optarg, 1, &option_server_port))
+                                return false;
+                        break;
+
+                case 'b':
+                        if (!parse_number(optarg, 1, &option_n_bots))
+                                return false;
+                        break;
+
+                case 't':
+                        if (!parse_number(optarg, 1, &option_n_threads))
+                                return false;
+                        break;
+
+                case 'd':
+                        if (!parse_number(optarg, 1, &option_duration))
+                                return false;
+                        break;
+
+                case 'r':
+                        if (!parse_number(optarg,
+                                          1,
+                                          &option_players_per_room))
+                                return false;
+                        break;
+
+                case 'w':
+                        if (!parse_number(optarg, 0, &option_ramp_up))
+                                return false;
+                        break;
+
+                case 'm':
+                        if (!parse_interval(optarg, &option_move_interval))
+                                return false;
+                        break;
+
+                case 'c':
+                        if (!parse_interval(optarg, &option_chat_interval))
+                                return false;
+                        break;
+
+                case 'x':
+                        if (!parse_interval(optarg,
+                                            &option_reconnect_interval))
+                                return false;
+                        break;
+
+                case '1':
+                        option_compact_protocol = false;
+                        break;
+                }
+        }
+
+        if (!vsx_netaddress_from_string(&server_address,
+                                        option_server,
+                                        option_server_port)) {
+                fprintf(stderr, "invalid server address: %s\n", option_server);
+                return false;
+        }
+
+        if (option_n_threads > option_n_bots)
+                option_n_threads = option_n_bots;
+
+        return true;
+}
+
+/* Returns a random delay in microseconds with an exponential
+ * distribution so that the actions of all the players look like a
+ * Poisson process.
+ */
+static int64_t
+random_delay(struct vsx_loadgen_bot *bot, double mean_seconds)
+{
+        double r = (rand_r(&bot->rand_state) + 1.0) / (RAND_MAX + 2.0);
+
+        return -log(r) * mean_seconds * 1e6;
+}
+
+static int
+random_range(struct vsx_loadgen_bot *bot, int min, int max)
+{
+        return min + rand_r(&bot->rand_state) % (max - min);
+}
+
+static void
+add_sample(struct vsx_loadgen_stats *stats, int64_t value)
+{
+        if (stats->n_samples >= stats->samples_size) {
+                stats->samples_size = MAX(stats->samples_size * 2, 1024);
+                stats->samples = vsx_realloc(stats->samples,
+                                             stats->samples_size *
+                                             sizeof stats->samples[0]);
+        }
+
+        stats->samples[stats->n_samples++] = MIN(value, UINT32_MAX);
+}
+
+static void
+start_command(struct vsx_loadgen_bot *bot,
+              enum vsx_loadgen_command command,
+              int64_t now)
+{
+        bot->thread->stats[command].n_sent++;
+
+        /* Only one instance of each command is timed at a time. If the
+         * previous one is still pending it will be matched against
+         * the first response instead.
+         */
+        if (bot->pending[command] == 0)
+                bot->pending[command] = now;
+}
+
+static void
+finish_command(struct vsx_loadgen_bot *bot,
+               enum vsx_loadgen_command command)
+{
+        int64_t start = bot->pending[command];
+
+        if (start == 0)
+                return;
+
+        bot->pending[command] = 0;
+
+        add_sample(bot->thread->stats + command, vsx_monotonic_get() - start);
+}
+
+static void
+update_poll(struct vsx_loadgen_bot *bot,
+            const struct vsx_connection_event *event)
+{
+        int epoll_fd = bot->thread->epoll_fd;
+        int fd = event->poll_changed.fd;
+        short events = event->poll_changed.events;
+
+        bot->wakeup_time = event->poll_changed.wakeup_time;
+
+        struct epoll_event epoll_event = {
+                /* The poll and epoll flags have the same values */
+                .events = events,
+                .data = { .ptr = bot },
+        };
+
+        if (fd == bot->fd) {
+                if (fd == -1 || events == bot->events)
+                        return;
+
+                /* If the socket was closed and another one was opened
+                 * with the same number then it will have been
+                 * automatically removed from the epoll set.
+                 */
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &epoll_event) ==
+                    -1 &&
+                    errno == ENOENT)
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &epoll_event);
+        } else {
+                /* This will fail if the old socket is already closed,
+                 * but then it would have been removed anyway.
+                 */
+                if (bot->fd != -1)
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, bot->fd, NULL);
+
+                if (fd != -1)
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &epoll_event);
+
+                bot->fd = fd;
+        }
+
+        bot->events = events;
+}
+
+static void
+handle_header(struct vsx_loadgen_bot *bot,
+              const struct vsx_connection_event *event)
+{
+        bot->has_header = true;
+        bot->self_num = event->header.self_num;
+
+        finish_command(bot, VSX_LOADGEN_COMMAND_JOIN);
+        finish_command(bot, VSX_LOADGEN_COMMAND_RECONNECT);
+}
+
+static void
+handle_tile_changed(struct vsx_loadgen_bot *bot,
+                    const struct vsx_connection_event *event)
+{
+        int num = event->tile_changed.num;
+
+        if (num >= bot->n_tiles_in_play) {
+                bot->n_tiles_in_play = num + 1;
+
+                /* Only the player whose turn it is can add a tile
+                 * except for the very first one so a new tile is the
+                 * response to our turn.
+                 */
+                if (event->synced)
+                        finish_command(bot, VSX_LOADGEN_COMMAND_TURN);
+        } else if (num == bot->pending_tile) {
+                if (event->tile_changed.last_player_moved == bot->self_num) {
+                        /* Any of our moves of the tile counts because
+                         * the connection might have replaced the timed
+                         * move with a later step of the drag before
+                         * writing it.
+                         */
+                        finish_command(bot, VSX_LOADGEN_COMMAND_MOVE_TILE);
+                } else {
+                        /* Someone else moved the same tile. The server
+                         * only sends the latest state of each tile so
+                         * our move might never be echoed. Drop the
+                         * measurement rather than count a timeout.
+                         */
+                        bot->pending[VSX_LOADGEN_COMMAND_MOVE_TILE] = 0;
+                }
+        }
+}
+
+static void
+handle_message(struct vsx_loadgen_bot *bot,
+               const struct vsx_connection_event *event)
+{
+        if (event->message.player_num == bot->self_num &&
+            !strcmp(event->message.message, bot->pending_message))
+                finish_command(bot, VSX_LOADGEN_COMMAND_SEND_MESSAGE);
+}
+
+static void
+handle_player_flags_changed(struct vsx_loadgen_bot *bot,
+                            const struct vsx_connection_event *event)
+{
+        if (!bot->has_header || event->player_flags_changed.player_num !=
+            bot->self_num)
+                return;
+
+        bool next_turn = (event->player_flags_changed.flags &
+                          VSX_LOADGEN_PLAYER_FLAG_NEXT_TURN);
+
+        /* Give the player some thinking time before taking the turn */
+        if (next_turn && !bot->next_turn)
+                bot->next_turn_time = (vsx_monotonic_get() +
+                                       random_delay(bot, 1.0));
+
+        bot->next_turn = next_turn;
+}
+
+static void
+event_cb(struct vsx_listener *listener,
+         void *user_data)
+{
+        struct vsx_loadgen_bot *bot =
+                vsx_container_of(listener,
+                                 struct vsx_loadgen_bot,
+                                 event_listener);
+        const struct vsx_connection_event *event = user_data;
+
+        switch (event->type) {
+        case VSX_CONNECTION_EVENT_TYPE_POLL_CHANGED:
+                update_poll(bot, event);
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_HEADER:
+                handle_header(bot, event);
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_TILE_CHANGED:
+                handle_tile_changed(bot, event);
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_N_TILES_CHANGED:
+                bot->n_tiles = event->n_tiles_changed.n_tiles;
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_MESSAGE:
+                handle_message(bot, event);
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_PLAYER_FLAGS_CHANGED:
+                handle_player_flags_changed(bot, event);
+                break;
+        case VSX_CONNECTION_EVENT_TYPE_ERROR:
+                bot->thread->n_errors++;
+                bot->has_header = false;
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+check_timeouts(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        for (int i = 0; i < VSX_LOADGEN_N_COMMANDS; i++) {
+                if (bot->pending[i] &&
+                    now - bot->pending[i] >= VSX_LOADGEN_TIMEOUT) {
+                        bot->thread->stats[i].n_timeouts++;
+                        bot->pending[i] = 0;
+                }
+        }
+}
+
+static void
+reconnect(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        vsx_connection_set_running(bot->connection, false);
+
+        /* Anything that was in flight won’t get a response */
+        memset(bot->pending, 0, sizeof bot->pending);
+
+        bot->has_header = false;
+        bot->drag_steps = 0;
+
+        start_command(bot, VSX_LOADGEN_COMMAND_RECONNECT, now);
+
+        /* The connection still has the person ID so this will send a
+         * reconnect command instead of joining again.
+         */
+        vsx_connection_set_running(bot->connection, true);
+}
+
+static void
+take_turn(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        bot->next_turn = false;
+        bot->next_turn_time = INT64_MAX;
+
+        start_command(bot, VSX_LOADGEN_COMMAND_TURN, now);
+        vsx_connection_turn(bot->connection);
+}
+
+static void
+start_drag(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        bot->drag_tile = random_range(bot, 0, bot->n_tiles_in_play);
+        bot->drag_steps = random_range(bot, 4, 16);
+        bot->drag_x = random_range(bot,
+                                   0,
+                                   VSX_LOADGEN_BOARD_WIDTH -
+                                   VSX_LOADGEN_TILE_SIZE);
+        bot->drag_y = random_range(bot,
+                                   0,
+                                   VSX_LOADGEN_BOARD_HEIGHT -
+                                   VSX_LOADGEN_TILE_SIZE);
+        bot->drag_dx = random_range(bot, -8, 9);
+        bot->drag_dy = random_range(bot, -8, 9);
+        bot->drag_start_time = now;
+        bot->next_drag_step_time = now;
+}
+
+static void
+drag_step(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        bot->drag_x = MIN(MAX(bot->drag_x + bot->drag_dx, 0),
+                          VSX_LOADGEN_BOARD_WIDTH - VSX_LOADGEN_TILE_SIZE);
+        bot->drag_y = MIN(MAX(bot->drag_y + bot->drag_dy, 0),
+                          VSX_LOADGEN_BOARD_HEIGHT - VSX_LOADGEN_TILE_SIZE);
+
+        /* Only the first step of each drag is timed. By then any
+         * echoes of the previous drag will have long arrived so they
+         * can’t be mistaken for the response.
+         */
+        if (bot->next_drag_step_time == bot->drag_start_time) {
+                bot->pending_tile = bot->drag_tile;
+                start_command(bot, VSX_LOADGEN_COMMAND_MOVE_TILE, now);
+        } else {
+                bot->thread->stats[VSX_LOADGEN_COMMAND_MOVE_TILE].n_sent++;
+        }
+
+        vsx_connection_move_tile(bot->connection,
+                                 bot->drag_tile,
+                                 bot->drag_x,
+                                 bot->drag_y);
+
+        if (--bot->drag_steps <= 0) {
+                bot->next_drag_time = now + random_delay(bot,
+                                                         option_move_interval);
+        } else {
+                bot->next_drag_step_time = now + VSX_LOADGEN_DRAG_STEP;
+        }
+}
+
+static void
+send_message(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        bot->next_chat_time = now + random_delay(bot, option_chat_interval);
+
+        /* A new message can’t be matched against its response if the
+         * previous one is still pending.
+         */
+        if (bot->pending[VSX_LOADGEN_COMMAND_SEND_MESSAGE])
+                return;
+
+        snprintf(bot->pending_message,
+                 sizeof bot->pending_message,
+                 "saluton %u-%u",
+                 bot->id,
+                 bot->n_messages++);
+
+        start_command(bot, VSX_LOADGEN_COMMAND_SEND_MESSAGE, now);
+        vsx_connection_send_message(bot->connection, bot->pending_message);
+}
+
+static void
+start_bot(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        bot->started = true;
+
+        bot->next_drag_time = now + random_delay(bot, option_move_interval);
+        bot->next_chat_time = now + random_delay(bot, option_chat_interval);
+        bot->next_reconnect_time =
+                now + random_delay(bot, option_reconnect_interval);
+        /* The first turn is a free for all so just wait a bit */
+        bot->next_turn_time = now + random_delay(bot, 2.0);
+
+        start_command(bot, VSX_LOADGEN_COMMAND_JOIN, now);
+        vsx_connection_set_running(bot->connection, true);
+}
+
+static void
+update_bot(struct vsx_loadgen_bot *bot, int64_t now)
+{
+        if (now >= bot->wakeup_time)
+                vsx_connection_wake_up(bot->connection, 0 /* poll_events */);
+
+        if (!bot->started) {
+                if (now >= bot->start_time)
+                        start_bot(bot, now);
+                return;
+        }
+
+        check_timeouts(bot, now);
+
+        if (!bot->has_header)
+                return;
+
+        if (now >= bot->next_reconnect_time) {
+                bot->next_reconnect_time =
+                        now + random_delay(bot, option_reconnect_interval);
+                reconnect(bot, now);
+                return;
+        }
+
+        if ((bot->next_turn || bot->n_tiles_in_play == 0) &&
+            bot->n_tiles_in_play < bot->n_tiles &&
+            now >= bot->next_turn_time &&
+            bot->pending[VSX_LOADGEN_COMMAND_TURN] == 0)
+                take_turn(bot, now);
+
+        if (bot->drag_steps > 0) {
+                if (now >= bot->next_drag_step_time)
+                        drag_step(bot, now);
+        } else if (bot->n_tiles_in_play > 0 && now >= bot->next_drag_time) {
+                start_drag(bot, now);
+        }
+
+        if (now >= bot->next_chat_time)
+                send_message(bot, now);
+}
+
+static void
+init_bot(struct vsx_loadgen_thread *thread,
+         struct vsx_loadgen_bot *bot,
+         unsigned int id,
+         int64_t start_time)
+{
+        bot->thread = thread;
+        bot->id = id;
+        bot->rand_state = id * 2654435761u;
+        bot->fd = -1;
+        bot->wakeup_time = INT64_MAX;
+        bot->start_time = start_time;
+        bot->n_tiles = INT_MAX;
+        bot->next_turn_time = INT64_MAX;
+
+        bot->connection = vsx_connection_new();
+
+        bot->event_listener.notify = event_cb;
+        vsx_signal_add(vsx_connection_get_event_signal(bot->connection),
+                       &bot->event_listener);
+
+        char buf[32];
+
+        snprintf(buf, sizeof buf, "loadgen-%u",
+                 id / option_players_per_room);
+        vsx_connection_set_room(bot->connection, buf);
+
+        snprintf(buf, sizeof buf, "Bot %u", id);
+        vsx_connection_set_player_name(bot->connection, buf);
+
+        vsx_connection_set_address(bot->connection, &server_address);
+
+        vsx_connection_set_compact_protocol(bot->connection,
+                                            option_compact_protocol);
+}
+
+static void *
+thread_func(void *user_data)
+{
+        struct vsx_loadgen_thread *thread = user_data;
+        struct epoll_event events[VSX_LOADGEN_MAX_EVENTS];
+        int64_t next_tick = 0;
+
+        while (true) {
+                int64_t now = vsx_monotonic_get();
+
+                if (now >= end_time)
+                        break;
+
+                if (now >= next_tick) {
+                        for (int i = 0; i < thread->n_bots; i++)
+                                update_bot(thread->bots + i, now);
+
+                        next_tick = now + VSX_LOADGEN_TICK;
+                }
+
+                int timeout = (next_tick - now) / 1000 + 1;
+
+                int n_events = epoll_wait(thread->epoll_fd,
+                                          events,
+                                          VSX_N_ELEMENTS(events),
+                                          timeout);
+
+                if (n_events == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        fprintf(stderr, "epoll_wait failed: %s\n",
+                                strerror(errno));
+                        break;
+                }
+
+                for (int i = 0; i < n_events; i++) {
+                        struct vsx_loadgen_bot *bot = events[i].data.ptr;
+
+                        vsx_connection_wake_up(bot->connection,
+                                               events[i].events);
+                }
+        }
+
+        return NULL;
+}
+
+static void
+free_thread(struct vsx_loadgen_thread *thread)
+{
+        for (int i = 0; i < thread->n_bots; i++)
+                vsx_connection_free(thread->bots[i].connection);
+
+        vsx_free(thread->bots);
+
+        if (thread->epoll_fd != -1)
+                vsx_close(thread->epoll_fd);
+
+        for (int i = 0; i < VSX_LOADGEN_N_COMMANDS; i++)
+                vsx_free(thread->stats[i].samples);
+}
+
+static bool
+init_thread(struct vsx_loadgen_thread *thread,
+            int first_bot,
+            int n_bots,
+            int64_t start_time)
+{
+        thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (thread->epoll_fd == -1) {
+                fprintf(stderr, "epoll_create1 failed: %s\n",
+                        strerror(errno));
+                return false;
+        }
+
+        thread->n_bots = n_bots;
+        thread->bots = vsx_calloc(n_bots * sizeof thread->bots[0]);
+
+        /* Spread the connections out over the ramp-up time so that the
+         * server isn’t hit with all of them at once.
+         */
+        int64_t ramp_up = option_ramp_up * (int64_t) 1000000;
+
+        for (int i = 0; i < n_bots; i++) {
+                int id = first_bot + i;
+
+                init_bot(thread,
+                         thread->bots + i,
+                         id,
+                         start_time + ramp_up * id / option_n_bots);
+        }
+
+        return true;
+}
+
+static bool
+start_thread(struct vsx_loadgen_thread *thread)
+{
+        int ret = vsx_thread_create(&thread->thread,
+                                    "LoadgenThread",
+                                    NULL, /* attr */
+                                    thread_func,
+                                    thread);
+
+        if (ret) {
+                fprintf(stderr, "Error creating thread: %s\n",
+                        strerror(ret));
+                return false;
+        }
+
+        thread->thread_created = true;
+
+        return true;
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+        uint32_t va = *(const uint32_t *) a;
+        uint32_t vb = *(const uint32_t *) b;
+
+        return (va > vb) - (va < vb);
+}
+
+static double
+get_percentile(const struct vsx_loadgen_stats *stats, double percentile)
+{
+        if (stats->n_samples == 0)
+                return 0.0;
+
+        size_t index = ceil(stats->n_samples * percentile);
+
+        if (index > 0)
+                index--;
+
+        return stats->samples[index] / 1000.0;
+}
+
+static void
+report(struct vsx_loadgen_thread *threads, double elapsed)
+{
+        uint64_t n_errors = 0;
+
+        for (int i = 0; i < option_n_threads; i++)
+                n_errors += threads[i].n_errors;
+
+        printf("%-14s %10s %10s %9s %10s %9s %9s %9s\n",
+               "command",
+               "sent",
+               "samples",
+               "timeouts",
+               "sent/s",
+               "p50 ms",
+               "p99 ms",
+               "p99.9 ms");
+
+        for (int command = 0; command < VSX_LOADGEN_N_COMMANDS; command++) {
+                struct vsx_loadgen_stats total = { 0 };
+
+                for (int i = 0; i < option_n_threads; i++) {
+                        const struct vsx_loadgen_stats *stats =
+                                threads[i].stats + command;
+
+                        total.n_sent += stats->n_sent;
+                        total.n_timeouts += stats->n_timeouts;
+                        total.n_samples += stats->n_samples;
+                }
+
+                total.samples = vsx_alloc(MAX(total.n_samples, 1) *
+                                          sizeof total.samples[0]);
+
+                size_t pos = 0;
+
+                for (int i = 0; i < option_n_threads; i++) {
+                        const struct vsx_loadgen_stats *stats =
+                                threads[i].stats + command;
+
+                        memcpy(total.samples + pos,
+                               stats->samples,
+                               stats->n_samples * sizeof stats->samples[0]);
+                        pos += stats->n_samples;
+                }
+
+                qsort(total.samples,
+                      total.n_samples,
+                      sizeof total.samples[0],
+                      compare_samples);
+
+                printf("%-14s %10" PRIu64 " %10zu %9" PRIu64
+                       " %10.1f %9.3f %9.3f %9.3f\n",
+                       command_names[command],
+                       total.n_sent,
+                       total.n_samples,
+                       total.n_timeouts,
+                       total.n_sent / elapsed,
+                       get_percentile(&total, 0.5),
+                       get_percentile(&total, 0.99),
+                       get_percentile(&total, 0.999));
+
+                vsx_free(total.samples);
+        }
+
+        printf("\n"
+               "players: %i, threads: %i, duration: %.1fs, "
+               "connection errors: %" PRIu64 "\n",
+               option_n_bots,
+               option_n_threads,
+               elapsed,
+               n_errors);
+}
+
+int
+main(int argc, char **argv)
+{
+        if (!process_arguments(argc, argv))
+                return EXIT_FAILURE;
+
+        int ret = EXIT_SUCCESS;
+
+        struct vsx_loadgen_thread *threads =
+                vsx_calloc(option_n_threads * sizeof threads[0]);
+
+        for (int i = 0; i < option_n_threads; i++)
+                threads[i].epoll_fd = -1;
+
+        int64_t start_time = vsx_monotonic_get();
+
+        end_time = start_time + option_duration * (int64_t) 1000000;
+
+        for (int i = 0; i < option_n_threads; i++) {
+                int first_bot = option_n_bots * i / option_n_threads;
+                int next_first_bot = option_n_bots * (i + 1) / option_n_threads;
+
+                if (!init_thread(threads + i,
+                                 first_bot,
+                                 next_first_bot - first_bot,
+                                 start_time)) {
+                        ret = EXIT_FAILURE;
+                        goto out;
+                }
+        }
+
+        /* If a thread fails to start then the others will still run
+         * until the end time, but nothing will be reported.
+         */
+        for (int i = 0; i < option_n_threads; i++) {
+                if (!start_thread(threads + i)) {
+                        ret = EXIT_FAILURE;
+                        break;
+                }
+        }
+
+        for (int i = 0; i < option_n_threads; i++) {
+                if (threads[i].thread_created)
+                        pthread_join(threads[i].thread, NULL /* retval */);
+                threads[i].thread_created = false;
+        }
+
+        if (ret == EXIT_SUCCESS)
+                report(threads, (vsx_monotonic_get() - start_time) / 1e6);
+
+out:
+        for (int i = 0; i < option_n_threads; i++)
+                free_thread(threads + i);
+
+        vsx_free(threads);
+
+        return ret;
+}
@@ -42,6 +42,7 @@
 #include "vsx-game-painter.h"
 #include "vsx-main-thread.h"
 #include "vsx-id-url.h"
+#include "vsx-frame-scheduler.h"
 
 #define MIN_GL_MAJOR_VERSION 2
 #define MIN_GL_MINOR_VERSION 0
@@ -86,7 +87,8 @@ struct vsx_main_data {
 
         SDL_Event wakeup_event;
 
-        bool redraw_queued;
+        struct vsx_frame_scheduler *frame_scheduler;
+        const char *painter_names[VSX_GAME_PAINTER_N_PAINTERS];
 
         bool should_quit;
 };
@@ -97,8 +99,9 @@ static char *option_room = NULL;
 static char *option_player_name = NULL;
 static bool option_conversation_id_specified = false;
 static uint64_t option_conversation_id;
+static bool option_print_frame_stats = false;
 
-static const char options[] = "-hs:p:r:n:u:";
+static const char options[] = "-hs:p:r:n:u:S";
 
 static void
 usage(void)
@@ -111,7 +114,8 @@ usage(void)
                " -p <port>            The port on the server to connect to\n"
                " -r <room>            The room to connect to\n"
                " -n <player>          The player name\n"
-               " -u <url>             An invite URL of a game to join\n");
+               " -u <url>             An invite URL of a game to join\n"
+               " -S                   Print statistics after each frame\n");
 }
 
 static bool
@@ -169,6 +173,10 @@ process_arguments(int argc, char **argv)
                         if (!parse_invite_url(optarg))
                                 return false;
                         break;
+
+                case 'S':
+                        option_print_frame_stats = true;
+                        break;
                 }
         }
 
@@ -333,6 +341,23 @@ init_sdl_window(struct vsx_main_data *main_data)
 
         SDL_GL_MakeCurrent(main_data->window, main_data->gl_context);
 
+        /* Try to sync the buffer swaps to the display. This isn’t
+         * always available so the frame scheduler also limits the
+         * frame rate.
+         */
+        SDL_GL_SetSwapInterval(1);
+
+        SDL_DisplayMode mode;
+
+        if (SDL_GetWindowDisplayMode(main_data->window, &mode) == 0 &&
+            mode.refresh_rate > 0) {
+                struct vsx_frame_scheduler *sched = main_data->frame_scheduler;
+
+                vsx_frame_scheduler_set_refresh_interval(sched,
+                                                         1000000 /
+                                                         mode.refresh_rate);
+        }
+
         main_data->gl = vsx_gl_new(gl_get_proc_address, NULL /* user_data */);
 
         if (!check_gl_version(main_data->gl))
@@ -347,7 +372,7 @@ queue_redraw_cb(struct vsx_shell_interface *shell)
         struct vsx_main_data *main_data =
                 vsx_container_of(shell, struct vsx_main_data, shell);
 
-        main_data->redraw_queued = true;
+        vsx_frame_scheduler_queue_redraw(main_data->frame_scheduler);
 }
 
 static void
@@ -451,6 +476,8 @@ create_connection(void)
 {
         struct vsx_connection *connection = vsx_connection_new();
 
+        vsx_connection_set_compact_protocol(connection, true);
+
         if (option_room)
                 vsx_connection_set_room(connection, option_room);
 
@@ -624,6 +651,19 @@ recreate_resources(struct vsx_main_data *main_data)
         vsx_free(instance_state);
 }
 
+static void
+dump_frame_stats(struct vsx_main_data *main_data)
+{
+        struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+
+        vsx_frame_scheduler_dump(main_data->frame_scheduler, &buf);
+
+        fwrite(buf.data, 1, buf.length, stdout);
+        fflush(stdout);
+
+        vsx_buffer_destroy(&buf);
+}
+
 static bool
 handle_key_down_event(struct vsx_main_data *main_data,
                  const SDL_KeyboardEvent *event)
@@ -636,6 +676,10 @@ handle_key_down_event(struct vsx_main_data *main_data,
         case SDLK_g:
                 vsx_game_state_reset(main_data->game_state);
                 return true;
+
+        case SDLK_f:
+                dump_frame_stats(main_data);
+                return true;
         }
 
         return false;
@@ -663,10 +707,10 @@ handle_event(struct vsx_main_data *main_data,
                         update_fb_size(main_data,
                                        event->window.data1,
                                        event->window.data2);
-                        main_data->redraw_queued = true;
+                        queue_redraw_cb(&main_data->shell);
                         break;
                 case SDL_WINDOWEVENT_EXPOSED:
-                        main_data->redraw_queued = true;
+                        queue_redraw_cb(&main_data->shell);
                         break;
                 }
                 goto handled;
@@ -714,32 +758,62 @@ wakeup_cb(void *user_data)
 static void
 paint(struct vsx_main_data *main_data)
 {
+        struct vsx_frame_scheduler *sched = main_data->frame_scheduler;
+
+        vsx_frame_scheduler_begin_frame(sched, vsx_monotonic_get());
+
         vsx_game_painter_paint(main_data->game_painter);
 
+        struct vsx_game_painter_frame_stats stats;
+
+        vsx_game_painter_get_frame_stats(main_data->game_painter, &stats);
+
+        /* End the frame before swapping so that the time spent
+         * waiting for the display isn’t counted.
+         */
+        vsx_frame_scheduler_end_frame(sched,
+                                      vsx_monotonic_get(),
+                                      stats.n_draw_calls,
+                                      stats.painter_times);
+
         SDL_GL_SwapWindow(main_data->window);
+
+        if (option_print_frame_stats)
+                printf("draw calls: %u\n", stats.n_draw_calls);
 }
 
 static void
 run_main_loop(struct vsx_main_data *main_data)
 {
+        struct vsx_frame_scheduler *sched = main_data->frame_scheduler;
+
         while (!main_data->should_quit) {
-                bool redraw_queued = main_data->redraw_queued;
+                int64_t delay =
+                        vsx_frame_scheduler_get_delay(sched,
+                                                      vsx_monotonic_get());
 
                 SDL_Event event;
                 bool had_event;
 
-                if (redraw_queued)
-                        had_event = SDL_PollEvent(&event);
-                else
+                if (delay < 0) {
                         had_event = SDL_WaitEvent(&event);
+                } else if (delay == 0) {
+                        had_event = SDL_PollEvent(&event);
+                } else {
+                        /* Wait until it’s time for the next frame
+                         * but keep handling events in the meantime.
+                         * All of the redraws that are queued until
+                         * then are painted in a single frame.
+                         */
+                        had_event = SDL_WaitEventTimeout(&event,
+                                                         (delay + 999) /
+                                                         1000);
+                }
 
-                if (had_event) {
+                if (had_event)
                         handle_event(main_data, &event);
-                } else if (main_data->redraw_queued) {
-                        main_data->redraw_queued = false;
-
+                else if (delay == 0)
                         paint(main_data);
-                }
         }
 }
 
@@ -760,6 +834,9 @@ free_main_data(struct vsx_main_data *main_data)
 
         finish_sdl(main_data);
 
+        if (main_data->frame_scheduler)
+                vsx_frame_scheduler_free(main_data->frame_scheduler);
+
         if (main_data->asset_manager)
                 vsx_asset_manager_free(main_data->asset_manager);
 
@@ -773,6 +850,15 @@ create_main_data(void)
 
         main_data->asset_manager = vsx_asset_manager_new();
 
+        for (int i = 0; i < VSX_GAME_PAINTER_N_PAINTERS; i++) {
+                main_data->painter_names[i] =
+                        vsx_game_painter_get_painter_name(i);
+        }
+
+        main_data->frame_scheduler =
+                vsx_frame_scheduler_new(VSX_GAME_PAINTER_N_PAINTERS,
+                                        main_data->painter_names);
+
         vsx_signal_init(&main_data->shell.name_size_signal);
 
         main_data->shell.queue_redraw_cb = queue_redraw_cb;
@@ -417,10 +417,12 @@ create_cb(struct vsx_game_state *game_state,
         struct vsx_image_loader *image_loader =
                 painter->toolbox->image_loader;
 
-        painter->image_token = vsx_image_loader_load(image_loader,
-                                                     "menu.mpng",
-                                                     texture_load_cb,
-                                                     painter);
+        painter->image_token =
+                vsx_image_loader_load(image_loader,
+                                      "menu.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_NORMAL,
+                                      texture_load_cb,
+                                      painter);
 
         return painter;
 }
@@ -672,7 +674,7 @@ paint_cb(void *painter_data)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->toolbox->paint_state.pixel_matrix,
                                  painter->translation);
 
@@ -685,7 +687,7 @@ paint_cb(void *painter_data)
 
         struct vsx_gl *gl = painter->toolbox->gl;
 
-        gl->glUseProgram(program->program);
+        vsx_gl_use_program(gl, program->program);
 
         gl->glUniformMatrix2fv(program->matrix_uniform,
                                1, /* count */
@@ -27,12 +27,19 @@
 #include "vsx-util.h"
 #include "vsx-image.h"
 #include "vsx-asset.h"
+#include "vsx-baked-texture.h"
 
 void
 vsx_mipmap_get_actual_image_size(const struct vsx_image *image,
                                  int *width_out,
                                  int *height_out)
 {
+        if (image->baked_asset) {
+                *width_out = image->width;
+                *height_out = image->height;
+                return;
+        }
+
         *width_out = image->width;
         /* The image in the file is 1.5 times the size of the base
          * image in order to accomodate the mipmap images.
@@ -104,6 +111,41 @@ format_for_image(const struct vsx_image *image)
         return GL_ALPHA;
 }
 
+static void
+load_baked_image(const struct vsx_image *image,
+                 struct vsx_gl *gl)
+{
+        GLenum format = format_for_image(image);
+        const uint8_t *data = image->data;
+        int width = image->width, height = image->height;
+        int mipmap_level = 0;
+
+        /* The levels are already laid out with the right alignment
+         * so they can be uploaded straight from the mapped file.
+         */
+        while (true) {
+                gl->glTexImage2D(GL_TEXTURE_2D,
+                                 mipmap_level,
+                                 format,
+                                 width, height,
+                                 0, /* border */
+                                 format,
+                                 GL_UNSIGNED_BYTE,
+                                 data);
+
+                if (width <= 1 && height <= 1)
+                        break;
+
+                data += vsx_baked_texture_get_stride(width,
+                                                     image->components) *
+                        height;
+
+                width = MAX(1, width / 2);
+                height = MAX(1, height / 2);
+                mipmap_level++;
+        }
+}
+
 void
 vsx_mipmap_load_image(const struct vsx_image *image,
                       struct vsx_gl *gl,
@@ -111,6 +153,11 @@ vsx_mipmap_load_image(const struct vsx_image *image,
 {
         gl->glBindTexture(GL_TEXTURE_2D, tex);
 
+        if (image->baked_asset) {
+                load_baked_image(image, gl);
+                return;
+        }
+
         int width, height;
         vsx_mipmap_get_actual_image_size(image, &width, &height);
 
@@ -129,6 +176,9 @@ vsx_mipmap_load_image_at_offset(const struct vsx_image *image,
                                 int x_off,
                                 int y_off)
 {
+        /* Baked images can only be loaded with vsx_mipmap_load_image */
+        assert(image->baked_asset == NULL);
+
         gl->glBindTexture(GL_TEXTURE_2D, tex);
 
         bool go_down = true;
@@ -24,9 +24,7 @@
 #include <string.h>
 #include <assert.h>
 
-#include "vsx-map-buffer.h"
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
 #include "vsx-layout.h"
 #include "vsx-buffer.h"
 
@@ -43,10 +41,6 @@ struct vsx_name_painter {
 
         struct vsx_toolbox *toolbox;
 
-        struct vsx_array_object *vao;
-        GLuint vbo;
-        struct vsx_quad_tool_buffer *quad_buffer;
-
         bool layout_dirty;
 
         struct vsx_layout_paint_position layouts[5];
@@ -72,10 +66,6 @@ struct vsx_name_painter {
         struct vsx_listener shadow_painter_ready_listener;
 };
 
-struct vertex {
-        float x, y;
-};
-
 enum layout {
         LAYOUT_NOTE,
         LAYOUT_BUTTON,
@@ -90,9 +80,6 @@ link_layouts[N_LINKS] = {
         LAYOUT_COPYRIGHT,
 };
 
-#define N_QUADS 3
-#define N_VERTICES (N_QUADS * 4)
-
 /* Gap in MM around the dialog */
 #define DIALOG_GAP 5
 /* Border in MM inside the dialog around the contents */
@@ -346,74 +333,6 @@ update_link_layouts(struct vsx_name_painter *painter)
                                                  painter->links_rect.h);
 }
 
-static void
-store_quad(struct vertex *v, const struct vsx_name_painter_rect *rect)
-{
-        v->x = rect->x;
-        v->y = rect->y;
-        v++;
-
-        v->x = rect->x;
-        v->y = rect->y + rect->h;
-        v++;
-
-        v->x = rect->x + rect->w;
-        v->y = rect->y;
-        v++;
-
-        v->x = rect->x + rect->w;
-        v->y = rect->y + rect->h;
-        v++;
-}
-
-static void
-update_vertices(struct vsx_name_painter *painter)
-{
-        struct vertex vertices[N_VERTICES];
-
-        store_quad(vertices, &painter->dialog_rect);
-        store_quad(vertices + 4, &painter->links_rect);
-        store_quad(vertices + 8, &painter->button_rect);
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         sizeof vertices,
-                         vertices,
-                         GL_DYNAMIC_DRAW);
-}
-
-static void
-create_buffer(struct vsx_name_painter *painter)
-{
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         N_VERTICES * sizeof (struct vertex),
-                         NULL, /* data */
-                         GL_DYNAMIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_FLOAT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-
-        painter->quad_buffer =
-                vsx_quad_tool_get_buffer(painter->toolbox->quad_tool,
-                                         painter->vao,
-                                         N_QUADS);
-}
-
 static void *
 create_cb(struct vsx_game_state *game_state,
           struct vsx_toolbox *toolbox)
@@ -429,9 +348,6 @@ create_cb(struct vsx_game_state *game_state,
         painter->toolbox = toolbox;
         painter->layout_dirty = true;
 
-        create_buffer(painter);
-        update_vertices(painter);
-
         for (int i = 0; i < VSX_N_ELEMENTS(painter->layouts); i++) {
                 painter->layouts[i].layout = vsx_layout_new(toolbox);
                 vsx_layout_set_font(painter->layouts[i].layout, FONT);
@@ -622,26 +538,29 @@ prepare_cb(void *painter_data)
 
         update_transform(painter, paint_state);
 
-        update_vertices(painter);
-
         create_dialog_shadow(painter);
 
         painter->layout_dirty = false;
 }
 
 static void
-set_uniforms(struct vsx_name_painter *painter,
-             const struct vsx_shader_data_program_data *program)
+add_rect(struct vsx_name_painter *painter,
+         const struct vsx_name_painter_rect *rect,
+         float r, float g, float b)
 {
-        struct vsx_gl *gl = painter->toolbox->gl;
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_SOLID,
+                .translation = { -1.0f, 1.0f },
+                .color = { r, g, b },
+        };
 
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               painter->matrix);
-        gl->glUniform2f(program->translation_uniform, -1.0f, 1.0f);
+        memcpy(state.matrix, painter->matrix, sizeof state.matrix);
 
-        gl->glUniform3f(program->color_uniform, 1.0f, 1.0f, 1.0f);
+        vsx_quad_batch_add_rectangle(painter->toolbox->quad_batch,
+                                     &state,
+                                     rect->x, rect->y,
+                                     rect->x + rect->w,
+                                     rect->y + rect->h);
 }
 
 static void
@@ -657,7 +576,7 @@ paint_shadows(struct vsx_name_painter *painter)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->dialog_shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->matrix,
                                  dialog_translation);
 
@@ -668,7 +587,7 @@ paint_shadows(struct vsx_name_painter *painter)
 
         vsx_shadow_painter_paint(painter->toolbox->shadow_painter,
                                  painter->links_shadow,
-                                 &painter->toolbox->shader_data,
+                                 painter->toolbox->quad_batch,
                                  painter->matrix,
                                  links_translation);
 }
@@ -683,29 +602,9 @@ paint_cb(void *painter_data)
 
         paint_shadows(painter);
 
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_SOLID;
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glUseProgram(program->program);
-
-        set_uniforms(painter, program);
-
-        vsx_array_object_bind(painter->vao, gl);
-
-        vsx_gl_draw_range_elements(gl,
-                                   GL_TRIANGLES,
-                                   0, 2 * 4 - 1,
-                                   2 * 6,
-                                   painter->quad_buffer->type,
-                                   NULL /* offset */);
-
-        gl->glUniform3f(program->color_uniform, 0.498f, 0.523f, 0.781f);
-
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
+        add_rect(painter, &painter->dialog_rect, 1.0f, 1.0f, 1.0f);
+        add_rect(painter, &painter->links_rect, 1.0f, 1.0f, 1.0f);
+        add_rect(painter, &painter->button_rect, 0.498f, 0.523f, 0.781f);
 
         struct vsx_layout_paint_params params = {
                 .layouts = painter->layouts,
@@ -815,15 +714,6 @@ free_cb(void *painter_data)
         vsx_list_remove(&painter->modified_listener.link);
         vsx_list_remove(&painter->name_size_listener.link);
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-        if (painter->quad_buffer)
-                vsx_quad_tool_unref_buffer(painter->quad_buffer, gl);
-
         for (int i = 0; i < VSX_N_ELEMENTS(painter->layouts); i++) {
                 if (painter->layouts[i].layout)
                         vsx_layout_free(painter->layouts[i].layout);
@@ -23,9 +23,9 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
 #include "vsx-layout.h"
 #include "vsx-main-thread.h"
 
@@ -35,10 +35,9 @@ struct vsx_note_painter {
 
         struct vsx_toolbox *toolbox;
 
-        struct vsx_array_object *vao;
-        GLuint vbo;
-
         int layout_x, layout_y;
+        int box_x1, box_y1;
+        int box_x2, box_y2;
 
         struct vsx_layout *layout;
         bool layout_dirty;
@@ -47,12 +46,6 @@ struct vsx_note_painter {
         struct vsx_main_thread_token *remove_note_timeout;
 };
 
-struct vertex {
-        int16_t x, y;
-};
-
-#define N_VERTICES 4
-
 /* Gap in mm between the bottom of the screen and the bottom of the note */
 #define BOTTOM_GAP 5
 /* Border around the note in mm */
@@ -131,31 +124,6 @@ modified_cb(struct vsx_listener *listener,
         }
 }
 
-static void
-create_buffer(struct vsx_note_painter *painter)
-{
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glGenBuffers(1, &painter->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         N_VERTICES * sizeof (struct vertex),
-                         NULL, /* data */
-                         GL_DYNAMIC_DRAW);
-
-        painter->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(painter->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       painter->vbo,
-                                       offsetof(struct vertex, x));
-}
-
 static void *
 create_cb(struct vsx_game_state *game_state,
           struct vsx_toolbox *toolbox)
@@ -171,8 +139,6 @@ create_cb(struct vsx_game_state *game_state,
         vsx_layout_set_font(painter->layout,
                             VSX_FONT_TYPE_LABEL);
 
-        create_buffer(painter);
-
         painter->modified_listener.notify = modified_cb;
         vsx_signal_add(vsx_game_state_get_modified_signal(game_state),
                        &painter->modified_listener);
@@ -222,25 +188,10 @@ prepare_cb(void *painter_data)
                              bottom_gap -
                              extents->bottom);
 
-        int box_x1 = painter->layout_x - extents->left - border;
-        int box_x2 = painter->layout_x + extents->right + border;
-        int box_y1 = painter->layout_y - extents->top - border;
-        int box_y2 = painter->layout_y + extents->bottom + border;
-
-        struct vertex vertices[] = {
-                { box_x1, box_y1 },
-                { box_x1, box_y2 },
-                { box_x2, box_y1 },
-                { box_x2, box_y2 },
-        };
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glBindBuffer(GL_ARRAY_BUFFER, painter->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         sizeof vertices,
-                         vertices,
-                         GL_DYNAMIC_DRAW);
+        painter->box_x1 = painter->layout_x - extents->left - border;
+        painter->box_x2 = painter->layout_x + extents->right + border;
+        painter->box_y1 = painter->layout_y - extents->top - border;
+        painter->box_y2 = painter->layout_y + extents->bottom + border;
 
         painter->layout_dirty = false;
 }
@@ -253,29 +204,23 @@ paint_cb(void *painter_data)
         if (painter->text == NULL)
                 return;
 
-        const struct vsx_shader_data *shader_data =
-                &painter->toolbox->shader_data;
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_SOLID;
-
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        gl->glUseProgram(program->program);
-        vsx_array_object_bind(painter->vao, gl);
-
         struct vsx_paint_state *paint_state = &painter->toolbox->paint_state;
 
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               paint_state->pixel_matrix);
-        gl->glUniform2f(program->translation_uniform,
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_SOLID,
+                .translation = {
                         paint_state->pixel_translation[0],
-                        paint_state->pixel_translation[1]);
-        gl->glUniform3f(program->color_uniform,
-                        0.0f, 0.0f, 0.0f);
+                        paint_state->pixel_translation[1],
+                },
+                .color = { 0.0f, 0.0f, 0.0f },
+        };
+
+        memcpy(state.matrix, paint_state->pixel_matrix, sizeof state.matrix);
 
-        gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        vsx_quad_batch_add_rectangle(painter->toolbox->quad_batch,
+                                     &state,
+                                     painter->box_x1, painter->box_y1,
+                                     painter->box_x2, painter->box_y2);
 
         vsx_layout_paint(painter->layout,
                          painter->layout_x,
@@ -317,13 +262,6 @@ free_cb(void *painter_data)
         vsx_free(painter->text);
         cancel_timeout(painter);
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
-        if (painter->vao)
-                vsx_array_object_free(painter->vao, gl);
-        if (painter->vbo)
-                gl->glDeleteBuffers(1, &painter->vbo);
-
         vsx_free(painter);
 }
 
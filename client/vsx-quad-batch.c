@@ -0,0 +1,500 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-quad-batch.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "vsx-array-object.h"
+#include "vsx-buffer.h"
+#include "vsx-util.h"
+
+/* The vertices are indexed with 16-bit elements so this is the most
+ * quads that can be drawn from the buffer at once.
+ */
+#define VSX_QUAD_BATCH_MAX_QUADS (65536 / 4)
+
+/* Minimum size of the vertex buffer in quads */
+#define VSX_QUAD_BATCH_MIN_QUADS 16
+
+/* A range of consecutive quads that all have the same state */
+struct vsx_quad_batch_run {
+        struct vsx_quad_batch_state state;
+        int first_quad;
+        int n_quads;
+};
+
+struct vsx_quad_batch {
+        struct vsx_gl *gl;
+        struct vsx_map_buffer *map_buffer;
+        struct vsx_quad_tool *quad_tool;
+        const struct vsx_shader_data *shader_data;
+
+        /* Array of struct vsx_quad_batch_vertex */
+        struct vsx_buffer vertices;
+        /* Array of struct vsx_quad_batch_run */
+        struct vsx_buffer runs;
+
+        struct vsx_array_object *vao;
+        GLuint vbo;
+        int buffer_n_quads;
+        struct vsx_quad_tool_buffer *quad_buffer;
+};
+
+struct vsx_quad_batch *
+vsx_quad_batch_new(struct vsx_gl *gl,
+                   struct vsx_map_buffer *map_buffer,
+                   struct vsx_quad_tool *quad_tool,
+                   const struct vsx_shader_data *shader_data)
+{
+        struct vsx_quad_batch *batch = vsx_calloc(sizeof *batch);
+
+        batch->gl = gl;
+        batch->map_buffer = map_buffer;
+        batch->quad_tool = quad_tool;
+        batch->shader_data = shader_data;
+
+        vsx_buffer_init(&batch->vertices);
+        vsx_buffer_init(&batch->runs);
+
+        return batch;
+}
+
+static void
+draw_quads(struct vsx_quad_batch *batch);
+
+static int
+get_n_quads(struct vsx_quad_batch *batch)
+{
+        return (batch->vertices.length /
+                (sizeof (struct vsx_quad_batch_vertex) * 4));
+}
+
+/* Checks whether two states can be drawn with the same draw call.
+ * The transformation doesn’t matter because it is applied to the
+ * vertices.
+ */
+static bool
+states_equal(const struct vsx_quad_batch_state *a,
+             const struct vsx_quad_batch_state *b)
+{
+        if (a->program != b->program ||
+            a->blend != b->blend ||
+            a->scissor != b->scissor)
+                return false;
+
+        if (a->scissor &&
+            (a->scissor_x != b->scissor_x ||
+             a->scissor_y != b->scissor_y ||
+             a->scissor_width != b->scissor_width ||
+             a->scissor_height != b->scissor_height))
+                return false;
+
+        switch (a->program) {
+        case VSX_SHADER_DATA_PROGRAM_TEXTURE:
+                return a->tex == b->tex;
+        case VSX_SHADER_DATA_PROGRAM_SOLID:
+                return !memcmp(a->color, b->color, sizeof a->color);
+        default:
+                break;
+        }
+
+        assert(!"Unsupported program for the quad batch");
+
+        return false;
+}
+
+static void
+flush_cb(void *data)
+{
+        struct vsx_quad_batch *batch = data;
+
+        draw_quads(batch);
+}
+
+static void
+add_vertices(struct vsx_quad_batch *batch,
+             const struct vsx_quad_batch_state *state,
+             const struct vsx_quad_batch_vertex *vertices,
+             int n_quads)
+{
+        size_t old_length = batch->vertices.length;
+        int n_vertices = n_quads * 4;
+
+        vsx_buffer_set_length(&batch->vertices,
+                              old_length +
+                              n_vertices * sizeof *vertices);
+
+        struct vsx_quad_batch_vertex *v =
+                (struct vsx_quad_batch_vertex *)
+                (batch->vertices.data + old_length);
+        const GLfloat *m = state->matrix;
+        const GLfloat *t = state->translation;
+
+        /* Apply the transformation in the same way as the vertex
+         * shaders. The matrix is in column-major order.
+         */
+        for (int i = 0; i < n_vertices; i++) {
+                v[i].x = m[0] * vertices[i].x + m[2] * vertices[i].y + t[0];
+                v[i].y = m[1] * vertices[i].x + m[3] * vertices[i].y + t[1];
+                v[i].s = vertices[i].s;
+                v[i].t = vertices[i].t;
+        }
+}
+
+static void
+add_run(struct vsx_quad_batch *batch,
+        const struct vsx_quad_batch_state *state,
+        int first_quad,
+        int n_quads)
+{
+        /* Only the last run can be extended so that the quads are
+         * still drawn in the order they were added.
+         */
+        if (batch->runs.length > 0) {
+                struct vsx_quad_batch_run *last_run =
+                        (struct vsx_quad_batch_run *)
+                        (batch->runs.data + batch->runs.length) - 1;
+
+                if (states_equal(&last_run->state, state)) {
+                        last_run->n_quads += n_quads;
+                        return;
+                }
+        } else {
+                /* Make sure the quads get drawn before anything
+                 * else changes the state.
+                 */
+                assert(batch->gl->flush_cb == NULL);
+                batch->gl->flush_cb = flush_cb;
+                batch->gl->flush_data = batch;
+        }
+
+        struct vsx_quad_batch_run run = {
+                .state = *state,
+                .first_quad = first_quad,
+                .n_quads = n_quads,
+        };
+
+        vsx_buffer_append(&batch->runs, &run, sizeof run);
+}
+
+void
+vsx_quad_batch_add_quads(struct vsx_quad_batch *batch,
+                         const struct vsx_quad_batch_state *state,
+                         const struct vsx_quad_batch_vertex *vertices,
+                         int n_quads)
+{
+        assert(state->program == VSX_SHADER_DATA_PROGRAM_TEXTURE ||
+               state->program == VSX_SHADER_DATA_PROGRAM_SOLID);
+
+        while (n_quads > 0) {
+                int quad_num = get_n_quads(batch);
+
+                if (quad_num >= VSX_QUAD_BATCH_MAX_QUADS) {
+                        vsx_quad_batch_flush(batch);
+                        quad_num = 0;
+                }
+
+                int to_add = MIN(n_quads,
+                                 VSX_QUAD_BATCH_MAX_QUADS - quad_num);
+
+                add_vertices(batch, state, vertices, to_add);
+                add_run(batch, state, quad_num, to_add);
+
+                vertices += to_add * 4;
+                n_quads -= to_add;
+        }
+}
+
+void
+vsx_quad_batch_add_quad(struct vsx_quad_batch *batch,
+                        const struct vsx_quad_batch_state *state,
+                        const struct vsx_quad_batch_vertex *vertices)
+{
+        vsx_quad_batch_add_quads(batch, state, vertices, 1);
+}
+
+void
+vsx_quad_batch_add_rectangle(struct vsx_quad_batch *batch,
+                             const struct vsx_quad_batch_state *state,
+                             float x1, float y1,
+                             float x2, float y2)
+{
+        const struct vsx_quad_batch_vertex vertices[] = {
+                { x1, y1, 0.0f, 0.0f },
+                { x1, y2, 0.0f, 1.0f },
+                { x2, y1, 1.0f, 0.0f },
+                { x2, y2, 1.0f, 1.0f },
+        };
+
+        vsx_quad_batch_add_quad(batch, state, vertices);
+}
+
+static void
+create_vao(struct vsx_quad_batch *batch)
+{
+        struct vsx_gl *gl = batch->gl;
+
+        gl->glGenBuffers(1, &batch->vbo);
+
+        batch->vao = vsx_array_object_new(gl);
+
+        vsx_array_object_set_attribute(batch->vao,
+                                       gl,
+                                       VSX_SHADER_DATA_ATTRIB_POSITION,
+                                       2, /* size */
+                                       GL_FLOAT,
+                                       false, /* normalized */
+                                       sizeof (struct vsx_quad_batch_vertex),
+                                       batch->vbo,
+                                       offsetof(struct vsx_quad_batch_vertex,
+                                                x));
+        vsx_array_object_set_attribute(batch->vao,
+                                       gl,
+                                       VSX_SHADER_DATA_ATTRIB_TEX_COORD,
+                                       2, /* size */
+                                       GL_FLOAT,
+                                       false, /* normalized */
+                                       sizeof (struct vsx_quad_batch_vertex),
+                                       batch->vbo,
+                                       offsetof(struct vsx_quad_batch_vertex,
+                                                s));
+}
+
+static void
+ensure_buffer_size(struct vsx_quad_batch *batch,
+                   int n_quads)
+{
+        if (batch->buffer_n_quads >= n_quads)
+                return;
+
+        struct vsx_gl *gl = batch->gl;
+
+        if (batch->vao == NULL)
+                create_vao(batch);
+
+        int buffer_n_quads = MAX(batch->buffer_n_quads,
+                                 VSX_QUAD_BATCH_MIN_QUADS);
+
+        while (buffer_n_quads < n_quads)
+                buffer_n_quads *= 2;
+
+        batch->buffer_n_quads = buffer_n_quads;
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+        gl->glBufferData(GL_ARRAY_BUFFER,
+                         buffer_n_quads *
+                         sizeof (struct vsx_quad_batch_vertex) * 4,
+                         NULL, /* data */
+                         GL_STREAM_DRAW);
+
+        struct vsx_quad_tool_buffer *quad_buffer =
+                vsx_quad_tool_get_buffer(batch->quad_tool,
+                                         batch->vao,
+                                         buffer_n_quads);
+
+        if (batch->quad_buffer)
+                vsx_quad_tool_unref_buffer(batch->quad_buffer, gl);
+
+        batch->quad_buffer = quad_buffer;
+}
+
+static void
+upload_vertices(struct vsx_quad_batch *batch)
+{
+        struct vsx_gl *gl = batch->gl;
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+
+        /* The whole buffer is invalidated by the map so the GPU can
+         * carry on using the data from the last flush.
+         */
+        void *data = vsx_map_buffer_map(batch->map_buffer,
+                                        GL_ARRAY_BUFFER,
+                                        batch->buffer_n_quads *
+                                        sizeof (struct vsx_quad_batch_vertex) *
+                                        4,
+                                        false, /* flush_explicit */
+                                        GL_STREAM_DRAW);
+
+        memcpy(data, batch->vertices.data, batch->vertices.length);
+
+        vsx_map_buffer_unmap(batch->map_buffer);
+}
+
+static size_t
+get_index_size(GLenum type)
+{
+        switch (type) {
+        case GL_UNSIGNED_BYTE:
+                return sizeof (uint8_t);
+        case GL_UNSIGNED_SHORT:
+                return sizeof (uint16_t);
+        }
+
+        assert(!"Unknown index type");
+
+        return 0;
+}
+
+static void
+set_capability(struct vsx_gl *gl,
+               GLenum cap,
+               bool *enabled,
+               bool enable)
+{
+        if (*enabled == enable)
+                return;
+
+        if (enable)
+                gl->glEnable(cap);
+        else
+                gl->glDisable(cap);
+
+        *enabled = enable;
+}
+
+static void
+draw_runs(struct vsx_quad_batch *batch)
+{
+        struct vsx_gl *gl = batch->gl;
+        size_t index_size = get_index_size(batch->quad_buffer->type);
+        const struct vsx_quad_batch_run *runs =
+                (const struct vsx_quad_batch_run *) batch->runs.data;
+        size_t n_runs = batch->runs.length / sizeof *runs;
+        int current_program = -1;
+        /* Everything else expects blending and scissoring to be
+         * disabled between draws.
+         */
+        bool blend = false, scissor = false;
+
+        static const GLfloat identity[] = { 1.0f, 0.0f, 0.0f, 1.0f };
+
+        for (unsigned i = 0; i < n_runs; i++) {
+                const struct vsx_quad_batch_run *run = runs + i;
+                const struct vsx_quad_batch_state *state = &run->state;
+                const struct vsx_shader_data_program_data *program =
+                        batch->shader_data->programs + state->program;
+
+                if (state->program != current_program) {
+                        current_program = state->program;
+
+                        gl->glUseProgram(program->program);
+
+                        /* The vertices are already transformed */
+                        gl->glUniformMatrix2fv(program->matrix_uniform,
+                                               1, /* count */
+                                               GL_FALSE, /* transpose */
+                                               identity);
+                        gl->glUniform2f(program->translation_uniform,
+                                        0.0f, 0.0f);
+                }
+
+                if (state->program == VSX_SHADER_DATA_PROGRAM_TEXTURE) {
+                        gl->glBindTexture(GL_TEXTURE_2D, state->tex);
+                } else {
+                        gl->glUniform3f(program->color_uniform,
+                                        state->color[0],
+                                        state->color[1],
+                                        state->color[2]);
+                }
+
+                if (state->blend && !blend) {
+                        gl->glBlendFunc(GL_SRC_ALPHA,
+                                        GL_ONE_MINUS_SRC_ALPHA);
+                }
+
+                set_capability(gl, GL_BLEND, &blend, state->blend);
+
+                if (state->scissor) {
+                        gl->glScissor(state->scissor_x,
+                                      state->scissor_y,
+                                      state->scissor_width,
+                                      state->scissor_height);
+                }
+
+                set_capability(gl, GL_SCISSOR_TEST, &scissor, state->scissor);
+
+                vsx_gl_draw_range_elements(gl,
+                                           GL_TRIANGLES,
+                                           run->first_quad * 4,
+                                           (run->first_quad +
+                                            run->n_quads) * 4 - 1,
+                                           run->n_quads * 6,
+                                           batch->quad_buffer->type,
+                                           (GLvoid *) (intptr_t)
+                                           (run->first_quad * 6 *
+                                            index_size));
+        }
+
+        set_capability(gl, GL_BLEND, &blend, false);
+        set_capability(gl, GL_SCISSOR_TEST, &scissor, false);
+}
+
+static void
+draw_quads(struct vsx_quad_batch *batch)
+{
+        ensure_buffer_size(batch, get_n_quads(batch));
+
+        upload_vertices(batch);
+
+        vsx_array_object_bind(batch->vao, batch->gl);
+
+        draw_runs(batch);
+
+        vsx_buffer_set_length(&batch->vertices, 0);
+        vsx_buffer_set_length(&batch->runs, 0);
+}
+
+void
+vsx_quad_batch_flush(struct vsx_quad_batch *batch)
+{
+        /* The GL callback is only set while there are quads */
+        if (batch->runs.length > 0) {
+                assert(batch->gl->flush_data == batch);
+                vsx_gl_flush(batch->gl);
+        }
+}
+
+void
+vsx_quad_batch_free(struct vsx_quad_batch *batch)
+{
+        struct vsx_gl *gl = batch->gl;
+
+        /* Drop any quads that haven’t been drawn */
+        if (batch->runs.length > 0) {
+                gl->flush_cb = NULL;
+                gl->flush_data = NULL;
+        }
+
+        if (batch->vao)
+                vsx_array_object_free(batch->vao, gl);
+        if (batch->vbo)
+                gl->glDeleteBuffers(1, &batch->vbo);
+        if (batch->quad_buffer)
+                vsx_quad_tool_unref_buffer(batch->quad_buffer, gl);
+
+        vsx_buffer_destroy(&batch->vertices);
+        vsx_buffer_destroy(&batch->runs);
+
+        vsx_free(batch);
+}
@@ -0,0 +1,112 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_QUAD_BATCH_H
+#define VSX_QUAD_BATCH_H
+
+#include <stdint.h>
+
+#include "vsx-gl.h"
+#include "vsx-map-buffer.h"
+#include "vsx-quad-tool.h"
+#include "vsx-shader-data.h"
+
+/* The quad batch collects quads from the painters and draws them
+ * from a single streaming buffer. Consecutive quads with the same
+ * state are drawn with one draw call, even if they come from
+ * different painters. The quads are drawn in the order they were
+ * added so that overlapping quads still look the same.
+ *
+ * The vertices are transformed on the CPU when they are added so
+ * that quads with a different transformation can still be drawn
+ * together.
+ *
+ * The quads aren’t drawn until something else needs to change the
+ * GL state. Anything that draws directly must use the state wrappers
+ * in vsx-gl.h, such as vsx_gl_use_program, so that the batch gets
+ * flushed first.
+ */
+
+struct vsx_quad_batch;
+
+struct vsx_quad_batch_state {
+        /* Either VSX_SHADER_DATA_PROGRAM_TEXTURE or
+         * VSX_SHADER_DATA_PROGRAM_SOLID
+         */
+        enum vsx_shader_data_program program;
+        /* Only used for the texture program */
+        GLuint tex;
+        /* Transformation for the vertices, the same as the uniforms
+         * of the shaders.
+         */
+        GLfloat matrix[4];
+        GLfloat translation[2];
+        /* Only used for the solid program */
+        GLfloat color[3];
+        /* Blend with GL_SRC_ALPHA and GL_ONE_MINUS_SRC_ALPHA */
+        bool blend;
+        /* Clip to the scissor rectangle */
+        bool scissor;
+        GLint scissor_x, scissor_y;
+        GLsizei scissor_width, scissor_height;
+};
+
+/* The vertices of a quad are given in the order top-left,
+ * bottom-left, top-right, bottom-right. The texture coordinates are
+ * ignored for the solid program.
+ */
+struct vsx_quad_batch_vertex {
+        float x, y;
+        float s, t;
+};
+
+struct vsx_quad_batch *
+vsx_quad_batch_new(struct vsx_gl *gl,
+                   struct vsx_map_buffer *map_buffer,
+                   struct vsx_quad_tool *quad_tool,
+                   const struct vsx_shader_data *shader_data);
+
+/* Adds n_quads quads with four vertices each */
+void
+vsx_quad_batch_add_quads(struct vsx_quad_batch *batch,
+                         const struct vsx_quad_batch_state *state,
+                         const struct vsx_quad_batch_vertex *vertices,
+                         int n_quads);
+
+void
+vsx_quad_batch_add_quad(struct vsx_quad_batch *batch,
+                        const struct vsx_quad_batch_state *state,
+                        const struct vsx_quad_batch_vertex *vertices);
+
+/* Adds an axis-aligned rectangle covering the whole texture */
+void
+vsx_quad_batch_add_rectangle(struct vsx_quad_batch *batch,
+                             const struct vsx_quad_batch_state *state,
+                             float x1, float y1,
+                             float x2, float y2);
+
+/* Draws all of the quads that have been added since the last flush.
+ * This only needs to be called explicitly at the end of the frame.
+ */
+void
+vsx_quad_batch_flush(struct vsx_quad_batch *batch);
+
+void
+vsx_quad_batch_free(struct vsx_quad_batch *batch);
+
+#endif /* VSX_QUAD_BATCH_H */
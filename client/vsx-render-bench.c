@@ -0,0 +1,804 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A benchmark for the painters that doesn’t need a window. It renders
+ * into an offscreen EGL surface so it can run on a headless machine
+ * with Mesa’s software renderer. The game state is driven by a
+ * scripted stream of connection events instead of a server. The
+ * script fills the board, slides tiles around, drags the board and
+ * makes the players shout to trigger the fireworks. The time taken by
+ * each painter and by the whole frame is reported at the end.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "vsx-gl.h"
+#include "vsx-connection.h"
+#include "vsx-worker.h"
+#include "vsx-game-state.h"
+#include "vsx-game-painter.h"
+#include "vsx-asset-linux.h"
+#include "vsx-main-thread.h"
+#include "vsx-monotonic.h"
+#include "vsx-board.h"
+#include "vsx-util.h"
+
+/* If nothing queues a redraw for this many microseconds during the
+ * warm up then the images are assumed to have finished loading.
+ */
+#define VSX_RENDER_BENCH_SETTLE_TIME (250 * 1000)
+
+/* Give up waiting for the warm up to settle after this long */
+#define VSX_RENDER_BENCH_MAX_WARM_UP_TIME (10 * 1000 * 1000)
+
+#define VSX_RENDER_BENCH_N_PLAYERS 4
+
+/* Same DPI that the SDL client pretends to have */
+#define VSX_RENDER_BENCH_DPI (480 * 2 / 5)
+
+/* Number of frames between each step of the script */
+#define VSX_RENDER_BENCH_MOVE_INTERVAL 4
+#define VSX_RENDER_BENCH_SHOUT_INTERVAL 120
+#define VSX_RENDER_BENCH_DRAG_INTERVAL 60
+#define VSX_RENDER_BENCH_DRAG_LENGTH 20
+
+struct vsx_render_bench_timing {
+        int64_t total;
+        int64_t max;
+};
+
+struct vsx_render_bench {
+        EGLDisplay egl_display;
+        EGLContext egl_context;
+        EGLSurface egl_surface;
+
+        struct vsx_gl *gl;
+
+        struct vsx_main_thread *main_thread;
+        struct vsx_asset_manager *asset_manager;
+        struct vsx_connection *connection;
+        struct vsx_worker *worker;
+        struct vsx_game_state *game_state;
+        struct vsx_game_painter *game_painter;
+
+        struct vsx_shell_interface shell;
+        bool redraw_queued;
+
+        int n_tiles;
+
+        struct vsx_render_bench_timing
+        painter_timings[VSX_GAME_PAINTER_N_PAINTERS];
+        struct vsx_render_bench_timing frame_timing;
+        uint64_t n_draw_calls;
+};
+
+static const char options[] = "-hn:s:t:";
+
+static int option_n_frames = 300;
+static int option_width = 2220 * 2 / 5;
+static int option_height = 1080 * 2 / 5;
+static int option_n_tiles = 122;
+
+/* Letters of the Esperanto alphabet used for the tiles */
+static const uint32_t
+tile_letters[] = {
+        'A', 'B', 'C', 0x108, 'D', 'E', 'F', 'G', 0x11c, 'H', 0x124,
+        'I', 'J', 0x134, 'K', 'L', 'M', 'N', 'O', 'P', 'R', 'S',
+        0x15c, 'T', 'U', 0x16c, 'V', 'Z',
+};
+
+static void
+usage(void)
+{
+        printf("verda-sxtelo-render-bench - Measure how long the "
+               "painters take\n"
+               "usage: verda-sxtelo-render-bench [options]...\n"
+               " -h                   Show this help message\n"
+               " -n <frames>          Number of frames to render\n"
+               " -s <width>x<height>  Size of the offscreen surface\n"
+               " -t <tiles>           Number of tiles on the board\n");
+}
+
+static bool
+parse_number(const char *arg, int min, int max, int *value)
+{
+        char *tail;
+
+        errno = 0;
+        long v = strtol(arg, &tail, 10);
+
+        if (errno || *tail || tail == arg || v < min || v > max) {
+                fprintf(stderr, "invalid number: %s\n", arg);
+                return false;
+        }
+
+        *value = v;
+
+        return true;
+}
+
+static bool
+parse_size(const char *arg)
+{
+        char *tail;
+
+        errno = 0;
+        long width = strtol(arg, &tail, 10);
+
+        if (errno || tail == arg || *tail != 'x' || width < 1)
+                goto error;
+
+        const char *height_start = tail + 1;
+
+        long height = strtol(height_start, &tail, 10);
+
+        if (errno || tail == height_start || *tail || height < 1)
+                goto error;
+
+        if (width > 16384 || height > 16384)
+                goto error;
+
+        option_width = width;
+        option_height = height;
+
+        return true;
+
+error:
+        fprintf(stderr, "invalid size: %s\n", arg);
+        return false;
+}
+
+static bool
+process_arguments(int argc, char **argv)
+{
+        int opt;
+
+        opterr = false;
+
+        while ((opt = getopt(argc, argv, options)) != -1) {
+                switch (opt) {
+                case ':':
+                case '?':
+                        fprintf(stderr, "invalid option '%c'\n", optopt);
+                        return false;
+
+                case '\1':
+                        fprintf(stderr, "unexpected argument \"%s\"\n", optarg);
+                        return false;
+
+                case 'h':
+                        usage();
+                        return false;
+
+                case 'n':
+                        if (!parse_number(optarg,
+                                          1, INT_MAX,
+                                          &option_n_frames))
+                                return false;
+                        break;
+
+                case 's':
+                        if (!parse_size(optarg))
+                                return false;
+                        break;
+
+                case 't':
+                        if (!parse_number(optarg,
+                                          1, UINT8_MAX + 1,
+                                          &option_n_tiles))
+                                return false;
+                        break;
+                }
+        }
+
+        return true;
+}
+
+static EGLDisplay
+get_egl_display(void)
+{
+        /* Prefer the surfaceless platform so that it doesn’t need a
+         * display server at all.
+         */
+        const char *client_extensions =
+                eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+        if (client_extensions &&
+            strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+                PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+                        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+                        eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+                if (get_platform_display) {
+                        EGLDisplay display =
+                                get_platform_display(
+                                        EGL_PLATFORM_SURFACELESS_MESA,
+                                        EGL_DEFAULT_DISPLAY,
+                                        NULL);
+
+                        if (display != EGL_NO_DISPLAY)
+                                return display;
+                }
+        }
+
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static void *
+gl_get_proc_address(const char *func_name,
+                    void *user_data)
+{
+        return (void *) eglGetProcAddress(func_name);
+}
+
+static bool
+init_egl(struct vsx_render_bench *bench)
+{
+        bench->egl_display = get_egl_display();
+
+        if (bench->egl_display == EGL_NO_DISPLAY ||
+            !eglInitialize(bench->egl_display, NULL, NULL)) {
+                bench->egl_display = EGL_NO_DISPLAY;
+                fprintf(stderr, "Failed to initialize EGL\n");
+                return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_ES_API)) {
+                fprintf(stderr, "GLES is not supported by EGL\n");
+                return false;
+        }
+
+        static const EGLint config_attribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_NONE,
+        };
+        EGLConfig config;
+        EGLint n_configs;
+
+        if (!eglChooseConfig(bench->egl_display,
+                             config_attribs,
+                             &config,
+                             1, /* config_size */
+                             &n_configs) ||
+            n_configs < 1) {
+                fprintf(stderr, "No suitable EGL config found\n");
+                return false;
+        }
+
+        static const EGLint context_attribs[] = {
+                EGL_CONTEXT_CLIENT_VERSION, 2,
+                EGL_NONE,
+        };
+
+        bench->egl_context = eglCreateContext(bench->egl_display,
+                                              config,
+                                              EGL_NO_CONTEXT,
+                                              context_attribs);
+
+        if (bench->egl_context == EGL_NO_CONTEXT) {
+                fprintf(stderr, "Failed to create the EGL context\n");
+                return false;
+        }
+
+        const EGLint surface_attribs[] = {
+                EGL_WIDTH, option_width,
+                EGL_HEIGHT, option_height,
+                EGL_NONE,
+        };
+
+        bench->egl_surface = eglCreatePbufferSurface(bench->egl_display,
+                                                     config,
+                                                     surface_attribs);
+
+        if (bench->egl_surface == EGL_NO_SURFACE) {
+                fprintf(stderr, "Failed to create the pbuffer surface\n");
+                return false;
+        }
+
+        if (!eglMakeCurrent(bench->egl_display,
+                            bench->egl_surface,
+                            bench->egl_surface,
+                            bench->egl_context)) {
+                fprintf(stderr, "Failed to make the EGL context current\n");
+                return false;
+        }
+
+        bench->gl = vsx_gl_new(gl_get_proc_address, NULL /* user_data */);
+
+        printf("renderer: %s\n",
+               (const char *) bench->gl->glGetString(GL_RENDERER));
+
+        return true;
+}
+
+static void
+queue_redraw_cb(struct vsx_shell_interface *shell)
+{
+        struct vsx_render_bench *bench =
+                vsx_container_of(shell, struct vsx_render_bench, shell);
+
+        bench->redraw_queued = true;
+}
+
+static void
+log_error_cb(struct vsx_shell_interface *shell,
+             const char *format,
+             ...)
+{
+        va_list ap;
+
+        va_start(ap, format);
+
+        vfprintf(stderr, format, ap);
+
+        va_end(ap);
+
+        fputc('\n', stderr);
+}
+
+static char *
+get_app_version_cb(struct vsx_shell_interface *shell)
+{
+        return vsx_strdup("BENCH");
+}
+
+static void
+share_or_open_link_cb(struct vsx_shell_interface *shell,
+                      const char *link,
+                      int link_x, int link_y,
+                      int link_width, int link_height)
+{
+}
+
+static void
+set_name_position_cb(struct vsx_shell_interface *shell,
+                     int y_pos,
+                     int max_width)
+{
+}
+
+static int
+get_name_height_cb(struct vsx_shell_interface *shell)
+{
+        return 0;
+}
+
+static void
+request_name_cb(struct vsx_shell_interface *shell)
+{
+}
+
+static void
+wakeup_cb(void *user_data)
+{
+        /* The idle events are flushed before every frame so there’s
+         * no need to wake anything up.
+         */
+}
+
+static void
+emit_event(struct vsx_render_bench *bench,
+           const struct vsx_connection_event *event)
+{
+        /* The events are sent on the connection’s signal exactly
+         * like they would be if they had come from a server.
+         */
+        vsx_worker_lock(bench->worker);
+        vsx_signal_emit(vsx_connection_get_event_signal(bench->connection),
+                        (void *) event);
+        vsx_worker_unlock(bench->worker);
+}
+
+static void
+get_tile_position(int tile_num,
+                  int offset,
+                  int *x, int *y)
+{
+        int tiles_per_row = (VSX_BOARD_WIDTH / 2) / VSX_BOARD_TILE_SIZE;
+        int n_rows = (VSX_BOARD_HEIGHT / 2) / VSX_BOARD_TILE_SIZE;
+        int pos = (tile_num + offset) % (tiles_per_row * n_rows);
+
+        *x = (VSX_BOARD_WIDTH / 4 +
+              pos % tiles_per_row * VSX_BOARD_TILE_SIZE);
+        *y = (VSX_BOARD_HEIGHT / 4 +
+              pos / tiles_per_row * VSX_BOARD_TILE_SIZE);
+}
+
+static void
+send_tile(struct vsx_render_bench *bench,
+          int tile_num,
+          int offset,
+          bool synced)
+{
+        struct vsx_connection_event event = {
+                .type = VSX_CONNECTION_EVENT_TYPE_TILE_CHANGED,
+                .synced = synced,
+                .tile_changed = {
+                        .num = tile_num,
+                        .last_player_moved = 1 + tile_num % 3,
+                        .letter = tile_letters[tile_num %
+                                               VSX_N_ELEMENTS(tile_letters)],
+                },
+        };
+
+        int x, y;
+
+        get_tile_position(tile_num, offset, &x, &y);
+
+        event.tile_changed.x = x;
+        event.tile_changed.y = y;
+
+        emit_event(bench, &event);
+}
+
+static void
+send_shout(struct vsx_render_bench *bench,
+           int player_num)
+{
+        struct vsx_connection_event event = {
+                .type = VSX_CONNECTION_EVENT_TYPE_PLAYER_SHOUTED,
+                .synced = true,
+                .player_shouted = {
+                        .player_num = player_num,
+                },
+        };
+
+        emit_event(bench, &event);
+}
+
+static void
+send_initial_state(struct vsx_render_bench *bench)
+{
+        struct vsx_connection_event event = {
+                .type = VSX_CONNECTION_EVENT_TYPE_HEADER,
+                .header = {
+                        .self_num = 0,
+                        .person_id = 1,
+                },
+        };
+
+        emit_event(bench, &event);
+
+        static const char * const player_names[] = {
+                "Zamenhof", "Kabe", "Grabowski", "Baghy",
+        };
+
+        _Static_assert(VSX_N_ELEMENTS(player_names) ==
+                       VSX_RENDER_BENCH_N_PLAYERS,
+                       "There should be a name for each player");
+
+        for (int i = 0; i < VSX_RENDER_BENCH_N_PLAYERS; i++) {
+                event.type = VSX_CONNECTION_EVENT_TYPE_PLAYER_NAME_CHANGED;
+                event.player_name_changed.player_num = i;
+                event.player_name_changed.name = player_names[i];
+                emit_event(bench, &event);
+
+                event.type = VSX_CONNECTION_EVENT_TYPE_PLAYER_FLAGS_CHANGED;
+                event.player_flags_changed.player_num = i;
+                event.player_flags_changed.flags =
+                        VSX_GAME_STATE_PLAYER_FLAG_CONNECTED;
+                emit_event(bench, &event);
+        }
+
+        event.type = VSX_CONNECTION_EVENT_TYPE_N_TILES_CHANGED;
+        event.n_tiles_changed.n_tiles = bench->n_tiles;
+        emit_event(bench, &event);
+
+        for (int i = 0; i < bench->n_tiles; i++)
+                send_tile(bench, i, 0, false /* synced */);
+}
+
+static void
+run_script(struct vsx_render_bench *bench,
+           int frame_num)
+{
+        if (frame_num % VSX_RENDER_BENCH_MOVE_INTERVAL == 0) {
+                /* Slide one of the tiles to a new position */
+                int move_num = frame_num / VSX_RENDER_BENCH_MOVE_INTERVAL;
+                send_tile(bench,
+                          move_num % bench->n_tiles,
+                          move_num / bench->n_tiles + 1,
+                          true /* synced */);
+        }
+
+        if (frame_num % VSX_RENDER_BENCH_SHOUT_INTERVAL == 0) {
+                int shout_num = frame_num / VSX_RENDER_BENCH_SHOUT_INTERVAL;
+                send_shout(bench, shout_num % VSX_RENDER_BENCH_N_PLAYERS);
+        }
+
+        /* Drag the board across a part of the screen with one
+         * finger.
+         */
+        int drag_pos = frame_num % VSX_RENDER_BENCH_DRAG_INTERVAL;
+        int drag_x = option_width / 4 + drag_pos * option_width / 200;
+        int drag_y = option_height / 2;
+
+        if (drag_pos == 0) {
+                vsx_game_painter_press_finger(bench->game_painter,
+                                              0, /* finger */
+                                              drag_x, drag_y);
+        } else if (drag_pos < VSX_RENDER_BENCH_DRAG_LENGTH) {
+                vsx_game_painter_move_finger(bench->game_painter,
+                                             0, /* finger */
+                                             drag_x, drag_y);
+        } else if (drag_pos == VSX_RENDER_BENCH_DRAG_LENGTH) {
+                vsx_game_painter_release_finger(bench->game_painter,
+                                                0 /* finger */);
+        }
+}
+
+static void
+paint(struct vsx_render_bench *bench)
+{
+        bench->redraw_queued = false;
+
+        vsx_game_painter_paint(bench->game_painter);
+
+        /* Wait for the rendering to finish so that the time spent
+         * by the GPU or the software renderer is included.
+         */
+        bench->gl->glFinish();
+
+        eglSwapBuffers(bench->egl_display, bench->egl_surface);
+}
+
+static void
+warm_up(struct vsx_render_bench *bench)
+{
+        /* Show the fireworks once so that the cost of compiling
+         * anything on first use isn’t included in the benchmark.
+         */
+        send_shout(bench, 0 /* player_num */);
+
+        int64_t start_time = vsx_monotonic_get();
+        int64_t last_redraw_time = start_time;
+
+        /* Keep painting until the images have finished loading and
+         * nothing is animating anymore so that the first frames of
+         * the benchmark don’t include the texture uploads.
+         */
+        while (true) {
+                int64_t now = vsx_monotonic_get();
+
+                if (now - last_redraw_time >= VSX_RENDER_BENCH_SETTLE_TIME ||
+                    now - start_time >= VSX_RENDER_BENCH_MAX_WARM_UP_TIME)
+                        break;
+
+                vsx_main_thread_flush_idle_events(bench->main_thread);
+
+                if (bench->redraw_queued) {
+                        paint(bench);
+                        last_redraw_time = vsx_monotonic_get();
+                } else {
+                        usleep(1000);
+                }
+        }
+}
+
+static void
+add_timing(struct vsx_render_bench_timing *timing,
+           int64_t value)
+{
+        timing->total += value;
+
+        if (value > timing->max)
+                timing->max = value;
+}
+
+static void
+run_frames(struct vsx_render_bench *bench)
+{
+        for (int i = 0; i < option_n_frames; i++) {
+                run_script(bench, i);
+
+                vsx_main_thread_flush_idle_events(bench->main_thread);
+
+                int64_t start_time = vsx_monotonic_get();
+
+                paint(bench);
+
+                add_timing(&bench->frame_timing,
+                           vsx_monotonic_get() - start_time);
+
+                struct vsx_game_painter_frame_stats stats;
+
+                vsx_game_painter_get_frame_stats(bench->game_painter, &stats);
+
+                for (int j = 0; j < VSX_GAME_PAINTER_N_PAINTERS; j++) {
+                        add_timing(bench->painter_timings + j,
+                                   stats.painter_times[j]);
+                }
+
+                bench->n_draw_calls += stats.n_draw_calls;
+        }
+}
+
+static void
+print_timing(const char *name,
+             const struct vsx_render_bench_timing *timing)
+{
+        printf("%-12s %10.1f %10" PRIi64 "\n",
+               name,
+               timing->total / (double) option_n_frames,
+               timing->max);
+}
+
+static void
+print_report(struct vsx_render_bench *bench)
+{
+        printf("frames: %i\n"
+               "size: %ix%i\n"
+               "times in microseconds\n"
+               "\n"
+               "%-12s %10s %10s\n",
+               option_n_frames,
+               option_width, option_height,
+               "painter", "mean", "max");
+
+        for (int i = 0; i < VSX_GAME_PAINTER_N_PAINTERS; i++) {
+                print_timing(vsx_game_painter_get_painter_name(i),
+                             bench->painter_timings + i);
+        }
+
+        print_timing("total", &bench->frame_timing);
+
+        printf("\n"
+               "draw calls per frame: %.1f\n",
+               bench->n_draw_calls / (double) option_n_frames);
+}
+
+static bool
+init_bench(struct vsx_render_bench *bench)
+{
+        if (!init_egl(bench))
+                return false;
+
+        bench->main_thread = vsx_main_thread_new(wakeup_cb, bench);
+        bench->asset_manager = vsx_asset_manager_new();
+        bench->connection = vsx_connection_new();
+
+        struct vsx_error *error = NULL;
+
+        bench->worker = vsx_worker_new(bench->connection, &error);
+
+        if (bench->worker == NULL)
+                goto error;
+
+        bench->game_state = vsx_game_state_new(bench->main_thread,
+                                               bench->worker,
+                                               bench->connection,
+                                               "eo");
+
+        /* Skip the name dialog. The connection is never set running
+         * so nothing is sent anywhere.
+         */
+        vsx_game_state_set_player_name(bench->game_state, "Zamenhof");
+        vsx_game_state_set_dialog(bench->game_state, VSX_DIALOG_NONE);
+
+        bench->game_painter = vsx_game_painter_new(bench->gl,
+                                                   bench->main_thread,
+                                                   bench->game_state,
+                                                   bench->asset_manager,
+                                                   VSX_RENDER_BENCH_DPI,
+                                                   &bench->shell,
+                                                   &error);
+
+        if (bench->game_painter == NULL)
+                goto error;
+
+        vsx_game_painter_set_fb_size(bench->game_painter,
+                                     option_width,
+                                     option_height);
+
+        return true;
+
+error:
+        fprintf(stderr, "%s\n", error->message);
+        vsx_error_free(error);
+        return false;
+}
+
+static void
+destroy_bench(struct vsx_render_bench *bench)
+{
+        if (bench->game_painter)
+                vsx_game_painter_free(bench->game_painter);
+        if (bench->game_state)
+                vsx_game_state_free(bench->game_state);
+        if (bench->worker)
+                vsx_worker_free(bench->worker);
+        if (bench->connection)
+                vsx_connection_free(bench->connection);
+        if (bench->asset_manager)
+                vsx_asset_manager_free(bench->asset_manager);
+        if (bench->main_thread)
+                vsx_main_thread_free(bench->main_thread);
+        if (bench->gl)
+                vsx_gl_free(bench->gl);
+
+        if (bench->egl_display != EGL_NO_DISPLAY) {
+                eglMakeCurrent(bench->egl_display,
+                               EGL_NO_SURFACE,
+                               EGL_NO_SURFACE,
+                               EGL_NO_CONTEXT);
+
+                if (bench->egl_surface != EGL_NO_SURFACE)
+                        eglDestroySurface(bench->egl_display,
+                                          bench->egl_surface);
+                if (bench->egl_context != EGL_NO_CONTEXT)
+                        eglDestroyContext(bench->egl_display,
+                                          bench->egl_context);
+
+                eglTerminate(bench->egl_display);
+        }
+}
+
+int
+main(int argc, char **argv)
+{
+        if (!process_arguments(argc, argv))
+                return EXIT_FAILURE;
+
+        struct vsx_render_bench bench = {
+                .egl_display = EGL_NO_DISPLAY,
+                .egl_context = EGL_NO_CONTEXT,
+                .egl_surface = EGL_NO_SURFACE,
+                .n_tiles = option_n_tiles,
+                .shell = {
+                        .queue_redraw_cb = queue_redraw_cb,
+                        .log_error_cb = log_error_cb,
+                        .get_app_version_cb = get_app_version_cb,
+                        .share_link_cb = share_or_open_link_cb,
+                        .open_link_cb = share_or_open_link_cb,
+                        .set_name_position_cb = set_name_position_cb,
+                        .get_name_height_cb = get_name_height_cb,
+                        .request_name_cb = request_name_cb,
+                },
+        };
+
+        vsx_signal_init(&bench.shell.name_size_signal);
+
+        int ret = EXIT_SUCCESS;
+
+        if (init_bench(&bench)) {
+                send_initial_state(&bench);
+                warm_up(&bench);
+                run_frames(&bench);
+                print_report(&bench);
+        } else {
+                ret = EXIT_FAILURE;
+        }
+
+        destroy_bench(&bench);
+
+        return ret;
+}
@@ -51,6 +51,7 @@ vsx_shader_data_shaders[] = {
                 {
                         VSX_SHADER_DATA_PROGRAM_TEXTURE,
                         VSX_SHADER_DATA_PROGRAM_LAYOUT,
+                        VSX_SHADER_DATA_PROGRAM_LAYOUT_SDF,
                         PROGRAMS_END
                 }
         },
@@ -59,6 +60,11 @@ vsx_shader_data_shaders[] = {
                 (const char *[]) { "vsx-layout-fragment.glsl", NULL },
                 { VSX_SHADER_DATA_PROGRAM_LAYOUT, PROGRAMS_END }
         },
+        {
+                GL_FRAGMENT_SHADER,
+                (const char *[]) { "vsx-layout-sdf-fragment.glsl", NULL },
+                { VSX_SHADER_DATA_PROGRAM_LAYOUT_SDF, PROGRAMS_END }
+        },
         {
                 GL_FRAGMENT_SHADER,
                 (const char *[]) { "vsx-solid-fragment.glsl", NULL },
@@ -282,6 +288,9 @@ get_uniforms(struct vsx_shader_data_program_data *program,
         program->color_uniform =
                 gl->glGetUniformLocation(program->program,
                                          "color");
+        program->smoothing_uniform =
+                gl->glGetUniformLocation(program->program,
+                                         "smoothing");
 }
 
 static bool
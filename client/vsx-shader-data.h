@@ -33,6 +33,7 @@ enum vsx_shader_data_program {
         VSX_SHADER_DATA_PROGRAM_TEXTURE,
         VSX_SHADER_DATA_PROGRAM_SOLID,
         VSX_SHADER_DATA_PROGRAM_LAYOUT,
+        VSX_SHADER_DATA_PROGRAM_LAYOUT_SDF,
         VSX_SHADER_DATA_PROGRAM_FIREWORKS,
         VSX_SHADER_DATA_N_PROGRAMS
 };
@@ -56,6 +57,7 @@ struct vsx_shader_data_program_data {
         GLint translation_uniform;
         GLint tex_uniform;
         GLint color_uniform;
+        GLint smoothing_uniform;
 };
 
 struct vsx_shader_data {
@@ -22,23 +22,20 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <string.h>
 
-#include "vsx-map-buffer.h"
 #include "vsx-mipmap.h"
 #include "vsx-gl.h"
-#include "vsx-array-object.h"
 #include "vsx-util.h"
 #include "vsx-signal.h"
 
 struct vsx_shadow_painter {
         struct vsx_gl *gl;
         struct vsx_image_loader *image_loader;
-        struct vsx_map_buffer *map_buffer;
 
         GLuint tex;
         struct vsx_shell_interface *shell;
         struct vsx_image_loader_token *image_token;
-        GLuint element_buffer;
 
         int top_left_shadow_width;
         int bottom_right_shadow_width;
@@ -46,27 +43,19 @@ struct vsx_shadow_painter {
         struct vsx_signal ready_signal;
 };
 
-struct vsx_shadow_painter_shadow {
-        struct vsx_array_object *vao;
-        GLuint vbo;
-};
-
-struct vertex {
-        int16_t x, y;
-        uint8_t s, t;
-};
+/* There are 8 quads: the four corners, the two horizontal bands and
+ * the two vertical bands.
+ */
+#define N_QUADS 8
 
 /* We only need to define the vertices for the corner quads. The other
  * four quads can share the vertices of the corners.
  */
-#define N_VERTICES (4 * 4)
+#define N_CORNER_VERTICES (4 * 4)
 
-/* We need six elements for each quad and there are 8 quads (the four
- * corners, the two horizontal bands and the two vertical bands).
- */
-#define N_ELEMENTS (8 * 6)
-
-#define ELEMENT_BUFFER_SIZE (N_ELEMENTS * sizeof (uint8_t))
+struct vsx_shadow_painter_shadow {
+        struct vsx_quad_batch_vertex vertices[N_QUADS * 4];
+};
 
 /* Width in mm of the shadow */
 #define TOP_LEFT_SHADOW_WIDTH 2
@@ -118,7 +107,6 @@ struct vsx_shadow_painter *
 vsx_shadow_painter_new(struct vsx_gl *gl,
                        struct vsx_shell_interface *shell,
                        struct vsx_image_loader *image_loader,
-                       struct vsx_map_buffer *map_buffer,
                        int dpi)
 {
         struct vsx_shadow_painter *painter = vsx_calloc(sizeof *painter);
@@ -128,12 +116,13 @@ vsx_shadow_painter_new(struct vsx_gl *gl,
         painter->gl = gl;
         painter->shell = shell;
         painter->image_loader = image_loader;
-        painter->map_buffer = map_buffer;
 
-        painter->image_token = vsx_image_loader_load(image_loader,
-                                                     "shadow.mpng",
-                                                     texture_load_cb,
-                                                     painter);
+        painter->image_token =
+                vsx_image_loader_load(image_loader,
+                                      "shadow.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_HIGH,
+                                      texture_load_cb,
+                                      painter);
 
         painter->top_left_shadow_width =
                 TOP_LEFT_SHADOW_WIDTH * dpi * 10 / 254;
@@ -156,18 +145,17 @@ vsx_shadow_painter_get_ready_signal(struct vsx_shadow_painter *painter)
 }
 
 static void
-generate_elements(uint8_t *elements)
+generate_quads(struct vsx_quad_batch_vertex *quads,
+               const struct vsx_quad_batch_vertex *corners)
 {
-        uint8_t *e = elements;
+        struct vsx_quad_batch_vertex *v = quads;
 
 #define QUAD(a, b, c, d)                        \
         do {                                    \
-                *(e++) = (a);                   \
-                *(e++) = (b);                   \
-                *(e++) = (c);                   \
-                *(e++) = (c);                   \
-                *(e++) = (b);                   \
-                *(e++) = (d);                   \
+                *(v++) = corners[a];            \
+                *(v++) = corners[b];            \
+                *(v++) = corners[c];            \
+                *(v++) = corners[d];            \
         } while (0)
 
         /* Top-left corner */
@@ -189,47 +177,11 @@ generate_elements(uint8_t *elements)
 
 #undef QUAD
 
-        assert(e - elements == N_ELEMENTS);
+        assert(v - quads == N_QUADS * 4);
 }
 
 static void
-set_element_buffer(struct vsx_shadow_painter *painter,
-                   struct vsx_array_object *vao)
-{
-        struct vsx_gl *gl = painter->gl;
-
-        if (painter->element_buffer) {
-                vsx_array_object_set_element_buffer(vao,
-                                                    gl,
-                                                    painter->element_buffer);
-                return;
-        }
-
-        gl->glGenBuffers(1, &painter->element_buffer);
-
-        vsx_array_object_set_element_buffer(vao,
-                                            gl,
-                                            painter->element_buffer);
-
-        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                         ELEMENT_BUFFER_SIZE,
-                         NULL, /* data */
-                         GL_STATIC_DRAW);
-
-        uint8_t *elements =
-                vsx_map_buffer_map(painter->map_buffer,
-                                   GL_ELEMENT_ARRAY_BUFFER,
-                                   ELEMENT_BUFFER_SIZE,
-                                   false, /* flush_explicit */
-                                   GL_STATIC_DRAW);
-
-        generate_elements(elements);
-
-        vsx_map_buffer_unmap(painter->map_buffer);
-}
-
-static void
-store_quad(struct vertex *v,
+store_quad(struct vsx_quad_batch_vertex *v,
            int x, int y,
            int w, int h,
            int s1, int t1,
@@ -260,7 +212,7 @@ store_quad(struct vertex *v,
 }
 
 static void
-generate_vertices(struct vertex *vertices,
+generate_vertices(struct vsx_quad_batch_vertex *vertices,
                   int w, int h,
                   int top_left_shadow_width,
                   int bottom_right_shadow_width)
@@ -271,7 +223,7 @@ generate_vertices(struct vertex *vertices,
                    -top_left_shadow_width, /* y */
                    top_left_shadow_width, /* w */
                    top_left_shadow_width, /* h */
-                   255, 255, /* s1, t1 */
+                   1, 1, /* s1, t1 */
                    0, 0 /* s2, t2 */);
         /* Top-right corner */
         store_quad(vertices + 4,
@@ -279,76 +231,39 @@ generate_vertices(struct vertex *vertices,
                    -top_left_shadow_width, /* y */
                    bottom_right_shadow_width, /* w */
                    top_left_shadow_width, /* h */
-                   0, 255, /* s1, t1 */
-                   255, 0 /* s2, t2 */);
+                   0, 1, /* s1, t1 */
+                   1, 0 /* s2, t2 */);
         /* Bottom-left corner */
         store_quad(vertices + 8,
                    -top_left_shadow_width, /* x */
                    h, /* y */
                    top_left_shadow_width, /* w */
                    bottom_right_shadow_width, /* h */
-                   255, 0, /* s1, t1 */
-                   0, 255 /* s2, t2 */);
+                   1, 0, /* s1, t1 */
+                   0, 1 /* s2, t2 */);
         /* Bottom-right corner */
         store_quad(vertices + 12,
                    w, h, /* x/y */
                    bottom_right_shadow_width, /* w */
                    bottom_right_shadow_width, /* h */
                    0, 0, /* s1, t1 */
-                   255, 255 /* s2, t2 */);
+                   1, 1 /* s2, t2 */);
 }
 
 struct vsx_shadow_painter_shadow *
 vsx_shadow_painter_create_shadow(struct vsx_shadow_painter *painter,
                                  int w, int h)
 {
-        struct vsx_shadow_painter_shadow *shadow = vsx_calloc(sizeof *shadow);
+        struct vsx_shadow_painter_shadow *shadow = vsx_alloc(sizeof *shadow);
 
-        struct vsx_gl *gl = painter->gl;
+        struct vsx_quad_batch_vertex corners[N_CORNER_VERTICES];
 
-        gl->glGenBuffers(1, &shadow->vbo);
-        gl->glBindBuffer(GL_ARRAY_BUFFER, shadow->vbo);
-        gl->glBufferData(GL_ARRAY_BUFFER,
-                         N_VERTICES * sizeof (struct vertex),
-                         NULL, /* data */
-                         GL_STATIC_DRAW);
-
-        shadow->vao = vsx_array_object_new(gl);
-
-        vsx_array_object_set_attribute(shadow->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_POSITION,
-                                       2, /* size */
-                                       GL_SHORT,
-                                       false, /* normalized */
-                                       sizeof (struct vertex),
-                                       shadow->vbo,
-                                       offsetof(struct vertex, x));
-        vsx_array_object_set_attribute(shadow->vao,
-                                       gl,
-                                       VSX_SHADER_DATA_ATTRIB_TEX_COORD,
-                                       2, /* size */
-                                       GL_UNSIGNED_BYTE,
-                                       true, /* normalized */
-                                       sizeof (struct vertex),
-                                       shadow->vbo,
-                                       offsetof(struct vertex, s));
-
-        struct vertex *vertices =
-                vsx_map_buffer_map(painter->map_buffer,
-                                   GL_ARRAY_BUFFER,
-                                   N_VERTICES * sizeof (struct vertex),
-                                   false, /* flush_explicit */
-                                   GL_STATIC_DRAW);
-
-        generate_vertices(vertices,
+        generate_vertices(corners,
                           w, h,
                           painter->top_left_shadow_width,
                           painter->bottom_right_shadow_width);
 
-        vsx_map_buffer_unmap(painter->map_buffer);
-
-        set_element_buffer(painter, shadow->vao);
+        generate_quads(shadow->vertices, corners);
 
         return shadow;
 }
@@ -356,54 +271,32 @@ vsx_shadow_painter_create_shadow(struct vsx_shadow_painter *painter,
 void
 vsx_shadow_painter_paint(struct vsx_shadow_painter *painter,
                          struct vsx_shadow_painter_shadow *shadow,
-                         const struct vsx_shader_data *shader_data,
+                         struct vsx_quad_batch *quad_batch,
                          const GLfloat *matrix,
                          const GLfloat *translation)
 {
         if (painter->tex == 0)
                 return;
 
-        struct vsx_gl *gl = painter->gl;
-
-        gl->glBindTexture(GL_TEXTURE_2D, painter->tex);
-
-        const struct vsx_shader_data_program_data *program =
-                shader_data->programs + VSX_SHADER_DATA_PROGRAM_TEXTURE;
-
-        gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        gl->glEnable(GL_BLEND);
-
-        gl->glUseProgram(program->program);
-
-        gl->glUniformMatrix2fv(program->matrix_uniform,
-                               1, /* count */
-                               GL_FALSE, /* transpose */
-                               matrix);
-        gl->glUniform2f(program->translation_uniform,
-                        translation[0],
-                        translation[1]);
-
-        vsx_array_object_bind(shadow->vao, gl);
+        struct vsx_quad_batch_state state = {
+                .program = VSX_SHADER_DATA_PROGRAM_TEXTURE,
+                .tex = painter->tex,
+                .blend = true,
+        };
 
-        vsx_gl_draw_range_elements(gl,
-                                   GL_TRIANGLES,
-                                   0, N_VERTICES - 1,
-                                   N_ELEMENTS,
-                                   GL_UNSIGNED_BYTE,
-                                   NULL /* offset */);
+        memcpy(state.matrix, matrix, sizeof state.matrix);
+        memcpy(state.translation, translation, sizeof state.translation);
 
-        gl->glDisable(GL_BLEND);
+        vsx_quad_batch_add_quads(quad_batch,
+                                 &state,
+                                 shadow->vertices,
+                                 N_QUADS);
 }
 
 void
 vsx_shadow_painter_free_shadow(struct vsx_shadow_painter *painter,
                                struct vsx_shadow_painter_shadow *shadow)
 {
-        struct vsx_gl *gl = painter->gl;
-
-        vsx_array_object_free(shadow->vao, gl);
-        gl->glDeleteBuffers(1, &shadow->vbo);
-
         vsx_free(shadow);
 }
 
@@ -412,10 +305,6 @@ vsx_shadow_painter_free(struct vsx_shadow_painter *painter)
 {
         struct vsx_gl *gl = painter->gl;
 
-        /* This is lazily created so it might be 0 */
-        if (painter->element_buffer)
-                gl->glDeleteBuffers(1, &painter->element_buffer);
-
         if (painter->tex)
                 gl->glDeleteTextures(1, &painter->tex);
         if (painter->image_token)
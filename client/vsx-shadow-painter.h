@@ -23,8 +23,7 @@
 
 #include "vsx-gl.h"
 #include "vsx-image-loader.h"
-#include "vsx-map-buffer.h"
-#include "vsx-shader-data.h"
+#include "vsx-quad-batch.h"
 #include "vsx-signal.h"
 #include "vsx-shell-interface.h"
 
@@ -35,7 +34,6 @@ struct vsx_shadow_painter *
 vsx_shadow_painter_new(struct vsx_gl *gl,
                        struct vsx_shell_interface *shell,
                        struct vsx_image_loader *image_loader,
-                       struct vsx_map_buffer *map_buffer,
                        int dpi);
 
 bool
@@ -47,7 +45,7 @@ vsx_shadow_painter_get_ready_signal(struct vsx_shadow_painter *painter);
 void
 vsx_shadow_painter_paint(struct vsx_shadow_painter *painter,
                          struct vsx_shadow_painter_shadow *shadow,
-                         const struct vsx_shader_data *shader_data,
+                         struct vsx_quad_batch *quad_batch,
                          const GLfloat *matrix,
                          const GLfloat *translation);
 
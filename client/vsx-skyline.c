@@ -0,0 +1,242 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-skyline.h"
+
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "vsx-util.h"
+#include "vsx-buffer.h"
+
+/* A skyline packer to allocate rectangles from a 2D region. The used
+ * space is tracked as a list of horizontal segments covering the
+ * whole width, each with the height of the top of the space below
+ * it. New rectangles are placed on the segment that leaves them
+ * lowest, preferring the leftmost one. This wastes less space than
+ * the BSP tree when the rectangles have lots of different heights,
+ * such as glyphs.
+ */
+
+struct vsx_skyline_segment {
+        int x, y;
+        int width;
+};
+
+struct vsx_skyline {
+        int width, height;
+        /* Array of segments sorted by x */
+        struct vsx_buffer segments;
+};
+
+static struct vsx_skyline_segment *
+get_segments(struct vsx_skyline *skyline,
+             int *n_segments_out)
+{
+        *n_segments_out = (skyline->segments.length /
+                           sizeof (struct vsx_skyline_segment));
+
+        return (struct vsx_skyline_segment *) skyline->segments.data;
+}
+
+static void
+insert_segment(struct vsx_skyline *skyline,
+               int segment_num,
+               int x, int y,
+               int width)
+{
+        vsx_buffer_set_length(&skyline->segments,
+                              skyline->segments.length +
+                              sizeof (struct vsx_skyline_segment));
+
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        memmove(segments + segment_num + 1,
+                segments + segment_num,
+                (n_segments - 1 - segment_num) * sizeof *segments);
+
+        segments[segment_num].x = x;
+        segments[segment_num].y = y;
+        segments[segment_num].width = width;
+}
+
+static void
+remove_segment(struct vsx_skyline *skyline,
+               int segment_num)
+{
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        memmove(segments + segment_num,
+                segments + segment_num + 1,
+                (n_segments - 1 - segment_num) * sizeof *segments);
+
+        vsx_buffer_set_length(&skyline->segments,
+                              skyline->segments.length -
+                              sizeof (struct vsx_skyline_segment));
+}
+
+struct vsx_skyline *
+vsx_skyline_new(int width, int height)
+{
+        struct vsx_skyline *skyline = vsx_alloc(sizeof *skyline);
+
+        skyline->width = width;
+        skyline->height = height;
+
+        vsx_buffer_init(&skyline->segments);
+
+        insert_segment(skyline, 0, 0, 0, width);
+
+        return skyline;
+}
+
+/* Gets the y position that a rectangle of the given width would have
+ * if its left edge was at the start of the segment. Returns false if
+ * it would go past the right edge.
+ */
+static bool
+get_fit_y(struct vsx_skyline *skyline,
+          int segment_num,
+          int add_width,
+          int *y_out)
+{
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        if (segments[segment_num].x + add_width > skyline->width)
+                return false;
+
+        int y = 0;
+
+        for (int i = segment_num; add_width > 0; i++) {
+                assert(i < n_segments);
+
+                y = MAX(y, segments[i].y);
+                add_width -= segments[i].width;
+        }
+
+        *y_out = y;
+
+        return true;
+}
+
+static void
+merge_segments(struct vsx_skyline *skyline)
+{
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        for (int i = 1; i < n_segments;) {
+                if (segments[i].y == segments[i - 1].y) {
+                        segments[i - 1].width += segments[i].width;
+                        remove_segment(skyline, i);
+                        segments = get_segments(skyline, &n_segments);
+                } else {
+                        i++;
+                }
+        }
+}
+
+static void
+place_rectangle(struct vsx_skyline *skyline,
+                int segment_num,
+                int y,
+                int add_width)
+{
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        int x = segments[segment_num].x;
+        int end = x + add_width;
+
+        /* Remove or shrink the segments that are now covered */
+        while (segment_num < n_segments && segments[segment_num].x < end) {
+                struct vsx_skyline_segment *segment = segments + segment_num;
+                int segment_end = segment->x + segment->width;
+
+                if (segment_end <= end) {
+                        remove_segment(skyline, segment_num);
+                        segments = get_segments(skyline, &n_segments);
+                } else {
+                        segment->x = end;
+                        segment->width = segment_end - end;
+                        break;
+                }
+        }
+
+        insert_segment(skyline, segment_num, x, y, add_width);
+
+        merge_segments(skyline);
+}
+
+bool
+vsx_skyline_add(struct vsx_skyline *skyline,
+                int add_width,
+                int add_height,
+                int *x_out,
+                int *y_out)
+{
+        int n_segments;
+        struct vsx_skyline_segment *segments =
+                get_segments(skyline, &n_segments);
+
+        int best_segment = -1;
+        int best_y = INT_MAX;
+
+        for (int i = 0; i < n_segments; i++) {
+                int y;
+
+                /* If it doesn’t fit here then it won’t fit on any of
+                 * the segments to the right either.
+                 */
+                if (!get_fit_y(skyline, i, add_width, &y))
+                        break;
+
+                if (y + add_height <= skyline->height && y < best_y) {
+                        best_segment = i;
+                        best_y = y;
+                }
+        }
+
+        if (best_segment == -1)
+                return false;
+
+        *x_out = segments[best_segment].x;
+        *y_out = best_y;
+
+        place_rectangle(skyline, best_segment, best_y + add_height, add_width);
+
+        return true;
+}
+
+void
+vsx_skyline_free(struct vsx_skyline *skyline)
+{
+        vsx_buffer_destroy(&skyline->segments);
+        vsx_free(skyline);
+}
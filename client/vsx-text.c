@@ -291,6 +291,8 @@ languages[] = {
 _Static_assert(VSX_N_ELEMENTS(languages) == VSX_TEXT_N_LANGUAGES,
                "The n_languages enum needs to match the number of languagues "
                "in the array");
+_Static_assert(VSX_N_ELEMENTS(english) == VSX_TEXT_N_TEXTS,
+               "VSX_TEXT_N_TEXTS needs to match the number of strings");
 _Static_assert(VSX_N_ELEMENTS(english) == VSX_N_ELEMENTS(french),
                "Every string needs to be defined for every language");
 _Static_assert(VSX_N_ELEMENTS(english) == VSX_N_ELEMENTS(esperanto),
@@ -63,6 +63,8 @@ enum vsx_text {
 
 #define VSX_TEXT_N_LANGUAGES 3
 
+#define VSX_TEXT_N_TEXTS (VSX_TEXT_PRIVACY_POLICY + 1)
+
 const char *
 vsx_text_get(enum vsx_text_language language,
              enum vsx_text text);
@@ -62,6 +62,15 @@ struct vsx_tile_painter_tile {
         int64_t animation_start_time;
         int64_t animation_end_time;
 
+        /* The slot in the tile buffer that the tile was last
+         * written to and the position it was written with. The slots
+         * are in the same order as the tile list. The tile only needs
+         * to be written again if either of these change. The slot is
+         * -1 if the tile hasn’t been written yet.
+         */
+        int slot;
+        int16_t slot_x, slot_y;
+
         const struct vsx_tile_texture_letter *letter_data;
         struct vsx_list link;
 };
@@ -180,6 +189,7 @@ get_tile_by_index(struct vsx_tile_painter *painter,
                 vsx_list_insert(painter->tile_list.prev, &tile->link);
 
                 tile->num = tile_num;
+                tile->slot = -1;
 
                 *is_new = true;
         } else {
@@ -785,27 +795,44 @@ static size_t
 update_tile_vertices(struct vsx_tile_painter *painter,
                      size_t max_tiles)
 {
-        size_t n_quads = 0;
+        struct vsx_tile_tool_buffer *buf = painter->tile_buffer;
+        int slot = 0;
 
         struct vsx_tile_painter_tile *tile;
 
-        vsx_tile_tool_begin_update(painter->tile_buffer, max_tiles);
+        vsx_tile_tool_set_n_slots(buf, max_tiles);
 
         vsx_list_for_each(tile, &painter->tile_list, link) {
                 if (tile->letter_data == NULL)
                         continue;
 
-                vsx_tile_tool_add_tile(painter->tile_buffer,
-                                       tile->current_x,
-                                       tile->current_y,
-                                       tile->letter_data);
+                /* Only write the tiles that have moved or that have
+                 * changed slot because a tile before them was raised.
+                 * While dragging, the dragged tile is already at the
+                 * end of the list so it will be the only one that
+                 * changes.
+                 */
+                if (tile->slot != slot ||
+                    tile->slot_x != tile->current_x ||
+                    tile->slot_y != tile->current_y) {
+                        vsx_tile_tool_set_slot(buf,
+                                               slot,
+                                               tile->current_x,
+                                               tile->current_y,
+                                               tile->letter_data);
+                        tile->slot = slot;
+                        tile->slot_x = tile->current_x;
+                        tile->slot_y = tile->current_y;
+                }
 
-                n_quads++;
+                slot++;
         }
 
-        vsx_tile_tool_end_update(painter->tile_buffer);
+        vsx_tile_tool_set_n_slots(buf, slot);
 
-        return n_quads;
+        vsx_tile_tool_flush_slots(buf);
+
+        return slot;
 }
 
 static void
@@ -840,24 +867,22 @@ paint_cb(void *painter_data)
         if (n_quads <= 0)
                 return;
 
-        struct vsx_gl *gl = painter->toolbox->gl;
-
         struct vsx_paint_state *paint_state = &painter->toolbox->paint_state;
 
         vsx_paint_state_ensure_layout(paint_state);
 
-        gl->glEnable(GL_SCISSOR_TEST);
-        gl->glScissor(paint_state->board_scissor_x,
-                      paint_state->board_scissor_y,
-                      paint_state->board_scissor_width,
-                      paint_state->board_scissor_height);
+        const GLint scissor[] = {
+                paint_state->board_scissor_x,
+                paint_state->board_scissor_y,
+                paint_state->board_scissor_width,
+                paint_state->board_scissor_height,
+        };
 
         vsx_tile_tool_paint(painter->tile_buffer,
                             &painter->toolbox->shader_data,
                             paint_state->board_matrix,
-                            paint_state->board_translation);
-
-        gl->glDisable(GL_SCISSOR_TEST);
+                            paint_state->board_translation,
+                            scissor);
 
         if (any_tiles_animating) {
                 struct vsx_shell_interface *shell = painter->toolbox->shell;
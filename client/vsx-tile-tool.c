@@ -26,6 +26,7 @@
 #include "vsx-mipmap.h"
 #include "vsx-board.h"
 #include "vsx-array-object.h"
+#include "vsx-bitmask.h"
 
 struct vsx_tile_tool_buffer {
         struct vsx_tile_tool *tool;
@@ -39,6 +40,16 @@ struct vsx_tile_tool_buffer {
         int n_tiles;
         int max_tiles;
         int tile_size;
+
+        /* Copy of the vertices written with the slot functions so
+         * that the tiles can be uploaded individually.
+         */
+        struct vsx_buffer slot_vertices;
+        /* Bitmask of slots that have been modified since they were
+         * last uploaded.
+         */
+        struct vsx_buffer dirty_slots;
+        bool any_dirty_slots;
 };
 
 struct vsx_tile_tool {
@@ -118,10 +129,12 @@ vsx_tile_tool_new(struct vsx_gl *gl,
         tool->map_buffer = map_buffer;
         tool->quad_tool = quad_tool;
 
-        tool->image_token = vsx_image_loader_load(image_loader,
-                                                  "tiles.mpng",
-                                                  texture_load_cb,
-                                                  tool);
+        tool->image_token =
+                vsx_image_loader_load(image_loader,
+                                      "tiles.mpng",
+                                      VSX_IMAGE_LOADER_PRIORITY_HIGH,
+                                      texture_load_cb,
+                                      tool);
 
         return tool;
 }
@@ -135,6 +148,9 @@ vsx_tile_tool_create_buffer(struct vsx_tile_tool *tool,
         buf->tool = tool;
         buf->tile_size = tile_size;
 
+        vsx_buffer_init(&buf->slot_vertices);
+        vsx_buffer_init(&buf->dirty_slots);
+
         return buf;
 }
 
@@ -229,37 +245,47 @@ vsx_tile_tool_begin_update(struct vsx_tile_tool_buffer *buf,
         buf->v = buf->vertices;
 }
 
-void
-vsx_tile_tool_add_tile(struct vsx_tile_tool_buffer *buf,
-                       int tile_x, int tile_y,
-                       const struct vsx_tile_texture_letter *letter_data)
+static struct vertex *
+write_quad(struct vertex *v,
+           int tile_size,
+           int tile_x, int tile_y,
+           const struct vsx_tile_texture_letter *letter_data)
 {
-        struct vertex *v = buf->v;
-
-        assert(buf->vertices);
-
         v->x = tile_x;
         v->y = tile_y;
         v->s = letter_data->s1;
         v->t = letter_data->t1;
         v++;
         v->x = tile_x;
-        v->y = tile_y + buf->tile_size;
+        v->y = tile_y + tile_size;
         v->s = letter_data->s1;
         v->t = letter_data->t2;
         v++;
-        v->x = tile_x + buf->tile_size;
+        v->x = tile_x + tile_size;
         v->y = tile_y;
         v->s = letter_data->s2;
         v->t = letter_data->t1;
         v++;
-        v->x = tile_x + buf->tile_size;
-        v->y = tile_y + buf->tile_size;
+        v->x = tile_x + tile_size;
+        v->y = tile_y + tile_size;
         v->s = letter_data->s2;
         v->t = letter_data->t2;
         v++;
 
-        buf->v = v;
+        return v;
+}
+
+void
+vsx_tile_tool_add_tile(struct vsx_tile_tool_buffer *buf,
+                       int tile_x, int tile_y,
+                       const struct vsx_tile_texture_letter *letter_data)
+{
+        assert(buf->vertices);
+
+        buf->v = write_quad(buf->v,
+                            buf->tile_size,
+                            tile_x, tile_y,
+                            letter_data);
 }
 
 void
@@ -282,11 +308,126 @@ vsx_tile_tool_end_update(struct vsx_tile_tool_buffer *buf)
         buf->vertices = NULL;
 }
 
+static int
+get_n_slot_vertices(struct vsx_tile_tool_buffer *buf)
+{
+        return buf->slot_vertices.length / sizeof (struct vertex);
+}
+
+void
+vsx_tile_tool_set_n_slots(struct vsx_tile_tool_buffer *buf,
+                          int n_slots)
+{
+        assert(buf->vertices == NULL);
+
+        if (n_slots > buf->max_tiles) {
+                ensure_buffer_size(buf, n_slots);
+
+                /* The GL buffer has been recreated so all of the
+                 * slots need to be uploaded again.
+                 */
+                int n_old_slots = get_n_slot_vertices(buf) / 4;
+
+                for (int i = 0; i < n_old_slots; i++)
+                        vsx_bitmask_set_buffer(&buf->dirty_slots, i, true);
+
+                buf->any_dirty_slots = n_old_slots > 0;
+        }
+
+        size_t length = n_slots * 4 * sizeof (struct vertex);
+
+        if (buf->slot_vertices.length < length)
+                vsx_buffer_set_length(&buf->slot_vertices, length);
+
+        buf->n_tiles = n_slots;
+}
+
+void
+vsx_tile_tool_set_slot(struct vsx_tile_tool_buffer *buf,
+                       int slot,
+                       int tile_x, int tile_y,
+                       const struct vsx_tile_texture_letter *letter_data)
+{
+        assert(slot >= 0 && slot < buf->n_tiles);
+
+        struct vertex *vertices = (struct vertex *) buf->slot_vertices.data;
+
+        write_quad(vertices + slot * 4,
+                   buf->tile_size,
+                   tile_x, tile_y,
+                   letter_data);
+
+        vsx_bitmask_set_buffer(&buf->dirty_slots, slot, true);
+        buf->any_dirty_slots = true;
+}
+
+static void
+upload_slots(struct vsx_tile_tool_buffer *buf,
+             int start,
+             int end)
+{
+        struct vsx_gl *gl = buf->tool->gl;
+        size_t slot_size = 4 * sizeof (struct vertex);
+
+        gl->glBufferSubData(GL_ARRAY_BUFFER,
+                            start * slot_size,
+                            (end - start) * slot_size,
+                            buf->slot_vertices.data + start * slot_size);
+
+        for (int i = start; i < end; i++)
+                vsx_bitmask_set_buffer(&buf->dirty_slots, i, false);
+}
+
+void
+vsx_tile_tool_flush_slots(struct vsx_tile_tool_buffer *buf)
+{
+        if (!buf->any_dirty_slots)
+                return;
+
+        struct vsx_gl *gl = buf->tool->gl;
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buf->vbo);
+
+        int run_start = -1;
+        bool any_left = false;
+
+        /* Upload each run of consecutive modified slots with a
+         * single call.
+         */
+        for (int i = 0; i < buf->n_tiles; i++) {
+                if (vsx_bitmask_get_buffer(&buf->dirty_slots, i)) {
+                        if (run_start == -1)
+                                run_start = i;
+                } else if (run_start != -1) {
+                        upload_slots(buf, run_start, i);
+                        run_start = -1;
+                }
+        }
+
+        if (run_start != -1)
+                upload_slots(buf, run_start, buf->n_tiles);
+
+        /* Slots beyond the end that were modified before the number
+         * of slots was reduced still need uploading later.
+         */
+        int n_slots = get_n_slot_vertices(buf) / 4;
+
+        for (int i = buf->n_tiles; i < n_slots; i++) {
+                if (vsx_bitmask_get_buffer(&buf->dirty_slots, i)) {
+                        any_left = true;
+                        break;
+                }
+        }
+
+        buf->any_dirty_slots = any_left;
+}
+
 void
 vsx_tile_tool_paint(struct vsx_tile_tool_buffer *buf,
                     const struct vsx_shader_data *shader_data,
                     const GLfloat *matrix,
-                    const GLfloat *translation)
+                    const GLfloat *translation,
+                    const GLint *scissor)
 {
         assert(buf->tool->tex != 0);
 
@@ -295,7 +436,12 @@ vsx_tile_tool_paint(struct vsx_tile_tool_buffer *buf,
         const struct vsx_shader_data_program_data *program =
                 shader_data->programs + VSX_SHADER_DATA_PROGRAM_TEXTURE;
 
-        gl->glUseProgram(program->program);
+        /* The tiles stay in their own buffer instead of going
+         * through the quad batch so that only the modified slots
+         * need uploading. Changing the program flushes the batch
+         * first so the drawing order is kept.
+         */
+        vsx_gl_use_program(gl, program->program);
         vsx_array_object_bind(buf->vao, gl);
 
         gl->glUniformMatrix2fv(program->matrix_uniform,
@@ -308,12 +454,20 @@ vsx_tile_tool_paint(struct vsx_tile_tool_buffer *buf,
 
         gl->glBindTexture(GL_TEXTURE_2D, buf->tool->tex);
 
+        if (scissor) {
+                vsx_gl_enable(gl, GL_SCISSOR_TEST);
+                gl->glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+        }
+
         vsx_gl_draw_range_elements(gl,
                                    GL_TRIANGLES,
                                    0, buf->n_tiles * 4 - 1,
                                    buf->n_tiles * 6,
                                    buf->quad_buffer->type,
                                    NULL /* indices */);
+
+        if (scissor)
+                vsx_gl_disable(gl, GL_SCISSOR_TEST);
 }
 
 void
@@ -321,6 +475,8 @@ vsx_tile_tool_free_buffer(struct vsx_tile_tool_buffer *buf)
 {
         assert(buf->vertices == NULL);
         free_buffer(buf);
+        vsx_buffer_destroy(&buf->slot_vertices);
+        vsx_buffer_destroy(&buf->dirty_slots);
         vsx_free(buf);
 }
 
@@ -44,11 +44,16 @@ vsx_tile_tool_is_ready(struct vsx_tile_tool *tool);
 struct vsx_signal *
 vsx_tile_tool_get_ready_signal(struct vsx_tile_tool *tool);
 
+/* Draws the tiles straight from the buffer after flushing anything
+ * pending in the quad batch. The scissor is an array of x, y, width
+ * and height, or NULL to not clip the tiles.
+ */
 void
 vsx_tile_tool_paint(struct vsx_tile_tool_buffer *buf,
                     const struct vsx_shader_data *shader_data,
                     const GLfloat *matrix,
-                    const GLfloat *translation);
+                    const GLfloat *translation,
+                    const GLint *scissor);
 
 struct vsx_tile_tool_buffer *
 vsx_tile_tool_create_buffer(struct vsx_tile_tool *tool,
@@ -66,6 +71,29 @@ vsx_tile_tool_add_tile(struct vsx_tile_tool_buffer *buf,
 void
 vsx_tile_tool_end_update(struct vsx_tile_tool_buffer *buf);
 
+/* As an alternative to replacing all of the tiles with
+ * vsx_tile_tool_begin_update, the buffer can be treated as an array
+ * of slots that keep their contents between paints. Only the slots
+ * that are modified are uploaded when vsx_tile_tool_flush_slots is
+ * called. The two methods shouldn’t be mixed on the same buffer.
+ *
+ * vsx_tile_tool_set_n_slots sets the number of slots that will be
+ * painted. The contents of the existing slots are kept but any new
+ * slots need to be set before painting.
+ */
+void
+vsx_tile_tool_set_n_slots(struct vsx_tile_tool_buffer *buf,
+                          int n_slots);
+
+void
+vsx_tile_tool_set_slot(struct vsx_tile_tool_buffer *buf,
+                       int slot,
+                       int tile_x, int tile_y,
+                       const struct vsx_tile_texture_letter *letter_data);
+
+void
+vsx_tile_tool_flush_slots(struct vsx_tile_tool_buffer *buf);
+
 void
 vsx_tile_tool_free_buffer(struct vsx_tile_tool_buffer *buf);
 
@@ -26,8 +26,10 @@
 #include "vsx-shader-data.h"
 #include "vsx-image-loader.h"
 #include "vsx-font.h"
+#include "vsx-layout-cache.h"
 #include "vsx-shadow-painter.h"
 #include "vsx-tile-tool.h"
+#include "vsx-quad-batch.h"
 #include "vsx-paint-state.h"
 #include "vsx-shell-interface.h"
 
@@ -39,8 +41,10 @@ struct vsx_toolbox {
         struct vsx_shader_data shader_data;
         struct vsx_image_loader *image_loader;
         struct vsx_font_library *font_library;
+        struct vsx_layout_cache *layout_cache;
         struct vsx_shadow_painter *shadow_painter;
         struct vsx_tile_tool *tile_tool;
+        struct vsx_quad_batch *quad_batch;
         struct vsx_paint_state paint_state;
         struct vsx_shell_interface *shell;
 };
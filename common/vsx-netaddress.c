@@ -97,6 +97,11 @@ vsx_netaddress_from_native(struct vsx_netaddress *address,
                                                 &native->sockaddr_in6);
                 break;
 
+        case AF_UNIX:
+                memset(address, 0, sizeof *address);
+                address->family = AF_UNIX;
+                break;
+
         default:
                 memset(address, 0, sizeof *address);
                 break;
@@ -119,6 +124,11 @@ vsx_netaddress_to_string(const struct vsx_netaddress *address)
         };
         int len;
 
+        if (address->family == AF_UNIX) {
+                strcpy(buf, "unix");
+                return buf;
+        }
+
         if (address->family == AF_INET6) {
                 if (memcmp(&address->ipv6,
                            ipv4_mapped_address_prefix,
@@ -22,7 +22,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 
+/* The family can also be AF_UNIX for a client connected to a UNIX
+ * domain socket. In that case there is no address and the port is
+ * zero.
+ */
 struct vsx_netaddress {
         short int family;
         uint16_t port;
@@ -38,6 +43,7 @@ struct vsx_netaddress_native {
                 struct sockaddr sockaddr;
                 struct sockaddr_in sockaddr_in;
                 struct sockaddr_in6 sockaddr_in6;
+                struct sockaddr_un sockaddr_un;
         };
         socklen_t length;
 };
@@ -27,6 +27,72 @@
 
 #include "vsx-utf8.h"
 
+/* Maximum number of bytes in a varint for a uint32_t */
+#define VSX_PROTO_MAX_VARINT_LENGTH 5
+
+static uint32_t
+zigzag_encode(int32_t value)
+{
+        return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t
+zigzag_decode(uint32_t value)
+{
+        return (int32_t) ((value >> 1) ^ -(value & 1));
+}
+
+static size_t
+get_varint_length(uint32_t value)
+{
+        size_t length = 1;
+
+        while (value >= 0x80) {
+                value >>= 7;
+                length++;
+        }
+
+        return length;
+}
+
+static size_t
+write_varint(uint8_t *buffer, uint32_t value)
+{
+        size_t pos = 0;
+
+        while (value >= 0x80) {
+                buffer[pos++] = (value & 0x7f) | 0x80;
+                value >>= 7;
+        }
+
+        buffer[pos++] = value;
+
+        return pos;
+}
+
+static bool
+read_varint(const uint8_t *buffer,
+            size_t length,
+            uint32_t *value_out,
+            size_t *consumed_out)
+{
+        uint32_t value = 0;
+
+        for (size_t pos = 0;
+             pos < length && pos < VSX_PROTO_MAX_VARINT_LENGTH;
+             pos++) {
+                value |= (uint32_t) (buffer[pos] & 0x7f) << (pos * 7);
+
+                if ((buffer[pos] & 0x80) == 0) {
+                        *value_out = value;
+                        *consumed_out = pos + 1;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
 #define VSX_PROTO_TYPE(enum_name, type_name, ap_type_name)      \
         case enum_name:                                         \
         payload_length += sizeof (type_name);                   \
@@ -52,6 +118,12 @@ get_payload_length(va_list ap)
                         payload_length += strlen(va_arg(ap, const char *)) + 1;
                         break;
 
+                case VSX_PROTO_TYPE_SVARINT:
+                        payload_length +=
+                                get_varint_length(zigzag_encode(va_arg(ap,
+                                                                       int)));
+                        break;
+
                 case VSX_PROTO_TYPE_NONE:
                         return payload_length;
                 }
@@ -106,34 +178,21 @@ vsx_proto_write_frame_header(uint8_t *buffer,
                                                                         \
         break;
 
-int
-vsx_proto_write_command_v(uint8_t *buffer,
-                          size_t buffer_length,
-                          int command,
-                          va_list ap)
+/* Writes the command ID and the values to the buffer, which must
+ * already be known to be big enough. Returns the number of bytes
+ * written.
+ */
+static size_t
+write_payload(uint8_t *buffer,
+              int command,
+              va_list ap)
 {
-        int pos;
-        size_t payload_length = 0;
-        size_t frame_header_length;
+        size_t pos = 0;
         size_t blob_length;
         const uint8_t *blob_data;
         const char *str;
-        va_list ap_copy;
-
-        va_copy(ap_copy, ap);
-        payload_length = get_payload_length(ap_copy);
-        va_end(ap_copy);
-
-        frame_header_length = vsx_proto_get_frame_header_length(payload_length);
-
-        if (frame_header_length + payload_length > buffer_length)
-                return -1;
-
-        vsx_proto_write_frame_header(buffer, payload_length);
 
-        buffer[frame_header_length] = command;
-
-        pos = frame_header_length + 1;
+        buffer[pos++] = command;
 
         while (true) {
                 switch (va_arg(ap, enum vsx_proto_type)) {
@@ -153,20 +212,48 @@ vsx_proto_write_command_v(uint8_t *buffer,
                         pos += blob_length;
                         break;
 
+                case VSX_PROTO_TYPE_SVARINT:
+                        pos += write_varint(buffer + pos,
+                                            zigzag_encode(va_arg(ap, int)));
+                        break;
+
                 case VSX_PROTO_TYPE_NONE:
-                        goto done;
+                        return pos;
                 }
         }
-done:
+}
 
-        va_end(ap);
+#undef VSX_PROTO_TYPE
 
-        assert(pos == frame_header_length + payload_length);
+int
+vsx_proto_write_command_v(uint8_t *buffer,
+                          size_t buffer_length,
+                          int command,
+                          va_list ap)
+{
+        size_t payload_length;
+        size_t frame_header_length;
+        va_list ap_copy;
 
-        return pos;
-}
+        va_copy(ap_copy, ap);
+        payload_length = get_payload_length(ap_copy);
+        va_end(ap_copy);
 
-#undef VSX_PROTO_TYPE
+        frame_header_length = vsx_proto_get_frame_header_length(payload_length);
+
+        if (frame_header_length + payload_length > buffer_length)
+                return -1;
+
+        vsx_proto_write_frame_header(buffer, payload_length);
+
+        size_t wrote = write_payload(buffer + frame_header_length,
+                                     command,
+                                     ap);
+
+        assert(wrote == payload_length);
+
+        return frame_header_length + payload_length;
+}
 
 int
 vsx_proto_write_command(uint8_t *buffer,
@@ -186,6 +273,95 @@ vsx_proto_write_command(uint8_t *buffer,
         return ret;
 }
 
+int
+vsx_proto_write_packed_command_v(uint8_t *buffer,
+                                 size_t buffer_length,
+                                 int command,
+                                 va_list ap)
+{
+        size_t payload_length;
+        size_t length_length;
+        va_list ap_copy;
+
+        va_copy(ap_copy, ap);
+        payload_length = get_payload_length(ap_copy);
+        va_end(ap_copy);
+
+        length_length = get_varint_length(payload_length);
+
+        if (length_length + payload_length > buffer_length)
+                return -1;
+
+        write_varint(buffer, payload_length);
+
+        size_t wrote = write_payload(buffer + length_length, command, ap);
+
+        assert(wrote == payload_length);
+
+        return length_length + payload_length;
+}
+
+int
+vsx_proto_write_packed_command(uint8_t *buffer,
+                               size_t buffer_length,
+                               int command,
+                               ...)
+{
+        int ret;
+        va_list ap;
+
+        va_start(ap, command);
+
+        ret = vsx_proto_write_packed_command_v(buffer,
+                                               buffer_length,
+                                               command,
+                                               ap);
+
+        va_end(ap);
+
+        return ret;
+}
+
+size_t
+vsx_proto_finish_packed_frame(uint8_t *buffer,
+                              size_t payload_length)
+{
+        size_t frame_header_length =
+                vsx_proto_get_frame_header_length(payload_length);
+
+        assert(frame_header_length <= VSX_PROTO_PACKED_FRAME_HEADER_LENGTH);
+
+        memmove(buffer + frame_header_length,
+                buffer + VSX_PROTO_PACKED_FRAME_HEADER_LENGTH,
+                payload_length);
+
+        vsx_proto_write_frame_header(buffer, payload_length);
+
+        return frame_header_length + payload_length;
+}
+
+bool
+vsx_proto_read_packed_command(const uint8_t **data,
+                              size_t *length,
+                              const uint8_t **payload_out,
+                              size_t *payload_length_out)
+{
+        uint32_t payload_length;
+        size_t length_length;
+
+        if (!read_varint(*data, *length, &payload_length, &length_length) ||
+            payload_length > *length - length_length)
+                return false;
+
+        *payload_out = *data + length_length;
+        *payload_length_out = payload_length;
+
+        *data += length_length + payload_length;
+        *length -= length_length + payload_length;
+
+        return true;
+}
+
 #define VSX_PROTO_TYPE(enum_name, type_name, ap_type_name)              \
         case enum_name:                                                 \
         if ((size_t) pos + sizeof (type_name) > length) {               \
@@ -214,6 +390,8 @@ vsx_proto_read_payload(const uint8_t *buffer,
         size_t *blob_size;
         const char **str;
         const uint8_t *str_end;
+        uint32_t varint;
+        size_t varint_length;
 
         va_start(ap, length);
 
@@ -244,6 +422,18 @@ vsx_proto_read_payload(const uint8_t *buffer,
                         pos = str_end - buffer + 1;
                         break;
 
+                case VSX_PROTO_TYPE_SVARINT:
+                        if (!read_varint(buffer + pos,
+                                         length - pos,
+                                         &varint,
+                                         &varint_length)) {
+                                ret = false;
+                                goto done;
+                        }
+                        *va_arg(ap, int32_t *) = zigzag_decode(varint);
+                        pos += varint_length;
+                        break;
+
                 case VSX_PROTO_TYPE_NONE:
                         if (pos != length)
                                 ret = false;
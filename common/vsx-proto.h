@@ -46,6 +46,18 @@
 
 #define VSX_PROTO_MAX_FRAME_HEADER_LENGTH (1 + 1 + 8 + 4)
 
+/* Name of the WebSocket subprotocol that the client can request to
+ * use version 2 of the protocol. See doc/protocol.txt.
+ */
+#define VSX_PROTO_V2_NAME "vsx.v2"
+
+/* In version 2 several messages are packed into each frame. The
+ * messages are written after reserving this much space for the frame
+ * header, which is enough for any payload up to
+ * VSX_PROTO_MAX_PAYLOAD_SIZE.
+ */
+#define VSX_PROTO_PACKED_FRAME_HEADER_LENGTH (1 + 1 + 2)
+
 #define VSX_PROTO_NEW_PLAYER 0x80
 #define VSX_PROTO_RECONNECT 0x81
 #define VSX_PROTO_KEEP_ALIVE 0x83
@@ -84,6 +96,10 @@ enum vsx_proto_type {
         VSX_PROTO_TYPE_INT16,
         VSX_PROTO_TYPE_BLOB,
         VSX_PROTO_TYPE_STRING,
+        /* Signed integer stored as a zigzag-encoded varint. This is
+         * passed as an int and read into an int32_t.
+         */
+        VSX_PROTO_TYPE_SVARINT,
         VSX_PROTO_TYPE_NONE
 };
 
@@ -133,6 +149,40 @@ vsx_proto_write_command(uint8_t *buffer,
                         int command,
                         ...);
 
+/* Same as vsx_proto_write_command except that instead of a frame
+ * header the message is preceded by its length as a varint so that it
+ * can be packed into a frame with other messages.
+ */
+int
+vsx_proto_write_packed_command_v(uint8_t *buffer,
+                                 size_t buffer_length,
+                                 int command,
+                                 va_list ap);
+
+int
+vsx_proto_write_packed_command(uint8_t *buffer,
+                               size_t buffer_length,
+                               int command,
+                               ...);
+
+/* Writes the header for a frame whose payload was written
+ * VSX_PROTO_PACKED_FRAME_HEADER_LENGTH bytes into the buffer and
+ * moves the payload down to directly follow it. Returns the total
+ * size of the frame.
+ */
+size_t
+vsx_proto_finish_packed_frame(uint8_t *buffer,
+                              size_t payload_length);
+
+/* Takes the next message out of the payload of a packed frame and
+ * advances *data past it. Returns false if the data is invalid.
+ */
+bool
+vsx_proto_read_packed_command(const uint8_t **data,
+                              size_t *length,
+                              const uint8_t **payload_out,
+                              size_t *payload_length_out);
+
 static inline uint8_t
 vsx_proto_read_uint8_t(const uint8_t *buffer)
 {
@@ -132,6 +132,24 @@ vsx_asset_remaining(struct vsx_asset *asset,
         }
 }
 
+const void *
+vsx_asset_map(struct vsx_asset *asset,
+              size_t *size_out,
+              struct vsx_error **error)
+{
+        /* This will likely get called from another thread that won’t have an autorelease pool,
+         * so let’s wrap it here.
+         */
+        @autoreleasepool {
+                NSDataAsset *asset_ns = (__bridge NSDataAsset *) asset->asset_ptr;
+
+                /* The data is kept alive by the asset until it is closed */
+                *size_out = [asset_ns.data length];
+
+                return [asset_ns.data bytes];
+        }
+}
+
 void
 vsx_asset_close(struct vsx_asset *asset)
 {
@@ -0,0 +1,15 @@
+#!/bin/sh
+
+# Converts all of the .mpng images in the assets directory to baked
+# textures so that the client can upload them without decoding the
+# PNGs at startup. Run it with “ninja bake-textures” from a build
+# directory.
+
+set -e
+
+bake_texture="$1"
+assets_dir="$2"
+
+for mpng in "$assets_dir"/*.mpng; do
+        "$bake_texture" "$mpng" "${mpng%.mpng}.vtex"
+done
@@ -0,0 +1,430 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs a large number of simulated players through their whole
+ * lifecycle using a simulated clock. Each player connects, joins a
+ * game, stays connected for a while and then disconnects. The last
+ * player to join each game starts it. The person is then left idle
+ * until the timer that removes silent people frees it along with its
+ * game. The clock only advances when the simulation says so, which
+ * means the timeouts that take minutes on a real server pass
+ * instantly. At the end it reports the peak memory usage and the
+ * longest time that a single iteration of the simulated main loop
+ * took, which is the longest that a real server would have stopped
+ * responding for.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "vsx-connection.h"
+#include "vsx-conversation-set.h"
+#include "vsx-person-set.h"
+#include "vsx-main-context.h"
+#include "vsx-metrics.h"
+#include "vsx-proto.h"
+#include "vsx-list.h"
+#include "vsx-util.h"
+
+typedef struct
+{
+  VsxConnection *ws_connection;
+  struct vsx_listener changed_listener;
+
+  /* Simulated time at which the player disconnects */
+  int64_t leave_time;
+
+  /* Link in the list of connected players, ordered by leave_time */
+  struct vsx_list link;
+
+  /* Link in the list of connections that might have data to write */
+  struct vsx_list dirty_link;
+  bool dirty;
+} SimPlayer;
+
+static const char options[] = "-hp:a:s:r:t:";
+
+static int option_n_players = 1000000;
+static int option_arrival_time = 10 * 60;
+static int option_session_time = 60;
+static int option_players_per_room = 4;
+static int option_tick_time = 100;
+
+/* Value returned by the simulated clock */
+static int64_t sim_time;
+
+static struct vsx_netaddress sim_address;
+static VsxConversationSet *conversation_set;
+static VsxPersonSet *person_set;
+
+static struct vsx_list connected_players;
+static struct vsx_list dirty_players;
+static int n_connected_players;
+
+static const char
+ws_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+  "\r\n";
+
+static void
+usage (void)
+{
+  printf ("bench-lifecycle - Simulate the lifecycle of many players\n"
+          "usage: bench-lifecycle [options]...\n"
+          " -h                   Show this help message\n"
+          " -p <players>         Number of players to simulate\n"
+          " -a <seconds>         Simulated time over which the players "
+          "arrive\n"
+          " -s <seconds>         Simulated time each player stays "
+          "connected\n"
+          " -r <players>         Number of players in each room\n"
+          " -t <ms>              Simulated time of each iteration of "
+          "the main loop\n");
+}
+
+static bool
+parse_positive (const char *arg,
+                int *value_out)
+{
+  char *tail;
+  long value = strtol (arg, &tail, 10);
+
+  if (*arg == '\0' || *tail != '\0' || value <= 0 || value > INT32_MAX)
+    {
+      fprintf (stderr, "invalid number \"%s\"\n", arg);
+      return false;
+    }
+
+  *value_out = value;
+
+  return true;
+}
+
+static bool
+process_arguments (int argc, char **argv)
+{
+  int opt;
+
+  opterr = false;
+
+  while ((opt = getopt (argc, argv, options)) != -1)
+    {
+      switch (opt)
+        {
+        case ':':
+        case '?':
+          fprintf (stderr, "invalid option '%c'\n", optopt);
+          return false;
+
+        case '\1':
+          fprintf (stderr, "unexpected argument \"%s\"\n", optarg);
+          return false;
+
+        case 'h':
+          usage ();
+          return false;
+
+        case 'p':
+          if (!parse_positive (optarg, &option_n_players))
+            return false;
+          break;
+
+        case 'a':
+          if (!parse_positive (optarg, &option_arrival_time))
+            return false;
+          break;
+
+        case 's':
+          if (!parse_positive (optarg, &option_session_time))
+            return false;
+          break;
+
+        case 'r':
+          if (!parse_positive (optarg, &option_players_per_room))
+            return false;
+          break;
+
+        case 't':
+          if (!parse_positive (optarg, &option_tick_time))
+            return false;
+          break;
+        }
+    }
+
+  return true;
+}
+
+static int64_t
+get_real_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C (1000000) + ts.tv_nsec / INT64_C (1000);
+}
+
+static int64_t
+sim_clock (void *user_data)
+{
+  return sim_time;
+}
+
+static void
+parse_or_abort (VsxConnection *conn,
+                const uint8_t *data,
+                size_t length)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (conn, data, length, &error))
+    {
+      fprintf (stderr, "Unexpected error: %s\n", error->message);
+      exit (EXIT_FAILURE);
+    }
+}
+
+static void
+changed_cb (struct vsx_listener *listener,
+            void *data)
+{
+  SimPlayer *player =
+    vsx_container_of (listener, SimPlayer, changed_listener);
+
+  if (!player->dirty)
+    {
+      player->dirty = true;
+      vsx_list_insert (&dirty_players, &player->dirty_link);
+    }
+}
+
+static void
+add_player (int player_num)
+{
+  SimPlayer *player = vsx_calloc (sizeof *player);
+
+  player->ws_connection = vsx_connection_new (&sim_address,
+                                              conversation_set,
+                                              person_set);
+  player->changed_listener.notify = changed_cb;
+  vsx_signal_add (vsx_connection_get_changed_signal (player->ws_connection),
+                  &player->changed_listener);
+
+  player->leave_time = sim_time + option_session_time * INT64_C (1000000);
+
+  /* Every player stays for the same amount of time so adding to the
+   * end of the list keeps it sorted.
+   */
+  vsx_list_insert (connected_players.prev, &player->link);
+  n_connected_players++;
+
+  parse_or_abort (player->ws_connection,
+                  (const uint8_t *) ws_request,
+                  (sizeof ws_request) - 1);
+
+  char room_name[32], player_name[32];
+
+  snprintf (room_name, sizeof room_name,
+            "room%i",
+            player_num / option_players_per_room);
+  snprintf (player_name, sizeof player_name, "player%i", player_num);
+
+  /* The client doesn’t need to mask the frames */
+  uint8_t frame[VSX_PROTO_MAX_PAYLOAD_SIZE
+                + VSX_PROTO_MAX_FRAME_HEADER_LENGTH];
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_NEW_PLAYER,
+
+                                        VSX_PROTO_TYPE_STRING,
+                                        room_name,
+
+                                        VSX_PROTO_TYPE_STRING,
+                                        player_name,
+
+                                        VSX_PROTO_TYPE_NONE);
+
+  parse_or_abort (player->ws_connection, frame, length);
+
+  /* The last player to join each room starts the game by turning a
+   * tile so that the room stops being a pending game that new
+   * players could join.
+   */
+  if ((player_num + 1) % option_players_per_room == 0)
+    {
+      length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_TURN,
+                                        VSX_PROTO_TYPE_NONE);
+      parse_or_abort (player->ws_connection, frame, length);
+    }
+}
+
+static void
+remove_player (SimPlayer *player)
+{
+  if (player->dirty)
+    vsx_list_remove (&player->dirty_link);
+
+  vsx_list_remove (&player->link);
+  n_connected_players--;
+
+  vsx_connection_free (player->ws_connection);
+  vsx_free (player);
+}
+
+static void
+flush_players (void)
+{
+  while (!vsx_list_empty (&dirty_players))
+    {
+      SimPlayer *player =
+        vsx_container_of (dirty_players.next, SimPlayer, dirty_link);
+
+      vsx_list_remove (&player->dirty_link);
+      player->dirty = false;
+
+      uint8_t buf[1024];
+
+      while (vsx_connection_fill_output_buffer (player->ws_connection,
+                                                buf,
+                                                sizeof buf) > 0);
+    }
+}
+
+static long
+get_peak_memory (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == -1)
+    return 0;
+
+  /* This is in kilobytes on Linux */
+  return usage.ru_maxrss;
+}
+
+int
+main (int argc, char **argv)
+{
+  if (!process_arguments (argc, argv))
+    return EXIT_FAILURE;
+
+  sim_time = get_real_time ();
+  vsx_main_context_set_clock (NULL, sim_clock, NULL);
+
+  vsx_netaddress_from_string (&sim_address, "127.0.0.1", 5144);
+  conversation_set = vsx_conversation_set_new ();
+  person_set = vsx_person_set_new ();
+  vsx_list_init (&connected_players);
+  vsx_list_init (&dirty_players);
+
+  int64_t tick_time = option_tick_time * INT64_C (1000);
+  int64_t start_time = sim_time;
+  int64_t arrival_time = option_arrival_time * INT64_C (1000000);
+  int64_t real_start_time = get_real_time ();
+  int64_t worst_tick = 0, worst_timers = 0;
+  int64_t peak_people = 0;
+  int peak_connections = 0;
+  int n_players = 0;
+
+  /* Keep going until every player has joined and then the timers
+   * have freed all of the people.
+   */
+  while (n_players < option_n_players
+         || n_connected_players > 0
+         || vsx_metrics.gauges[VSX_METRICS_GAUGE_ACTIVE_PEOPLE] > 0)
+    {
+      sim_time += tick_time;
+
+      int64_t tick_start = get_real_time ();
+
+      vsx_main_context_dispatch_timers (NULL);
+
+      int64_t timers_end = get_real_time ();
+
+      /* Spread the arrivals evenly over the arrival time */
+      int64_t elapsed = sim_time - start_time;
+      int target_players = (elapsed >= arrival_time ?
+                            option_n_players :
+                            option_n_players * elapsed / arrival_time);
+
+      while (n_players < target_players)
+        add_player (n_players++);
+
+      while (!vsx_list_empty (&connected_players))
+        {
+          SimPlayer *player =
+            vsx_container_of (connected_players.next, SimPlayer, link);
+
+          if (player->leave_time > sim_time)
+            break;
+
+          remove_player (player);
+        }
+
+      flush_players ();
+
+      int64_t tick_end = get_real_time ();
+
+      if (tick_end - tick_start > worst_tick)
+        worst_tick = tick_end - tick_start;
+      if (timers_end - tick_start > worst_timers)
+        worst_timers = timers_end - tick_start;
+
+      if (vsx_metrics.gauges[VSX_METRICS_GAUGE_ACTIVE_PEOPLE] > peak_people)
+        peak_people = vsx_metrics.gauges[VSX_METRICS_GAUGE_ACTIVE_PEOPLE];
+      if (n_connected_players > peak_connections)
+        peak_connections = n_connected_players;
+    }
+
+  int64_t real_time = get_real_time () - real_start_time;
+
+  printf ("players:            %i\n"
+          "games created:      %" PRIu64 "\n"
+          "games abandoned:    %" PRIu64 "\n"
+          "peak people:        %" PRIi64 "\n"
+          "peak connections:   %i\n"
+          "simulated time:     %.1fs\n"
+          "real time:          %.3fs\n"
+          "peak memory:        %.1f MiB\n"
+          "worst loop stall:   %.3f ms\n"
+          "worst timer stall:  %.3f ms\n",
+          n_players,
+          vsx_metrics.counters[VSX_METRICS_COUNTER_GAMES_CREATED],
+          vsx_metrics.counters[VSX_METRICS_COUNTER_GAMES_ABANDONED],
+          peak_people,
+          peak_connections,
+          (sim_time - start_time) / 1e6,
+          real_time / 1e6,
+          get_peak_memory () / 1024.0,
+          worst_tick / 1e3,
+          worst_timers / 1e3);
+
+  vsx_object_unref (person_set);
+  vsx_object_unref (conversation_set);
+
+  vsx_main_context_free (vsx_main_context_get_default (NULL));
+
+  return EXIT_SUCCESS;
+}
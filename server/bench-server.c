@@ -0,0 +1,750 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Micro-benchmarks for the hot paths of the server. Each benchmark is
+ * run with an increasing number of iterations until it takes long
+ * enough to time reliably and then repeated a few times. The results
+ * are written to stdout as JSON so that they can be compared between
+ * releases.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "vsx-connection.h"
+#include "vsx-ws-parser.h"
+#include "vsx-hash-table.h"
+#include "vsx-main-context.h"
+#include "vsx-proto.h"
+#include "vsx-buffer.h"
+#include "vsx-util.h"
+
+/* Minimum time in nanoseconds that one repetition of a benchmark
+ * should take.
+ */
+#define MIN_TIME ((int64_t) 100000000)
+
+#define N_REPETITIONS 5
+
+/* Number of tiles to move before each drain of the output buffer */
+#define N_DIRTY_TILES 100
+
+/* Maximum number of entries to add to a hash table at once */
+#define HASH_TABLE_BATCH_SIZE 65536
+
+typedef struct
+{
+  const char *name;
+  /* Runs the benchmark n_iterations times and returns the time that
+   * it took in nanoseconds, not counting any setup.
+   */
+  int64_t (* func) (uint64_t n_iterations);
+  /* Number of bytes processed by each iteration, or zero if that
+   * isn’t meaningful.
+   */
+  size_t bytes_per_op;
+} Benchmark;
+
+typedef struct
+{
+  struct vsx_netaddress socket_address;
+  VsxConversationSet *conversation_set;
+  VsxPersonSet *person_set;
+  VsxConnection *conn;
+} Harness;
+
+/* A handshake as sent by a typical browser */
+static const char
+ws_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: gemelo.org:5144\r\n"
+  "Connection: Upgrade\r\n"
+  "Pragma: no-cache\r\n"
+  "Cache-Control: no-cache\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+  "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+  "Upgrade: websocket\r\n"
+  "Origin: https://gemelo.org\r\n"
+  "Sec-WebSocket-Version: 13\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Accept-Language: eo,en-GB;q=0.9,en;q=0.8,fr;q=0.7\r\n"
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+  "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+  "\r\n";
+
+static struct vsx_buffer
+frame_stream = VSX_BUFFER_STATIC_INIT;
+
+static int64_t
+get_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C (1000000000) + ts.tv_nsec;
+}
+
+static void
+append_frame (struct vsx_buffer *buf,
+              uint8_t first_byte,
+              const uint8_t *payload,
+              size_t payload_length)
+{
+  static const uint8_t mask[] = { 0x12, 0x34, 0x56, 0x78 };
+
+  /* All of the frames are small enough to fit in a short length */
+  vsx_buffer_append_c (buf, first_byte);
+  vsx_buffer_append_c (buf, 0x80 | payload_length);
+  vsx_buffer_append (buf, mask, sizeof mask);
+
+  for (size_t i = 0; i < payload_length; i++)
+    vsx_buffer_append_c (buf, payload[i] ^ mask[i % sizeof mask]);
+}
+
+static void
+append_command (struct vsx_buffer *buf,
+                int command,
+                ...)
+{
+  uint8_t frame[VSX_PROTO_MAX_PAYLOAD_SIZE
+                + VSX_PROTO_MAX_FRAME_HEADER_LENGTH];
+  va_list ap;
+
+  va_start (ap, command);
+  int length = vsx_proto_write_command_v (frame, sizeof frame, command, ap);
+  va_end (ap);
+
+  /* Skip the unmasked frame header from vsx_proto so that it can be
+   * rewritten as a masked frame like a real client would send.
+   */
+  int header_length = length - (frame[1] & 0x7f);
+
+  append_frame (buf, 0x82, frame + header_length, length - header_length);
+}
+
+static void
+drain_output (VsxConnection *conn)
+{
+  uint8_t buf[1024];
+
+  while (vsx_connection_fill_output_buffer (conn, buf, sizeof buf) > 0);
+}
+
+static void
+parse_or_abort (VsxConnection *conn,
+                const uint8_t *data,
+                size_t length)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (conn, data, length, &error))
+    {
+      fprintf (stderr, "Unexpected error: %s\n", error->message);
+      exit (EXIT_FAILURE);
+    }
+}
+
+static void
+parse_command (VsxConnection *conn,
+               int command,
+               ...)
+{
+  uint8_t frame[VSX_PROTO_MAX_PAYLOAD_SIZE
+                + VSX_PROTO_MAX_FRAME_HEADER_LENGTH];
+  va_list ap;
+
+  va_start (ap, command);
+  int length = vsx_proto_write_command_v (frame, sizeof frame, command, ap);
+  va_end (ap);
+
+  parse_or_abort (conn, frame, length);
+}
+
+/* Creates a connection that has finished the handshake, joined a
+ * game and turned over all of the tiles.
+ */
+static Harness *
+create_harness (void)
+{
+  Harness *harness = vsx_calloc (sizeof *harness);
+
+  vsx_netaddress_from_string (&harness->socket_address, "127.0.0.1", 5344);
+
+  harness->person_set = vsx_person_set_new ();
+  harness->conversation_set = vsx_conversation_set_new ();
+
+  harness->conn = vsx_connection_new (&harness->socket_address,
+                                      harness->conversation_set,
+                                      harness->person_set);
+
+  parse_or_abort (harness->conn,
+                  (const uint8_t *) ws_request,
+                  (sizeof ws_request) - 1);
+
+  parse_command (harness->conn,
+                 VSX_PROTO_NEW_PLAYER,
+                 VSX_PROTO_TYPE_STRING, "bench:eo",
+                 VSX_PROTO_TYPE_STRING, "Zamenhof",
+                 VSX_PROTO_TYPE_NONE);
+
+  parse_command (harness->conn,
+                 VSX_PROTO_SET_N_TILES,
+                 VSX_PROTO_TYPE_UINT8, (uint8_t) 255,
+                 VSX_PROTO_TYPE_NONE);
+
+  /* With only one player it is always our turn */
+  for (int i = 0; i < 255; i++)
+    {
+      parse_command (harness->conn,
+                     VSX_PROTO_TURN,
+                     VSX_PROTO_TYPE_NONE);
+      drain_output (harness->conn);
+    }
+
+  return harness;
+}
+
+static void
+free_harness (Harness *harness)
+{
+  vsx_connection_free (harness->conn);
+  vsx_object_unref (harness->conversation_set);
+  vsx_object_unref (harness->person_set);
+
+  vsx_free (harness);
+}
+
+static int64_t
+bench_ws_parser (uint64_t n_iterations)
+{
+  int64_t start = get_time ();
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      VsxWsParser *parser = vsx_ws_parser_new ();
+      size_t consumed;
+      struct vsx_error *error = NULL;
+
+      if (vsx_ws_parser_parse_data (parser,
+                                    (const uint8_t *) ws_request,
+                                    (sizeof ws_request) - 1,
+                                    &consumed,
+                                    &error)
+          != VSX_WS_PARSER_RESULT_FINISHED)
+        {
+          fprintf (stderr, "WebSocket handshake didn’t parse\n");
+          exit (EXIT_FAILURE);
+        }
+
+      size_t key_hash_size;
+      vsx_ws_parser_get_key_hash (parser, &key_hash_size);
+
+      vsx_ws_parser_free (parser);
+    }
+
+  return get_time () - start;
+}
+
+/* Same as above but the data arrives in small pieces like it might
+ * from a slow network.
+ */
+static int64_t
+bench_ws_parser_fragmented (uint64_t n_iterations)
+{
+  const size_t chunk_size = 37;
+  int64_t start = get_time ();
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      VsxWsParser *parser = vsx_ws_parser_new ();
+      const uint8_t *p = (const uint8_t *) ws_request;
+      size_t length = (sizeof ws_request) - 1;
+      VsxWsParserResult result;
+
+      do
+        {
+          size_t consumed;
+          struct vsx_error *error = NULL;
+          size_t to_parse = MIN (length, chunk_size);
+
+          result = vsx_ws_parser_parse_data (parser,
+                                             p,
+                                             to_parse,
+                                             &consumed,
+                                             &error);
+
+          if (result == VSX_WS_PARSER_RESULT_ERROR)
+            {
+              fprintf (stderr, "WebSocket handshake didn’t parse\n");
+              exit (EXIT_FAILURE);
+            }
+
+          p += to_parse;
+          length -= to_parse;
+        }
+      while (result == VSX_WS_PARSER_RESULT_NEED_MORE_DATA);
+
+      vsx_ws_parser_free (parser);
+    }
+
+  return get_time () - start;
+}
+
+static void
+init_frame_stream (void)
+{
+  static const uint8_t ping_data[] = "ping";
+
+  for (int i = 0; i < 8; i++)
+    {
+      append_command (&frame_stream,
+                      VSX_PROTO_START_TYPING,
+                      VSX_PROTO_TYPE_NONE);
+
+      /* Each tile is moved twice so that every repetition of the
+       * stream really changes the tile.
+       */
+      for (int j = 0; j < 2; j++)
+        {
+          append_command (&frame_stream,
+                          VSX_PROTO_MOVE_TILE,
+                          VSX_PROTO_TYPE_UINT8, (uint8_t) i,
+                          VSX_PROTO_TYPE_INT16, (int16_t) (i * 20 + j),
+                          VSX_PROTO_TYPE_INT16, (int16_t) (j * 20),
+                          VSX_PROTO_TYPE_NONE);
+        }
+
+      append_command (&frame_stream,
+                      VSX_PROTO_STOP_TYPING,
+                      VSX_PROTO_TYPE_NONE);
+
+      append_frame (&frame_stream,
+                    0x89,
+                    ping_data,
+                    (sizeof ping_data) - 1);
+
+      append_command (&frame_stream,
+                      VSX_PROTO_KEEP_ALIVE,
+                      VSX_PROTO_TYPE_NONE);
+
+      /* A move command split into a fragmented message */
+      static const uint8_t move_start[] = { VSX_PROTO_MOVE_TILE, 9, 1 };
+      static const uint8_t move_end[] = { 0, 2, 0 };
+
+      append_frame (&frame_stream, 0x02, move_start, sizeof move_start);
+      append_frame (&frame_stream, 0x80, move_end, sizeof move_end);
+    }
+}
+
+static int64_t
+bench_process_frames (uint64_t n_iterations)
+{
+  Harness *harness = create_harness ();
+
+  int64_t start = get_time ();
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      parse_or_abort (harness->conn,
+                      frame_stream.data,
+                      frame_stream.length);
+    }
+
+  int64_t end = get_time ();
+
+  free_harness (harness);
+
+  return end - start;
+}
+
+static int64_t
+bench_fill_output_buffer (uint64_t n_iterations)
+{
+  Harness *harness = create_harness ();
+  struct vsx_buffer moves = VSX_BUFFER_STATIC_INIT;
+  int64_t total = 0;
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      vsx_buffer_set_length (&moves, 0);
+
+      for (int tile = 0; tile < N_DIRTY_TILES; tile++)
+        {
+          append_command (&moves,
+                          VSX_PROTO_MOVE_TILE,
+                          VSX_PROTO_TYPE_UINT8, (uint8_t) tile,
+                          VSX_PROTO_TYPE_INT16, (int16_t) (i & 0xff),
+                          VSX_PROTO_TYPE_INT16, (int16_t) tile,
+                          VSX_PROTO_TYPE_NONE);
+        }
+
+      parse_or_abort (harness->conn, moves.data, moves.length);
+
+      int64_t start = get_time ();
+
+      drain_output (harness->conn);
+
+      total += get_time () - start;
+    }
+
+  vsx_buffer_destroy (&moves);
+
+  free_harness (harness);
+
+  return total;
+}
+
+static struct vsx_hash_table_entry *
+create_entries (uint64_t n_entries)
+{
+  struct vsx_hash_table_entry *entries =
+    vsx_alloc (n_entries * sizeof *entries);
+
+  for (uint64_t i = 0; i < n_entries; i++)
+    {
+      /* Spread the IDs out like the random person IDs would be */
+      entries[i].id = i * UINT64_C (0x9e3779b97f4a7c15);
+    }
+
+  return entries;
+}
+
+static int64_t
+bench_hash_table_add (uint64_t n_iterations)
+{
+  struct vsx_hash_table_entry *entries =
+    create_entries (HASH_TABLE_BATCH_SIZE);
+  int64_t total = 0;
+
+  /* The entries are added in batches to a fresh table so that the
+   * memory used doesn’t depend on the number of iterations.
+   */
+  for (uint64_t done = 0; done < n_iterations; done += HASH_TABLE_BATCH_SIZE)
+    {
+      uint64_t batch_size = MIN (n_iterations - done, HASH_TABLE_BATCH_SIZE);
+      struct vsx_hash_table hash_table;
+
+      vsx_hash_table_init (&hash_table);
+
+      int64_t start = get_time ();
+
+      for (uint64_t i = 0; i < batch_size; i++)
+        vsx_hash_table_add (&hash_table, entries + i);
+
+      total += get_time () - start;
+
+      vsx_hash_table_destroy (&hash_table);
+    }
+
+  vsx_free (entries);
+
+  return total;
+}
+
+static int64_t
+bench_hash_table_get (uint64_t n_iterations)
+{
+  /* Look up entries from a table that is about the size of a busy
+   * server’s person set.
+   */
+  const uint64_t n_entries = 10000;
+  struct vsx_hash_table_entry *entries = create_entries (n_entries);
+  struct vsx_hash_table hash_table;
+
+  vsx_hash_table_init (&hash_table);
+
+  for (uint64_t i = 0; i < n_entries; i++)
+    vsx_hash_table_add (&hash_table, entries + i);
+
+  uint64_t n_found = 0;
+
+  int64_t start = get_time ();
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      /* Every other lookup is for an ID that isn’t in the table */
+      uint64_t id = (i % (n_entries * 2)) * UINT64_C (0x9e3779b97f4a7c15);
+
+      if (i & 1)
+        id ^= 1;
+
+      if (vsx_hash_table_get (&hash_table, id))
+        n_found++;
+    }
+
+  int64_t end = get_time ();
+
+  if (n_found == 0)
+    {
+      fprintf (stderr, "No entries found in the hash table\n");
+      exit (EXIT_FAILURE);
+    }
+
+  vsx_hash_table_destroy (&hash_table);
+  vsx_free (entries);
+
+  return end - start;
+}
+
+static int64_t
+bench_hash_table_remove (uint64_t n_iterations)
+{
+  struct vsx_hash_table_entry *entries =
+    create_entries (HASH_TABLE_BATCH_SIZE);
+  int64_t total = 0;
+
+  for (uint64_t done = 0; done < n_iterations; done += HASH_TABLE_BATCH_SIZE)
+    {
+      uint64_t batch_size = MIN (n_iterations - done, HASH_TABLE_BATCH_SIZE);
+      struct vsx_hash_table hash_table;
+
+      vsx_hash_table_init (&hash_table);
+
+      for (uint64_t i = 0; i < batch_size; i++)
+        vsx_hash_table_add (&hash_table, entries + i);
+
+      int64_t start = get_time ();
+
+      for (uint64_t i = 0; i < batch_size; i++)
+        vsx_hash_table_remove (&hash_table, entries + i);
+
+      total += get_time () - start;
+
+      vsx_hash_table_destroy (&hash_table);
+    }
+
+  vsx_free (entries);
+
+  return total;
+}
+
+static int64_t
+bench_read_payload (uint64_t n_iterations)
+{
+  uint8_t frame[VSX_PROTO_MAX_PAYLOAD_SIZE
+                + VSX_PROTO_MAX_FRAME_HEADER_LENGTH];
+
+  /* A tile command is the most common one the server sends */
+  int length = vsx_proto_write_command (frame,
+                                        sizeof frame,
+                                        VSX_PROTO_TILE,
+                                        VSX_PROTO_TYPE_UINT8, (uint8_t) 42,
+                                        VSX_PROTO_TYPE_INT16, (int16_t) 300,
+                                        VSX_PROTO_TYPE_INT16, (int16_t) -20,
+                                        VSX_PROTO_TYPE_STRING, "ĉ",
+                                        VSX_PROTO_TYPE_UINT8, (uint8_t) 3,
+                                        VSX_PROTO_TYPE_NONE);
+  const uint8_t *payload = frame + 2;
+  size_t payload_length = length - 2;
+  unsigned int sum = 0;
+
+  int64_t start = get_time ();
+
+  for (uint64_t i = 0; i < n_iterations; i++)
+    {
+      uint8_t num, player;
+      int16_t x, y;
+      const char *letter;
+
+      if (!vsx_proto_read_payload (payload + 1,
+                                   payload_length - 1,
+
+                                   VSX_PROTO_TYPE_UINT8,
+                                   &num,
+
+                                   VSX_PROTO_TYPE_INT16,
+                                   &x,
+
+                                   VSX_PROTO_TYPE_INT16,
+                                   &y,
+
+                                   VSX_PROTO_TYPE_STRING,
+                                   &letter,
+
+                                   VSX_PROTO_TYPE_UINT8,
+                                   &player,
+
+                                   VSX_PROTO_TYPE_NONE))
+        {
+          fprintf (stderr, "Failed to read payload\n");
+          exit (EXIT_FAILURE);
+        }
+
+      sum += num + x + y + player + *letter;
+    }
+
+  int64_t end = get_time ();
+
+  /* Make sure the compiler can’t throw the results away */
+  if (sum == 0)
+    fputc ('\n', stderr);
+
+  return end - start;
+}
+
+static const Benchmark
+benchmarks[] =
+  {
+    { "ws_parser_handshake", bench_ws_parser, (sizeof ws_request) - 1 },
+    {
+      "ws_parser_handshake_fragmented",
+      bench_ws_parser_fragmented,
+      (sizeof ws_request) - 1,
+    },
+    /* bytes_per_op is filled in from the frame stream */
+    { "process_frames", bench_process_frames, 0 },
+    { "fill_output_buffer", bench_fill_output_buffer, 0 },
+    { "hash_table_add", bench_hash_table_add, 0 },
+    { "hash_table_get", bench_hash_table_get, 0 },
+    { "hash_table_remove", bench_hash_table_remove, 0 },
+    { "proto_read_payload", bench_read_payload, 0 },
+  };
+
+static int
+compare_int64 (const void *a, const void *b)
+{
+  int64_t va = *(const int64_t *) a;
+  int64_t vb = *(const int64_t *) b;
+
+  return (va > vb) - (va < vb);
+}
+
+static void
+run_benchmark (const Benchmark *benchmark,
+               bool first)
+{
+  uint64_t n_iterations = 1;
+  int64_t elapsed;
+
+  /* Keep increasing the number of iterations until it takes long
+   * enough to be measured reliably.
+   */
+  while (true)
+    {
+      elapsed = benchmark->func (n_iterations);
+
+      if (elapsed >= MIN_TIME)
+        break;
+
+      uint64_t next = (elapsed <= 0
+                       ? n_iterations * 100
+                       : n_iterations * MIN_TIME * 5 / 4 / elapsed);
+
+      n_iterations = MAX (next, n_iterations * 2);
+    }
+
+  int64_t times[N_REPETITIONS];
+
+  times[0] = elapsed;
+
+  for (int i = 1; i < N_REPETITIONS; i++)
+    times[i] = benchmark->func (n_iterations);
+
+  qsort (times, N_REPETITIONS, sizeof times[0], compare_int64);
+
+  size_t bytes_per_op = benchmark->bytes_per_op;
+
+  if (benchmark->func == bench_process_frames)
+    bytes_per_op = frame_stream.length;
+
+  printf ("%s\n"
+          "    {\n"
+          "      \"name\": \"%s\",\n"
+          "      \"iterations\": %" PRIu64 ",\n"
+          "      \"repetitions\": %i,\n"
+          "      \"ns_per_op\": %.3f,\n"
+          "      \"min_ns_per_op\": %.3f,\n"
+          "      \"max_ns_per_op\": %.3f",
+          first ? "" : ",",
+          benchmark->name,
+          n_iterations,
+          N_REPETITIONS,
+          times[N_REPETITIONS / 2] / (double) n_iterations,
+          times[0] / (double) n_iterations,
+          times[N_REPETITIONS - 1] / (double) n_iterations);
+
+  if (bytes_per_op > 0)
+    {
+      printf (",\n"
+              "      \"bytes_per_op\": %zu,\n"
+              "      \"mb_per_second\": %.3f",
+              bytes_per_op,
+              bytes_per_op * n_iterations * 1e3
+              / times[N_REPETITIONS / 2]);
+    }
+
+  fputs ("\n    }", stdout);
+  fflush (stdout);
+}
+
+static bool
+should_run (const Benchmark *benchmark,
+            int argc,
+            char **argv)
+{
+  /* With no arguments everything is run. Otherwise each argument is
+   * a substring of the names of the benchmarks to run.
+   */
+  if (argc <= 1)
+    return true;
+
+  for (int i = 1; i < argc; i++)
+    {
+      if (strstr (benchmark->name, argv[i]))
+        return true;
+    }
+
+  return false;
+}
+
+int
+main (int argc, char **argv)
+{
+  init_frame_stream ();
+
+  printf ("{\n"
+          "  \"version\": \"%s\",\n"
+          "  \"benchmarks\": [",
+          PACKAGE_VERSION);
+
+  bool first = true;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (benchmarks); i++)
+    {
+      if (!should_run (benchmarks + i, argc, argv))
+        continue;
+
+      run_benchmark (benchmarks + i, first);
+      first = false;
+    }
+
+  fputs ("\n  ]\n}\n", stdout);
+
+  vsx_buffer_destroy (&frame_stream);
+
+  vsx_main_context_free (vsx_main_context_get_default (NULL /* error */));
+
+  return EXIT_SUCCESS;
+}
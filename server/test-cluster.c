@@ -0,0 +1,249 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "vsx-cluster.h"
+#include "vsx-generate-id.h"
+#include "vsx-util.h"
+
+#define N_IDS 100000
+
+/* Simple generator so that the test is repeatable */
+static uint64_t
+next_id (uint64_t *state)
+{
+  *state = *state * UINT64_C (6364136223846793005) + 1442695040888963407;
+
+  return *state;
+}
+
+static bool
+test_deterministic (void)
+{
+  VsxCluster *a = vsx_cluster_new (5);
+  VsxCluster *b = vsx_cluster_new (5);
+  uint64_t state = 1;
+  bool ret = true;
+
+  for (int i = 0; i < N_IDS; i++)
+    {
+      uint64_t id = next_id (&state);
+      int node = vsx_cluster_get_node_for_id (a, id);
+
+      if (node < 0 || node >= 5)
+        {
+          fprintf (stderr, "Node %i is out of range\n", node);
+          ret = false;
+          break;
+        }
+
+      if (node != vsx_cluster_get_node_for_id (b, id))
+        {
+          fprintf (stderr,
+                   "ID %" PRIx64 " mapped to different nodes\n",
+                   id);
+          ret = false;
+          break;
+        }
+    }
+
+  if (vsx_cluster_get_node_for_name (a, "eo:default")
+      != vsx_cluster_get_node_for_name (b, "eo:default"))
+    {
+      fprintf (stderr, "Room name mapped to different nodes\n");
+      ret = false;
+    }
+
+  vsx_cluster_free (b);
+  vsx_cluster_free (a);
+
+  return ret;
+}
+
+static bool
+test_single_node (void)
+{
+  VsxCluster *cluster = vsx_cluster_new (1);
+  uint64_t state = 2;
+  bool ret = true;
+
+  for (int i = 0; i < 1000; i++)
+    {
+      if (vsx_cluster_get_node_for_id (cluster, next_id (&state)) != 0)
+        {
+          fprintf (stderr, "ID didn’t map to the only node\n");
+          ret = false;
+          break;
+        }
+    }
+
+  vsx_cluster_free (cluster);
+
+  return ret;
+}
+
+static bool
+test_distribution (void)
+{
+  const int n_nodes = 4;
+  VsxCluster *cluster = vsx_cluster_new (n_nodes);
+  int counts[n_nodes];
+  uint64_t state = 3;
+  bool ret = true;
+
+  for (int i = 0; i < n_nodes; i++)
+    counts[i] = 0;
+
+  for (int i = 0; i < N_IDS; i++)
+    counts[vsx_cluster_get_node_for_id (cluster, next_id (&state))]++;
+
+  /* Each node should get roughly its share */
+  for (int i = 0; i < n_nodes; i++)
+    {
+      if (counts[i] < N_IDS / n_nodes / 2
+          || counts[i] > N_IDS / n_nodes * 3 / 2)
+        {
+          fprintf (stderr,
+                   "Node %i got %i of %i IDs\n",
+                   i,
+                   counts[i],
+                   N_IDS);
+          ret = false;
+        }
+    }
+
+  vsx_cluster_free (cluster);
+
+  return ret;
+}
+
+static bool
+test_add_node (void)
+{
+  VsxCluster *before = vsx_cluster_new (4);
+  VsxCluster *after = vsx_cluster_new (5);
+  uint64_t state = 4;
+  int n_moved = 0;
+  bool ret = true;
+
+  for (int i = 0; i < N_IDS; i++)
+    {
+      uint64_t id = next_id (&state);
+      int old_node = vsx_cluster_get_node_for_id (before, id);
+      int new_node = vsx_cluster_get_node_for_id (after, id);
+
+      if (old_node == new_node)
+        continue;
+
+      /* IDs should only ever move to the new node */
+      if (new_node != 4)
+        {
+          fprintf (stderr,
+                   "ID moved from node %i to node %i\n",
+                   old_node,
+                   new_node);
+          ret = false;
+          break;
+        }
+
+      n_moved++;
+    }
+
+  /* Roughly a fifth of the IDs should move */
+  if (n_moved < N_IDS / 10 || n_moved > N_IDS * 3 / 10)
+    {
+      fprintf (stderr,
+               "%i of %i IDs moved when adding a node\n",
+               n_moved,
+               N_IDS);
+      ret = false;
+    }
+
+  vsx_cluster_free (after);
+  vsx_cluster_free (before);
+
+  return ret;
+}
+
+static bool
+node_filter (uint64_t id,
+             void *user_data)
+{
+  VsxCluster *cluster = user_data;
+
+  return vsx_cluster_get_node_for_id (cluster, id) == 2;
+}
+
+static bool
+test_filter (void)
+{
+  VsxCluster *cluster = vsx_cluster_new (3);
+  struct vsx_netaddress address = { .family = AF_INET, .port = 5144 };
+  bool ret = true;
+
+  vsx_generate_id_set_filter (node_filter, cluster);
+
+  for (int i = 0; i < 100; i++)
+    {
+      uint64_t id = vsx_generate_id (&address);
+
+      if (vsx_cluster_get_node_for_id (cluster, id) != 2)
+        {
+          fprintf (stderr,
+                   "Generated ID %" PRIx64 " doesn’t map to node 2\n",
+                   id);
+          ret = false;
+          break;
+        }
+    }
+
+  vsx_generate_id_set_filter (NULL, NULL);
+
+  vsx_cluster_free (cluster);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (!test_deterministic ())
+    ret = EXIT_FAILURE;
+
+  if (!test_single_node ())
+    ret = EXIT_FAILURE;
+
+  if (!test_distribution ())
+    ret = EXIT_FAILURE;
+
+  if (!test_add_node ())
+    ret = EXIT_FAILURE;
+
+  if (!test_filter ())
+    ret = EXIT_FAILURE;
+
+  return ret;
+}
@@ -23,8 +23,12 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <string.h>
+#include <zlib.h>
 
 #include "vsx-connection.h"
+#include "vsx-conversation.h"
+#include "vsx-main-context.h"
+#include "vsx-metrics.h"
 #include "vsx-proto.h"
 #include "vsx-buffer.h"
 #include "vsx-util.h"
@@ -51,6 +55,42 @@ ws_reply[] =
   "Sec-WebSocket-Accept: p4PX7Zjj5DyJVCBrt49wxR4RyoQ=\r\n"
   "\r\n";
 
+static char
+ws_v2_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Sec-WebSocket-Key: potato\r\n"
+  "Sec-WebSocket-Protocol: chat, " VSX_PROTO_V2_NAME "\r\n"
+  "\r\n";
+
+static char
+ws_v2_reply[] =
+  "HTTP/1.1 101 Switching Protocols\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Accept: p4PX7Zjj5DyJVCBrt49wxR4RyoQ=\r\n"
+  "Sec-WebSocket-Protocol: " VSX_PROTO_V2_NAME "\r\n"
+  "\r\n";
+
+/* The first offer can’t be accepted because zlib can’t compress with
+ * a window of 8 bits.
+ */
+static char
+ws_deflate_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Sec-WebSocket-Key: potato\r\n"
+  "Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=8, "
+  "permessage-deflate; client_max_window_bits\r\n"
+  "\r\n";
+
+static char
+ws_deflate_reply[] =
+  "HTTP/1.1 101 Switching Protocols\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Accept: p4PX7Zjj5DyJVCBrt49wxR4RyoQ=\r\n"
+  "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=10\r\n"
+  "\r\n";
+
 typedef struct
 {
   const char *frame;
@@ -1701,6 +1741,131 @@ test_typing (void)
   return ret;
 }
 
+static int64_t
+test_clock_time;
+
+static int64_t
+test_clock (void *user_data)
+{
+  return test_clock_time;
+}
+
+static bool
+send_typing_command (Harness *harness,
+                     uint8_t command)
+{
+  struct vsx_error *error = NULL;
+  uint8_t buf[] = { 0x82, 0x1, command };
+
+  if (!vsx_connection_parse_data (harness->conn, buf, sizeof buf, &error))
+    {
+      fprintf (stderr,
+               "Unexpected error sending typing command: %s\n",
+               error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_rate_limit (Harness *harness,
+                  VsxPerson *person)
+{
+  uint64_t n_limited_before =
+    vsx_metrics.counters[VSX_METRICS_COUNTER_COMMANDS_RATE_LIMITED];
+
+  /* The burst allows three commands at once */
+  if (!send_typing_command (harness, VSX_PROTO_START_TYPING)
+      || !send_typing_command (harness, VSX_PROTO_START_TYPING)
+      || !send_typing_command (harness, VSX_PROTO_START_TYPING))
+    return false;
+
+  /* Stopping is never limited so that the flag can’t get stuck */
+  if (!send_typing_command (harness, VSX_PROTO_STOP_TYPING))
+    return false;
+
+  if ((person->player->flags & VSX_PLAYER_TYPING))
+    {
+      fprintf (stderr, "STOP_TYPING was rate limited\n");
+      return false;
+    }
+
+  /* The fourth START_TYPING should be dropped */
+  if (!send_typing_command (harness, VSX_PROTO_START_TYPING))
+    return false;
+
+  if ((person->player->flags & VSX_PLAYER_TYPING))
+    {
+      fprintf (stderr, "Command over the rate limit was not dropped\n");
+      return false;
+    }
+
+  if (vsx_metrics.counters[VSX_METRICS_COUNTER_COMMANDS_RATE_LIMITED]
+      != n_limited_before + 1)
+    {
+      fprintf (stderr, "Rate limited command was not counted\n");
+      return false;
+    }
+
+  /* After one interval there should be space for one more command */
+  test_clock_time += 100000;
+
+  if (!send_typing_command (harness, VSX_PROTO_START_TYPING))
+    return false;
+
+  if (!(person->player->flags & VSX_PLAYER_TYPING))
+    {
+      fprintf (stderr, "Command wasn’t allowed after waiting\n");
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+test_rate_limit (void)
+{
+  Harness *harness = create_negotiated_harness ();
+
+  if (harness == NULL)
+    return false;
+
+  VsxConnectionRateLimit limits[VSX_CONNECTION_N_RATE_CLASSES] =
+    {
+      [VSX_CONNECTION_RATE_CLASS_TYPING] = { .rate = 10, .burst = 3 },
+    };
+
+  vsx_connection_set_rate_limits (harness->conn, limits);
+
+  test_clock_time = 1000000;
+  vsx_main_context_set_clock (NULL, test_clock, NULL);
+
+  VsxPerson *person;
+  bool ret = true;
+
+  if (!create_player (harness,
+                      "default:eo", "Zamenhof",
+                      &person))
+    {
+      ret = false;
+    }
+  else
+    {
+      if (!check_rate_limit (harness, person))
+        ret = false;
+
+      vsx_object_unref (person);
+    }
+
+  free_harness (harness);
+
+  vsx_main_context_set_clock (NULL, NULL, NULL);
+
+  return ret;
+}
+
 static bool
 read_tile (VsxConnection *conn,
            int *tile_num_out,
@@ -1939,38 +2104,41 @@ test_turn_and_move (void)
 }
 
 static bool
-test_got_shout (Harness *harness, int shout_player)
+send_move_command (Harness *harness,
+                   int x,
+                   int y)
 {
-  uint8_t buf[1 + 1 + 1 + 1];
-
-  size_t got = vsx_connection_fill_output_buffer (harness->conn,
-                                                  buf,
-                                                  sizeof buf);
+  struct vsx_error *error = NULL;
+  uint8_t buf[] = { 0x82, 0x6, 0x88, 0x0, x, 0x00, y, 0x00 };
 
-  if (got != sizeof buf)
+  if (!vsx_connection_parse_data (harness->conn, buf, sizeof buf, &error))
     {
       fprintf (stderr,
-               "Only got %zu bytes out of %zu "
-               "when trying to read the shout\n",
-               got,
-               sizeof buf);
+               "Unexpected error after move command: %s\n",
+               error->message);
+      vsx_error_free (error);
       return false;
     }
 
-  if (buf[2] != VSX_PROTO_PLAYER_SHOUTED)
-    {
-      fprintf (stderr,
-               "Expected PLAYER_SHOUTED command but received 0x%02x\n",
-               buf[2]);
-      return false;
-    }
+  return true;
+}
 
-  if (buf[3] != shout_player)
+static bool
+check_tile_position (VsxConnection *conn,
+                     int expected_x,
+                     int expected_y)
+{
+  int tile_x, tile_y;
+
+  if (!read_tile (conn, NULL, &tile_x, &tile_y, NULL))
+    return false;
+
+  if (tile_x != expected_x || tile_y != expected_y)
     {
       fprintf (stderr,
-               "test_got_shout: Expected %i but received %i\n",
-               shout_player,
-               buf[3]);
+               "Expected tile at %i,%i but the connection reported %i,%i\n",
+               expected_x, expected_y,
+               tile_x, tile_y);
       return false;
     }
 
@@ -1978,112 +2146,113 @@ test_got_shout (Harness *harness, int shout_player)
 }
 
 static bool
-test_shout (void)
+check_nothing_to_write (VsxConnection *conn)
 {
-  Harness *harness = create_negotiated_harness ();
-
-  if (harness == NULL)
-    return false;
-
-  VsxPerson *person;
-  bool ret = true;
+  uint8_t buf[64];
+  size_t got = vsx_connection_fill_output_buffer (conn, buf, sizeof buf);
 
-  if (!create_player (harness,
-                      "default:eo", "Zamenhof",
-                      &person))
-    {
-      ret = false;
-    }
-  else
+  if (got != 0)
     {
-      struct vsx_error *error = NULL;
-
-      if (!vsx_connection_parse_data (harness->conn,
-                                      (uint8_t *) "\x82\x1\x8a",
-                                      3,
-                                      &error))
-        {
-          fprintf (stderr,
-                   "test_shout: Unexpected error: %s\n",
-                   error->message);
-          vsx_error_free (error);
-          ret = false;
-        }
-      else if (person->conversation->last_shout_time == 0)
-        {
-          fprintf (stderr,
-                   "test_shout: last_shout_time is still zero after shouting");
-          ret = false;
-        }
-      else if (!test_got_shout (harness, 0 /* shout_player */))
-        ret = false;
-
-      vsx_object_unref (person);
+      fprintf (stderr,
+               "Expected no pending data but the connection wrote %zu "
+               "bytes\n",
+               got);
+      return false;
     }
 
-  free_harness (harness);
-
-  return ret;
+  return true;
 }
 
 static bool
-check_set_n_tiles (Harness *harness, VsxPerson *person, int n_tiles)
+check_broadcast_tick (Harness *harness)
 {
   struct vsx_error *error = NULL;
 
-  uint8_t command[] =
-    {
-      0x82, 0x02, 0x8b, n_tiles,
-    };
-
   if (!vsx_connection_parse_data (harness->conn,
-                                  command, sizeof command,
+                                  (uint8_t *) "\x82\x1\x89",
+                                  3,
                                   &error))
     {
       fprintf (stderr,
-               "test_set_n_tiles: Unexpected error: %s\n",
+               "Unexpected error after turn command: %s\n",
                error->message);
       vsx_error_free (error);
       return false;
     }
 
-  if (person->conversation->total_n_tiles != n_tiles)
+  /* Turning a tile isn’t held back */
+  if (!read_player (harness->conn,
+                    0, /* expected_player_num */
+                    VSX_PLAYER_CONNECTED | VSX_PLAYER_NEXT_TURN)
+      || !read_tile (harness->conn, NULL, NULL, NULL, NULL))
+    return false;
+
+  /* The first move is sent straight away */
+  if (!send_move_command (harness, 1, 1)
+      || !check_tile_position (harness->conn, 1, 1)
+      || !read_sync (harness->conn))
+    return false;
+
+  uint64_t n_coalesced_before =
+    vsx_metrics.counters[VSX_METRICS_COUNTER_CHANGES_COALESCED];
+
+  /* The next moves within the interval are held back and merged */
+  if (!send_move_command (harness, 2, 2)
+      || !send_move_command (harness, 3, 3)
+      || !check_nothing_to_write (harness->conn))
+    return false;
+
+  if (vsx_metrics.counters[VSX_METRICS_COUNTER_CHANGES_COALESCED]
+      != n_coalesced_before + 1)
     {
-      fprintf (stderr,
-               "test_set_n_tiles: failed to set total_n_tiles.\n"
-               " Expected: %i\n"
-               " Received: %i\n",
-               n_tiles,
-               person->conversation->total_n_tiles);
+      fprintf (stderr, "Merged tile move was not counted\n");
       return false;
     }
 
-  uint8_t got_n_tiles;
+  int64_t next_time = vsx_conversation_flush_broadcasts ();
 
-  if (!read_n_tiles (harness->conn, &got_n_tiles))
+  if (next_time != test_clock_time + 100000)
+    {
+      fprintf (stderr,
+               "Expected the next broadcast at %" PRIi64 " but got "
+               "%" PRIi64 "\n",
+               test_clock_time + 100000,
+               next_time);
+      return false;
+    }
+
+  if (!check_nothing_to_write (harness->conn))
     return false;
 
-  if (got_n_tiles != n_tiles)
+  test_clock_time = next_time;
+
+  if (vsx_conversation_flush_broadcasts () != INT64_MAX)
     {
-      fprintf (stderr,
-               "test_set_n_tiles: After sending set_n_tiles %i, the "
-               "connection reported %i tiles\n",
-               n_tiles,
-               got_n_tiles);
+      fprintf (stderr, "Broadcast still pending after flushing\n");
       return false;
     }
 
+  /* Only the final position is sent */
+  if (!check_tile_position (harness->conn, 3, 3)
+      || !check_nothing_to_write (harness->conn))
+    return false;
+
   return true;
 }
 
 static bool
-test_set_n_tiles (void)
+test_broadcast_tick (void)
 {
   Harness *harness = create_negotiated_harness ();
 
   if (harness == NULL)
     return false;
 
+  /* Start after the shout time so that turns are allowed */
+  test_clock_time = VSX_CONVERSATION_SHOUT_TIME * 2;
+  vsx_main_context_set_clock (NULL, test_clock, NULL);
+  vsx_conversation_set_global_broadcast_interval (100000);
+
   VsxPerson *person;
   bool ret = true;
 
@@ -2095,7 +2264,7 @@ test_set_n_tiles (void)
     }
   else
     {
-      if (!check_set_n_tiles (harness, person, 5))
+      if (!check_broadcast_tick (harness))
         ret = false;
 
       vsx_object_unref (person);
@@ -2103,35 +2272,949 @@ test_set_n_tiles (void)
 
   free_harness (harness);
 
+  vsx_conversation_set_global_broadcast_interval (0);
+  vsx_main_context_set_clock (NULL, NULL, NULL);
+
   return ret;
 }
 
 static bool
-test_set_language (void)
+check_conversation_tile (VsxPerson *person,
+                         int expected_x,
+                         int expected_y)
 {
-  Harness *harness = create_negotiated_harness ();
-
-  if (harness == NULL)
-    return false;
-
-  VsxPerson *person;
-  bool ret = true;
+  const VsxTile *tile = person->conversation->tiles + 0;
 
-  if (!create_player (harness,
-                      "default:eo", "Zamenhof",
-                      &person))
+  if (tile->x != expected_x || tile->y != expected_y)
     {
-      ret = false;
+      fprintf (stderr,
+               "Expected tile at %i,%i but it is at %i,%i\n",
+               expected_x, expected_y,
+               tile->x, tile->y);
+      return false;
     }
-  else
-    {
-      struct vsx_error *error = NULL;
 
-      if (!vsx_connection_parse_data (harness->conn,
-                                      (uint8_t *) "\x82\x4\x8e" "en\x0",
-                                      6,
-                                      &error))
-        {
+  return true;
+}
+
+static bool
+apply_deferred_moves (Harness *harness)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_apply_deferred_moves (harness->conn, &error))
+    {
+      fprintf (stderr,
+               "Unexpected error applying deferred moves: %s\n",
+               error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_deferred_move_time (Harness *harness,
+                          int64_t expected_time)
+{
+  int64_t time = vsx_connection_get_deferred_move_time (harness->conn);
+
+  if (time != expected_time)
+    {
+      fprintf (stderr,
+               "Expected deferred moves at %" PRIi64 " but got "
+               "%" PRIi64 "\n",
+               expected_time,
+               time);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_deferred_moves (Harness *harness,
+                      VsxPerson *person)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (harness->conn,
+                                  (uint8_t *) "\x82\x1\x89",
+                                  3,
+                                  &error))
+    {
+      fprintf (stderr,
+               "Unexpected error after turn command: %s\n",
+               error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  /* The burst allows two moves at once */
+  if (!send_move_command (harness, 1, 1)
+      || !send_move_command (harness, 2, 2)
+      || !check_deferred_move_time (harness, INT64_MAX))
+    return false;
+
+  /* The next moves are held back and only the last one is kept */
+  if (!send_move_command (harness, 3, 3)
+      || !send_move_command (harness, 4, 4)
+      || !check_conversation_tile (person, 2, 2)
+      || !check_deferred_move_time (harness, test_clock_time + 100000))
+    return false;
+
+  /* Nothing happens until the bucket has refilled */
+  if (!apply_deferred_moves (harness)
+      || !check_conversation_tile (person, 2, 2))
+    return false;
+
+  test_clock_time += 100000;
+
+  if (!apply_deferred_moves (harness)
+      || !check_conversation_tile (person, 4, 4)
+      || !check_deferred_move_time (harness, INT64_MAX))
+    return false;
+
+  /* A held back move is forgotten if a newer one gets through */
+  if (!send_move_command (harness, 5, 5)
+      || !check_deferred_move_time (harness, test_clock_time + 100000))
+    return false;
+
+  test_clock_time += 100000;
+
+  if (!send_move_command (harness, 6, 6)
+      || !check_conversation_tile (person, 6, 6)
+      || !check_deferred_move_time (harness, INT64_MAX))
+    return false;
+
+  return true;
+}
+
+static bool
+test_deferred_moves (void)
+{
+  Harness *harness = create_negotiated_harness ();
+
+  if (harness == NULL)
+    return false;
+
+  VsxConnectionRateLimit limits[VSX_CONNECTION_N_RATE_CLASSES] =
+    {
+      [VSX_CONNECTION_RATE_CLASS_MOVE_TILE] = { .rate = 10, .burst = 2 },
+    };
+
+  vsx_connection_set_rate_limits (harness->conn, limits);
+
+  /* Start after the shout time so that turns are allowed */
+  test_clock_time = VSX_CONVERSATION_SHOUT_TIME * 2;
+  vsx_main_context_set_clock (NULL, test_clock, NULL);
+
+  VsxPerson *person;
+  bool ret = true;
+
+  if (!create_player (harness,
+                      "default:eo", "Zamenhof",
+                      &person))
+    {
+      ret = false;
+    }
+  else
+    {
+      if (!check_deferred_moves (harness, person))
+        ret = false;
+
+      vsx_object_unref (person);
+    }
+
+  free_harness (harness);
+
+  vsx_main_context_set_clock (NULL, NULL, NULL);
+
+  return ret;
+}
+
+static bool
+send_data (VsxConnection *conn,
+           const uint8_t *data,
+           size_t length)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (conn, data, length, &error))
+    {
+      fprintf (stderr,
+               "Unexpected error while sending data: %s\n",
+               error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  return true;
+}
+
+/* Reads a single frame from the connection and checks that it
+ * contains exactly the expected packed commands. If find_command is
+ * in the frame then its payload is returned.
+ */
+static bool
+read_packed_frame (VsxConnection *conn,
+                   uint8_t *buf,
+                   size_t buf_size,
+                   const uint8_t *expected_commands,
+                   size_t n_expected_commands,
+                   uint8_t find_command,
+                   const uint8_t **payload_out,
+                   size_t *payload_length_out)
+{
+  size_t got = vsx_connection_fill_output_buffer (conn, buf, buf_size);
+
+  if (got < 2 || buf[0] != 0x82 || buf[1] >= 126)
+    {
+      fprintf (stderr, "Expected a short binary frame\n");
+      return false;
+    }
+
+  if (got != buf[1] + 2)
+    {
+      fprintf (stderr,
+               "Expected %i bytes of packed frame but received %zu\n",
+               buf[1] + 2,
+               got);
+      return false;
+    }
+
+  const uint8_t *data = buf + 2;
+  size_t length = buf[1];
+
+  for (size_t i = 0; i < n_expected_commands; i++)
+    {
+      const uint8_t *payload;
+      size_t payload_length;
+
+      if (!vsx_proto_read_packed_command (&data,
+                                          &length,
+                                          &payload,
+                                          &payload_length)
+          || payload_length < 1)
+        {
+          fprintf (stderr, "Invalid packed command in frame\n");
+          return false;
+        }
+
+      if (payload[0] != expected_commands[i])
+        {
+          fprintf (stderr,
+                   "Expected packed command 0x%02x but received 0x%02x\n",
+                   expected_commands[i],
+                   payload[0]);
+          return false;
+        }
+
+      if (payload[0] == find_command)
+        {
+          *payload_out = payload;
+          *payload_length_out = payload_length;
+        }
+    }
+
+  if (length > 0)
+    {
+      fprintf (stderr, "Unexpected extra data in packed frame\n");
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+read_v2_tile (VsxConnection *conn,
+              const uint8_t *expected_commands,
+              size_t n_expected_commands,
+              int expected_dx,
+              int expected_dy)
+{
+  uint8_t buf[128];
+  const uint8_t *payload = NULL;
+  size_t payload_length = 0;
+
+  if (!read_packed_frame (conn,
+                          buf, sizeof buf,
+                          expected_commands,
+                          n_expected_commands,
+                          VSX_PROTO_TILE,
+                          &payload,
+                          &payload_length))
+    return false;
+
+  uint8_t tile_num, player;
+  int32_t dx, dy;
+  const char *letter;
+
+  if (!vsx_proto_read_payload (payload + 1,
+                               payload_length - 1,
+
+                               VSX_PROTO_TYPE_UINT8,
+                               &tile_num,
+
+                               VSX_PROTO_TYPE_SVARINT,
+                               &dx,
+
+                               VSX_PROTO_TYPE_SVARINT,
+                               &dy,
+
+                               VSX_PROTO_TYPE_STRING,
+                               &letter,
+
+                               VSX_PROTO_TYPE_UINT8,
+                               &player,
+
+                               VSX_PROTO_TYPE_NONE))
+    {
+      fprintf (stderr, "Invalid version 2 tile command\n");
+      return false;
+    }
+
+  if (tile_num != 0 || dx != expected_dx || dy != expected_dy)
+    {
+      fprintf (stderr,
+               "Expected tile 0 to move by %i,%i but received tile %i "
+               "moving by %i,%i\n",
+               expected_dx, expected_dy,
+               tile_num,
+               dx, dy);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_tile_moved_to (const VsxConversation *conversation,
+                     int x,
+                     int y)
+{
+  const VsxTile *tile = conversation->tiles + 0;
+
+  if (tile->x != x || tile->y != y)
+    {
+      fprintf (stderr,
+               "Expected tile to be at %i,%i but it is at %i,%i\n",
+               x, y,
+               tile->x, tile->y);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_compact_protocol (Harness *harness)
+{
+  /* The first command is always sent in the original format */
+  if (!send_data (harness->conn,
+                  (const uint8_t *) "\x82\x15\x80" "default:eo\0Zamenhof\0",
+                  23))
+    return false;
+
+  static const uint8_t connect_commands[] =
+    {
+      VSX_PROTO_PLAYER_ID,
+      VSX_PROTO_CONVERSATION_ID,
+      VSX_PROTO_N_TILES,
+      VSX_PROTO_LANGUAGE,
+      VSX_PROTO_PLAYER_NAME,
+      VSX_PROTO_PLAYER,
+      VSX_PROTO_SYNC,
+    };
+  uint8_t buf[128];
+  const uint8_t *payload = NULL;
+  size_t payload_length = 0;
+
+  /* All of the initial state should be in one frame */
+  if (!read_packed_frame (harness->conn,
+                          buf, sizeof buf,
+                          connect_commands,
+                          VSX_N_ELEMENTS (connect_commands),
+                          VSX_PROTO_PLAYER_ID,
+                          &payload,
+                          &payload_length))
+    return false;
+
+  uint64_t person_id;
+  uint8_t player_num;
+
+  if (!vsx_proto_read_payload (payload + 1,
+                               payload_length - 1,
+
+                               VSX_PROTO_TYPE_UINT64,
+                               &person_id,
+
+                               VSX_PROTO_TYPE_UINT8,
+                               &player_num,
+
+                               VSX_PROTO_TYPE_NONE))
+    {
+      fprintf (stderr, "Invalid player ID command\n");
+      return false;
+    }
+
+  VsxPerson *person = vsx_person_set_get_person (harness->person_set,
+                                                 person_id);
+
+  if (person == NULL)
+    {
+      fprintf (stderr, "Player ID from version 2 connection not found\n");
+      return false;
+    }
+
+  const VsxConversation *conversation = person->conversation;
+
+  /* Turn a tile. The first position is relative to 0,0. */
+  if (!send_data (harness->conn, (const uint8_t *) "\x82\x02\x01\x89", 4))
+    return false;
+
+  static const uint8_t turn_commands[] =
+    {
+      VSX_PROTO_PLAYER,
+      VSX_PROTO_TILE,
+    };
+
+  if (!read_v2_tile (harness->conn,
+                     turn_commands,
+                     VSX_N_ELEMENTS (turn_commands),
+                     conversation->tiles[0].x,
+                     conversation->tiles[0].y))
+    return false;
+
+  static const uint8_t tile_command[] = { VSX_PROTO_TILE };
+  int old_x = conversation->tiles[0].x, old_y = conversation->tiles[0].y;
+
+  /* Move the tile by 5,-3 from the client’s starting point of 0,0 */
+  if (!send_data (harness->conn,
+                  (const uint8_t *) "\x82\x05\x04\x88\x00\x0a\x05",
+                  7)
+      || !check_tile_moved_to (conversation, 5, -3)
+      || !read_v2_tile (harness->conn,
+                        tile_command,
+                        VSX_N_ELEMENTS (tile_command),
+                        5 - old_x,
+                        -3 - old_y))
+    return false;
+
+  /* Two moves packed in one frame. They are relative to each other. */
+  if (!send_data (harness->conn,
+                  (const uint8_t *)
+                  "\x82\x0a"
+                  "\x04\x88\x00\x02\x02"
+                  "\x04\x88\x00\x0b\x04",
+                  12)
+      || !check_tile_moved_to (conversation, 0, 0)
+      || !read_v2_tile (harness->conn,
+                        tile_command,
+                        VSX_N_ELEMENTS (tile_command),
+                        -5,
+                        3))
+    return false;
+
+  return true;
+}
+
+static bool
+test_compact_protocol (void)
+{
+  Harness *harness = create_harness ();
+  struct vsx_error *error = NULL;
+  bool ret = true;
+
+  if (!vsx_connection_parse_data (harness->conn,
+                                  (uint8_t *) ws_v2_request,
+                                  (sizeof ws_v2_request) - 1,
+                                  &error))
+    {
+      fprintf (stderr,
+               "Unexpected error negotiating WebSocket: %s",
+               error->message);
+      vsx_error_free (error);
+      ret = false;
+      goto out;
+    }
+
+  uint8_t buf[(sizeof ws_v2_reply) * 2];
+  size_t got = vsx_connection_fill_output_buffer (harness->conn,
+                                                  buf,
+                                                  sizeof buf);
+
+  if (got != (sizeof ws_v2_reply) - 1
+      || memcmp (ws_v2_reply, buf, got))
+    {
+      fprintf (stderr,
+               "WebSocket negotiation with the subprotocol doesn’t match.\n"
+               "Received:\n"
+               "%.*s\n"
+               "Expected:\n"
+               "%s\n",
+               (int) got,
+               buf,
+               ws_v2_reply);
+      ret = false;
+      goto out;
+    }
+
+  if (!check_compact_protocol (harness))
+    ret = false;
+
+ out:
+  free_harness (harness);
+
+  return ret;
+}
+
+/* Compresses the payload with the client’s stream and sends it in a
+ * frame with RSV1 set.
+ */
+static bool
+send_compressed_message (VsxConnection *conn,
+                         z_stream *stream,
+                         const uint8_t *payload,
+                         size_t payload_length)
+{
+  uint8_t buf[2 + 125 + 4];
+
+  stream->next_in = (Bytef *) payload;
+  stream->avail_in = payload_length;
+  stream->next_out = buf + 2;
+  stream->avail_out = (sizeof buf) - 2;
+
+  int ret = deflate (stream, Z_SYNC_FLUSH);
+
+  assert (ret == Z_OK && stream->avail_out > 0);
+
+  /* Remove the empty block at the end */
+  size_t compressed_length = (sizeof buf) - 2 - stream->avail_out - 4;
+
+  buf[0] = 0xc2;
+  buf[1] = compressed_length;
+
+  return send_data (conn, buf, compressed_length + 2);
+}
+
+/* Reads a single compressed frame from the connection, inflates it
+ * and checks that it is the expected chat message. The length of the
+ * frame payload is returned in compressed_length.
+ */
+static bool
+read_compressed_message (VsxConnection *conn,
+                         z_stream *stream,
+                         const char *expected_message,
+                         size_t *compressed_length)
+{
+  uint8_t buf[VSX_PROTO_MAX_PAYLOAD_SIZE + 4];
+  size_t got = vsx_connection_fill_output_buffer (conn, buf, sizeof buf);
+
+  if (got < 2 || buf[0] != 0xc2 || buf[1] >= 126 || got != buf[1] + 2)
+    {
+      fprintf (stderr, "Expected a single short compressed frame\n");
+      return false;
+    }
+
+  static const uint8_t tail[] = { 0x00, 0x00, 0xff, 0xff };
+  uint8_t message[VSX_PROTO_MAX_PAYLOAD_SIZE];
+
+  stream->next_out = message;
+  stream->avail_out = sizeof message;
+
+  stream->next_in = buf + 2;
+  stream->avail_in = buf[1];
+
+  int ret = inflate (stream, Z_SYNC_FLUSH);
+
+  if (ret == Z_OK)
+    {
+      stream->next_in = (Bytef *) tail;
+      stream->avail_in = sizeof tail;
+      ret = inflate (stream, Z_SYNC_FLUSH);
+    }
+
+  if (ret != Z_OK || stream->avail_in > 0)
+    {
+      fprintf (stderr, "Error inflating the message from the server\n");
+      return false;
+    }
+
+  size_t message_length = (sizeof message) - stream->avail_out;
+  size_t expected_length = strlen (expected_message) + 1;
+
+  if (message_length != expected_length + 2
+      || message[0] != VSX_PROTO_MESSAGE
+      || message[1] != 0
+      || memcmp (message + 2, expected_message, expected_length))
+    {
+      fprintf (stderr,
+               "The decompressed message doesn’t match\n"
+               " Expected: %s\n"
+               " Received: %.*s\n",
+               expected_message,
+               (int) message_length,
+               message);
+      return false;
+    }
+
+  *compressed_length = buf[1];
+
+  return true;
+}
+
+static bool
+check_compressed_chat (Harness *harness,
+                       z_stream *deflate_stream,
+                       z_stream *inflate_stream)
+{
+  static const char message[] =
+    "Saluton! La vortoj en ĉi tiu mesaĝo estas sufiĉe longaj por la "
+    "densigo.";
+  uint8_t send_message_payload[sizeof message + 1];
+
+  send_message_payload[0] = VSX_PROTO_SEND_MESSAGE;
+  memcpy (send_message_payload + 1, message, sizeof message);
+
+  size_t compressed_lengths[2];
+
+  for (int i = 0; i < VSX_N_ELEMENTS (compressed_lengths); i++)
+    {
+      if (!send_compressed_message (harness->conn,
+                                    deflate_stream,
+                                    send_message_payload,
+                                    sizeof send_message_payload)
+          || !read_compressed_message (harness->conn,
+                                       inflate_stream,
+                                       message,
+                                       compressed_lengths + i))
+        return false;
+    }
+
+  /* The second message should refer back to the first one */
+  if (compressed_lengths[1] * 2 >= compressed_lengths[0])
+    {
+      fprintf (stderr,
+               "The repeated message was compressed to %zu bytes but the "
+               "first one was %zu bytes\n",
+               compressed_lengths[1],
+               compressed_lengths[0]);
+      return false;
+    }
+
+  if (!check_nothing_to_write (harness->conn))
+    return false;
+
+  struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+  bool saved = vsx_connection_save_state (harness->conn, &buf);
+
+  vsx_buffer_destroy (&buf);
+
+  if (saved)
+    {
+      fprintf (stderr, "The state of a compressed connection was saved\n");
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+check_deflate (Harness *harness,
+               z_stream *deflate_stream,
+               z_stream *inflate_stream)
+{
+  static const char new_player_payload[] =
+    "\x80" "room\0" "Zamenhof";
+
+  if (!send_compressed_message (harness->conn,
+                                deflate_stream,
+                                (const uint8_t *) new_player_payload,
+                                sizeof new_player_payload))
+    return false;
+
+  VsxPerson *person;
+
+  /* The messages at the start are all shorter than the threshold so
+   * they aren’t compressed.
+   */
+  if (!check_new_player (harness->conn,
+                         harness->person_set,
+                         "Zamenhof",
+                         0, /* player_num */
+                         &person))
+    return false;
+
+  bool ret = (read_sync (harness->conn)
+              && check_compressed_chat (harness,
+                                        deflate_stream,
+                                        inflate_stream));
+
+  vsx_object_unref (person);
+
+  return ret;
+}
+
+static bool
+test_deflate (void)
+{
+  static const VsxDeflateOptions options =
+    {
+      .window_bits = 10,
+      .threshold = 20,
+    };
+  Harness *harness = create_harness ();
+  bool ret = true;
+
+  vsx_connection_set_deflate_options (harness->conn, &options);
+
+  if (!send_data (harness->conn,
+                  (uint8_t *) ws_deflate_request,
+                  (sizeof ws_deflate_request) - 1))
+    {
+      free_harness (harness);
+      return false;
+    }
+
+  uint8_t buf[(sizeof ws_deflate_reply) * 2];
+  size_t got = vsx_connection_fill_output_buffer (harness->conn,
+                                                  buf,
+                                                  sizeof buf);
+
+  if (got != (sizeof ws_deflate_reply) - 1
+      || memcmp (ws_deflate_reply, buf, got))
+    {
+      fprintf (stderr,
+               "WebSocket negotiation with deflate doesn’t match.\n"
+               "Received:\n"
+               "%.*s\n"
+               "Expected:\n"
+               "%s\n",
+               (int) got,
+               buf,
+               ws_deflate_reply);
+      free_harness (harness);
+      return false;
+    }
+
+  z_stream deflate_stream = { .zalloc = Z_NULL };
+  z_stream inflate_stream = { .zalloc = Z_NULL };
+
+  deflateInit2 (&deflate_stream,
+                Z_DEFAULT_COMPRESSION,
+                Z_DEFLATED,
+                -10, /* window_bits */
+                8, /* mem_level */
+                Z_DEFAULT_STRATEGY);
+  inflateInit2 (&inflate_stream, -15 /* window_bits */);
+
+  if (!check_deflate (harness, &deflate_stream, &inflate_stream))
+    ret = false;
+
+  deflateEnd (&deflate_stream);
+  inflateEnd (&inflate_stream);
+
+  free_harness (harness);
+
+  return ret;
+}
+
+static bool
+test_got_shout (Harness *harness, int shout_player)
+{
+  uint8_t buf[1 + 1 + 1 + 1];
+
+  size_t got = vsx_connection_fill_output_buffer (harness->conn,
+                                                  buf,
+                                                  sizeof buf);
+
+  if (got != sizeof buf)
+    {
+      fprintf (stderr,
+               "Only got %zu bytes out of %zu "
+               "when trying to read the shout\n",
+               got,
+               sizeof buf);
+      return false;
+    }
+
+  if (buf[2] != VSX_PROTO_PLAYER_SHOUTED)
+    {
+      fprintf (stderr,
+               "Expected PLAYER_SHOUTED command but received 0x%02x\n",
+               buf[2]);
+      return false;
+    }
+
+  if (buf[3] != shout_player)
+    {
+      fprintf (stderr,
+               "test_got_shout: Expected %i but received %i\n",
+               shout_player,
+               buf[3]);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+test_shout (void)
+{
+  Harness *harness = create_negotiated_harness ();
+
+  if (harness == NULL)
+    return false;
+
+  VsxPerson *person;
+  bool ret = true;
+
+  if (!create_player (harness,
+                      "default:eo", "Zamenhof",
+                      &person))
+    {
+      ret = false;
+    }
+  else
+    {
+      struct vsx_error *error = NULL;
+
+      if (!vsx_connection_parse_data (harness->conn,
+                                      (uint8_t *) "\x82\x1\x8a",
+                                      3,
+                                      &error))
+        {
+          fprintf (stderr,
+                   "test_shout: Unexpected error: %s\n",
+                   error->message);
+          vsx_error_free (error);
+          ret = false;
+        }
+      else if (person->conversation->last_shout_time == 0)
+        {
+          fprintf (stderr,
+                   "test_shout: last_shout_time is still zero after shouting");
+          ret = false;
+        }
+      else if (!test_got_shout (harness, 0 /* shout_player */))
+        ret = false;
+
+      vsx_object_unref (person);
+    }
+
+  free_harness (harness);
+
+  return ret;
+}
+
+static bool
+check_set_n_tiles (Harness *harness, VsxPerson *person, int n_tiles)
+{
+  struct vsx_error *error = NULL;
+
+  uint8_t command[] =
+    {
+      0x82, 0x02, 0x8b, n_tiles,
+    };
+
+  if (!vsx_connection_parse_data (harness->conn,
+                                  command, sizeof command,
+                                  &error))
+    {
+      fprintf (stderr,
+               "test_set_n_tiles: Unexpected error: %s\n",
+               error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  if (person->conversation->total_n_tiles != n_tiles)
+    {
+      fprintf (stderr,
+               "test_set_n_tiles: failed to set total_n_tiles.\n"
+               " Expected: %i\n"
+               " Received: %i\n",
+               n_tiles,
+               person->conversation->total_n_tiles);
+      return false;
+    }
+
+  uint8_t got_n_tiles;
+
+  if (!read_n_tiles (harness->conn, &got_n_tiles))
+    return false;
+
+  if (got_n_tiles != n_tiles)
+    {
+      fprintf (stderr,
+               "test_set_n_tiles: After sending set_n_tiles %i, the "
+               "connection reported %i tiles\n",
+               n_tiles,
+               got_n_tiles);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+test_set_n_tiles (void)
+{
+  Harness *harness = create_negotiated_harness ();
+
+  if (harness == NULL)
+    return false;
+
+  VsxPerson *person;
+  bool ret = true;
+
+  if (!create_player (harness,
+                      "default:eo", "Zamenhof",
+                      &person))
+    {
+      ret = false;
+    }
+  else
+    {
+      if (!check_set_n_tiles (harness, person, 5))
+        ret = false;
+
+      vsx_object_unref (person);
+    }
+
+  free_harness (harness);
+
+  return ret;
+}
+
+static bool
+test_set_language (void)
+{
+  Harness *harness = create_negotiated_harness ();
+
+  if (harness == NULL)
+    return false;
+
+  VsxPerson *person;
+  bool ret = true;
+
+  if (!create_player (harness,
+                      "default:eo", "Zamenhof",
+                      &person))
+    {
+      ret = false;
+    }
+  else
+    {
+      struct vsx_error *error = NULL;
+
+      if (!vsx_connection_parse_data (harness->conn,
+                                      (uint8_t *) "\x82\x4\x8e" "en\x0",
+                                      6,
+                                      &error))
+        {
           fprintf (stderr,
                    "test_set_language: Unexpected error: %s\n",
                    error->message);
@@ -2402,6 +3485,46 @@ test_ping_string (VsxConnection *conn,
   return true;
 }
 
+static const uint8_t
+ping_frame[] = { 0x89, 0x04, 'p', 'o', 'o', 'p' };
+
+/* Sends the rest of ping_frame starting from offset and checks that
+ * the pong is received.
+ */
+static bool
+test_ping_string_part (VsxConnection *conn,
+                       size_t offset)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (conn,
+                                  ping_frame + offset,
+                                  (sizeof ping_frame) - offset,
+                                  &error))
+    {
+      fprintf (stderr,
+               "Unexpected error sending the rest of a ping: %s\n",
+               error->message);
+      vsx_error_free (error);
+
+      return false;
+    }
+
+  uint8_t result[(sizeof ping_frame) * 2];
+
+  size_t got = vsx_connection_fill_output_buffer (conn, result, sizeof result);
+
+  if (got != sizeof ping_frame
+      || result[0] != 0x8a
+      || memcmp (result + 1, ping_frame + 1, (sizeof ping_frame) - 1))
+    {
+      fprintf (stderr, "Pong after partial ping is not as expected\n");
+      return false;
+    }
+
+  return true;
+}
+
 static bool
 test_ping (void)
 {
@@ -2430,6 +3553,131 @@ test_ping (void)
   return ret;
 }
 
+static bool
+check_restored_connection (VsxConnection *conn,
+                           uint64_t expected_person_id)
+{
+  uint64_t person_id;
+
+  /* The restored connection should send everything again as if the
+   * client had reconnected.
+   */
+  if (!read_connect_header (conn, "Zamenhof", 0, &person_id)
+      || !read_sync (conn))
+    return false;
+
+  if (person_id != expected_person_id)
+    {
+      fprintf (stderr,
+               "Restored connection has a different person ID "
+               "(%" PRIu64 " != %" PRIu64 ")\n",
+               person_id,
+               expected_person_id);
+      return false;
+    }
+
+  /* Finish the ping that was started before the state was saved */
+  if (!test_ping_string_part (conn, 3))
+    return false;
+
+  return true;
+}
+
+static bool
+test_saved_state (void)
+{
+  Harness *harness = create_harness ();
+  struct vsx_buffer state = VSX_BUFFER_STATIC_INIT;
+  bool ret = true;
+
+  if (vsx_connection_save_state (harness->conn, &state))
+    {
+      fprintf (stderr,
+               "Saving a connection before the WebSocket negotiation "
+               "succeeded\n");
+      ret = false;
+    }
+
+  VsxPerson *person = NULL;
+
+  if (!negotiate_connection (harness->conn)
+      || !create_player (harness, "default:eo", "Zamenhof", &person))
+    {
+      ret = false;
+      goto out;
+    }
+
+  /* Send the first part of a ping so that the restored connection
+   * needs to carry on parsing it.
+   */
+  struct vsx_error *error = NULL;
+
+  if (!vsx_connection_parse_data (harness->conn, ping_frame, 3, &error))
+    {
+      fprintf (stderr,
+               "Unexpected error sending partial ping: %s\n",
+               error->message);
+      vsx_error_free (error);
+      ret = false;
+      goto out;
+    }
+
+  if (!vsx_connection_save_state (harness->conn, &state))
+    {
+      fprintf (stderr, "Failed to save the connection state\n");
+      ret = false;
+      goto out;
+    }
+
+  VsxConnection *restored =
+    vsx_connection_new_from_state (harness->conversation_set,
+                                   harness->person_set,
+                                   state.data,
+                                   state.length,
+                                   &error);
+
+  if (restored == NULL)
+    {
+      fprintf (stderr,
+               "Failed to restore the connection: %s\n",
+               error->message);
+      vsx_error_free (error);
+      ret = false;
+      goto out;
+    }
+
+  if (!check_restored_connection (restored, person->hash_entry.id))
+    ret = false;
+
+  vsx_connection_free (restored);
+
+  /* A truncated state should be rejected */
+  restored = vsx_connection_new_from_state (harness->conversation_set,
+                                            harness->person_set,
+                                            state.data,
+                                            state.length - 1,
+                                            &error);
+
+  if (restored)
+    {
+      fprintf (stderr, "Restoring a truncated state succeeded\n");
+      vsx_connection_free (restored);
+      ret = false;
+    }
+  else
+    {
+      vsx_error_free (error);
+    }
+
+ out:
+  if (person)
+    vsx_object_unref (person);
+  vsx_buffer_destroy (&state);
+  free_harness (harness);
+
+  return ret;
+}
+
 static bool
 check_error_message (VsxConnection *conn,
                      const char *command_name,
@@ -2974,9 +4222,24 @@ main (int argc, char **argv)
   if (!test_typing ())
     ret = EXIT_FAILURE;
 
+  if (!test_rate_limit ())
+    ret = EXIT_FAILURE;
+
+  if (!test_deferred_moves ())
+    ret = EXIT_FAILURE;
+
   if (!test_turn_and_move ())
     ret = EXIT_FAILURE;
 
+  if (!test_broadcast_tick ())
+    ret = EXIT_FAILURE;
+
+  if (!test_compact_protocol ())
+    ret = EXIT_FAILURE;
+
+  if (!test_deflate ())
+    ret = EXIT_FAILURE;
+
   if (!test_shout ())
     ret = EXIT_FAILURE;
 
@@ -2998,6 +4261,9 @@ main (int argc, char **argv)
   if (!test_ping ())
     ret = EXIT_FAILURE;
 
+  if (!test_saved_state ())
+    ret = EXIT_FAILURE;
+
   if (!test_bad_player_id ())
     ret = EXIT_FAILURE;
 
@@ -0,0 +1,214 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vsx-deflate.h"
+#include "vsx-util.h"
+
+#define HEADER "\r\nSec-WebSocket-Extensions: permessage-deflate"
+
+typedef struct
+{
+  const char *extensions;
+  int window_bits;
+  /* NULL if the offer should be declined */
+  const char *expected_header;
+} NegotiateTest;
+
+static const NegotiateTest
+negotiate_tests[] =
+  {
+    { "permessage-deflate", 15, HEADER },
+    /* The client might use a bigger window than we want */
+    { "permessage-deflate", 12, NULL },
+    { "permessage-deflate; client_max_window_bits", 12,
+      HEADER "; client_max_window_bits=12" },
+    { "permessage-deflate; client_max_window_bits=10", 12,
+      HEADER "; client_max_window_bits=10" },
+    { "permessage-deflate ; client_max_window_bits = \"14\"", 12,
+      HEADER "; client_max_window_bits=12" },
+    { "permessage-deflate; server_max_window_bits=13", 15,
+      HEADER "; server_max_window_bits=13" },
+    { "permessage-deflate; server_no_context_takeover; "
+      "client_no_context_takeover", 15,
+      HEADER "; server_no_context_takeover; client_no_context_takeover" },
+    /* The window size is clamped to what zlib supports */
+    { "permessage-deflate; client_max_window_bits", 4,
+      HEADER "; client_max_window_bits=9" },
+    { "x-webkit-deflate-frame, permessage-deflate", 15, HEADER },
+    { "permessage-deflate; server_max_window_bits=8, permessage-deflate", 15,
+      HEADER },
+    { "permessage-deflate; server_max_window_bits", 15, NULL },
+    { "permessage-deflate; server_max_window_bits=16", 15, NULL },
+    { "permessage-deflate; client_max_window_bits=1x", 15, NULL },
+    { "permessage-deflate; client_max_window_bits; client_max_window_bits",
+      15, NULL },
+    { "permessage-deflate; server_no_context_takeover=1", 15, NULL },
+    { "permessage-deflate; potato", 15, NULL },
+    { "permessage-deflat", 15, NULL },
+    { "", 15, NULL },
+    /* A window of zero disables the extension */
+    { "permessage-deflate", 0, NULL },
+  };
+
+static bool
+test_negotiate (void)
+{
+  bool ret = true;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (negotiate_tests); i++)
+    {
+      const NegotiateTest *test = negotiate_tests + i;
+      VsxDeflateOptions options = { .window_bits = test->window_bits };
+      VsxDeflate *state = vsx_deflate_negotiate (test->extensions, &options);
+      const char *header =
+        state ? vsx_deflate_get_response_header (state) : NULL;
+
+      if (test->expected_header == NULL
+          ? header != NULL
+          : header == NULL || strcmp (header, test->expected_header))
+        {
+          fprintf (stderr,
+                   "Negotiating “%s” with a window of %i bits:\n"
+                   " Expected: %s\n"
+                   " Received: %s\n",
+                   test->extensions,
+                   test->window_bits,
+                   test->expected_header ? test->expected_header : "(null)",
+                   header ? header : "(null)");
+          ret = false;
+        }
+
+      if (state)
+        vsx_deflate_free (state);
+    }
+
+  return ret;
+}
+
+static bool
+check_round_trip (VsxDeflate *state,
+                  const char *message)
+{
+  struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+  uint8_t out[128];
+  size_t out_length;
+  size_t length = strlen (message);
+  bool ret = true;
+
+  vsx_deflate_compress (state, (const uint8_t *) message, length, &buf);
+
+  if (!vsx_deflate_decompress (state,
+                               buf.data,
+                               buf.length,
+                               out,
+                               sizeof out,
+                               &out_length))
+    {
+      fprintf (stderr, "Failed to decompress “%s”\n", message);
+      ret = false;
+    }
+  else if (out_length != length || memcmp (out, message, length))
+    {
+      fprintf (stderr,
+               "Round trip of “%s” gave “%.*s”\n",
+               message,
+               (int) out_length,
+               out);
+      ret = false;
+    }
+
+  vsx_buffer_destroy (&buf);
+
+  return ret;
+}
+
+static bool
+test_compress (void)
+{
+  static const VsxDeflateOptions options = { .window_bits = 15 };
+  /* The server and the client have the same settings so the state
+   * can decompress its own output.
+   */
+  VsxDeflate *state = vsx_deflate_negotiate ("permessage-deflate", &options);
+  bool ret = true;
+
+  if (!check_round_trip (state, "Saluton, mondo!")
+      || !check_round_trip (state, "Saluton, mondo!")
+      || !check_round_trip (state, ""))
+    ret = false;
+
+  struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+  static const char message[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  uint8_t out[(sizeof message) - 1];
+  size_t out_length;
+
+  /* A message that exactly fills the output buffer is fine but one
+   * byte less is an error.
+   */
+  for (int i = 0; i < 2; i++)
+    {
+      buf.length = 0;
+
+      vsx_deflate_compress (state,
+                            (const uint8_t *) message,
+                            (sizeof message) - 1,
+                            &buf);
+
+      if (vsx_deflate_decompress (state,
+                                  buf.data,
+                                  buf.length,
+                                  out,
+                                  (sizeof out) - i,
+                                  &out_length)
+          != (i == 0))
+        {
+          fprintf (stderr,
+                   "Decompressing into a buffer of %zu bytes %s\n",
+                   (sizeof out) - i,
+                   i == 0 ? "failed" : "worked");
+          ret = false;
+        }
+    }
+
+  vsx_buffer_destroy (&buf);
+
+  vsx_deflate_free (state);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (!test_negotiate ())
+    ret = EXIT_FAILURE;
+
+  if (!test_compress ())
+    ret = EXIT_FAILURE;
+
+  return ret;
+}
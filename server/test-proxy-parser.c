@@ -0,0 +1,377 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vsx-proxy-parser.h"
+#include "vsx-util.h"
+
+#define SIGNATURE "\r\n\r\n\0\r\nQUIT\n"
+
+typedef struct
+{
+  const char *data;
+  size_t length;
+  VsxProxyParserError expected_code;
+  const char *expected_message;
+} ErrorTest;
+
+#define DATA(x) x, (sizeof x) - 1
+
+static const ErrorTest
+error_tests[] =
+  {
+    {
+      DATA ("GET / HTTP/1.1\r\n"
+            "Host: localhost\r\n"),
+      VSX_PROXY_PARSER_ERROR_INVALID,
+      "Connection did not start with a PROXY v2 header",
+    },
+    {
+      DATA (SIGNATURE "\x11\x11\x00\x0c"),
+      VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+      "Unsupported PROXY protocol version 1",
+    },
+    {
+      DATA (SIGNATURE "\x22\x11\x00\x0c"),
+      VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+      "Unsupported PROXY command 0x2",
+    },
+    {
+      DATA (SIGNATURE "\x21\x11\x08\x00"),
+      VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+      "PROXY header is too long",
+    },
+    {
+      DATA (SIGNATURE "\x21\x21\x00\x0c"),
+      VSX_PROXY_PARSER_ERROR_INVALID,
+      "PROXY header is too short for its address family",
+    },
+  };
+
+typedef struct
+{
+  const char *data;
+  size_t length;
+  /* NULL if no address is expected */
+  const char *expected_address;
+} SuccessTest;
+
+static const SuccessTest
+success_tests[] =
+  {
+    {
+      /* TCP over IPv4 */
+      DATA (SIGNATURE "\x21\x11\x00\x0c"
+            "\xc0\xa8\x01\x02" "\x7f\x00\x00\x01" "\x30\x39" "\x01\xbb"
+            "TRAILING_DATA"),
+      "192.168.1.2:12345",
+    },
+    {
+      /* TCP over IPv6 */
+      DATA (SIGNATURE "\x21\x21\x00\x24"
+            "\x20\x01\x0d\xb8\x00\x00\x00\x00"
+            "\x00\x00\x00\x00\x00\x00\x00\x01"
+            "\x00\x00\x00\x00\x00\x00\x00\x00"
+            "\x00\x00\x00\x00\x00\x00\x00\x01"
+            "\x00\x50" "\x01\xbb"
+            "TRAILING_DATA"),
+      "[2001:db8::1]:80",
+    },
+    {
+      /* IPv4 with a TLV on the end that should be skipped */
+      DATA (SIGNATURE "\x21\x11\x00\x11"
+            "\x0a\x00\x00\x07" "\x7f\x00\x00\x01" "\x00\x2a" "\x01\xbb"
+            "\x04\x00\x02" "hi"
+            "TRAILING_DATA"),
+      "10.0.0.7:42",
+    },
+    {
+      /* LOCAL command, for example from a health check */
+      DATA (SIGNATURE "\x20\x00\x00\x00"
+            "TRAILING_DATA"),
+      NULL,
+    },
+    {
+      /* LOCAL command with an address that should be ignored */
+      DATA (SIGNATURE "\x20\x11\x00\x0c"
+            "\xc0\xa8\x01\x02" "\x7f\x00\x00\x01" "\x30\x39" "\x01\xbb"
+            "TRAILING_DATA"),
+      NULL,
+    },
+    {
+      /* Unknown address family */
+      DATA (SIGNATURE "\x21\x31\x00\x04"
+            "abcd"
+            "TRAILING_DATA"),
+      NULL,
+    },
+  };
+
+static bool
+test_errors (void)
+{
+  bool ret = true;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (error_tests); i++)
+    {
+      VsxProxyParser *parser = vsx_proxy_parser_new ();
+
+      size_t consumed;
+      struct vsx_error *error = NULL;
+
+      VsxProxyParserResult res =
+        vsx_proxy_parser_parse_data (parser,
+                                     (const uint8_t *) error_tests[i].data,
+                                     error_tests[i].length,
+                                     &consumed,
+                                     &error);
+
+      if (res == VSX_PROXY_PARSER_RESULT_ERROR)
+        {
+          if (error->domain != &vsx_proxy_parser_error)
+            {
+              fprintf (stderr,
+                       "error test %i: error was from a different domain\n",
+                       i);
+              ret = false;
+            }
+          if (error->code != error_tests[i].expected_code)
+            {
+              fprintf (stderr,
+                       "error test %i: expected code %i but received %i\n",
+                       i,
+                       (int) error_tests[i].expected_code,
+                       (int) error->code);
+              ret = false;
+            }
+          if (strcmp (error->message, error_tests[i].expected_message))
+            {
+              fprintf (stderr,
+                       "error test %i: error message different\n"
+                       "  Expected: %s\n"
+                       "  Received: %s\n",
+                       i,
+                       error_tests[i].expected_message,
+                       error->message);
+              ret = false;
+            }
+
+          vsx_error_free (error);
+        }
+      else
+        {
+          fprintf (stderr,
+                   "error test %i: expected failure but result was %i\n",
+                   i,
+                   (int) res);
+          ret = false;
+        }
+
+      vsx_proxy_parser_free (parser);
+    }
+
+  return ret;
+}
+
+static VsxProxyParserResult
+parse_data_byte_at_a_time (VsxProxyParser *parser,
+                           const uint8_t *data,
+                           size_t length,
+                           size_t *consumed_out,
+                           struct vsx_error **error)
+{
+  size_t total_consumed = 0;
+
+  while (total_consumed < length)
+    {
+      size_t consumed;
+      uint8_t bytes[] = { data[total_consumed], 0xff, 0xff, 0xff };
+
+      switch (vsx_proxy_parser_parse_data (parser,
+                                           bytes,
+                                           1, /* length */
+                                           &consumed,
+                                           error))
+        {
+        case VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA:
+          total_consumed++;
+          break;
+        case VSX_PROXY_PARSER_RESULT_FINISHED:
+          total_consumed += consumed;
+          *consumed_out = total_consumed;
+          return VSX_PROXY_PARSER_RESULT_FINISHED;
+        case VSX_PROXY_PARSER_RESULT_ERROR:
+          return VSX_PROXY_PARSER_RESULT_ERROR;
+        }
+    }
+
+  return VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA;
+}
+
+static bool
+check_address (int test_num,
+               VsxProxyParser *parser,
+               const char *expected_address)
+{
+  struct vsx_netaddress address;
+
+  if (!vsx_proxy_parser_get_address (parser, &address))
+    {
+      if (expected_address == NULL)
+        return true;
+
+      fprintf (stderr,
+               "success test %i: expected address %s but there was none\n",
+               test_num,
+               expected_address);
+      return false;
+    }
+
+  char *address_string = vsx_netaddress_to_string (&address);
+  bool ret = true;
+
+  if (expected_address == NULL)
+    {
+      fprintf (stderr,
+               "success test %i: expected no address but got %s\n",
+               test_num,
+               address_string);
+      ret = false;
+    }
+  else if (strcmp (address_string, expected_address))
+    {
+      fprintf (stderr,
+               "success test %i: address does not match\n"
+               " Expected: %s\n"
+               " Received: %s\n",
+               test_num,
+               expected_address,
+               address_string);
+      ret = false;
+    }
+
+  vsx_free (address_string);
+
+  return ret;
+}
+
+static bool
+test_success (bool byte_at_a_time)
+{
+  bool ret = true;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (success_tests); i++)
+    {
+      VsxProxyParser *parser = vsx_proxy_parser_new ();
+
+      size_t consumed;
+      struct vsx_error *error = NULL;
+
+      const uint8_t *data = (const uint8_t *) success_tests[i].data;
+      size_t length = success_tests[i].length;
+
+      VsxProxyParserResult res;
+
+      if (byte_at_a_time)
+        {
+          res = parse_data_byte_at_a_time (parser,
+                                           data,
+                                           length,
+                                           &consumed,
+                                           &error);
+        }
+      else
+        {
+          res = vsx_proxy_parser_parse_data (parser,
+                                             data,
+                                             length,
+                                             &consumed,
+                                             &error);
+        }
+
+      if (res == VSX_PROXY_PARSER_RESULT_FINISHED)
+        {
+          if (consumed > length)
+            {
+              fprintf (stderr,
+                       "success test %i: consumed > length (%zu > %zu)\n",
+                       i,
+                       consumed,
+                       length);
+              ret = false;
+            }
+          else if (length - consumed != strlen ("TRAILING_DATA")
+                   || memcmp ("TRAILING_DATA",
+                              data + consumed,
+                              length - consumed))
+            {
+              fprintf (stderr,
+                       "success test %i: didn’t consume until TRAILING_DATA "
+                       "(consumed = %zu)\n",
+                       i,
+                       consumed);
+              ret = false;
+            }
+
+          if (!check_address (i, parser, success_tests[i].expected_address))
+            ret = false;
+        }
+      else
+        {
+          fprintf (stderr,
+                   "success test %i: expected success but result was %i\n",
+                   i,
+                   (int) res);
+          if (res == VSX_PROXY_PARSER_RESULT_ERROR)
+            {
+              fprintf (stderr,
+                       " error: %s\n",
+                       error->message);
+              vsx_error_free (error);
+            }
+          ret = false;
+        }
+
+      vsx_proxy_parser_free (parser);
+    }
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (!test_errors ())
+    ret = EXIT_FAILURE;
+
+  if (!test_success (false))
+    ret = EXIT_FAILURE;
+
+  if (!test_success (true))
+    ret = EXIT_FAILURE;
+
+  return ret;
+}
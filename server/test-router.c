@@ -0,0 +1,720 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "vsx-router.h"
+#include "vsx-cluster.h"
+#include "vsx-fd-message.h"
+#include "vsx-main-context.h"
+#include "vsx-proto.h"
+#include "vsx-socket.h"
+#include "vsx-buffer.h"
+#include "vsx-util.h"
+
+/* Runs a router in the test process with several fake backends that
+ * are just listening fd-message sockets in a temporary directory.
+ * Each client is one end of a socketpair and the test checks which
+ * backend the other end is passed to.
+ */
+
+#define N_BACKENDS 3
+
+typedef struct
+{
+  char *path;
+  int listen_sock;
+  /* The router’s connection to the backend or -1 */
+  int sock;
+} TestBackend;
+
+typedef struct
+{
+  char *dir;
+  TestBackend backends[N_BACKENDS];
+  VsxRouter *router;
+  VsxCluster *cluster;
+} Harness;
+
+/* The request offers permessage-deflate to check that the router
+ * turns it down.
+ */
+static const char
+ws_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Sec-WebSocket-Key: potato\r\n"
+  "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+  "\r\n";
+
+static const char
+ws_response[] =
+  "HTTP/1.1 101 Switching Protocols\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Accept: p4PX7Zjj5DyJVCBrt49wxR4RyoQ=\r\n"
+  "\r\n";
+
+static bool
+listen_backend (TestBackend *backend)
+{
+  struct vsx_error *error = NULL;
+
+  backend->listen_sock = vsx_fd_message_listen (backend->path, &error);
+
+  if (backend->listen_sock == -1)
+    {
+      fprintf (stderr, "%s\n", error->message);
+      vsx_error_free (error);
+      return false;
+    }
+
+  return true;
+}
+
+static void
+close_backend (TestBackend *backend)
+{
+  if (backend->sock != -1)
+    {
+      vsx_close (backend->sock);
+      backend->sock = -1;
+    }
+
+  if (backend->listen_sock != -1)
+    {
+      vsx_close (backend->listen_sock);
+      backend->listen_sock = -1;
+    }
+}
+
+static void
+free_harness (Harness *harness)
+{
+  if (harness->router)
+    vsx_router_free (harness->router);
+
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      TestBackend *backend = harness->backends + i;
+
+      close_backend (backend);
+      unlink (backend->path);
+      vsx_free (backend->path);
+    }
+
+  rmdir (harness->dir);
+  vsx_free (harness->dir);
+
+  if (harness->cluster)
+    vsx_cluster_free (harness->cluster);
+
+  vsx_free (harness);
+}
+
+static Harness *
+create_harness (void)
+{
+  Harness *harness = vsx_calloc (sizeof *harness);
+
+  harness->dir = vsx_strdup ("/tmp/test-router-XXXXXX");
+
+  if (mkdtemp (harness->dir) == NULL)
+    {
+      fprintf (stderr, "mkdtemp: %s\n", strerror (errno));
+      vsx_free (harness->dir);
+      vsx_free (harness);
+      return NULL;
+    }
+
+  const char *paths[N_BACKENDS];
+  bool ret = true;
+
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      TestBackend *backend = harness->backends + i;
+
+      char name[] = "/backend-0";
+
+      name[sizeof name - 2] += i;
+      backend->path = vsx_strconcat (harness->dir, name, NULL);
+      backend->listen_sock = -1;
+      backend->sock = -1;
+      paths[i] = backend->path;
+
+      if (!listen_backend (backend))
+        ret = false;
+    }
+
+  harness->router = vsx_router_new (N_BACKENDS, paths);
+  harness->cluster = vsx_cluster_new (N_BACKENDS);
+
+  if (!ret)
+    {
+      free_harness (harness);
+      return NULL;
+    }
+
+  return harness;
+}
+
+/* Adds a client to the router that has already sent the request
+ * followed by data, which can be empty. Returns the client’s end of
+ * the socket.
+ */
+static int
+add_client (Harness *harness,
+            const uint8_t *data,
+            size_t length)
+{
+  int fds[2];
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    {
+      fprintf (stderr, "socketpair: %s\n", strerror (errno));
+      return -1;
+    }
+
+  struct vsx_error *error = NULL;
+
+  if (!vsx_socket_set_nonblock (fds[1], &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      vsx_error_free (error);
+      vsx_close (fds[0]);
+      vsx_close (fds[1]);
+      return -1;
+    }
+
+  struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+
+  vsx_buffer_append_string (&buf, ws_request);
+  vsx_buffer_append (&buf, data, length);
+
+  if (write (fds[0], buf.data, buf.length) != buf.length)
+    {
+      fprintf (stderr, "write: %s\n", strerror (errno));
+      vsx_buffer_destroy (&buf);
+      vsx_close (fds[0]);
+      vsx_close (fds[1]);
+      return -1;
+    }
+
+  vsx_buffer_destroy (&buf);
+
+  vsx_router_add_connection (harness->router, fds[1]);
+
+  return fds[0];
+}
+
+/* Accepts any new connections from the router and returns the number
+ * of the backend that has a message waiting, or -1 if there isn’t
+ * one. The received socket is checked to be the other end of client.
+ */
+static int
+receive_client (Harness *harness,
+                int client,
+                const uint8_t *data,
+                size_t length)
+{
+  struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
+  int found_backend = -1;
+
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      TestBackend *backend = harness->backends + i;
+      int sock = accept (backend->listen_sock, NULL, NULL);
+
+      if (sock != -1)
+        {
+          /* The router only keeps one connection to each backend */
+          if (backend->sock != -1)
+            vsx_close (backend->sock);
+          backend->sock = sock;
+          vsx_socket_set_nonblock (sock, NULL);
+        }
+
+      if (backend->sock == -1)
+        continue;
+
+      int fd;
+      struct vsx_error *error = NULL;
+
+      if (!vsx_fd_message_receive (backend->sock,
+                                   &buf,
+                                   VSX_CLUSTER_MAX_HANDOFF_SIZE,
+                                   &fd,
+                                   &error))
+        {
+          vsx_error_free (error);
+          continue;
+        }
+
+      if (found_backend != -1)
+        {
+          fprintf (stderr, "Client was sent to more than one backend\n");
+          found_backend = -1;
+        }
+      else if (buf.length != 1 + strlen (ws_request) + length
+               || memcmp (buf.data + 1, ws_request, strlen (ws_request))
+               || memcmp (buf.data + 1 + strlen (ws_request), data, length))
+        {
+          fprintf (stderr, "Backend received the wrong data\n");
+        }
+      else if (buf.data[0] != VSX_CLUSTER_HANDOFF_FLAG_RESPONSE_SENT)
+        {
+          fprintf (stderr, "Backend wasn’t told the response was sent\n");
+        }
+      else if (fd == -1)
+        {
+          fprintf (stderr, "Backend didn’t receive a socket\n");
+        }
+      else if (write (client, "x", 1) != 1
+               || read (fd, buf.data, 1) != 1
+               || buf.data[0] != 'x')
+        {
+          fprintf (stderr, "Passed socket isn’t connected to the client\n");
+        }
+      else
+        {
+          found_backend = i;
+        }
+
+      if (fd != -1)
+        vsx_close (fd);
+    }
+
+  vsx_buffer_destroy (&buf);
+
+  return found_backend;
+}
+
+/* Checks that the router has sent the handshake response to the
+ * client and that it didn’t accept permessage-deflate.
+ */
+static bool
+check_response (int client)
+{
+  char buf[sizeof ws_response];
+  ssize_t got = recv (client, buf, sizeof buf, MSG_DONTWAIT);
+
+  if (got != strlen (ws_response) || memcmp (buf, ws_response, got))
+    {
+      fprintf (stderr, "Client didn’t receive the expected response\n");
+      return false;
+    }
+
+  return true;
+}
+
+/* Sends a client through the router and returns the backend that it
+ * was passed to or -1 if something went wrong.
+ */
+static int
+route_client (Harness *harness,
+              const uint8_t *data,
+              size_t length)
+{
+  int client = add_client (harness, data, length);
+
+  if (client == -1)
+    return -1;
+
+  /* The data is already waiting so one iteration is enough for the
+   * router to read it and pass it on.
+   */
+  vsx_main_context_poll (NULL);
+
+  int backend = receive_client (harness, client, data, length);
+
+  if (!check_response (client))
+    backend = -1;
+
+  vsx_close (client);
+
+  return backend;
+}
+
+static bool
+check_route (Harness *harness,
+             const char *name,
+             const uint8_t *data,
+             size_t length,
+             int expected_backend)
+{
+  int backend = route_client (harness, data, length);
+
+  if (backend != expected_backend)
+    {
+      fprintf (stderr,
+               "%s: expected backend %i but got %i\n",
+               name,
+               expected_backend,
+               backend);
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+test_commands (Harness *harness)
+{
+  uint8_t frame[128];
+  bool ret = true;
+  bool backend_used[N_BACKENDS] = { false };
+
+  for (int i = 0; i < 8; i++)
+    {
+      char room[32];
+
+      sprintf (room, "eo:room%i", i);
+
+      int length = vsx_proto_write_command (frame, sizeof frame,
+                                            VSX_PROTO_NEW_PLAYER,
+                                            VSX_PROTO_TYPE_STRING, room,
+                                            VSX_PROTO_TYPE_STRING, "Bob",
+                                            VSX_PROTO_TYPE_NONE);
+      int node = vsx_cluster_get_node_for_name (harness->cluster, room);
+
+      if (!check_route (harness, "NEW_PLAYER", frame, length, node))
+        ret = false;
+
+      backend_used[node] = true;
+    }
+
+  for (uint64_t id = 1; id <= 8; id++)
+    {
+      uint64_t person_id = id * UINT64_C (0x9e3779b97f4a7c15);
+      int length = vsx_proto_write_command (frame, sizeof frame,
+                                            VSX_PROTO_RECONNECT,
+                                            VSX_PROTO_TYPE_UINT64, person_id,
+                                            VSX_PROTO_TYPE_UINT16, 0,
+                                            VSX_PROTO_TYPE_NONE);
+      int node = vsx_cluster_get_node_for_id (harness->cluster, person_id);
+
+      if (!check_route (harness, "RECONNECT", frame, length, node))
+        ret = false;
+
+      backend_used[node] = true;
+    }
+
+  for (uint64_t id = 1; id <= 8; id++)
+    {
+      uint64_t conversation_id = id * UINT64_C (0xc2b2ae3d27d4eb4f);
+      int length = vsx_proto_write_command (frame, sizeof frame,
+                                            VSX_PROTO_JOIN_GAME,
+                                            VSX_PROTO_TYPE_UINT64,
+                                            conversation_id,
+                                            VSX_PROTO_TYPE_STRING, "Bob",
+                                            VSX_PROTO_TYPE_NONE);
+      int node = vsx_cluster_get_node_for_id (harness->cluster,
+                                              conversation_id);
+
+      if (!check_route (harness, "JOIN_GAME", frame, length, node))
+        ret = false;
+
+      backend_used[node] = true;
+    }
+
+  /* Make sure the test isn’t just sending everything to one place */
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      if (!backend_used[i])
+        {
+          fprintf (stderr, "No command was routed to backend %i\n", i);
+          ret = false;
+        }
+    }
+
+  return ret;
+}
+
+static bool
+test_masked_frame (Harness *harness)
+{
+  static const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+  uint8_t frame[128], masked[128 + 4 + 2];
+  uint64_t id = UINT64_C (0x0123456789abcdef);
+
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_JOIN_GAME,
+                                        VSX_PROTO_TYPE_UINT64, id,
+                                        VSX_PROTO_TYPE_STRING, "Bob",
+                                        VSX_PROTO_TYPE_NONE);
+  int payload_length = length - 2;
+
+  /* Put a ping before the command to check that control frames are
+   * skipped, then add a mask to the command like a browser would.
+   */
+  masked[0] = 0x89;
+  masked[1] = 0x00;
+  masked[2] = frame[0];
+  masked[3] = frame[1] | 0x80;
+  memcpy (masked + 4, mask, sizeof mask);
+
+  for (int i = 0; i < payload_length; i++)
+    masked[8 + i] = frame[2 + i] ^ mask[i & 3];
+
+  return check_route (harness,
+                      "Masked JOIN_GAME",
+                      masked,
+                      8 + payload_length,
+                      vsx_cluster_get_node_for_id (harness->cluster, id));
+}
+
+static bool
+test_round_robin (Harness *harness)
+{
+  uint8_t frame[128];
+  bool ret = true;
+  int first_backend = -1;
+
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_NEW_PRIVATE_GAME,
+                                        VSX_PROTO_TYPE_STRING, "eo",
+                                        VSX_PROTO_TYPE_STRING, "Bob",
+                                        VSX_PROTO_TYPE_NONE);
+
+  /* Connections that can go anywhere should be spread over all of
+   * the backends in turn.
+   */
+  for (int i = 0; i < N_BACKENDS * 2; i++)
+    {
+      int backend = route_client (harness, frame, length);
+
+      if (first_backend == -1)
+        first_backend = backend;
+
+      if (backend == -1
+          || backend != (first_backend + i) % N_BACKENDS)
+        {
+          fprintf (stderr,
+                   "NEW_PRIVATE_GAME %i went to backend %i\n",
+                   i,
+                   backend);
+          ret = false;
+        }
+    }
+
+  /* Garbage is also passed on so that a backend can report the error */
+  static const uint8_t garbage[] = { 0x82, 0x01, 0xff };
+
+  if (route_client (harness, garbage, sizeof garbage) == -1)
+    {
+      fprintf (stderr, "Invalid command wasn’t passed to a backend\n");
+      ret = false;
+    }
+
+  return ret;
+}
+
+static bool
+test_response_first (Harness *harness)
+{
+  uint8_t frame[128];
+  uint64_t id = UINT64_C (0x0123456789abcdef);
+  bool ret = true;
+
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_RECONNECT,
+                                        VSX_PROTO_TYPE_UINT64, id,
+                                        VSX_PROTO_TYPE_UINT16, 0,
+                                        VSX_PROTO_TYPE_NONE);
+
+  /* Browsers don’t send anything after the request until they get
+   * the response so the router has to send it before it can see the
+   * command.
+   */
+  int client = add_client (harness, frame, 0);
+
+  if (client == -1)
+    return false;
+
+  vsx_main_context_poll (NULL);
+
+  if (receive_client (harness, client, frame, 0) != -1)
+    {
+      fprintf (stderr, "Client was routed before sending a command\n");
+      ret = false;
+    }
+  else if (!check_response (client))
+    {
+      ret = false;
+    }
+  else if (write (client, frame, length) != length)
+    {
+      fprintf (stderr, "write: %s\n", strerror (errno));
+      ret = false;
+    }
+  else
+    {
+      vsx_main_context_poll (NULL);
+
+      int backend = receive_client (harness, client, frame, length);
+      int expected_backend = vsx_cluster_get_node_for_id (harness->cluster,
+                                                          id);
+
+      if (backend != expected_backend)
+        {
+          fprintf (stderr,
+                   "RECONNECT after response: "
+                   "expected backend %i but got %i\n",
+                   expected_backend,
+                   backend);
+          ret = false;
+        }
+    }
+
+  vsx_close (client);
+
+  return ret;
+}
+
+static bool
+test_compressed_frame (Harness *harness)
+{
+  uint8_t frame[128];
+  uint64_t id = UINT64_C (0x0123456789abcdef);
+  bool backend_used[N_BACKENDS] = { false };
+  bool ret = true;
+
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_JOIN_GAME,
+                                        VSX_PROTO_TYPE_UINT64, id,
+                                        VSX_PROTO_TYPE_STRING, "Bob",
+                                        VSX_PROTO_TYPE_NONE);
+
+  /* Set RSV1 as if the payload was compressed. The router shouldn’t
+   * try to read the command so the connections should be spread
+   * over all of the backends instead of all going to the owner of
+   * the ID.
+   */
+  frame[0] |= 0x40;
+
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      int backend = route_client (harness, frame, length);
+
+      if (backend == -1)
+        {
+          fprintf (stderr, "Compressed frame wasn’t passed to a backend\n");
+          ret = false;
+        }
+      else
+        {
+          backend_used[backend] = true;
+        }
+    }
+
+  for (int i = 0; i < N_BACKENDS; i++)
+    {
+      if (!backend_used[i])
+        {
+          fprintf (stderr,
+                   "Compressed frame was routed using its payload\n");
+          ret = false;
+          break;
+        }
+    }
+
+  return ret;
+}
+
+static bool
+test_backend_restart (Harness *harness)
+{
+  uint8_t frame[128];
+  uint64_t id = 1;
+
+  /* Find an ID for the first backend */
+  while (vsx_cluster_get_node_for_id (harness->cluster, id) != 0)
+    id++;
+
+  int length = vsx_proto_write_command (frame, sizeof frame,
+                                        VSX_PROTO_RECONNECT,
+                                        VSX_PROTO_TYPE_UINT64, id,
+                                        VSX_PROTO_TYPE_UINT16, 0,
+                                        VSX_PROTO_TYPE_NONE);
+
+  /* Make sure the router has a connection to the backend */
+  if (!check_route (harness, "RECONNECT", frame, length, 0))
+    return false;
+
+  /* Pretend the backend was restarted. The router’s old connection
+   * is now dead so it should notice when sending and reconnect.
+   */
+  close_backend (harness->backends + 0);
+
+  if (!listen_backend (harness->backends + 0))
+    return false;
+
+  return check_route (harness,
+                      "RECONNECT after restart",
+                      frame, length,
+                      0);
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (vsx_main_context_get_default (NULL) == NULL)
+    return EXIT_FAILURE;
+
+  Harness *harness = create_harness ();
+
+  if (harness == NULL)
+    {
+      ret = EXIT_FAILURE;
+    }
+  else
+    {
+      if (!test_commands (harness))
+        ret = EXIT_FAILURE;
+
+      if (!test_masked_frame (harness))
+        ret = EXIT_FAILURE;
+
+      if (!test_round_robin (harness))
+        ret = EXIT_FAILURE;
+
+      if (!test_response_first (harness))
+        ret = EXIT_FAILURE;
+
+      if (!test_compressed_frame (harness))
+        ret = EXIT_FAILURE;
+
+      if (!test_backend_restart (harness))
+        ret = EXIT_FAILURE;
+
+      free_harness (harness);
+    }
+
+  vsx_main_context_free (vsx_main_context_get_default (NULL));
+
+  return ret;
+}
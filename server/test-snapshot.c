@@ -0,0 +1,402 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "vsx-snapshot.h"
+#include "vsx-conversation-set.h"
+#include "vsx-person-set.h"
+#include "vsx-util.h"
+#include "vsx-main-context.h"
+
+#define N_PEOPLE 5
+
+typedef struct {
+        VsxConversationSet *conversation_set;
+        VsxPersonSet *person_set;
+        VsxPerson *people[N_PEOPLE];
+        VsxConversation *conversations[2];
+} Harness;
+
+static void
+create_state(Harness *harness)
+{
+        struct vsx_netaddress addr;
+
+        vsx_netaddress_from_string(&addr, "127.0.0.1", 5344);
+
+        harness->conversation_set = vsx_conversation_set_new();
+        harness->person_set = vsx_person_set_new();
+
+        /* The first conversation is still pending */
+        harness->conversations[0] =
+                vsx_conversation_set_get_pending_conversation(
+                        harness->conversation_set,
+                        "eo:pending",
+                        &addr);
+        /* The second one has started */
+        harness->conversations[1] =
+                vsx_conversation_set_get_pending_conversation(
+                        harness->conversation_set,
+                        "en:started",
+                        &addr);
+
+        static const char * const names[N_PEOPLE] = {
+                "Alice", "Bob", "Charles", "Dora", "Eve",
+        };
+
+        for (int i = 0; i < N_PEOPLE; i++) {
+                VsxConversation *conversation =
+                        harness->conversations[i < 2 ? 0 : 1];
+                harness->people[i] =
+                        vsx_person_set_generate_person(harness->person_set,
+                                                       names[i],
+                                                       &addr,
+                                                       conversation);
+        }
+
+        VsxConversation *started = harness->conversations[1];
+
+        vsx_conversation_add_message(started, 0, "Saluton", 7);
+        vsx_conversation_turn(started, 0);
+        vsx_conversation_turn(started, 1);
+        vsx_conversation_move_tile(started, 2, 0, 42, -17);
+        vsx_conversation_add_message(started, 1, "ĉu vi?", strlen("ĉu vi?"));
+        vsx_conversation_set_typing(started, 2, true);
+
+        /* Eve leaves so she shouldn’t be restored */
+        vsx_person_leave_conversation(harness->people[4]);
+}
+
+static void
+free_state(Harness *harness)
+{
+        for (int i = 0; i < N_PEOPLE; i++)
+                vsx_object_unref(harness->people[i]);
+        for (int i = 0; i < VSX_N_ELEMENTS(harness->conversations); i++)
+                vsx_object_unref(harness->conversations[i]);
+
+        vsx_object_unref(harness->person_set);
+        vsx_object_unref(harness->conversation_set);
+}
+
+static bool
+compare_conversations(VsxConversation *a,
+                      VsxConversation *b)
+{
+        if (a->state != b->state ||
+            a->tile_data != b->tile_data ||
+            a->total_n_tiles != b->total_n_tiles ||
+            a->n_tiles_in_play != b->n_tiles_in_play ||
+            a->n_players != b->n_players ||
+            a->n_connected_players != b->n_connected_players) {
+                fprintf(stderr, "Restored conversation has different state\n");
+                return false;
+        }
+
+        for (int i = 0; i < VSX_TILE_DATA_N_TILES; i++) {
+                const VsxTile *ta = a->tiles + i, *tb = b->tiles + i;
+
+                if (ta->x != tb->x ||
+                    ta->y != tb->y ||
+                    ta->last_player != tb->last_player ||
+                    strcmp(ta->letter, tb->letter)) {
+                        fprintf(stderr, "Restored tile %i is different\n", i);
+                        return false;
+                }
+        }
+
+        for (int i = 0; i < a->n_players; i++) {
+                const VsxPlayer *pa = a->players[i], *pb = b->players[i];
+
+                if (strcmp(pa->name, pb->name) ||
+                    (pa->flags & ~VSX_PLAYER_TYPING) != pb->flags) {
+                        fprintf(stderr,
+                                "Restored player %i is different\n",
+                                i);
+                        return false;
+                }
+        }
+
+        if (vsx_conversation_get_n_messages(a) !=
+            vsx_conversation_get_n_messages(b)) {
+                fprintf(stderr,
+                        "Restored conversation has a different number of "
+                        "messages\n");
+                return false;
+        }
+
+        for (int i = 0; i < vsx_conversation_get_n_messages(a); i++) {
+                const VsxConversationMessage *ma =
+                        vsx_conversation_get_message(a, i);
+                const VsxConversationMessage *mb =
+                        vsx_conversation_get_message(b, i);
+
+                if (ma->player_num != mb->player_num ||
+                    strcmp(ma->text, mb->text)) {
+                        fprintf(stderr,
+                                "Restored message %i is different\n",
+                                i);
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+static bool
+check_restored_state(Harness *harness,
+                     VsxConversationSet *conversation_set,
+                     VsxPersonSet *person_set)
+{
+        for (int i = 0; i < VSX_N_ELEMENTS(harness->conversations); i++) {
+                VsxConversation *original = harness->conversations[i];
+                VsxConversation *restored =
+                        vsx_conversation_set_get_conversation(
+                                conversation_set,
+                                original->hash_entry.id);
+
+                if (restored == NULL) {
+                        fprintf(stderr, "Conversation %i not restored\n", i);
+                        return false;
+                }
+
+                if (!compare_conversations(original, restored))
+                        return false;
+        }
+
+        for (int i = 0; i < N_PEOPLE; i++) {
+                VsxPerson *original = harness->people[i];
+                VsxPerson *restored =
+                        vsx_person_set_get_person(person_set,
+                                                  original->hash_entry.id);
+
+                if (!vsx_player_is_connected(original->player)) {
+                        if (restored) {
+                                fprintf(stderr,
+                                        "Person %i was restored after "
+                                        "leaving\n",
+                                        i);
+                                return false;
+                        }
+                        continue;
+                }
+
+                if (restored == NULL) {
+                        fprintf(stderr, "Person %i not restored\n", i);
+                        return false;
+                }
+
+                if (restored->conversation->hash_entry.id !=
+                    original->conversation->hash_entry.id ||
+                    restored->player->num != original->player->num ||
+                    restored->message_offset != original->message_offset) {
+                        fprintf(stderr, "Restored person %i is different\n", i);
+                        return false;
+                }
+        }
+
+        /* The pending conversation should still be joinable by name */
+        struct vsx_netaddress addr;
+        vsx_netaddress_from_string(&addr, "127.0.0.1", 5344);
+
+        VsxConversation *pending =
+                vsx_conversation_set_get_pending_conversation(conversation_set,
+                                                              "eo:pending",
+                                                              &addr);
+        bool ret = true;
+
+        if (pending->hash_entry.id != harness->conversations[0]->hash_entry.id) {
+                fprintf(stderr, "Restored conversation is no longer pending\n");
+                ret = false;
+        }
+
+        vsx_object_unref(pending);
+
+        return ret;
+}
+
+static bool
+write_file(const char *filename,
+           const uint8_t *data,
+           size_t length)
+{
+        FILE *file = fopen(filename, "wb");
+
+        if (file == NULL) {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                return false;
+        }
+
+        fwrite(data, 1, length, file);
+        fclose(file);
+
+        return true;
+}
+
+static bool
+load_snapshot(const char *filename,
+              Harness *harness,
+              bool expect_success)
+{
+        VsxConversationSet *conversation_set = vsx_conversation_set_new();
+        VsxPersonSet *person_set = vsx_person_set_new();
+        struct vsx_error *error = NULL;
+        bool ret = true;
+
+        if (vsx_snapshot_load(filename,
+                              conversation_set,
+                              person_set,
+                              &error)) {
+                if (!expect_success) {
+                        fprintf(stderr, "Loading an invalid snapshot "
+                                "succeeded\n");
+                        ret = false;
+                } else if (harness &&
+                           !check_restored_state(harness,
+                                                 conversation_set,
+                                                 person_set)) {
+                        ret = false;
+                }
+        } else {
+                if (expect_success) {
+                        fprintf(stderr,
+                                "Error loading snapshot: %s\n",
+                                error->message);
+                        ret = false;
+                }
+                vsx_error_free(error);
+        }
+
+        vsx_object_unref(person_set);
+        vsx_object_unref(conversation_set);
+
+        return ret;
+}
+
+static bool
+test_round_trip(const char *filename)
+{
+        Harness harness;
+        bool ret = true;
+
+        create_state(&harness);
+
+        /* Save it with the writer so that the thread also gets
+         * tested.
+         */
+        VsxSnapshotWriter *writer = vsx_snapshot_writer_new(filename);
+        vsx_snapshot_writer_save(writer,
+                                 harness.conversation_set,
+                                 harness.person_set);
+        vsx_snapshot_writer_free(writer);
+
+        if (!load_snapshot(filename, &harness, true /* expect_success */))
+                ret = false;
+
+        free_state(&harness);
+
+        return ret;
+}
+
+static bool
+test_invalid(const char *filename)
+{
+        Harness harness;
+        struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+        bool ret = true;
+
+        create_state(&harness);
+        vsx_snapshot_serialize(harness.conversation_set,
+                               harness.person_set,
+                               &buffer);
+        free_state(&harness);
+
+        /* Every truncated version of the snapshot should fail */
+        for (size_t length = 0; length < buffer.length; length++) {
+                if (!write_file(filename, buffer.data, length) ||
+                    !load_snapshot(filename,
+                                   NULL,
+                                   false /* expect_success */)) {
+                        fprintf(stderr,
+                                "Truncated snapshot of length %zu was "
+                                "accepted\n",
+                                length);
+                        ret = false;
+                        break;
+                }
+        }
+
+        /* Trailing garbage should fail */
+        vsx_buffer_append_c(&buffer, 0);
+
+        if (!write_file(filename, buffer.data, buffer.length) ||
+            !load_snapshot(filename, NULL, false /* expect_success */))
+                ret = false;
+
+        vsx_buffer_destroy(&buffer);
+
+        return ret;
+}
+
+static bool
+test_missing_file(const char *filename)
+{
+        unlink(filename);
+
+        /* A missing file should just restore nothing */
+        return load_snapshot(filename, NULL, true /* expect_success */);
+}
+
+int
+main(int argc, char **argv)
+{
+        int ret = EXIT_SUCCESS;
+        char filename[] = "/tmp/test-snapshot-XXXXXX";
+        int fd = mkstemp(filename);
+
+        if (fd == -1) {
+                fprintf(stderr, "mkstemp failed: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        close(fd);
+
+        if (!test_round_trip(filename))
+                ret = EXIT_FAILURE;
+
+        if (!test_invalid(filename))
+                ret = EXIT_FAILURE;
+
+        if (!test_missing_file(filename))
+                ret = EXIT_FAILURE;
+
+        unlink(filename);
+
+        vsx_main_context_free(vsx_main_context_get_default(NULL /* error */));
+
+        return ret;
+}
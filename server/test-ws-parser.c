@@ -476,6 +476,185 @@ test_success (bool byte_at_a_time)
   return ret;
 }
 
+static bool
+test_plain_http (void)
+{
+  static const char request[] =
+    "GET /metrics?x=y HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n"
+    "TRAILING_DATA";
+  bool ret = true;
+
+  VsxWsParser *parser = vsx_ws_parser_new ();
+
+  vsx_ws_parser_set_require_key (parser, false);
+
+  size_t consumed;
+  struct vsx_error *error = NULL;
+
+  VsxWsParserResult res =
+    vsx_ws_parser_parse_data (parser,
+                              (const uint8_t *) request,
+                              strlen (request),
+                              &consumed,
+                              &error);
+
+  if (res != VSX_WS_PARSER_RESULT_FINISHED)
+    {
+      fprintf (stderr,
+               "plain HTTP test: expected success but result was %i\n",
+               (int) res);
+      if (res == VSX_WS_PARSER_RESULT_ERROR)
+        {
+          fprintf (stderr, " error: %s\n", error->message);
+          vsx_error_free (error);
+        }
+      ret = false;
+    }
+  else
+    {
+      if (strcmp ("TRAILING_DATA", request + consumed))
+        {
+          fprintf (stderr,
+                   "plain HTTP test: didn’t consume until TRAILING_DATA "
+                   "(consumed = %zu)\n",
+                   consumed);
+          ret = false;
+        }
+
+      const char *method = vsx_ws_parser_get_method (parser);
+      const char *uri = vsx_ws_parser_get_uri (parser);
+
+      if (method == NULL || strcmp (method, "GET")
+          || uri == NULL || strcmp (uri, "/metrics?x=y"))
+        {
+          fprintf (stderr,
+                   "plain HTTP test: request line not parsed correctly\n"
+                   " Method: %s\n"
+                   " URI: %s\n",
+                   method ? method : "(null)",
+                   uri ? uri : "(null)");
+          ret = false;
+        }
+
+      size_t key_hash_length;
+      vsx_ws_parser_get_key_hash (parser, &key_hash_length);
+
+      if (key_hash_length != 0)
+        {
+          fprintf (stderr,
+                   "plain HTTP test: unexpected key hash\n");
+          ret = false;
+        }
+    }
+
+  vsx_ws_parser_free (parser);
+
+  return ret;
+}
+
+static bool
+test_protocols (void)
+{
+  static const char request[] =
+    "GET / HTTP/1.1\r\n"
+    "Sec-WebSocket-Key: potato\r\n"
+    "Sec-WebSocket-Protocol: chat, vsx.v2\r\n"
+    "sec-websocket-protocol:\tsuperchat \r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=10\r\n"
+    "sec-websocket-extensions: x-webkit-deflate-frame\r\n"
+    "\r\n";
+  static const char expected_extensions[] =
+    " permessage-deflate; server_max_window_bits=10,"
+    " x-webkit-deflate-frame";
+  static const struct
+  {
+    const char *protocol;
+    bool expected;
+  } checks[] =
+    {
+      { "chat", true },
+      { "vsx.v2", true },
+      { "superchat", true },
+      { "vsx", false },
+      { "vsx.v", false },
+      { "Chat", false },
+    };
+  bool ret = true;
+
+  VsxWsParser *parser = vsx_ws_parser_new ();
+
+  size_t consumed;
+  struct vsx_error *error = NULL;
+
+  VsxWsParserResult res =
+    vsx_ws_parser_parse_data (parser,
+                              (const uint8_t *) request,
+                              strlen (request),
+                              &consumed,
+                              &error);
+
+  if (res != VSX_WS_PARSER_RESULT_FINISHED)
+    {
+      fprintf (stderr,
+               "protocol test: expected success but result was %i\n",
+               (int) res);
+      if (res == VSX_WS_PARSER_RESULT_ERROR)
+        {
+          fprintf (stderr, " error: %s\n", error->message);
+          vsx_error_free (error);
+        }
+      ret = false;
+    }
+  else
+    {
+      for (int i = 0; i < VSX_N_ELEMENTS (checks); i++)
+        {
+          if (vsx_ws_parser_has_protocol (parser, checks[i].protocol)
+              != checks[i].expected)
+            {
+              fprintf (stderr,
+                       "protocol test: has_protocol(\"%s\") should be %s\n",
+                       checks[i].protocol,
+                       checks[i].expected ? "true" : "false");
+              ret = false;
+            }
+        }
+
+      const char *extensions = vsx_ws_parser_get_extensions (parser);
+
+      if (extensions == NULL || strcmp (extensions, expected_extensions))
+        {
+          fprintf (stderr,
+                   "protocol test: extensions are “%s”\n",
+                   extensions ? extensions : "(null)");
+          ret = false;
+        }
+    }
+
+  vsx_ws_parser_free (parser);
+
+  /* A request without the header has no protocols */
+  parser = vsx_ws_parser_new ();
+
+  if (vsx_ws_parser_has_protocol (parser, "vsx.v2"))
+    {
+      fprintf (stderr, "protocol test: empty parser has a protocol\n");
+      ret = false;
+    }
+
+  if (vsx_ws_parser_get_extensions (parser) != NULL)
+    {
+      fprintf (stderr, "protocol test: empty parser has extensions\n");
+      ret = false;
+    }
+
+  vsx_ws_parser_free (parser);
+
+  return ret;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -484,6 +663,12 @@ main (int argc, char **argv)
   if (!test_errors ())
     ret = EXIT_FAILURE;
 
+  if (!test_plain_http ())
+    ret = EXIT_FAILURE;
+
+  if (!test_protocols ())
+    ret = EXIT_FAILURE;
+
   if (test_success (false))
     {
       if (!test_success (true))
@@ -0,0 +1,321 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-capture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vsx-main-context.h"
+#include "vsx-file-error.h"
+#include "vsx-log.h"
+#include "vsx-util.h"
+
+#define VSX_CAPTURE_MAGIC "VSXCAP01"
+
+/* Size of the stdio buffer so that the trace is written in big
+ * chunks.
+ */
+#define VSX_CAPTURE_BUFFER_SIZE (64 * 1024)
+
+/* Maximum length of a varint encoding a uint64_t */
+#define VSX_CAPTURE_MAX_VARINT_LENGTH 10
+
+struct _VsxCaptureReader
+{
+  FILE *file;
+  int64_t time;
+};
+
+struct vsx_error_domain
+vsx_capture_error;
+
+static FILE *
+capture_file = NULL;
+
+static char *
+capture_buffer = NULL;
+
+static uint64_t
+next_connection_id = 1;
+
+static int64_t
+last_record_time;
+
+bool
+vsx_capture_start (const char *filename,
+                   struct vsx_error **error)
+{
+  FILE *file = fopen (filename, "wb");
+
+  if (file == NULL)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "%s: %s",
+                          filename,
+                          strerror (errno));
+      return false;
+    }
+
+  capture_buffer = vsx_alloc (VSX_CAPTURE_BUFFER_SIZE);
+  setvbuf (file, capture_buffer, _IOFBF, VSX_CAPTURE_BUFFER_SIZE);
+
+  fputs (VSX_CAPTURE_MAGIC, file);
+
+  capture_file = file;
+  last_record_time = vsx_main_context_get_monotonic_clock (NULL);
+
+  return true;
+}
+
+static size_t
+write_varint (uint8_t *buf,
+              uint64_t value)
+{
+  size_t length = 0;
+
+  while (value >= 0x80)
+    {
+      buf[length++] = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+
+  buf[length++] = value;
+
+  return length;
+}
+
+static void
+write_record (VsxCaptureRecordType type,
+              uint64_t connection_id,
+              uint64_t generated_id,
+              const uint8_t *payload,
+              size_t payload_length)
+{
+  uint8_t header[1 + VSX_CAPTURE_MAX_VARINT_LENGTH * 3];
+  size_t length = 0;
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+
+  header[length++] = type;
+  length += write_varint (header + length, now - last_record_time);
+  length += write_varint (header + length, connection_id);
+
+  if (type == VSX_CAPTURE_RECORD_COMMAND)
+    length += write_varint (header + length, payload_length);
+  else if (type == VSX_CAPTURE_RECORD_ID)
+    length += write_varint (header + length, generated_id);
+
+  last_record_time = now;
+
+  if (fwrite (header, 1, length, capture_file) != length
+      || (payload_length > 0
+          && fwrite (payload, 1, payload_length, capture_file)
+          != payload_length))
+    {
+      vsx_log ("Error writing capture file: %s", strerror (errno));
+      vsx_capture_stop ();
+    }
+}
+
+uint64_t
+vsx_capture_open_connection (void)
+{
+  if (capture_file == NULL)
+    return 0;
+
+  uint64_t id = next_connection_id++;
+
+  write_record (VSX_CAPTURE_RECORD_OPEN, id, 0, NULL, 0);
+
+  return id;
+}
+
+void
+vsx_capture_command (uint64_t connection_id,
+                     const uint8_t *payload,
+                     size_t payload_length)
+{
+  if (capture_file == NULL || connection_id == 0)
+    return;
+
+  write_record (VSX_CAPTURE_RECORD_COMMAND,
+                connection_id,
+                0, /* generated_id */
+                payload,
+                payload_length);
+}
+
+void
+vsx_capture_close_connection (uint64_t connection_id)
+{
+  if (capture_file == NULL || connection_id == 0)
+    return;
+
+  write_record (VSX_CAPTURE_RECORD_CLOSE, connection_id, 0, NULL, 0);
+}
+
+void
+vsx_capture_generated_id (uint64_t id)
+{
+  if (capture_file == NULL)
+    return;
+
+  write_record (VSX_CAPTURE_RECORD_ID, 0, id, NULL, 0);
+}
+
+void
+vsx_capture_stop (void)
+{
+  if (capture_file == NULL)
+    return;
+
+  fclose (capture_file);
+  capture_file = NULL;
+
+  vsx_free (capture_buffer);
+  capture_buffer = NULL;
+}
+
+VsxCaptureReader *
+vsx_capture_reader_new (const char *filename,
+                        struct vsx_error **error)
+{
+  FILE *file = fopen (filename, "rb");
+
+  if (file == NULL)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "%s: %s",
+                          filename,
+                          strerror (errno));
+      return NULL;
+    }
+
+  char magic[sizeof VSX_CAPTURE_MAGIC - 1];
+
+  if (fread (magic, 1, sizeof magic, file) != sizeof magic
+      || memcmp (magic, VSX_CAPTURE_MAGIC, sizeof magic))
+    {
+      vsx_set_error (error,
+                     &vsx_capture_error,
+                     VSX_CAPTURE_ERROR_INVALID,
+                     "%s: not a capture file",
+                     filename);
+      fclose (file);
+      return NULL;
+    }
+
+  VsxCaptureReader *reader = vsx_calloc (sizeof *reader);
+
+  reader->file = file;
+
+  return reader;
+}
+
+static bool
+read_varint (VsxCaptureReader *reader,
+             uint64_t *value_out)
+{
+  uint64_t value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+    {
+      int ch = getc (reader->file);
+
+      if (ch == EOF)
+        return false;
+
+      value |= (uint64_t) (ch & 0x7f) << shift;
+
+      if ((ch & 0x80) == 0)
+        {
+          *value_out = value;
+          return true;
+        }
+    }
+
+  return false;
+}
+
+VsxCaptureReadResult
+vsx_capture_reader_read (VsxCaptureReader *reader,
+                         VsxCaptureRecord *record,
+                         struct vsx_error **error)
+{
+  int type = getc (reader->file);
+
+  if (type == EOF)
+    return VSX_CAPTURE_READ_RESULT_END;
+
+  uint64_t time_delta, payload_length = 0, generated_id = 0;
+
+  if (!read_varint (reader, &time_delta)
+      || !read_varint (reader, &record->connection_id))
+    goto error;
+
+  switch (type)
+    {
+    case VSX_CAPTURE_RECORD_COMMAND:
+      if (!read_varint (reader, &payload_length)
+          || payload_length < 1
+          || payload_length > sizeof record->payload
+          || fread (record->payload,
+                    1,
+                    payload_length,
+                    reader->file) != payload_length)
+        goto error;
+      break;
+    case VSX_CAPTURE_RECORD_ID:
+      if (!read_varint (reader, &generated_id))
+        goto error;
+      break;
+    case VSX_CAPTURE_RECORD_OPEN:
+    case VSX_CAPTURE_RECORD_CLOSE:
+      break;
+    default:
+      goto error;
+    }
+
+  reader->time += time_delta;
+
+  record->type = type;
+  record->time = reader->time;
+  record->generated_id = generated_id;
+  record->payload_length = payload_length;
+
+  return VSX_CAPTURE_READ_RESULT_RECORD;
+
+error:
+  vsx_set_error (error,
+                 &vsx_capture_error,
+                 VSX_CAPTURE_ERROR_INVALID,
+                 "Invalid record in capture file");
+  return VSX_CAPTURE_READ_RESULT_ERROR;
+}
+
+void
+vsx_capture_reader_free (VsxCaptureReader *reader)
+{
+  fclose (reader->file);
+  vsx_free (reader);
+}
@@ -0,0 +1,122 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_CAPTURE_H
+#define VSX_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vsx-error.h"
+#include "vsx-proto.h"
+
+/* Records the commands received on every connection to a single file
+ * so that they can be replayed later with verda-sxtelo-replay. The
+ * file starts with an 8-byte magic string followed by a series of
+ * records. Each record is a type byte followed by the time in
+ * microseconds since the previous record and the connection ID, both
+ * encoded as LEB128 varints. Command records then have the length of
+ * the payload as another varint followed by the payload as it was
+ * received after removing the WebSocket framing. The command record
+ * is written after the command has been handled and any IDs that the
+ * server generated for it are written before it as ID records with a
+ * zero connection ID followed by the generated ID as another varint.
+ *
+ * Note that the payloads include everything the players sent,
+ * including their names and chat messages.
+ */
+
+extern struct vsx_error_domain
+vsx_capture_error;
+
+typedef enum
+{
+  VSX_CAPTURE_ERROR_INVALID
+} VsxCaptureError;
+
+typedef enum
+{
+  VSX_CAPTURE_RECORD_OPEN = 1,
+  VSX_CAPTURE_RECORD_COMMAND = 2,
+  VSX_CAPTURE_RECORD_CLOSE = 3,
+  VSX_CAPTURE_RECORD_ID = 4,
+} VsxCaptureRecordType;
+
+typedef struct
+{
+  VsxCaptureRecordType type;
+  /* Monotonic time in microseconds relative to the first record */
+  int64_t time;
+  uint64_t connection_id;
+  /* Only used for ID records */
+  uint64_t generated_id;
+  /* Only used for command records */
+  size_t payload_length;
+  uint8_t payload[VSX_PROTO_MAX_PAYLOAD_SIZE];
+} VsxCaptureRecord;
+
+typedef enum
+{
+  VSX_CAPTURE_READ_RESULT_RECORD,
+  VSX_CAPTURE_READ_RESULT_END,
+  VSX_CAPTURE_READ_RESULT_ERROR,
+} VsxCaptureReadResult;
+
+typedef struct _VsxCaptureReader VsxCaptureReader;
+
+bool
+vsx_capture_start (const char *filename,
+                   struct vsx_error **error);
+
+/* Returns an ID to pass to the other functions, or zero if capturing
+ * isn’t enabled.
+ */
+uint64_t
+vsx_capture_open_connection (void);
+
+void
+vsx_capture_command (uint64_t connection_id,
+                     const uint8_t *payload,
+                     size_t payload_length);
+
+void
+vsx_capture_close_connection (uint64_t connection_id);
+
+/* Records an ID that was generated for a person or a conversation so
+ * that the replay can generate the same one.
+ */
+void
+vsx_capture_generated_id (uint64_t id);
+
+void
+vsx_capture_stop (void);
+
+VsxCaptureReader *
+vsx_capture_reader_new (const char *filename,
+                        struct vsx_error **error);
+
+VsxCaptureReadResult
+vsx_capture_reader_read (VsxCaptureReader *reader,
+                         VsxCaptureRecord *record,
+                         struct vsx_error **error);
+
+void
+vsx_capture_reader_free (VsxCaptureReader *reader);
+
+#endif /* VSX_CAPTURE_H */
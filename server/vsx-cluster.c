@@ -0,0 +1,162 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-cluster.h"
+
+#include <stdlib.h>
+
+#include "vsx-util.h"
+
+/* Each node is placed at this many points on the ring so that the
+ * share of each node is roughly even.
+ */
+#define VSX_CLUSTER_POINTS_PER_NODE 64
+
+typedef struct
+{
+  uint64_t hash;
+  int node;
+} VsxClusterPoint;
+
+struct _VsxCluster
+{
+  int n_nodes;
+  int n_points;
+  VsxClusterPoint *points;
+};
+
+/* The finaliser from SplitMix64. The IDs are already random but the
+ * names and the point positions are not so everything is mixed
+ * before being put on the ring.
+ */
+static uint64_t
+mix (uint64_t x)
+{
+  x ^= x >> 30;
+  x *= UINT64_C (0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C (0x94d049bb133111eb);
+  x ^= x >> 31;
+
+  return x;
+}
+
+static int
+compare_points (const void *a,
+                const void *b)
+{
+  const VsxClusterPoint *pa = a, *pb = b;
+
+  if (pa->hash < pb->hash)
+    return -1;
+  if (pa->hash > pb->hash)
+    return 1;
+
+  return pa->node - pb->node;
+}
+
+VsxCluster *
+vsx_cluster_new (int n_nodes)
+{
+  VsxCluster *cluster = vsx_alloc (sizeof *cluster);
+
+  cluster->n_nodes = n_nodes;
+  cluster->n_points = n_nodes * VSX_CLUSTER_POINTS_PER_NODE;
+  cluster->points = vsx_alloc (sizeof (VsxClusterPoint) * cluster->n_points);
+
+  for (int node = 0; node < n_nodes; node++)
+    {
+      for (int i = 0; i < VSX_CLUSTER_POINTS_PER_NODE; i++)
+        {
+          VsxClusterPoint *point =
+            cluster->points + node * VSX_CLUSTER_POINTS_PER_NODE + i;
+
+          point->hash = mix (((uint64_t) node << 32) | i);
+          point->node = node;
+        }
+    }
+
+  qsort (cluster->points,
+         cluster->n_points,
+         sizeof (VsxClusterPoint),
+         compare_points);
+
+  return cluster;
+}
+
+int
+vsx_cluster_get_n_nodes (const VsxCluster *cluster)
+{
+  return cluster->n_nodes;
+}
+
+static int
+get_node_for_hash (const VsxCluster *cluster,
+                   uint64_t hash)
+{
+  /* Find the first point that is >= the hash */
+  int min = 0, max = cluster->n_points;
+
+  while (min < max)
+    {
+      int mid = (min + max) / 2;
+
+      if (cluster->points[mid].hash < hash)
+        min = mid + 1;
+      else
+        max = mid;
+    }
+
+  /* Wrap around to the start of the ring */
+  if (min >= cluster->n_points)
+    min = 0;
+
+  return cluster->points[min].node;
+}
+
+int
+vsx_cluster_get_node_for_id (const VsxCluster *cluster,
+                             uint64_t id)
+{
+  return get_node_for_hash (cluster, mix (id));
+}
+
+int
+vsx_cluster_get_node_for_name (const VsxCluster *cluster,
+                               const char *name)
+{
+  /* FNV-1a */
+  uint64_t hash = UINT64_C (0xcbf29ce484222325);
+
+  for (const char *p = name; *p; p++)
+    {
+      hash ^= (uint8_t) *p;
+      hash *= UINT64_C (0x100000001b3);
+    }
+
+  return get_node_for_hash (cluster, mix (hash));
+}
+
+void
+vsx_cluster_free (VsxCluster *cluster)
+{
+  vsx_free (cluster->points);
+  vsx_free (cluster);
+}
@@ -0,0 +1,70 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_CLUSTER_H
+#define VSX_CLUSTER_H
+
+#include <stdint.h>
+
+/* In cluster mode several backend processes each own a share of the
+ * games. A router process accepts the WebSocket connections, answers
+ * the handshake, reads the first command and passes the socket to the
+ * backend that owns the game. The owner is found with a consistent hash ring so that
+ * the router and the backends agree without talking to each other and
+ * so that changing the number of backends only moves a small share
+ * of the games.
+ */
+
+/* Maximum size of the data that the router forwards along with a
+ * socket. This is the HTTP request and the first frames that it read
+ * while looking for the command.
+ */
+#define VSX_CLUSTER_MAX_HANDOFF_SIZE 16384
+
+/* The data sent with a socket starts with one byte of flags before
+ * the data read from the client.
+ */
+#define VSX_CLUSTER_HANDOFF_HEADER_SIZE 1
+
+/* Set if the router has already sent the handshake response. The
+ * response never accepts any extensions.
+ */
+#define VSX_CLUSTER_HANDOFF_FLAG_RESPONSE_SENT (1 << 0)
+
+typedef struct _VsxCluster VsxCluster;
+
+VsxCluster *
+vsx_cluster_new (int n_nodes);
+
+int
+vsx_cluster_get_n_nodes (const VsxCluster *cluster);
+
+/* Returns the node that owns a conversation or person ID */
+int
+vsx_cluster_get_node_for_id (const VsxCluster *cluster,
+                             uint64_t id);
+
+/* Returns the node that owns the public room with the given name */
+int
+vsx_cluster_get_node_for_name (const VsxCluster *cluster,
+                               const char *name);
+
+void
+vsx_cluster_free (VsxCluster *cluster);
+
+#endif /* VSX_CLUSTER_H */
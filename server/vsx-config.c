@@ -23,6 +23,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "vsx-key-value.h"
 #include "vsx-util.h"
@@ -92,6 +93,8 @@ static const Option server_options[] = {
   OPTION (certificate, STRING),
   OPTION (private_key, STRING),
   OPTION (private_key_password, STRING),
+  OPTION (proxy_protocol, BOOL),
+  OPTION (metrics, BOOL),
 #undef OPTION
 };
 
@@ -105,6 +108,24 @@ static const Option general_options[] = {
   OPTION (log_file, STRING),
   OPTION (user, STRING),
   OPTION (group, STRING),
+  OPTION (handshake_threads, INT),
+  OPTION (capture_file, STRING),
+  OPTION (snapshot_file, STRING),
+  OPTION (snapshot_interval, INT),
+  OPTION (upgrade_socket, STRING),
+  OPTION (cluster_socket, STRING),
+  OPTION (cluster_node, INT),
+  OPTION (cluster_size, INT),
+  OPTION (move_tile_rate, INT),
+  OPTION (move_tile_burst, INT),
+  OPTION (message_rate, INT),
+  OPTION (message_burst, INT),
+  OPTION (typing_rate, INT),
+  OPTION (typing_burst, INT),
+  OPTION (max_connections_per_ip, INT),
+  OPTION (broadcast_rate, INT),
+  OPTION (deflate_window_bits, INT),
+  OPTION (deflate_threshold, INT),
 #undef OPTION
 };
 
@@ -131,14 +152,18 @@ set_option (LoadConfigData *data,
       }
     case OPTION_TYPE_INT:
       {
-        int64_t *ptr = (int64_t *) ((uint8_t *) config_item + option->offset);
+        int *ptr = (int *) ((uint8_t *) config_item + option->offset);
         errno = 0;
         char *tail;
-        *ptr = strtoll (value, &tail, 10);
-        if (errno || *tail)
+        long long_value = strtol (value, &tail, 10);
+        if (errno || *tail || long_value < INT_MIN || long_value > INT_MAX)
           {
             load_config_error (data, "invalid value for %s", option->key);
           }
+        else
+          {
+            *ptr = long_value;
+          }
         break;
       }
     case OPTION_TYPE_BOOL:
@@ -257,6 +282,28 @@ validate_server (VsxConfigServer *server,
       return false;
     }
 
+  if (server->proxy_protocol && server->certificate)
+    {
+      vsx_set_error (error,
+                     &vsx_config_error,
+                     VSX_CONFIG_ERROR_IO,
+                     "%s: the PROXY protocol can’t be used together with "
+                     "SSL",
+                     filename);
+      return false;
+    }
+
+  if (server->metrics && (server->certificate || server->proxy_protocol))
+    {
+      vsx_set_error (error,
+                     &vsx_config_error,
+                     VSX_CONFIG_ERROR_IO,
+                     "%s: the metrics listener can’t use SSL or the PROXY "
+                     "protocol",
+                     filename);
+      return false;
+    }
+
   if (server->private_key_password && server->private_key == NULL)
     {
       vsx_set_error (error,
@@ -284,9 +331,28 @@ validate_config (VsxConfig *config,
   {
     if (!validate_server (server, filename, error))
       return false;
-    found_something = true;
+    if (!server->metrics)
+      found_something = true;
   }
 
+  if (config->cluster_socket)
+    {
+      if (config->cluster_size < 1
+          || config->cluster_node < 0
+          || config->cluster_node >= config->cluster_size)
+        {
+          vsx_set_error (error,
+                         &vsx_config_error,
+                         VSX_CONFIG_ERROR_IO,
+                         "%s: cluster_node must be less than cluster_size",
+                         filename);
+          return false;
+        }
+
+      /* A backend can get all of its connections from the router */
+      found_something = true;
+    }
+
   if (!found_something)
     {
       vsx_set_error (error,
@@ -356,6 +422,19 @@ vsx_config_load (const char *filename, struct vsx_error **error)
   VsxConfig *config = vsx_calloc (sizeof *config);
 
   vsx_list_init (&config->servers);
+  config->handshake_threads = -1;
+  config->snapshot_interval = 5;
+  config->cluster_size = 1;
+  /* These are well above what a person can do in the real client */
+  config->move_tile_rate = 100;
+  config->move_tile_burst = 200;
+  config->message_rate = 5;
+  config->message_burst = 20;
+  config->typing_rate = 20;
+  config->typing_burst = 40;
+  config->broadcast_rate = 30;
+  config->deflate_window_bits = 11;
+  config->deflate_threshold = 32;
 
   if (!load_config (filename, config, error))
     goto error;
@@ -391,6 +470,10 @@ vsx_config_free (VsxConfig *config)
   vsx_free (config->user);
   vsx_free (config->group);
   vsx_free (config->log_file);
+  vsx_free (config->capture_file);
+  vsx_free (config->snapshot_file);
+  vsx_free (config->upgrade_socket);
+  vsx_free (config->cluster_socket);
 
   vsx_free (config);
 }
@@ -19,6 +19,8 @@
 #ifndef VSX_CONFIG_H
 #define VSX_CONFIG_H
 
+#include <stdbool.h>
+
 #include "vsx-list.h"
 #include "vsx-error.h"
 
@@ -30,11 +32,22 @@ typedef enum
 typedef struct
 {
   struct vsx_list link;
+  /* This can be an IPv4 or IPv6 address, or “unix:” followed by the
+   * path of a UNIX domain socket.
+   */
   char *address;
   int port;
   char *certificate;
   char *private_key;
   char *private_key_password;
+  /* If true then each connection is expected to start with a version 2
+   * PROXY protocol header which contains the real client’s address.
+   */
+  bool proxy_protocol;
+  /* If true then this listener serves the metrics over HTTP instead
+   * of running the game.
+   */
+  bool metrics;
 } VsxConfigServer;
 
 typedef struct
@@ -42,6 +55,58 @@ typedef struct
   char *log_file;
   char *user;
   char *group;
+  /* Number of threads to use for TLS handshakes. Zero means to do
+   * them on the main thread and -1 means to pick a number based on
+   * the number of CPUs.
+   */
+  int handshake_threads;
+  /* If set, every command received from the clients is recorded to
+   * this file so that it can be replayed later.
+   */
+  char *capture_file;
+  /* If set, the games are saved to this file periodically and when
+   * the server quits, and restored from it when the server starts.
+   */
+  char *snapshot_file;
+  /* Minutes between each save of the snapshot */
+  int snapshot_interval;
+  /* If set, a new version of the server started with -U can connect
+   * to this UNIX socket to take over from the running one.
+   */
+  char *upgrade_socket;
+  /* If set, the server is a backend in a cluster and receives
+   * connections from the router on this UNIX socket. cluster_node is
+   * the index of this backend and cluster_size is the number of
+   * backends.
+   */
+  char *cluster_socket;
+  int cluster_node;
+  int cluster_size;
+  /* Commands per second that a connection can send on average for
+   * each class of command and how many it can send in a burst. A rate
+   * of zero disables the limit.
+   */
+  int move_tile_rate;
+  int move_tile_burst;
+  int message_rate;
+  int message_burst;
+  int typing_rate;
+  int typing_burst;
+  /* Maximum connections from one client address, or zero for no
+   * limit.
+   */
+  int max_connections_per_ip;
+  /* Times per second that tile moves are broadcast to each game, or
+   * zero to send them immediately.
+   */
+  int broadcast_rate;
+  /* Base-two logarithm of the largest window for permessage-deflate
+   * compression, which caps the memory used by each connection, or
+   * zero to disable it. Messages shorter than deflate_threshold are
+   * never compressed.
+   */
+  int deflate_window_bits;
+  int deflate_threshold;
   struct vsx_list servers;
 } VsxConfig;
 
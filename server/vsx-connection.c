@@ -25,12 +25,14 @@
 #include <string.h>
 
 #include "vsx-ws-parser.h"
+#include "vsx-ws-response.h"
 #include "vsx-proto.h"
 #include "vsx-log.h"
 #include "vsx-bitmask.h"
 #include "vsx-normalize-name.h"
-#include "vsx-base64.h"
 #include "vsx-util.h"
+#include "vsx-metrics.h"
+#include "vsx-capture.h"
 
 typedef enum
 {
@@ -52,6 +54,40 @@ typedef enum
   VSX_CONNECTION_DIRTY_FLAG_PENDING_ERROR = (1 << 8),
 } VsxConnectionDirtyFlag;
 
+/* Dirty flags that need to be kept when the connection is handed over
+ * to another process. The rest are recreated by
+ * start_following_person.
+ */
+#define VSX_CONNECTION_SAVED_DIRTY_FLAGS                \
+  (VSX_CONNECTION_DIRTY_FLAG_WS_HEADER                  \
+   | VSX_CONNECTION_DIRTY_FLAG_PONG                     \
+   | VSX_CONNECTION_DIRTY_FLAG_PENDING_SHOUT            \
+   | VSX_CONNECTION_DIRTY_FLAG_PENDING_ERROR)
+
+typedef struct
+{
+  int16_t x, y;
+} VsxConnectionTilePosition;
+
+/* Size of the fixed part of the saved state. This is the address
+ * family, port and address of the client, the person ID, the message
+ * number, the dirty flags, the pending error, the pending shout, the
+ * protocol flags and then the lengths of the pong data, the read
+ * buffer and the message data. The variable-length data follows in
+ * the same order. If version 2 of the protocol is used then the sent
+ * and received tile positions follow that.
+ */
+#define VSX_CONNECTION_STATE_ADDRESS_SIZE (sizeof (struct in6_addr))
+#define VSX_CONNECTION_STATE_HEADER_SIZE                \
+  (2 + 2 + VSX_CONNECTION_STATE_ADDRESS_SIZE            \
+   + 8 + 4 + 2 + 1 + 1 + 1 + 1 + 2 + 2)
+#define VSX_CONNECTION_STATE_POSITIONS_SIZE     \
+  (VSX_TILE_DATA_N_TILES * 2 * 2 * sizeof (int16_t))
+
+/* Bits for the protocol flags in the saved state */
+#define VSX_CONNECTION_STATE_FLAG_V2 (1 << 0)
+#define VSX_CONNECTION_STATE_FLAG_V2_INPUT (1 << 1)
+
 struct _VsxConnection
 {
   VsxConnectionState state;
@@ -60,7 +96,37 @@ struct _VsxConnection
 
   int64_t last_message_time;
 
+  /* Time of the oldest change to the conversation that hasn’t been
+   * collected with vsx_connection_take_change_time yet, or zero if
+   * there isn’t one or metrics are disabled.
+   */
+  int64_t change_time;
+
+  /* ID used to record this connection in the capture file, or zero
+   * if capturing is disabled.
+   */
+  uint64_t capture_id;
+
   struct vsx_netaddress socket_address;
+
+  /* Array of limits for each VsxConnectionRateClass or NULL */
+  const VsxConnectionRateLimit *rate_limits;
+  /* For each class, the earliest time that the next command would be
+   * allowed if the client had stuck to the average rate. The bucket
+   * is full when this is in the past and a command is over the limit
+   * when this is more than the burst allowance in the future.
+   */
+  int64_t rate_times[VSX_CONNECTION_N_RATE_CLASSES];
+
+  /* Tiles that the client moved while MOVE_TILE was over the rate
+   * limit. Only the latest position of each tile is kept and they are
+   * applied by vsx_connection_apply_deferred_moves once the bucket
+   * refills so that the end of a long drag isn’t lost.
+   */
+  vsx_bitmask_element_t deferred_tiles
+  [VSX_BITMASK_N_ELEMENTS_FOR_SIZE (VSX_TILE_DATA_N_TILES)];
+  VsxConnectionTilePosition deferred_tile_positions[VSX_TILE_DATA_N_TILES];
+
   VsxConversationSet *conversation_set;
   VsxPersonSet *person_set;
 
@@ -114,17 +180,52 @@ struct _VsxConnection
                   "The message size is too long for a uint16_t");
   uint16_t message_data_length;
   uint8_t message_data[VSX_PROTO_MAX_PAYLOAD_SIZE];
-};
 
-static const char
-ws_header_prefix[] =
-  "HTTP/1.1 101 Switching Protocols\r\n"
-  "Upgrade: websocket\r\n"
-  "Connection: Upgrade\r\n"
-  "Sec-WebSocket-Accept: ";
+  /* The command that is currently being handled. This usually points
+   * into message_data.
+   */
+  const uint8_t *command_data;
+  size_t command_length;
+
+  /* True if the client asked for version 2 of the protocol with the
+   * Sec-WebSocket-Protocol header. In that case every message sent to
+   * the client is packed. The client can’t pack its first message
+   * because it doesn’t know whether the server supports version 2
+   * until it gets the response, so v2_input only becomes true after
+   * that.
+   */
+  bool v2;
+  bool v2_input;
+
+  /* True if the handshake response was already sent before the
+   * connection was handed to us.
+   */
+  bool response_sent;
+
+  /* In version 2 the tile positions are sent as the difference from
+   * the last position sent for the same tile on this connection.
+   * These are the last positions in each direction.
+   */
+  VsxConnectionTilePosition sent_tile_positions[VSX_TILE_DATA_N_TILES];
+  VsxConnectionTilePosition received_tile_positions[VSX_TILE_DATA_N_TILES];
 
-static const char
-ws_header_postfix[] = "\r\n\r\n";
+  /* Options for permessage-deflate, or NULL if it is disabled */
+  const VsxDeflateOptions *deflate_options;
+  /* The compression state if the client negotiated permessage-deflate
+   * or NULL otherwise.
+   */
+  VsxDeflate *deflate;
+  /* True if the message being read had the RSV1 bit set on its first
+   * frame.
+   */
+  bool message_compressed;
+  /* Frames that have been compressed but didn’t fit in the output
+   * buffer yet. deflate_output_pos bytes of it have already been
+   * sent.
+   */
+  struct vsx_buffer deflate_output;
+  size_t deflate_output_pos;
+};
 
 struct vsx_error_domain
 vsx_connection_error;
@@ -169,6 +270,9 @@ conversation_changed_cb (struct vsx_listener *listener,
       break;
     }
 
+  if (conn->change_time == 0)
+    conn->change_time = vsx_metrics_get_time ();
+
   vsx_signal_emit (&conn->changed_signal, NULL);
 }
 
@@ -198,8 +302,8 @@ handle_new_private_game (VsxConnection *conn,
 {
   const char *language_code, *player_name;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_STRING,
                                &language_code,
@@ -268,8 +372,8 @@ handle_join_game (VsxConnection *conn,
   uint64_t conversation_id;
   const char *player_name;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_UINT64,
                                &conversation_id,
@@ -346,8 +450,8 @@ handle_new_player (VsxConnection *conn,
 {
   const char *room_name, *player_name;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_STRING,
                                &room_name,
@@ -440,8 +544,8 @@ handle_reconnect (VsxConnection *conn,
   uint64_t player_id;
   uint16_t n_messages_received;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_UINT64,
                                &player_id,
@@ -524,7 +628,7 @@ ensure_empty_payload (VsxConnection *conn,
                       const char *message_type,
                       struct vsx_error **error)
 {
-  if (conn->message_data_length != 1)
+  if (conn->command_length != 1)
     {
       vsx_set_error (error,
                      &vsx_connection_error,
@@ -605,8 +709,8 @@ handle_send_message (VsxConnection *conn,
 {
   const char *message;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_STRING,
                                &message,
@@ -643,8 +747,8 @@ handle_move_tile (VsxConnection *conn,
   uint8_t tile_num;
   int16_t tile_x, tile_y;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_UINT8,
                                &tile_num,
@@ -723,8 +827,8 @@ handle_set_n_tiles (VsxConnection *conn,
 {
   uint8_t n_tiles;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_UINT8,
                                &n_tiles,
@@ -754,8 +858,8 @@ handle_set_language (VsxConnection *conn,
 {
   const char *language_code;
 
-  if (!vsx_proto_read_payload (conn->message_data + 1,
-                               conn->message_data_length - 1,
+  if (!vsx_proto_read_payload (conn->command_data + 1,
+                               conn->command_length - 1,
 
                                VSX_PROTO_TYPE_STRING,
                                &language_code,
@@ -789,21 +893,10 @@ handle_set_language (VsxConnection *conn,
 }
 
 static bool
-process_message (VsxConnection *conn,
-                 struct vsx_error **error)
+handle_message (VsxConnection *conn,
+                struct vsx_error **error)
 {
-  if (conn->message_data_length < 1)
-    {
-      vsx_set_error (error,
-                     &vsx_connection_error,
-                     VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
-                     "Client sent an empty message");
-      return false;
-    }
-
-  conn->last_message_time = vsx_main_context_get_monotonic_clock (NULL);
-
-  switch (conn->message_data[0])
+  switch (conn->command_data[0])
     {
     case VSX_PROTO_NEW_PRIVATE_GAME:
       return handle_new_private_game (conn, error);
@@ -839,205 +932,874 @@ process_message (VsxConnection *conn,
                  &vsx_connection_error,
                  VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
                  "Client sent an unknown message ID (0x%x)",
-                 conn->message_data[0]);
+                 conn->command_data[0]);
 
   return false;
 }
 
-VsxConnection *
-vsx_connection_new (const struct vsx_netaddress *socket_address,
-                    VsxConversationSet *conversation_set,
-                    VsxPersonSet *person_set)
+static int
+get_rate_class (uint8_t command)
 {
-  VsxConnection *conn = vsx_calloc (sizeof *conn);
+  switch (command)
+    {
+    case VSX_PROTO_MOVE_TILE:
+      return VSX_CONNECTION_RATE_CLASS_MOVE_TILE;
+    case VSX_PROTO_SEND_MESSAGE:
+      return VSX_CONNECTION_RATE_CLASS_MESSAGE;
+    case VSX_PROTO_START_TYPING:
+      return VSX_CONNECTION_RATE_CLASS_TYPING;
+    }
 
-  conn->socket_address = *socket_address;
-  conn->conversation_set = vsx_object_ref (conversation_set);
-  conn->person_set = vsx_object_ref (person_set);
+  /* STOP_TYPING is never limited because dropping it would leave the
+   * player marked as typing.
+   */
+  return -1;
+}
 
-  conn->ws_parser = vsx_ws_parser_new ();
+static const VsxConnectionRateLimit *
+get_rate_limit (VsxConnection *conn,
+                int rate_class)
+{
+  if (conn->rate_limits == NULL || rate_class == -1)
+    return NULL;
 
-  conn->last_message_time = vsx_main_context_get_monotonic_clock (NULL);
+  const VsxConnectionRateLimit *limit = conn->rate_limits + rate_class;
 
-  vsx_signal_init (&conn->changed_signal);
+  if (limit->rate <= 0)
+    return NULL;
 
-  return conn;
+  return limit;
 }
 
-static bool
-has_pending_data (VsxConnection *conn)
+/* Returns the earliest time that a command in the class will be
+ * allowed. If this is not after the current time then the command is
+ * allowed now.
+ */
+static int64_t
+get_rate_allowed_time (VsxConnection *conn,
+                       int rate_class,
+                       const VsxConnectionRateLimit *limit)
 {
-  if (conn->dirty_flags)
-    return true;
+  int64_t interval = 1000000 / limit->rate;
+  int64_t allowance = interval * MAX (limit->burst - 1, 0);
 
-  if (conn->person
-      && conn->named_players < conn->person->conversation->n_players)
-    return true;
+  return conn->rate_times[rate_class] - allowance;
+}
 
-  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_players); i++)
-    {
-      if (conn->dirty_players[i])
-        return true;
-    }
+static bool
+is_rate_limited (VsxConnection *conn,
+                 uint8_t command)
+{
+  int rate_class = get_rate_class (command);
+  const VsxConnectionRateLimit *limit = get_rate_limit (conn, rate_class);
 
-  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_tiles); i++)
-    {
-      if (conn->dirty_tiles[i])
-        return true;
-    }
+  if (limit == NULL)
+    return false;
 
-  if (conn->person
-      && (conn->message_num
-          < vsx_conversation_get_n_messages (conn->person->conversation)))
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+
+  if (get_rate_allowed_time (conn, rate_class, limit) > now)
     return true;
 
+  conn->rate_times[rate_class] =
+    MAX (conn->rate_times[rate_class], now) + 1000000 / limit->rate;
+
   return false;
 }
 
-static int
-write_player_name (VsxConnection *conn,
-                   uint8_t *buffer,
-                   size_t buffer_size)
+static bool
+run_command (VsxConnection *conn,
+             const uint8_t *data,
+             size_t length,
+             struct vsx_error **error)
 {
-  /* This returns -1 if there wasn’t enough space, 0 if there are no
-   * players to write or the size of the written data if one name was
-   * written. We can only write one name at a time because there’s no
-   * way to return that we wrote some data but still need to write
-   * more.
-   */
+  conn->command_data = data;
+  conn->command_length = length;
 
-  if (conn->person == NULL)
-    return 0;
+  vsx_metrics_count_command (data[0]);
 
-  VsxConversation *conversation = conn->person->conversation;
+  int64_t start_time = vsx_metrics_get_time ();
 
-  if (conn->named_players >= conversation->n_players)
-    return 0;
+  bool ret = handle_message (conn, error);
 
-  const VsxPlayer *player = conversation->players[conn->named_players];
+  /* This is recorded after handling the message so that any IDs
+   * generated for it are recorded first.
+   */
+  vsx_capture_command (conn->capture_id, data, length);
+
+  if (start_time)
+    {
+      vsx_metrics_observe (VSX_METRICS_HISTOGRAM_COMMAND_TIME,
+                           vsx_metrics_get_time () - start_time);
+    }
+
+  return ret;
+}
 
-  int wrote = vsx_proto_write_command (buffer,
-                                       buffer_size,
+static bool
+defer_move_tile (VsxConnection *conn,
+                 const uint8_t *data,
+                 size_t length,
+                 struct vsx_error **error)
+{
+  uint8_t tile_num;
+  int16_t tile_x, tile_y;
 
-                                       VSX_PROTO_PLAYER_NAME,
+  if (!vsx_proto_read_payload (data + 1,
+                               length - 1,
 
-                                       VSX_PROTO_TYPE_UINT8,
-                                       conn->named_players,
+                               VSX_PROTO_TYPE_UINT8,
+                               &tile_num,
 
-                                       VSX_PROTO_TYPE_STRING,
-                                       player->name,
+                               VSX_PROTO_TYPE_INT16,
+                               &tile_x,
 
-                                       VSX_PROTO_TYPE_NONE);
+                               VSX_PROTO_TYPE_INT16,
+                               &tile_y,
 
-  if (wrote == -1)
+                               VSX_PROTO_TYPE_NONE)
+      || tile_num >= VSX_TILE_DATA_N_TILES)
     {
-      return -1;
+      vsx_set_error (error,
+                     &vsx_connection_error,
+                     VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                     "Invalid move tile command received");
+      return false;
     }
-  else
+
+  VsxConnectionTilePosition *position =
+    conn->deferred_tile_positions + tile_num;
+
+  position->x = tile_x;
+  position->y = tile_y;
+
+  vsx_bitmask_set (conn->deferred_tiles, tile_num, true);
+
+  return true;
+}
+
+static bool
+has_deferred_moves (VsxConnection *conn)
+{
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->deferred_tiles); i++)
     {
-      conn->named_players++;
-      return wrote;
+      if (conn->deferred_tiles[i])
+        return true;
     }
+
+  return false;
 }
 
-static int
-write_player (VsxConnection *conn,
-              uint8_t *buffer,
-              size_t buffer_size)
+static bool
+process_command (VsxConnection *conn,
+                 const uint8_t *data,
+                 size_t length,
+                 struct vsx_error **error)
 {
-  /* This returns -1 if there wasn’t enough space, 0 if there are no
-   * players to write or the size of the written data if one player was
-   * written. We can only write one player at a time because there’s
-   * no way to return that we wrote some data but still need to write
-   * more.
-   */
+  if (length < 1)
+    {
+      vsx_set_error (error,
+                     &vsx_connection_error,
+                     VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                     "Client sent an empty message");
+      return false;
+    }
 
-  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_players); i++)
+  conn->last_message_time = vsx_main_context_get_monotonic_clock (NULL);
+
+  /* The command is dropped without telling the client. This isn’t
+   * recorded in the capture either so that the replay matches what
+   * the server did. Tile moves are held back instead and recorded
+   * when they are applied.
+   */
+  if (is_rate_limited (conn, data[0]))
     {
-      if (conn->dirty_players[i] == 0)
-        continue;
+      vsx_metrics_count (VSX_METRICS_COUNTER_COMMANDS_RATE_LIMITED, 1);
 
-      int bit_num = ffsl (conn->dirty_players[i]) - 1;
-      int player_num = i * sizeof (unsigned long) * 8 + bit_num;
+      if (data[0] == VSX_PROTO_MOVE_TILE)
+        return defer_move_tile (conn, data, length, error);
 
-      const VsxPlayer *player = conn->person->conversation->players[player_num];
+      return true;
+    }
 
-      int wrote = vsx_proto_write_command (buffer,
-                                           buffer_size,
+  /* A held back position for the same tile is now out of date */
+  if (data[0] == VSX_PROTO_MOVE_TILE
+      && length >= 2
+      && data[1] < VSX_TILE_DATA_N_TILES)
+    vsx_bitmask_set (conn->deferred_tiles, data[1], false);
 
-                                           VSX_PROTO_PLAYER,
+  return run_command (conn, data, length, error);
+}
 
-                                           VSX_PROTO_TYPE_UINT8,
-                                           player_num,
+int64_t
+vsx_connection_get_deferred_move_time (VsxConnection *conn)
+{
+  if (!has_deferred_moves (conn))
+    return INT64_MAX;
 
-                                           VSX_PROTO_TYPE_UINT8,
-                                           player->flags,
+  int rate_class = VSX_CONNECTION_RATE_CLASS_MOVE_TILE;
+  const VsxConnectionRateLimit *limit = get_rate_limit (conn, rate_class);
 
-                                           VSX_PROTO_TYPE_NONE);
+  /* Moves are only held back when there is a limit */
+  assert (limit);
 
-      if (wrote == -1)
-        {
-          return -1;
-        }
-      else
+  return get_rate_allowed_time (conn, rate_class, limit);
+}
+
+bool
+vsx_connection_apply_deferred_moves (VsxConnection *conn,
+                                     struct vsx_error **error)
+{
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->deferred_tiles); i++)
+    {
+      while (conn->deferred_tiles[i])
         {
-          conn->dirty_players[i] &= ~(1UL << bit_num);
-          return wrote;
+          if (is_rate_limited (conn, VSX_PROTO_MOVE_TILE))
+            return true;
+
+          int bit_num = ffsl (conn->deferred_tiles[i]) - 1;
+          int tile_num = i * VSX_BITMASK_BITS_PER_ELEMENT + bit_num;
+          const VsxConnectionTilePosition *position =
+            conn->deferred_tile_positions + tile_num;
+
+          vsx_bitmask_set (conn->deferred_tiles, tile_num, false);
+
+          uint8_t command[1 + 1 + sizeof (int16_t) * 2];
+
+          command[0] = VSX_PROTO_MOVE_TILE;
+          command[1] = tile_num;
+          vsx_proto_write_int16_t (command + 2, position->x);
+          vsx_proto_write_int16_t (command + 2 + sizeof (int16_t),
+                                   position->y);
+
+          if (!run_command (conn, command, sizeof command, error))
+            return false;
         }
     }
 
-  return 0;
+  return true;
 }
 
-static int
-write_tile (VsxConnection *conn,
-            uint8_t *buffer,
-            size_t buffer_size)
+/* In version 2 the move tile command has the position relative to the
+ * last one received. This converts it back to the original format so
+ * that the rest of the code, including the capture file, only has to
+ * handle one format.
+ */
+static bool
+process_v2_move_tile (VsxConnection *conn,
+                      const uint8_t *payload,
+                      size_t payload_length,
+                      struct vsx_error **error)
 {
-  /* This returns -1 if there wasn’t enough space, 0 if there are no
-   * tiles to write or the size of the written data if one tile was
-   * written. We can only write one tile at a time because there’s no
-   * way to return that we wrote some data but still need to write
-   * more.
-   */
+  uint8_t tile_num;
+  int32_t dx, dy;
 
-  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_tiles); i++)
-    {
-      if (conn->dirty_tiles[i] == 0)
-        continue;
+  if (!vsx_proto_read_payload (payload + 1,
+                               payload_length - 1,
 
-      int bit_num = ffsl (conn->dirty_tiles[i]) - 1;
-      int tile_num = i * sizeof (unsigned long) * 8 + bit_num;
+                               VSX_PROTO_TYPE_UINT8,
+                               &tile_num,
 
-      const VsxTile *tile = conn->person->conversation->tiles + tile_num;
+                               VSX_PROTO_TYPE_SVARINT,
+                               &dx,
 
-      int wrote = vsx_proto_write_command (buffer,
-                                           buffer_size,
+                               VSX_PROTO_TYPE_SVARINT,
+                               &dy,
 
-                                           VSX_PROTO_TILE,
+                               VSX_PROTO_TYPE_NONE)
+      || tile_num >= VSX_TILE_DATA_N_TILES)
+    {
+      vsx_set_error (error,
+                     &vsx_connection_error,
+                     VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                     "Invalid move tile command received");
+      return false;
+    }
 
-                                           VSX_PROTO_TYPE_UINT8,
-                                           tile_num,
+  VsxConnectionTilePosition *position =
+    conn->received_tile_positions + tile_num;
 
-                                           VSX_PROTO_TYPE_INT16,
-                                           tile->x,
+  position->x += dx;
+  position->y += dy;
 
-                                           VSX_PROTO_TYPE_INT16,
-                                           tile->y,
+  uint8_t command[1 + 1 + sizeof (int16_t) * 2];
 
-                                           VSX_PROTO_TYPE_STRING,
-                                           tile->letter,
+  command[0] = VSX_PROTO_MOVE_TILE;
+  command[1] = tile_num;
+  vsx_proto_write_int16_t (command + 2, position->x);
+  vsx_proto_write_int16_t (command + 2 + sizeof (int16_t), position->y);
 
-                                           VSX_PROTO_TYPE_UINT8,
-                                           tile->last_player,
+  return process_command (conn, command, sizeof command, error);
+}
 
-                                           VSX_PROTO_TYPE_NONE);
+static bool
+process_packed_message (VsxConnection *conn,
+                        struct vsx_error **error)
+{
+  const uint8_t *data = conn->message_data;
+  size_t length = conn->message_data_length;
 
-      if (wrote == -1)
+  while (length > 0)
+    {
+      const uint8_t *payload;
+      size_t payload_length;
+
+      if (!vsx_proto_read_packed_command (&data,
+                                          &length,
+                                          &payload,
+                                          &payload_length))
         {
-          return -1;
-        }
-      else
+          vsx_set_error (error,
+                         &vsx_connection_error,
+                         VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                         "Client sent an invalid packed message");
+          return false;
+        }
+
+      bool ret;
+
+      if (payload_length > 0 && payload[0] == VSX_PROTO_MOVE_TILE)
+        ret = process_v2_move_tile (conn, payload, payload_length, error);
+      else
+        ret = process_command (conn, payload, payload_length, error);
+
+      if (!ret)
+        return false;
+    }
+
+  return true;
+}
+
+static bool
+process_message (VsxConnection *conn,
+                 struct vsx_error **error)
+{
+  if (conn->v2_input)
+    return process_packed_message (conn, error);
+
+  if (conn->v2)
+    conn->v2_input = true;
+
+  return process_command (conn,
+                          conn->message_data,
+                          conn->message_data_length,
+                          error);
+}
+
+VsxConnection *
+vsx_connection_new (const struct vsx_netaddress *socket_address,
+                    VsxConversationSet *conversation_set,
+                    VsxPersonSet *person_set)
+{
+  VsxConnection *conn = vsx_calloc (sizeof *conn);
+
+  conn->socket_address = *socket_address;
+  conn->conversation_set = vsx_object_ref (conversation_set);
+  conn->person_set = vsx_object_ref (person_set);
+
+  conn->ws_parser = vsx_ws_parser_new ();
+
+  conn->last_message_time = vsx_main_context_get_monotonic_clock (NULL);
+
+  vsx_signal_init (&conn->changed_signal);
+
+  conn->capture_id = vsx_capture_open_connection ();
+
+  return conn;
+}
+
+void
+vsx_connection_set_socket_address (VsxConnection *conn,
+                                   const struct vsx_netaddress *address)
+{
+  assert (conn->state == VSX_CONNECTION_STATE_READING_WS_HEADERS);
+  assert (conn->person == NULL);
+
+  conn->socket_address = *address;
+}
+
+void
+vsx_connection_set_rate_limits (VsxConnection *conn,
+                                const VsxConnectionRateLimit *limits)
+{
+  conn->rate_limits = limits;
+}
+
+void
+vsx_connection_set_deflate_options (VsxConnection *conn,
+                                    const VsxDeflateOptions *options)
+{
+  conn->deflate_options = options;
+}
+
+void
+vsx_connection_set_response_sent (VsxConnection *conn)
+{
+  assert (conn->state == VSX_CONNECTION_STATE_READING_WS_HEADERS);
+
+  conn->response_sent = true;
+}
+
+const struct vsx_netaddress *
+vsx_connection_get_socket_address (VsxConnection *conn)
+{
+  return &conn->socket_address;
+}
+
+bool
+vsx_connection_save_state (VsxConnection *conn,
+                           struct vsx_buffer *buffer)
+{
+  if (conn->state != VSX_CONNECTION_STATE_WRITING_DATA)
+    return false;
+
+  /* The compression context can’t be recreated in another process so
+   * the client will have to reconnect.
+   */
+  if (conn->deflate)
+    return false;
+
+  size_t start = buffer->length;
+
+  vsx_buffer_set_length (buffer, start + VSX_CONNECTION_STATE_HEADER_SIZE);
+
+  uint8_t *p = buffer->data + start;
+
+  vsx_proto_write_uint16_t (p, conn->socket_address.family);
+  p += sizeof (uint16_t);
+  vsx_proto_write_uint16_t (p, conn->socket_address.port);
+  p += sizeof (uint16_t);
+  memcpy (p, &conn->socket_address.ipv6, VSX_CONNECTION_STATE_ADDRESS_SIZE);
+  p += VSX_CONNECTION_STATE_ADDRESS_SIZE;
+  vsx_proto_write_uint64_t (p, conn->person ? conn->person->hash_entry.id : 0);
+  p += sizeof (uint64_t);
+  vsx_proto_write_uint32_t (p, conn->message_num);
+  p += sizeof (uint32_t);
+  vsx_proto_write_uint16_t (p,
+                            conn->dirty_flags
+                            & VSX_CONNECTION_SAVED_DIRTY_FLAGS);
+  p += sizeof (uint16_t);
+  *(p++) = conn->pending_error;
+  *(p++) = conn->pending_shout;
+  *(p++) = ((conn->v2 ? VSX_CONNECTION_STATE_FLAG_V2 : 0)
+            | (conn->v2_input ? VSX_CONNECTION_STATE_FLAG_V2_INPUT : 0));
+  *(p++) = conn->pong_data_length;
+  vsx_proto_write_uint16_t (p, conn->read_buf_pos);
+  p += sizeof (uint16_t);
+  vsx_proto_write_uint16_t (p, conn->message_data_length);
+
+  vsx_buffer_append (buffer, conn->pong_data, conn->pong_data_length);
+  vsx_buffer_append (buffer, conn->read_buf, conn->read_buf_pos);
+  vsx_buffer_append (buffer, conn->message_data, conn->message_data_length);
+
+  if (conn->v2)
+    {
+      const VsxConnectionTilePosition *positions[] =
+        {
+          conn->sent_tile_positions,
+          conn->received_tile_positions,
+        };
+
+      for (int i = 0; i < VSX_N_ELEMENTS (positions); i++)
+        {
+          for (int tile = 0; tile < VSX_TILE_DATA_N_TILES; tile++)
+            {
+              uint8_t buf[sizeof (int16_t) * 2];
+
+              vsx_proto_write_int16_t (buf, positions[i][tile].x);
+              vsx_proto_write_int16_t (buf + sizeof (int16_t),
+                                       positions[i][tile].y);
+              vsx_buffer_append (buffer, buf, sizeof buf);
+            }
+        }
+    }
+
+  return true;
+}
+
+VsxConnection *
+vsx_connection_new_from_state (VsxConversationSet *conversation_set,
+                               VsxPersonSet *person_set,
+                               const uint8_t *data,
+                               size_t length,
+                               struct vsx_error **error)
+{
+  if (length < VSX_CONNECTION_STATE_HEADER_SIZE)
+    goto invalid;
+
+  const uint8_t *p = data;
+  struct vsx_netaddress socket_address;
+
+  memset (&socket_address, 0, sizeof socket_address);
+  socket_address.family = vsx_proto_read_uint16_t (p);
+  p += sizeof (uint16_t);
+  socket_address.port = vsx_proto_read_uint16_t (p);
+  p += sizeof (uint16_t);
+  memcpy (&socket_address.ipv6, p, VSX_CONNECTION_STATE_ADDRESS_SIZE);
+  p += VSX_CONNECTION_STATE_ADDRESS_SIZE;
+
+  uint64_t person_id = vsx_proto_read_uint64_t (p);
+  p += sizeof (uint64_t);
+  uint32_t message_num = vsx_proto_read_uint32_t (p);
+  p += sizeof (uint32_t);
+  uint16_t dirty_flags = vsx_proto_read_uint16_t (p);
+  p += sizeof (uint16_t);
+  uint8_t pending_error = *(p++);
+  uint8_t pending_shout = *(p++);
+  uint8_t protocol_flags = *(p++);
+  uint8_t pong_data_length = *(p++);
+  uint16_t read_buf_pos = vsx_proto_read_uint16_t (p);
+  p += sizeof (uint16_t);
+  uint16_t message_data_length = vsx_proto_read_uint16_t (p);
+  p += sizeof (uint16_t);
+
+  VsxConnection *conn;
+
+  bool v2 = protocol_flags & VSX_CONNECTION_STATE_FLAG_V2;
+
+  if ((dirty_flags & ~VSX_CONNECTION_SAVED_DIRTY_FLAGS)
+      || (protocol_flags & ~(VSX_CONNECTION_STATE_FLAG_V2
+                             | VSX_CONNECTION_STATE_FLAG_V2_INPUT))
+      || pong_data_length > sizeof conn->pong_data
+      || read_buf_pos > sizeof conn->read_buf
+      || message_data_length > sizeof conn->message_data
+      || length != (VSX_CONNECTION_STATE_HEADER_SIZE
+                    + pong_data_length
+                    + read_buf_pos
+                    + message_data_length
+                    + (v2 ? VSX_CONNECTION_STATE_POSITIONS_SIZE : 0)))
+    goto invalid;
+
+  VsxPerson *person = NULL;
+
+  if (person_id)
+    {
+      person = vsx_person_set_get_person (person_set, person_id);
+
+      if (person == NULL)
+        {
+          vsx_set_error (error,
+                         &vsx_connection_error,
+                         VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                         "Saved connection refers to an unknown player");
+          return NULL;
+        }
+
+      if (message_num < person->message_offset
+          || (message_num
+              > vsx_conversation_get_n_messages (person->conversation)))
+        goto invalid;
+    }
+
+  conn = vsx_connection_new (&socket_address, conversation_set, person_set);
+
+  /* The WebSocket negotiation was already done by the old process */
+  vsx_ws_parser_free (conn->ws_parser);
+  conn->ws_parser = NULL;
+  conn->state = VSX_CONNECTION_STATE_WRITING_DATA;
+
+  conn->dirty_flags = dirty_flags;
+  conn->pending_error = pending_error;
+  conn->pending_shout = pending_shout;
+
+  conn->pong_data_length = pong_data_length;
+  memcpy (conn->pong_data, p, pong_data_length);
+  p += pong_data_length;
+  conn->read_buf_pos = read_buf_pos;
+  memcpy (conn->read_buf, p, read_buf_pos);
+  p += read_buf_pos;
+  conn->message_data_length = message_data_length;
+  memcpy (conn->message_data, p, message_data_length);
+  p += message_data_length;
+
+  if (v2)
+    {
+      conn->v2 = true;
+      conn->v2_input = protocol_flags & VSX_CONNECTION_STATE_FLAG_V2_INPUT;
+
+      VsxConnectionTilePosition *positions[] =
+        {
+          conn->sent_tile_positions,
+          conn->received_tile_positions,
+        };
+
+      for (int i = 0; i < VSX_N_ELEMENTS (positions); i++)
+        {
+          for (int tile = 0; tile < VSX_TILE_DATA_N_TILES; tile++)
+            {
+              positions[i][tile].x = vsx_proto_read_int16_t (p);
+              p += sizeof (int16_t);
+              positions[i][tile].y = vsx_proto_read_int16_t (p);
+              p += sizeof (int16_t);
+            }
+        }
+    }
+
+  if (person)
+    {
+      conn->person = vsx_object_ref (person);
+      conn->message_num = message_num;
+
+      /* Resend everything except the messages as if the client had
+       * reconnected in case the old process hadn’t finished sending
+       * some changes.
+       */
+      start_following_person (conn);
+    }
+
+  return conn;
+
+ invalid:
+  vsx_set_error (error,
+                 &vsx_connection_error,
+                 VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                 "Invalid saved connection state");
+  return NULL;
+}
+
+static bool
+has_pending_data (VsxConnection *conn)
+{
+  if (conn->dirty_flags)
+    return true;
+
+  if (conn->person
+      && conn->named_players < conn->person->conversation->n_players)
+    return true;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_players); i++)
+    {
+      if (conn->dirty_players[i])
+        return true;
+    }
+
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_tiles); i++)
+    {
+      if (conn->dirty_tiles[i])
+        return true;
+    }
+
+  if (conn->person
+      && (conn->message_num
+          < vsx_conversation_get_n_messages (conn->person->conversation)))
+    return true;
+
+  return false;
+}
+
+static int
+write_command (VsxConnection *conn,
+               uint8_t *buffer,
+               size_t buffer_size,
+               int command,
+               ...)
+{
+  va_list ap;
+  int ret;
+
+  va_start (ap, command);
+
+  if (conn->v2)
+    {
+      ret = vsx_proto_write_packed_command_v (buffer,
+                                              buffer_size,
+                                              command,
+                                              ap);
+    }
+  else
+    {
+      ret = vsx_proto_write_command_v (buffer, buffer_size, command, ap);
+    }
+
+  va_end (ap);
+
+  return ret;
+}
+
+static int
+write_player_name (VsxConnection *conn,
+                   uint8_t *buffer,
+                   size_t buffer_size)
+{
+  /* This returns -1 if there wasn’t enough space, 0 if there are no
+   * players to write or the size of the written data if one name was
+   * written. We can only write one name at a time because there’s no
+   * way to return that we wrote some data but still need to write
+   * more.
+   */
+
+  if (conn->person == NULL)
+    return 0;
+
+  VsxConversation *conversation = conn->person->conversation;
+
+  if (conn->named_players >= conversation->n_players)
+    return 0;
+
+  const VsxPlayer *player = conversation->players[conn->named_players];
+
+  int wrote = write_command (conn,
+                             buffer,
+                             buffer_size,
+
+                             VSX_PROTO_PLAYER_NAME,
+
+                             VSX_PROTO_TYPE_UINT8,
+                             conn->named_players,
+
+                             VSX_PROTO_TYPE_STRING,
+                             player->name,
+
+                             VSX_PROTO_TYPE_NONE);
+
+  if (wrote == -1)
+    {
+      return -1;
+    }
+  else
+    {
+      conn->named_players++;
+      return wrote;
+    }
+}
+
+static int
+write_player (VsxConnection *conn,
+              uint8_t *buffer,
+              size_t buffer_size)
+{
+  /* This returns -1 if there wasn’t enough space, 0 if there are no
+   * players to write or the size of the written data if one player was
+   * written. We can only write one player at a time because there’s
+   * no way to return that we wrote some data but still need to write
+   * more.
+   */
+
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_players); i++)
+    {
+      if (conn->dirty_players[i] == 0)
+        continue;
+
+      int bit_num = ffsl (conn->dirty_players[i]) - 1;
+      int player_num = i * sizeof (unsigned long) * 8 + bit_num;
+
+      const VsxPlayer *player = conn->person->conversation->players[player_num];
+
+      int wrote = write_command (conn,
+                                 buffer,
+                                 buffer_size,
+
+                                 VSX_PROTO_PLAYER,
+
+                                 VSX_PROTO_TYPE_UINT8,
+                                 player_num,
+
+                                 VSX_PROTO_TYPE_UINT8,
+                                 player->flags,
+
+                                 VSX_PROTO_TYPE_NONE);
+
+      if (wrote == -1)
+        {
+          return -1;
+        }
+      else
+        {
+          conn->dirty_players[i] &= ~(1UL << bit_num);
+          return wrote;
+        }
+    }
+
+  return 0;
+}
+
+static int
+write_tile (VsxConnection *conn,
+            uint8_t *buffer,
+            size_t buffer_size)
+{
+  /* This returns -1 if there wasn’t enough space, 0 if there are no
+   * tiles to write or the size of the written data if one tile was
+   * written. We can only write one tile at a time because there’s no
+   * way to return that we wrote some data but still need to write
+   * more.
+   */
+
+  for (int i = 0; i < VSX_N_ELEMENTS (conn->dirty_tiles); i++)
+    {
+      if (conn->dirty_tiles[i] == 0)
+        continue;
+
+      int bit_num = ffsl (conn->dirty_tiles[i]) - 1;
+      int tile_num = i * sizeof (unsigned long) * 8 + bit_num;
+
+      const VsxTile *tile = conn->person->conversation->tiles + tile_num;
+
+      int wrote;
+
+      if (conn->v2)
+        {
+          VsxConnectionTilePosition *position =
+            conn->sent_tile_positions + tile_num;
+
+          wrote = vsx_proto_write_packed_command (buffer,
+                                                  buffer_size,
+
+                                                  VSX_PROTO_TILE,
+
+                                                  VSX_PROTO_TYPE_UINT8,
+                                                  tile_num,
+
+                                                  VSX_PROTO_TYPE_SVARINT,
+                                                  tile->x - position->x,
+
+                                                  VSX_PROTO_TYPE_SVARINT,
+                                                  tile->y - position->y,
+
+                                                  VSX_PROTO_TYPE_STRING,
+                                                  tile->letter,
+
+                                                  VSX_PROTO_TYPE_UINT8,
+                                                  tile->last_player,
+
+                                                  VSX_PROTO_TYPE_NONE);
+
+          if (wrote != -1)
+            {
+              position->x = tile->x;
+              position->y = tile->y;
+            }
+        }
+      else
+        {
+          wrote = vsx_proto_write_command (buffer,
+                                           buffer_size,
+
+                                           VSX_PROTO_TILE,
+
+                                           VSX_PROTO_TYPE_UINT8,
+                                           tile_num,
+
+                                           VSX_PROTO_TYPE_INT16,
+                                           tile->x,
+
+                                           VSX_PROTO_TYPE_INT16,
+                                           tile->y,
+
+                                           VSX_PROTO_TYPE_STRING,
+                                           tile->letter,
+
+                                           VSX_PROTO_TYPE_UINT8,
+                                           tile->last_player,
+
+                                           VSX_PROTO_TYPE_NONE);
+        }
+
+      if (wrote == -1)
+        {
+          return -1;
+        }
+      else
         {
           conn->dirty_tiles[i] &= ~(1UL << bit_num);
           return wrote;
@@ -1071,18 +1833,19 @@ write_message (VsxConnection *conn,
   const VsxConversationMessage *message =
     vsx_conversation_get_message (conversation, conn->message_num);
 
-  int wrote = vsx_proto_write_command (buffer,
-                                       buffer_size,
+  int wrote = write_command (conn,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_MESSAGE,
+                             VSX_PROTO_MESSAGE,
 
-                                       VSX_PROTO_TYPE_UINT8,
-                                       message->player_num,
+                             VSX_PROTO_TYPE_UINT8,
+                             message->player_num,
 
-                                       VSX_PROTO_TYPE_STRING,
-                                       message->text,
+                             VSX_PROTO_TYPE_STRING,
+                             message->text,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 
   if (wrote == -1)
     {
@@ -1100,41 +1863,17 @@ write_ws_response (VsxConnection *conn,
                    uint8_t *buffer,
                    size_t buffer_size)
 {
-  size_t key_hash_size;
-  const uint8_t *key_hash = vsx_ws_parser_get_key_hash (conn->ws_parser,
-                                                       &key_hash_size);
+  const char *extensions =
+    conn->deflate ? vsx_deflate_get_response_header (conn->deflate) : "";
 
-  size_t base64_size_needed = VSX_BASE64_ENCODED_SIZE (key_hash_size);
-
-  if (base64_size_needed
-      + (sizeof ws_header_prefix) - 1
-      + (sizeof ws_header_postfix) - 1
-      > buffer_size)
-    {
-      /* This probably shouldn’t happen because the WS response should
-       * be the first thing we write which means the buffer should be
-       * empty.
-       */
-      return -1;
-    }
-
-  uint8_t *p = buffer;
-
-  memcpy (p, ws_header_prefix, (sizeof ws_header_prefix) - 1);
-  p += (sizeof ws_header_prefix) - 1;
-
-  size_t encoded_size = vsx_base64_encode (key_hash,
-                                           key_hash_size,
-                                           (char *) p);
-
-  assert (encoded_size == base64_size_needed);
-
-  p += base64_size_needed;
-
-  memcpy (p, ws_header_postfix, (sizeof ws_header_postfix) - 1);
-  p += (sizeof ws_header_postfix) - 1;
-
-  return p - buffer;
+  /* This probably shouldn’t fail because the WS response should be
+   * the first thing we write which means the buffer should be empty.
+   */
+  return vsx_ws_response_write (conn->ws_parser,
+                                conn->v2,
+                                extensions,
+                                buffer,
+                                buffer_size);
 }
 
 static int
@@ -1160,18 +1899,19 @@ write_player_id (VsxConnection *conn,
                  uint8_t *buffer,
                  size_t buffer_size)
 {
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_PLAYER_ID,
+                        VSX_PROTO_PLAYER_ID,
 
-                                  VSX_PROTO_TYPE_UINT64,
-                                  conn->person->hash_entry.id,
+                        VSX_PROTO_TYPE_UINT64,
+                        conn->person->hash_entry.id,
 
-                                  VSX_PROTO_TYPE_UINT8,
-                                  conn->person->player->num,
+                        VSX_PROTO_TYPE_UINT8,
+                        conn->person->player->num,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1179,15 +1919,16 @@ write_conversation_id (VsxConnection *conn,
                        uint8_t *buffer,
                        size_t buffer_size)
 {
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_CONVERSATION_ID,
+                        VSX_PROTO_CONVERSATION_ID,
 
-                                  VSX_PROTO_TYPE_UINT64,
-                                  conn->person->conversation->hash_entry.id,
+                        VSX_PROTO_TYPE_UINT64,
+                        conn->person->conversation->hash_entry.id,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1197,15 +1938,16 @@ write_n_tiles (VsxConnection *conn,
 {
   uint8_t n_tiles = conn->person->conversation->total_n_tiles;
 
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_N_TILES,
+                        VSX_PROTO_N_TILES,
 
-                                  VSX_PROTO_TYPE_UINT8,
-                                  n_tiles,
+                        VSX_PROTO_TYPE_UINT8,
+                        n_tiles,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1216,15 +1958,16 @@ write_language (VsxConnection *conn,
   const char *language_code =
     conn->person->conversation->tile_data->language_code;
 
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_LANGUAGE,
+                        VSX_PROTO_LANGUAGE,
 
-                                  VSX_PROTO_TYPE_STRING,
-                                  language_code,
+                        VSX_PROTO_TYPE_STRING,
+                        language_code,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1232,15 +1975,16 @@ write_pending_shout (VsxConnection *conn,
                      uint8_t *buffer,
                      size_t buffer_size)
 {
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_PLAYER_SHOUTED,
+                        VSX_PROTO_PLAYER_SHOUTED,
 
-                                  VSX_PROTO_TYPE_UINT8,
-                                  conn->pending_shout,
+                        VSX_PROTO_TYPE_UINT8,
+                        conn->pending_shout,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1252,12 +1996,13 @@ write_end (VsxConnection *conn,
       || vsx_player_is_connected (conn->person->player))
     return 0;
 
-  int wrote = vsx_proto_write_command (buffer,
-                                       buffer_size,
+  int wrote = write_command (conn,
+                             buffer,
+                             buffer_size,
 
-                                       VSX_PROTO_END,
+                             VSX_PROTO_END,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 
   if (wrote != -1)
     conn->state = VSX_CONNECTION_STATE_DONE;
@@ -1270,12 +2015,13 @@ write_sync (VsxConnection *conn,
             uint8_t *buffer,
             size_t buffer_size)
 {
-  return vsx_proto_write_command (buffer,
-                                  buffer_size,
+  return write_command (conn,
+                        buffer,
+                        buffer_size,
 
-                                  VSX_PROTO_SYNC,
+                        VSX_PROTO_SYNC,
 
-                                  VSX_PROTO_TYPE_NONE);
+                        VSX_PROTO_TYPE_NONE);
 }
 
 static int
@@ -1283,12 +2029,13 @@ write_pending_error (VsxConnection *conn,
                      uint8_t *buffer,
                      size_t buffer_size)
 {
-  int wrote = vsx_proto_write_command (buffer,
-                                       buffer_size,
+  int wrote = write_command (conn,
+                             buffer,
+                             buffer_size,
 
-                                       conn->pending_error,
+                             conn->pending_error,
 
-                                       VSX_PROTO_TYPE_NONE);
+                             VSX_PROTO_TYPE_NONE);
 
   if (wrote != -1)
     conn->state = VSX_CONNECTION_STATE_DONE;
@@ -1296,19 +2043,45 @@ write_pending_error (VsxConnection *conn,
   return wrote;
 }
 
-size_t
-vsx_connection_fill_output_buffer (VsxConnection *conn,
-                                   uint8_t *buffer,
-                                   size_t buffer_size)
+/* Writes the header for the packed frame that was started at
+ * *frame_start and returns the new total length of the data in the
+ * buffer. If nothing was added to the frame then it is removed.
+ */
+static size_t
+close_packed_frame (uint8_t *buffer,
+                    size_t total_wrote,
+                    size_t *frame_start)
 {
+  size_t start = *frame_start;
+  size_t payload_length =
+    total_wrote - start - VSX_PROTO_PACKED_FRAME_HEADER_LENGTH;
+
+  *frame_start = SIZE_MAX;
+
+  if (payload_length == 0)
+    return start;
+
+  return start + vsx_proto_finish_packed_frame (buffer + start,
+                                                payload_length);
+}
+
+static size_t
+fill_frames (VsxConnection *conn,
+             uint8_t *buffer,
+             size_t buffer_size)
+{
+  /* In version 2 all of the messages are packed into frames together
+   * except for the ones marked unpacked, which are written directly.
+   */
   static const struct
   {
     VsxConnectionDirtyFlag flag;
     VsxConnectionWriteStateFunc func;
+    bool unpacked;
   } write_funcs[] =
     {
-      { VSX_CONNECTION_DIRTY_FLAG_WS_HEADER, write_ws_response },
-      { VSX_CONNECTION_DIRTY_FLAG_PONG, write_pong },
+      { VSX_CONNECTION_DIRTY_FLAG_WS_HEADER, write_ws_response, true },
+      { VSX_CONNECTION_DIRTY_FLAG_PONG, write_pong, true },
       { VSX_CONNECTION_DIRTY_FLAG_PLAYER_ID, write_player_id },
       { VSX_CONNECTION_DIRTY_FLAG_CONVERSATION_ID, write_conversation_id },
       { VSX_CONNECTION_DIRTY_FLAG_N_TILES, write_n_tiles },
@@ -1324,62 +2097,286 @@ vsx_connection_fill_output_buffer (VsxConnection *conn,
     };
 
   size_t total_wrote = 0;
+  /* Offset of the header of the packed frame being filled or SIZE_MAX
+   * if there isn’t one.
+   */
+  size_t frame_start = SIZE_MAX;
 
-  while (true)
+  while (conn->state == VSX_CONNECTION_STATE_WRITING_DATA)
     {
-      switch (conn->state)
+      for (int i = 0; i < VSX_N_ELEMENTS (write_funcs); i++)
         {
-        case VSX_CONNECTION_STATE_READING_WS_HEADERS:
-          return total_wrote;
+          if (write_funcs[i].flag != 0
+              && (conn->dirty_flags & write_funcs[i].flag) == 0)
+            continue;
 
-        case VSX_CONNECTION_STATE_WRITING_DATA:
-          for (int i = 0; i < VSX_N_ELEMENTS (write_funcs); i++)
+          bool packed = conn->v2 && !write_funcs[i].unpacked;
+          size_t available;
+
+          if (packed)
             {
-              if (write_funcs[i].flag == 0)
+              if (frame_start == SIZE_MAX)
                 {
-                  int wrote = write_funcs[i].func (conn,
-                                                   buffer + total_wrote,
-                                                   buffer_size - total_wrote);
+                  if (buffer_size - total_wrote
+                      <= VSX_PROTO_PACKED_FRAME_HEADER_LENGTH)
+                    goto out;
 
-                  if (wrote == 0)
-                    continue;
+                  frame_start = total_wrote;
+                  total_wrote += VSX_PROTO_PACKED_FRAME_HEADER_LENGTH;
+                }
+
+              available = MIN (buffer_size,
+                               frame_start
+                               + VSX_PROTO_PACKED_FRAME_HEADER_LENGTH
+                               + VSX_PROTO_MAX_PAYLOAD_SIZE)
+                - total_wrote;
+            }
+          else
+            {
+              if (frame_start != SIZE_MAX)
+                {
+                  total_wrote = close_packed_frame (buffer,
+                                                    total_wrote,
+                                                    &frame_start);
+                }
 
-                  if (wrote == -1)
-                    return total_wrote;
+              available = buffer_size - total_wrote;
+            }
 
-                  total_wrote += wrote;
+          int wrote = write_funcs[i].func (conn,
+                                           buffer + total_wrote,
+                                           available);
 
+          if (wrote == -1)
+            {
+              /* If the frame is full then start another one */
+              if (packed
+                  && total_wrote
+                  > frame_start + VSX_PROTO_PACKED_FRAME_HEADER_LENGTH)
+                {
+                  total_wrote = close_packed_frame (buffer,
+                                                    total_wrote,
+                                                    &frame_start);
                   goto found;
                 }
-              else
-                {
-                  if ((conn->dirty_flags & write_funcs[i].flag) == 0)
-                    continue;
 
-                  int wrote = write_funcs[i].func (conn,
-                                                   buffer + total_wrote,
-                                                   buffer_size - total_wrote);
+              goto out;
+            }
 
-                  if (wrote == -1)
-                    return total_wrote;
+          if (write_funcs[i].flag == 0)
+            {
+              if (wrote == 0)
+                continue;
+            }
+          else
+            {
+              conn->dirty_flags &= ~write_funcs[i].flag;
+            }
 
-                  total_wrote += wrote;
+          total_wrote += wrote;
 
-                  conn->dirty_flags &= ~write_funcs[i].flag;
+          goto found;
+        }
 
-                  goto found;
-                }
-            }
+      break;
+
+    found:
+      continue;
+    }
 
-          return total_wrote;
+ out:
+  if (frame_start != SIZE_MAX)
+    total_wrote = close_packed_frame (buffer, total_wrote, &frame_start);
 
-        found:
-          break;
+  return total_wrote;
+}
+
+/* Gets the header and payload length of a frame written by
+ * fill_frames. The server never writes frames that need a 64-bit
+ * length.
+ */
+static size_t
+get_frame_payload_length (const uint8_t *frame,
+                          size_t *header_length)
+{
+  size_t payload_length = frame[1] & 0x7f;
 
-        case VSX_CONNECTION_STATE_DONE:
-          return total_wrote;
+  assert (payload_length != 127);
+
+  if (payload_length == 126)
+    {
+      uint16_t word;
+      memcpy (&word, frame + 2, sizeof word);
+      *header_length = 2 + sizeof word;
+      return VSX_UINT16_FROM_BE (word);
+    }
+
+  *header_length = 2;
+
+  return payload_length;
+}
+
+static bool
+should_compress_frame (VsxConnection *conn,
+                       const uint8_t *frame,
+                       size_t payload_length)
+{
+  return ((frame[0] & 0xf) == 0x2
+          && payload_length >= conn->deflate_options->threshold);
+}
+
+static void
+compress_frame (VsxConnection *conn,
+                const uint8_t *payload,
+                size_t payload_length)
+{
+  struct vsx_buffer *output = &conn->deflate_output;
+  size_t frame_start = output->length;
+  /* Leave space for the largest header that we will need */
+  size_t max_header_length = 2 + sizeof (uint16_t);
+
+  vsx_buffer_set_length (output, frame_start + max_header_length);
+
+  vsx_deflate_compress (conn->deflate, payload, payload_length, output);
+
+  size_t compressed_length = output->length - frame_start - max_header_length;
+  size_t header_length = vsx_proto_get_frame_header_length (compressed_length);
+
+  assert (header_length <= max_header_length);
+
+  uint8_t *frame = output->data + frame_start;
+
+  memmove (frame + header_length,
+           frame + max_header_length,
+           compressed_length);
+  vsx_proto_write_frame_header (frame, compressed_length);
+  /* RSV1 marks the message as compressed */
+  frame[0] |= 0x40;
+
+  output->length = frame_start + header_length + compressed_length;
+}
+
+/* Compresses the frames written by fill_frames that are big enough
+ * and appends the result to deflate_output along with the frames that
+ * are left uncompressed. Returns false without doing anything if none
+ * of the frames need compressing so that the data can be sent as it
+ * is.
+ */
+static bool
+compress_frames (VsxConnection *conn,
+                 const uint8_t *data,
+                 size_t length)
+{
+  const uint8_t *end = data + length;
+  const uint8_t *p;
+  size_t header_length, payload_length;
+
+  for (p = data; p < end; p += header_length + payload_length)
+    {
+      payload_length = get_frame_payload_length (p, &header_length);
+
+      if (should_compress_frame (conn, p, payload_length))
+        goto found;
+    }
+
+  return false;
+
+ found:
+  vsx_buffer_append (&conn->deflate_output, data, p - data);
+
+  for (; p < end; p += header_length + payload_length)
+    {
+      payload_length = get_frame_payload_length (p, &header_length);
+
+      if (should_compress_frame (conn, p, payload_length))
+        {
+          compress_frame (conn, p + header_length, payload_length);
+        }
+      else
+        {
+          vsx_buffer_append (&conn->deflate_output,
+                             p,
+                             header_length + payload_length);
         }
     }
+
+  return true;
+}
+
+static size_t
+flush_deflate_output (VsxConnection *conn,
+                      uint8_t *buffer,
+                      size_t buffer_size)
+{
+  struct vsx_buffer *output = &conn->deflate_output;
+  size_t to_copy = MIN (buffer_size,
+                        output->length - conn->deflate_output_pos);
+
+  if (to_copy == 0)
+    return 0;
+
+  memcpy (buffer, output->data + conn->deflate_output_pos, to_copy);
+  conn->deflate_output_pos += to_copy;
+
+  if (conn->deflate_output_pos >= output->length)
+    {
+      output->length = 0;
+      conn->deflate_output_pos = 0;
+    }
+
+  return to_copy;
+}
+
+size_t
+vsx_connection_fill_output_buffer (VsxConnection *conn,
+                                   uint8_t *buffer,
+                                   size_t buffer_size)
+{
+  if (conn->deflate == NULL)
+    return fill_frames (conn, buffer, buffer_size);
+
+  size_t total_wrote = 0;
+
+  /* The handshake response isn’t a frame so it is written before
+   * looking for frames to compress.
+   */
+  if ((conn->dirty_flags & VSX_CONNECTION_DIRTY_FLAG_WS_HEADER))
+    {
+      int wrote = write_ws_response (conn, buffer, buffer_size);
+
+      if (wrote == -1)
+        return 0;
+
+      conn->dirty_flags &= ~VSX_CONNECTION_DIRTY_FLAG_WS_HEADER;
+      total_wrote = wrote;
+    }
+
+  /* The frames are generated into the caller’s buffer as usual. If
+   * any of them need compressing then the whole lot is rewritten into
+   * deflate_output and copied back from there because the compressed
+   * data might not fit.
+   */
+  while (true)
+    {
+      total_wrote += flush_deflate_output (conn,
+                                           buffer + total_wrote,
+                                           buffer_size - total_wrote);
+
+      if (conn->deflate_output.length > 0)
+        break;
+
+      size_t wrote = fill_frames (conn,
+                                  buffer + total_wrote,
+                                  buffer_size - total_wrote);
+
+      if (wrote == 0)
+        break;
+
+      if (!compress_frames (conn, buffer + total_wrote, wrote))
+        total_wrote += wrote;
+    }
+
+  return total_wrote;
 }
 
 bool
@@ -1477,6 +2474,34 @@ unmask_data (uint32_t mask,
     buffer[i] ^= ((uint8_t *) &mask)[i % 4];
 }
 
+static bool
+decompress_message (VsxConnection *conn,
+                    struct vsx_error **error)
+{
+  uint8_t buf[VSX_PROTO_MAX_PAYLOAD_SIZE];
+  size_t length;
+
+  if (!vsx_deflate_decompress (conn->deflate,
+                               conn->message_data,
+                               conn->message_data_length,
+                               buf,
+                               sizeof buf,
+                               &length))
+    {
+      vsx_set_error (error,
+                     &vsx_connection_error,
+                     VSX_CONNECTION_ERROR_INVALID_PROTOCOL,
+                     "Client sent a compressed message that is invalid or "
+                     "too long");
+      return false;
+    }
+
+  memcpy (conn->message_data, buf, length);
+  conn->message_data_length = length;
+
+  return true;
+}
+
 static bool
 process_frames (VsxConnection *conn,
                 struct vsx_error **error)
@@ -1525,8 +2550,13 @@ process_frames (VsxConnection *conn,
       if (has_mask)
         header_size += sizeof mask;
 
-      /* RSV bits must be zero */
-      if (data[0] & 0x70)
+      /* If permessage-deflate was negotiated then RSV1 marks a
+       * compressed message. It is only allowed on the first frame of
+       * a data message. The other RSV bits must always be zero.
+       */
+      bool compressed = conn->deflate && opcode == 0x2 && (data[0] & 0x40);
+
+      if (data[0] & (compressed ? 0x30 : 0x70))
         {
           vsx_set_error (error,
                          &vsx_connection_error,
@@ -1626,6 +2656,9 @@ process_frames (VsxConnection *conn,
         }
       else
         {
+          if (opcode == 0x2)
+            conn->message_compressed = compressed;
+
           memcpy (conn->message_data + conn->message_data_length,
                   data,
                   payload_length);
@@ -1633,6 +2666,10 @@ process_frames (VsxConnection *conn,
 
           if (is_fin)
             {
+              if (conn->message_compressed
+                  && !decompress_message (conn, error))
+                return false;
+
               if (!process_message (conn, error))
                 return false;
 
@@ -1671,8 +2708,20 @@ vsx_connection_parse_data (VsxConnection *conn,
         case VSX_WS_PARSER_RESULT_ERROR:
           return false;
         case VSX_WS_PARSER_RESULT_FINISHED:
+          conn->v2 = vsx_ws_parser_has_protocol (conn->ws_parser,
+                                                 VSX_PROTO_V2_NAME);
           conn->state = VSX_CONNECTION_STATE_WRITING_DATA;
-          conn->dirty_flags |= VSX_CONNECTION_DIRTY_FLAG_WS_HEADER;
+          if (!conn->response_sent)
+            {
+              if (conn->deflate_options)
+                {
+                  const char *extensions =
+                    vsx_ws_parser_get_extensions (conn->ws_parser);
+                  conn->deflate =
+                    vsx_deflate_negotiate (extensions, conn->deflate_options);
+                }
+              conn->dirty_flags |= VSX_CONNECTION_DIRTY_FLAG_WS_HEADER;
+            }
           buffer += consumed;
           buffer_length -= consumed;
           break;
@@ -1698,12 +2747,16 @@ vsx_connection_parse_data (VsxConnection *conn,
 bool
 vsx_connection_is_finished (VsxConnection *conn)
 {
-  return conn->state == VSX_CONNECTION_STATE_DONE;
+  return (conn->state == VSX_CONNECTION_STATE_DONE
+          && conn->deflate_output.length == 0);
 }
 
 bool
 vsx_connection_has_data (VsxConnection *conn)
 {
+  if (conn->deflate_output.length > 0)
+    return true;
+
   switch (conn->state)
     {
     case VSX_CONNECTION_STATE_READING_WS_HEADERS:
@@ -1725,6 +2778,16 @@ vsx_connection_get_changed_signal (VsxConnection *conn)
   return &conn->changed_signal;
 }
 
+int64_t
+vsx_connection_take_change_time (VsxConnection *conn)
+{
+  int64_t change_time = conn->change_time;
+
+  conn->change_time = 0;
+
+  return change_time;
+}
+
 int64_t
 vsx_connection_get_last_message_time (VsxConnection *conn)
 {
@@ -1734,6 +2797,8 @@ vsx_connection_get_last_message_time (VsxConnection *conn)
 void
 vsx_connection_free (VsxConnection *conn)
 {
+  vsx_capture_close_connection (conn->capture_id);
+
   if (conn->person)
     {
       vsx_list_remove (&conn->conversation_changed_listener.link);
@@ -1746,5 +2811,10 @@ vsx_connection_free (VsxConnection *conn)
   if (conn->ws_parser)
     vsx_ws_parser_free (conn->ws_parser);
 
+  if (conn->deflate)
+    vsx_deflate_free (conn->deflate);
+
+  vsx_buffer_destroy (&conn->deflate_output);
+
   vsx_free (conn);
 }
@@ -24,6 +24,8 @@
 #include "vsx-signal.h"
 #include "vsx-error.h"
 #include "vsx-netaddress.h"
+#include "vsx-buffer.h"
+#include "vsx-deflate.h"
 
 typedef struct _VsxConnection VsxConnection;
 
@@ -35,11 +37,101 @@ typedef enum
 extern struct vsx_error_domain
 vsx_connection_error;
 
+/* Commands that a client could send fast enough to flood everyone
+ * else in the conversation are grouped into classes that each have
+ * their own rate limit.
+ */
+typedef enum
+{
+  /* MOVE_TILE */
+  VSX_CONNECTION_RATE_CLASS_MOVE_TILE,
+  /* SEND_MESSAGE */
+  VSX_CONNECTION_RATE_CLASS_MESSAGE,
+  /* START_TYPING. STOP_TYPING is never limited. */
+  VSX_CONNECTION_RATE_CLASS_TYPING,
+  VSX_CONNECTION_N_RATE_CLASSES
+} VsxConnectionRateClass;
+
+typedef struct
+{
+  /* Commands per second allowed on average, or zero for no limit */
+  int rate;
+  /* Number of commands that can arrive at once before the rate
+   * applies
+   */
+  int burst;
+} VsxConnectionRateLimit;
+
 VsxConnection *
 vsx_connection_new (const struct vsx_netaddress *socket_address,
                     VsxConversationSet *conversation_set,
                     VsxPersonSet *person_set);
 
+/* Replaces the address given when the connection was created. This
+ * can be used when the real address of the client is only known after
+ * reading some data, such as from a PROXY protocol header. It must be
+ * called before any data is given to vsx_connection_parse_data.
+ */
+void
+vsx_connection_set_socket_address (VsxConnection *conn,
+                                   const struct vsx_netaddress *address);
+
+const struct vsx_netaddress *
+vsx_connection_get_socket_address (VsxConnection *conn);
+
+/* Sets the rate limits for each class of command. The array must
+ * have VSX_CONNECTION_N_RATE_CLASSES elements and stay alive as long
+ * as the connection. Commands over the limit are dropped, except for
+ * MOVE_TILE where the latest position of each tile is held back until
+ * vsx_connection_apply_deferred_moves is called. By default there are
+ * no limits.
+ */
+void
+vsx_connection_set_rate_limits (VsxConnection *conn,
+                                const VsxConnectionRateLimit *limits);
+
+/* Enables the permessage-deflate extension for clients that ask for
+ * it. The options must stay alive as long as the connection and this
+ * must be called before any data is given to
+ * vsx_connection_parse_data. By default compression is disabled.
+ */
+void
+vsx_connection_set_deflate_options (VsxConnection *conn,
+                                    const VsxDeflateOptions *options);
+
+/* Marks that something else, such as the router, has already sent
+ * the handshake response to the client. The request is still parsed
+ * to find out which protocol the client asked for but no response is
+ * written and permessage-deflate is never negotiated because the
+ * response that was sent didn’t accept it. This must be called before
+ * any data is given to vsx_connection_parse_data.
+ */
+void
+vsx_connection_set_response_sent (VsxConnection *conn);
+
+/* Appends the state of the connection that can’t be recreated from the
+ * person to the buffer so that the connection can be handed over to
+ * another process during an upgrade. Returns false without adding
+ * anything if the connection can’t be handed over because the
+ * WebSocket negotiation hasn’t finished, the connection is already
+ * finished or it is using compression.
+ */
+bool
+vsx_connection_save_state (VsxConnection *conn,
+                           struct vsx_buffer *buffer);
+
+/* Creates a connection from state saved with
+ * vsx_connection_save_state. The person must already have been
+ * restored into person_set. Everything about the game is sent again
+ * as if the client had reconnected.
+ */
+VsxConnection *
+vsx_connection_new_from_state (VsxConversationSet *conversation_set,
+                               VsxPersonSet *person_set,
+                               const uint8_t *data,
+                               size_t length,
+                               struct vsx_error **error);
+
 size_t
 vsx_connection_fill_output_buffer (VsxConnection *conn,
                                    uint8_t *buffer,
@@ -64,9 +156,31 @@ vsx_connection_has_data (VsxConnection *conn);
 struct vsx_signal *
 vsx_connection_get_changed_signal (VsxConnection *conn);
 
+/* Returns the time in microseconds from vsx_metrics_get_time of the
+ * oldest change to the conversation since the last call, or zero if
+ * there hasn’t been one.
+ */
+int64_t
+vsx_connection_take_change_time (VsxConnection *conn);
+
 int64_t
 vsx_connection_get_last_message_time (VsxConnection *conn);
 
+/* Returns the monotonic time when the tile moves that were held back
+ * by the rate limit can be applied, or INT64_MAX if there aren’t
+ * any.
+ */
+int64_t
+vsx_connection_get_deferred_move_time (VsxConnection *conn);
+
+/* Applies as many of the held back tile moves as the rate limit
+ * allows. Returns false if applying one of them failed in the same
+ * way as for vsx_connection_parse_data.
+ */
+bool
+vsx_connection_apply_deferred_moves (VsxConnection *conn,
+                                     struct vsx_error **error);
+
 void
 vsx_connection_free (VsxConnection *conn);
 
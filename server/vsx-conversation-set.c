@@ -26,6 +26,7 @@
 #include "vsx-list.h"
 #include "vsx-hash-table.h"
 #include "vsx-generate-id.h"
+#include "vsx-metrics.h"
 
 typedef struct
 {
@@ -116,6 +117,7 @@ conversation_changed_cb (struct vsx_listener *listener,
         {
           vsx_log ("Game %i abandoned without starting",
                    data->conversation->log_id);
+          vsx_metrics_count (VSX_METRICS_COUNTER_GAMES_ABANDONED, 1);
         }
       else
         {
@@ -212,22 +214,12 @@ vsx_conversation_set_new (void)
 }
 
 static VsxConversationSetListener *
-generate_conversation (VsxConversationSet *set,
-                       const VsxTileData *tile_data,
-                       const struct vsx_netaddress *addr)
+add_listener (VsxConversationSet *set,
+              VsxConversation *conversation)
 {
-  VsxConversationId id;
-
-  /* Keep generating ids until we find one that isn't used. It's
-   * hopefully pretty unlikely that it will generate a clash.
-   */
-  do
-    id = vsx_generate_id (addr);
-  while (vsx_hash_table_get (&set->hash_table, id));
-
   VsxConversationSetListener *listener = vsx_alloc (sizeof *listener);
 
-  listener->conversation = vsx_conversation_new (id, tile_data);
+  listener->conversation = conversation;
 
   listener->room_name = NULL;
   listener->set = set;
@@ -244,6 +236,23 @@ generate_conversation (VsxConversationSet *set,
   return listener;
 }
 
+static VsxConversationSetListener *
+generate_conversation (VsxConversationSet *set,
+                       const VsxTileData *tile_data,
+                       const struct vsx_netaddress *addr)
+{
+  VsxConversationId id;
+
+  /* Keep generating ids until we find one that isn't used. It's
+   * hopefully pretty unlikely that it will generate a clash.
+   */
+  do
+    id = vsx_generate_id (addr);
+  while (vsx_hash_table_get (&set->hash_table, id));
+
+  return add_listener (set, vsx_conversation_new (id, tile_data));
+}
+
 VsxConversation *
 vsx_conversation_set_generate_conversation (VsxConversationSet *set,
                                             const char *language_code,
@@ -293,3 +302,45 @@ vsx_conversation_set_get_pending_conversation (VsxConversationSet *set,
 
   return vsx_object_ref (listener->conversation);
 }
+
+void
+vsx_conversation_set_foreach (VsxConversationSet *set,
+                              VsxConversationSetForeachCallback callback,
+                              void *user_data)
+{
+  VsxConversationSetListener *listener;
+
+  vsx_list_for_each (listener, &set->pending_listeners, link)
+    {
+      callback (listener->conversation, listener->room_name, user_data);
+    }
+
+  vsx_list_for_each (listener, &set->other_listeners, link)
+    {
+      callback (listener->conversation, NULL, user_data);
+    }
+}
+
+bool
+vsx_conversation_set_add_conversation (VsxConversationSet *set,
+                                       VsxConversation *conversation,
+                                       const char *room_name)
+{
+  if (vsx_hash_table_get (&set->hash_table, conversation->hash_entry.id))
+    return false;
+
+  VsxConversationSetListener *listener =
+    add_listener (set, vsx_object_ref (conversation));
+
+  if (room_name && conversation->state == VSX_CONVERSATION_AWAITING_START)
+    {
+      vsx_list_insert (&set->pending_listeners, &listener->link);
+      listener->room_name = vsx_strdup (room_name);
+    }
+  else
+    {
+      vsx_list_insert (&set->other_listeners, &listener->link);
+    }
+
+  return true;
+}
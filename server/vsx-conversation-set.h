@@ -46,4 +46,25 @@ vsx_conversation_set_get_pending_conversation (VsxConversationSet *set,
                                                const char *room_name,
                                                const struct vsx_netaddress *a);
 
+/* room_name is NULL unless the conversation can still be joined by
+   name */
+typedef void
+(* VsxConversationSetForeachCallback) (VsxConversation *conversation,
+                                       const char *room_name,
+                                       void *user_data);
+
+void
+vsx_conversation_set_foreach (VsxConversationSet *set,
+                              VsxConversationSetForeachCallback callback,
+                              void *user_data);
+
+/* Adds a conversation that was created elsewhere, such as when
+   restoring a snapshot. If room_name is not NULL and the game hasn’t
+   started then new players can join it by name. Returns false if
+   there is already a conversation with the same ID. */
+bool
+vsx_conversation_set_add_conversation (VsxConversationSet *set,
+                                       VsxConversation *conversation,
+                                       const char *room_name);
+
 #endif /* VSX_CONVERSATION_SET_H */
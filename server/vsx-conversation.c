@@ -28,6 +28,7 @@
 #include "vsx-proto.h"
 #include "vsx-utf8.h"
 #include "vsx-util.h"
+#include "vsx-metrics.h"
 
 #define VSX_CONVERSATION_CENTER_X (600 / 2 - VSX_TILE_SIZE / 2)
 #define VSX_CONVERSATION_CENTER_Y (360 / 2 - VSX_TILE_SIZE / 2)
@@ -41,6 +42,13 @@ _Static_assert(VSX_CONVERSATION_DEFAULT_N_TILES <=
 
 static uint16_t next_log_id = 0;
 
+/* Process-wide. See vsx_conversation_set_global_broadcast_interval */
+static int64_t broadcast_interval = 0;
+
+/* List of conversations from all sets that have pending changes */
+static struct vsx_list pending_conversations =
+  { &pending_conversations, &pending_conversations };
+
 static void
 vsx_conversation_free (void *object)
 {
@@ -63,6 +71,9 @@ vsx_conversation_free (void *object)
 
   vsx_buffer_destroy (&self->messages);
 
+  if (self->has_pending_changes)
+    vsx_list_remove (&self->pending_link);
+
   vsx_free (self);
 }
 
@@ -110,6 +121,126 @@ vsx_conversation_tile_changed (VsxConversation *conversation,
   vsx_signal_emit (&conversation->changed_signal, &data);
 }
 
+/* Either emits a tile or player change straight away or marks it in
+ * the pending bitmask to be emitted on the next tick.
+ */
+static void
+vsx_conversation_queue_change (VsxConversation *conversation,
+                               VsxConversationChangedType type,
+                               vsx_bitmask_element_t *pending,
+                               int num)
+{
+  if (broadcast_interval > 0)
+    {
+      int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+
+      if (conversation->has_pending_changes)
+        {
+          if (vsx_bitmask_get (pending, num))
+            vsx_metrics_count (VSX_METRICS_COUNTER_CHANGES_COALESCED, 1);
+          else
+            vsx_bitmask_set (pending, num, true);
+          return;
+        }
+
+      if (now - conversation->last_broadcast_time < broadcast_interval)
+        {
+          vsx_bitmask_set (pending, num, true);
+          conversation->has_pending_changes = true;
+          vsx_list_insert (pending_conversations.prev,
+                           &conversation->pending_link);
+          return;
+        }
+
+      conversation->last_broadcast_time = now;
+    }
+
+  VsxConversationChangedData data;
+
+  data.conversation = conversation;
+  data.type = type;
+  data.num = num;
+
+  vsx_signal_emit (&conversation->changed_signal, &data);
+}
+
+static void
+emit_pending_changes (VsxConversation *conversation,
+                      VsxConversationChangedType type,
+                      vsx_bitmask_element_t *pending,
+                      int n_elements)
+{
+  VsxConversationChangedData data;
+
+  data.conversation = conversation;
+  data.type = type;
+
+  for (int i = 0; i < n_elements; i++)
+    {
+      vsx_bitmask_element_t element = pending[i];
+
+      pending[i] = 0;
+
+      while (element)
+        {
+          int bit_num = ffsl (element) - 1;
+
+          element &= element - 1;
+
+          data.num = i * VSX_BITMASK_BITS_PER_ELEMENT + bit_num;
+          vsx_signal_emit (&conversation->changed_signal, &data);
+        }
+    }
+}
+
+static void
+flush_pending_changes (VsxConversation *conversation,
+                       int64_t now)
+{
+  vsx_list_remove (&conversation->pending_link);
+  conversation->has_pending_changes = false;
+  conversation->last_broadcast_time = now;
+
+  emit_pending_changes (conversation,
+                        VSX_CONVERSATION_TILE_CHANGED,
+                        conversation->pending_tiles,
+                        VSX_N_ELEMENTS (conversation->pending_tiles));
+  emit_pending_changes (conversation,
+                        VSX_CONVERSATION_PLAYER_CHANGED,
+                        conversation->pending_players,
+                        VSX_N_ELEMENTS (conversation->pending_players));
+}
+
+void
+vsx_conversation_set_global_broadcast_interval (int64_t interval)
+{
+  broadcast_interval = MAX (interval, 0);
+}
+
+int64_t
+vsx_conversation_flush_broadcasts (void)
+{
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+  int64_t next_time = INT64_MAX;
+  VsxConversation *conversation, *tmp;
+
+  vsx_list_for_each_safe (conversation,
+                          tmp,
+                          &pending_conversations,
+                          pending_link)
+    {
+      int64_t due_time =
+        conversation->last_broadcast_time + broadcast_interval;
+
+      if (due_time <= now)
+        flush_pending_changes (conversation, now);
+      else if (due_time < next_time)
+        next_time = due_time;
+    }
+
+  return next_time;
+}
+
 void
 vsx_conversation_start (VsxConversation *conversation)
 {
@@ -201,10 +332,19 @@ vsx_conversation_set_typing (VsxConversation *conversation,
   if (!vsx_player_is_connected (player))
     return;
 
-  vsx_conversation_set_flag (conversation,
-                             player,
-                             VSX_PLAYER_TYPING,
-                             typing);
+  VsxPlayerFlags flags = player->flags & ~VSX_PLAYER_TYPING;
+
+  if (typing)
+    flags |= VSX_PLAYER_TYPING;
+
+  if (player->flags != flags)
+    {
+      player->flags = flags;
+      vsx_conversation_queue_change (conversation,
+                                     VSX_CONVERSATION_PLAYER_CHANGED,
+                                     conversation->pending_players,
+                                     player_num);
+    }
 }
 
 static void
@@ -364,6 +504,8 @@ vsx_conversation_new (VsxConversationId id,
 
   self->state = VSX_CONVERSATION_AWAITING_START;
 
+  vsx_metrics_count (VSX_METRICS_COUNTER_GAMES_CREATED, 1);
+
   return self;
 }
 
@@ -545,7 +687,10 @@ vsx_conversation_move_tile (VsxConversation *conversation,
       tile->x = x;
       tile->y = y;
       tile->last_player = player_num;
-      vsx_conversation_tile_changed (conversation, tile);
+      vsx_conversation_queue_change (conversation,
+                                     VSX_CONVERSATION_TILE_CHANGED,
+                                     conversation->pending_tiles,
+                                     tile_num);
     }
 }
 
@@ -28,6 +28,8 @@
 #include "vsx-tile-data.h"
 #include "vsx-buffer.h"
 #include "vsx-hash-table.h"
+#include "vsx-bitmask.h"
+#include "vsx-list.h"
 
 #define VSX_CONVERSATION_MAX_PLAYERS 6
 
@@ -69,6 +71,21 @@ typedef struct
 
   int64_t last_shout_time;
 
+  /* Tiles and players whose changes are being held back until the
+   * next broadcast tick. See vsx_conversation_set_global_broadcast_interval.
+   */
+  vsx_bitmask_element_t
+  pending_tiles[VSX_BITMASK_N_ELEMENTS_FOR_SIZE (VSX_TILE_DATA_N_TILES)];
+  vsx_bitmask_element_t
+  pending_players[VSX_BITMASK_N_ELEMENTS_FOR_SIZE
+                  (VSX_CONVERSATION_MAX_PLAYERS)];
+  /* Link in the list of conversations that have pending changes. This
+   * is only valid if has_pending_changes is true.
+   */
+  struct vsx_list pending_link;
+  bool has_pending_changes;
+  int64_t last_broadcast_time;
+
   int log_id;
 } VsxConversation;
 
@@ -160,4 +177,28 @@ void
 vsx_conversation_turn (VsxConversation *conversation,
                        unsigned int player_num);
 
+/* Sets the minimum time in microseconds between broadcasts of tile
+ * moves and typing changes for each conversation. The first change
+ * after a quiet period is sent straight away and any further changes
+ * within the interval are merged so that each tile or player is only
+ * reported once when the interval is over. Other changes such as
+ * shouts and turns are always sent immediately. Zero disables the
+ * merging.
+ *
+ * The interval is a process-wide setting rather than a property of a
+ * VsxConversationSet. It applies to every conversation in every set,
+ * including ones that already exist.
+ */
+void
+vsx_conversation_set_global_broadcast_interval (int64_t interval);
+
+/* Sends the held back changes of any conversations whose interval has
+ * passed. The list of conversations with held back changes is also
+ * process-wide so this covers every conversation set. Returns the
+ * monotonic time when this next needs to be called or INT64_MAX if
+ * nothing is pending.
+ */
+int64_t
+vsx_conversation_flush_broadcasts (void);
+
 #endif /* VSX_CONVERSATION_H */
@@ -0,0 +1,528 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-deflate.h"
+
+#include <string.h>
+#include <assert.h>
+#include <zlib.h>
+
+#include "vsx-util.h"
+
+#define VSX_DEFLATE_EXTENSION_NAME "permessage-deflate"
+
+/* Every message compressed with Z_SYNC_FLUSH ends with an empty
+ * stored block. RFC 7692 says to leave it out on the wire and to put
+ * it back before decompressing.
+ */
+static const uint8_t
+sync_flush_tail[] = { 0x00, 0x00, 0xff, 0xff };
+
+typedef struct
+{
+  bool server_no_context_takeover;
+  bool client_no_context_takeover;
+  /* Zero if the parameter wasn’t given and -1 if it was given
+   * without a value.
+   */
+  int server_max_window_bits;
+  int client_max_window_bits;
+} VsxDeflateOffer;
+
+struct _VsxDeflate
+{
+  int server_window_bits;
+  int client_window_bits;
+  bool server_no_context_takeover;
+
+  /* The streams are only created the first time they are needed so
+   * that connections that never send anything big enough to compress
+   * don’t pay for the window.
+   */
+  bool deflate_initialized;
+  bool inflate_initialized;
+  z_stream deflate_stream;
+  z_stream inflate_stream;
+
+  struct vsx_buffer response_header;
+};
+
+/* Like memchr but takes the end of the span, which can be empty */
+static const char *
+find_char (const char *start,
+           const char *end,
+           char ch)
+{
+  if (start >= end)
+    return NULL;
+
+  return memchr (start, ch, end - start);
+}
+
+static const char *
+skip_whitespace (const char *p,
+                 const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+
+  return p;
+}
+
+static const char *
+trim_end (const char *start,
+          const char *end)
+{
+  while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+    end--;
+
+  return end;
+}
+
+static bool
+span_equal (const char *start,
+            const char *end,
+            const char *str)
+{
+  size_t length = strlen (str);
+
+  return end - start == length && !memcmp (start, str, length);
+}
+
+static bool
+parse_window_bits (const char *start,
+                   const char *end,
+                   int *value)
+{
+  /* The value is allowed to be quoted */
+  if (end - start >= 2 && *start == '"' && end[-1] == '"')
+    {
+      start++;
+      end--;
+    }
+
+  if (start >= end || end - start > 2)
+    return false;
+
+  int bits = 0;
+
+  for (const char *p = start; p < end; p++)
+    {
+      if (!vsx_ascii_isdigit (*p))
+        return false;
+
+      bits = bits * 10 + *p - '0';
+    }
+
+  if (bits < 8 || bits > VSX_DEFLATE_MAX_WINDOW_BITS)
+    return false;
+
+  *value = bits;
+
+  return true;
+}
+
+static bool
+parse_parameter (VsxDeflateOffer *offer,
+                 const char *start,
+                 const char *end)
+{
+  const char *equals = find_char (start, end, '=');
+  const char *name_end = equals ? trim_end (start, equals) : end;
+  const char *value = equals ? skip_whitespace (equals + 1, end) : NULL;
+
+  /* Each parameter can only be given once */
+
+  if (span_equal (start, name_end, "server_no_context_takeover"))
+    {
+      if (equals || offer->server_no_context_takeover)
+        return false;
+      offer->server_no_context_takeover = true;
+      return true;
+    }
+
+  if (span_equal (start, name_end, "client_no_context_takeover"))
+    {
+      if (equals || offer->client_no_context_takeover)
+        return false;
+      offer->client_no_context_takeover = true;
+      return true;
+    }
+
+  if (span_equal (start, name_end, "server_max_window_bits"))
+    {
+      if (equals == NULL || offer->server_max_window_bits)
+        return false;
+      return parse_window_bits (value, end, &offer->server_max_window_bits);
+    }
+
+  if (span_equal (start, name_end, "client_max_window_bits"))
+    {
+      if (offer->client_max_window_bits)
+        return false;
+
+      if (equals == NULL)
+        {
+          offer->client_max_window_bits = -1;
+          return true;
+        }
+
+      return parse_window_bits (value, end, &offer->client_max_window_bits);
+    }
+
+  /* Unknown parameters make the whole offer invalid */
+  return false;
+}
+
+static bool
+parse_offer (const char *start,
+             const char *end,
+             VsxDeflateOffer *offer)
+{
+  memset (offer, 0, sizeof *offer);
+
+  const char *semicolon = find_char (start, end, ';');
+  const char *name_end = trim_end (start, semicolon ? semicolon : end);
+
+  if (!span_equal (start, name_end, VSX_DEFLATE_EXTENSION_NAME))
+    return false;
+
+  while (semicolon)
+    {
+      const char *param_start = skip_whitespace (semicolon + 1, end);
+
+      semicolon = find_char (param_start, end, ';');
+
+      const char *param_end = trim_end (param_start,
+                                        semicolon ? semicolon : end);
+
+      if (!parse_parameter (offer, param_start, param_end))
+        return false;
+    }
+
+  return true;
+}
+
+static bool
+is_acceptable (const VsxDeflateOffer *offer,
+               int max_window_bits)
+{
+  /* zlib can’t compress with a window of 256 bytes */
+  if (offer->server_max_window_bits > 0
+      && offer->server_max_window_bits < VSX_DEFLATE_MIN_WINDOW_BITS)
+    return false;
+
+  /* If the client can’t limit its window then it might use the
+   * maximum size, which would break the memory cap.
+   */
+  if (offer->client_max_window_bits == 0
+      && max_window_bits < VSX_DEFLATE_MAX_WINDOW_BITS)
+    return false;
+
+  return true;
+}
+
+static VsxDeflate *
+accept_offer (const VsxDeflateOffer *offer,
+              int max_window_bits)
+{
+  VsxDeflate *state = vsx_calloc (sizeof *state);
+
+  if (offer->server_max_window_bits > 0)
+    {
+      state->server_window_bits = MIN (offer->server_max_window_bits,
+                                       max_window_bits);
+    }
+  else
+    {
+      /* We can always use a smaller window than the client expects
+       * without telling it.
+       */
+      state->server_window_bits = max_window_bits;
+    }
+
+  if (offer->client_max_window_bits > 0)
+    {
+      state->client_window_bits = MIN (offer->client_max_window_bits,
+                                       max_window_bits);
+    }
+  else if (offer->client_max_window_bits == -1)
+    {
+      state->client_window_bits = max_window_bits;
+    }
+  else
+    {
+      state->client_window_bits = VSX_DEFLATE_MAX_WINDOW_BITS;
+    }
+
+  state->server_no_context_takeover = offer->server_no_context_takeover;
+
+  struct vsx_buffer *header = &state->response_header;
+
+  vsx_buffer_init (header);
+  vsx_buffer_append_string (header,
+                            "\r\n"
+                            "Sec-WebSocket-Extensions: "
+                            VSX_DEFLATE_EXTENSION_NAME);
+
+  if (offer->server_no_context_takeover)
+    vsx_buffer_append_string (header, "; server_no_context_takeover");
+  if (offer->client_no_context_takeover)
+    vsx_buffer_append_string (header, "; client_no_context_takeover");
+  if (offer->server_max_window_bits)
+    {
+      vsx_buffer_append_printf (header,
+                                "; server_max_window_bits=%i",
+                                state->server_window_bits);
+    }
+  if (offer->client_max_window_bits)
+    {
+      vsx_buffer_append_printf (header,
+                                "; client_max_window_bits=%i",
+                                state->client_window_bits);
+    }
+
+  return state;
+}
+
+VsxDeflate *
+vsx_deflate_negotiate (const char *extensions,
+                       const VsxDeflateOptions *options)
+{
+  if (extensions == NULL || options->window_bits <= 0)
+    return NULL;
+
+  int max_window_bits = MAX (MIN (options->window_bits,
+                                  VSX_DEFLATE_MAX_WINDOW_BITS),
+                             VSX_DEFLATE_MIN_WINDOW_BITS);
+  const char *end = extensions + strlen (extensions);
+  const char *p = extensions;
+
+  while (true)
+    {
+      const char *offer_start = skip_whitespace (p, end);
+      const char *comma = find_char (offer_start, end, ',');
+      const char *offer_end = trim_end (offer_start, comma ? comma : end);
+      VsxDeflateOffer offer;
+
+      if (parse_offer (offer_start, offer_end, &offer)
+          && is_acceptable (&offer, max_window_bits))
+        return accept_offer (&offer, max_window_bits);
+
+      if (comma == NULL)
+        return NULL;
+
+      p = comma + 1;
+    }
+}
+
+const char *
+vsx_deflate_get_response_header (VsxDeflate *state)
+{
+  return (const char *) state->response_header.data;
+}
+
+static voidpf
+zlib_alloc (voidpf opaque,
+            uInt items,
+            uInt size)
+{
+  return vsx_alloc ((size_t) items * size);
+}
+
+static void
+zlib_free (voidpf opaque,
+           voidpf address)
+{
+  vsx_free (address);
+}
+
+void
+vsx_deflate_compress (VsxDeflate *state,
+                      const uint8_t *data,
+                      size_t length,
+                      struct vsx_buffer *buffer)
+{
+  /* zlib won’t flush anything if there is no new input so empty
+   * messages are sent as a single empty stored block instead.
+   */
+  if (length == 0)
+    {
+      vsx_buffer_append_c (buffer, 0x00);
+      return;
+    }
+
+  z_stream *stream = &state->deflate_stream;
+
+  if (!state->deflate_initialized)
+    {
+      /* The memory level scales the hash table with the window so
+       * that the cap covers both of them.
+       */
+      int mem_level = MAX (MIN (state->server_window_bits - 7, 8), 1);
+
+      stream->zalloc = zlib_alloc;
+      stream->zfree = zlib_free;
+
+      int ret = deflateInit2 (stream,
+                              Z_DEFAULT_COMPRESSION,
+                              Z_DEFLATED,
+                              -state->server_window_bits,
+                              mem_level,
+                              Z_DEFAULT_STRATEGY);
+
+      if (ret != Z_OK)
+        vsx_fatal ("deflateInit2 failed");
+
+      state->deflate_initialized = true;
+    }
+
+  stream->next_in = (Bytef *) data;
+  stream->avail_in = length;
+
+  /* The flush has finished once deflate leaves some space in the
+   * output.
+   */
+  do
+    {
+      vsx_buffer_ensure_size (buffer, buffer->length + length + 64);
+
+      stream->next_out = buffer->data + buffer->length;
+      stream->avail_out = buffer->size - buffer->length;
+
+      deflate (stream, Z_SYNC_FLUSH);
+
+      buffer->length = buffer->size - stream->avail_out;
+    } while (stream->avail_out == 0);
+
+  assert (buffer->length >= sizeof sync_flush_tail
+          && !memcmp (buffer->data + buffer->length - sizeof sync_flush_tail,
+                      sync_flush_tail,
+                      sizeof sync_flush_tail));
+
+  buffer->length -= sizeof sync_flush_tail;
+
+  if (state->server_no_context_takeover)
+    deflateReset (stream);
+}
+
+static bool
+inflate_data (z_stream *stream,
+              const uint8_t *data,
+              size_t length,
+              bool *stream_end)
+{
+  stream->next_in = (Bytef *) data;
+  stream->avail_in = length;
+
+  int ret = inflate (stream, Z_SYNC_FLUSH);
+
+  if (ret == Z_STREAM_END)
+    {
+      /* The client finished the stream with a final block. The next
+       * message will start a new one.
+       */
+      *stream_end = true;
+      inflateReset (stream);
+      return true;
+    }
+
+  if (ret != Z_OK && ret != Z_BUF_ERROR)
+    return false;
+
+  /* If there is input left then the output buffer is full */
+  return stream->avail_in == 0;
+}
+
+bool
+vsx_deflate_decompress (VsxDeflate *state,
+                        const uint8_t *data,
+                        size_t length,
+                        uint8_t *out,
+                        size_t out_size,
+                        size_t *out_length)
+{
+  z_stream *stream = &state->inflate_stream;
+
+  if (!state->inflate_initialized)
+    {
+      stream->zalloc = zlib_alloc;
+      stream->zfree = zlib_free;
+
+      /* A client that asked for a window of 8 bits may really use 9
+       * if it is also using zlib so we always allow at least the
+       * minimum.
+       */
+      int window_bits = MAX (state->client_window_bits,
+                             VSX_DEFLATE_MIN_WINDOW_BITS);
+
+      if (inflateInit2 (stream, -window_bits) != Z_OK)
+        vsx_fatal ("inflateInit2 failed");
+
+      state->inflate_initialized = true;
+    }
+
+  bool stream_end = false;
+
+  stream->next_out = out;
+  stream->avail_out = out_size;
+
+  if (!inflate_data (stream, data, length, &stream_end))
+    return false;
+
+  if (!stream_end
+      && !inflate_data (stream,
+                        sync_flush_tail,
+                        sizeof sync_flush_tail,
+                        &stream_end))
+    return false;
+
+  *out_length = out_size - stream->avail_out;
+
+  /* If the output is exactly full then check whether there was any
+   * more to come.
+   */
+  if (!stream_end && stream->avail_out == 0)
+    {
+      uint8_t extra;
+
+      stream->next_out = &extra;
+      stream->avail_out = 1;
+
+      if (inflate (stream, Z_SYNC_FLUSH) != Z_BUF_ERROR
+          || stream->avail_out == 0)
+        return false;
+    }
+
+  return true;
+}
+
+void
+vsx_deflate_free (VsxDeflate *state)
+{
+  if (state->deflate_initialized)
+    deflateEnd (&state->deflate_stream);
+  if (state->inflate_initialized)
+    inflateEnd (&state->inflate_stream);
+
+  vsx_buffer_destroy (&state->response_header);
+
+  vsx_free (state);
+}
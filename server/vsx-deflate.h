@@ -0,0 +1,91 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_DEFLATE_H
+#define VSX_DEFLATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vsx-buffer.h"
+
+/* Implementation of the permessage-deflate WebSocket extension from
+ * RFC 7692. Unless the client asks otherwise the compression context
+ * is kept between messages so that repeated player names and commands
+ * compress against everything sent before on the same connection.
+ */
+
+#define VSX_DEFLATE_MIN_WINDOW_BITS 9
+#define VSX_DEFLATE_MAX_WINDOW_BITS 15
+
+typedef struct
+{
+  /* Base-two logarithm of the largest LZ77 window that will be used
+   * in either direction, or zero to disable the extension. This caps
+   * the memory used by each connection. Compressing needs about
+   * 2^(window_bits + 3) bytes and decompressing about 2^window_bits
+   * plus 7KiB.
+   */
+  int window_bits;
+  /* Messages with a payload shorter than this are sent uncompressed */
+  int threshold;
+} VsxDeflateOptions;
+
+typedef struct _VsxDeflate VsxDeflate;
+
+/* Looks through the value of the Sec-WebSocket-Extensions headers for
+ * the first permessage-deflate offer that can be accepted within the
+ * options. Returns NULL if there isn’t one.
+ */
+VsxDeflate *
+vsx_deflate_negotiate (const char *extensions,
+                       const VsxDeflateOptions *options);
+
+/* Returns the header line to add to the handshake response to accept
+ * the offer. It starts with "\r\n" and has no line ending so that it
+ * can be put straight after the previous header.
+ */
+const char *
+vsx_deflate_get_response_header (VsxDeflate *state);
+
+/* Compresses the payload of one message and appends the result to
+ * buffer.
+ */
+void
+vsx_deflate_compress (VsxDeflate *state,
+                      const uint8_t *data,
+                      size_t length,
+                      struct vsx_buffer *buffer);
+
+/* Decompresses the payload of one message into out. Returns false if
+ * the data is invalid or if it would decompress to more than
+ * out_size bytes.
+ */
+bool
+vsx_deflate_decompress (VsxDeflate *state,
+                        const uint8_t *data,
+                        size_t length,
+                        uint8_t *out,
+                        size_t out_size,
+                        size_t *out_length);
+
+void
+vsx_deflate_free (VsxDeflate *state);
+
+#endif /* VSX_DEFLATE_H */
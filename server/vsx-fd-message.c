@@ -0,0 +1,296 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-fd-message.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "vsx-file-error.h"
+#include "vsx-socket.h"
+#include "vsx-util.h"
+
+struct vsx_error_domain
+vsx_fd_message_error;
+
+static bool
+make_address (const char *path,
+              struct sockaddr_un *addr,
+              struct vsx_error **error)
+{
+  if (strlen (path) >= sizeof addr->sun_path)
+    {
+      vsx_set_error (error,
+                     &vsx_fd_message_error,
+                     VSX_FD_MESSAGE_ERROR_INVALID_PATH,
+                     "UNIX socket path is too long: %s",
+                     path);
+      return false;
+    }
+
+  memset (addr, 0, sizeof *addr);
+  addr->sun_family = AF_UNIX;
+  strcpy (addr->sun_path, path);
+
+  return true;
+}
+
+static int
+create_socket (struct vsx_error **error)
+{
+  int sock = socket (PF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  if (sock == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to create socket: %s",
+                          strerror (errno));
+    }
+
+  return sock;
+}
+
+int
+vsx_fd_message_listen (const char *path,
+                       struct vsx_error **error)
+{
+  struct sockaddr_un addr;
+
+  if (!make_address (path, &addr, error))
+    return -1;
+
+  int sock = create_socket (error);
+
+  if (sock == -1)
+    return -1;
+
+  if (!vsx_socket_set_nonblock (sock, error))
+    goto error;
+
+  struct stat statbuf;
+
+  if (stat (path, &statbuf) == 0 && S_ISSOCK (statbuf.st_mode))
+    unlink (path);
+
+  if (bind (sock, (struct sockaddr *) &addr, sizeof addr) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to bind %s: %s",
+                          path,
+                          strerror (errno));
+      goto error;
+    }
+
+  chmod (path, 0600);
+
+  if (listen (sock, 10) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to make %s listen: %s",
+                          path,
+                          strerror (errno));
+      unlink (path);
+      goto error;
+    }
+
+  return sock;
+
+ error:
+  vsx_close (sock);
+  return -1;
+}
+
+int
+vsx_fd_message_connect (const char *path,
+                        struct vsx_error **error)
+{
+  struct sockaddr_un addr;
+
+  if (!make_address (path, &addr, error))
+    return -1;
+
+  int sock = create_socket (error);
+
+  if (sock == -1)
+    return -1;
+
+  if (connect (sock, (struct sockaddr *) &addr, sizeof addr) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to connect to %s: %s",
+                          path,
+                          strerror (errno));
+      vsx_close (sock);
+      return -1;
+    }
+
+  return sock;
+}
+
+void
+vsx_fd_message_set_timeout (int sock,
+                            int seconds)
+{
+  struct timeval timeout = { .tv_sec = seconds };
+
+  setsockopt (sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+  setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+}
+
+bool
+vsx_fd_message_send (int sock,
+                     const struct iovec *iov,
+                     int n_iov,
+                     int fd,
+                     struct vsx_error **error)
+{
+  union
+  {
+    struct cmsghdr cmsg;
+    uint8_t buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  struct msghdr msg =
+    {
+      .msg_iov = (struct iovec *) iov,
+      .msg_iovlen = n_iov,
+    };
+
+  if (fd != -1)
+    {
+      memset (&control, 0, sizeof control);
+      msg.msg_control = control.buf;
+      msg.msg_controllen = sizeof control.buf;
+
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+      memcpy (CMSG_DATA (cmsg), &fd, sizeof fd);
+    }
+
+  while (sendmsg (sock, &msg, MSG_NOSIGNAL) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+
+      vsx_file_error_set (error,
+                          errno,
+                          "Error sending message: %s",
+                          strerror (errno));
+      return false;
+    }
+
+  return true;
+}
+
+bool
+vsx_fd_message_receive (int sock,
+                        struct vsx_buffer *buffer,
+                        size_t max_size,
+                        int *fd_out,
+                        struct vsx_error **error)
+{
+  vsx_buffer_set_length (buffer, max_size);
+
+  struct iovec iov =
+    {
+      .iov_base = buffer->data,
+      .iov_len = max_size,
+    };
+  union
+  {
+    struct cmsghdr cmsg;
+    uint8_t buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  struct msghdr msg =
+    {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buf,
+      .msg_controllen = sizeof control.buf,
+    };
+  ssize_t got;
+
+  *fd_out = -1;
+
+  while ((got = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC)) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+
+      vsx_file_error_set (error,
+                          errno,
+                          "Error receiving message: %s",
+                          strerror (errno));
+      vsx_buffer_set_length (buffer, 0);
+      return false;
+    }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+       cmsg;
+       cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET
+          && cmsg->cmsg_type == SCM_RIGHTS
+          && cmsg->cmsg_len == CMSG_LEN (sizeof (int)))
+        memcpy (fd_out, CMSG_DATA (cmsg), sizeof *fd_out);
+    }
+
+  if (got == 0)
+    {
+      vsx_set_error (error,
+                     &vsx_fd_message_error,
+                     VSX_FD_MESSAGE_ERROR_CLOSED,
+                     "The other process closed the socket");
+      goto error;
+    }
+
+  if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+      vsx_set_error (error,
+                     &vsx_fd_message_error,
+                     VSX_FD_MESSAGE_ERROR_TRUNCATED,
+                     "Received message is too long");
+      goto error;
+    }
+
+  vsx_buffer_set_length (buffer, got);
+
+  return true;
+
+ error:
+  if (*fd_out != -1)
+    {
+      vsx_close (*fd_out);
+      *fd_out = -1;
+    }
+  vsx_buffer_set_length (buffer, 0);
+  return false;
+}
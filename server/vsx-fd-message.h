@@ -0,0 +1,84 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_FD_MESSAGE_H
+#define VSX_FD_MESSAGE_H
+
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include "vsx-error.h"
+#include "vsx-buffer.h"
+
+/* Helpers for sending messages between processes over a UNIX
+ * SOCK_SEQPACKET socket. Each message is received in one piece and
+ * can optionally carry a file descriptor which is passed with
+ * SCM_RIGHTS.
+ */
+
+extern struct vsx_error_domain
+vsx_fd_message_error;
+
+typedef enum
+{
+  /* The other end closed the socket */
+  VSX_FD_MESSAGE_ERROR_CLOSED,
+  /* A message was too big for the buffer */
+  VSX_FD_MESSAGE_ERROR_TRUNCATED,
+  VSX_FD_MESSAGE_ERROR_INVALID_PATH,
+} VsxFdMessageError;
+
+/* Creates a non-blocking socket listening on path. Any stale socket
+ * file is replaced and only the current user can connect to it.
+ */
+int
+vsx_fd_message_listen (const char *path,
+                       struct vsx_error **error);
+
+/* Creates a blocking socket connected to path */
+int
+vsx_fd_message_connect (const char *path,
+                        struct vsx_error **error);
+
+/* Sets a timeout in seconds for blocking sends and receives */
+void
+vsx_fd_message_set_timeout (int sock,
+                            int seconds);
+
+/* Sends the concatenation of the iovecs as one message along with fd
+ * if it is not -1.
+ */
+bool
+vsx_fd_message_send (int sock,
+                     const struct iovec *iov,
+                     int n_iov,
+                     int fd,
+                     struct vsx_error **error);
+
+/* Receives one message into buffer. *fd_out is set to the passed file
+ * descriptor or -1 if there wasn’t one. If the socket is non-blocking
+ * and there is no message this fails with VSX_FILE_ERROR_AGAIN.
+ */
+bool
+vsx_fd_message_receive (int sock,
+                        struct vsx_buffer *buffer,
+                        size_t max_size,
+                        int *fd_out,
+                        struct vsx_error **error);
+
+#endif /* VSX_FD_MESSAGE_H */
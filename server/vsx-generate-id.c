@@ -25,6 +25,20 @@
 #include <unistd.h>
 #include <string.h>
 
+#include "vsx-capture.h"
+
+static vsx_generate_id_func
+generate_id_func = NULL;
+
+static void *
+generate_id_data;
+
+static vsx_generate_id_filter
+generate_id_filter = NULL;
+
+static void *
+generate_id_filter_data;
+
 static void
 xor_bytes(uint64_t *id,
           const uint8_t *data,
@@ -55,8 +69,8 @@ fill_from_urandom(void *buf, size_t size)
         return got == -1 ? 0 : got;
 }
 
-uint64_t
-vsx_generate_id(const struct vsx_netaddress *remote_address)
+static uint64_t
+generate_random_id(const struct vsx_netaddress *remote_address)
 {
         uint16_t random_data;
         uint64_t id = 0;
@@ -92,3 +106,38 @@ vsx_generate_id(const struct vsx_netaddress *remote_address)
 
         return id;
 }
+
+uint64_t
+vsx_generate_id(const struct vsx_netaddress *remote_address)
+{
+        uint64_t id;
+
+        if (generate_id_func)
+                id = generate_id_func(generate_id_data);
+        else {
+                do
+                        id = generate_random_id(remote_address);
+                while (generate_id_filter &&
+                       !generate_id_filter(id, generate_id_filter_data));
+        }
+
+        vsx_capture_generated_id(id);
+
+        return id;
+}
+
+void
+vsx_generate_id_set_func(vsx_generate_id_func func,
+                         void *user_data)
+{
+        generate_id_func = func;
+        generate_id_data = user_data;
+}
+
+void
+vsx_generate_id_set_filter(vsx_generate_id_filter filter,
+                           void *user_data)
+{
+        generate_id_filter = filter;
+        generate_id_filter_data = user_data;
+}
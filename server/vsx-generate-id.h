@@ -21,9 +21,35 @@
 
 #include <stdint.h>
 
+#include <stdbool.h>
+
 #include "vsx-netaddress.h"
 
+typedef uint64_t
+(* vsx_generate_id_func)(void *user_data);
+
+typedef bool
+(* vsx_generate_id_filter)(uint64_t id, void *user_data);
+
 uint64_t
 vsx_generate_id(const struct vsx_netaddress *remote_address);
 
+/* Replaces the random number generator with a function so that the
+ * IDs can be predicted when replaying a capture. Pass NULL to go back
+ * to random IDs.
+ */
+void
+vsx_generate_id_set_func(vsx_generate_id_func func,
+                         void *user_data);
+
+/* Sets a function that random IDs must pass. IDs are regenerated
+ * until the filter returns true. This is used in cluster mode so that
+ * every ID a backend hands out routes back to that backend. The
+ * filter is not used for IDs from a function set with
+ * vsx_generate_id_set_func. Pass NULL to remove it.
+ */
+void
+vsx_generate_id_set_filter(vsx_generate_id_filter filter,
+                           void *user_data);
+
 #endif /* VSX_GENERATE_ID_H */
@@ -0,0 +1,336 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-handshake-pool.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <openssl/err.h>
+
+#include "vsx-main-context.h"
+#include "vsx-file-error.h"
+#include "vsx-socket.h"
+#include "vsx-util.h"
+
+struct _VsxHandshakePool
+{
+  int n_threads;
+  pthread_t *threads;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  /* Jobs waiting to be picked up by a thread */
+  struct vsx_list queue;
+  /* Jobs that have finished and need to be given back to the owner */
+  struct vsx_list completed;
+
+  bool quit;
+
+  /* The threads write a byte to this pipe when they add something to
+   * an empty completed list in order to wake up the main context.
+   */
+  int notify_pipe[2];
+  VsxMainContextSource *notify_source;
+
+  VsxHandshakePoolCallback callback;
+  void *user_data;
+};
+
+static int64_t
+get_monotonic_time (void)
+{
+  /* We can’t use vsx_main_context_get_monotonic_clock from the worker
+   * threads because it isn’t thread-safe.
+   */
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C (1000000) + ts.tv_nsec / INT64_C (1000);
+}
+
+void
+vsx_handshake_pool_run_job (VsxHandshakePoolJob *job)
+{
+  /* Make sure we don’t pick up a stale error left by some other
+   * connection that used this thread.
+   */
+  ERR_clear_error ();
+
+  int ret = SSL_do_handshake (job->ssl);
+
+  if (ret == 1)
+    {
+      job->result = VSX_HANDSHAKE_POOL_RESULT_DONE;
+      return;
+    }
+
+  switch (SSL_get_error (job->ssl, ret))
+    {
+    case SSL_ERROR_WANT_READ:
+      job->result = VSX_HANDSHAKE_POOL_RESULT_WANT_READ;
+      break;
+    case SSL_ERROR_WANT_WRITE:
+      job->result = VSX_HANDSHAKE_POOL_RESULT_WANT_WRITE;
+      break;
+    default:
+      job->result = VSX_HANDSHAKE_POOL_RESULT_ERROR;
+      job->ssl_errnum = ERR_get_error ();
+      break;
+    }
+}
+
+static void
+block_signals (void)
+{
+  sigset_t sigset;
+
+  sigemptyset (&sigset);
+  sigaddset (&sigset, SIGINT);
+  sigaddset (&sigset, SIGTERM);
+
+  if (pthread_sigmask (SIG_BLOCK, &sigset, NULL) == -1)
+    vsx_warning ("pthread_sigmask failed: %s", strerror (errno));
+}
+
+static void
+wake_up_main_context (VsxHandshakePool *pool)
+{
+  uint8_t byte = 42;
+
+  while (write (pool->notify_pipe[1], &byte, 1) == -1
+         && errno == EINTR);
+}
+
+static void *
+thread_func (void *user_data)
+{
+  VsxHandshakePool *pool = user_data;
+
+  block_signals ();
+
+  pthread_mutex_lock (&pool->mutex);
+
+  while (true)
+    {
+      /* Keep going until the queue is empty even if we’ve been asked
+       * to quit so that every job will be given back to the owner.
+       */
+      while (!pool->quit && vsx_list_empty (&pool->queue))
+        pthread_cond_wait (&pool->cond, &pool->mutex);
+
+      if (vsx_list_empty (&pool->queue))
+        break;
+
+      VsxHandshakePoolJob *job =
+        vsx_container_of (pool->queue.next, VsxHandshakePoolJob, link);
+
+      vsx_list_remove (&job->link);
+
+      pthread_mutex_unlock (&pool->mutex);
+
+      job->wait_time = get_monotonic_time () - job->queue_time;
+
+      vsx_handshake_pool_run_job (job);
+
+      pthread_mutex_lock (&pool->mutex);
+
+      bool was_empty = vsx_list_empty (&pool->completed);
+
+      vsx_list_insert (pool->completed.prev, &job->link);
+
+      if (was_empty && !pool->quit)
+        wake_up_main_context (pool);
+    }
+
+  pthread_mutex_unlock (&pool->mutex);
+
+  return NULL;
+}
+
+static void
+dispatch_completed (VsxHandshakePool *pool)
+{
+  struct vsx_list completed;
+
+  pthread_mutex_lock (&pool->mutex);
+
+  vsx_list_init (&completed);
+  vsx_list_insert_list (&completed, &pool->completed);
+  vsx_list_init (&pool->completed);
+
+  pthread_mutex_unlock (&pool->mutex);
+
+  VsxHandshakePoolJob *job, *tmp;
+
+  /* The callback is allowed to free the job so the list needs to be
+   * iterated safely.
+   */
+  vsx_list_for_each_safe (job, tmp, &completed, link)
+    {
+      pool->callback (job, pool->user_data);
+    }
+}
+
+static void
+notify_cb (VsxMainContextSource *source,
+           int fd,
+           VsxMainContextPollFlags flags,
+           void *user_data)
+{
+  VsxHandshakePool *pool = user_data;
+  uint8_t buf[16];
+
+  if (read (pool->notify_pipe[0], buf, sizeof buf) == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        vsx_warning ("Read from handshake pipe failed: %s", strerror (errno));
+    }
+
+  dispatch_completed (pool);
+}
+
+static void
+stop_threads (VsxHandshakePool *pool)
+{
+  pthread_mutex_lock (&pool->mutex);
+  pool->quit = true;
+  pthread_cond_broadcast (&pool->cond);
+  pthread_mutex_unlock (&pool->mutex);
+
+  for (int i = 0; i < pool->n_threads; i++)
+    pthread_join (pool->threads[i], NULL);
+
+  pool->n_threads = 0;
+}
+
+VsxHandshakePool *
+vsx_handshake_pool_new (int n_threads,
+                        VsxHandshakePoolCallback callback,
+                        void *user_data,
+                        struct vsx_error **error)
+{
+  assert (n_threads > 0);
+
+  VsxHandshakePool *pool = vsx_calloc (sizeof *pool);
+
+  pool->callback = callback;
+  pool->user_data = user_data;
+
+  pthread_mutex_init (&pool->mutex, NULL);
+  pthread_cond_init (&pool->cond, NULL);
+  vsx_list_init (&pool->queue);
+  vsx_list_init (&pool->completed);
+
+  if (pipe (pool->notify_pipe) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to create handshake pipe: %s",
+                          strerror (errno));
+      pool->notify_pipe[0] = -1;
+      goto error;
+    }
+
+  if (!vsx_socket_set_nonblock (pool->notify_pipe[0], error))
+    goto error;
+
+  pool->notify_source =
+    vsx_main_context_add_poll (NULL /* default context */,
+                               pool->notify_pipe[0],
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               notify_cb,
+                               pool);
+
+  pool->threads = vsx_alloc (n_threads * sizeof (pthread_t));
+
+  for (int i = 0; i < n_threads; i++)
+    {
+      int res = pthread_create (pool->threads + i,
+                                NULL, /* attr */
+                                thread_func,
+                                pool);
+
+      if (res)
+        {
+          vsx_file_error_set (error,
+                              res,
+                              "Error creating handshake thread: %s",
+                              strerror (res));
+          goto error;
+        }
+
+      pool->n_threads++;
+    }
+
+  return pool;
+
+ error:
+  vsx_handshake_pool_free (pool);
+  return NULL;
+}
+
+void
+vsx_handshake_pool_queue (VsxHandshakePool *pool,
+                          VsxHandshakePoolJob *job)
+{
+  job->queue_time = get_monotonic_time ();
+
+  pthread_mutex_lock (&pool->mutex);
+
+  vsx_list_insert (pool->queue.prev, &job->link);
+
+  pthread_cond_signal (&pool->cond);
+
+  pthread_mutex_unlock (&pool->mutex);
+}
+
+void
+vsx_handshake_pool_free (VsxHandshakePool *pool)
+{
+  stop_threads (pool);
+
+  /* Give any remaining jobs back to the owner so it can clean up */
+  dispatch_completed (pool);
+
+  assert (vsx_list_empty (&pool->queue));
+
+  vsx_free (pool->threads);
+
+  if (pool->notify_source)
+    vsx_main_context_remove_source (pool->notify_source);
+
+  if (pool->notify_pipe[0] != -1)
+    {
+      vsx_close (pool->notify_pipe[0]);
+      vsx_close (pool->notify_pipe[1]);
+    }
+
+  pthread_cond_destroy (&pool->cond);
+  pthread_mutex_destroy (&pool->mutex);
+
+  vsx_free (pool);
+}
@@ -0,0 +1,98 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_HANDSHAKE_POOL_H
+#define VSX_HANDSHAKE_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <openssl/ssl.h>
+
+#include "vsx-list.h"
+#include "vsx-error.h"
+
+/* A pool of threads that run the expensive part of the TLS handshake
+ * away from the main loop. The socket is still polled by the main
+ * loop. Whenever it becomes ready the owner queues a job and the pool
+ * calls SSL_do_handshake once on a worker thread. The result is then
+ * handed back to the owner via a callback that is invoked from the
+ * main context.
+ */
+
+typedef struct _VsxHandshakePool VsxHandshakePool;
+
+typedef enum
+{
+  VSX_HANDSHAKE_POOL_RESULT_DONE,
+  VSX_HANDSHAKE_POOL_RESULT_WANT_READ,
+  VSX_HANDSHAKE_POOL_RESULT_WANT_WRITE,
+  VSX_HANDSHAKE_POOL_RESULT_ERROR,
+} VsxHandshakePoolResult;
+
+/* This is meant to be embedded in the owner’s connection struct so
+ * that queuing a job doesn’t need an allocation. Only ssl needs to be
+ * filled in before queuing.
+ */
+typedef struct
+{
+  struct vsx_list link;
+
+  SSL *ssl;
+
+  VsxHandshakePoolResult result;
+  /* If the result is ERROR then this is the first code from the
+   * OpenSSL error queue of the thread that ran the job.
+   */
+  unsigned long ssl_errnum;
+
+  /* Monotonic time in microseconds that the job was queued */
+  int64_t queue_time;
+  /* Time in microseconds that the job waited before a thread picked
+   * it up. This is set before the callback is invoked.
+   */
+  int64_t wait_time;
+} VsxHandshakePoolJob;
+
+typedef void
+(* VsxHandshakePoolCallback) (VsxHandshakePoolJob *job,
+                              void *user_data);
+
+VsxHandshakePool *
+vsx_handshake_pool_new (int n_threads,
+                        VsxHandshakePoolCallback callback,
+                        void *user_data,
+                        struct vsx_error **error);
+
+void
+vsx_handshake_pool_queue (VsxHandshakePool *pool,
+                          VsxHandshakePoolJob *job);
+
+/* Runs a single step of the handshake for the job synchronously.
+ * This is what the worker threads use, and it can also be used to run
+ * the handshake inline when there is no pool.
+ */
+void
+vsx_handshake_pool_run_job (VsxHandshakePoolJob *job);
+
+/* Waits for all of the queued jobs to finish and then invokes the
+ * callback for each of them before freeing the pool.
+ */
+void
+vsx_handshake_pool_free (VsxHandshakePool *pool);
+
+#endif /* VSX_HANDSHAKE_POOL_H */
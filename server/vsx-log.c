@@ -26,19 +26,57 @@
 #include <time.h>
 #include <pthread.h>
 #include <signal.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 
 #include "vsx-log.h"
 #include "vsx-util.h"
-#include "vsx-buffer.h"
 #include "vsx-file-error.h"
 
+/* The log messages are stored in a fixed-size ring of fixed-size
+ * slots so that logging never allocates memory and never has to wait
+ * for the log thread. This is a bounded multi-producer queue where
+ * each slot has a sequence number that tells whether it is ready to
+ * be filled or to be written. If the log thread falls behind and the
+ * ring is full then the message is dropped and counted instead.
+ */
+
+#define VSX_LOG_N_SLOTS 1024
+#define VSX_LOG_MAX_MESSAGE_LENGTH 500
+
+_Static_assert ((VSX_LOG_N_SLOTS & (VSX_LOG_N_SLOTS - 1)) == 0,
+                "The number of slots must be a power of two");
+
+typedef struct
+{
+  /* If this is equal to the position of the slot then it is free to
+   * be claimed by a producer. When it is one more than the position
+   * the message is ready to be written.
+   */
+  atomic_size_t sequence;
+  time_t time;
+  uint16_t length;
+  char message[VSX_LOG_MAX_MESSAGE_LENGTH];
+} VsxLogSlot;
+
+static VsxLogSlot vsx_log_slots[VSX_LOG_N_SLOTS];
+static atomic_size_t vsx_log_enqueue_pos;
+/* Only touched by the log thread */
+static size_t vsx_log_dequeue_pos;
+
+static atomic_uint_fast64_t vsx_log_n_dropped;
+
+/* The log thread sets this to true before it waits on the semaphore
+ * so that the producers know they need to wake it up.
+ */
+static atomic_bool vsx_log_sleeping;
+static sem_t vsx_log_semaphore;
+
 static FILE *vsx_log_file = NULL;
-static struct vsx_buffer vsx_log_buffer = VSX_BUFFER_STATIC_INIT;
 static pthread_t vsx_log_thread;
 static bool vsx_log_has_thread = false;
-static pthread_mutex_t vsx_log_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t vsx_log_cond = PTHREAD_COND_INITIALIZER;
-static bool vsx_log_finished = false;
+static atomic_bool vsx_log_finished;
 
 bool
 vsx_log_available (void)
@@ -46,6 +84,59 @@ vsx_log_available (void)
   return vsx_log_file != NULL;
 }
 
+static void
+init_slots (void)
+{
+  for (size_t i = 0; i < VSX_LOG_N_SLOTS; i++)
+    atomic_init (&vsx_log_slots[i].sequence, i);
+
+  atomic_init (&vsx_log_enqueue_pos, 0);
+  vsx_log_dequeue_pos = 0;
+}
+
+static VsxLogSlot *
+claim_slot (void)
+{
+  size_t pos = atomic_load_explicit (&vsx_log_enqueue_pos,
+                                     memory_order_relaxed);
+
+  while (true)
+    {
+      VsxLogSlot *slot = vsx_log_slots + (pos & (VSX_LOG_N_SLOTS - 1));
+      size_t sequence = atomic_load_explicit (&slot->sequence,
+                                              memory_order_acquire);
+      intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+      if (diff == 0)
+        {
+          if (atomic_compare_exchange_weak_explicit (&vsx_log_enqueue_pos,
+                                                     &pos,
+                                                     pos + 1,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+            return slot;
+        }
+      else if (diff < 0)
+        {
+          /* The ring is full */
+          return NULL;
+        }
+      else
+        {
+          /* Another producer claimed the slot first */
+          pos = atomic_load_explicit (&vsx_log_enqueue_pos,
+                                      memory_order_relaxed);
+        }
+    }
+}
+
+static void
+wake_up_log_thread (void)
+{
+  if (atomic_exchange (&vsx_log_sleeping, false))
+    sem_post (&vsx_log_semaphore);
+}
+
 void
 vsx_log (const char *format,
          ...)
@@ -55,31 +146,42 @@ vsx_log (const char *format,
   if (!vsx_log_available ())
     return;
 
-  pthread_mutex_lock (&vsx_log_mutex);
+  VsxLogSlot *slot = claim_slot ();
 
-  time_t now;
-  time (&now);
-  struct tm tm;
-  gmtime_r (&now, &tm);
+  if (slot == NULL)
+    {
+      atomic_fetch_add_explicit (&vsx_log_n_dropped,
+                                 1,
+                                 memory_order_relaxed);
+      return;
+    }
 
-  vsx_buffer_append_printf (&vsx_log_buffer,
-                            "[%4d-%02d-%02dT%02d:%02d:%02dZ] ",
-                            tm.tm_year + 1900,
-                            tm.tm_mon + 1,
-                            tm.tm_mday,
-                            tm.tm_hour,
-                            tm.tm_min,
-                            tm.tm_sec);
+  /* The timestamp is only formatted on the log thread */
+  slot->time = time (NULL);
 
   va_start (ap, format);
-  vsx_buffer_append_vprintf (&vsx_log_buffer, format, ap);
+  int length = vsnprintf (slot->message, sizeof slot->message, format, ap);
   va_end (ap);
 
-  vsx_buffer_append_c (&vsx_log_buffer, '\n');
+  if (length < 0)
+    length = 0;
+  else if (length >= sizeof slot->message)
+    length = sizeof slot->message - 1;
+
+  slot->length = length;
+
+  /* Publish the message. When the slot was claimed its sequence
+   * number was the same as its position.
+   */
+  size_t sequence = atomic_load_explicit (&slot->sequence,
+                                          memory_order_relaxed);
 
-  pthread_cond_signal (&vsx_log_cond);
+  /* This needs to be sequentially consistent with the check of the
+   * sleeping flag in wake_up_log_thread.
+   */
+  atomic_store (&slot->sequence, sequence + 1);
 
-  pthread_mutex_unlock (&vsx_log_mutex);
+  wake_up_log_thread ();
 }
 
 static void
@@ -95,62 +197,159 @@ block_sigint (void)
     vsx_warning ("pthread_sigmask failed: %s", strerror (errno));
 }
 
+typedef struct
+{
+  time_t time;
+  char text[32];
+  size_t length;
+} VsxLogTimestamp;
+
+static void
+update_timestamp (VsxLogTimestamp *timestamp,
+                  time_t now)
+{
+  /* Lots of messages are usually logged in the same second so the
+   * formatted timestamp is cached.
+   */
+  if (timestamp->length > 0 && timestamp->time == now)
+    return;
+
+  struct tm tm;
+  gmtime_r (&now, &tm);
+
+  timestamp->length = snprintf (timestamp->text,
+                                sizeof timestamp->text,
+                                "[%4d-%02d-%02dT%02d:%02d:%02dZ] ",
+                                tm.tm_year + 1900,
+                                tm.tm_mon + 1,
+                                tm.tm_mday,
+                                tm.tm_hour,
+                                tm.tm_min,
+                                tm.tm_sec);
+  timestamp->time = now;
+}
+
+static bool
+write_line (VsxLogTimestamp *timestamp,
+            time_t time,
+            const char *message,
+            size_t length)
+{
+  update_timestamp (timestamp, time);
+
+  if (fwrite (timestamp->text, 1, timestamp->length, vsx_log_file)
+      != timestamp->length
+      || fwrite (message, 1, length, vsx_log_file) != length
+      || fputc ('\n', vsx_log_file) == EOF)
+    return false;
+
+  return true;
+}
+
+static bool
+report_dropped (VsxLogTimestamp *timestamp,
+                uint64_t *last_n_dropped)
+{
+  uint64_t n_dropped = atomic_load_explicit (&vsx_log_n_dropped,
+                                             memory_order_relaxed);
+
+  if (n_dropped == *last_n_dropped)
+    return true;
+
+  char message[64];
+  int length = snprintf (message,
+                         sizeof message,
+                         "%" PRIu64 " log messages were dropped",
+                         n_dropped - *last_n_dropped);
+
+  *last_n_dropped = n_dropped;
+
+  return write_line (timestamp, time (NULL), message, length);
+}
+
+/* Returns the next slot that is ready to be written or NULL if the
+ * ring is empty.
+ */
+static VsxLogSlot *
+get_ready_slot (void)
+{
+  VsxLogSlot *slot =
+    vsx_log_slots + (vsx_log_dequeue_pos & (VSX_LOG_N_SLOTS - 1));
+  size_t sequence = atomic_load (&slot->sequence);
+
+  if (sequence != vsx_log_dequeue_pos + 1)
+    return NULL;
+
+  return slot;
+}
+
+static void
+release_slot (VsxLogSlot *slot)
+{
+  /* Make the slot available again for the producers on the next trip
+   * around the ring.
+   */
+  atomic_store_explicit (&slot->sequence,
+                         vsx_log_dequeue_pos + VSX_LOG_N_SLOTS,
+                         memory_order_release);
+  vsx_log_dequeue_pos++;
+}
+
+static void
+wait_for_slot (void)
+{
+  atomic_store (&vsx_log_sleeping, true);
+
+  /* Check again after setting the flag in case a producer added a
+   * message before it could see it.
+   */
+  if (get_ready_slot () || atomic_load (&vsx_log_finished))
+    {
+      atomic_store (&vsx_log_sleeping, false);
+      return;
+    }
+
+  while (sem_wait (&vsx_log_semaphore) == -1 && errno == EINTR);
+}
+
 static void *
 vsx_log_thread_func (void *data)
 {
-  struct vsx_buffer alternate_buffer;
-  struct vsx_buffer tmp;
+  VsxLogTimestamp timestamp = { .length = 0 };
+  uint64_t last_n_dropped = 0;
   bool had_error = false;
 
   block_sigint ();
 
-  vsx_buffer_init (&alternate_buffer);
-
-  pthread_mutex_lock (&vsx_log_mutex);
-
-  while (!vsx_log_finished || vsx_log_buffer.length > 0)
+  while (true)
     {
-      size_t wrote;
+      VsxLogSlot *slot = get_ready_slot ();
 
-      /* Wait until there's something to do */
-      while (!vsx_log_finished && vsx_log_buffer.length == 0)
-        pthread_cond_wait (&vsx_log_cond, &vsx_log_mutex);
-
-      if (had_error)
-        /* Just ignore the data */
-        vsx_buffer_set_length (&vsx_log_buffer, 0);
-      else
+      if (slot == NULL)
         {
-          /* Swap the log buffer for an empty alternate buffer so we can
-             write from the normal one */
-          tmp = vsx_log_buffer;
-          vsx_log_buffer = alternate_buffer;
-          alternate_buffer = tmp;
-
-          /* Release the mutex while we do a blocking write */
-          pthread_mutex_unlock (&vsx_log_mutex);
-
-          wrote = fwrite (alternate_buffer.data,
-                          1 /* size */,
-                          alternate_buffer.length,
-                          vsx_log_file);
-
-          /* If there was an error then we'll just start ignoring data
-             until we're told to quit */
-          if (wrote != alternate_buffer.length)
-            had_error = true;
-          else
-            fflush (vsx_log_file);
-
-          vsx_buffer_set_length (&alternate_buffer, 0);
-
-          pthread_mutex_lock (&vsx_log_mutex);
+          if (!had_error)
+            {
+              /* Report any dropped messages once we’ve caught up */
+              if (!report_dropped (&timestamp, &last_n_dropped)
+                  || fflush (vsx_log_file) == EOF)
+                had_error = true;
+            }
+
+          if (atomic_load (&vsx_log_finished) && get_ready_slot () == NULL)
+            break;
+
+          wait_for_slot ();
+          continue;
         }
-    }
 
-  pthread_mutex_unlock (&vsx_log_mutex);
+      /* If there was an error then we'll just start ignoring data
+         until we're told to quit */
+      if (!had_error
+          && !write_line (&timestamp, slot->time, slot->message, slot->length))
+        had_error = true;
 
-  vsx_buffer_destroy (&alternate_buffer);
+      release_slot (slot);
+    }
 
   return NULL;
 }
@@ -175,8 +374,10 @@ vsx_log_set_file (const char *filename,
 
   vsx_log_close ();
 
+  init_slots ();
+
   vsx_log_file = file;
-  vsx_log_finished = false;
+  atomic_store (&vsx_log_finished, false);
 
   return true;
 }
@@ -190,6 +391,9 @@ vsx_log_start (void)
   if (vsx_log_has_thread)
     return;
 
+  sem_init (&vsx_log_semaphore, 0 /* pshared */, 0 /* value */);
+  atomic_store (&vsx_log_sleeping, false);
+
   int res = pthread_create (&vsx_log_thread,
                             NULL, /* attr */
                             vsx_log_thread_func,
@@ -206,19 +410,16 @@ vsx_log_close (void)
 {
   if (vsx_log_has_thread)
     {
-      pthread_mutex_lock (&vsx_log_mutex);
-      vsx_log_finished = true;
-      pthread_cond_signal (&vsx_log_cond);
-      pthread_mutex_unlock (&vsx_log_mutex);
+      atomic_store (&vsx_log_finished, true);
+      sem_post (&vsx_log_semaphore);
 
       pthread_join (vsx_log_thread, NULL);
 
+      sem_destroy (&vsx_log_semaphore);
+
       vsx_log_has_thread = false;
     }
 
-  vsx_buffer_destroy (&vsx_log_buffer);
-  vsx_buffer_init (&vsx_log_buffer);
-
   if (vsx_log_file)
     {
       fclose (vsx_log_file);
@@ -66,6 +66,12 @@ struct _VsxMainContext
   bool monotonic_time_valid;
   int64_t monotonic_time;
 
+  /* Replacement for the system clock, or NULL to use the system
+   * clock.
+   */
+  VsxMainContextClockFunc clock_func;
+  void *clock_data;
+
   struct vsx_list buckets;
   int64_t last_timer_time;
 
@@ -188,6 +194,7 @@ vsx_main_context_new (struct vsx_error **error)
       mc->n_sources = 0;
       vsx_buffer_init (&mc->events);
       mc->monotonic_time_valid = false;
+      mc->clock_func = NULL;
       vsx_list_init (&mc->quit_sources);
       mc->quit_pipe_source = NULL;
       vsx_list_init (&mc->buckets);
@@ -622,6 +629,11 @@ vsx_main_context_get_monotonic_clock (VsxMainContext *mc)
   if (mc == NULL)
     mc = vsx_main_context_get_default_or_abort ();
 
+  /* A replacement clock is usually driven by something other than
+     poll so it isn't cached */
+  if (mc->clock_func)
+    return mc->clock_func (mc->clock_data);
+
   /* Because in theory the program doesn't block between calls to
      poll, we can act as if no time passes between calls to
      epoll. That way we can cache the clock value instead of having to
@@ -641,6 +653,34 @@ vsx_main_context_get_monotonic_clock (VsxMainContext *mc)
   return mc->monotonic_time;
 }
 
+void
+vsx_main_context_set_clock (VsxMainContext *mc,
+                            VsxMainContextClockFunc func,
+                            void *user_data)
+{
+  if (mc == NULL)
+    mc = vsx_main_context_get_default_or_abort ();
+
+  mc->clock_func = func;
+  mc->clock_data = user_data;
+  mc->monotonic_time_valid = false;
+
+  /* The new clock probably has a completely different base so start
+     counting the timer minutes again from now */
+  mc->last_timer_time = vsx_main_context_get_monotonic_clock (mc);
+}
+
+void
+vsx_main_context_dispatch_timers (VsxMainContext *mc)
+{
+  if (mc == NULL)
+    mc = vsx_main_context_get_default_or_abort ();
+
+  mc->monotonic_time_valid = false;
+
+  check_timer_sources (mc);
+}
+
 static void
 free_buckets (VsxMainContext *mc)
 {
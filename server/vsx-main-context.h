@@ -53,6 +53,9 @@ typedef void (* VsxMainContextTimerCallback) (VsxMainContextSource *source,
 typedef void (* VsxMainContextQuitCallback) (VsxMainContextSource *source,
                                              void *user_data);
 
+/* Returns a monotonic time in microseconds */
+typedef int64_t (* VsxMainContextClockFunc) (void *user_data);
+
 VsxMainContext *
 vsx_main_context_new (struct vsx_error **error);
 
@@ -90,6 +93,19 @@ vsx_main_context_poll (VsxMainContext *mc);
 int64_t
 vsx_main_context_get_monotonic_clock (VsxMainContext *mc);
 
+/* Replaces the clock used for the timers and returned by
+   vsx_main_context_get_monotonic_clock. Pass NULL to go back to the
+   system clock. */
+void
+vsx_main_context_set_clock (VsxMainContext *mc,
+                            VsxMainContextClockFunc func,
+                            void *user_data);
+
+/* Invokes any timers that have expired according to the clock
+   without polling. This is useful along with a replacement clock. */
+void
+vsx_main_context_dispatch_timers (VsxMainContext *mc);
+
 void
 vsx_main_context_free (VsxMainContext *mc);
 
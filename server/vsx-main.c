@@ -27,7 +27,6 @@
 #include <pwd.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <assert.h>
 
 #ifdef USE_SYSTEMD
 #include <systemd/sd-daemon.h>
@@ -37,6 +36,8 @@
 #include "vsx-main-context.h"
 #include "vsx-log.h"
 #include "vsx-config.h"
+#include "vsx-capture.h"
+#include "vsx-upgrade.h"
 #include "vsx-buffer.h"
 #include "vsx-file-error.h"
 #include "vsx-util.h"
@@ -46,8 +47,9 @@ static char *option_config_file = NULL;
 static bool option_daemonize = false;
 static char *option_user = NULL;
 static char *option_group = NULL;
+static bool option_upgrade = false;
 
-static const char options[] = "-hl:c:du:g:";
+static const char options[] = "-hl:c:du:g:U";
 
 static void
 usage (void)
@@ -61,7 +63,10 @@ usage (void)
           " -d                   Fork and detach from terminal\n"
           "                      (Daemonize)\n"
           " -u <user>            Drop privileges to user\n"
-          " -g <group>           Drop privileges to group\n");
+          " -g <group>           Drop privileges to group\n"
+          " -U                   Take over from the server that is\n"
+          "                      already running using the upgrade\n"
+          "                      socket in the config file\n");
 }
 
 static bool
@@ -109,6 +114,10 @@ process_arguments(int argc, char **argv)
     case 'g':
       option_group = optarg;
       break;
+
+    case 'U':
+      option_upgrade = true;
+      break;
     }
   }
 
@@ -177,15 +186,52 @@ load_config(struct vsx_error **error)
   return config;
 }
 
-static VsxServer *
-create_server (VsxConfig *config,
-               struct vsx_error **error)
+static VsxUpgradeState *
+receive_upgrade_state (VsxConfig *config,
+                       struct vsx_error **error)
 {
-  assert (!vsx_list_empty (&config->servers));
+  if (config->upgrade_socket == NULL)
+    {
+      vsx_set_error (error,
+                     &vsx_file_error,
+                     VSX_FILE_ERROR_NOENT,
+                     "-U was given but no upgrade_socket is configured");
+      return NULL;
+    }
+
+  VsxUpgradeState *state = vsx_upgrade_receive (config->upgrade_socket,
+                                                error);
+
+  if (state == NULL)
+    return NULL;
+
+  int n_fds = state->listen_fds.length / sizeof (int);
 
+  if (n_fds != vsx_list_length (&config->servers))
+    {
+      vsx_set_error (error,
+                     &vsx_file_error,
+                     VSX_FILE_ERROR_BADF,
+                     "Wrong number of file descriptors received "
+                     "from the old server (expected: %i, got %i)",
+                     vsx_list_length (&config->servers),
+                     n_fds);
+      vsx_upgrade_state_free (state);
+      return NULL;
+    }
+
+  return state;
+}
+
+static VsxServer *
+create_server_with_state (VsxConfig *config,
+                          VsxUpgradeState *upgrade_state,
+                          struct vsx_error **error)
+{
   int override_fd = -1;
 
 #ifdef USE_SYSTEMD
+  if (upgrade_state == NULL)
   {
     int nfds = sd_listen_fds (true /* unset_environment */);
 
@@ -218,20 +264,107 @@ create_server (VsxConfig *config,
 
   VsxServer *server = vsx_server_new ();
 
+  vsx_server_set_handshake_threads (server, config->handshake_threads);
+
+  vsx_server_set_rate_limit (server,
+                             VSX_CONNECTION_RATE_CLASS_MOVE_TILE,
+                             config->move_tile_rate,
+                             config->move_tile_burst);
+  vsx_server_set_rate_limit (server,
+                             VSX_CONNECTION_RATE_CLASS_MESSAGE,
+                             config->message_rate,
+                             config->message_burst);
+  vsx_server_set_rate_limit (server,
+                             VSX_CONNECTION_RATE_CLASS_TYPING,
+                             config->typing_rate,
+                             config->typing_burst);
+  vsx_server_set_max_connections_per_ip (server,
+                                         config->max_connections_per_ip);
+  vsx_server_set_broadcast_rate (server, config->broadcast_rate);
+  vsx_server_set_deflate (server,
+                          config->deflate_window_bits,
+                          config->deflate_threshold);
+
+  /* If we are taking over from an old server then the state comes
+   * from that instead of the snapshot file.
+   */
+  if (config->snapshot_file
+      && !vsx_server_set_snapshot_file (server,
+                                        config->snapshot_file,
+                                        config->snapshot_interval,
+                                        upgrade_state == NULL, /* load */
+                                        error))
+    goto error;
+
+  if (upgrade_state
+      && !vsx_server_take_over (server, upgrade_state, error))
+    goto error;
+
   VsxConfigServer *server_config;
+  int *upgrade_fds = (upgrade_state ?
+                      (int *) upgrade_state->listen_fds.data :
+                      NULL);
 
   vsx_list_for_each (server_config, &config->servers, link)
     {
-      if (!vsx_server_add_config (server, server_config, override_fd, error))
+      if (upgrade_fds)
         {
-          vsx_server_free (server);
-          return NULL;
+          /* The server owns the socket now */
+          override_fd = *upgrade_fds;
+          *(upgrade_fds++) = -1;
         }
 
+      if (!vsx_server_add_config (server, server_config, override_fd, error))
+        goto error;
+
       if (override_fd != -1)
         override_fd++;
     }
 
+  if (config->cluster_socket
+      && !vsx_server_set_cluster (server,
+                                  config->cluster_node,
+                                  config->cluster_size,
+                                  config->cluster_socket,
+                                  error))
+    goto error;
+
+  if (config->upgrade_socket
+      && !vsx_server_set_upgrade_socket (server,
+                                         config->upgrade_socket,
+                                         error))
+    goto error;
+
+  /* The old server exits once we acknowledge so this has to be done
+   * after everything that can fail.
+   */
+  if (upgrade_state
+      && !vsx_upgrade_acknowledge (upgrade_state, error))
+    goto error;
+
+  return server;
+
+ error:
+  vsx_server_free (server);
+  return NULL;
+}
+
+static VsxServer *
+create_server (VsxConfig *config,
+               struct vsx_error **error)
+{
+  if (!option_upgrade)
+    return create_server_with_state (config, NULL, error);
+
+  VsxUpgradeState *upgrade_state = receive_upgrade_state (config, error);
+
+  if (upgrade_state == NULL)
+    return NULL;
+
+  VsxServer *server = create_server_with_state (config, upgrade_state, error);
+
+  vsx_upgrade_state_free (upgrade_state);
+
   return server;
 }
 
@@ -357,6 +490,14 @@ main (int argc, char **argv)
           fprintf (stderr, "Error setting log file: %s\n", error->message);
           vsx_error_free (error);
         }
+      else if (config->capture_file
+               && !vsx_capture_start (config->capture_file, &error))
+        {
+          fprintf (stderr,
+                   "Error opening capture file: %s\n",
+                   error->message);
+          vsx_error_free (error);
+        }
       else
         {
           server = create_server (config, &error);
@@ -394,6 +535,8 @@ main (int argc, char **argv)
               vsx_server_free (server);
             }
 
+          vsx_capture_stop ();
+
           vsx_log_close ();
         }
 
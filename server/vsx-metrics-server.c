@@ -0,0 +1,333 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-metrics-server.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "vsx-main-context.h"
+#include "vsx-ws-parser.h"
+#include "vsx-metrics.h"
+#include "vsx-buffer.h"
+#include "vsx-list.h"
+#include "vsx-util.h"
+
+/* Interval in minutes to check for connections that never sent a
+ * complete request.
+ */
+#define VSX_METRICS_SERVER_GC_TIMEOUT 1
+
+/* Time in microseconds after which a connection that hasn’t finished
+ * will be closed.
+ */
+#define VSX_METRICS_SERVER_CONNECTION_TIMEOUT (60 * (int64_t) 1000000)
+
+struct _VsxMetricsServer
+{
+  /* List of VsxMetricsConnections */
+  struct vsx_list connections;
+
+  VsxMainContextSource *gc_source;
+};
+
+typedef struct
+{
+  struct vsx_list link;
+
+  VsxMetricsServer *server;
+
+  int sock;
+  VsxMainContextSource *source;
+
+  /* This is freed and becomes NULL once the request has been parsed */
+  VsxWsParser *parser;
+
+  struct vsx_buffer response;
+  size_t response_pos;
+
+  int64_t accept_time;
+} VsxMetricsConnection;
+
+static void
+remove_connection (VsxMetricsConnection *connection)
+{
+  VsxMetricsServer *server = connection->server;
+
+  vsx_main_context_remove_source (connection->source);
+  vsx_close (connection->sock);
+
+  if (connection->parser)
+    vsx_ws_parser_free (connection->parser);
+
+  vsx_buffer_destroy (&connection->response);
+
+  vsx_list_remove (&connection->link);
+
+  vsx_free (connection);
+
+  if (vsx_list_empty (&server->connections) && server->gc_source)
+    {
+      vsx_main_context_remove_source (server->gc_source);
+      server->gc_source = NULL;
+    }
+}
+
+static void
+set_response (VsxMetricsConnection *connection,
+              const char *status,
+              const struct vsx_buffer *body,
+              bool include_body)
+{
+  vsx_buffer_append_printf (&connection->response,
+                            "HTTP/1.1 %s\r\n"
+                            "Content-Type: text/plain; version=0.0.4; "
+                            "charset=utf-8\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n"
+                            "\r\n",
+                            status,
+                            body->length);
+
+  if (include_body)
+    vsx_buffer_append (&connection->response, body->data, body->length);
+
+  vsx_ws_parser_free (connection->parser);
+  connection->parser = NULL;
+
+  vsx_main_context_modify_poll (connection->source,
+                                VSX_MAIN_CONTEXT_POLL_OUT);
+}
+
+static void
+set_error_response (VsxMetricsConnection *connection,
+                    const char *status)
+{
+  struct vsx_buffer body = VSX_BUFFER_STATIC_INIT;
+
+  vsx_buffer_append_string (&body, status);
+  vsx_buffer_append_c (&body, '\n');
+
+  set_response (connection, status, &body, true /* include_body */);
+
+  vsx_buffer_destroy (&body);
+}
+
+static bool
+is_metrics_path (const char *uri)
+{
+  static const char path[] = "/metrics";
+
+  /* Ignore any query string */
+  return (!strncmp (uri, path, sizeof path - 1)
+          && (uri[sizeof path - 1] == '\0' || uri[sizeof path - 1] == '?'));
+}
+
+static void
+handle_request (VsxMetricsConnection *connection)
+{
+  const char *method = vsx_ws_parser_get_method (connection->parser);
+  const char *uri = vsx_ws_parser_get_uri (connection->parser);
+  bool is_head = !strcmp (method, "HEAD");
+
+  if (strcmp (method, "GET") && !is_head)
+    {
+      set_error_response (connection, "405 Method Not Allowed");
+      return;
+    }
+
+  if (!is_metrics_path (uri))
+    {
+      set_error_response (connection, "404 Not Found");
+      return;
+    }
+
+  struct vsx_buffer body = VSX_BUFFER_STATIC_INIT;
+
+  vsx_metrics_write (&body);
+
+  set_response (connection, "200 OK", &body, !is_head);
+
+  vsx_buffer_destroy (&body);
+}
+
+static void
+handle_read (VsxMetricsConnection *connection)
+{
+  uint8_t buf[512];
+
+  ssize_t got = read (connection->sock, buf, sizeof buf);
+
+  if (got == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        remove_connection (connection);
+      return;
+    }
+
+  if (got == 0)
+    {
+      remove_connection (connection);
+      return;
+    }
+
+  size_t consumed;
+  struct vsx_error *error = NULL;
+
+  switch (vsx_ws_parser_parse_data (connection->parser,
+                                    buf,
+                                    got,
+                                    &consumed,
+                                    &error))
+    {
+    case VSX_WS_PARSER_RESULT_NEED_MORE_DATA:
+      break;
+    case VSX_WS_PARSER_RESULT_FINISHED:
+      handle_request (connection);
+      break;
+    case VSX_WS_PARSER_RESULT_ERROR:
+      vsx_error_free (error);
+      set_error_response (connection, "400 Bad Request");
+      break;
+    }
+}
+
+static void
+handle_write (VsxMetricsConnection *connection)
+{
+  ssize_t wrote = write (connection->sock,
+                         connection->response.data
+                         + connection->response_pos,
+                         connection->response.length
+                         - connection->response_pos);
+
+  if (wrote == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        remove_connection (connection);
+      return;
+    }
+
+  connection->response_pos += wrote;
+
+  if (connection->response_pos >= connection->response.length)
+    {
+      shutdown (connection->sock, SHUT_WR);
+      remove_connection (connection);
+    }
+}
+
+static void
+connection_poll_cb (VsxMainContextSource *source,
+                    int fd,
+                    VsxMainContextPollFlags flags,
+                    void *user_data)
+{
+  VsxMetricsConnection *connection = user_data;
+
+  if (flags & VSX_MAIN_CONTEXT_POLL_ERROR)
+    remove_connection (connection);
+  else if (connection->parser)
+    {
+      if ((flags & VSX_MAIN_CONTEXT_POLL_IN))
+        handle_read (connection);
+    }
+  else if ((flags & VSX_MAIN_CONTEXT_POLL_OUT))
+    {
+      handle_write (connection);
+    }
+}
+
+static void
+gc_cb (VsxMainContextSource *source,
+       void *user_data)
+{
+  VsxMetricsServer *server = user_data;
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+  VsxMetricsConnection *connection, *tmp;
+
+  vsx_list_for_each_safe (connection, tmp, &server->connections, link)
+    {
+      if (now - connection->accept_time
+          >= VSX_METRICS_SERVER_CONNECTION_TIMEOUT)
+        remove_connection (connection);
+    }
+}
+
+VsxMetricsServer *
+vsx_metrics_server_new (void)
+{
+  VsxMetricsServer *server = vsx_calloc (sizeof *server);
+
+  vsx_list_init (&server->connections);
+
+  return server;
+}
+
+void
+vsx_metrics_server_add_connection (VsxMetricsServer *server,
+                                   int sock)
+{
+  VsxMetricsConnection *connection = vsx_calloc (sizeof *connection);
+
+  connection->server = server;
+  connection->sock = sock;
+  connection->accept_time = vsx_main_context_get_monotonic_clock (NULL);
+
+  connection->parser = vsx_ws_parser_new ();
+  vsx_ws_parser_set_require_key (connection->parser, false);
+
+  vsx_buffer_init (&connection->response);
+
+  connection->source =
+    vsx_main_context_add_poll (NULL /* default context */,
+                               sock,
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               connection_poll_cb,
+                               connection);
+
+  vsx_list_insert (&server->connections, &connection->link);
+
+  if (server->gc_source == NULL)
+    {
+      server->gc_source =
+        vsx_main_context_add_timer (NULL, /* default context */
+                                    VSX_METRICS_SERVER_GC_TIMEOUT,
+                                    gc_cb,
+                                    server);
+    }
+}
+
+void
+vsx_metrics_server_free (VsxMetricsServer *server)
+{
+  while (!vsx_list_empty (&server->connections))
+    {
+      VsxMetricsConnection *connection =
+        vsx_container_of (server->connections.next,
+                          VsxMetricsConnection,
+                          link);
+      remove_connection (connection);
+    }
+
+  vsx_free (server);
+}
@@ -0,0 +1,42 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_METRICS_SERVER_H
+#define VSX_METRICS_SERVER_H
+
+/* Handles connections to a metrics listener. Each connection gets a
+ * single HTTP request answered with the contents of vsx_metrics in
+ * the Prometheus text format and is then closed.
+ */
+
+typedef struct _VsxMetricsServer VsxMetricsServer;
+
+VsxMetricsServer *
+vsx_metrics_server_new (void);
+
+/* Takes ownership of a socket that has just been accepted. The
+ * socket should already be non-blocking.
+ */
+void
+vsx_metrics_server_add_connection (VsxMetricsServer *server,
+                                   int sock);
+
+void
+vsx_metrics_server_free (VsxMetricsServer *server);
+
+#endif /* VSX_METRICS_SERVER_H */
@@ -0,0 +1,310 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-metrics.h"
+
+#include <time.h>
+#include <inttypes.h>
+
+#include "vsx-proto.h"
+#include "vsx-util.h"
+
+VsxMetrics
+vsx_metrics;
+
+typedef struct
+{
+  const char *name;
+  const char *help;
+} MetricInfo;
+
+static const MetricInfo
+counter_info[] =
+  {
+    [VSX_METRICS_COUNTER_CONNECTIONS_ACCEPTED] =
+    {
+      "vsx_connections_accepted_total",
+      "Number of WebSocket connections accepted",
+    },
+    [VSX_METRICS_COUNTER_CONNECTIONS_CLOSED] =
+    {
+      "vsx_connections_closed_total",
+      "Number of WebSocket connections closed",
+    },
+    [VSX_METRICS_COUNTER_BYTES_RECEIVED] =
+    {
+      "vsx_received_bytes_total",
+      "Number of bytes read from clients",
+    },
+    [VSX_METRICS_COUNTER_BYTES_SENT] =
+    {
+      "vsx_sent_bytes_total",
+      "Number of bytes written to clients",
+    },
+    [VSX_METRICS_COUNTER_GAMES_CREATED] =
+    {
+      "vsx_games_created_total",
+      "Number of games created",
+    },
+    [VSX_METRICS_COUNTER_GAMES_ABANDONED] =
+    {
+      "vsx_games_abandoned_total",
+      "Number of games that everyone left before they started",
+    },
+    [VSX_METRICS_COUNTER_COMMANDS_RATE_LIMITED] =
+    {
+      "vsx_rate_limited_commands_total",
+      "Number of commands dropped because a client sent them too fast",
+    },
+    [VSX_METRICS_COUNTER_CONNECTIONS_REJECTED] =
+    {
+      "vsx_rejected_connections_total",
+      "Number of connections closed because their address had too many",
+    },
+    [VSX_METRICS_COUNTER_CHANGES_COALESCED] =
+    {
+      "vsx_coalesced_changes_total",
+      "Number of tile and player changes merged into a pending broadcast",
+    },
+  };
+
+_Static_assert (VSX_N_ELEMENTS (counter_info) == VSX_METRICS_N_COUNTERS,
+                "Every counter needs a name");
+
+static const MetricInfo
+gauge_info[] =
+  {
+    [VSX_METRICS_GAUGE_ACTIVE_PEOPLE] =
+    {
+      "vsx_active_people",
+      "Number of people that haven’t been removed for being silent",
+    },
+    [VSX_METRICS_GAUGE_HANDSHAKE_QUEUE_DEPTH] =
+    {
+      "vsx_ssl_handshake_queue_depth",
+      "Number of SSL handshake steps queued or running on the pool",
+    },
+    [VSX_METRICS_GAUGE_HANDSHAKE_MAX_QUEUE_DEPTH] =
+    {
+      "vsx_ssl_handshake_max_queue_depth",
+      "Highest number of SSL handshake steps queued at once",
+    },
+  };
+
+_Static_assert (VSX_N_ELEMENTS (gauge_info) == VSX_METRICS_N_GAUGES,
+                "Every gauge needs a name");
+
+static const MetricInfo
+histogram_info[] =
+  {
+    [VSX_METRICS_HISTOGRAM_COMMAND_TIME] =
+    {
+      "vsx_command_duration_seconds",
+      "Time taken to process a command from a client",
+    },
+    [VSX_METRICS_HISTOGRAM_CHANGE_TO_WRITE_TIME] =
+    {
+      "vsx_change_to_write_seconds",
+      "Time from a change in a game to it being written to a client",
+    },
+    [VSX_METRICS_HISTOGRAM_HANDSHAKE_TIME] =
+    {
+      "vsx_ssl_handshake_seconds",
+      "Time from accepting a connection to finishing the SSL handshake",
+    },
+    [VSX_METRICS_HISTOGRAM_HANDSHAKE_WAIT_TIME] =
+    {
+      "vsx_ssl_handshake_wait_seconds",
+      "Time that an SSL handshake step waits for a pool thread",
+    },
+  };
+
+_Static_assert (VSX_N_ELEMENTS (histogram_info) == VSX_METRICS_N_HISTOGRAMS,
+                "Every histogram needs a name");
+
+static const struct
+{
+  uint8_t id;
+  const char *name;
+}
+command_names[] =
+  {
+    { VSX_PROTO_NEW_PLAYER, "new_player" },
+    { VSX_PROTO_RECONNECT, "reconnect" },
+    { VSX_PROTO_KEEP_ALIVE, "keep_alive" },
+    { VSX_PROTO_LEAVE, "leave" },
+    { VSX_PROTO_SEND_MESSAGE, "send_message" },
+    { VSX_PROTO_START_TYPING, "start_typing" },
+    { VSX_PROTO_STOP_TYPING, "stop_typing" },
+    { VSX_PROTO_MOVE_TILE, "move_tile" },
+    { VSX_PROTO_TURN, "turn" },
+    { VSX_PROTO_SHOUT, "shout" },
+    { VSX_PROTO_SET_N_TILES, "set_n_tiles" },
+    { VSX_PROTO_NEW_PRIVATE_GAME, "new_private_game" },
+    { VSX_PROTO_JOIN_GAME, "join_game" },
+    { VSX_PROTO_SET_LANGUAGE, "set_language" },
+  };
+
+int64_t
+vsx_metrics_get_time (void)
+{
+  if (!vsx_metrics.enabled)
+    return 0;
+
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C (1000000) + ts.tv_nsec / INT64_C (1000);
+}
+
+void
+vsx_metrics_observe (VsxMetricsHistogram histogram,
+                     int64_t value)
+{
+  VsxMetricsHistogramData *data = vsx_metrics.histograms + histogram;
+
+  if (value < 0)
+    value = 0;
+
+  data->count++;
+  data->sum += value;
+
+  /* Find the smallest power of two that is >= the value */
+  int bucket = (value <= 1
+                ? 0
+                : 64 - __builtin_clzll ((uint64_t) value - 1));
+
+  if (bucket < VSX_METRICS_HISTOGRAM_N_BUCKETS)
+    data->buckets[bucket]++;
+}
+
+static void
+write_header (struct vsx_buffer *buffer,
+              const MetricInfo *info,
+              const char *type)
+{
+  vsx_buffer_append_printf (buffer,
+                            "# HELP %s %s\n"
+                            "# TYPE %s %s\n",
+                            info->name,
+                            info->help,
+                            info->name,
+                            type);
+}
+
+static void
+write_commands (struct vsx_buffer *buffer)
+{
+  static const MetricInfo info =
+    {
+      "vsx_commands_total",
+      "Number of commands received from clients",
+    };
+
+  write_header (buffer, &info, "counter");
+
+  uint64_t unknown = 0;
+
+  for (int i = 0; i < VSX_N_ELEMENTS (vsx_metrics.commands); i++)
+    unknown += vsx_metrics.commands[i];
+
+  for (int i = 0; i < VSX_N_ELEMENTS (command_names); i++)
+    {
+      uint64_t count = vsx_metrics.commands[command_names[i].id];
+
+      vsx_buffer_append_printf (buffer,
+                                "%s{command=\"%s\"} %" PRIu64 "\n",
+                                info.name,
+                                command_names[i].name,
+                                count);
+
+      unknown -= count;
+    }
+
+  vsx_buffer_append_printf (buffer,
+                            "%s{command=\"unknown\"} %" PRIu64 "\n",
+                            info.name,
+                            unknown);
+}
+
+static void
+write_histogram (struct vsx_buffer *buffer,
+                 const MetricInfo *info,
+                 const VsxMetricsHistogramData *data)
+{
+  write_header (buffer, info, "histogram");
+
+  uint64_t total = 0;
+
+  for (int i = 0; i < VSX_METRICS_HISTOGRAM_N_BUCKETS; i++)
+    {
+      total += data->buckets[i];
+
+      vsx_buffer_append_printf (buffer,
+                                "%s_bucket{le=\"%g\"} %" PRIu64 "\n",
+                                info->name,
+                                (UINT64_C (1) << i) / 1e6,
+                                total);
+    }
+
+  vsx_buffer_append_printf (buffer,
+                            "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n"
+                            "%s_sum %" PRIu64 ".%06" PRIu64 "\n"
+                            "%s_count %" PRIu64 "\n",
+                            info->name,
+                            data->count,
+                            info->name,
+                            data->sum / 1000000,
+                            data->sum % 1000000,
+                            info->name,
+                            data->count);
+}
+
+void
+vsx_metrics_write (struct vsx_buffer *buffer)
+{
+  for (int i = 0; i < VSX_METRICS_N_COUNTERS; i++)
+    {
+      write_header (buffer, counter_info + i, "counter");
+      vsx_buffer_append_printf (buffer,
+                                "%s %" PRIu64 "\n",
+                                counter_info[i].name,
+                                vsx_metrics.counters[i]);
+    }
+
+  write_commands (buffer);
+
+  for (int i = 0; i < VSX_METRICS_N_GAUGES; i++)
+    {
+      write_header (buffer, gauge_info + i, "gauge");
+      vsx_buffer_append_printf (buffer,
+                                "%s %" PRIi64 "\n",
+                                gauge_info[i].name,
+                                vsx_metrics.gauges[i]);
+    }
+
+  for (int i = 0; i < VSX_METRICS_N_HISTOGRAMS; i++)
+    {
+      write_histogram (buffer,
+                       histogram_info + i,
+                       vsx_metrics.histograms + i);
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_METRICS_H
+#define VSX_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vsx-buffer.h"
+
+/* Global counters and histograms describing what the server is doing.
+ * Everything runs on the main thread so updating a counter is just an
+ * increment of a global variable. The values are only formatted when
+ * something scrapes the metrics listener.
+ */
+
+typedef enum
+{
+  VSX_METRICS_COUNTER_CONNECTIONS_ACCEPTED,
+  VSX_METRICS_COUNTER_CONNECTIONS_CLOSED,
+  VSX_METRICS_COUNTER_BYTES_RECEIVED,
+  VSX_METRICS_COUNTER_BYTES_SENT,
+  VSX_METRICS_COUNTER_GAMES_CREATED,
+  VSX_METRICS_COUNTER_GAMES_ABANDONED,
+  VSX_METRICS_COUNTER_COMMANDS_RATE_LIMITED,
+  VSX_METRICS_COUNTER_CONNECTIONS_REJECTED,
+  VSX_METRICS_COUNTER_CHANGES_COALESCED,
+  VSX_METRICS_N_COUNTERS
+} VsxMetricsCounter;
+
+typedef enum
+{
+  VSX_METRICS_GAUGE_ACTIVE_PEOPLE,
+  /* Number of SSL handshake steps queued or running on the pool */
+  VSX_METRICS_GAUGE_HANDSHAKE_QUEUE_DEPTH,
+  /* The highest value that the queue depth has reached */
+  VSX_METRICS_GAUGE_HANDSHAKE_MAX_QUEUE_DEPTH,
+  VSX_METRICS_N_GAUGES
+} VsxMetricsGauge;
+
+typedef enum
+{
+  /* Time taken to process a command from a client */
+  VSX_METRICS_HISTOGRAM_COMMAND_TIME,
+  /* Time from a change in a conversation to the bytes describing it
+   * being written to the socket.
+   */
+  VSX_METRICS_HISTOGRAM_CHANGE_TO_WRITE_TIME,
+  /* Time from accepting a connection to finishing the SSL handshake */
+  VSX_METRICS_HISTOGRAM_HANDSHAKE_TIME,
+  /* Time that a handshake step waits before a pool thread runs it */
+  VSX_METRICS_HISTOGRAM_HANDSHAKE_WAIT_TIME,
+  VSX_METRICS_N_HISTOGRAMS
+} VsxMetricsHistogram;
+
+/* The buckets are powers of two of microseconds so the largest one is
+ * about 8 seconds. Anything bigger only ends up in the +Inf bucket.
+ */
+#define VSX_METRICS_HISTOGRAM_N_BUCKETS 24
+
+typedef struct
+{
+  uint64_t buckets[VSX_METRICS_HISTOGRAM_N_BUCKETS];
+  uint64_t count;
+  /* Sum of all the observed values in microseconds */
+  uint64_t sum;
+} VsxMetricsHistogramData;
+
+typedef struct
+{
+  /* This is set when a metrics listener is configured. Counters are
+   * always collected because they are so cheap, but measurements that
+   * need to read the clock are skipped when this is false.
+   */
+  bool enabled;
+
+  uint64_t counters[VSX_METRICS_N_COUNTERS];
+  int64_t gauges[VSX_METRICS_N_GAUGES];
+  /* Commands indexed by their message ID */
+  uint64_t commands[256];
+  VsxMetricsHistogramData histograms[VSX_METRICS_N_HISTOGRAMS];
+} VsxMetrics;
+
+extern VsxMetrics
+vsx_metrics;
+
+static inline void
+vsx_metrics_count (VsxMetricsCounter counter,
+                   uint64_t amount)
+{
+  vsx_metrics.counters[counter] += amount;
+}
+
+static inline void
+vsx_metrics_gauge_add (VsxMetricsGauge gauge,
+                       int64_t amount)
+{
+  vsx_metrics.gauges[gauge] += amount;
+}
+
+static inline void
+vsx_metrics_gauge_set (VsxMetricsGauge gauge,
+                       int64_t value)
+{
+  vsx_metrics.gauges[gauge] = value;
+}
+
+static inline void
+vsx_metrics_count_command (uint8_t command)
+{
+  vsx_metrics.commands[command]++;
+}
+
+/* Returns the current monotonic time in microseconds, or zero if
+ * metrics aren’t enabled. Unlike vsx_main_context_get_monotonic_clock
+ * this isn’t cached so it can be used to time something within a
+ * single iteration of the main loop.
+ */
+int64_t
+vsx_metrics_get_time (void);
+
+/* Adds a value in microseconds to the histogram */
+void
+vsx_metrics_observe (VsxMetricsHistogram histogram,
+                     int64_t value);
+
+/* Appends all of the metrics in the Prometheus text format */
+void
+vsx_metrics_write (struct vsx_buffer *buffer);
+
+#endif /* VSX_METRICS_H */
@@ -118,6 +118,23 @@ vsx_person_set_new (void)
   return self;
 }
 
+/* Takes ownership of a reference to the person */
+static void
+add_person (VsxPersonSet *set,
+            VsxPerson *person)
+{
+  vsx_list_insert (&set->people, &person->link);
+
+  vsx_hash_table_add (&set->hash_table, &person->hash_entry);
+
+  if (set->people_timer_source == NULL)
+    set->people_timer_source =
+      vsx_main_context_add_timer (NULL, /* default context */
+                                  VSX_PERSON_SET_REMOVE_SILENT_PEOPLE_INTERVAL,
+                                  remove_silent_people_timer_cb,
+                                  set);
+}
+
 VsxPerson *
 vsx_person_set_activate_person (VsxPersonSet *set,
                                 VsxPersonId id)
@@ -157,18 +174,32 @@ vsx_person_set_generate_person (VsxPersonSet *set,
 
   person = vsx_person_new (id, player_name, conversation);
 
-  vsx_list_insert (&set->people, &person->link);
+  add_person (set, vsx_object_ref (person));
 
-  vsx_hash_table_add (&set->hash_table, &person->hash_entry);
+  return person;
+}
 
-  vsx_object_ref (person);
+void
+vsx_person_set_foreach (VsxPersonSet *set,
+                        VsxPersonSetForeachCallback callback,
+                        void *user_data)
+{
+  VsxPerson *person;
 
-  if (set->people_timer_source == NULL)
-    set->people_timer_source =
-      vsx_main_context_add_timer (NULL, /* default context */
-                                  VSX_PERSON_SET_REMOVE_SILENT_PEOPLE_INTERVAL,
-                                  remove_silent_people_timer_cb,
-                                  set);
+  vsx_list_for_each (person, &set->people, link)
+    {
+      callback (person, user_data);
+    }
+}
 
-  return person;
+bool
+vsx_person_set_add_person (VsxPersonSet *set,
+                           VsxPerson *person)
+{
+  if (vsx_hash_table_get (&set->hash_table, person->hash_entry.id))
+    return false;
+
+  add_person (set, vsx_object_ref (person));
+
+  return true;
 }
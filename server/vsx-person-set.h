@@ -43,4 +43,20 @@ vsx_person_set_generate_person (VsxPersonSet *set,
                                 const struct vsx_netaddress *address,
                                 VsxConversation *conversation);
 
+typedef void
+(* VsxPersonSetForeachCallback) (VsxPerson *person,
+                                 void *user_data);
+
+void
+vsx_person_set_foreach (VsxPersonSet *set,
+                        VsxPersonSetForeachCallback callback,
+                        void *user_data);
+
+/* Adds a person that was created elsewhere, such as when restoring a
+   snapshot. Returns false if there is already a person with the same
+   ID. */
+bool
+vsx_person_set_add_person (VsxPersonSet *set,
+                           VsxPerson *person);
+
 #endif /* VSX_PERSON_SET_H */
@@ -22,6 +22,7 @@
 
 #include "vsx-person.h"
 #include "vsx-main-context.h"
+#include "vsx-metrics.h"
 
 /* Time in microseconds after the last request is sent on a person
    before he/she is considered to be silent */
@@ -39,6 +40,8 @@ vsx_person_free (void *object)
       vsx_object_unref (person->conversation);
     }
 
+  vsx_metrics_gauge_add (VSX_METRICS_GAUGE_ACTIVE_PEOPLE, -1);
+
   vsx_free (person);
 }
 
@@ -65,6 +68,30 @@ vsx_person_new (VsxPersonId id,
 
   person->player = vsx_conversation_add_player (conversation, player_name);
 
+  vsx_metrics_gauge_add (VSX_METRICS_GAUGE_ACTIVE_PEOPLE, 1);
+
+  return person;
+}
+
+VsxPerson *
+vsx_person_new_for_player (VsxPersonId id,
+                           VsxConversation *conversation,
+                           unsigned int player_num,
+                           unsigned int message_offset)
+{
+  VsxPerson *person = vsx_calloc (sizeof *person);
+
+  vsx_object_init (person, &vsx_person_class);
+
+  vsx_person_make_noise (person);
+
+  person->hash_entry.id = id;
+  person->conversation = vsx_object_ref (conversation);
+  person->message_offset = message_offset;
+  person->player = conversation->players[player_num];
+
+  vsx_metrics_gauge_add (VSX_METRICS_GAUGE_ACTIVE_PEOPLE, 1);
+
   return person;
 }
 
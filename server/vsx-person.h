@@ -60,6 +60,14 @@ vsx_person_new (VsxPersonId id,
                 const char *player_name,
                 VsxConversation *conversation);
 
+/* Creates a person for a player that is already in the conversation,
+   such as when restoring a snapshot */
+VsxPerson *
+vsx_person_new_for_player (VsxPersonId id,
+                           VsxConversation *conversation,
+                           unsigned int player_num,
+                           unsigned int message_offset);
+
 void
 vsx_person_make_noise (VsxPerson *person);
 
@@ -0,0 +1,310 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-proxy-parser.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include "vsx-util.h"
+
+/* See https://www.haproxy.org/download/2.9/doc/proxy-protocol.txt */
+
+static const uint8_t
+proxy_signature[] =
+  {
+    0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a
+  };
+
+/* Signature + version/command + family + length */
+#define VSX_PROXY_PARSER_HEADER_SIZE (sizeof proxy_signature + 1 + 1 + 2)
+
+/* The largest address block that we care about, which is for IPv6 */
+#define VSX_PROXY_PARSER_MAX_ADDRESS_SIZE (16 + 16 + 2 + 2)
+
+/* Any header longer than this is considered to be an error. This
+ * leaves plenty of space for the UNIX address family and some TLVs.
+ */
+#define VSX_PROXY_PARSER_MAX_LENGTH 1024
+
+#define VSX_PROXY_PARSER_COMMAND_LOCAL 0x0
+#define VSX_PROXY_PARSER_COMMAND_PROXY 0x1
+
+#define VSX_PROXY_PARSER_FAMILY_INET 0x1
+#define VSX_PROXY_PARSER_FAMILY_INET6 0x2
+
+struct _VsxProxyParser
+{
+  enum
+  {
+    VSX_PROXY_PARSER_READING_HEADER,
+    VSX_PROXY_PARSER_READING_ADDRESS,
+    VSX_PROXY_PARSER_SKIPPING,
+    VSX_PROXY_PARSER_DONE
+  } state;
+
+  unsigned int buf_len;
+  uint8_t buf[VSX_PROXY_PARSER_HEADER_SIZE
+              + VSX_PROXY_PARSER_MAX_ADDRESS_SIZE];
+
+  /* Number of bytes after the fixed header */
+  unsigned int address_length;
+  /* Number of bytes of the address block that we want to keep */
+  unsigned int address_keep;
+  /* Number of bytes left to skip in the SKIPPING state */
+  unsigned int skip_remaining;
+
+  bool has_address;
+  struct vsx_netaddress address;
+};
+
+struct vsx_error_domain
+vsx_proxy_parser_error;
+
+VsxProxyParser *
+vsx_proxy_parser_new (void)
+{
+  VsxProxyParser *parser = vsx_calloc (sizeof *parser);
+
+  parser->state = VSX_PROXY_PARSER_READING_HEADER;
+
+  return parser;
+}
+
+static size_t
+fill_buffer (VsxProxyParser *parser,
+             size_t target,
+             const uint8_t *data,
+             size_t length)
+{
+  size_t to_copy = MIN (target - parser->buf_len, length);
+
+  memcpy (parser->buf + parser->buf_len, data, to_copy);
+  parser->buf_len += to_copy;
+
+  return to_copy;
+}
+
+static bool
+process_header (VsxProxyParser *parser,
+                struct vsx_error **error)
+{
+  if (memcmp (parser->buf, proxy_signature, sizeof proxy_signature))
+    {
+      vsx_set_error (error,
+                     &vsx_proxy_parser_error,
+                     VSX_PROXY_PARSER_ERROR_INVALID,
+                     "Connection did not start with a PROXY v2 header");
+      return false;
+    }
+
+  uint8_t version_command = parser->buf[sizeof proxy_signature];
+
+  if ((version_command >> 4) != 2)
+    {
+      vsx_set_error (error,
+                     &vsx_proxy_parser_error,
+                     VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+                     "Unsupported PROXY protocol version %i",
+                     version_command >> 4);
+      return false;
+    }
+
+  uint8_t command = version_command & 0xf;
+
+  if (command != VSX_PROXY_PARSER_COMMAND_LOCAL
+      && command != VSX_PROXY_PARSER_COMMAND_PROXY)
+    {
+      vsx_set_error (error,
+                     &vsx_proxy_parser_error,
+                     VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+                     "Unsupported PROXY command 0x%x",
+                     command);
+      return false;
+    }
+
+  uint16_t length_be;
+  memcpy (&length_be, parser->buf + sizeof proxy_signature + 2,
+          sizeof length_be);
+  parser->address_length = VSX_UINT16_FROM_BE (length_be);
+
+  if (parser->address_length > VSX_PROXY_PARSER_MAX_LENGTH)
+    {
+      vsx_set_error (error,
+                     &vsx_proxy_parser_error,
+                     VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+                     "PROXY header is too long");
+      return false;
+    }
+
+  /* Only keep the address block if it is a family that we
+   * understand. The transport protocol in the bottom nibble is
+   * ignored.
+   */
+  uint8_t family = parser->buf[sizeof proxy_signature + 1] >> 4;
+  unsigned int needed;
+
+  switch (family)
+    {
+    case VSX_PROXY_PARSER_FAMILY_INET:
+      needed = 4 + 4 + 2 + 2;
+      break;
+    case VSX_PROXY_PARSER_FAMILY_INET6:
+      needed = 16 + 16 + 2 + 2;
+      break;
+    default:
+      needed = 0;
+      break;
+    }
+
+  if (command == VSX_PROXY_PARSER_COMMAND_LOCAL)
+    needed = 0;
+
+  if (needed > parser->address_length)
+    {
+      vsx_set_error (error,
+                     &vsx_proxy_parser_error,
+                     VSX_PROXY_PARSER_ERROR_INVALID,
+                     "PROXY header is too short for its address family");
+      return false;
+    }
+
+  parser->address_keep = needed;
+  parser->skip_remaining = parser->address_length - needed;
+
+  return true;
+}
+
+static void
+process_address (VsxProxyParser *parser)
+{
+  const uint8_t *p = parser->buf + VSX_PROXY_PARSER_HEADER_SIZE;
+  uint16_t port_be;
+
+  switch (parser->address_keep)
+    {
+    case 4 + 4 + 2 + 2:
+      parser->address.family = AF_INET;
+      memcpy (&parser->address.ipv4, p, 4);
+      memcpy (&port_be, p + 4 + 4, sizeof port_be);
+      break;
+    case 16 + 16 + 2 + 2:
+      parser->address.family = AF_INET6;
+      memcpy (&parser->address.ipv6, p, 16);
+      memcpy (&port_be, p + 16 + 16, sizeof port_be);
+      break;
+    default:
+      return;
+    }
+
+  parser->address.port = VSX_UINT16_FROM_BE (port_be);
+  parser->has_address = true;
+}
+
+VsxProxyParserResult
+vsx_proxy_parser_parse_data (VsxProxyParser *parser,
+                             const uint8_t *data,
+                             size_t length,
+                             size_t *consumed,
+                             struct vsx_error **error)
+{
+  const uint8_t *p = data;
+
+  while (true)
+    {
+      switch (parser->state)
+        {
+        case VSX_PROXY_PARSER_READING_HEADER:
+          {
+            size_t got = fill_buffer (parser,
+                                      VSX_PROXY_PARSER_HEADER_SIZE,
+                                      p, length);
+            p += got;
+            length -= got;
+
+            if (parser->buf_len < VSX_PROXY_PARSER_HEADER_SIZE)
+              return VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA;
+
+            if (!process_header (parser, error))
+              return VSX_PROXY_PARSER_RESULT_ERROR;
+
+            parser->state = VSX_PROXY_PARSER_READING_ADDRESS;
+          }
+          break;
+
+        case VSX_PROXY_PARSER_READING_ADDRESS:
+          {
+            size_t got = fill_buffer (parser,
+                                      VSX_PROXY_PARSER_HEADER_SIZE
+                                      + parser->address_keep,
+                                      p, length);
+            p += got;
+            length -= got;
+
+            if (parser->buf_len
+                < VSX_PROXY_PARSER_HEADER_SIZE + parser->address_keep)
+              return VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA;
+
+            process_address (parser);
+
+            parser->state = VSX_PROXY_PARSER_SKIPPING;
+          }
+          break;
+
+        case VSX_PROXY_PARSER_SKIPPING:
+          {
+            /* Skip the TLVs or any address that we don’t understand */
+            size_t to_skip = MIN (parser->skip_remaining, length);
+
+            p += to_skip;
+            length -= to_skip;
+            parser->skip_remaining -= to_skip;
+
+            if (parser->skip_remaining > 0)
+              return VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA;
+
+            parser->state = VSX_PROXY_PARSER_DONE;
+          }
+          break;
+
+        case VSX_PROXY_PARSER_DONE:
+          *consumed = p - data;
+          return VSX_PROXY_PARSER_RESULT_FINISHED;
+        }
+    }
+}
+
+bool
+vsx_proxy_parser_get_address (VsxProxyParser *parser,
+                              struct vsx_netaddress *address)
+{
+  if (!parser->has_address)
+    return false;
+
+  *address = parser->address;
+
+  return true;
+}
+
+void
+vsx_proxy_parser_free (VsxProxyParser *parser)
+{
+  vsx_free (parser);
+}
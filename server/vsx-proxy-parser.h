@@ -0,0 +1,72 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_PROXY_PARSER_H
+#define VSX_PROXY_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vsx-error.h"
+#include "vsx-netaddress.h"
+
+/* Parser for the binary header of version 2 of the PROXY protocol
+ * that a proxy such as haproxy can prepend to the connection to tell
+ * us the address of the real client.
+ */
+
+typedef struct _VsxProxyParser VsxProxyParser;
+
+extern struct vsx_error_domain
+vsx_proxy_parser_error;
+
+typedef enum
+{
+  VSX_PROXY_PARSER_ERROR_INVALID,
+  VSX_PROXY_PARSER_ERROR_UNSUPPORTED,
+} VsxProxyParserError;
+
+typedef enum
+{
+  VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA,
+  VSX_PROXY_PARSER_RESULT_FINISHED,
+  VSX_PROXY_PARSER_RESULT_ERROR
+} VsxProxyParserResult;
+
+VsxProxyParser *vsx_proxy_parser_new (void);
+
+VsxProxyParserResult
+vsx_proxy_parser_parse_data (VsxProxyParser *parser,
+                             const uint8_t *data,
+                             size_t length,
+                             size_t *consumed,
+                             struct vsx_error **error);
+
+/* Once the header is finished, this returns true and fills in
+ * address with the source address if the header contained one. It
+ * returns false if the proxy sent a LOCAL command or an address
+ * family that we don’t understand. In that case the address of the
+ * socket should be used.
+ */
+bool
+vsx_proxy_parser_get_address (VsxProxyParser *parser,
+                              struct vsx_netaddress *address);
+
+void vsx_proxy_parser_free (VsxProxyParser *parser);
+
+#endif /* VSX_PROXY_PARSER_H */
@@ -0,0 +1,516 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Replays a file recorded with the capture_file option. The commands
+ * are framed again and fed to VsxConnections in the same process,
+ * without any sockets, while the main context’s clock is replaced
+ * with one that follows the times in the capture. That way the replay
+ * is deterministic and timers such as the one that removes silent
+ * people fire at the same points in the traffic. The IDs generated
+ * for people and conversations are also taken from the capture so
+ * that commands that refer to them still work. By default the
+ * traffic is replayed as fast as possible, which is useful for
+ * profiling, or it can be replayed at the original speed.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "vsx-capture.h"
+#include "vsx-connection.h"
+#include "vsx-conversation-set.h"
+#include "vsx-person-set.h"
+#include "vsx-main-context.h"
+#include "vsx-hash-table.h"
+#include "vsx-generate-id.h"
+#include "vsx-buffer.h"
+#include "vsx-netaddress.h"
+#include "vsx-list.h"
+#include "vsx-util.h"
+
+typedef struct
+{
+  struct vsx_hash_table_entry hash_entry;
+
+  VsxConnection *ws_connection;
+  struct vsx_listener changed_listener;
+
+  /* Link in the list of connections that might have data to write */
+  struct vsx_list dirty_link;
+  bool dirty;
+} ReplayConnection;
+
+typedef struct
+{
+  uint64_t n_records;
+  uint64_t n_commands;
+  uint64_t n_connections;
+  uint64_t n_errors;
+  uint64_t bytes_written;
+} ReplayStats;
+
+static const char options[] = "-hr";
+
+static bool option_real_time = false;
+static const char *option_capture_file = NULL;
+
+/* Value returned by the replacement clock */
+static int64_t replay_time;
+
+static struct vsx_netaddress replay_address;
+static VsxConversationSet *conversation_set;
+static VsxPersonSet *person_set;
+static struct vsx_hash_table connections;
+static struct vsx_list dirty_connections;
+
+/* IDs from the capture that haven’t been generated yet */
+static struct vsx_buffer pending_ids = VSX_BUFFER_STATIC_INIT;
+static size_t pending_ids_pos;
+/* Used if the server generates more IDs than in the capture */
+static uint64_t next_fallback_id = 1;
+static ReplayStats stats;
+
+static const char
+ws_request[] =
+  "GET / HTTP/1.1\r\n"
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+  "\r\n";
+
+static void
+usage (void)
+{
+  printf ("verda-sxtelo-replay - Replay traffic captured from "
+          "verda-sxtelo\n"
+          "usage: verda-sxtelo-replay [options]... <capture-file>\n"
+          " -h                   Show this help message\n"
+          " -r                   Replay at the original speed instead of "
+          "as fast as possible\n");
+}
+
+static bool
+process_arguments (int argc, char **argv)
+{
+  int opt;
+
+  opterr = false;
+
+  while ((opt = getopt (argc, argv, options)) != -1)
+    {
+      switch (opt)
+        {
+        case ':':
+        case '?':
+          fprintf (stderr, "invalid option '%c'\n", optopt);
+          return false;
+
+        case '\1':
+          if (option_capture_file)
+            {
+              fprintf (stderr, "unexpected argument \"%s\"\n", optarg);
+              return false;
+            }
+          option_capture_file = optarg;
+          break;
+
+        case 'h':
+          usage ();
+          return false;
+
+        case 'r':
+          option_real_time = true;
+          break;
+        }
+    }
+
+  if (option_capture_file == NULL)
+    {
+      fprintf (stderr, "no capture file specified\n");
+      return false;
+    }
+
+  return true;
+}
+
+static int64_t
+get_real_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C (1000000) + ts.tv_nsec / INT64_C (1000);
+}
+
+static int64_t
+replay_clock (void *user_data)
+{
+  return replay_time;
+}
+
+static uint64_t
+replay_generate_id (void *user_data)
+{
+  const uint64_t *ids = (const uint64_t *) pending_ids.data;
+  size_t n_ids = pending_ids.length / sizeof (uint64_t);
+
+  if (pending_ids_pos >= n_ids)
+    return next_fallback_id++;
+
+  uint64_t id = ids[pending_ids_pos++];
+
+  if (pending_ids_pos >= n_ids)
+    {
+      pending_ids.length = 0;
+      pending_ids_pos = 0;
+    }
+
+  return id;
+}
+
+static void
+changed_cb (struct vsx_listener *listener,
+            void *data)
+{
+  ReplayConnection *connection =
+    vsx_container_of (listener, ReplayConnection, changed_listener);
+
+  if (!connection->dirty)
+    {
+      connection->dirty = true;
+      vsx_list_insert (&dirty_connections, &connection->dirty_link);
+    }
+}
+
+static void
+remove_connection (ReplayConnection *connection)
+{
+  if (connection->dirty)
+    vsx_list_remove (&connection->dirty_link);
+
+  vsx_hash_table_remove (&connections, &connection->hash_entry);
+  vsx_connection_free (connection->ws_connection);
+  vsx_free (connection);
+}
+
+static ReplayConnection *
+lookup_connection (uint64_t id)
+{
+  struct vsx_hash_table_entry *entry = vsx_hash_table_get (&connections, id);
+
+  if (entry == NULL)
+    return NULL;
+
+  return vsx_container_of (entry, ReplayConnection, hash_entry);
+}
+
+/* Feeds the data to the connection and returns false if the
+ * connection was closed because of an error, like the server would
+ * do.
+ */
+static bool
+parse_data (ReplayConnection *connection,
+            const uint8_t *data,
+            size_t length)
+{
+  struct vsx_error *error = NULL;
+
+  if (vsx_connection_parse_data (connection->ws_connection,
+                                 data,
+                                 length,
+                                 &error))
+    return true;
+
+  stats.n_errors++;
+  vsx_error_free (error);
+  remove_connection (connection);
+
+  return false;
+}
+
+static void
+open_connection (uint64_t id)
+{
+  ReplayConnection *old_connection = lookup_connection (id);
+
+  if (old_connection)
+    remove_connection (old_connection);
+
+  ReplayConnection *connection = vsx_calloc (sizeof *connection);
+
+  connection->hash_entry.id = id;
+  connection->ws_connection = vsx_connection_new (&replay_address,
+                                                  conversation_set,
+                                                  person_set);
+
+  connection->changed_listener.notify = changed_cb;
+  vsx_signal_add (vsx_connection_get_changed_signal (connection->
+                                                     ws_connection),
+                  &connection->changed_listener);
+
+  vsx_hash_table_add (&connections, &connection->hash_entry);
+
+  stats.n_connections++;
+
+  parse_data (connection,
+              (const uint8_t *) ws_request,
+              (sizeof ws_request) - 1);
+}
+
+static void
+replay_command (const VsxCaptureRecord *record)
+{
+  ReplayConnection *connection = lookup_connection (record->connection_id);
+
+  /* The connection might have already been closed because of an
+   * error.
+   */
+  if (connection == NULL)
+    return;
+
+  stats.n_commands++;
+
+  /* Wrap the payload in a masked frame like the one the client
+   * originally sent.
+   */
+  static const uint8_t mask[] = { 0x37, 0xfa, 0x21, 0x3d };
+  uint8_t frame[VSX_PROTO_MAX_FRAME_HEADER_LENGTH
+                + VSX_PROTO_MAX_PAYLOAD_SIZE];
+  size_t pos = 0;
+
+  frame[pos++] = 0x82;
+
+  if (record->payload_length < 126)
+    {
+      frame[pos++] = 0x80 | record->payload_length;
+    }
+  else
+    {
+      frame[pos++] = 0x80 | 126;
+      frame[pos++] = record->payload_length >> 8;
+      frame[pos++] = record->payload_length & 0xff;
+    }
+
+  memcpy (frame + pos, mask, sizeof mask);
+  pos += sizeof mask;
+
+  for (size_t i = 0; i < record->payload_length; i++)
+    frame[pos++] = record->payload[i] ^ mask[i % sizeof mask];
+
+  parse_data (connection, frame, pos);
+}
+
+static void
+flush_connections (void)
+{
+  while (!vsx_list_empty (&dirty_connections))
+    {
+      ReplayConnection *connection =
+        vsx_container_of (dirty_connections.next,
+                          ReplayConnection,
+                          dirty_link);
+
+      vsx_list_remove (&connection->dirty_link);
+      connection->dirty = false;
+
+      uint8_t buf[1024];
+      size_t got;
+
+      while ((got = vsx_connection_fill_output_buffer (connection->
+                                                       ws_connection,
+                                                       buf,
+                                                       sizeof buf)) > 0)
+        stats.bytes_written += got;
+    }
+}
+
+static void
+wait_for_record (int64_t real_start_time,
+                 const VsxCaptureRecord *record)
+{
+  int64_t delay = real_start_time + record->time - get_real_time ();
+
+  if (delay > 0)
+    {
+      struct timespec ts =
+        {
+          .tv_sec = delay / 1000000,
+          .tv_nsec = delay % 1000000 * 1000,
+        };
+
+      nanosleep (&ts, NULL);
+    }
+}
+
+static bool
+replay (VsxCaptureReader *reader,
+        struct vsx_error **error)
+{
+  VsxCaptureRecord *record = vsx_alloc (sizeof *record);
+  int64_t start_time = replay_time;
+  int64_t real_start_time = get_real_time ();
+  bool ret = true;
+
+  while (true)
+    {
+      switch (vsx_capture_reader_read (reader, record, error))
+        {
+        case VSX_CAPTURE_READ_RESULT_RECORD:
+          break;
+        case VSX_CAPTURE_READ_RESULT_END:
+          goto done;
+        case VSX_CAPTURE_READ_RESULT_ERROR:
+          ret = false;
+          goto done;
+        }
+
+      if (option_real_time)
+        wait_for_record (real_start_time, record);
+
+      replay_time = start_time + record->time;
+      vsx_main_context_dispatch_timers (NULL);
+
+      stats.n_records++;
+
+      switch (record->type)
+        {
+        case VSX_CAPTURE_RECORD_OPEN:
+          open_connection (record->connection_id);
+          break;
+        case VSX_CAPTURE_RECORD_COMMAND:
+          replay_command (record);
+          break;
+        case VSX_CAPTURE_RECORD_CLOSE:
+          {
+            ReplayConnection *connection =
+              lookup_connection (record->connection_id);
+
+            if (connection)
+              remove_connection (connection);
+          }
+          break;
+        case VSX_CAPTURE_RECORD_ID:
+          vsx_buffer_append (&pending_ids,
+                             &record->generated_id,
+                             sizeof record->generated_id);
+          break;
+        }
+
+      flush_connections ();
+    }
+
+done:
+  vsx_free (record);
+
+  return ret;
+}
+
+static void
+free_connections (void)
+{
+  for (int i = 0; i < connections.table_size; i++)
+    {
+      while (connections.entries[i])
+        {
+          remove_connection (vsx_container_of (connections.entries[i],
+                                               ReplayConnection,
+                                               hash_entry));
+        }
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  if (!process_arguments (argc, argv))
+    return EXIT_FAILURE;
+
+  struct vsx_error *error = NULL;
+
+  VsxCaptureReader *reader = vsx_capture_reader_new (option_capture_file,
+                                                     &error);
+
+  if (reader == NULL)
+    {
+      fprintf (stderr, "%s\n", error->message);
+      vsx_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  /* Start the virtual clock from the real time so that the times
+   * look plausible.
+   */
+  replay_time = get_real_time ();
+  vsx_main_context_set_clock (NULL, replay_clock, NULL);
+  vsx_generate_id_set_func (replay_generate_id, NULL);
+
+  vsx_netaddress_from_string (&replay_address, "127.0.0.1", 5144);
+  conversation_set = vsx_conversation_set_new ();
+  person_set = vsx_person_set_new ();
+  vsx_hash_table_init (&connections);
+  vsx_list_init (&dirty_connections);
+
+  int64_t real_start_time = get_real_time ();
+  int64_t start_time = replay_time;
+
+  int ret = EXIT_SUCCESS;
+
+  if (!replay (reader, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      vsx_error_free (error);
+      ret = EXIT_FAILURE;
+    }
+
+  double elapsed = (get_real_time () - real_start_time) / 1e6;
+
+  printf ("records:         %" PRIu64 "\n"
+          "connections:     %" PRIu64 "\n"
+          "commands:        %" PRIu64 "\n"
+          "errors:          %" PRIu64 "\n"
+          "bytes written:   %" PRIu64 "\n"
+          "captured time:   %.3fs\n"
+          "replay time:     %.3fs\n"
+          "commands/second: %.1f\n",
+          stats.n_records,
+          stats.n_connections,
+          stats.n_commands,
+          stats.n_errors,
+          stats.bytes_written,
+          (replay_time - start_time) / 1e6,
+          elapsed,
+          elapsed > 0.0 ? stats.n_commands / elapsed : 0.0);
+
+  free_connections ();
+  vsx_hash_table_destroy (&connections);
+
+  vsx_object_unref (person_set);
+  vsx_object_unref (conversation_set);
+
+  vsx_capture_reader_free (reader);
+  vsx_buffer_destroy (&pending_ids);
+
+  vsx_main_context_free (vsx_main_context_get_default (NULL));
+
+  return ret;
+}
@@ -0,0 +1,313 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "vsx-router.h"
+#include "vsx-main-context.h"
+#include "vsx-log.h"
+#include "vsx-netaddress.h"
+#include "vsx-socket.h"
+#include "vsx-file-error.h"
+#include "vsx-util.h"
+
+#define DEFAULT_PORT 5144
+
+static const char options[] = "-ha:p:l:";
+
+static const char *option_address = "0.0.0.0";
+static int option_port = DEFAULT_PORT;
+static const char *option_log_file = NULL;
+
+static struct vsx_netaddress listen_address;
+
+static const char **backend_paths;
+static int n_backends;
+
+static VsxRouter *router;
+
+static int listen_sock = -1;
+static VsxMainContextSource *listen_source;
+
+static void
+usage (void)
+{
+  printf ("verda-sxtelo-router - Route connections to a cluster of "
+          "verda-sxtelo backends\n"
+          "usage: verda-sxtelo-router [options]... <backend-socket>...\n"
+          " -h                   Show this help message\n"
+          " -a <address>         Address to listen on (default: "
+          "0.0.0.0)\n"
+          " -p <port>            Port to listen on (default: %i)\n"
+          " -l <file>            File to write log messages to\n"
+          "\n"
+          "Each backend socket is the cluster_socket of a backend. The\n"
+          "backends must be given in the order of their cluster_node\n"
+          "and there must be cluster_size of them.\n",
+          DEFAULT_PORT);
+}
+
+static bool
+process_arguments (int argc, char **argv)
+{
+  int opt;
+
+  opterr = false;
+
+  backend_paths = vsx_alloc (sizeof (const char *) * argc);
+  n_backends = 0;
+
+  while ((opt = getopt (argc, argv, options)) != -1)
+    {
+      switch (opt)
+        {
+        case ':':
+        case '?':
+          fprintf (stderr, "invalid option '%c'\n", optopt);
+          return false;
+
+        case '\1':
+          backend_paths[n_backends++] = optarg;
+          break;
+
+        case 'h':
+          usage ();
+          return false;
+
+        case 'a':
+          option_address = optarg;
+          break;
+
+        case 'p':
+          option_port = atoi (optarg);
+          break;
+
+        case 'l':
+          option_log_file = optarg;
+          break;
+        }
+    }
+
+  if (n_backends < 1)
+    {
+      fprintf (stderr, "no backends specified\n");
+      return false;
+    }
+
+  if (!vsx_netaddress_from_string (&listen_address,
+                                   option_address,
+                                   option_port))
+    {
+      fprintf (stderr, "invalid address \"%s\"\n", option_address);
+      return false;
+    }
+
+  return true;
+}
+
+static void
+listen_cb (VsxMainContextSource *source,
+           int fd,
+           VsxMainContextPollFlags flags,
+           void *user_data)
+{
+  int sock = accept (listen_sock, NULL, NULL);
+
+  if (sock == -1)
+    {
+      if (errno == EMFILE)
+        vsx_log ("Too many open files to accept connection");
+      else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        vsx_log ("Error accepting connection: %s", strerror (errno));
+      return;
+    }
+
+  struct vsx_error *error = NULL;
+
+  if (!vsx_socket_set_nonblock (sock, &error))
+    {
+      vsx_log ("While accepting connection: %s", error->message);
+      vsx_error_free (error);
+      vsx_close (sock);
+      return;
+    }
+
+  vsx_router_add_connection (router, sock);
+}
+
+static void
+quit_cb (VsxMainContextSource *source,
+         void *user_data)
+{
+  bool *quit_received_ptr = user_data;
+
+  *quit_received_ptr = true;
+
+  vsx_log ("Quit signal received");
+}
+
+static int
+create_listen_socket (struct vsx_error **error)
+{
+  struct vsx_netaddress_native native_address;
+
+  vsx_netaddress_to_native (&listen_address, &native_address);
+
+  int sock = socket (native_address.sockaddr.sa_family == AF_INET6
+                     ? PF_INET6
+                     : PF_INET,
+                     SOCK_STREAM,
+                     0);
+
+  if (sock == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to create socket: %s",
+                          strerror (errno));
+      return -1;
+    }
+
+  const int true_value = true;
+
+  setsockopt (sock,
+              SOL_SOCKET, SO_REUSEADDR,
+              &true_value, sizeof true_value);
+
+  if (!vsx_socket_set_nonblock (sock, error))
+    goto error;
+
+  if (bind (sock,
+            &native_address.sockaddr,
+            native_address.length) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to bind socket: %s",
+                          strerror (errno));
+      goto error;
+    }
+
+  if (listen (sock, 128) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to make socket listen: %s",
+                          strerror (errno));
+      goto error;
+    }
+
+  return sock;
+
+ error:
+  vsx_close (sock);
+  return -1;
+}
+
+static bool
+run (struct vsx_error **error)
+{
+  if (vsx_main_context_get_default (error) == NULL)
+    return false;
+
+  listen_sock = create_listen_socket (error);
+
+  if (listen_sock == -1)
+    return false;
+
+  router = vsx_router_new (n_backends, backend_paths);
+
+  listen_source = vsx_main_context_add_poll (NULL /* default context */,
+                                             listen_sock,
+                                             VSX_MAIN_CONTEXT_POLL_IN,
+                                             listen_cb,
+                                             NULL);
+
+  bool quit_received = false;
+  VsxMainContextSource *quit_source =
+    vsx_main_context_add_quit (NULL /* default context */,
+                               quit_cb,
+                               &quit_received);
+
+  vsx_log_start ();
+
+  char *address_string = vsx_netaddress_to_string (&listen_address);
+
+  vsx_log ("Routing connections on %s to %i backends",
+           address_string,
+           n_backends);
+
+  vsx_free (address_string);
+
+  do
+    vsx_main_context_poll (NULL /* default context */);
+  while (!quit_received);
+
+  vsx_log ("Exiting...");
+
+  vsx_router_free (router);
+
+  vsx_main_context_remove_source (quit_source);
+  vsx_main_context_remove_source (listen_source);
+  vsx_close (listen_sock);
+
+  vsx_main_context_free (vsx_main_context_get_default (NULL));
+
+  return true;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (!process_arguments (argc, argv))
+    {
+      ret = EXIT_FAILURE;
+    }
+  else
+    {
+      struct vsx_error *error = NULL;
+
+      if (option_log_file && !vsx_log_set_file (option_log_file, &error))
+        {
+          fprintf (stderr, "Error setting log file: %s\n", error->message);
+          vsx_error_free (error);
+          ret = EXIT_FAILURE;
+        }
+      else if (!run (&error))
+        {
+          fprintf (stderr, "%s\n", error->message);
+          vsx_error_free (error);
+          ret = EXIT_FAILURE;
+        }
+
+      vsx_log_close ();
+    }
+
+  vsx_free (backend_paths);
+
+  return ret;
+}
@@ -0,0 +1,589 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-router.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "vsx-cluster.h"
+#include "vsx-fd-message.h"
+#include "vsx-ws-parser.h"
+#include "vsx-ws-response.h"
+#include "vsx-main-context.h"
+#include "vsx-log.h"
+#include "vsx-proto.h"
+#include "vsx-buffer.h"
+#include "vsx-list.h"
+#include "vsx-socket.h"
+#include "vsx-util.h"
+
+/* Time in seconds that a send to a backend can block for */
+#define ROUTER_BACKEND_TIMEOUT 5
+
+/* Connections that haven’t sent their first command after this many
+ * microseconds are dropped. The timer that checks this runs once a
+ * minute so they can live for up to twice as long.
+ */
+#define ROUTER_CONNECTION_TIMEOUT (60 * (int64_t) 1000000)
+
+typedef struct
+{
+  const char *path;
+  /* Persistent connection to the backend or -1 if there isn’t one
+   * yet or it failed.
+   */
+  int sock;
+} RouterBackend;
+
+typedef struct
+{
+  struct vsx_list link;
+
+  VsxRouter *router;
+
+  int sock;
+  VsxMainContextSource *source;
+  int64_t accept_time;
+
+  /* Used to find the end of the HTTP request. This becomes NULL once
+   * the request is finished and then frames_start is the offset of
+   * the first WebSocket frame in buffer.
+   */
+  VsxWsParser *ws_parser;
+  size_t frames_start;
+
+  /* True once the router has sent the handshake response. Clients
+   * such as browsers don’t send the first command until they get it.
+   */
+  bool response_sent;
+
+  /* Everything read from the client so far. This is passed on to the
+   * backend.
+   */
+  struct vsx_buffer buffer;
+} RouterConnection;
+
+typedef enum
+{
+  FIND_NODE_NEED_MORE_DATA,
+  FIND_NODE_FOUND,
+  /* The connection doesn’t belong to any particular backend. Either
+   * it is creating a new private game or the data is invalid. In the
+   * latter case the backend will report the error.
+   */
+  FIND_NODE_ANY,
+  /* Writing to the client failed so the connection should be dropped */
+  FIND_NODE_ERROR,
+} FindNodeResult;
+
+struct _VsxRouter
+{
+  RouterBackend *backends;
+  int n_backends;
+  VsxCluster *cluster;
+
+  /* Used to pick a backend for connections that can go anywhere */
+  int next_backend;
+
+  /* List of RouterConnections that are still waiting for the command */
+  struct vsx_list connections;
+
+  VsxMainContextSource *gc_source;
+};
+
+static void
+remove_connection (RouterConnection *connection)
+{
+  if (connection->source)
+    vsx_main_context_remove_source (connection->source);
+  vsx_close (connection->sock);
+
+  if (connection->ws_parser)
+    vsx_ws_parser_free (connection->ws_parser);
+
+  vsx_buffer_destroy (&connection->buffer);
+
+  vsx_list_remove (&connection->link);
+
+  vsx_free (connection);
+}
+
+static bool
+connect_backend (RouterBackend *backend,
+                 struct vsx_error **error)
+{
+  backend->sock = vsx_fd_message_connect (backend->path, error);
+
+  if (backend->sock == -1)
+    return false;
+
+  vsx_fd_message_set_timeout (backend->sock, ROUTER_BACKEND_TIMEOUT);
+
+  return true;
+}
+
+static void
+disconnect_backend (RouterBackend *backend)
+{
+  if (backend->sock != -1)
+    {
+      vsx_close (backend->sock);
+      backend->sock = -1;
+    }
+}
+
+static bool
+send_to_backend (RouterBackend *backend,
+                 RouterConnection *connection,
+                 struct vsx_error **error)
+{
+  uint8_t flags = (connection->response_sent
+                   ? VSX_CLUSTER_HANDOFF_FLAG_RESPONSE_SENT
+                   : 0);
+  struct iovec iov[] =
+    {
+      { .iov_base = &flags, .iov_len = sizeof flags },
+      {
+        .iov_base = connection->buffer.data,
+        .iov_len = connection->buffer.length,
+      },
+    };
+
+  /* If there was already a connection then it might have been closed
+   * because the backend was restarted so it is worth trying again
+   * with a fresh connection.
+   */
+  if (backend->sock != -1)
+    {
+      struct vsx_error *local_error = NULL;
+
+      if (vsx_fd_message_send (backend->sock,
+                               iov, VSX_N_ELEMENTS (iov),
+                               connection->sock,
+                               &local_error))
+        return true;
+
+      vsx_log ("Reconnecting to %s: %s",
+               backend->path,
+               local_error->message);
+      vsx_error_free (local_error);
+      disconnect_backend (backend);
+    }
+
+  if (!connect_backend (backend, error))
+    return false;
+
+  if (!vsx_fd_message_send (backend->sock,
+                            iov, VSX_N_ELEMENTS (iov),
+                            connection->sock,
+                            error))
+    {
+      disconnect_backend (backend);
+      return false;
+    }
+
+  return true;
+}
+
+static void
+route_connection (RouterConnection *connection,
+                  int node)
+{
+  struct vsx_error *error = NULL;
+
+  if (!send_to_backend (connection->router->backends + node,
+                        connection,
+                        &error))
+    {
+      vsx_log ("Dropping connection for backend %i: %s",
+               node,
+               error->message);
+      vsx_error_free (error);
+    }
+
+  /* Either the backend has its own copy of the socket now or the
+   * connection is dropped.
+   */
+  remove_connection (connection);
+}
+
+static int
+get_any_node (VsxRouter *router)
+{
+  int node = router->next_backend;
+
+  router->next_backend = (router->next_backend + 1) % router->n_backends;
+
+  return node;
+}
+
+static FindNodeResult
+find_node_for_command (VsxRouter *router,
+                       const uint8_t *payload,
+                       size_t length,
+                       int *node_out)
+{
+  const char *room_name, *player_name;
+  uint64_t id;
+  uint16_t n_messages_received;
+
+  if (length < 1)
+    return FIND_NODE_ANY;
+
+  switch (payload[0])
+    {
+    case VSX_PROTO_NEW_PLAYER:
+      if (!vsx_proto_read_payload (payload + 1,
+                                   length - 1,
+
+                                   VSX_PROTO_TYPE_STRING,
+                                   &room_name,
+
+                                   VSX_PROTO_TYPE_STRING,
+                                   &player_name,
+
+                                   VSX_PROTO_TYPE_NONE))
+        return FIND_NODE_ANY;
+      *node_out = vsx_cluster_get_node_for_name (router->cluster,
+                                                 room_name);
+      return FIND_NODE_FOUND;
+
+    case VSX_PROTO_RECONNECT:
+      if (!vsx_proto_read_payload (payload + 1,
+                                   length - 1,
+
+                                   VSX_PROTO_TYPE_UINT64,
+                                   &id,
+
+                                   VSX_PROTO_TYPE_UINT16,
+                                   &n_messages_received,
+
+                                   VSX_PROTO_TYPE_NONE))
+        return FIND_NODE_ANY;
+      *node_out = vsx_cluster_get_node_for_id (router->cluster, id);
+      return FIND_NODE_FOUND;
+
+    case VSX_PROTO_JOIN_GAME:
+      if (!vsx_proto_read_payload (payload + 1,
+                                   length - 1,
+
+                                   VSX_PROTO_TYPE_UINT64,
+                                   &id,
+
+                                   VSX_PROTO_TYPE_STRING,
+                                   &player_name,
+
+                                   VSX_PROTO_TYPE_NONE))
+        return FIND_NODE_ANY;
+      *node_out = vsx_cluster_get_node_for_id (router->cluster, id);
+      return FIND_NODE_FOUND;
+    }
+
+  return FIND_NODE_ANY;
+}
+
+/* Looks through the WebSocket frames after the request for the first
+ * command. Control frames are skipped over.
+ */
+static FindNodeResult
+find_node (RouterConnection *connection,
+           int *node_out)
+{
+  const uint8_t *data = connection->buffer.data;
+  size_t length = connection->buffer.length;
+  size_t pos = connection->frames_start;
+
+  while (true)
+    {
+      if (length - pos < 2)
+        return FIND_NODE_NEED_MORE_DATA;
+
+      uint8_t opcode = data[pos] & 0x0f;
+      bool fin = (data[pos] & 0x80) != 0;
+      bool masked = (data[pos + 1] & 0x80) != 0;
+      uint64_t payload_length = data[pos + 1] & 0x7f;
+      size_t header_length = 2;
+
+      if (payload_length == 126)
+        {
+          if (length - pos < 4)
+            return FIND_NODE_NEED_MORE_DATA;
+          payload_length = ((data[pos + 2] << 8) | data[pos + 3]);
+          header_length += 2;
+        }
+      else if (payload_length == 127)
+        {
+          /* Nothing that big is valid for the first command */
+          return FIND_NODE_ANY;
+        }
+
+      if (masked)
+        header_length += 4;
+
+      if (length - pos < header_length + payload_length)
+        return FIND_NODE_NEED_MORE_DATA;
+
+      if ((opcode & 0x08))
+        {
+          pos += header_length + payload_length;
+          continue;
+        }
+
+      /* No extensions are accepted in the response so any RSV bits
+       * are invalid. In particular a browser can’t have compressed
+       * the command with permessage-deflate.
+       */
+      if (!fin
+          || (data[pos] & 0x70)
+          || opcode != 0x2
+          || payload_length > VSX_PROTO_MAX_PAYLOAD_SIZE)
+        return FIND_NODE_ANY;
+
+      /* Like the server, the mask is optional */
+      const uint8_t *frame_payload = data + pos + header_length;
+      uint8_t payload[VSX_PROTO_MAX_PAYLOAD_SIZE];
+
+      if (masked)
+        {
+          const uint8_t *mask = frame_payload - 4;
+
+          for (size_t i = 0; i < payload_length; i++)
+            payload[i] = frame_payload[i] ^ mask[i & 3];
+        }
+      else
+        {
+          memcpy (payload, frame_payload, payload_length);
+        }
+
+      return find_node_for_command (connection->router,
+                                    payload,
+                                    payload_length,
+                                    node_out);
+    }
+}
+
+/* Sends the handshake response so that the client will start sending
+ * frames. permessage-deflate is never accepted because the router
+ * would have to inflate the command and hand the compression state
+ * over to the backend.
+ */
+static bool
+send_response (RouterConnection *connection)
+{
+  bool v2 = vsx_ws_parser_has_protocol (connection->ws_parser,
+                                        VSX_PROTO_V2_NAME);
+  uint8_t response[256];
+  int length = vsx_ws_response_write (connection->ws_parser,
+                                      v2,
+                                      "" /* extensions */,
+                                      response,
+                                      sizeof response);
+
+  if (length == -1)
+    return false;
+
+  /* Nothing else has been written to the socket so the response
+   * should always fit in the socket buffer.
+   */
+  if (write (connection->sock, response, length) != length)
+    return false;
+
+  connection->response_sent = true;
+
+  return true;
+}
+
+static FindNodeResult
+handle_new_data (RouterConnection *connection,
+                 size_t old_length,
+                 int *node_out)
+{
+  if (connection->ws_parser)
+    {
+      struct vsx_error *error = NULL;
+      size_t consumed;
+
+      switch (vsx_ws_parser_parse_data (connection->ws_parser,
+                                        connection->buffer.data + old_length,
+                                        connection->buffer.length - old_length,
+                                        &consumed,
+                                        &error))
+        {
+        case VSX_WS_PARSER_RESULT_NEED_MORE_DATA:
+          return FIND_NODE_NEED_MORE_DATA;
+        case VSX_WS_PARSER_RESULT_ERROR:
+          /* Let a backend send the error response */
+          vsx_error_free (error);
+          return FIND_NODE_ANY;
+        case VSX_WS_PARSER_RESULT_FINISHED:
+          if (!send_response (connection))
+            return FIND_NODE_ERROR;
+          vsx_ws_parser_free (connection->ws_parser);
+          connection->ws_parser = NULL;
+          connection->frames_start = old_length + consumed;
+          break;
+        }
+    }
+
+  return find_node (connection, node_out);
+}
+
+static void
+connection_poll_cb (VsxMainContextSource *source,
+                    int fd,
+                    VsxMainContextPollFlags flags,
+                    void *user_data)
+{
+  RouterConnection *connection = user_data;
+  size_t old_length = connection->buffer.length;
+
+  vsx_buffer_set_length (&connection->buffer, VSX_CLUSTER_MAX_HANDOFF_SIZE);
+
+  ssize_t got = read (connection->sock,
+                      connection->buffer.data + old_length,
+                      VSX_CLUSTER_MAX_HANDOFF_SIZE - old_length);
+
+  if (got == -1)
+    {
+      vsx_buffer_set_length (&connection->buffer, old_length);
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        remove_connection (connection);
+
+      return;
+    }
+
+  /* If the client gives up before sending a command then there’s
+   * nothing to route.
+   */
+  if (got == 0)
+    {
+      remove_connection (connection);
+      return;
+    }
+
+  vsx_buffer_set_length (&connection->buffer, old_length + got);
+
+  int node;
+
+  switch (handle_new_data (connection, old_length, &node))
+    {
+    case FIND_NODE_NEED_MORE_DATA:
+      /* If the buffer is full then let a backend deal with it */
+      if (connection->buffer.length < VSX_CLUSTER_MAX_HANDOFF_SIZE)
+        return;
+      node = get_any_node (connection->router);
+      break;
+    case FIND_NODE_ANY:
+      node = get_any_node (connection->router);
+      break;
+    case FIND_NODE_FOUND:
+      break;
+    case FIND_NODE_ERROR:
+      remove_connection (connection);
+      return;
+    }
+
+  route_connection (connection, node);
+}
+
+static void
+gc_cb (VsxMainContextSource *source,
+       void *user_data)
+{
+  VsxRouter *router = user_data;
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+  RouterConnection *connection, *tmp;
+
+  vsx_list_for_each_safe (connection, tmp, &router->connections, link)
+    {
+      if (now - connection->accept_time >= ROUTER_CONNECTION_TIMEOUT)
+        remove_connection (connection);
+    }
+}
+
+VsxRouter *
+vsx_router_new (int n_backends,
+                const char * const *backend_paths)
+{
+  VsxRouter *router = vsx_calloc (sizeof *router);
+
+  router->n_backends = n_backends;
+  router->backends = vsx_alloc (sizeof (RouterBackend) * n_backends);
+
+  for (int i = 0; i < n_backends; i++)
+    {
+      router->backends[i].path = backend_paths[i];
+      router->backends[i].sock = -1;
+    }
+
+  router->cluster = vsx_cluster_new (n_backends);
+  vsx_list_init (&router->connections);
+
+  router->gc_source = vsx_main_context_add_timer (NULL /* default context */,
+                                                  1, /* minutes */
+                                                  gc_cb,
+                                                  router);
+
+  return router;
+}
+
+void
+vsx_router_add_connection (VsxRouter *router,
+                           int sock)
+{
+  RouterConnection *connection = vsx_calloc (sizeof *connection);
+
+  connection->router = router;
+  connection->sock = sock;
+  connection->accept_time = vsx_main_context_get_monotonic_clock (NULL);
+  connection->ws_parser = vsx_ws_parser_new ();
+  vsx_buffer_init (&connection->buffer);
+  connection->source = vsx_main_context_add_poll (NULL /* default context */,
+                                                  sock,
+                                                  VSX_MAIN_CONTEXT_POLL_IN,
+                                                  connection_poll_cb,
+                                                  connection);
+
+  vsx_list_insert (&router->connections, &connection->link);
+}
+
+void
+vsx_router_free (VsxRouter *router)
+{
+  while (!vsx_list_empty (&router->connections))
+    {
+      RouterConnection *connection =
+        vsx_container_of (router->connections.next, RouterConnection, link);
+      remove_connection (connection);
+    }
+
+  vsx_main_context_remove_source (router->gc_source);
+
+  for (int i = 0; i < router->n_backends; i++)
+    disconnect_backend (router->backends + i);
+
+  vsx_cluster_free (router->cluster);
+
+  vsx_free (router->backends);
+  vsx_free (router);
+}
@@ -0,0 +1,56 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_ROUTER_H
+#define VSX_ROUTER_H
+
+/* Front end for running the server as a cluster of several backend
+ * processes. The router accepts the WebSocket connections and reads
+ * the HTTP request and the first command without answering them. It
+ * then works out which backend owns the game that the command refers
+ * to with the consistent hash ring from vsx-cluster and passes the
+ * socket to that backend over its cluster_socket along with the bytes
+ * that it has already read. After that the router closes its copy of
+ * the socket and the client talks directly to the backend. The
+ * backends generate their IDs so that they map back to themselves so
+ * a reconnect or a join always arrives at the right process.
+ *
+ * The router only handles plain connections so any TLS needs to be
+ * terminated in front of it. It runs on the default main context.
+ */
+
+typedef struct _VsxRouter VsxRouter;
+
+/* The backend paths are the cluster_sockets of the backends in the
+ * order of their cluster_node. The strings aren’t copied.
+ */
+VsxRouter *
+vsx_router_new (int n_backends,
+                const char * const *backend_paths);
+
+/* Takes ownership of a non-blocking socket for a client that has
+ * just connected.
+ */
+void
+vsx_router_add_connection (VsxRouter *router,
+                           int sock);
+
+void
+vsx_router_free (VsxRouter *router);
+
+#endif /* VSX_ROUTER_H */
@@ -20,6 +20,8 @@
 
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <errno.h>
 #include <openssl/ssl.h>
 #include <unistd.h>
@@ -39,6 +41,16 @@
 #include "vsx-file-error.h"
 #include "vsx-netaddress.h"
 #include "vsx-socket.h"
+#include "vsx-handshake-pool.h"
+#include "vsx-proxy-parser.h"
+#include "vsx-metrics.h"
+#include "vsx-metrics-server.h"
+#include "vsx-snapshot.h"
+#include "vsx-upgrade.h"
+#include "vsx-fd-message.h"
+#include "vsx-cluster.h"
+#include "vsx-generate-id.h"
+#include "vsx-hash-table.h"
 
 #define DEFAULT_PORT 5144
 #define DEFAULT_SSL_PORT (DEFAULT_PORT + 1)
@@ -60,8 +72,94 @@ struct _VsxServer
   VsxPersonSet *person_set;
 
   VsxMainContextSource *gc_source;
+
+  /* Number of threads to use for the handshake pool. The pool is
+   * created lazily when the first SSL socket is added.
+   */
+  int handshake_threads;
+  VsxHandshakePool *handshake_pool;
+
+  /* This is created when the first metrics listener is added */
+  VsxMetricsServer *metrics_server;
+
+  VsxSnapshotWriter *snapshot_writer;
+  VsxMainContextSource *snapshot_source;
+  int snapshot_interval;
+
+  /* UNIX socket that a new process can connect to in order to take
+   * over the server, or -1 if upgrades are disabled.
+   */
+  int upgrade_socket;
+  char *upgrade_path;
+  VsxMainContextSource *upgrade_source;
+  /* A connection from a new process that is waiting to take over.
+   * This is handled between iterations of the main loop so that no
+   * more events for the connections are dispatched after they have
+   * been handed over.
+   */
+  int upgrade_client;
+  /* This becomes true once a new process has taken over. After that
+   * the sockets must only be closed and not shut down or unlinked.
+   */
+  bool upgraded;
+
+  /* In cluster mode this is the ring that decides which backend owns
+   * each ID, and this server is cluster_node on it. Otherwise it is
+   * NULL.
+   */
+  VsxCluster *cluster;
+  int cluster_node;
+  /* UNIX socket that the router connects to in order to pass on the
+   * connections that belong to this backend, or -1.
+   */
+  int cluster_socket;
+  char *cluster_path;
+  VsxMainContextSource *cluster_source;
+  /* List of VsxServerClusterLinks, one for each connected router */
+  struct vsx_list cluster_links;
+
+  /* Limits given to every VsxConnection */
+  VsxConnectionRateLimit rate_limits[VSX_CONNECTION_N_RATE_CLASSES];
+  VsxDeflateOptions deflate_options;
+
+  /* Maximum number of connections from one address, or zero for no
+   * limit.
+   */
+  int max_connections_per_ip;
+  /* Hash table of VsxServerAddressCounts for each client address that
+   * has a connection. This is only used when there is a limit.
+   */
+  struct vsx_hash_table address_counts;
+
+  /* Number of times per second that the tile moves and typing changes
+   * of each conversation are broadcast, or zero to send them
+   * immediately.
+   */
+  int broadcast_rate;
+
+  /* List of VsxServerConnections that have tile moves held back by
+   * the rate limit.
+   */
+  struct vsx_list deferred_connections;
+
+  /* Timer fd that wakes up the main loop when the next held back
+   * conversation changes or tile moves are due. It is created when
+   * the server starts running if either can be held back.
+   */
+  int wakeup_timer;
+  VsxMainContextSource *wakeup_source;
+  /* Monotonic time that the timer is set for or INT64_MAX if it isn’t
+   * set.
+   */
+  int64_t wakeup_timer_time;
 };
 
+typedef struct
+{
+  struct vsx_hash_table_entry hash_entry;
+  int n_connections;
+} VsxServerAddressCount;
+
 /* Make sure the output buffer is large enough to contain the largest
  * payload plus the corresponding frame header.
  */
@@ -77,9 +175,21 @@ typedef struct
   /* List node within the list of connections */
   struct vsx_list link;
 
+  /* List node within deferred_connections if has_deferred_moves is
+   * true.
+   */
+  struct vsx_list deferred_link;
+  bool has_deferred_moves;
+
   VsxConnection *ws_connection;
   struct vsx_listener ws_connection_listener;
 
+  /* If the socket is expecting a PROXY protocol header then this will
+   * be used to parse it before passing any data on to ws_connection.
+   * It is freed and becomes NULL once the header is finished.
+   */
+  VsxProxyParser *proxy_parser;
+
   /* This becomes true when we've received something from the client
      that we don't understand and we're ignoring any further input */
   bool had_bad_input;
@@ -96,14 +206,38 @@ typedef struct
   VsxMainContextPollFlags ssl_read_block;
   /* Same for an SSL_write */
   VsxMainContextPollFlags ssl_write_block;
+  /* If the SSL handshake hasn’t completed yet then these are the
+   * flags needed to continue it.
+   */
+  VsxMainContextPollFlags ssl_handshake_block;
+
+  /* This becomes true while a step of the handshake is running on the
+   * handshake pool. The pool is using the socket and the SSL object
+   * during that time so they can’t be freed.
+   */
+  bool handshake_in_flight;
+  /* This becomes true if the connection is removed while a handshake
+   * is in flight. The rest of the connection will be freed once the
+   * handshake pool gives it back.
+   */
+  bool removed;
+  VsxHandshakePoolJob handshake_job;
+  int64_t accept_time;
 
   unsigned int output_length;
   uint8_t output_buffer[VSX_SERVER_OUTPUT_BUFFER_SIZE];
+  /* Time of the oldest conversation change that is in the output
+   * buffer, or zero if there isn’t one or metrics are disabled.
+   */
+  int64_t output_change_time;
 
   /* IP address of the connection. This is only filled in if logging
      is enabled */
   char *peer_address_string;
 
+  /* The count for the client’s address if it is being tracked */
+  VsxServerAddressCount *address_count;
+
   SSL *ssl;
 } VsxServerConnection;
 
@@ -114,8 +248,25 @@ typedef struct
   int sock;
   VsxServer *server;
   SSL_CTX *ssl_ctx;
+  bool proxy_protocol;
+  /* If true then connections to this socket are given to the metrics
+   * server instead of being treated as WebSocket connections.
+   */
+  bool metrics;
+  /* If the socket is a UNIX domain socket that we created then this
+   * is the path so that it can be removed when the socket is closed.
+   */
+  char *unix_path;
 } VsxServerSocket;
 
+typedef struct
+{
+  struct vsx_list link;
+  VsxServer *server;
+  int sock;
+  VsxMainContextSource *source;
+} VsxServerClusterLink;
+
 /* Interval time in minutes to run the dead person garbage
    collector */
 #define VSX_SERVER_GC_TIMEOUT 5
@@ -196,21 +347,142 @@ vsx_server_gc_cb (VsxMainContextSource *source,
     check_dead_connection (connection);
 }
 
+/* Returns a key that identifies the client for the per-address
+ * limit. IPv6 clients are grouped by their /64 network because a
+ * single client can usually pick any address within that.
+ */
+static uint64_t
+get_address_key (const struct vsx_netaddress *address)
+{
+  const uint8_t *bytes;
+
+  switch (address->family)
+    {
+    case AF_INET:
+      return ((uint64_t) AF_INET << 32) | address->ipv4.s_addr;
+
+    case AF_INET6:
+      bytes = address->ipv6.s6_addr;
+
+      if (IN6_IS_ADDR_V4MAPPED (&address->ipv6))
+        {
+          uint32_t ipv4;
+          memcpy (&ipv4, bytes + 12, sizeof ipv4);
+          return ((uint64_t) AF_INET << 32) | ipv4;
+        }
+
+      uint64_t prefix;
+      memcpy (&prefix, bytes, sizeof prefix);
+      /* Make sure it can’t clash with an IPv4 key */
+      return prefix | ((uint64_t) 1 << 63);
+    }
+
+  /* Everything else, such as UNIX sockets, shares one key */
+  return 0;
+}
+
+/* Starts counting the connection against its address. Returns false
+ * if the address already has the maximum number of connections. If
+ * force is true then the connection is counted anyway.
+ */
+static bool
+track_address (VsxServerConnection *connection,
+               bool force)
+{
+  VsxServer *server = connection->server;
+
+  if (server->max_connections_per_ip <= 0)
+    return true;
+
+  const struct vsx_netaddress *address =
+    vsx_connection_get_socket_address (connection->ws_connection);
+
+  if (address->family != AF_INET && address->family != AF_INET6)
+    return true;
+
+  uint64_t key = get_address_key (address);
+  struct vsx_hash_table_entry *entry =
+    vsx_hash_table_get (&server->address_counts, key);
+  VsxServerAddressCount *count;
+
+  if (entry)
+    {
+      count = vsx_container_of (entry, VsxServerAddressCount, hash_entry);
+
+      if (!force
+          && count->n_connections >= server->max_connections_per_ip)
+        {
+          vsx_metrics_count (VSX_METRICS_COUNTER_CONNECTIONS_REJECTED, 1);
+          return false;
+        }
+    }
+  else
+    {
+      count = vsx_alloc (sizeof *count);
+      count->hash_entry.id = key;
+      count->n_connections = 0;
+      vsx_hash_table_add (&server->address_counts, &count->hash_entry);
+    }
+
+  count->n_connections++;
+  connection->address_count = count;
+
+  return true;
+}
+
 static void
-vsx_server_remove_connection (VsxServer *server,
-                              VsxServerConnection *connection)
+untrack_address (VsxServerConnection *connection)
+{
+  VsxServerAddressCount *count = connection->address_count;
+
+  if (count == NULL)
+    return;
+
+  if (--count->n_connections <= 0)
+    {
+      vsx_hash_table_remove (&connection->server->address_counts,
+                             &count->hash_entry);
+      vsx_free (count);
+    }
+
+  connection->address_count = NULL;
+}
+
+static void
+free_connection (VsxServerConnection *connection)
 {
   if (connection->ssl)
     SSL_free(connection->ssl);
 
-  vsx_main_context_remove_source (connection->source);
   vsx_close (connection->client_socket);
+
+  vsx_free (connection);
+}
+
+static void
+vsx_server_remove_connection (VsxServer *server,
+                              VsxServerConnection *connection)
+{
+  vsx_main_context_remove_source (connection->source);
   vsx_list_remove (&connection->link);
   vsx_free (connection->peer_address_string);
 
+  if (connection->has_deferred_moves)
+    vsx_list_remove (&connection->deferred_link);
+
+  untrack_address (connection);
+
   vsx_connection_free (connection->ws_connection);
 
-  vsx_free (connection);
+  vsx_metrics_count (VSX_METRICS_COUNTER_CONNECTIONS_CLOSED, 1);
+
+  if (connection->proxy_parser)
+    vsx_proxy_parser_free (connection->proxy_parser);
+
+  if (connection->handshake_in_flight)
+    connection->removed = true;
+  else
+    free_connection (connection);
 
   if (vsx_list_empty (&server->connections))
     {
@@ -242,6 +514,16 @@ vsx_server_remove_socket (VsxServer *server,
   if (ssocket->sock != -1)
     vsx_close (ssocket->sock);
 
+  if (ssocket->unix_path)
+    {
+      /* If the server was upgraded then the new process is still
+       * listening on the socket.
+       */
+      if (!server->upgraded)
+        unlink (ssocket->unix_path);
+      vsx_free (ssocket->unix_path);
+    }
+
   vsx_list_remove (&ssocket->link);
 
   vsx_free (ssocket);
@@ -288,6 +570,19 @@ update_poll (VsxServerConnection *connection)
 {
   VsxMainContextPollFlags flags = 0;
 
+  /* Nothing else can happen until the handshake is complete */
+  if (connection->handshake_in_flight)
+    {
+      vsx_main_context_modify_poll (connection->source, 0);
+      return;
+    }
+  if (connection->ssl_handshake_block)
+    {
+      vsx_main_context_modify_poll (connection->source,
+                                    connection->ssl_handshake_block);
+      return;
+    }
+
   if (connection->ssl_read_block)
     flags |= connection->ssl_read_block;
   else if (!connection->read_finished)
@@ -355,6 +650,101 @@ update_poll (VsxServerConnection *connection)
                                   flags);
 }
 
+static bool
+set_proxied_address (VsxServerConnection *connection,
+                     struct vsx_error **error)
+{
+  struct vsx_netaddress address;
+
+  if (!vsx_proxy_parser_get_address (connection->proxy_parser, &address))
+    return true;
+
+  vsx_connection_set_socket_address (connection->ws_connection, &address);
+
+  if (connection->peer_address_string)
+    {
+      char *address_string = vsx_netaddress_to_string (&address);
+
+      vsx_log ("Connection from %s is proxied for %s",
+               connection->peer_address_string,
+               address_string);
+
+      vsx_free (connection->peer_address_string);
+      connection->peer_address_string = address_string;
+    }
+
+  /* Connections on a proxied socket are only counted once the real
+   * address is known.
+   */
+  if (!track_address (connection, false /* force */))
+    {
+      vsx_set_error (error,
+                     &vsx_server_error,
+                     VSX_SERVER_ERROR_TOO_MANY_CONNECTIONS,
+                     "Too many connections from the same address");
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+parse_data (VsxServerConnection *connection,
+            const uint8_t *data,
+            size_t length,
+            struct vsx_error **error)
+{
+  if (connection->proxy_parser)
+    {
+      size_t consumed;
+
+      switch (vsx_proxy_parser_parse_data (connection->proxy_parser,
+                                           data,
+                                           length,
+                                           &consumed,
+                                           error))
+        {
+        case VSX_PROXY_PARSER_RESULT_NEED_MORE_DATA:
+          return true;
+        case VSX_PROXY_PARSER_RESULT_ERROR:
+          return false;
+        case VSX_PROXY_PARSER_RESULT_FINISHED:
+          {
+            bool address_ok = set_proxied_address (connection, error);
+
+            vsx_proxy_parser_free (connection->proxy_parser);
+            connection->proxy_parser = NULL;
+
+            if (!address_ok)
+              return false;
+          }
+          data += consumed;
+          length -= consumed;
+          break;
+        }
+
+      if (length == 0)
+        return true;
+    }
+
+  if (!vsx_connection_parse_data (connection->ws_connection,
+                                  data,
+                                  length,
+                                  error))
+    return false;
+
+  if (!connection->has_deferred_moves
+      && (vsx_connection_get_deferred_move_time (connection->ws_connection)
+          != INT64_MAX))
+    {
+      vsx_list_insert (&connection->server->deferred_connections,
+                       &connection->deferred_link);
+      connection->has_deferred_moves = true;
+    }
+
+  return true;
+}
+
 static void
 handle_read (VsxServer *server,
              VsxServerConnection *connection)
@@ -439,11 +829,13 @@ handle_read (VsxServer *server,
     {
       struct vsx_error *ws_error = NULL;
 
+      vsx_metrics_count (VSX_METRICS_COUNTER_BYTES_RECEIVED, got);
+
       if (!connection->had_bad_input
-          && !vsx_connection_parse_data (connection->ws_connection,
-                                         (uint8_t *) buf,
-                                         got,
-                                         &ws_error))
+          && !parse_data (connection,
+                          (uint8_t *) buf,
+                          got,
+                          &ws_error))
         {
           set_bad_input_with_error (connection, ws_error);
           vsx_error_free (ws_error);
@@ -453,6 +845,109 @@ handle_read (VsxServer *server,
     }
 }
 
+static void
+handle_handshake_result (VsxServer *server,
+                         VsxServerConnection *connection)
+{
+  VsxHandshakePoolJob *job = &connection->handshake_job;
+
+  switch (job->result)
+    {
+    case VSX_HANDSHAKE_POOL_RESULT_DONE:
+      {
+        int64_t handshake_time =
+          vsx_main_context_get_monotonic_clock (NULL)
+          - connection->accept_time;
+
+        vsx_metrics_observe (VSX_METRICS_HISTOGRAM_HANDSHAKE_TIME,
+                             handshake_time);
+
+        connection->ssl_handshake_block = 0;
+
+        /* The client may have sent some data along with the end of
+         * the handshake which OpenSSL will have already buffered, so
+         * we won’t necessarily get another poll event for it.
+         */
+        handle_read (server, connection);
+      }
+      return;
+    case VSX_HANDSHAKE_POOL_RESULT_WANT_READ:
+      connection->ssl_handshake_block = VSX_MAIN_CONTEXT_POLL_IN;
+      break;
+    case VSX_HANDSHAKE_POOL_RESULT_WANT_WRITE:
+      connection->ssl_handshake_block = VSX_MAIN_CONTEXT_POLL_OUT;
+      break;
+    case VSX_HANDSHAKE_POOL_RESULT_ERROR:
+      {
+        struct vsx_error *error = NULL;
+
+        vsx_ssl_error_set_from_errnum (&error, job->ssl_errnum);
+        vsx_log ("For %s: %s",
+                 connection->peer_address_string,
+                 error->message);
+        vsx_error_free (error);
+
+        vsx_server_remove_connection (server, connection);
+      }
+      return;
+    }
+
+  update_poll (connection);
+}
+
+static void
+handshake_job_finished_cb (VsxHandshakePoolJob *job,
+                           void *user_data)
+{
+  VsxServer *server = user_data;
+  VsxServerConnection *connection =
+    vsx_container_of (job, VsxServerConnection, handshake_job);
+
+  connection->handshake_in_flight = false;
+
+  vsx_metrics_gauge_add (VSX_METRICS_GAUGE_HANDSHAKE_QUEUE_DEPTH, -1);
+  vsx_metrics_observe (VSX_METRICS_HISTOGRAM_HANDSHAKE_WAIT_TIME,
+                       job->wait_time);
+
+  if (connection->removed)
+    free_connection (connection);
+  else
+    handle_handshake_result (server, connection);
+}
+
+static void
+handle_handshake (VsxServer *server,
+                  VsxServerConnection *connection)
+{
+  if (server->handshake_pool)
+    {
+      connection->handshake_in_flight = true;
+      update_poll (connection);
+
+      /* The depth is tracked here rather than in the pool so that
+       * the metrics are only touched from the main thread.
+       */
+      vsx_metrics_gauge_add (VSX_METRICS_GAUGE_HANDSHAKE_QUEUE_DEPTH, 1);
+
+      int64_t depth =
+        vsx_metrics.gauges[VSX_METRICS_GAUGE_HANDSHAKE_QUEUE_DEPTH];
+
+      if (depth
+          > vsx_metrics.gauges[VSX_METRICS_GAUGE_HANDSHAKE_MAX_QUEUE_DEPTH])
+        {
+          vsx_metrics_gauge_set (VSX_METRICS_GAUGE_HANDSHAKE_MAX_QUEUE_DEPTH,
+                                 depth);
+        }
+      vsx_handshake_pool_queue (server->handshake_pool,
+                                &connection->handshake_job);
+    }
+  else
+    {
+      vsx_handshake_pool_run_job (&connection->handshake_job);
+      handle_handshake_result (server, connection);
+    }
+}
+
 static void
 fill_output_buffer (VsxServerConnection *connection)
 {
@@ -464,6 +959,14 @@ fill_output_buffer (VsxServerConnection *connection)
                                        - connection->output_length);
 
   connection->output_length += added;
+
+  int64_t change_time =
+    vsx_connection_take_change_time (connection->ws_connection);
+
+  if (change_time
+      && (connection->output_change_time == 0
+          || change_time < connection->output_change_time))
+    connection->output_change_time = change_time;
 }
 
 static void
@@ -531,12 +1034,22 @@ handle_write (VsxServer *server,
         }
     }
 
+  vsx_metrics_count (VSX_METRICS_COUNTER_BYTES_SENT, wrote);
+
   /* Move any remaining data in the output buffer to the front */
   memmove (connection->output_buffer,
            connection->output_buffer + wrote,
            connection->output_length - wrote);
   connection->output_length -= wrote;
 
+  if (connection->output_length == 0 && connection->output_change_time)
+    {
+      vsx_metrics_observe (VSX_METRICS_HISTOGRAM_CHANGE_TO_WRITE_TIME,
+                           vsx_metrics_get_time ()
+                           - connection->output_change_time);
+      connection->output_change_time = 0;
+    }
+
   update_poll (connection);
 }
 
@@ -570,6 +1083,11 @@ vsx_server_connection_poll_cb (VsxMainContextSource *source,
 
       vsx_server_remove_connection (server, connection);
     }
+  else if (connection->ssl_handshake_block)
+    {
+      if ((flags & connection->ssl_handshake_block))
+        handle_handshake (server, connection);
+    }
   else if (connection->ssl_read_block
            && ((flags & connection->ssl_read_block)
                == connection->ssl_read_block))
@@ -607,6 +1125,12 @@ init_connection_ssl (VsxServerConnection *connection,
   if (!SSL_set_fd (connection->ssl, connection->client_socket))
     goto error;
 
+  /* The client speaks first so wait for some input before starting
+   * the handshake.
+   */
+  connection->ssl_handshake_block = VSX_MAIN_CONTEXT_POLL_IN;
+  connection->handshake_job.ssl = connection->ssl;
+
   return true;
 
  error:
@@ -614,6 +1138,76 @@ init_connection_ssl (VsxServerConnection *connection,
   return false;
 }
 
+static VsxServerConnection *
+add_connection (VsxServer *server,
+                int client_socket,
+                VsxConnection *ws_connection)
+{
+  VsxServerConnection *connection = vsx_alloc (sizeof *connection);
+
+  connection->server = server;
+  connection->client_socket = client_socket;
+  connection->source =
+    vsx_main_context_add_poll (NULL /* default context */,
+                               client_socket,
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               vsx_server_connection_poll_cb,
+                               connection);
+  vsx_list_insert (&server->connections, &connection->link);
+
+  connection->ws_connection = ws_connection;
+  vsx_connection_set_rate_limits (ws_connection, server->rate_limits);
+  vsx_connection_set_deflate_options (ws_connection,
+                                      &server->deflate_options);
+  connection->address_count = NULL;
+
+  struct vsx_signal *changed_signal =
+    vsx_connection_get_changed_signal (connection->ws_connection);
+  connection->ws_connection_listener.notify =
+    ws_connection_changed_cb;
+  vsx_signal_add (changed_signal,
+                  &connection->ws_connection_listener);
+
+  connection->has_deferred_moves = false;
+  connection->had_bad_input = false;
+  connection->read_finished = false;
+  connection->write_finished = false;
+  connection->ssl_read_block = 0;
+  connection->ssl_write_block = 0;
+  connection->ssl_handshake_block = 0;
+  connection->handshake_in_flight = false;
+  connection->removed = false;
+  connection->accept_time = vsx_main_context_get_monotonic_clock (NULL);
+  connection->ssl = NULL;
+  connection->proxy_parser = NULL;
+
+  connection->output_length = 0;
+  connection->output_change_time = 0;
+
+  /* If logging is available then we'll want to store the peer
+     address as a string so we've got something to refer to */
+  if (vsx_log_available ())
+    {
+      const struct vsx_netaddress *remote_address =
+        vsx_connection_get_socket_address (ws_connection);
+      connection->peer_address_string =
+        vsx_netaddress_to_string (remote_address);
+    }
+  else
+    connection->peer_address_string = NULL;
+
+  if (server->gc_source == NULL)
+    {
+      server->gc_source =
+        vsx_main_context_add_timer (NULL, /* default context */
+                                    VSX_SERVER_GC_TIMEOUT,
+                                    vsx_server_gc_cb,
+                                    server);
+    }
+
+  return connection;
+}
+
 static void
 vsx_server_pending_connection_cb (VsxMainContextSource *source,
                                   int fd,
@@ -665,54 +1259,42 @@ vsx_server_pending_connection_cb (VsxMainContextSource *source,
       return;
     }
 
-  VsxServerConnection *connection = vsx_alloc (sizeof *connection);
+  if (ssocket->metrics)
+    {
+      vsx_metrics_server_add_connection (server->metrics_server,
+                                         client_socket);
+      return;
+    }
 
-  connection->server = server;
-  connection->client_socket = client_socket;
-  connection->source =
-    vsx_main_context_add_poll (NULL /* default context */,
-                               client_socket,
-                               VSX_MAIN_CONTEXT_POLL_IN,
-                               vsx_server_connection_poll_cb,
-                               connection);
-  vsx_list_insert (&server->connections, &connection->link);
+  vsx_metrics_count (VSX_METRICS_COUNTER_CONNECTIONS_ACCEPTED, 1);
 
   struct vsx_netaddress remote_address;
   vsx_netaddress_from_native (&remote_address, &native_address);
 
-  connection->ws_connection =
+  VsxConnection *ws_connection =
     vsx_connection_new (&remote_address,
                         server->pending_conversations,
                         server->person_set);
 
-  struct vsx_signal *changed_signal =
-    vsx_connection_get_changed_signal (connection->ws_connection);
-  connection->ws_connection_listener.notify =
-    ws_connection_changed_cb;
-  vsx_signal_add (changed_signal,
-                  &connection->ws_connection_listener);
-
-  connection->had_bad_input = false;
-  connection->read_finished = false;
-  connection->write_finished = false;
-  connection->ssl_read_block = 0;
-  connection->ssl_write_block = 0;
-  connection->ssl = NULL;
-
-  connection->output_length = 0;
+  VsxServerConnection *connection =
+    add_connection (server, client_socket, ws_connection);
 
-  /* If logging is available then we'll want to store the peer
-     address as a string so we've got something to refer to */
-  if (vsx_log_available ())
+  if (ssocket->proxy_protocol)
+    {
+      connection->proxy_parser = vsx_proxy_parser_new ();
+    }
+  else if (!track_address (connection, false /* force */))
+    {
+      vsx_server_remove_connection (server, connection);
+      return;
+    }
+
+  if (connection->peer_address_string)
     {
-      connection->peer_address_string =
-        vsx_netaddress_to_string (&remote_address);
       vsx_log ("Accepted WebSocket%s connection from %s",
                ssocket->ssl_ctx ? " SSL" : "",
                connection->peer_address_string);
     }
-  else
-    connection->peer_address_string = NULL;
 
   if (ssocket->ssl_ctx
       && !init_connection_ssl (connection, ssocket->ssl_ctx, &error))
@@ -723,14 +1305,6 @@ vsx_server_pending_connection_cb (VsxMainContextSource *source,
       vsx_error_free (error);
       vsx_server_remove_connection (server, connection);
     }
-  else if (server->gc_source == NULL)
-    {
-      server->gc_source =
-        vsx_main_context_add_timer (NULL, /* default context */
-                                    VSX_SERVER_GC_TIMEOUT,
-                                    vsx_server_gc_cb,
-                                    server);
-    }
 }
 
 static int
@@ -829,12 +1403,101 @@ create_socket_for_port (int port,
   return create_socket_for_address (&netaddress, error);
 }
 
+static int
+create_socket_for_unix_path (const char *path,
+                             struct vsx_error **error)
+{
+  struct vsx_netaddress_native native_address;
+
+  if (strlen (path) >= sizeof native_address.sockaddr_un.sun_path)
+    {
+      vsx_set_error (error,
+                     &vsx_server_error,
+                     VSX_SERVER_ERROR_INVALID_ADDRESS,
+                     "UNIX socket path is too long: %s",
+                     path);
+      return -1;
+    }
+
+  memset (&native_address, 0, sizeof native_address);
+  native_address.sockaddr_un.sun_family = AF_UNIX;
+  strcpy (native_address.sockaddr_un.sun_path, path);
+  native_address.length = sizeof native_address.sockaddr_un;
+
+  int sock = socket (PF_UNIX, SOCK_STREAM, 0);
+
+  if (sock == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to create socket: %s",
+                          strerror (errno));
+      return -1;
+    }
+
+  if (!vsx_socket_set_nonblock (sock, error))
+    goto error;
+
+  /* Remove any stale socket left over from a previous run. Anything
+   * that isn’t a socket is left alone so that bind will report an
+   * error.
+   */
+  struct stat statbuf;
+
+  if (stat (path, &statbuf) == 0 && S_ISSOCK (statbuf.st_mode))
+    unlink (path);
+
+  if (bind (sock,
+            &native_address.sockaddr,
+            native_address.length) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to bind socket: %s",
+                          strerror (errno));
+      goto error;
+    }
+
+  if (listen (sock, 10) == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Failed to make socket listen: %s",
+                          strerror (errno));
+      unlink (path);
+      goto error;
+    }
+
+  return sock;
+
+ error:
+  vsx_close (sock);
+  return -1;
+}
+
+static const char *
+get_unix_path (const VsxConfigServer *server_config)
+{
+  static const char prefix[] = "unix:";
+
+  if (server_config->address == NULL
+      || strncmp (server_config->address, prefix, sizeof prefix - 1))
+    return NULL;
+
+  return server_config->address + sizeof prefix - 1;
+}
+
 static int
 create_socket_for_config (VsxConfigServer *server_config,
                           struct vsx_error **error)
 {
   int default_port;
 
+  const char *unix_path = get_unix_path (server_config);
+
+  if (unix_path)
+    return create_socket_for_unix_path (unix_path, error);
+
   if (server_config->port == -1)
     {
       default_port = (server_config->certificate
@@ -929,6 +1592,52 @@ init_ssl (VsxServerSocket *ssocket,
   return false;
 }
 
+static int
+get_default_handshake_threads (void)
+{
+  long n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+  /* Leave one CPU for the main thread */
+  return MAX (1, MIN (n_cpus - 1, 4));
+}
+
+static bool
+has_ssl_socket (VsxServer *server)
+{
+  VsxServerSocket *ssocket;
+
+  vsx_list_for_each (ssocket, &server->sockets, link)
+    {
+      if (ssocket->ssl_ctx)
+        return true;
+    }
+
+  return false;
+}
+
+static bool
+ensure_handshake_pool (VsxServer *server,
+                       struct vsx_error **error)
+{
+  if (server->handshake_pool
+      || server->handshake_threads == 0
+      || !has_ssl_socket (server))
+    return true;
+
+  int n_threads = server->handshake_threads;
+
+  if (n_threads < 0)
+    n_threads = get_default_handshake_threads ();
+
+  server->handshake_pool =
+    vsx_handshake_pool_new (n_threads,
+                            handshake_job_finished_cb,
+                            server,
+                            error);
+
+  return server->handshake_pool != NULL;
+}
+
 bool
 vsx_server_add_config (VsxServer *server,
                        VsxConfigServer *server_config,
@@ -951,6 +1660,24 @@ vsx_server_add_config (VsxServer *server,
 
   ssocket->server = server;
   ssocket->sock = sock;
+  ssocket->proxy_protocol = server_config->proxy_protocol;
+  ssocket->metrics = server_config->metrics;
+
+  if (ssocket->metrics)
+    {
+      if (server->metrics_server == NULL)
+        server->metrics_server = vsx_metrics_server_new ();
+
+      vsx_metrics.enabled = true;
+    }
+
+  if (fd_override < 0)
+    {
+      const char *unix_path = get_unix_path (server_config);
+
+      if (unix_path)
+        ssocket->unix_path = vsx_strdup (unix_path);
+    }
 
   ssocket->source =
     vsx_main_context_add_poll (NULL /* default context */,
@@ -983,9 +1710,580 @@ vsx_server_new (void)
   vsx_list_init (&server->sockets);
   vsx_list_init (&server->connections);
 
+  server->handshake_threads = -1;
+
+  server->upgrade_socket = -1;
+  server->upgrade_client = -1;
+
+  server->cluster_socket = -1;
+  vsx_list_init (&server->cluster_links);
+  vsx_list_init (&server->deferred_connections);
+
+  vsx_hash_table_init (&server->address_counts);
+
+  server->wakeup_timer = -1;
+  server->wakeup_timer_time = INT64_MAX;
+
   return server;
 }
 
+void
+vsx_server_set_deflate (VsxServer *server,
+                        int window_bits,
+                        int threshold)
+{
+  server->deflate_options.window_bits = MAX (window_bits, 0);
+  server->deflate_options.threshold = MAX (threshold, 0);
+}
+
+void
+vsx_server_set_rate_limit (VsxServer *server,
+                           VsxConnectionRateClass rate_class,
+                           int rate,
+                           int burst)
+{
+  server->rate_limits[rate_class].rate = rate;
+  server->rate_limits[rate_class].burst = burst;
+}
+
+void
+vsx_server_set_max_connections_per_ip (VsxServer *server,
+                                       int max_connections)
+{
+  server->max_connections_per_ip = max_connections;
+}
+
+void
+vsx_server_set_broadcast_rate (VsxServer *server,
+                               int rate)
+{
+  server->broadcast_rate = MAX (rate, 0);
+
+  int64_t interval = (server->broadcast_rate > 0 ?
+                      1000000 / server->broadcast_rate :
+                      0);
+
+  vsx_conversation_set_global_broadcast_interval (interval);
+}
+
+void
+vsx_server_set_handshake_threads (VsxServer *server,
+                                  int n_threads)
+{
+  /* This must be called before running the server */
+  assert (server->handshake_pool == NULL);
+
+  server->handshake_threads = n_threads;
+}
+
+bool
+vsx_server_set_snapshot_file (VsxServer *server,
+                              const char *filename,
+                              int interval_minutes,
+                              bool load,
+                              struct vsx_error **error)
+{
+  assert (server->snapshot_writer == NULL);
+
+  if (load
+      && !vsx_snapshot_load (filename,
+                          server->pending_conversations,
+                          server->person_set,
+                          error))
+    return false;
+
+  server->snapshot_writer = vsx_snapshot_writer_new (filename);
+  server->snapshot_interval = MAX (1, interval_minutes);
+
+  return true;
+}
+
+static void
+save_snapshot (VsxServer *server)
+{
+  vsx_snapshot_writer_save (server->snapshot_writer,
+                            server->pending_conversations,
+                            server->person_set);
+}
+
+static void
+snapshot_timer_cb (VsxMainContextSource *source,
+                   void *user_data)
+{
+  save_snapshot (user_data);
+}
+
+static void
+upgrade_socket_cb (VsxMainContextSource *source,
+                   int fd,
+                   VsxMainContextPollFlags flags,
+                   void *user_data)
+{
+  VsxServer *server = user_data;
+
+  if (server->upgrade_client != -1)
+    return;
+
+  int client = accept (server->upgrade_socket, NULL, NULL);
+
+  if (client == -1)
+    {
+      if (!is_would_block_error (errno) && errno != EINTR)
+        vsx_log ("Error accepting upgrade connection: %s", strerror (errno));
+      return;
+    }
+
+  server->upgrade_client = client;
+}
+
+bool
+vsx_server_set_upgrade_socket (VsxServer *server,
+                               const char *path,
+                               struct vsx_error **error)
+{
+  assert (server->upgrade_socket == -1);
+
+  server->upgrade_socket = vsx_fd_message_listen (path, error);
+
+  if (server->upgrade_socket == -1)
+    return false;
+
+  server->upgrade_path = vsx_strdup (path);
+  server->upgrade_source =
+    vsx_main_context_add_poll (NULL /* default context */,
+                               server->upgrade_socket,
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               upgrade_socket_cb,
+                               server);
+
+  return true;
+}
+
+static bool
+can_hand_over_connection (VsxServerConnection *connection)
+{
+  /* The SSL state can’t be handed over and the rest of these states
+   * are too short-lived to be worth it. The connection will be closed
+   * and the client will reconnect.
+   */
+  return (connection->ssl == NULL
+          && connection->proxy_parser == NULL
+          && !connection->had_bad_input
+          && !connection->read_finished
+          && !connection->write_finished);
+}
+
+static bool
+hand_over_connection (VsxServerConnection *connection,
+                      int sock,
+                      struct vsx_buffer *buffer,
+                      struct vsx_error **error)
+{
+  vsx_buffer_set_length (buffer, sizeof (uint16_t));
+  vsx_proto_write_uint16_t (buffer->data, connection->output_length);
+  vsx_buffer_append (buffer,
+                     connection->output_buffer,
+                     connection->output_length);
+
+  if (!vsx_connection_save_state (connection->ws_connection, buffer))
+    return true;
+
+  return vsx_upgrade_send_connection (sock,
+                                      connection->client_socket,
+                                      buffer->data,
+                                      buffer->length,
+                                      error);
+}
+
+static bool
+hand_over (VsxServer *server,
+           int sock,
+           struct vsx_error **error)
+{
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+  bool ret = false;
+
+  if (!vsx_upgrade_send_start (sock, error))
+    goto out;
+
+  /* The sockets are in reverse order of the config */
+  VsxServerSocket *ssocket;
+
+  vsx_list_for_each_reverse (ssocket, &server->sockets, link)
+    {
+      if (!vsx_upgrade_send_listen_socket (sock, ssocket->sock, error))
+        goto out;
+    }
+
+  vsx_snapshot_serialize (server->pending_conversations,
+                          server->person_set,
+                          &buffer);
+
+  if (!vsx_upgrade_send_snapshot (sock, buffer.data, buffer.length, error))
+    goto out;
+
+  VsxServerConnection *connection;
+
+  vsx_list_for_each (connection, &server->connections, link)
+    {
+      if (can_hand_over_connection (connection)
+          && !hand_over_connection (connection, sock, &buffer, error))
+        goto out;
+    }
+
+  ret = vsx_upgrade_send_end (sock, error);
+
+ out:
+  vsx_buffer_destroy (&buffer);
+
+  return ret;
+}
+
+static void
+handle_upgrade_client (VsxServer *server)
+{
+  struct vsx_error *error = NULL;
+
+  vsx_log ("Handing over to a new process");
+
+  if (hand_over (server, server->upgrade_client, &error))
+    {
+      server->upgraded = true;
+      vsx_log ("New process has taken over");
+    }
+  else
+    {
+      vsx_log ("Upgrade failed, carrying on: %s", error->message);
+      vsx_error_free (error);
+    }
+
+  vsx_close (server->upgrade_client);
+  server->upgrade_client = -1;
+}
+
+static void
+adopt_connection (VsxServer *server,
+                  VsxUpgradeConnection *upgrade_connection)
+{
+  const uint8_t *data = upgrade_connection->data.data;
+  size_t length = upgrade_connection->data.length;
+  struct vsx_error *error = NULL;
+
+  if (length < sizeof (uint16_t))
+    goto invalid;
+
+  uint16_t output_length = vsx_proto_read_uint16_t (data);
+
+  data += sizeof (uint16_t);
+  length -= sizeof (uint16_t);
+
+  if (output_length > VSX_SERVER_OUTPUT_BUFFER_SIZE
+      || output_length > length)
+    goto invalid;
+
+  VsxConnection *ws_connection =
+    vsx_connection_new_from_state (server->pending_conversations,
+                                   server->person_set,
+                                   data + output_length,
+                                   length - output_length,
+                                   &error);
+
+  if (ws_connection == NULL)
+    {
+      vsx_log ("Dropping handed over connection: %s", error->message);
+      vsx_error_free (error);
+      return;
+    }
+
+  struct vsx_error *nonblock_error = NULL;
+
+  if (!vsx_socket_set_nonblock (upgrade_connection->fd, &nonblock_error))
+    {
+      vsx_log ("Dropping handed over connection: %s",
+               nonblock_error->message);
+      vsx_error_free (nonblock_error);
+      vsx_connection_free (ws_connection);
+      return;
+    }
+
+  VsxServerConnection *connection =
+    add_connection (server, upgrade_connection->fd, ws_connection);
+
+  /* The connection now owns the socket */
+  upgrade_connection->fd = -1;
+
+  /* The connection was already accepted by the old process so it is
+   * counted even if it goes over the limit.
+   */
+  track_address (connection, true /* force */);
+
+  /* Anything that the old process had already started writing needs
+   * to be finished first so that the frames don’t get corrupted.
+   */
+  memcpy (connection->output_buffer, data, output_length);
+  connection->output_length = output_length;
+
+  update_poll (connection);
+
+  return;
+
+ invalid:
+  vsx_log ("Dropping handed over connection with invalid state");
+}
+
+bool
+vsx_server_take_over (VsxServer *server,
+                      VsxUpgradeState *state,
+                      struct vsx_error **error)
+{
+  if (!vsx_snapshot_load_data (state->snapshot.data,
+                               state->snapshot.length,
+                               server->pending_conversations,
+                               server->person_set,
+                               error))
+    return false;
+
+  VsxUpgradeConnection *upgrade_connection;
+  int n_connections = 0;
+
+  vsx_list_for_each (upgrade_connection, &state->connections, link)
+    {
+      adopt_connection (server, upgrade_connection);
+      n_connections++;
+    }
+
+  vsx_log ("Took over %i of %i connections from the old process",
+           vsx_list_length (&server->connections),
+           n_connections);
+
+  return true;
+}
+
+static bool
+cluster_id_filter (uint64_t id,
+                   void *user_data)
+{
+  VsxServer *server = user_data;
+
+  return vsx_cluster_get_node_for_id (server->cluster, id) ==
+    server->cluster_node;
+}
+
+static void
+remove_cluster_link (VsxServerClusterLink *link)
+{
+  vsx_main_context_remove_source (link->source);
+  vsx_close (link->sock);
+  vsx_list_remove (&link->link);
+  vsx_free (link);
+}
+
+static void
+adopt_routed_connection (VsxServer *server,
+                         int fd,
+                         uint8_t flags,
+                         const uint8_t *data,
+                         size_t length)
+{
+  struct vsx_error *error = NULL;
+
+  if (!vsx_socket_set_nonblock (fd, &error))
+    {
+      vsx_log ("While accepting connection from the router: %s",
+               error->message);
+      vsx_error_free (error);
+      vsx_close (fd);
+      return;
+    }
+
+  struct vsx_netaddress_native native_address =
+    {
+      .length = offsetof (struct vsx_netaddress_native, length)
+    };
+
+  /* This can fail if the client has already gone away */
+  if (getpeername (fd, &native_address.sockaddr, &native_address.length)
+      == -1)
+    {
+      vsx_close (fd);
+      return;
+    }
+
+  vsx_metrics_count (VSX_METRICS_COUNTER_CONNECTIONS_ACCEPTED, 1);
+
+  struct vsx_netaddress remote_address;
+  vsx_netaddress_from_native (&remote_address, &native_address);
+
+  VsxConnection *ws_connection =
+    vsx_connection_new (&remote_address,
+                        server->pending_conversations,
+                        server->person_set);
+
+  VsxServerConnection *connection =
+    add_connection (server, fd, ws_connection);
+
+  if (!track_address (connection, false /* force */))
+    {
+      vsx_server_remove_connection (server, connection);
+      return;
+    }
+
+  if (connection->peer_address_string)
+    {
+      vsx_log ("Accepted WebSocket connection from %s via the router",
+               connection->peer_address_string);
+    }
+
+  if ((flags & VSX_CLUSTER_HANDOFF_FLAG_RESPONSE_SENT))
+    vsx_connection_set_response_sent (ws_connection);
+
+  /* The router has already read the request and the first command so
+   * they are handled as if they had just been read from the socket.
+   */
+  if (length > 0)
+    {
+      vsx_metrics_count (VSX_METRICS_COUNTER_BYTES_RECEIVED, length);
+
+      if (!parse_data (connection, data, length, &error))
+        {
+          set_bad_input_with_error (connection, error);
+          vsx_error_free (error);
+        }
+    }
+
+  update_poll (connection);
+}
+
+static void
+cluster_link_cb (VsxMainContextSource *source,
+                 int fd,
+                 VsxMainContextPollFlags flags,
+                 void *user_data)
+{
+  VsxServerClusterLink *link = user_data;
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+  struct vsx_error *error = NULL;
+  int client_fd;
+
+  while (true)
+    {
+      if (!vsx_fd_message_receive (link->sock,
+                                   &buffer,
+                                   VSX_CLUSTER_HANDOFF_HEADER_SIZE
+                                   + VSX_CLUSTER_MAX_HANDOFF_SIZE,
+                                   &client_fd,
+                                   &error))
+        {
+          if (error->domain == &vsx_file_error
+              && error->code == VSX_FILE_ERROR_AGAIN)
+            {
+              vsx_error_free (error);
+              break;
+            }
+
+          if (error->domain != &vsx_fd_message_error
+              || error->code != VSX_FD_MESSAGE_ERROR_CLOSED)
+            vsx_log ("Error on router connection: %s", error->message);
+
+          vsx_error_free (error);
+          remove_cluster_link (link);
+          break;
+        }
+
+      if (client_fd == -1)
+        {
+          vsx_log ("Ignoring message from the router without a socket");
+          continue;
+        }
+
+      if (buffer.length < VSX_CLUSTER_HANDOFF_HEADER_SIZE)
+        {
+          vsx_log ("Ignoring message from the router without a header");
+          vsx_close (client_fd);
+          continue;
+        }
+
+      adopt_routed_connection (link->server,
+                               client_fd,
+                               buffer.data[0],
+                               buffer.data + VSX_CLUSTER_HANDOFF_HEADER_SIZE,
+                               buffer.length
+                               - VSX_CLUSTER_HANDOFF_HEADER_SIZE);
+    }
+
+  vsx_buffer_destroy (&buffer);
+}
+
+static void
+cluster_socket_cb (VsxMainContextSource *source,
+                   int fd,
+                   VsxMainContextPollFlags flags,
+                   void *user_data)
+{
+  VsxServer *server = user_data;
+
+  int sock = accept (server->cluster_socket, NULL, NULL);
+
+  if (sock == -1)
+    {
+      if (!is_would_block_error (errno) && errno != EINTR)
+        vsx_log ("Error accepting router connection: %s", strerror (errno));
+      return;
+    }
+
+  struct vsx_error *error = NULL;
+
+  if (!vsx_socket_set_nonblock (sock, &error))
+    {
+      vsx_log ("While accepting router connection: %s", error->message);
+      vsx_error_free (error);
+      vsx_close (sock);
+      return;
+    }
+
+  VsxServerClusterLink *link = vsx_alloc (sizeof *link);
+
+  link->server = server;
+  link->sock = sock;
+  link->source = vsx_main_context_add_poll (NULL /* default context */,
+                                            sock,
+                                            VSX_MAIN_CONTEXT_POLL_IN,
+                                            cluster_link_cb,
+                                            link);
+  vsx_list_insert (&server->cluster_links, &link->link);
+}
+
+bool
+vsx_server_set_cluster (VsxServer *server,
+                        int node,
+                        int n_nodes,
+                        const char *path,
+                        struct vsx_error **error)
+{
+  assert (server->cluster == NULL);
+  assert (node >= 0 && node < n_nodes);
+
+  server->cluster_socket = vsx_fd_message_listen (path, error);
+
+  if (server->cluster_socket == -1)
+    return false;
+
+  server->cluster_path = vsx_strdup (path);
+  server->cluster_source =
+    vsx_main_context_add_poll (NULL /* default context */,
+                               server->cluster_socket,
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               cluster_socket_cb,
+                               server);
+
+  server->cluster = vsx_cluster_new (n_nodes);
+  server->cluster_node = node;
+
+  vsx_generate_id_set_filter (cluster_id_filter, server);
+
+  return true;
+}
+
 static void
 vsx_server_quit_cb (VsxMainContextSource *source,
                     void *user_data)
@@ -997,6 +2295,172 @@ vsx_server_quit_cb (VsxMainContextSource *source,
   vsx_log ("Quit signal received");
 }
 
+static void
+wakeup_timer_cb (VsxMainContextSource *source,
+                 int fd,
+                 VsxMainContextPollFlags flags,
+                 void *user_data)
+{
+  VsxServer *server = user_data;
+  uint64_t expirations;
+
+  /* The held back changes are flushed after the main loop iteration
+   * so this only needs to clear the timer.
+   */
+  if (read (fd, &expirations, sizeof expirations) == -1
+      && errno != EAGAIN
+      && errno != EINTR)
+    {
+      vsx_log ("Error reading wakeup timer: %s", strerror (errno));
+      vsx_main_context_remove_source (source);
+      server->wakeup_source = NULL;
+      /* Fall back to sending the changes immediately. Held back tile
+       * moves will only be applied when the main loop next wakes up
+       * for something else.
+       */
+      vsx_conversation_set_global_broadcast_interval (0);
+      vsx_conversation_flush_broadcasts ();
+    }
+
+  server->wakeup_timer_time = INT64_MAX;
+}
+
+static bool
+ensure_wakeup_timer (VsxServer *server,
+                     struct vsx_error **error)
+{
+  if (server->wakeup_timer != -1)
+    return true;
+
+  if (server->broadcast_rate <= 0
+      && server->rate_limits[VSX_CONNECTION_RATE_CLASS_MOVE_TILE].rate <= 0)
+    return true;
+
+  server->wakeup_timer = timerfd_create (CLOCK_MONOTONIC,
+                                         TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (server->wakeup_timer == -1)
+    {
+      vsx_file_error_set (error,
+                          errno,
+                          "Error creating wakeup timer: %s",
+                          strerror (errno));
+      return false;
+    }
+
+  server->wakeup_source =
+    vsx_main_context_add_poll (NULL, /* default context */
+                               server->wakeup_timer,
+                               VSX_MAIN_CONTEXT_POLL_IN,
+                               wakeup_timer_cb,
+                               server);
+
+  return true;
+}
+
+/* Applies the tile moves that were held back by the rate limit and
+ * are now allowed. Returns the time that the next ones are due or
+ * INT64_MAX if there aren’t any left.
+ */
+static int64_t
+apply_deferred_moves (VsxServer *server)
+{
+  int64_t now = vsx_main_context_get_monotonic_clock (NULL);
+  int64_t next_time = INT64_MAX;
+  struct vsx_list to_check;
+
+  /* Applying a move can cause other connections to be removed so the
+   * connections are moved back to the list one at a time instead of
+   * iterating it directly.
+   */
+  vsx_list_init (&to_check);
+  vsx_list_insert_list (&to_check, &server->deferred_connections);
+  vsx_list_init (&server->deferred_connections);
+
+  while (!vsx_list_empty (&to_check))
+    {
+      VsxServerConnection *connection =
+        vsx_container_of (to_check.next, VsxServerConnection, deferred_link);
+      VsxConnection *ws_connection = connection->ws_connection;
+
+      vsx_list_remove (&connection->deferred_link);
+      connection->has_deferred_moves = false;
+
+      /* The connection isn’t kept alive for the moves if the client
+       * has already gone.
+       */
+      if (connection->read_finished || connection->had_bad_input)
+        continue;
+
+      int64_t due_time = vsx_connection_get_deferred_move_time (ws_connection);
+
+      if (due_time <= now)
+        {
+          struct vsx_error *error = NULL;
+
+          if (!vsx_connection_apply_deferred_moves (ws_connection, &error))
+            {
+              set_bad_input_with_error (connection, error);
+              vsx_error_free (error);
+              update_poll (connection);
+              continue;
+            }
+
+          due_time = vsx_connection_get_deferred_move_time (ws_connection);
+        }
+
+      if (due_time != INT64_MAX)
+        {
+          vsx_list_insert (&server->deferred_connections,
+                           &connection->deferred_link);
+          connection->has_deferred_moves = true;
+
+          if (due_time < next_time)
+            next_time = due_time;
+        }
+    }
+
+  return next_time;
+}
+
+/* Applies any held back tile moves and sends any held back
+ * conversation changes that are due, then sets the timer for the next
+ * ones. This is called between iterations of the main loop so that
+ * all of the changes made while dispatching the events are seen.
+ */
+static void
+flush_held_back_changes (VsxServer *server)
+{
+  int64_t next_time = apply_deferred_moves (server);
+
+  if (server->broadcast_rate > 0)
+    next_time = MIN (next_time, vsx_conversation_flush_broadcasts ());
+
+  if (server->wakeup_source == NULL
+      || next_time == server->wakeup_timer_time)
+    return;
+
+  /* A zero value disarms the timer */
+  struct itimerspec spec = { 0 };
+
+  if (next_time != INT64_MAX)
+    {
+      spec.it_value.tv_sec = next_time / 1000000;
+      spec.it_value.tv_nsec = next_time % 1000000 * 1000;
+    }
+
+  if (timerfd_settime (server->wakeup_timer,
+                       TFD_TIMER_ABSTIME,
+                       &spec,
+                       NULL) == -1)
+    {
+      vsx_log ("Error setting wakeup timer: %s", strerror (errno));
+      next_time = INT64_MAX;
+    }
+
+  server->wakeup_timer_time = next_time;
+}
+
 static void
 log_server_listening (VsxServer *server)
 {
@@ -1025,6 +2489,12 @@ log_server_listening (VsxServer *server)
         {
           vsx_buffer_append_string (&buf, "?");
         }
+      else if (native_address.sockaddr.sa_family == AF_UNIX)
+        {
+          vsx_buffer_append_string (&buf, "unix:");
+          vsx_buffer_append_string (&buf,
+                                    native_address.sockaddr_un.sun_path);
+        }
       else
         {
           struct vsx_netaddress address;
@@ -1034,6 +2504,21 @@ log_server_listening (VsxServer *server)
           vsx_buffer_append_string (&buf, address_string);
           vsx_free (address_string);
         }
+
+      if (ssocket->metrics)
+        vsx_buffer_append_string (&buf, " (metrics)");
+    }
+
+  if (server->cluster)
+    {
+      if (buf.length > 0)
+        vsx_buffer_append_string (&buf, " and ");
+
+      vsx_buffer_append_printf (&buf,
+                                "unix:%s (cluster node %i of %i)",
+                                server->cluster_path,
+                                server->cluster_node,
+                                vsx_cluster_get_n_nodes (server->cluster));
     }
 
   vsx_log ("Server listening on %s", (const char *) buf.data);
@@ -1048,6 +2533,14 @@ vsx_server_run (VsxServer *server,
   VsxMainContextSource *quit_source;
   bool quit_received = false;
 
+  /* The threads for the handshake pool also need to be created in the
+   * final process so they are made here for the same reason as the
+   * quit source below.
+   */
+  if (!ensure_handshake_pool (server, error)
+      || !ensure_wakeup_timer (server, error))
+    return false;
+
   /* We have to make the quit source here instead of during
      vsx_server_new because if we are daemonized then the process will
      be different by the time we reach here so the signalfd needs to
@@ -1056,14 +2549,44 @@ vsx_server_run (VsxServer *server,
                                            vsx_server_quit_cb,
                                            &quit_received);
 
+  /* The snapshot thread is only created on the first save so the
+   * timer can be added here even if we have daemonized.
+   */
+  if (server->snapshot_writer && server->snapshot_source == NULL)
+    {
+      server->snapshot_source =
+        vsx_main_context_add_timer (NULL, /* default context */
+                                    server->snapshot_interval,
+                                    snapshot_timer_cb,
+                                    server);
+    }
+
   log_server_listening (server);
 
   do
-    vsx_main_context_poll (NULL /* default context */);
-  while (!quit_received && !server->fatal_error);
+    {
+      vsx_main_context_poll (NULL /* default context */);
+
+      flush_held_back_changes (server);
+
+      if (server->upgrade_client != -1)
+        handle_upgrade_client (server);
+    }
+  while (!quit_received && !server->fatal_error && !server->upgraded);
 
   vsx_main_context_remove_source (quit_source);
 
+  /* Save the final state so that the clients can reconnect after the
+   * server is restarted. vsx_server_free will wait for it to be
+   * written. If a new process has taken over then it owns the state
+   * now.
+   */
+  if (server->snapshot_writer && !server->upgraded)
+    {
+      vsx_log ("Saving snapshot");
+      save_snapshot (server);
+    }
+
   if (server->fatal_error)
     {
       vsx_error_propagate (error, server->fatal_error);
@@ -1085,6 +2608,15 @@ vsx_server_free (VsxServer *server)
       vsx_server_remove_connection (server, connection);
     }
 
+  /* This will give back any connections that still had a handshake in
+   * flight so that they can be freed.
+   */
+  if (server->handshake_pool)
+    vsx_handshake_pool_free (server->handshake_pool);
+
+  if (server->metrics_server)
+    vsx_metrics_server_free (server->metrics_server);
+
   while (!vsx_list_empty (&server->sockets))
     {
       VsxServerSocket *ssocket =
@@ -1092,6 +2624,66 @@ vsx_server_free (VsxServer *server)
       vsx_server_remove_socket (server, ssocket);
     }
 
+  if (server->snapshot_source)
+    vsx_main_context_remove_source (server->snapshot_source);
+
+  if (server->snapshot_writer)
+    vsx_snapshot_writer_free (server->snapshot_writer);
+
+  if (server->upgrade_source)
+    vsx_main_context_remove_source (server->upgrade_source);
+
+  if (server->upgrade_client != -1)
+    vsx_close (server->upgrade_client);
+
+  if (server->upgrade_socket != -1)
+    {
+      vsx_close (server->upgrade_socket);
+
+      /* The new process will have replaced the socket file */
+      if (!server->upgraded)
+        unlink (server->upgrade_path);
+
+      vsx_free (server->upgrade_path);
+    }
+
+  while (!vsx_list_empty (&server->cluster_links))
+    {
+      VsxServerClusterLink *link =
+        vsx_container_of (server->cluster_links.next,
+                          VsxServerClusterLink,
+                          link);
+      remove_cluster_link (link);
+    }
+
+  if (server->cluster_source)
+    vsx_main_context_remove_source (server->cluster_source);
+
+  if (server->cluster_socket != -1)
+    {
+      vsx_close (server->cluster_socket);
+
+      if (!server->upgraded)
+        unlink (server->cluster_path);
+
+      vsx_free (server->cluster_path);
+    }
+
+  if (server->cluster)
+    {
+      vsx_generate_id_set_filter (NULL, NULL);
+      vsx_cluster_free (server->cluster);
+    }
+
+  if (server->wakeup_source)
+    vsx_main_context_remove_source (server->wakeup_source);
+
+  if (server->wakeup_timer != -1)
+    vsx_close (server->wakeup_timer);
+
+  /* All of the counts are removed along with the connections */
+  vsx_hash_table_destroy (&server->address_counts);
+
   vsx_object_unref (server->person_set);
 
   vsx_object_unref (server->pending_conversations);
@@ -23,12 +23,15 @@
 
 #include "vsx-config.h"
 #include "vsx-error.h"
+#include "vsx-upgrade.h"
+#include "vsx-connection.h"
 
 typedef struct _VsxServer VsxServer;
 
 typedef enum
 {
   VSX_SERVER_ERROR_INVALID_ADDRESS,
+  VSX_SERVER_ERROR_TOO_MANY_CONNECTIONS,
 } VsxServerError;
 
 extern struct vsx_error_domain
@@ -37,6 +40,95 @@ vsx_server_error;
 VsxServer *
 vsx_server_new (void);
 
+/* Sets the number of threads to use for SSL handshakes. Zero means to
+ * run them inline on the main thread and a negative number picks a
+ * default based on the number of CPUs. The threads are created when
+ * the server starts running.
+ */
+void
+vsx_server_set_handshake_threads (VsxServer *server,
+                                  int n_threads);
+
+/* Enables permessage-deflate compression for clients that ask for it
+ * with a window of at most 2^window_bits bytes. Messages shorter than
+ * threshold are sent uncompressed. A window_bits of zero disables it.
+ */
+void
+vsx_server_set_deflate (VsxServer *server,
+                        int window_bits,
+                        int threshold);
+
+/* Limits how fast each connection can send the commands in
+ * rate_class. A rate of zero disables the limit.
+ */
+void
+vsx_server_set_rate_limit (VsxServer *server,
+                           VsxConnectionRateClass rate_class,
+                           int rate,
+                           int burst);
+
+/* Sets the maximum number of connections that can be open from one
+ * client address at the same time. Any more are closed as soon as
+ * they are accepted. IPv6 addresses in the same /64 network count as
+ * one address. Zero means there is no limit.
+ */
+void
+vsx_server_set_max_connections_per_ip (VsxServer *server,
+                                       int max_connections);
+
+/* Sets how many times per second each game broadcasts the tile moves
+ * and typing changes. Changes that arrive faster than this are merged
+ * so that the amount of data sent for a game doesn’t depend on how
+ * fast the clients send commands. Zero sends every change
+ * immediately. The rate is shared by every conversation in the
+ * process so there should only be one server setting it.
+ */
+void
+vsx_server_set_broadcast_rate (VsxServer *server,
+                               int rate);
+
+/* If load is true, restores the games and people from the snapshot
+ * file if it exists. While the server is running the state is saved
+ * back to the file every interval_minutes minutes and again when it
+ * quits.
+ */
+bool
+vsx_server_set_snapshot_file (VsxServer *server,
+                              const char *filename,
+                              int interval_minutes,
+                              bool load,
+                              struct vsx_error **error);
+
+/* Listens on a UNIX socket so that a new process can take over the
+ * server with vsx_server_take_over. Once it has, vsx_server_run
+ * returns.
+ */
+bool
+vsx_server_set_upgrade_socket (VsxServer *server,
+                               const char *path,
+                               struct vsx_error **error);
+
+/* Restores the games and connections received from the old process.
+ * The listening sockets in the state need to be added separately with
+ * vsx_server_add_config.
+ */
+bool
+vsx_server_take_over (VsxServer *server,
+                      VsxUpgradeState *state,
+                      struct vsx_error **error);
+
+/* Makes the server a backend in a cluster of n_nodes backends. The
+ * router connects to the UNIX socket at path and passes on the
+ * connections for the games that this node owns. All of the IDs that
+ * the server generates are picked so that they map to this node.
+ */
+bool
+vsx_server_set_cluster (VsxServer *server,
+                        int node,
+                        int n_nodes,
+                        const char *path,
+                        struct vsx_error **error);
+
 bool
 vsx_server_add_config (VsxServer *server,
                        VsxConfigServer *server_config,
@@ -0,0 +1,892 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-snapshot.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vsx-file-error.h"
+#include "vsx-log.h"
+#include "vsx-proto.h"
+#include "vsx-util.h"
+
+/* The file starts with this magic string and is followed by a list of
+ * records. Each record starts with a byte for the type. All of the
+ * conversations come before the people so that the people can refer
+ * to them. Numbers are stored as LEB128 varints, except for the IDs
+ * which are always 8 little-endian bytes, and strings are stored as a
+ * varint length followed by the bytes.
+ */
+#define VSX_SNAPSHOT_MAGIC "VSXSNAP1"
+
+typedef enum
+{
+  VSX_SNAPSHOT_RECORD_END = 0,
+  VSX_SNAPSHOT_RECORD_CONVERSATION = 1,
+  VSX_SNAPSHOT_RECORD_PERSON = 2,
+} VsxSnapshotRecordType;
+
+typedef struct
+{
+  const uint8_t *p, *end;
+} VsxSnapshotReader;
+
+struct _VsxSnapshotWriter
+{
+  char *filename;
+
+  bool has_thread;
+  pthread_t thread;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  /* Snapshot waiting to be written by the thread */
+  bool has_pending;
+  struct vsx_buffer pending;
+
+  bool quit;
+};
+
+struct vsx_error_domain
+vsx_snapshot_error;
+
+static void
+write_varint (struct vsx_buffer *buffer,
+              uint64_t value)
+{
+  while (value >= 0x80)
+    {
+      vsx_buffer_append_c (buffer, (value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+
+  vsx_buffer_append_c (buffer, value);
+}
+
+static void
+write_signed (struct vsx_buffer *buffer,
+              int64_t value)
+{
+  /* Zigzag encoding so that small negative numbers stay small */
+  write_varint (buffer, ((uint64_t) value << 1) ^ (value >> 63));
+}
+
+static void
+write_id (struct vsx_buffer *buffer,
+          uint64_t id)
+{
+  for (int i = 0; i < 8; i++)
+    vsx_buffer_append_c (buffer, id >> (i * 8));
+}
+
+static void
+write_string (struct vsx_buffer *buffer,
+              const char *str)
+{
+  size_t length = str ? strlen (str) : 0;
+
+  write_varint (buffer, length);
+
+  if (length > 0)
+    vsx_buffer_append (buffer, str, length);
+}
+
+static void
+serialize_conversation_cb (VsxConversation *conversation,
+                           const char *room_name,
+                           void *user_data)
+{
+  struct vsx_buffer *buffer = user_data;
+
+  vsx_buffer_append_c (buffer, VSX_SNAPSHOT_RECORD_CONVERSATION);
+  write_id (buffer, conversation->hash_entry.id);
+  write_string (buffer, conversation->tile_data->language_code);
+  write_string (buffer, room_name);
+  vsx_buffer_append_c (buffer, conversation->state);
+  write_varint (buffer, conversation->total_n_tiles);
+  write_varint (buffer, conversation->n_tiles_in_play);
+
+  /* All of the tiles are saved, including the ones that aren’t in
+   * play yet, so that the rest of the game will be the same.
+   */
+  write_varint (buffer, VSX_TILE_DATA_N_TILES);
+
+  for (int i = 0; i < VSX_TILE_DATA_N_TILES; i++)
+    {
+      const VsxTile *tile = conversation->tiles + i;
+
+      write_string (buffer, tile->letter);
+      write_signed (buffer, tile->x);
+      write_signed (buffer, tile->y);
+      write_signed (buffer, tile->last_player);
+    }
+
+  write_varint (buffer, conversation->n_players);
+
+  for (int i = 0; i < conversation->n_players; i++)
+    {
+      const VsxPlayer *player = conversation->players[i];
+
+      write_string (buffer, player->name);
+      write_varint (buffer, player->flags);
+    }
+
+  int n_messages = vsx_conversation_get_n_messages (conversation);
+
+  write_varint (buffer, n_messages);
+
+  for (int i = 0; i < n_messages; i++)
+    {
+      const VsxConversationMessage *message =
+        vsx_conversation_get_message (conversation, i);
+
+      write_varint (buffer, message->player_num);
+      write_string (buffer, message->text);
+    }
+}
+
+static void
+serialize_person_cb (VsxPerson *person,
+                     void *user_data)
+{
+  struct vsx_buffer *buffer = user_data;
+
+  /* People who have left their game are only kept until the next
+   * garbage collection and their conversation might have already been
+   * removed from the set, so there’s no point in saving them.
+   */
+  if (!vsx_player_is_connected (person->player))
+    return;
+
+  vsx_buffer_append_c (buffer, VSX_SNAPSHOT_RECORD_PERSON);
+  write_id (buffer, person->hash_entry.id);
+  write_id (buffer, person->conversation->hash_entry.id);
+  write_varint (buffer, person->player->num);
+  write_varint (buffer, person->message_offset);
+}
+
+void
+vsx_snapshot_serialize (VsxConversationSet *conversation_set,
+                        VsxPersonSet *person_set,
+                        struct vsx_buffer *buffer)
+{
+  vsx_buffer_append_string (buffer, VSX_SNAPSHOT_MAGIC);
+
+  vsx_conversation_set_foreach (conversation_set,
+                                serialize_conversation_cb,
+                                buffer);
+  vsx_person_set_foreach (person_set,
+                          serialize_person_cb,
+                          buffer);
+
+  vsx_buffer_append_c (buffer, VSX_SNAPSHOT_RECORD_END);
+}
+
+static bool
+read_byte (VsxSnapshotReader *reader,
+           uint8_t *value_out)
+{
+  if (reader->p >= reader->end)
+    return false;
+
+  *value_out = *(reader->p++);
+
+  return true;
+}
+
+static bool
+read_varint (VsxSnapshotReader *reader,
+             uint64_t *value_out)
+{
+  uint64_t value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+    {
+      uint8_t byte;
+
+      if (!read_byte (reader, &byte))
+        return false;
+
+      value |= (uint64_t) (byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+        {
+          *value_out = value;
+          return true;
+        }
+    }
+
+  return false;
+}
+
+/* Reads a varint and checks that it is no more than max */
+static bool
+read_uint (VsxSnapshotReader *reader,
+           uint64_t max,
+           int *value_out)
+{
+  uint64_t value;
+
+  if (!read_varint (reader, &value) || value > max)
+    return false;
+
+  *value_out = value;
+
+  return true;
+}
+
+static bool
+read_int16 (VsxSnapshotReader *reader,
+            int16_t *value_out)
+{
+  uint64_t value;
+
+  if (!read_varint (reader, &value))
+    return false;
+
+  int64_t decoded = (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+
+  if (decoded < INT16_MIN || decoded > INT16_MAX)
+    return false;
+
+  *value_out = decoded;
+
+  return true;
+}
+
+static bool
+read_id (VsxSnapshotReader *reader,
+         uint64_t *id_out)
+{
+  if (reader->end - reader->p < 8)
+    return false;
+
+  uint64_t id = 0;
+
+  for (int i = 0; i < 8; i++)
+    id |= (uint64_t) reader->p[i] << (i * 8);
+
+  reader->p += 8;
+  *id_out = id;
+
+  return true;
+}
+
+/* Returns a newly allocated copy of the string or NULL on error */
+static char *
+read_string (VsxSnapshotReader *reader,
+             size_t max_length)
+{
+  uint64_t length;
+
+  if (!read_varint (reader, &length)
+      || length > max_length
+      || length > reader->end - reader->p
+      || memchr (reader->p, '\0', length))
+    return NULL;
+
+  char *str = vsx_strndup ((const char *) reader->p, length);
+
+  reader->p += length;
+
+  return str;
+}
+
+static bool
+read_tiles (VsxSnapshotReader *reader,
+            VsxConversation *conversation)
+{
+  int n_tiles;
+
+  if (!read_uint (reader, VSX_TILE_DATA_N_TILES, &n_tiles)
+      || n_tiles != VSX_TILE_DATA_N_TILES)
+    return false;
+
+  for (int i = 0; i < n_tiles; i++)
+    {
+      VsxTile *tile = conversation->tiles + i;
+      char *letter = read_string (reader, VSX_TILE_MAX_LETTER_BYTES);
+
+      if (letter == NULL)
+        return false;
+
+      strcpy (tile->letter, letter);
+      vsx_free (letter);
+
+      if (!read_int16 (reader, &tile->x)
+          || !read_int16 (reader, &tile->y)
+          || !read_int16 (reader, &tile->last_player))
+        return false;
+    }
+
+  return true;
+}
+
+static bool
+read_players (VsxSnapshotReader *reader,
+              VsxConversation *conversation)
+{
+  int n_players;
+
+  if (!read_uint (reader, VSX_CONVERSATION_MAX_PLAYERS, &n_players))
+    return false;
+
+  for (int i = 0; i < n_players; i++)
+    {
+      char *name = read_string (reader, VSX_PROTO_MAX_NAME_LENGTH);
+
+      if (name == NULL)
+        return false;
+
+      VsxPlayer *player = vsx_player_new (name, i);
+
+      vsx_free (name);
+
+      conversation->players[conversation->n_players++] = player;
+
+      int flags;
+
+      if (!read_uint (reader, UINT8_MAX, &flags))
+        return false;
+
+      /* Nobody can still be typing after a restart */
+      player->flags = flags & ~VSX_PLAYER_TYPING;
+
+      if (vsx_player_is_connected (player))
+        conversation->n_connected_players++;
+    }
+
+  return true;
+}
+
+static bool
+read_messages (VsxSnapshotReader *reader,
+               VsxConversation *conversation)
+{
+  uint64_t n_messages;
+
+  if (!read_varint (reader, &n_messages))
+    return false;
+
+  for (uint64_t i = 0; i < n_messages; i++)
+    {
+      int player_num;
+
+      if (!read_uint (reader, conversation->n_players - 1, &player_num))
+        return false;
+
+      char *text = read_string (reader, VSX_PROTO_MAX_MESSAGE_LENGTH);
+
+      if (text == NULL)
+        return false;
+
+      int n = vsx_conversation_get_n_messages (conversation);
+      vsx_buffer_set_length (&conversation->messages,
+                             (n + 1) * sizeof (VsxConversationMessage));
+      VsxConversationMessage *message =
+        vsx_conversation_get_message (conversation, n);
+
+      message->player_num = player_num;
+      message->text = text;
+    }
+
+  return true;
+}
+
+static bool
+read_conversation (VsxSnapshotReader *reader,
+                   VsxConversationSet *conversation_set)
+{
+  uint64_t id;
+
+  if (!read_id (reader, &id))
+    return false;
+
+  char *language_code = read_string (reader, 16);
+
+  if (language_code == NULL)
+    return false;
+
+  const VsxTileData *tile_data =
+    vsx_tile_data_get_for_language_code (language_code);
+
+  vsx_free (language_code);
+
+  if (tile_data == NULL)
+    return false;
+
+  char *room_name = read_string (reader, VSX_PROTO_MAX_PAYLOAD_SIZE);
+
+  if (room_name == NULL)
+    return false;
+
+  VsxConversation *conversation = vsx_conversation_new (id, tile_data);
+  bool ret = false;
+  uint8_t state;
+
+  if (!read_byte (reader, &state)
+      || state > VSX_CONVERSATION_IN_PROGRESS
+      || !read_uint (reader,
+                     VSX_TILE_DATA_N_TILES,
+                     &conversation->total_n_tiles)
+      || !read_uint (reader,
+                     conversation->total_n_tiles,
+                     &conversation->n_tiles_in_play)
+      || !read_tiles (reader, conversation)
+      || !read_players (reader, conversation)
+      || conversation->n_players < 1
+      || !read_messages (reader, conversation))
+    goto done;
+
+  conversation->state = state;
+
+  if (!vsx_conversation_set_add_conversation (conversation_set,
+                                              conversation,
+                                              *room_name ? room_name : NULL))
+    goto done;
+
+  ret = true;
+
+done:
+  vsx_object_unref (conversation);
+  vsx_free (room_name);
+
+  return ret;
+}
+
+static bool
+read_person (VsxSnapshotReader *reader,
+             VsxConversationSet *conversation_set,
+             VsxPersonSet *person_set)
+{
+  uint64_t id, conversation_id;
+  int player_num, message_offset;
+
+  if (!read_id (reader, &id) || !read_id (reader, &conversation_id))
+    return false;
+
+  VsxConversation *conversation =
+    vsx_conversation_set_get_conversation (conversation_set,
+                                           conversation_id);
+
+  if (conversation == NULL
+      || !read_uint (reader, conversation->n_players - 1, &player_num)
+      || !read_uint (reader,
+                     vsx_conversation_get_n_messages (conversation),
+                     &message_offset)
+      || !vsx_player_is_connected (conversation->players[player_num]))
+    return false;
+
+  VsxPerson *person = vsx_person_new_for_player (id,
+                                                 conversation,
+                                                 player_num,
+                                                 message_offset);
+  bool ret = vsx_person_set_add_person (person_set, person);
+
+  vsx_object_unref (person);
+
+  return ret;
+}
+
+static bool
+read_records (VsxSnapshotReader *reader,
+              VsxConversationSet *conversation_set,
+              VsxPersonSet *person_set)
+{
+  while (true)
+    {
+      uint8_t type;
+
+      if (!read_byte (reader, &type))
+        return false;
+
+      switch ((VsxSnapshotRecordType) type)
+        {
+        case VSX_SNAPSHOT_RECORD_END:
+          return reader->p == reader->end;
+
+        case VSX_SNAPSHOT_RECORD_CONVERSATION:
+          if (!read_conversation (reader, conversation_set))
+            return false;
+          break;
+
+        case VSX_SNAPSHOT_RECORD_PERSON:
+          if (!read_person (reader, conversation_set, person_set))
+            return false;
+          break;
+
+        default:
+          return false;
+        }
+    }
+}
+
+static bool
+read_file (const char *filename,
+           struct vsx_buffer *buffer,
+           struct vsx_error **error)
+{
+  FILE *file = fopen (filename, "rb");
+
+  if (file == NULL)
+    goto error;
+
+  while (true)
+    {
+      vsx_buffer_ensure_size (buffer, buffer->length + 65536);
+
+      size_t got = fread (buffer->data + buffer->length,
+                          1,
+                          buffer->size - buffer->length,
+                          file);
+
+      buffer->length += got;
+
+      if (got == 0)
+        break;
+    }
+
+  bool ok = !ferror (file);
+
+  fclose (file);
+
+  if (ok)
+    return true;
+
+error:
+  vsx_file_error_set (error,
+                      errno,
+                      "%s: %s",
+                      filename,
+                      strerror (errno));
+  return false;
+}
+
+static bool
+load_data (const char *name,
+           const uint8_t *data,
+           size_t length,
+           VsxConversationSet *conversation_set,
+           VsxPersonSet *person_set,
+           struct vsx_error **error)
+{
+  VsxSnapshotReader reader =
+    {
+      .p = data,
+      .end = data + length,
+    };
+  size_t magic_length = (sizeof VSX_SNAPSHOT_MAGIC) - 1;
+
+  if (length < magic_length
+      || memcmp (data, VSX_SNAPSHOT_MAGIC, magic_length))
+    {
+      vsx_set_error (error,
+                     &vsx_snapshot_error,
+                     VSX_SNAPSHOT_ERROR_INVALID,
+                     "%s: not a snapshot file",
+                     name);
+      return false;
+    }
+
+  reader.p += magic_length;
+
+  if (!read_records (&reader, conversation_set, person_set))
+    {
+      vsx_set_error (error,
+                     &vsx_snapshot_error,
+                     VSX_SNAPSHOT_ERROR_INVALID,
+                     "%s: invalid snapshot at offset %zu",
+                     name,
+                     (size_t) (reader.p - data));
+      return false;
+    }
+
+  return true;
+}
+
+bool
+vsx_snapshot_load (const char *filename,
+                   VsxConversationSet *conversation_set,
+                   VsxPersonSet *person_set,
+                   struct vsx_error **error)
+{
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+  bool ret = true;
+
+  if (!read_file (filename, &buffer, error))
+    {
+      if ((*error)->domain == &vsx_file_error
+          && (*error)->code == VSX_FILE_ERROR_NOENT)
+        {
+          /* Nothing to restore */
+          vsx_error_free (*error);
+          *error = NULL;
+        }
+      else
+        {
+          ret = false;
+        }
+    }
+  else
+    {
+      ret = load_data (filename,
+                       buffer.data,
+                       buffer.length,
+                       conversation_set,
+                       person_set,
+                       error);
+    }
+
+  vsx_buffer_destroy (&buffer);
+
+  return ret;
+}
+
+bool
+vsx_snapshot_load_data (const uint8_t *data,
+                        size_t length,
+                        VsxConversationSet *conversation_set,
+                        VsxPersonSet *person_set,
+                        struct vsx_error **error)
+{
+  return load_data ("snapshot",
+                    data,
+                    length,
+                    conversation_set,
+                    person_set,
+                    error);
+}
+
+static bool
+write_all (int fd,
+           const uint8_t *data,
+           size_t length)
+{
+  while (length > 0)
+    {
+      ssize_t wrote = write (fd, data, length);
+
+      if (wrote == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+
+      data += wrote;
+      length -= wrote;
+    }
+
+  return true;
+}
+
+static void
+write_snapshot (const char *filename,
+                const struct vsx_buffer *buffer)
+{
+  char *tmp_filename = vsx_strconcat (filename, ".tmp", NULL);
+
+  /* The snapshot contains everyone’s chat messages so it shouldn’t be
+   * readable by other users.
+   */
+  int fd = open (tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  if (fd == -1)
+    {
+      vsx_log ("Error writing snapshot: %s: %s",
+               tmp_filename,
+               strerror (errno));
+    }
+  else
+    {
+      bool ok = (write_all (fd, buffer->data, buffer->length)
+                 && fsync (fd) == 0);
+      int write_errno = errno;
+
+      close (fd);
+
+      if (!ok)
+        {
+          vsx_log ("Error writing snapshot: %s: %s",
+                   tmp_filename,
+                   strerror (write_errno));
+          unlink (tmp_filename);
+        }
+      else if (rename (tmp_filename, filename) == -1)
+        {
+          vsx_log ("Error renaming snapshot: %s: %s",
+                   filename,
+                   strerror (errno));
+          unlink (tmp_filename);
+        }
+    }
+
+  vsx_free (tmp_filename);
+}
+
+static void
+block_signals (void)
+{
+  sigset_t sigset;
+
+  sigemptyset (&sigset);
+  sigaddset (&sigset, SIGINT);
+  sigaddset (&sigset, SIGTERM);
+
+  if (pthread_sigmask (SIG_BLOCK, &sigset, NULL) == -1)
+    vsx_warning ("pthread_sigmask failed: %s", strerror (errno));
+}
+
+static void *
+thread_func (void *user_data)
+{
+  VsxSnapshotWriter *writer = user_data;
+
+  block_signals ();
+
+  pthread_mutex_lock (&writer->mutex);
+
+  while (true)
+    {
+      if (writer->has_pending)
+        {
+          struct vsx_buffer buffer = writer->pending;
+
+          writer->has_pending = false;
+          vsx_buffer_init (&writer->pending);
+
+          pthread_mutex_unlock (&writer->mutex);
+
+          write_snapshot (writer->filename, &buffer);
+          vsx_buffer_destroy (&buffer);
+
+          pthread_mutex_lock (&writer->mutex);
+        }
+      else if (writer->quit)
+        {
+          break;
+        }
+      else
+        {
+          pthread_cond_wait (&writer->cond, &writer->mutex);
+        }
+    }
+
+  pthread_mutex_unlock (&writer->mutex);
+
+  return NULL;
+}
+
+VsxSnapshotWriter *
+vsx_snapshot_writer_new (const char *filename)
+{
+  VsxSnapshotWriter *writer = vsx_calloc (sizeof *writer);
+
+  writer->filename = vsx_strdup (filename);
+
+  pthread_mutex_init (&writer->mutex, NULL);
+  pthread_cond_init (&writer->cond, NULL);
+
+  vsx_buffer_init (&writer->pending);
+
+  return writer;
+}
+
+static bool
+ensure_thread (VsxSnapshotWriter *writer)
+{
+  /* The thread is only created on the first save so that it will be
+   * in the right process if the server daemonizes.
+   */
+  if (writer->has_thread)
+    return true;
+
+  int ret = pthread_create (&writer->thread,
+                            NULL, /* attr */
+                            thread_func,
+                            writer);
+
+  if (ret)
+    {
+      vsx_log ("Error creating snapshot thread: %s", strerror (ret));
+      return false;
+    }
+
+  writer->has_thread = true;
+
+  return true;
+}
+
+void
+vsx_snapshot_writer_save (VsxSnapshotWriter *writer,
+                          VsxConversationSet *conversation_set,
+                          VsxPersonSet *person_set)
+{
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+
+  vsx_snapshot_serialize (conversation_set, person_set, &buffer);
+
+  if (!ensure_thread (writer))
+    {
+      /* Fall back to writing it on the main thread */
+      write_snapshot (writer->filename, &buffer);
+      vsx_buffer_destroy (&buffer);
+      return;
+    }
+
+  pthread_mutex_lock (&writer->mutex);
+
+  vsx_buffer_destroy (&writer->pending);
+  writer->pending = buffer;
+  writer->has_pending = true;
+
+  pthread_cond_signal (&writer->cond);
+
+  pthread_mutex_unlock (&writer->mutex);
+}
+
+void
+vsx_snapshot_writer_free (VsxSnapshotWriter *writer)
+{
+  if (writer->has_thread)
+    {
+      pthread_mutex_lock (&writer->mutex);
+      writer->quit = true;
+      pthread_cond_signal (&writer->cond);
+      pthread_mutex_unlock (&writer->mutex);
+
+      pthread_join (writer->thread, NULL);
+    }
+
+  vsx_buffer_destroy (&writer->pending);
+
+  pthread_mutex_destroy (&writer->mutex);
+  pthread_cond_destroy (&writer->cond);
+
+  vsx_free (writer->filename);
+  vsx_free (writer);
+}
@@ -0,0 +1,87 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_SNAPSHOT_H
+#define VSX_SNAPSHOT_H
+
+#include <stdbool.h>
+
+#include "vsx-conversation-set.h"
+#include "vsx-person-set.h"
+#include "vsx-buffer.h"
+#include "vsx-error.h"
+
+/* Saves the games and the IDs of the people playing them to a file so
+ * that they can be restored when the server restarts. The clients can
+ * then reconnect with their old IDs as if nothing happened.
+ *
+ * The state is serialised into a buffer on the main thread, which is
+ * quick because it is just copying memory, and then the buffer is
+ * handed to a thread which does the slow part of writing it to disk.
+ * The file is written under a temporary name and then renamed so that
+ * a crash in the middle of writing never leaves a broken snapshot.
+ */
+
+extern struct vsx_error_domain
+vsx_snapshot_error;
+
+typedef enum
+{
+  VSX_SNAPSHOT_ERROR_INVALID
+} VsxSnapshotError;
+
+typedef struct _VsxSnapshotWriter VsxSnapshotWriter;
+
+void
+vsx_snapshot_serialize (VsxConversationSet *conversation_set,
+                        VsxPersonSet *person_set,
+                        struct vsx_buffer *buffer);
+
+/* Adds everything in the snapshot to the sets. It is not an error if
+ * the file doesn’t exist.
+ */
+bool
+vsx_snapshot_load (const char *filename,
+                   VsxConversationSet *conversation_set,
+                   VsxPersonSet *person_set,
+                   struct vsx_error **error);
+
+/* Same as vsx_snapshot_load but the snapshot is already in memory */
+bool
+vsx_snapshot_load_data (const uint8_t *data,
+                        size_t length,
+                        VsxConversationSet *conversation_set,
+                        VsxPersonSet *person_set,
+                        struct vsx_error **error);
+
+VsxSnapshotWriter *
+vsx_snapshot_writer_new (const char *filename);
+
+/* Takes a copy of the current state and queues it to be written. If
+ * the previous snapshot hasn’t been written yet it is replaced.
+ */
+void
+vsx_snapshot_writer_save (VsxSnapshotWriter *writer,
+                          VsxConversationSet *conversation_set,
+                          VsxPersonSet *person_set);
+
+/* Waits for any queued snapshot to be written */
+void
+vsx_snapshot_writer_free (VsxSnapshotWriter *writer);
+
+#endif /* VSX_SNAPSHOT_H */
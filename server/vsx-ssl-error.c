@@ -35,9 +35,15 @@ vsx_ssl_error_from_errno (unsigned long errnum)
 
 void
 vsx_ssl_error_set (struct vsx_error **error)
+{
+  vsx_ssl_error_set_from_errnum (error, ERR_get_error ());
+}
+
+void
+vsx_ssl_error_set_from_errnum (struct vsx_error **error,
+                               unsigned long errnum)
 {
   struct vsx_buffer buf = VSX_BUFFER_STATIC_INIT;
-  unsigned long errnum = ERR_get_error ();
 
   vsx_buffer_append_string (&buf, "SSL error: ");
   vsx_buffer_ensure_size (&buf, buf.length + 200);
@@ -35,4 +35,13 @@ vsx_ssl_error_from_errno (unsigned long errnum);
 void
 vsx_ssl_error_set (struct vsx_error **error);
 
+/* Same as vsx_ssl_error_set except that it uses the given error code
+ * instead of taking the next one from the queue. The error queue is
+ * per-thread so this can be used to report an error that was
+ * retrieved on a different thread.
+ */
+void
+vsx_ssl_error_set_from_errnum (struct vsx_error **error,
+                               unsigned long errnum);
+
 #endif /* VSX_SSL_ERROR_H */
@@ -0,0 +1,394 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-upgrade.h"
+
+#include <string.h>
+
+#include "vsx-fd-message.h"
+#include "vsx-util.h"
+
+/* Sent at the start so that an incompatible version can be detected */
+#define VSX_UPGRADE_MAGIC "VSXUPG02"
+
+/* Each message is sent with vsx_fd_message_send. The first byte is
+ * the message type and the rest is the payload. Large payloads such
+ * as the snapshot are split into chunks of this size.
+ */
+#define VSX_UPGRADE_CHUNK_SIZE 16384
+#define VSX_UPGRADE_MAX_MESSAGE_SIZE (VSX_UPGRADE_CHUNK_SIZE + 1)
+
+/* Time in seconds that either side will wait for the other before
+ * giving up. This stops the old server from hanging forever if the
+ * new process gets stuck.
+ */
+#define VSX_UPGRADE_TIMEOUT 10
+
+typedef enum
+{
+  VSX_UPGRADE_MESSAGE_START,
+  VSX_UPGRADE_MESSAGE_LISTEN_SOCKET,
+  VSX_UPGRADE_MESSAGE_SNAPSHOT,
+  VSX_UPGRADE_MESSAGE_CONNECTION,
+  VSX_UPGRADE_MESSAGE_END,
+  VSX_UPGRADE_MESSAGE_ACKNOWLEDGE,
+} VsxUpgradeMessageType;
+
+struct vsx_error_domain
+vsx_upgrade_error;
+
+static bool
+send_message (int sock,
+              VsxUpgradeMessageType type,
+              const uint8_t *data,
+              size_t length,
+              int fd,
+              struct vsx_error **error)
+{
+  uint8_t type_byte = type;
+  struct iovec iov[] =
+    {
+      { .iov_base = &type_byte, .iov_len = 1 },
+      { .iov_base = (void *) data, .iov_len = length },
+    };
+
+  return vsx_fd_message_send (sock, iov, VSX_N_ELEMENTS (iov), fd, error);
+}
+
+bool
+vsx_upgrade_send_start (int sock,
+                        struct vsx_error **error)
+{
+  vsx_fd_message_set_timeout (sock, VSX_UPGRADE_TIMEOUT);
+
+  return send_message (sock,
+                       VSX_UPGRADE_MESSAGE_START,
+                       (const uint8_t *) VSX_UPGRADE_MAGIC,
+                       (sizeof VSX_UPGRADE_MAGIC) - 1,
+                       -1, /* fd */
+                       error);
+}
+
+bool
+vsx_upgrade_send_listen_socket (int sock,
+                                int fd,
+                                struct vsx_error **error)
+{
+  return send_message (sock,
+                       VSX_UPGRADE_MESSAGE_LISTEN_SOCKET,
+                       NULL, 0, /* data */
+                       fd,
+                       error);
+}
+
+bool
+vsx_upgrade_send_snapshot (int sock,
+                           const uint8_t *data,
+                           size_t length,
+                           struct vsx_error **error)
+{
+  while (length > 0)
+    {
+      size_t chunk_size = MIN (length, VSX_UPGRADE_CHUNK_SIZE);
+
+      if (!send_message (sock,
+                         VSX_UPGRADE_MESSAGE_SNAPSHOT,
+                         data,
+                         chunk_size,
+                         -1, /* fd */
+                         error))
+        return false;
+
+      data += chunk_size;
+      length -= chunk_size;
+    }
+
+  return true;
+}
+
+bool
+vsx_upgrade_send_connection (int sock,
+                             int fd,
+                             const uint8_t *data,
+                             size_t length,
+                             struct vsx_error **error)
+{
+  if (length > VSX_UPGRADE_CHUNK_SIZE)
+    {
+      vsx_set_error (error,
+                     &vsx_upgrade_error,
+                     VSX_UPGRADE_ERROR_INVALID,
+                     "Connection state is too long to hand over");
+      return false;
+    }
+
+  return send_message (sock,
+                       VSX_UPGRADE_MESSAGE_CONNECTION,
+                       data,
+                       length,
+                       fd,
+                       error);
+}
+
+static void
+set_protocol_error (struct vsx_error **error)
+{
+  vsx_set_error (error,
+                 &vsx_upgrade_error,
+                 VSX_UPGRADE_ERROR_INVALID,
+                 "Invalid message received on the upgrade socket");
+}
+
+/* Receives one message into the buffer, which will start with the
+ * type byte. *fd_out is set to any passed file descriptor or -1.
+ */
+static bool
+receive_message (int sock,
+                 struct vsx_buffer *buffer,
+                 int *fd_out,
+                 struct vsx_error **error)
+{
+  if (!vsx_fd_message_receive (sock,
+                               buffer,
+                               VSX_UPGRADE_MAX_MESSAGE_SIZE,
+                               fd_out,
+                               error))
+    return false;
+
+  if (buffer->length < 1)
+    {
+      if (*fd_out != -1)
+        vsx_close (*fd_out);
+      set_protocol_error (error);
+      return false;
+    }
+
+  return true;
+}
+
+bool
+vsx_upgrade_send_end (int sock,
+                      struct vsx_error **error)
+{
+  if (!send_message (sock,
+                     VSX_UPGRADE_MESSAGE_END,
+                     NULL, 0, /* data */
+                     -1, /* fd */
+                     error))
+    return false;
+
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+  int fd;
+  bool ret = true;
+
+  if (!receive_message (sock, &buffer, &fd, error))
+    {
+      ret = false;
+    }
+  else
+    {
+      if (fd != -1)
+        vsx_close (fd);
+
+      if (buffer.length != 1
+          || buffer.data[0] != VSX_UPGRADE_MESSAGE_ACKNOWLEDGE)
+        {
+          set_protocol_error (error);
+          ret = false;
+        }
+    }
+
+  vsx_buffer_destroy (&buffer);
+
+  return ret;
+}
+
+static bool
+handle_message (VsxUpgradeState *state,
+                const struct vsx_buffer *buffer,
+                int fd,
+                bool *finished,
+                struct vsx_error **error)
+{
+  const uint8_t *payload = buffer->data + 1;
+  size_t payload_length = buffer->length - 1;
+
+  switch ((VsxUpgradeMessageType) buffer->data[0])
+    {
+    case VSX_UPGRADE_MESSAGE_LISTEN_SOCKET:
+      if (fd == -1 || payload_length != 0)
+        break;
+      vsx_buffer_append (&state->listen_fds, &fd, sizeof fd);
+      return true;
+
+    case VSX_UPGRADE_MESSAGE_SNAPSHOT:
+      if (fd != -1)
+        break;
+      vsx_buffer_append (&state->snapshot, payload, payload_length);
+      return true;
+
+    case VSX_UPGRADE_MESSAGE_CONNECTION:
+      {
+        if (fd == -1)
+          break;
+
+        VsxUpgradeConnection *connection = vsx_alloc (sizeof *connection);
+
+        connection->fd = fd;
+        vsx_buffer_init (&connection->data);
+        vsx_buffer_append (&connection->data, payload, payload_length);
+        vsx_list_insert (state->connections.prev, &connection->link);
+      }
+      return true;
+
+    case VSX_UPGRADE_MESSAGE_END:
+      if (fd != -1 || payload_length != 0)
+        break;
+      *finished = true;
+      return true;
+
+    case VSX_UPGRADE_MESSAGE_START:
+    case VSX_UPGRADE_MESSAGE_ACKNOWLEDGE:
+      break;
+    }
+
+  if (fd != -1)
+    vsx_close (fd);
+
+  set_protocol_error (error);
+
+  return false;
+}
+
+static bool
+receive_state (VsxUpgradeState *state,
+               struct vsx_error **error)
+{
+  struct vsx_buffer buffer = VSX_BUFFER_STATIC_INIT;
+  size_t magic_length = (sizeof VSX_UPGRADE_MAGIC) - 1;
+  bool finished = false;
+  bool ret = true;
+  int fd;
+
+  if (!receive_message (state->sock, &buffer, &fd, error))
+    {
+      ret = false;
+      goto out;
+    }
+
+  if (fd != -1)
+    vsx_close (fd);
+
+  if (buffer.length != magic_length + 1
+      || buffer.data[0] != VSX_UPGRADE_MESSAGE_START
+      || memcmp (buffer.data + 1, VSX_UPGRADE_MAGIC, magic_length))
+    {
+      vsx_set_error (error,
+                     &vsx_upgrade_error,
+                     VSX_UPGRADE_ERROR_INVALID,
+                     "The running server uses an incompatible upgrade "
+                     "protocol");
+      ret = false;
+      goto out;
+    }
+
+  while (!finished)
+    {
+      if (!receive_message (state->sock, &buffer, &fd, error)
+          || !handle_message (state, &buffer, fd, &finished, error))
+        {
+          ret = false;
+          break;
+        }
+    }
+
+ out:
+  vsx_buffer_destroy (&buffer);
+
+  return ret;
+}
+
+VsxUpgradeState *
+vsx_upgrade_receive (const char *path,
+                     struct vsx_error **error)
+{
+  int sock = vsx_fd_message_connect (path, error);
+
+  if (sock == -1)
+    return NULL;
+
+  vsx_fd_message_set_timeout (sock, VSX_UPGRADE_TIMEOUT);
+
+  VsxUpgradeState *state = vsx_alloc (sizeof *state);
+
+  state->sock = sock;
+  vsx_buffer_init (&state->listen_fds);
+  vsx_buffer_init (&state->snapshot);
+  vsx_list_init (&state->connections);
+
+  if (!receive_state (state, error))
+    {
+      vsx_upgrade_state_free (state);
+      return NULL;
+    }
+
+  return state;
+}
+
+bool
+vsx_upgrade_acknowledge (VsxUpgradeState *state,
+                         struct vsx_error **error)
+{
+  return send_message (state->sock,
+                       VSX_UPGRADE_MESSAGE_ACKNOWLEDGE,
+                       NULL, 0, /* data */
+                       -1, /* fd */
+                       error);
+}
+
+void
+vsx_upgrade_state_free (VsxUpgradeState *state)
+{
+  const int *fds = (const int *) state->listen_fds.data;
+  size_t n_fds = state->listen_fds.length / sizeof (int);
+
+  for (size_t i = 0; i < n_fds; i++)
+    {
+      if (fds[i] != -1)
+        vsx_close (fds[i]);
+    }
+
+  VsxUpgradeConnection *connection, *tmp;
+
+  vsx_list_for_each_safe (connection, tmp, &state->connections, link)
+    {
+      if (connection->fd != -1)
+        vsx_close (connection->fd);
+      vsx_buffer_destroy (&connection->data);
+      vsx_free (connection);
+    }
+
+  vsx_buffer_destroy (&state->listen_fds);
+  vsx_buffer_destroy (&state->snapshot);
+
+  vsx_close (state->sock);
+
+  vsx_free (state);
+}
@@ -0,0 +1,122 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_UPGRADE_H
+#define VSX_UPGRADE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vsx-error.h"
+#include "vsx-buffer.h"
+#include "vsx-list.h"
+
+/* Replaces a running server with a new process without dropping the
+ * players. The old server listens on a UNIX socket. When the new
+ * process connects to it, the old server sends its listening sockets,
+ * a snapshot of the games and the sockets of the established
+ * connections along with their state. The file descriptors are passed
+ * with SCM_RIGHTS. Once the new process has set everything up it
+ * sends back an acknowledgement and the old process exits without
+ * closing the connections. If the new process fails before that then
+ * the old process just carries on.
+ */
+
+extern struct vsx_error_domain
+vsx_upgrade_error;
+
+typedef enum
+{
+  VSX_UPGRADE_ERROR_INVALID,
+} VsxUpgradeError;
+
+typedef struct
+{
+  struct vsx_list link;
+  int fd;
+  struct vsx_buffer data;
+} VsxUpgradeConnection;
+
+typedef struct
+{
+  int sock;
+
+  /* Array of ints in the order that the old server sent them. The
+   * fds are closed when the state is freed unless they are set to
+   * -1.
+   */
+  struct vsx_buffer listen_fds;
+
+  struct vsx_buffer snapshot;
+
+  /* List of VsxUpgradeConnections. Same as for listen_fds, the fd is
+   * closed when the state is freed unless it is set to -1.
+   */
+  struct vsx_list connections;
+} VsxUpgradeState;
+
+/* Functions to send the state over a socket accepted from the upgrade
+ * socket, which is created with vsx_fd_message_listen. These block.
+ */
+bool
+vsx_upgrade_send_start (int sock,
+                        struct vsx_error **error);
+
+bool
+vsx_upgrade_send_listen_socket (int sock,
+                                int fd,
+                                struct vsx_error **error);
+
+bool
+vsx_upgrade_send_snapshot (int sock,
+                           const uint8_t *data,
+                           size_t length,
+                           struct vsx_error **error);
+
+bool
+vsx_upgrade_send_connection (int sock,
+                             int fd,
+                             const uint8_t *data,
+                             size_t length,
+                             struct vsx_error **error);
+
+/* Sends the end marker and waits for the new process to acknowledge
+ * that it has taken over. If this returns true the old process must
+ * stop using the sockets.
+ */
+bool
+vsx_upgrade_send_end (int sock,
+                      struct vsx_error **error);
+
+/* Connects to the upgrade socket of a running server and receives its
+ * state.
+ */
+VsxUpgradeState *
+vsx_upgrade_receive (const char *path,
+                     struct vsx_error **error);
+
+/* Tells the old process that the new one has taken over */
+bool
+vsx_upgrade_acknowledge (VsxUpgradeState *state,
+                         struct vsx_error **error);
+
+void
+vsx_upgrade_state_free (VsxUpgradeState *state);
+
+#endif /* VSX_UPGRADE_H */
@@ -50,6 +50,20 @@ struct _VsxWsParser
   unsigned int key_hash_length;
 
   EVP_MD_CTX *key_hash_ctx;
+
+  bool require_key;
+
+  /* Copies of the parts of the request line. These are NULL until
+   * the request line has been parsed.
+   */
+  char *method;
+  char *uri;
+
+  /* Comma-separated list of the values of all of the
+   * Sec-WebSocket-Protocol headers, or NULL if there weren’t any.
+   */
+  char *protocols;
+  char *extensions;
 };
 
 struct vsx_error_domain
@@ -66,10 +80,23 @@ vsx_ws_parser_new (void)
   parser->buf_len = 0;
   parser->state = VSX_WS_PARSER_READING_REQUEST_LINE;
   parser->key_hash_ctx = NULL;
+  parser->key_hash_length = 0;
+  parser->require_key = true;
+  parser->method = NULL;
+  parser->uri = NULL;
+  parser->protocols = NULL;
+  parser->extensions = NULL;
 
   return parser;
 }
 
+void
+vsx_ws_parser_set_require_key (VsxWsParser *parser,
+                               bool require_key)
+{
+  parser->require_key = require_key;
+}
+
 static bool
 check_http_version (const uint8_t *data,
                     unsigned int length,
@@ -169,14 +196,17 @@ process_request_line (VsxWsParser *parser,
   if (!check_http_version (data, length, error))
     return false;
 
+  parser->method = vsx_strdup ((const char *) parser->buf);
+  parser->uri = vsx_strdup ((const char *) method_end + 1);
+
   return true;
 }
 
 static bool
-is_key_header (const char *header)
+is_header (const char *header,
+           const char *name)
 {
-  static const char key_header[] = "sec-websocket-key:";
-  const char *a = key_header, *b = header;
+  const char *a = name, *b = header;
 
   while (*a)
     {
@@ -190,6 +220,29 @@ is_key_header (const char *header)
   return true;
 }
 
+/* Appends the value of a header to a comma-separated list so that
+ * repeated headers are combined in the same way as HTTP specifies.
+ */
+static void
+add_list_header (char **list,
+                 const uint8_t *data,
+                 unsigned int length)
+{
+  char *value = vsx_strndup ((const char *) data, length);
+
+  if (*list == NULL)
+    {
+      *list = value;
+    }
+  else
+    {
+      char *joined = vsx_strconcat (*list, ",", value, NULL);
+      vsx_free (*list);
+      vsx_free (value);
+      *list = joined;
+    }
+}
+
 static bool
 process_header (VsxWsParser *parser, struct vsx_error **error)
 {
@@ -209,8 +262,22 @@ process_header (VsxWsParser *parser, struct vsx_error **error)
       return false;
     }
 
-  /* Ignore any headers apart from the key header */
-  if (!is_key_header (field_name))
+  if (is_header (field_name, "sec-websocket-protocol:"))
+    {
+      length -= field_name_end - data + 1;
+      add_list_header (&parser->protocols, field_name_end + 1, length);
+      return true;
+    }
+
+  if (is_header (field_name, "sec-websocket-extensions:"))
+    {
+      length -= field_name_end - data + 1;
+      add_list_header (&parser->extensions, field_name_end + 1, length);
+      return true;
+    }
+
+  /* Ignore any other headers apart from the key header */
+  if (!is_header (field_name, "sec-websocket-key:"))
     return true;
 
   if (parser->key_hash_ctx != NULL)
@@ -362,6 +429,9 @@ finish_key_hash (VsxWsParser *parser,
 {
   if (parser->key_hash_ctx == NULL)
     {
+      if (!parser->require_key)
+        return true;
+
       vsx_set_error (error,
                      &vsx_ws_parser_error,
                      VSX_WS_PARSER_ERROR_INVALID,
@@ -514,11 +584,70 @@ vsx_ws_parser_get_key_hash (VsxWsParser *parser,
   return parser->key_hash;
 }
 
+const char *
+vsx_ws_parser_get_method (VsxWsParser *parser)
+{
+  return parser->method;
+}
+
+const char *
+vsx_ws_parser_get_uri (VsxWsParser *parser)
+{
+  return parser->uri;
+}
+
+bool
+vsx_ws_parser_has_protocol (VsxWsParser *parser,
+                            const char *protocol)
+{
+  if (parser->protocols == NULL)
+    return false;
+
+  size_t protocol_length = strlen (protocol);
+  const char *p = parser->protocols;
+
+  while (true)
+    {
+      while (*p == ' ' || *p == '\t')
+        p++;
+
+      const char *end = strchr (p, ',');
+
+      if (end == NULL)
+        end = p + strlen (p);
+
+      const char *token_end = end;
+
+      while (token_end > p && (token_end[-1] == ' ' || token_end[-1] == '\t'))
+        token_end--;
+
+      if (token_end - p == protocol_length
+          && !memcmp (p, protocol, protocol_length))
+        return true;
+
+      if (*end == '\0')
+        return false;
+
+      p = end + 1;
+    }
+}
+
+const char *
+vsx_ws_parser_get_extensions (VsxWsParser *parser)
+{
+  return parser->extensions;
+}
+
 void
 vsx_ws_parser_free (VsxWsParser *parser)
 {
   if (parser->key_hash_ctx)
     EVP_MD_CTX_free (parser->key_hash_ctx);
 
+  vsx_free (parser->method);
+  vsx_free (parser->uri);
+  vsx_free (parser->protocols);
+  vsx_free (parser->extensions);
+
   vsx_free (parser);
 }
@@ -20,6 +20,7 @@
 #define VSX_WS_PARSER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "vsx-error.h"
 
@@ -43,6 +44,15 @@ typedef enum
 
 VsxWsParser *vsx_ws_parser_new (void);
 
+/* By default it is an error if the request doesn’t have a
+ * Sec-WebSocket-Key header. This can be disabled in order to use the
+ * parser for plain HTTP requests. In that case the key hash will be
+ * empty if there was no key.
+ */
+void
+vsx_ws_parser_set_require_key (VsxWsParser *parser,
+                               bool require_key);
+
 VsxWsParserResult
 vsx_ws_parser_parse_data (VsxWsParser *parser,
                           const uint8_t *data,
@@ -54,6 +64,28 @@ const uint8_t *
 vsx_ws_parser_get_key_hash (VsxWsParser *parser,
                             size_t *key_hash_size);
 
+/* These return the method and the URI from the request line, or NULL
+ * if it hasn’t been parsed yet.
+ */
+const char *
+vsx_ws_parser_get_method (VsxWsParser *parser);
+
+const char *
+vsx_ws_parser_get_uri (VsxWsParser *parser);
+
+/* Returns whether the client listed protocol in one of its
+ * Sec-WebSocket-Protocol headers.
+ */
+bool
+vsx_ws_parser_has_protocol (VsxWsParser *parser,
+                            const char *protocol);
+
+/* Returns the values of all of the Sec-WebSocket-Extensions headers
+ * joined with commas, or NULL if the client didn’t send any.
+ */
+const char *
+vsx_ws_parser_get_extensions (VsxWsParser *parser);
+
 void vsx_ws_parser_free (VsxWsParser *parser);
 
 #endif /* VSX_WS_PARSER_H */
@@ -0,0 +1,88 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "vsx-ws-response.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "vsx-base64.h"
+#include "vsx-proto.h"
+
+static const char
+ws_header_prefix[] =
+  "HTTP/1.1 101 Switching Protocols\r\n"
+  "Upgrade: websocket\r\n"
+  "Connection: Upgrade\r\n"
+  "Sec-WebSocket-Accept: ";
+
+static const char
+ws_header_postfix[] = "\r\n\r\n";
+
+static const char
+ws_header_v2_postfix[] =
+  "\r\n"
+  "Sec-WebSocket-Protocol: " VSX_PROTO_V2_NAME "\r\n"
+  "\r\n";
+
+int
+vsx_ws_response_write (VsxWsParser *parser,
+                       bool v2,
+                       const char *extensions,
+                       uint8_t *buffer,
+                       size_t buffer_size)
+{
+  size_t key_hash_size;
+  const uint8_t *key_hash = vsx_ws_parser_get_key_hash (parser,
+                                                       &key_hash_size);
+
+  size_t base64_size_needed = VSX_BASE64_ENCODED_SIZE (key_hash_size);
+  const char *postfix = v2 ? ws_header_v2_postfix : ws_header_postfix;
+  size_t postfix_length = strlen (postfix);
+  size_t extensions_length = strlen (extensions);
+
+  if (base64_size_needed
+      + (sizeof ws_header_prefix) - 1
+      + extensions_length
+      + postfix_length
+      > buffer_size)
+    return -1;
+
+  uint8_t *p = buffer;
+
+  memcpy (p, ws_header_prefix, (sizeof ws_header_prefix) - 1);
+  p += (sizeof ws_header_prefix) - 1;
+
+  size_t encoded_size = vsx_base64_encode (key_hash,
+                                           key_hash_size,
+                                           (char *) p);
+
+  assert (encoded_size == base64_size_needed);
+
+  p += base64_size_needed;
+
+  memcpy (p, extensions, extensions_length);
+  p += extensions_length;
+
+  memcpy (p, postfix, postfix_length);
+  p += postfix_length;
+
+  return p - buffer;
+}
@@ -0,0 +1,42 @@
+/*
+ * Verda Ŝtelo - An anagram game in Esperanto for the web
+ * Copyright (C) 2026  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSX_WS_RESPONSE_H
+#define VSX_WS_RESPONSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "vsx-ws-parser.h"
+
+/* Writes the “101 Switching Protocols” response to a request that
+ * parser has finished parsing. If v2 is true then the response
+ * accepts the v2 protocol. extensions is added after the accept
+ * header in the format returned by vsx_deflate_get_response_header or
+ * can be an empty string. Returns the number of bytes written or -1
+ * if the response doesn’t fit in buffer_size.
+ */
+int
+vsx_ws_response_write (VsxWsParser *parser,
+                       bool v2,
+                       const char *extensions,
+                       uint8_t *buffer,
+                       size_t buffer_size);
+
+#endif /* VSX_WS_RESPONSE_H */